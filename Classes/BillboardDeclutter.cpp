@@ -0,0 +1,338 @@
+//
+//  BillboardDeclutter.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "BillboardDeclutter.h"
+
+#include <algorithm>
+#include <math.h>
+
+namespace unifeye
+{
+    namespace
+    {
+        const float PI = 3.14159265f;
+
+        // share of the height a billboard moves up per level once a stack exceeds maxPOIOverlap
+        const float OVERLAP_STEP = 0.1f;
+
+        // the grid covers the elevations up to this, stacks can grow above the zenith
+        const float MAX_ELEVATION = PI;
+
+        const int MAX_GRID_SIZE = 256;
+
+        inline float wrapAngle( float angle )
+        {
+            if (angle >= PI || angle < -PI)
+                angle -= 2.0f * PI * floorf((angle + PI) / (2.0f * PI));
+            return angle;
+        }
+
+        inline int clampIndex( int index, int count )
+        {
+            return index < 0 ? 0 : (index >= count ? count - 1 : index);
+        }
+    }
+
+    BillboardDeclutter::BillboardDeclutter( float _nearValue, float _farValue ) :
+        billboardCount(0), nearValue(_nearValue), farValue(_farValue), weight(10), expand(0.8f), strength(5),
+        maxPOIOverlap(10), relayoutDistance(0.0f), dirty(true), layoutCount(0), columns(0), rows(0),
+        cellWidth(0.0f), cellHeight(0.0f)
+    {
+        for (int i = 0; i < 3; i++)
+            camera[i] = layoutCamera[i] = 0.0f;
+    }
+
+    int BillboardDeclutter::addBillboard( const metaio::Vector3d& position, float width, float height )
+    {
+        int billboard;
+        if (freeIDs.empty())
+        {
+            billboard = (int)billboards.size();
+            billboards.push_back(Billboard());
+        }
+        else
+        {
+            billboard = freeIDs.back();
+            freeIDs.pop_back();
+        }
+
+        Billboard& added = billboards[billboard];
+        added.active = true;
+        added.lift = 0.0f;
+        billboardCount++;
+
+        setSize(billboard, width, height);
+        setPosition(billboard, position);
+        for (int i = 0; i < 3; i++)
+            added.placed[i] = added.position[i];
+        return billboard;
+    }
+
+    void BillboardDeclutter::removeBillboard( int billboard )
+    {
+        if (!billboards[billboard].active)
+            return;
+
+        billboards[billboard].active = false;
+        freeIDs.push_back(billboard);
+        billboardCount--;
+        dirty = true;
+    }
+
+    void BillboardDeclutter::setPosition( int billboard, const metaio::Vector3d& position )
+    {
+        Billboard& moved = billboards[billboard];
+        moved.position[0] = position.x;
+        moved.position[1] = position.y;
+        moved.position[2] = position.z;
+        dirty = true;
+    }
+
+    void BillboardDeclutter::setSize( int billboard, float width, float height )
+    {
+        billboards[billboard].width = width;
+        billboards[billboard].height = height;
+        dirty = true;
+    }
+
+    void BillboardDeclutter::setCameraPosition( const metaio::Vector3d& position )
+    {
+        camera[0] = position.x;
+        camera[1] = position.y;
+        camera[2] = position.z;
+
+        float dx = camera[0] - layoutCamera[0];
+        float dy = camera[1] - layoutCamera[1];
+        float dz = camera[2] - layoutCamera[2];
+        float moved = dx * dx + dy * dy + dz * dz;
+        if (moved > relayoutDistance * relayoutDistance)
+            dirty = true;
+    }
+
+    void BillboardDeclutter::setRelayoutDistance( float distance )
+    {
+        relayoutDistance = distance;
+    }
+
+    void BillboardDeclutter::setViewCompressionValues( float _nearValue, float _farValue )
+    {
+        nearValue = _nearValue;
+        farValue = _farValue;
+        dirty = true;
+    }
+
+    void BillboardDeclutter::setDistanceWeightFactor( int _weight )
+    {
+        weight = _weight;
+        dirty = true;
+    }
+
+    void BillboardDeclutter::setBillboardExpandFactors( float _expand, int _strength, int _maxPOIOverlap )
+    {
+        // the expansion is applied per update, only the overlap limit changes the stacks
+        expand = _expand;
+        strength = _strength;
+        if (_maxPOIOverlap != maxPOIOverlap)
+        {
+            maxPOIOverlap = _maxPOIOverlap;
+            dirty = true;
+        }
+    }
+
+    void BillboardDeclutter::update( const metaio::Vector3d& viewDirection, float fieldOfView )
+    {
+        if (dirty)
+            layout();
+
+        float viewAzimuth = atan2f(viewDirection.x, viewDirection.y);
+        float halfView = fieldOfView > 0.0f ? 0.5f * fieldOfView : PI;
+
+        for (size_t i = 0; i < billboards.size(); i++)
+        {
+            Billboard& billboard = billboards[i];
+            if (!billboard.active)
+                continue;
+
+            // fully expanded stacks in the center of the view, collapsing towards the edges
+            float offCenter = fabsf(wrapAngle(billboard.azimuth - viewAzimuth)) / halfView;
+            float expansion = offCenter < 1.0f ? expand * powf(1.0f - offCenter, (float)strength) : 0.0f;
+
+            float elevation = billboard.elevation + billboard.lift * expansion;
+            float horizontal = billboard.distance * cosf(elevation);
+            billboard.placed[0] = camera[0] + horizontal * sinf(billboard.azimuth);
+            billboard.placed[1] = camera[1] + horizontal * cosf(billboard.azimuth);
+            billboard.placed[2] = camera[2] + billboard.distance * sinf(elevation);
+        }
+    }
+
+    metaio::Vector3d BillboardDeclutter::getPosition( int billboard ) const
+    {
+        const float* placed = billboards[billboard].placed;
+        return metaio::Vector3d(placed[0], placed[1], placed[2]);
+    }
+
+    void BillboardDeclutter::layout()
+    {
+        dirty = false;
+        layoutCount++;
+        for (int i = 0; i < 3; i++)
+            layoutCamera[i] = camera[i];
+
+        // the nearest billboards keep their place, the ones behind them move up
+        order.clear();
+        float maxDistance = 0.0f;
+        for (size_t i = 0; i < billboards.size(); i++)
+        {
+            Billboard& billboard = billboards[i];
+            if (!billboard.active)
+                continue;
+
+            float dx = billboard.position[0] - camera[0];
+            float dy = billboard.position[1] - camera[1];
+            float dz = billboard.position[2] - camera[2];
+            billboard.range = sqrtf(dx * dx + dy * dy + dz * dz);
+            maxDistance = std::max(maxDistance, billboard.range);
+            order.push_back(std::make_pair(billboard.range, (int)i));
+        }
+        std::sort(order.begin(), order.end());
+
+        project(maxDistance);
+        buildGrid();
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            stack(order[i].second);
+            insert(order[i].second);
+        }
+    }
+
+    void BillboardDeclutter::project( float maxDistance )
+    {
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            Billboard& billboard = billboards[order[i].second];
+            float dx = billboard.position[0] - camera[0];
+            float dy = billboard.position[1] - camera[1];
+            float dz = billboard.position[2] - camera[2];
+
+            // pow(distance / maximum distance, weight) spread linearly over [near, far]
+            float ratio = maxDistance > 0.0f ? billboard.range / maxDistance : 1.0f;
+            billboard.distance = nearValue + (farValue - nearValue) * powf(ratio, (float)weight);
+
+            billboard.azimuth = billboard.range > 0.0f ? atan2f(dx, dy) : 0.0f;
+            billboard.elevation = billboard.range > 0.0f ? atan2f(dz, sqrtf(dx * dx + dy * dy)) : 0.0f;
+            billboard.halfWidth = atanf(0.5f * billboard.width / billboard.distance);
+            billboard.angularHeight = 2.0f * atanf(0.5f * billboard.height / billboard.distance);
+            billboard.lift = 0.0f;
+        }
+    }
+
+    void BillboardDeclutter::buildGrid()
+    {
+        // cells about the size of an average billboard
+        float meanWidth = 0.0f, meanHeight = 0.0f;
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            const Billboard& billboard = billboards[order[i].second];
+            meanWidth += 2.0f * billboard.halfWidth;
+            meanHeight += billboard.angularHeight;
+        }
+        if (!order.empty())
+        {
+            meanWidth /= order.size();
+            meanHeight /= order.size();
+        }
+
+        columns = meanWidth > 0.0f ? (int)ceilf(2.0f * PI / meanWidth) : 1;
+        rows = meanHeight > 0.0f ? (int)ceilf((MAX_ELEVATION + 0.5f * PI) / meanHeight) : 1;
+        columns = std::max(1, std::min(columns, MAX_GRID_SIZE));
+        rows = std::max(1, std::min(rows, MAX_GRID_SIZE));
+        cellWidth = 2.0f * PI / columns;
+        cellHeight = (MAX_ELEVATION + 0.5f * PI) / rows;
+
+        cells.assign(columns * rows, -1);
+        entries.clear();
+    }
+
+    void BillboardDeclutter::stack( int index )
+    {
+        Billboard& billboard = billboards[index];
+
+        int first = (int)floorf((billboard.azimuth - billboard.halfWidth + PI) / cellWidth);
+        int last = (int)floorf((billboard.azimuth + billboard.halfWidth + PI) / cellWidth);
+        if (last - first >= columns)
+            last = first + columns - 1;
+
+        for (int level = 0; ; level++)
+        {
+            float bottom = billboard.elevation + billboard.lift;
+            float top = bottom + billboard.angularHeight;
+            int lowest = clampIndex((int)floorf((bottom + 0.5f * PI) / cellHeight), rows);
+            int highest = clampIndex((int)floorf((top + 0.5f * PI) / cellHeight), rows);
+
+            // the highest top and bottom of the billboards this one covers
+            bool covered = false;
+            float maxTop = 0.0f, maxBottom = 0.0f;
+            for (int column = first; column <= last; column++)
+            {
+                int wrapped = ((column % columns) + columns) % columns;
+                for (int row = lowest; row <= highest; row++)
+                {
+                    for (int entry = cells[row * columns + wrapped]; entry >= 0; entry = entries[entry].next)
+                    {
+                        const Billboard& other = billboards[entries[entry].billboard];
+                        float otherBottom = other.elevation + other.lift;
+                        float otherTop = otherBottom + other.angularHeight;
+                        if (otherBottom >= top || bottom >= otherTop ||
+                            fabsf(wrapAngle(billboard.azimuth - other.azimuth)) >= billboard.halfWidth + other.halfWidth)
+                            continue;
+
+                        maxTop = covered ? std::max(maxTop, otherTop) : otherTop;
+                        maxBottom = covered ? std::max(maxBottom, otherBottom) : otherBottom;
+                        covered = true;
+                    }
+                }
+            }
+
+            if (!covered)
+                return;
+
+            if (level >= maxPOIOverlap)
+            {
+                // high stacks only show a strip of each billboard
+                billboard.lift = maxBottom + OVERLAP_STEP * billboard.angularHeight - billboard.elevation;
+                return;
+            }
+            billboard.lift = maxTop - billboard.elevation;
+        }
+    }
+
+    void BillboardDeclutter::insert( int index )
+    {
+        const Billboard& billboard = billboards[index];
+        float bottom = billboard.elevation + billboard.lift;
+        float top = bottom + billboard.angularHeight;
+
+        int first = (int)floorf((billboard.azimuth - billboard.halfWidth + PI) / cellWidth);
+        int last = (int)floorf((billboard.azimuth + billboard.halfWidth + PI) / cellWidth);
+        if (last - first >= columns)
+            last = first + columns - 1;
+        int lowest = clampIndex((int)floorf((bottom + 0.5f * PI) / cellHeight), rows);
+        int highest = clampIndex((int)floorf((top + 0.5f * PI) / cellHeight), rows);
+
+        for (int column = first; column <= last; column++)
+        {
+            int wrapped = ((column % columns) + columns) % columns;
+            for (int row = lowest; row <= highest; row++)
+            {
+                CellEntry entry;
+                entry.billboard = index;
+                entry.next = cells[row * columns + wrapped];
+                cells[row * columns + wrapped] = (int)entries.size();
+                entries.push_back(entry);
+            }
+        }
+    }
+}
@@ -0,0 +1,161 @@
+//
+//  BillboardDeclutter.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Arranges billboards around the camera so they don't overlap, with the
+//  parameters and the semantics of IUnifeyeBillboardGroup: the distances
+//  are first compressed into [near, far], then billboards that cover each
+//  other are stacked upwards, and the stacks are expanded the more the
+//  closer they are to the center of the view.
+//
+//  The stacking is done on the sphere around the camera (azimuth and
+//  elevation) instead of in clip space, so it stays valid while the camera
+//  only rotates; only the expansion, which depends on the view direction,
+//  is redone every frame. Overlaps are found with a uniform grid, which
+//  keeps a layout at O(n log n) instead of comparing all pairs.
+//
+#ifndef __UNIFEYE_BILLBOARDDECLUTTER_H__
+#define __UNIFEYE_BILLBOARDDECLUTTER_H__
+
+#include <utility>
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+namespace unifeye
+{
+    /**
+     * \brief Layout of billboards around the camera
+     *
+     * Positions are in world coordinates with z pointing up, sizes in the
+     * same unit as the positions.
+     */
+    class BillboardDeclutter
+    {
+    public:
+        BillboardDeclutter( float nearValue, float farValue );
+
+        /**
+         * \brief Add a billboard
+         * \param position position in world coordinates
+         * \param width width of the billboard
+         * \param height height of the billboard
+         * \return the ID of the billboard
+         */
+        int addBillboard( const metaio::Vector3d& position, float width, float height );
+
+        /// Remove a billboard, its ID can be reused
+        void removeBillboard( int billboard );
+
+        /// Move a billboard
+        void setPosition( int billboard, const metaio::Vector3d& position );
+
+        /// Resize a billboard
+        void setSize( int billboard, float width, float height );
+
+        /**
+         * \brief Move the camera
+         *
+         * Moves below the relayout distance keep the current stacks.
+         *
+         * \param position camera position in world coordinates
+         */
+        void setCameraPosition( const metaio::Vector3d& position );
+
+        /// Camera move that triggers a new layout, 0 lays out on every move
+        void setRelayoutDistance( float distance );
+
+        /// See IUnifeyeBillboardGroup::setViewCompressionValues
+        void setViewCompressionValues( float nearValue, float farValue );
+
+        /// See IUnifeyeBillboardGroup::setDistanceWeightFactor
+        void setDistanceWeightFactor( int weight );
+
+        /// See IUnifeyeBillboardGroup::setBillboardExpandFactors
+        void setBillboardExpandFactors( float expand, int strength, int maxPOIOverlap = 10 );
+
+        /**
+         * \brief Place the billboards for a view direction
+         *
+         * Stacks the billboards again if anything but the view direction
+         * changed since the last update, then expands the stacks.
+         *
+         * \param viewDirection direction the camera looks at, in world coordinates
+         * \param fieldOfView horizontal field of view in radians
+         */
+        void update( const metaio::Vector3d& viewDirection, float fieldOfView );
+
+        /// Position of a billboard after the last update, in world coordinates
+        metaio::Vector3d getPosition( int billboard ) const;
+
+        /// Height a billboard is lifted by when its stack is fully expanded, in radians
+        float getLift( int billboard ) const { return billboards[billboard].lift; }
+
+        /// Number of billboards
+        int getBillboardCount() const { return billboardCount; }
+
+        /// Number of layouts done so far, excluding updates of the expansion only
+        unsigned long getLayoutCount() const { return layoutCount; }
+
+    private:
+        struct Billboard
+        {
+            bool active;
+            float position[3];
+            float width, height;
+
+            // layout on the sphere around the camera
+            float range;        // distance to the camera
+            float distance;     // compressed distance
+            float azimuth;      // from north (y) towards east (x), [-pi, pi)
+            float elevation;
+            float halfWidth;    // angular half width
+            float angularHeight;
+            float lift;         // stack offset above the elevation
+
+            float placed[3];
+        };
+
+        struct CellEntry
+        {
+            int billboard;
+            int next;
+        };
+
+        BillboardDeclutter( const BillboardDeclutter& );
+        BillboardDeclutter& operator=( const BillboardDeclutter& );
+
+        void layout();
+        void project( float maxDistance );
+        void buildGrid();
+        void stack( int billboard );
+        void insert( int billboard );
+
+        std::vector<Billboard> billboards;
+        std::vector<int> freeIDs;
+        int billboardCount;
+
+        float nearValue, farValue;
+        int weight;
+        float expand;
+        int strength;
+        int maxPOIOverlap;
+
+        float camera[3];
+        float layoutCamera[3];
+        float relayoutDistance;
+        bool dirty;
+        unsigned long layoutCount;
+
+        std::vector<std::pair<float, int> > order;  // by distance to the camera
+
+        // grid over azimuth and elevation, with linked lists of the stacked billboards per cell
+        std::vector<int> cells;
+        std::vector<CellEntry> entries;
+        int columns, rows;
+        float cellWidth, cellHeight;
+    };
+}
+
+#endif
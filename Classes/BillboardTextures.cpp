@@ -0,0 +1,152 @@
+//
+//  BillboardTextures.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "BillboardTextures.h"
+
+#include <string.h>
+#include <UnifeyeSDKMobile/AS_IUnifeyeMobile.h>
+
+#include "ColorConvert.h"
+#include "ImageFormat.h"
+
+namespace unifeye
+{
+    namespace
+    {
+        std::string getTextureName( const std::string& id )
+        {
+            return "billboard-" + id;
+        }
+    }
+
+    BillboardTextures::BillboardTextures( metaio::IUnifeyeMobile* _unifeye ) :
+        unifeye(_unifeye), imageBytes(0), imageCount(0)
+    {
+    }
+
+    BillboardTextures::~BillboardTextures()
+    {
+        while (!billboards.empty())
+            releaseBillboard(billboards.begin()->first);
+    }
+
+    bool BillboardTextures::addImage( const std::string& id, const metaio::ImageStruct& image )
+    {
+        std::map<std::string, Image>::iterator found = images.find(id);
+        if (found != images.end())
+        {
+            found->second.references++;
+            return true;
+        }
+
+        if (!image.buffer || image.width <= 0 || image.height <= 0)
+            return false;
+
+        Image& entry = images[id];
+        entry.pixels.resize(getImageBufferSize(metaio::common::ECF_A8R8G8B8, image.width, image.height));
+        entry.width = image.width;
+        entry.height = image.height;
+        entry.references = 1;
+
+        // kept the way the SDK takes it, so a billboard needs no copy
+        if (image.colorFormat == metaio::common::ECF_A8R8G8B8 && image.originIsUpperLeft)
+        {
+            memcpy(&entry.pixels[0], image.buffer, entry.pixels.size());
+        }
+        else
+        {
+            metaio::ImageStruct target(&entry.pixels[0], image.width, image.height, metaio::common::ECF_A8R8G8B8, true);
+            if (!convertImage(image, target))
+            {
+                images.erase(id);
+                return false;
+            }
+        }
+
+        imageBytes += entry.pixels.size();
+        return true;
+    }
+
+    void BillboardTextures::removeImage( const std::string& id )
+    {
+        release(id);
+    }
+
+    bool BillboardTextures::hasImage( const std::string& id ) const
+    {
+        return images.find(id) != images.end();
+    }
+
+    metaio::IUnifeyeMobileGeometry* BillboardTextures::createBillboard( const std::string& id )
+    {
+        metaio::ImageStruct image;
+        if (!use(id, image))
+            return NULL;
+
+        metaio::IUnifeyeMobileGeometry* billboard = unifeye->loadImageBillboard(getTextureName(id), image);
+        if (!billboard)
+        {
+            release(id);
+            return NULL;
+        }
+
+        billboards[billboard] = id;
+        return billboard;
+    }
+
+    bool BillboardTextures::setImage( metaio::IUnifeyeMobileGeometry* billboard, const std::string& id )
+    {
+        std::map<metaio::IUnifeyeMobileGeometry*, std::string>::iterator found = billboards.find(billboard);
+        if (found == billboards.end())
+            return false;
+        if (found->second == id)
+            return true;
+
+        metaio::ImageStruct image;
+        if (!use(id, image))
+            return false;
+
+        billboard->setTexture(getTextureName(id), image, false);
+        release(found->second);
+        found->second = id;
+        return true;
+    }
+
+    void BillboardTextures::releaseBillboard( metaio::IUnifeyeMobileGeometry* billboard )
+    {
+        std::map<metaio::IUnifeyeMobileGeometry*, std::string>::iterator found = billboards.find(billboard);
+        if (found == billboards.end())
+            return;
+
+        unifeye->unloadGeometry(billboard);
+        release(found->second);
+        billboards.erase(found);
+    }
+
+    bool BillboardTextures::use( const std::string& id, metaio::ImageStruct& image )
+    {
+        // one reference per billboard, so the pixels outlive removeImage() while they are shown
+        std::map<std::string, Image>::iterator found = images.find(id);
+        if (found == images.end())
+            return false;
+
+        Image& entry = found->second;
+        entry.references++;
+        image = metaio::ImageStruct(&entry.pixels[0], entry.width, entry.height, metaio::common::ECF_A8R8G8B8, true);
+        imageCount++;
+        return true;
+    }
+
+    void BillboardTextures::release( const std::string& id )
+    {
+        std::map<std::string, Image>::iterator found = images.find(id);
+        if (found == images.end() || --found->second.references > 0)
+            return;
+
+        imageBytes -= found->second.pixels.size();
+        images.erase(found);
+    }
+}
@@ -0,0 +1,124 @@
+//
+//  BillboardTextures.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Image billboards from memory that share their textures. Images are
+//  registered once under an id chosen by the caller and kept converted to
+//  ARGB, one buffer per id, which is handed to the SDK as it is.
+//
+//  The SDK shares textures of the same name, so the texture is named after
+//  the id and POIs with the same icon end up with a single texture upload.
+//  It always maps the whole texture onto a billboard, so packing the images
+//  into atlas pages would only add the pages to the memory and a copy per
+//  billboard.
+//
+#ifndef __UNIFEYE_BILLBOARDTEXTURES_H__
+#define __UNIFEYE_BILLBOARDTEXTURES_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+namespace metaio
+{
+    class IUnifeyeMobile;           // forward declaration
+    class IUnifeyeMobileGeometry;   // forward declaration
+}
+
+namespace unifeye
+{
+    /**
+     * \brief Creates image billboards from images registered by id
+     */
+    class BillboardTextures
+    {
+    public:
+        /**
+         * \brief Constructor
+         * \param unifeye the SDK instance
+         */
+        explicit BillboardTextures( metaio::IUnifeyeMobile* unifeye );
+
+        /// Releases the billboards still alive
+        ~BillboardTextures();
+
+        /**
+         * \brief Register an image
+         *
+         * The pixels are copied, the image can be freed afterwards. Adding an
+         * id again only adds a reference, the image is not looked at.
+         *
+         * \param id name of the image, unique for its content
+         * \param image the image
+         * \return false if the image is empty or can not be converted to ARGB
+         */
+        bool addImage( const std::string& id, const metaio::ImageStruct& image );
+
+        /**
+         * \brief Drop the reference of addImage(), the pixels are freed once no billboard uses them
+         * \param id name of the image
+         */
+        void removeImage( const std::string& id );
+
+        /// true if an image of that id is registered
+        bool hasImage( const std::string& id ) const;
+
+        /**
+         * \brief Create a billboard showing a registered image
+         * \param id name of the image
+         * \return the billboard, NULL if the id is unknown or the SDK failed; release with releaseBillboard()
+         */
+        metaio::IUnifeyeMobileGeometry* createBillboard( const std::string& id );
+
+        /**
+         * \brief Show another registered image on a billboard
+         * \param billboard a billboard of createBillboard()
+         * \param id name of the image
+         * \return false if the id is unknown
+         */
+        bool setImage( metaio::IUnifeyeMobileGeometry* billboard, const std::string& id );
+
+        /**
+         * \brief Unload a billboard of createBillboard() and drop its image reference
+         * \param billboard the billboard
+         */
+        void releaseBillboard( metaio::IUnifeyeMobileGeometry* billboard );
+
+        /// Number of registered images
+        int getTextureCount() const { return (int)images.size(); }
+
+        /// Number of images handed to the SDK
+        unsigned long getImageCount() const { return imageCount; }
+
+        /// Number of billboards alive
+        int getBillboardCount() const { return (int)billboards.size(); }
+
+        /// Bytes of the registered images
+        size_t getImageBytes() const { return imageBytes; }
+
+    private:
+        BillboardTextures( const BillboardTextures& );
+        BillboardTextures& operator=( const BillboardTextures& );
+
+        struct Image
+        {
+            std::vector<unsigned char> pixels;  // ARGB
+            int width, height;
+            int references;                     // addImage() and the billboards showing it
+        };
+
+        bool use( const std::string& id, metaio::ImageStruct& image );
+        void release( const std::string& id );
+
+        metaio::IUnifeyeMobile* unifeye;
+        std::map<std::string, Image> images;
+        std::map<metaio::IUnifeyeMobileGeometry*, std::string> billboards;
+        size_t imageBytes;
+        unsigned long imageCount;
+    };
+}
+
+#endif
@@ -0,0 +1,293 @@
+//
+//  CallbackDispatcher.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "CallbackDispatcher.h"
+#include "CommandBuffer.h"
+#include "FrameScheduler.h"
+
+#include <string.h>
+
+namespace unifeye
+{
+    namespace
+    {
+        const char* CALLBACK_EVENT_NAMES[CALLBACK_EVENT_COUNT] = { "animationend", "cameraframe" };
+
+        // only the latest of these is delivered
+        inline bool isCoalesced( CALLBACK_EVENT type )
+        {
+            return type == CALLBACK_CAMERA_FRAME;
+        }
+    }
+
+    const char* getCallbackEventName( CALLBACK_EVENT type )
+    {
+        return type >= 0 && type < CALLBACK_EVENT_COUNT ? CALLBACK_EVENT_NAMES[type] : "unknown";
+    }
+
+    void CallbackEvent::setName( const char* value )
+    {
+        size_t length = strlen(value);
+        if (length >= (size_t)MAX_NAME)
+        {
+            // not in the middle of a UTF-8 sequence
+            length = MAX_NAME - 1;
+            while (length > 0 && (value[length] & 0xc0) == 0x80)
+                length--;
+        }
+        memcpy(name, value, length);
+        name[length] = 0;
+    }
+
+    CallbackDispatcher::CallbackDispatcher( ICallbackListener* _listener, IFrameClock* _clock, int capacity ) :
+        listener(_listener), clock(_clock), head(0), tail(0), posted(0), ignoredByProducer(0), dropped(0),
+        delivered(0), ignoredByConsumer(0), coalesced(0), totalLatency(0), maxLatency(0), sleeping(0), stopping(0),
+        threadRunning(false)
+    {
+        for (int i = 0; i < CALLBACK_EVENT_COUNT; i++)
+            listeners[i] = 0;
+
+        unsigned int size = 1;
+        while (size < (unsigned int)capacity)
+            size <<= 1;
+        events.resize(size);
+        mask = size - 1;
+    }
+
+    CallbackDispatcher::~CallbackDispatcher()
+    {
+        stop();
+    }
+
+    void CallbackDispatcher::setListenerCount( CALLBACK_EVENT type, int count )
+    {
+        atomicStore(&listeners[type], count);
+    }
+
+    bool CallbackDispatcher::isListening( CALLBACK_EVENT type ) const
+    {
+        return atomicLoad(const_cast<volatile int*>(&listeners[type])) > 0;
+    }
+
+    bool CallbackDispatcher::push( const CallbackEvent& event )
+    {
+        unsigned int written = head;
+        if (written - atomicLoad(&tail) >= events.size())
+        {
+            atomicStore(&dropped, dropped + 1);
+            return false;
+        }
+        events[written & mask] = event;
+        atomicStore(&head, written + 1);
+        return true;
+    }
+
+    bool CallbackDispatcher::post( const CallbackEvent& event )
+    {
+        if (!isListening(event.type))
+        {
+            atomicStore(&ignoredByProducer, ignoredByProducer + 1);
+            return false;
+        }
+        atomicStore(&posted, posted + 1);
+
+        CallbackEvent stamped = event;
+        stamped.timestamp = clock->now();
+        stamped.coalesced = 0;
+        if (!isCoalesced(event.type))
+        {
+            if (!push(stamped))
+                return false;
+            wake();
+            return true;
+        }
+
+        // replace the latest, carrying its number in coalesced
+        Latest& slot = latest[event.type];
+        stamped.coalesced = ++slot.posted;
+        atomicStore(&slot.version, slot.version + 1);
+        memoryBarrier();
+        slot.event = stamped;
+        atomicStore(&slot.version, slot.version + 1);
+
+        // while a marker is queued the consumer reads this one when it gets there
+        if (atomicLoad(&slot.queued))
+            return true;
+        atomicStore(&slot.queued, 1);
+        if (!push(stamped))
+        {
+            atomicStore(&slot.queued, 0);
+            return false;
+        }
+        wake();
+        return true;
+    }
+
+    bool CallbackDispatcher::readLatest( CALLBACK_EVENT type, CallbackEvent& event )
+    {
+        Latest& slot = latest[type];
+
+        // from here on the producer queues a new marker for a newer event
+        atomicStore(&slot.queued, 0);
+        memoryBarrier();
+
+        for (;;)
+        {
+            unsigned int version = atomicLoad(&slot.version);
+            if (version & 1)
+                continue;
+            event = slot.event;
+            memoryBarrier();
+            if (slot.version == version)
+                break;
+        }
+
+        // a marker queued while the previous one was read finds nothing new
+        unsigned int number = (unsigned int)event.coalesced;
+        if (number == slot.delivered)
+            return false;
+        event.coalesced = number - slot.delivered - 1;
+        slot.delivered = number;
+        return true;
+    }
+
+    void CallbackDispatcher::deliver( const CallbackEvent& event )
+    {
+        // listeners may have gone while it was queued
+        if (!isListening(event.type))
+        {
+            ScopedLock lock(statsMutex);
+            ignoredByConsumer++;
+            return;
+        }
+
+        listener->deliver(event);
+
+        double latency = clock->now() - event.timestamp;
+        ScopedLock lock(statsMutex);
+        delivered++;
+        totalLatency += latency;
+        if (latency > maxLatency)
+            maxLatency = latency;
+        coalesced += event.coalesced;
+    }
+
+    unsigned long CallbackDispatcher::dispatch()
+    {
+        unsigned long count = 0;
+        for (;;)
+        {
+            unsigned int read = tail;
+            if (read == atomicLoad(&head))
+                break;
+            CallbackEvent event = events[read & mask];
+            atomicStore(&tail, read + 1);
+
+            if (isCoalesced(event.type) && !readLatest(event.type, event))
+                continue;
+            deliver(event);
+            count++;
+        }
+        return count;
+    }
+
+    void CallbackDispatcher::wake()
+    {
+        // the consumer announces that it sleeps before it looks at the ring a last time
+        memoryBarrier();
+        if (!atomicLoad(&sleeping))
+            return;
+        ScopedLock lock(wakeMutex);
+        wakeCondition.signal();
+    }
+
+    void* CallbackDispatcher::dispatchThread( void* dispatcher )
+    {
+        CallbackDispatcher* self = static_cast<CallbackDispatcher*>(dispatcher);
+        for (;;)
+        {
+            self->dispatch();
+            if (atomicLoad(&self->stopping))
+                break;
+
+            ScopedLock lock(self->wakeMutex);
+            atomicStore(&self->sleeping, 1);
+            memoryBarrier();
+            if (self->tail == atomicLoad(&self->head) && !atomicLoad(&self->stopping))
+                self->wakeCondition.wait(self->wakeMutex);
+            atomicStore(&self->sleeping, 0);
+        }
+        self->dispatch();
+        return 0;
+    }
+
+    bool CallbackDispatcher::start()
+    {
+        if (threadRunning)
+            return true;
+        atomicStore(&stopping, 0);
+        threadRunning = pthread_create(&thread, 0, dispatchThread, this) == 0;
+        return threadRunning;
+    }
+
+    void CallbackDispatcher::stop()
+    {
+        if (!threadRunning)
+            return;
+        {
+            ScopedLock lock(wakeMutex);
+            atomicStore(&stopping, 1);
+            wakeCondition.signal();
+        }
+        pthread_join(thread, 0);
+        threadRunning = false;
+    }
+
+    CallbackStats CallbackDispatcher::getStats() const
+    {
+        CallbackStats stats;
+        stats.posted = atomicLoad(const_cast<volatile unsigned int*>(&posted));
+        stats.dropped = atomicLoad(const_cast<volatile unsigned int*>(&dropped));
+
+        ScopedLock lock(statsMutex);
+        stats.ignored = atomicLoad(const_cast<volatile unsigned int*>(&ignoredByProducer)) + ignoredByConsumer;
+        stats.delivered = delivered;
+        stats.coalesced = coalesced;
+        stats.meanLatency = delivered > 0 ? totalLatency / delivered : 0;
+        stats.maxLatency = maxLatency;
+        return stats;
+    }
+
+    UnifeyeCallbackAdapter::UnifeyeCallbackAdapter( CallbackDispatcher* _dispatcher, UnifeyeCommandTarget* _handles ) :
+        dispatcher(_dispatcher), handles(_handles), frameSequence(0)
+    {
+    }
+
+    void UnifeyeCallbackAdapter::onAnimationEnd( metaio::IUnifeyeMobileGeometry* geometry, std::string animationName )
+    {
+        if (!dispatcher->isListening(CALLBACK_ANIMATION_END))
+            return;
+
+        CallbackEvent event;
+        event.type = CALLBACK_ANIMATION_END;
+        event.handle = handles ? handles->findHandle(geometry) : 0;
+        event.setName(animationName.c_str());
+        dispatcher->post(event);
+    }
+
+    void UnifeyeCallbackAdapter::onNewCameraFrame( metaio::ImageStruct* cameraFrame )
+    {
+        if (!dispatcher->isListening(CALLBACK_CAMERA_FRAME))
+            return;
+
+        CallbackEvent event;
+        event.type = CALLBACK_CAMERA_FRAME;
+        event.width = cameraFrame->width;
+        event.height = cameraFrame->height;
+        event.frame = frameSequence;
+        dispatcher->post(event);
+    }
+}
@@ -0,0 +1,223 @@
+//
+//  CallbackDispatcher.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Moves the SDK callbacks off the render loop. onAnimationEnd and
+//  onNewCameraFrame arrive inside render(); firing Titanium events from
+//  there would stall the frame. The callback only posts a small event into
+//  a lock-free ring, a thread of its own delivers it to the listeners.
+//  Camera frame notifications are coalesced: while one is queued, newer
+//  ones replace it, so a slow listener only ever gets the latest. Events
+//  nobody listens to are not even queued.
+//
+#ifndef __UNIFEYE_CALLBACKDISPATCHER_H__
+#define __UNIFEYE_CALLBACKDISPATCHER_H__
+
+#include <pthread.h>
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+#include <UnifeyeSDKMobile/AS_IUnifeyeMobileCallback.h>
+
+#include "Threading.h"
+
+namespace unifeye
+{
+    class IFrameClock;              // forward declaration
+    class UnifeyeCommandTarget;     // forward declaration
+
+    /// The events of the SDK callbacks
+    enum CALLBACK_EVENT
+    {
+        CALLBACK_ANIMATION_END,     ///< an animation of a geometry ended, never coalesced
+        CALLBACK_CAMERA_FRAME,      ///< a requested camera frame arrived, only the latest is delivered
+        CALLBACK_EVENT_COUNT
+    };
+
+    /// Name of the Titanium event of a callback, "animationend" or "cameraframe"
+    const char* getCallbackEventName( CALLBACK_EVENT type );
+
+    /**
+     * \brief One SDK callback, copied so the producer never allocates
+     */
+    struct CallbackEvent
+    {
+        enum { MAX_NAME = 64 };
+
+        CALLBACK_EVENT type;
+        double timestamp;               ///< seconds, when it was posted
+        int handle;                     ///< animation end: handle of the geometry, 0 if it has none
+        char name[MAX_NAME];            ///< animation end: the animation, truncated
+        int width, height;              ///< camera frame: its size
+        unsigned long frame;            ///< camera frame: its sequence in the CameraFrameRing
+        unsigned long coalesced;        ///< on delivery, older events of the type this one replaced
+
+        CallbackEvent() : type(CALLBACK_ANIMATION_END), timestamp(0), handle(0), width(0), height(0),
+            frame(0), coalesced(0) { name[0] = 0; }
+
+        /// Copy a UTF-8 name, truncated to fit
+        void setName( const char* value );
+    };
+
+    /**
+     * \brief Receives the events on the thread of the dispatcher
+     */
+    class ICallbackListener
+    {
+    public:
+        virtual ~ICallbackListener() {};
+
+        virtual void deliver( const CallbackEvent& event ) = 0;
+    };
+
+    /**
+     * \brief Counters of a CallbackDispatcher
+     */
+    struct CallbackStats
+    {
+        unsigned long posted;           ///< events posted while someone listened
+        unsigned long ignored;          ///< events posted or due while nobody listened
+        unsigned long coalesced;        ///< camera frames replaced by a newer one before delivery
+        unsigned long dropped;          ///< events lost because the ring was full
+        unsigned long delivered;        ///< events passed to the listener
+        double meanLatency;             ///< seconds from post to delivery
+        double maxLatency;
+
+        CallbackStats() : posted(0), ignored(0), coalesced(0), dropped(0), delivered(0),
+            meanLatency(0), maxLatency(0) {};
+    };
+
+    /**
+     * \brief Single producer, single consumer hand over of callback events
+     *
+     * post() is called by the thread of the callbacks and never blocks on
+     * the listener; dispatch() delivers on the consumer thread, the one of
+     * start() or the caller's. setListenerCount() may be called from any
+     * thread.
+     */
+    class CallbackDispatcher
+    {
+    public:
+        /// Default number of events the ring holds
+        enum { DEFAULT_CAPACITY = 64 };
+
+        /**
+         * \brief Constructor
+         * \param listener receives the events, not owned
+         * \param clock stamps the events, not owned
+         * \param capacity events queued at most, rounded up to a power of two
+         */
+        CallbackDispatcher( ICallbackListener* listener, IFrameClock* clock, int capacity = DEFAULT_CAPACITY );
+
+        /// Stops the thread
+        ~CallbackDispatcher();
+
+        /// Number of listeners of a type, as Titanium counts them; 0 stops posting it
+        void setListenerCount( CALLBACK_EVENT type, int count );
+
+        /// Whether anyone listens, to skip the work of an event nobody wants
+        bool isListening( CALLBACK_EVENT type ) const;
+
+        /**
+         * \brief Queue an event, producer thread only
+         * \param event the event, its timestamp is set
+         * \return false if nobody listens or the ring was full
+         */
+        bool post( const CallbackEvent& event );
+
+        /**
+         * \brief Deliver the queued events, consumer thread only
+         * \return the number of events delivered
+         */
+        unsigned long dispatch();
+
+        /// Start a thread that delivers the events as they come
+        bool start();
+
+        /// Stop the thread, after it delivered what is queued
+        void stop();
+
+        CallbackStats getStats() const;
+
+    private:
+        CallbackDispatcher( const CallbackDispatcher& );
+        CallbackDispatcher& operator=( const CallbackDispatcher& );
+
+        static void* dispatchThread( void* dispatcher );
+        bool push( const CallbackEvent& event );
+        bool readLatest( CALLBACK_EVENT type, CallbackEvent& event );
+        void deliver( const CallbackEvent& event );
+        void wake();
+
+        // the latest event of a coalesced type, written under a version
+        // that is odd while the producer writes
+        struct Latest
+        {
+            volatile unsigned int version;
+            volatile int queued;        // a marker for it is in the ring
+            unsigned int posted;        // events written, by the producer
+            unsigned int delivered;     // the posted count of the last one delivered, by the consumer
+            CallbackEvent event;
+
+            Latest() : version(0), queued(0), posted(0), delivered(0) {};
+        };
+
+        ICallbackListener* listener;
+        IFrameClock* clock;
+        volatile int listeners[CALLBACK_EVENT_COUNT];
+
+        std::vector<CallbackEvent> events;
+        unsigned int mask;
+        volatile unsigned int head;     // events ever pushed, written by the producer
+        volatile unsigned int tail;     // events ever popped, written by the consumer
+        Latest latest[CALLBACK_EVENT_COUNT];
+
+        // the producer's counters, and the consumer's
+        volatile unsigned int posted, ignoredByProducer, dropped;
+        unsigned long delivered, ignoredByConsumer, coalesced;
+        double totalLatency, maxLatency;
+        mutable Mutex statsMutex;       // the consumer's counters
+
+        Mutex wakeMutex;
+        Condition wakeCondition;
+        volatile int sleeping;
+        volatile int stopping;
+        pthread_t thread;
+        bool threadRunning;
+    };
+
+    /**
+     * \brief Posts the callbacks of an SDK instance to a dispatcher
+     *
+     * Register it with registerCallback(), or forward the calls of the
+     * UnifeyeMobileDelegate to it.
+     */
+    class UnifeyeCallbackAdapter : public metaio::IUnifeyeMobileCallback
+    {
+    public:
+        /**
+         * \brief Constructor
+         * \param dispatcher the dispatcher, not owned
+         * \param handles finds the handles of geometries, not owned, may be NULL;
+         *                only used on the thread of the callbacks
+         */
+        UnifeyeCallbackAdapter( CallbackDispatcher* dispatcher, UnifeyeCommandTarget* handles );
+
+        /// The sequence of the next camera frame, set before onNewCameraFrame()
+        void setFrameSequence( unsigned long sequence ) { frameSequence = sequence; }
+
+        virtual void onAnimationEnd( metaio::IUnifeyeMobileGeometry* geometry, std::string animationName );
+        virtual void onNewCameraFrame( metaio::ImageStruct* cameraFrame );
+
+    private:
+        UnifeyeCallbackAdapter( const UnifeyeCallbackAdapter& );
+        UnifeyeCallbackAdapter& operator=( const UnifeyeCallbackAdapter& );
+
+        CallbackDispatcher* dispatcher;
+        UnifeyeCommandTarget* handles;
+        unsigned long frameSequence;
+    };
+}
+
+#endif
@@ -0,0 +1,217 @@
+//
+//  CameraFrameRing.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "CameraFrameRing.h"
+#include "ImageFormat.h"
+
+#include <string.h>
+
+namespace unifeye
+{
+    struct CameraFrameLease::Slot
+    {
+        unsigned char* buffer;
+        size_t capacity;
+        metaio::ImageStruct image;
+        double timestamp;
+        unsigned long sequence;     // 0 while empty or being written
+        bool leased;                // leased at least once since it was written
+        volatile int refs;
+    };
+
+
+    CameraFrameLease::CameraFrameLease() : slot(0)
+    {
+    }
+
+    CameraFrameLease::CameraFrameLease( Slot* _slot ) : slot(_slot)
+    {
+        // the ring took the reference for us
+    }
+
+    CameraFrameLease::CameraFrameLease( const CameraFrameLease& other ) : slot(other.slot)
+    {
+        if (slot)
+            atomicIncrement(&slot->refs);
+    }
+
+    CameraFrameLease& CameraFrameLease::operator=( const CameraFrameLease& other )
+    {
+        if (other.slot)
+            atomicIncrement(&other.slot->refs);
+        release();
+        slot = other.slot;
+        return *this;
+    }
+
+    CameraFrameLease::~CameraFrameLease()
+    {
+        release();
+    }
+
+    void CameraFrameLease::release()
+    {
+        if (slot)
+        {
+            atomicDecrement(&slot->refs);
+            slot = 0;
+        }
+    }
+
+    const metaio::ImageStruct& CameraFrameLease::getImage() const
+    {
+        static const metaio::ImageStruct empty;
+        return slot ? slot->image : empty;
+    }
+
+    double CameraFrameLease::getTimestamp() const
+    {
+        return slot ? slot->timestamp : 0.0;
+    }
+
+    unsigned long CameraFrameLease::getSequence() const
+    {
+        return slot ? slot->sequence : 0;
+    }
+
+
+    CameraFrameRing::CameraFrameRing( int capacity, int width, int height, metaio::common::ECOLOR_FORMAT format ) :
+        sequence(0)
+    {
+        if (capacity < 2)
+            capacity = 2;
+
+        size_t size = getImageBufferSize(format, width, height);
+        for (int i = 0; i < capacity; i++)
+        {
+            CameraFrameLease::Slot* slot = new CameraFrameLease::Slot();
+            slot->buffer = size ? new unsigned char[size] : 0;
+            slot->capacity = size;
+            slot->timestamp = 0;
+            slot->sequence = 0;
+            slot->leased = false;
+            slot->refs = 0;
+            slots.push_back(slot);
+        }
+    }
+
+    CameraFrameRing::~CameraFrameRing()
+    {
+        // all leases must have been released by now
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            delete[] slots[i]->buffer;
+            delete slots[i];
+        }
+    }
+
+    bool CameraFrameRing::push( const metaio::ImageStruct& frame, double timestamp )
+    {
+        size_t size = getImageBufferSize(frame);
+        if (!frame.buffer || !size)
+            return false;
+
+        CameraFrameLease::Slot* target = 0;
+        {
+            ScopedLock lock(mutex);
+
+            // the oldest frame nobody is reading is overwritten
+            for (size_t i = 0; i < slots.size(); i++)
+            {
+                CameraFrameLease::Slot* slot = slots[i];
+                if (atomicLoad(&slot->refs) != 0)
+                    continue;
+                if (!target || slot->sequence < target->sequence)
+                    target = slot;
+            }
+
+            if (!target)
+            {
+                stats.framesRejected++;
+                return false;
+            }
+
+            if (target->sequence && !target->leased)
+                stats.framesOverwritten++;
+
+            // hide the slot from readers while it is written
+            target->sequence = 0;
+        }
+
+        bool reallocated = size > target->capacity;
+        if (reallocated)
+        {
+            delete[] target->buffer;
+            target->buffer = new unsigned char[size];
+            target->capacity = size;
+        }
+
+        memcpy(target->buffer, frame.buffer, size);
+        target->image = frame;
+        target->image.buffer = target->buffer;
+        target->timestamp = timestamp;
+
+        ScopedLock lock(mutex);
+        target->leased = false;
+        target->sequence = ++sequence;
+        stats.framesPushed++;
+        if (reallocated)
+            stats.reallocations++;
+        return true;
+    }
+
+    CameraFrameLease CameraFrameRing::acquireLatest()
+    {
+        ScopedLock lock(mutex);
+
+        CameraFrameLease::Slot* found = 0;
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            CameraFrameLease::Slot* slot = slots[i];
+            if (slot->sequence && (!found || slot->sequence > found->sequence))
+                found = slot;
+        }
+
+        if (!found)
+            return CameraFrameLease();
+
+        atomicIncrement(&found->refs);
+        found->leased = true;
+        return CameraFrameLease(found);
+    }
+
+    CameraFrameLease CameraFrameRing::acquireNext( unsigned long last )
+    {
+        ScopedLock lock(mutex);
+
+        CameraFrameLease::Slot* found = 0;
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            CameraFrameLease::Slot* slot = slots[i];
+            if (slot->sequence > last && (!found || slot->sequence < found->sequence))
+                found = slot;
+        }
+
+        if (!found)
+            return CameraFrameLease();
+
+        atomicIncrement(&found->refs);
+        found->leased = true;
+        return CameraFrameLease(found);
+    }
+
+    unsigned long CameraFrameRing::getLatestSequence()
+    {
+        ScopedLock lock(mutex);
+        return sequence;
+    }
+
+    CameraFrameRingStats CameraFrameRing::getStats()
+    {
+        ScopedLock lock(mutex);
+        return stats;
+    }
+}
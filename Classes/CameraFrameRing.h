@@ -0,0 +1,139 @@
+//
+//  CameraFrameRing.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Fixed capacity ring of preallocated camera frames. The camera callback
+//  copies each frame once into a free slot; readers hold ref-counted leases
+//  on the slots and never copy again.
+//
+#ifndef __UNIFEYE_CAMERAFRAMERING_H__
+#define __UNIFEYE_CAMERAFRAMERING_H__
+
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+#include "Threading.h"
+
+namespace unifeye
+{
+    class CameraFrameRing;
+
+    /**
+     * \brief Read access to one frame of a CameraFrameRing
+     *
+     * The frame is not overwritten while at least one lease on it exists.
+     * Copying a lease adds a reference, it does not copy the pixels.
+     */
+    class CameraFrameLease
+    {
+    public:
+        CameraFrameLease();
+        CameraFrameLease( const CameraFrameLease& other );
+        CameraFrameLease& operator=( const CameraFrameLease& other );
+        ~CameraFrameLease();
+
+        /// True if the lease refers to a frame
+        bool isValid() const { return slot != 0; }
+
+        /// The frame, the buffer belongs to the ring
+        const metaio::ImageStruct& getImage() const;
+
+        /// Time stamp passed to CameraFrameRing::push
+        double getTimestamp() const;
+
+        /// Sequence number of the frame, starting at 1
+        unsigned long getSequence() const;
+
+        /// Give up the frame before the lease is destroyed
+        void release();
+
+    private:
+        friend class CameraFrameRing;
+        struct Slot;
+
+        explicit CameraFrameLease( Slot* _slot );
+
+        Slot* slot;
+    };
+
+    /**
+     * \brief Counters of a CameraFrameRing
+     */
+    struct CameraFrameRingStats
+    {
+        unsigned long framesPushed;     ///< frames copied into the ring
+        unsigned long framesRejected;   ///< frames not copied because all slots were leased
+        unsigned long framesOverwritten;///< frames overwritten before anybody leased them
+        unsigned long reallocations;    ///< slots that had to grow for a larger frame
+
+        CameraFrameRingStats() : framesPushed(0), framesRejected(0), framesOverwritten(0), reallocations(0) {};
+    };
+
+    /**
+     * \brief Ring of camera frames shared by any number of readers
+     *
+     * push() is called by a single producer (the camera callback), leases can
+     * be taken and released from any thread.
+     */
+    class CameraFrameRing
+    {
+    public:
+        /**
+         * \brief Constructor, allocates all slots upfront
+         * \param capacity number of frames in the ring, at least 2
+         * \param width expected width of the frames
+         * \param height expected height of the frames
+         * \param format expected color format of the frames
+         */
+        CameraFrameRing( int capacity, int width, int height, metaio::common::ECOLOR_FORMAT format );
+        ~CameraFrameRing();
+
+        /**
+         * \brief Copy a frame into the oldest slot nobody holds a lease on
+         * \param frame the frame as delivered by the SDK
+         * \param timestamp capture time of the frame in seconds
+         * \return false if the frame was dropped because every slot is leased
+         */
+        bool push( const metaio::ImageStruct& frame, double timestamp );
+
+        /**
+         * \brief Lease the most recent frame
+         *
+         * When every other slot is leased the newest frame is the one written
+         * next; while that happens an older frame is returned, readers compare
+         * the sequence with the one they saw last.
+         *
+         * \return a lease, invalid if no frame was pushed yet
+         */
+        CameraFrameLease acquireLatest();
+
+        /**
+         * \brief Lease the oldest frame newer than a given one
+         *
+         * Readers that want every frame pass the sequence of the frame they saw
+         * last. If they fell behind, the frames in between have been dropped.
+         *
+         * \param sequence the sequence of the last frame seen, 0 for none
+         * \return a lease, invalid if there is no newer frame
+         */
+        CameraFrameLease acquireNext( unsigned long sequence );
+
+        /// Sequence of the most recent frame, 0 if none
+        unsigned long getLatestSequence();
+
+        CameraFrameRingStats getStats();
+
+    private:
+        CameraFrameRing( const CameraFrameRing& );
+        CameraFrameRing& operator=( const CameraFrameRing& );
+
+        std::vector<CameraFrameLease::Slot*> slots;
+        unsigned long sequence;
+        CameraFrameRingStats stats;
+        Mutex mutex;
+    };
+}
+
+#endif
@@ -0,0 +1,299 @@
+//
+//  CaptureResolution.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "CaptureResolution.h"
+
+#include <math.h>
+#include <UnifeyeSDKMobile/AS_IUnifeyeMobile.h>
+
+namespace unifeye
+{
+    namespace
+    {
+        // the presets of the iOS cameras, the SDK picks the closest one
+        const int DEFAULT_RESOLUTIONS[][2] = { { 192, 144 }, { 320, 240 }, { 480, 360 }, { 640, 480 }, { 1280, 720 } };
+        const int DEFAULT_START = 2;
+
+        // time constant of the measured rate and cost in seconds
+        const double SMOOTHING = 1.0;
+
+        // the longest a resolution that fell behind is left alone
+        const double MAX_BACKOFF = 600.0;
+    }
+
+    metaio::Vector2di getLargestCaptureResolution()
+    {
+        const int* largest = DEFAULT_RESOLUTIONS[sizeof(DEFAULT_RESOLUTIONS) / sizeof(DEFAULT_RESOLUTIONS[0]) - 1];
+        return metaio::Vector2di(largest[0], largest[1]);
+    }
+
+    metaio::Vector2di UnifeyeCaptureCamera::activate( int width, int height )
+    {
+        return unifeye->activateCamera(cameraIndex, width, height);
+    }
+
+    void UnifeyeCaptureCamera::stop()
+    {
+        unifeye->stopCamera();
+    }
+
+    const char* getCaptureReasonName( CAPTURE_REASON reason )
+    {
+        switch (reason)
+        {
+            case CAPTURE_REASON_START: return "start";
+            case CAPTURE_REASON_PROFILE: return "profile";
+            case CAPTURE_REASON_OVERLOAD: return "overload";
+            case CAPTURE_REASON_HEADROOM: return "headroom";
+            case CAPTURE_REASON_FIXED: return "fixed";
+            case CAPTURE_REASON_FAILED: return "failed";
+            default: return "unknown";
+        }
+    }
+
+    CaptureResolutionManager::CaptureResolutionManager( ICaptureCamera* _camera ) :
+        camera(_camera), index(0), reason(CAPTURE_REASON_START), running(false), profiling(true), switches(0),
+        failures(0), lastFrameRate(0)
+    {
+        std::vector<metaio::Vector2di> defaults;
+        for (size_t i = 0; i < sizeof(DEFAULT_RESOLUTIONS) / sizeof(DEFAULT_RESOLUTIONS[0]); i++)
+            defaults.push_back(metaio::Vector2di(DEFAULT_RESOLUTIONS[i][0], DEFAULT_RESOLUTIONS[i][1]));
+        setResolutions(defaults, DEFAULT_START);
+        restartMeasurement(0);
+    }
+
+    void CaptureResolutionManager::setParameters( const CaptureParameters& _parameters )
+    {
+        parameters = _parameters;
+        backoffs.assign(resolutions.size(), parameters.backoff);
+    }
+
+    void CaptureResolutionManager::setResolutions( const std::vector<metaio::Vector2di>& _resolutions, int startIndex )
+    {
+        if (_resolutions.empty())
+            return;
+
+        resolutions = _resolutions;
+        blockedUntil.assign(resolutions.size(), -1.0);
+        backoffs.assign(resolutions.size(), parameters.backoff);
+        index = startIndex < 0 ? 0 : startIndex >= (int)resolutions.size() ? (int)resolutions.size() - 1 : startIndex;
+        profiling = true;
+    }
+
+    bool CaptureResolutionManager::setFixedResolution( const metaio::Vector2di& resolution )
+    {
+        if (resolution.x == fixed.x && resolution.y == fixed.y)
+            return true;
+        metaio::Vector2di previousFixed = fixed;
+        bool previousProfiling = profiling;
+        CAPTURE_REASON previousReason = reason;
+        fixed = resolution;
+
+        // back to automatic, measure again from where we are
+        if (fixed.isNull())
+            profiling = true;
+        if (!running)
+            return true;
+
+        switches++;
+        if (activate(index, lastUpdate, fixed.isNull() ? CAPTURE_REASON_START : CAPTURE_REASON_FIXED))
+            return true;
+
+        failures++;
+        fixed = previousFixed;
+        profiling = previousProfiling;
+        running = activate(index, lastUpdate, previousReason);
+        if (running)
+            reason = CAPTURE_REASON_FAILED;
+        return false;
+    }
+
+    metaio::Vector2di CaptureResolutionManager::getResolution() const
+    {
+        return fixed.isNull() ? resolutions[index] : fixed;
+    }
+
+    double CaptureResolutionManager::getPixels( int i ) const
+    {
+        return (double)resolutions[i].x * resolutions[i].y;
+    }
+
+    bool CaptureResolutionManager::activate( int _index, double time, CAPTURE_REASON _reason )
+    {
+        index = _index;
+        reason = _reason;
+        metaio::Vector2di resolution = getResolution();
+        actual = camera->activate(resolution.x, resolution.y);
+        restartMeasurement(time);
+        return !actual.isNull();
+    }
+
+    void CaptureResolutionManager::switchTo( int next, double time, CAPTURE_REASON nextReason )
+    {
+        int previous = index;
+        switches++;
+        if (activate(next, time, nextReason))
+            return;
+
+        // not tried again before the back-off, like a resolution the tracking fell behind at
+        failures++;
+        block(next, time);
+        running = activate(previous, time, CAPTURE_REASON_FAILED);
+    }
+
+    void CaptureResolutionManager::block( int i, double time )
+    {
+        blockedUntil[i] = time + backoffs[i];
+        backoffs[i] = backoffs[i] * 2 < MAX_BACKOFF ? backoffs[i] * 2 : MAX_BACKOFF;
+    }
+
+    bool CaptureResolutionManager::start( double time )
+    {
+        if (running)
+            return true;
+
+        CAPTURE_REASON startReason = !fixed.isNull() ? CAPTURE_REASON_FIXED : profiling ? CAPTURE_REASON_START : reason;
+        running = activate(index, time, startReason);
+        return running;
+    }
+
+    void CaptureResolutionManager::stop()
+    {
+        if (!running)
+            return;
+        camera->stop();
+        running = false;
+    }
+
+    void CaptureResolutionManager::restartMeasurement( double time )
+    {
+        measureStart = time;
+        lastUpdate = time;
+        rateSum = costSum = 0;
+        rateCount = costCount = 0;
+        meanRate = 0;
+        meanCost = 0;
+        behindSince = -1.0;
+        roomSince = -1.0;
+    }
+
+    int CaptureResolutionManager::choose( double costPerPixel, float wantedRate ) const
+    {
+        // the largest resolution predicted to fit, scaling the cost with the pixels
+        int best = 0;
+        for (int i = 0; i < (int)resolutions.size(); i++)
+        {
+            if (costPerPixel * getPixels(i) <= parameters.headroom / wantedRate)
+                best = i;
+        }
+        return best;
+    }
+
+    bool CaptureResolutionManager::update( double time, float trackingFrameRate, double trackingCost, float frameRate )
+    {
+        if (!running)
+            return false;
+
+        // a pause (frozen tracking) or another frame rate makes the means useless
+        if (frameRate != lastFrameRate || time - lastUpdate > parameters.settleTime)
+            restartMeasurement(time);
+        lastFrameRate = frameRate;
+        double dt = time - lastUpdate;
+        lastUpdate = time;
+        if (time - measureStart < parameters.settleTime)
+            return false;
+
+        rateSum += trackingFrameRate;
+        rateCount++;
+        double alpha = rateCount == 1 ? 1.0 : 1.0 - exp(-dt / SMOOTHING);
+        meanRate += (float)(alpha * (trackingFrameRate - meanRate));
+        if (trackingCost > 0)
+        {
+            costSum += trackingCost;
+            costCount++;
+            meanCost = costCount == 1 ? trackingCost : meanCost + alpha * (trackingCost - meanCost);
+        }
+
+        if (!fixed.isNull())
+            return false;
+
+        // the tracking can not be faster than the frames, the budget is that of the target rate though
+        float targetRate = parameters.targetTrackingRate;
+        float wantedRate = frameRate > 0 && frameRate < targetRate ? frameRate : targetRate;
+
+        if (profiling)
+        {
+            if (time - measureStart < parameters.settleTime + parameters.profileTime)
+                return false;
+            profiling = false;
+
+            // a resolution that keeps up is kept even if it would not be chosen
+            bool keepsUp = rateSum / rateCount >= wantedRate * parameters.overloadRatio;
+            int next = index;
+            if (costCount > 0)
+            {
+                next = choose(costSum / costCount / getPixels(index), targetRate);
+                if (next < index && keepsUp)
+                    next = index;
+            }
+            else if (!keepsUp && index > 0)
+            {
+                next = index - 1;
+            }
+
+            reason = CAPTURE_REASON_PROFILE;
+            if (next == index)
+                return false;
+            switchTo(next, time, CAPTURE_REASON_PROFILE);
+            return true;
+        }
+
+        if (meanRate < wantedRate * parameters.overloadRatio)
+        {
+            if (behindSince < 0)
+                behindSince = time;
+        }
+        else
+        {
+            behindSince = -1.0;
+        }
+
+        if (behindSince >= 0 && time - behindSince >= parameters.overloadDelay && index > 0)
+        {
+            // do not come straight back to where the tracking fell behind
+            block(index, time);
+            switchTo(index - 1, time, CAPTURE_REASON_OVERLOAD);
+            return true;
+        }
+
+        // only the cost tells if there is room, the rate is capped by the camera
+        bool room = behindSince < 0 && costCount > 0 && index + 1 < (int)resolutions.size() &&
+            time >= blockedUntil[index + 1] &&
+            meanCost * getPixels(index + 1) / getPixels(index) <= parameters.headroom / targetRate;
+        if (!room)
+        {
+            roomSince = -1.0;
+            return false;
+        }
+        if (roomSince < 0)
+            roomSince = time;
+        if (time - roomSince < parameters.headroomDelay)
+            return false;
+
+        switchTo(index + 1, time, CAPTURE_REASON_HEADROOM);
+        return true;
+    }
+
+    CaptureStats CaptureResolutionManager::getStats() const
+    {
+        CaptureStats stats;
+        stats.switches = switches;
+        stats.failures = failures;
+        stats.trackingRate = meanRate;
+        stats.trackingCost = meanCost;
+        return stats;
+    }
+}
@@ -0,0 +1,223 @@
+//
+//  CaptureResolution.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Picks the camera resolution the tracking can keep up with. The cost of
+//  a tracked frame is measured at startup and scaled by the pixel count to
+//  find the largest resolution that fits the frame budget; afterwards the
+//  camera is only restarted when the tracking falls behind, or has room
+//  for more, for several seconds in a row.
+//
+//  The camera is only reached through ICaptureCamera, so the policy can be
+//  exercised with a stub camera and any cost per resolution.
+//
+#ifndef __UNIFEYE_CAPTURERESOLUTION_H__
+#define __UNIFEYE_CAPTURERESOLUTION_H__
+
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+namespace metaio
+{
+    class IUnifeyeMobile;   // forward declaration
+}
+
+namespace unifeye
+{
+    /**
+     * \brief Starts and stops the camera for a CaptureResolutionManager
+     */
+    class ICaptureCamera
+    {
+    public:
+        virtual ~ICaptureCamera() {};
+
+        /**
+         * \brief Start capturing, restarting the camera if it runs
+         * \return the actual resolution, a null vector on failure
+         */
+        virtual metaio::Vector2di activate( int width, int height ) = 0;
+
+        virtual void stop() = 0;
+    };
+
+    /**
+     * \brief ICaptureCamera on top of an SDK instance
+     */
+    class UnifeyeCaptureCamera : public ICaptureCamera
+    {
+    public:
+        UnifeyeCaptureCamera( metaio::IUnifeyeMobile* _unifeye, int _cameraIndex = 0 ) :
+            unifeye(_unifeye), cameraIndex(_cameraIndex) {};
+
+        virtual metaio::Vector2di activate( int width, int height );
+        virtual void stop();
+
+    private:
+        metaio::IUnifeyeMobile* unifeye;
+        int cameraIndex;
+    };
+
+    /// Why a CaptureResolutionManager chose its resolution
+    enum CAPTURE_REASON
+    {
+        CAPTURE_REASON_START,           ///< the start resolution, before profiling
+        CAPTURE_REASON_PROFILE,         ///< chosen from the cost measured at startup
+        CAPTURE_REASON_OVERLOAD,        ///< the tracking fell behind at the larger one
+        CAPTURE_REASON_HEADROOM,        ///< the tracking had room for the larger one
+        CAPTURE_REASON_FIXED,           ///< set with setFixedResolution()
+        CAPTURE_REASON_FAILED           ///< the camera could not start the one asked for, this is the one before
+    };
+
+    /// Name of a reason for logs and events
+    const char* getCaptureReasonName( CAPTURE_REASON reason );
+
+    /// The largest of the resolutions a CaptureResolutionManager chooses from by default, to size frame buffers
+    metaio::Vector2di getLargestCaptureResolution();
+
+    /**
+     * \brief Parameters of the CaptureResolutionManager
+     */
+    struct CaptureParameters
+    {
+        float targetTrackingRate;       ///< tracked frames per second to reach
+        float headroom;                 ///< share of the frame budget a larger resolution may be predicted to use
+        float overloadRatio;            ///< share of the wanted tracking rate below which the tracking falls behind
+        float settleTime;               ///< seconds after a change before measuring, the SDK averages 25 frames
+        float profileTime;              ///< seconds of measuring at startup
+        float overloadDelay;            ///< seconds behind before a smaller resolution
+        float headroomDelay;            ///< seconds with room before a larger resolution
+        float backoff;                  ///< seconds before a resolution that fell behind is tried again, doubling
+
+        CaptureParameters() : targetTrackingRate(24.0f), headroom(0.7f), overloadRatio(0.85f), settleTime(1.0f),
+            profileTime(2.0f), overloadDelay(2.0f), headroomDelay(10.0f), backoff(30.0f) {};
+    };
+
+    /**
+     * \brief Counters of a CaptureResolutionManager
+     */
+    struct CaptureStats
+    {
+        unsigned long switches;         ///< camera restarts after the first start
+        unsigned long failures;         ///< restarts the camera refused
+        float trackingRate;             ///< measured tracked frames per second
+        double trackingCost;            ///< measured seconds per tracked frame, 0 if unknown
+
+        CaptureStats() : switches(0), failures(0), trackingRate(0), trackingCost(0) {};
+    };
+
+    /**
+     * \brief Chooses the capture resolution from the measured tracking cost
+     *
+     * Call update() once per tracked frame while the camera runs. All
+     * methods are for the render loop only. A resolution the camera can not
+     * be restarted with is backed off like one the tracking fell behind at,
+     * the camera goes back to the one before; if that fails too, the
+     * manager stops.
+     */
+    class CaptureResolutionManager
+    {
+    public:
+        /**
+         * \brief Constructor
+         * \param camera the camera, not owned
+         */
+        explicit CaptureResolutionManager( ICaptureCamera* camera );
+
+        void setParameters( const CaptureParameters& parameters );
+        const CaptureParameters& getParameters() const { return parameters; }
+
+        /**
+         * \brief Set the resolutions to choose from
+         * \param resolutions width and height, ordered by pixel count
+         * \param startIndex the one to start and profile with
+         */
+        void setResolutions( const std::vector<metaio::Vector2di>& resolutions, int startIndex );
+
+        /**
+         * \brief Always use this resolution, a null vector chooses automatically again
+         * \return false if the running camera could not be restarted with it, the one before is kept
+         */
+        bool setFixedResolution( const metaio::Vector2di& resolution );
+
+        /**
+         * \brief Start the camera
+         *
+         * The first start profiles the tracking; later ones reuse what was
+         * chosen.
+         *
+         * \param time the time in seconds
+         * \return false if the camera could not be started
+         */
+        bool start( double time );
+
+        void stop();
+
+        bool isRunning() const { return running; }
+
+        /**
+         * \brief Measure a tracked frame and change the resolution if needed
+         * \param time the frame time in seconds
+         * \param trackingFrameRate getTrackingFrameRate()
+         * \param trackingCost seconds the frame took to track, 0 if unknown
+         * \param frameRate frames per second the render loop asks for, the tracking is not expected to exceed it
+         * \return true if the camera was restarted, also when that failed; check isRunning()
+         */
+        bool update( double time, float trackingFrameRate, double trackingCost, float frameRate );
+
+        /// The resolution asked for
+        metaio::Vector2di getResolution() const;
+
+        /// The resolution the camera delivers
+        metaio::Vector2di getActualResolution() const { return actual; }
+
+        CAPTURE_REASON getReason() const { return reason; }
+
+        /// True until the startup measurement is done
+        bool isProfiling() const { return profiling; }
+
+        CaptureStats getStats() const;
+
+    private:
+        CaptureResolutionManager( const CaptureResolutionManager& );
+        CaptureResolutionManager& operator=( const CaptureResolutionManager& );
+
+        bool activate( int index, double time, CAPTURE_REASON reason );
+        // activate, back to the current resolution if the camera refuses the new one
+        void switchTo( int index, double time, CAPTURE_REASON reason );
+        void block( int index, double time );
+        void restartMeasurement( double time );
+        int choose( double costPerPixel, float wantedRate ) const;
+        double getPixels( int index ) const;
+
+        ICaptureCamera* camera;
+        CaptureParameters parameters;
+        std::vector<metaio::Vector2di> resolutions;
+        std::vector<double> blockedUntil;       // a resolution that fell behind is not tried again before this
+        std::vector<double> backoffs;
+        metaio::Vector2di fixed;
+        metaio::Vector2di actual;
+
+        int index;
+        CAPTURE_REASON reason;
+        bool running;
+        bool profiling;
+        unsigned long switches;
+        unsigned long failures;
+
+        // the measurement since the last change
+        double measureStart;            // measuring begins after the settle time from here
+        double lastUpdate;
+        float lastFrameRate;
+        double rateSum, costSum;
+        unsigned long rateCount, costCount;
+        float meanRate;                 // smoothed over about a second
+        double meanCost;
+        double behindSince;             // negative if the tracking keeps up
+        double roomSince;               // negative if the larger resolution would not fit
+    };
+}
+
+#endif
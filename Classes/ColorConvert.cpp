@@ -0,0 +1,915 @@
+//
+//  ColorConvert.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Every pair of formats gets its own instantiation of Convert<S, D>, so the
+//  per pixel load and store of both formats are inlined into one loop.
+//  The pairs on the camera and screenshot paths are specialized further and
+//  use row kernels that have a scalar reference and NEON/SSE2 versions with
+//  identical integer math.
+//
+#include "ColorConvert.h"
+#include "ImageFormat.h"
+
+#include <string.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define UNIFEYE_COLORCONVERT_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define UNIFEYE_COLORCONVERT_SSE2 1
+#endif
+
+using metaio::ImageStruct;
+using namespace metaio::common;
+
+namespace unifeye
+{
+    namespace
+    {
+        typedef unsigned char uint8;
+
+        bool simdEnabled = true;
+
+        inline uint8 clampByte( int value )
+        {
+            return (uint8)(value < 0 ? 0 : (value > 255 ? 255 : value));
+        }
+
+        // BT.601 video range in 6 bit fixed point (luma gain 74.5), all terms fit into 16 bits
+        inline void yuvToRgba( int y, int u, int v, uint8* rgba )
+        {
+            int c = 74 * (y - 16) + ((y - 16) >> 1) + 32;
+            int d = u - 128;
+            int e = v - 128;
+            rgba[0] = clampByte((c + 102 * e) >> 6);
+            rgba[1] = clampByte((c - 25 * d - 52 * e) >> 6);
+            rgba[2] = clampByte((c + 129 * d) >> 6);
+            rgba[3] = 255;
+        }
+
+        inline uint8 rgbaToY( const uint8* rgba )
+        {
+            return (uint8)(((66 * rgba[0] + 129 * rgba[1] + 25 * rgba[2] + 128) >> 8) + 16);
+        }
+
+        inline int rgbaToU( const uint8* rgba )
+        {
+            return ((-38 * rgba[0] - 74 * rgba[1] + 112 * rgba[2] + 128) >> 8) + 128;
+        }
+
+        inline int rgbaToV( const uint8* rgba )
+        {
+            return ((112 * rgba[0] - 94 * rgba[1] - 18 * rgba[2] + 128) >> 8) + 128;
+        }
+
+        inline uint8 rgbaToGray( const uint8* rgba )
+        {
+            return (uint8)((77 * rgba[0] + 150 * rgba[1] + 29 * rgba[2] + 128) >> 8);
+        }
+
+        inline int srcRow( const ImageStruct& image, int row, bool flip )
+        {
+            return flip ? image.height - 1 - row : row;
+        }
+
+        enum { CHUNK = 256 };
+
+
+        /*
+         * Format traits. Packed formats provide load/store of one pixel,
+         * subsampled formats decode and encode spans of rows. Pixels are
+         * exchanged as R, G, B, A bytes.
+         */
+        template<int F> struct Format;
+
+        template<class Derived, int BPP>
+        struct PackedFormat
+        {
+            enum { packed = 1, bpp = BPP };
+
+            static void decodeRow( const ImageStruct& image, int row, int x, int n, uint8* rgba )
+            {
+                const uint8* p = image.buffer + ((size_t)row * image.width + x) * BPP;
+                for (int i = 0; i < n; i++, p += BPP, rgba += 4)
+                    Derived::load(p, rgba);
+            }
+
+            static void encodeRows( ImageStruct& image, int y, int rows, int x, int n,
+                const uint8* rgba0, const uint8* rgba1 )
+            {
+                for (int r = 0; r < rows; r++)
+                {
+                    const uint8* in = r ? rgba1 : rgba0;
+                    uint8* p = image.buffer + ((size_t)(y + r) * image.width + x) * BPP;
+                    for (int i = 0; i < n; i++, p += BPP, in += 4)
+                        Derived::store(p, in);
+                }
+            }
+        };
+
+        template<> struct Format<ECF_A1R5G5B5> : PackedFormat<Format<ECF_A1R5G5B5>, 2>
+        {
+            static void load( const uint8* p, uint8* rgba )
+            {
+                unsigned int w = p[0] | (p[1] << 8);
+                unsigned int r = (w >> 10) & 31, g = (w >> 5) & 31, b = w & 31;
+                rgba[0] = (uint8)((r << 3) | (r >> 2));
+                rgba[1] = (uint8)((g << 3) | (g >> 2));
+                rgba[2] = (uint8)((b << 3) | (b >> 2));
+                rgba[3] = (w & 0x8000) ? 255 : 0;
+            }
+
+            static void store( uint8* p, const uint8* rgba )
+            {
+                unsigned int w = ((rgba[3] & 0x80) << 8) | ((rgba[0] >> 3) << 10) | ((rgba[1] >> 3) << 5) | (rgba[2] >> 3);
+                p[0] = (uint8)w;
+                p[1] = (uint8)(w >> 8);
+            }
+        };
+
+        template<> struct Format<ECF_R5G6B5> : PackedFormat<Format<ECF_R5G6B5>, 2>
+        {
+            static void load( const uint8* p, uint8* rgba )
+            {
+                unsigned int w = p[0] | (p[1] << 8);
+                unsigned int r = w >> 11, g = (w >> 5) & 63, b = w & 31;
+                rgba[0] = (uint8)((r << 3) | (r >> 2));
+                rgba[1] = (uint8)((g << 2) | (g >> 4));
+                rgba[2] = (uint8)((b << 3) | (b >> 2));
+                rgba[3] = 255;
+            }
+
+            static void store( uint8* p, const uint8* rgba )
+            {
+                unsigned int w = ((rgba[0] >> 3) << 11) | ((rgba[1] >> 2) << 5) | (rgba[2] >> 3);
+                p[0] = (uint8)w;
+                p[1] = (uint8)(w >> 8);
+            }
+        };
+
+        template<> struct Format<ECF_R8G8B8> : PackedFormat<Format<ECF_R8G8B8>, 3>
+        {
+            static void load( const uint8* p, uint8* rgba )
+            {
+                rgba[0] = p[0]; rgba[1] = p[1]; rgba[2] = p[2]; rgba[3] = 255;
+            }
+
+            static void store( uint8* p, const uint8* rgba )
+            {
+                p[0] = rgba[0]; p[1] = rgba[1]; p[2] = rgba[2];
+            }
+        };
+
+        template<> struct Format<ECF_B8G8R8> : PackedFormat<Format<ECF_B8G8R8>, 3>
+        {
+            static void load( const uint8* p, uint8* rgba )
+            {
+                rgba[0] = p[2]; rgba[1] = p[1]; rgba[2] = p[0]; rgba[3] = 255;
+            }
+
+            static void store( uint8* p, const uint8* rgba )
+            {
+                p[0] = rgba[2]; p[1] = rgba[1]; p[2] = rgba[0];
+            }
+        };
+
+        template<> struct Format<ECF_A8R8G8B8> : PackedFormat<Format<ECF_A8R8G8B8>, 4>
+        {
+            static void load( const uint8* p, uint8* rgba )
+            {
+                rgba[0] = p[2]; rgba[1] = p[1]; rgba[2] = p[0]; rgba[3] = p[3];
+            }
+
+            static void store( uint8* p, const uint8* rgba )
+            {
+                p[0] = rgba[2]; p[1] = rgba[1]; p[2] = rgba[0]; p[3] = rgba[3];
+            }
+        };
+
+        template<> struct Format<ECF_A8B8G8R8> : PackedFormat<Format<ECF_A8B8G8R8>, 4>
+        {
+            static void load( const uint8* p, uint8* rgba )
+            {
+                rgba[0] = p[0]; rgba[1] = p[1]; rgba[2] = p[2]; rgba[3] = p[3];
+            }
+
+            static void store( uint8* p, const uint8* rgba )
+            {
+                p[0] = rgba[0]; p[1] = rgba[1]; p[2] = rgba[2]; p[3] = rgba[3];
+            }
+        };
+
+        template<> struct Format<ECF_GRAY> : PackedFormat<Format<ECF_GRAY>, 1>
+        {
+            static void load( const uint8* p, uint8* rgba )
+            {
+                rgba[0] = rgba[1] = rgba[2] = p[0];
+                rgba[3] = 255;
+            }
+
+            static void store( uint8* p, const uint8* rgba )
+            {
+                p[0] = rgbaToGray(rgba);
+            }
+        };
+
+        template<> struct Format<ECF_V8Y8U8Y8>
+        {
+            enum { packed = 0 };
+
+            // x is always even, spans start at multiples of CHUNK
+            static void decodeRow( const ImageStruct& image, int row, int x, int n, uint8* rgba )
+            {
+                const uint8* p = image.buffer + ((size_t)row * image.width + x) * 2;
+                for (int i = 0; i < n; i += 2, p += 4, rgba += 8)
+                {
+                    yuvToRgba(p[0], p[1], p[3], rgba);
+                    if (i + 1 < n)
+                        yuvToRgba(p[2], p[1], p[3], rgba + 4);
+                }
+            }
+
+            static void encodeRows( ImageStruct& image, int y, int rows, int x, int n,
+                const uint8* rgba0, const uint8* rgba1 )
+            {
+                for (int r = 0; r < rows; r++)
+                {
+                    const uint8* in = r ? rgba1 : rgba0;
+                    uint8* p = image.buffer + ((size_t)(y + r) * image.width + x) * 2;
+                    for (int i = 0; i < n; i += 2, p += 4, in += 8)
+                    {
+                        const uint8* in1 = i + 1 < n ? in + 4 : in;
+                        p[0] = rgbaToY(in);
+                        p[1] = clampByte((rgbaToU(in) + rgbaToU(in1) + 1) >> 1);
+                        p[2] = rgbaToY(in1);
+                        p[3] = clampByte((rgbaToV(in) + rgbaToV(in1) + 1) >> 1);
+                    }
+                }
+            }
+        };
+
+        template<> struct Format<ECF_YUV420SP>
+        {
+            enum { packed = 0 };
+
+            static int chromaStride( const ImageStruct& image )
+            {
+                return ((image.width + 1) / 2) * 2;
+            }
+
+            static const uint8* chromaRow( const ImageStruct& image, int row )
+            {
+                return image.buffer + (size_t)image.width * image.height + (size_t)(row / 2) * chromaStride(image);
+            }
+
+            static void decodeRow( const ImageStruct& image, int row, int x, int n, uint8* rgba )
+            {
+                const uint8* luma = image.buffer + (size_t)row * image.width + x;
+                const uint8* vu = chromaRow(image, row) + x;
+                for (int i = 0; i < n; i++, rgba += 4)
+                {
+                    const uint8* c = vu + (i & ~1);
+                    yuvToRgba(luma[i], c[1], c[0], rgba);
+                }
+            }
+
+            static void encodeRows( ImageStruct& image, int y, int rows, int x, int n,
+                const uint8* rgba0, const uint8* rgba1 )
+            {
+                uint8* luma0 = image.buffer + (size_t)y * image.width + x;
+                uint8* luma1 = luma0 + image.width;
+                uint8* vu = (uint8*)chromaRow(image, y) + x;
+                for (int i = 0; i < n; i += 2)
+                {
+                    // average the chroma of the (up to) four pixels of the block
+                    const uint8* block[4];
+                    int count = 0;
+                    block[count++] = rgba0 + i * 4;
+                    if (i + 1 < n)
+                        block[count++] = rgba0 + (i + 1) * 4;
+                    if (rows == 2)
+                    {
+                        block[count++] = rgba1 + i * 4;
+                        if (i + 1 < n)
+                            block[count++] = rgba1 + (i + 1) * 4;
+                    }
+
+                    int u = 0, v = 0;
+                    for (int k = 0; k < count; k++)
+                    {
+                        u += rgbaToU(block[k]);
+                        v += rgbaToV(block[k]);
+                    }
+                    vu[i] = clampByte((v + count / 2) / count);
+                    vu[i + 1] = clampByte((u + count / 2) / count);
+
+                    luma0[i] = rgbaToY(rgba0 + i * 4);
+                    if (i + 1 < n)
+                        luma0[i + 1] = rgbaToY(rgba0 + (i + 1) * 4);
+                    if (rows == 2)
+                    {
+                        luma1[i] = rgbaToY(rgba1 + i * 4);
+                        if (i + 1 < n)
+                            luma1[i + 1] = rgbaToY(rgba1 + (i + 1) * 4);
+                    }
+                }
+            }
+        };
+
+
+        /*
+         * Same format on both sides: copy rows, flipping if needed
+         */
+        void copyImage( const ImageStruct& src, ImageStruct& dst, bool flip )
+        {
+            if (src.colorFormat == ECF_YUV420SP)
+            {
+                // flip both planes, the chroma rows of odd heights end up shifted by a line
+                size_t lumaSize = (size_t)src.width * src.height;
+                int chromaStride = Format<ECF_YUV420SP>::chromaStride(src);
+                int chromaRows = (src.height + 1) / 2;
+                for (int y = 0; y < src.height; y++)
+                    memcpy(dst.buffer + (size_t)y * src.width, src.buffer + (size_t)srcRow(src, y, flip) * src.width, src.width);
+                for (int y = 0; y < chromaRows; y++)
+                {
+                    int from = flip ? chromaRows - 1 - y : y;
+                    memcpy(dst.buffer + lumaSize + (size_t)y * chromaStride, src.buffer + lumaSize + (size_t)from * chromaStride, chromaStride);
+                }
+                return;
+            }
+
+            size_t rowSize = (size_t)src.width * getBytesPerPixel(src.colorFormat);
+            if (!flip)
+            {
+                memcpy(dst.buffer, src.buffer, rowSize * src.height);
+                return;
+            }
+            for (int y = 0; y < src.height; y++)
+                memcpy(dst.buffer + y * rowSize, src.buffer + (size_t)srcRow(src, y, true) * rowSize, rowSize);
+        }
+
+
+        /*
+         * Generic conversion through R, G, B, A
+         */
+        template<int S, int D, bool PACKED = Format<S>::packed && Format<D>::packed>
+        struct GenericConvert
+        {
+            // at least one side is subsampled, work on pairs of rows and spans of pixels
+            static void run( const ImageStruct& src, ImageStruct& dst, bool flip )
+            {
+                uint8 rgba0[CHUNK * 4];
+                uint8 rgba1[CHUNK * 4];
+
+                for (int y = 0; y < src.height; y += 2)
+                {
+                    int rows = src.height - y < 2 ? 1 : 2;
+                    for (int x = 0; x < src.width; x += CHUNK)
+                    {
+                        int n = src.width - x < CHUNK ? src.width - x : CHUNK;
+                        Format<S>::decodeRow(src, srcRow(src, y, flip), x, n, rgba0);
+                        if (rows == 2)
+                            Format<S>::decodeRow(src, srcRow(src, y + 1, flip), x, n, rgba1);
+                        Format<D>::encodeRows(dst, y, rows, x, n, rgba0, rgba1);
+                    }
+                }
+            }
+        };
+
+        template<int S, int D>
+        struct GenericConvert<S, D, true>
+        {
+            static void run( const ImageStruct& src, ImageStruct& dst, bool flip )
+            {
+                uint8* out = dst.buffer;
+                for (int y = 0; y < src.height; y++)
+                {
+                    const uint8* in = src.buffer + (size_t)srcRow(src, y, flip) * src.width * Format<S>::bpp;
+                    for (int x = 0; x < src.width; x++, in += Format<S>::bpp, out += Format<D>::bpp)
+                    {
+                        uint8 rgba[4];
+                        Format<S>::load(in, rgba);
+                        Format<D>::store(out, rgba);
+                    }
+                }
+            }
+        };
+
+        template<int S, int D>
+        struct Convert
+        {
+            static void run( const ImageStruct& src, ImageStruct& dst, bool flip )
+            {
+                if (S == D)
+                    copyImage(src, dst, flip);
+                else
+                    GenericConvert<S, D>::run(src, dst, flip);
+            }
+        };
+
+
+        /*
+         * Luminance only conversions between YUV and gray
+         */
+        template<> struct Convert<ECF_YUV420SP, ECF_GRAY>
+        {
+            static void run( const ImageStruct& src, ImageStruct& dst, bool flip )
+            {
+                for (int y = 0; y < src.height; y++)
+                    memcpy(dst.buffer + (size_t)y * src.width, src.buffer + (size_t)srcRow(src, y, flip) * src.width, src.width);
+            }
+        };
+
+        template<> struct Convert<ECF_V8Y8U8Y8, ECF_GRAY>
+        {
+            static void run( const ImageStruct& src, ImageStruct& dst, bool flip )
+            {
+                uint8* out = dst.buffer;
+                for (int y = 0; y < src.height; y++)
+                {
+                    const uint8* in = src.buffer + (size_t)srcRow(src, y, flip) * src.width * 2;
+                    for (int x = 0; x < src.width; x++)
+                        *out++ = in[x * 2];
+                }
+            }
+        };
+
+        template<> struct Convert<ECF_GRAY, ECF_YUV420SP>
+        {
+            static void run( const ImageStruct& src, ImageStruct& dst, bool flip )
+            {
+                for (int y = 0; y < src.height; y++)
+                    memcpy(dst.buffer + (size_t)y * src.width, src.buffer + (size_t)srcRow(src, y, flip) * src.width, src.width);
+                size_t lumaSize = (size_t)src.width * src.height;
+                memset(dst.buffer + lumaSize, 128, getImageBufferSize(dst) - lumaSize);
+            }
+        };
+
+        template<> struct Convert<ECF_GRAY, ECF_V8Y8U8Y8>
+        {
+            static void run( const ImageStruct& src, ImageStruct& dst, bool flip )
+            {
+                uint8* out = dst.buffer;
+                for (int y = 0; y < src.height; y++)
+                {
+                    const uint8* in = src.buffer + (size_t)srcRow(src, y, flip) * src.width;
+                    for (int x = 0; x < src.width; x++, out += 2)
+                    {
+                        out[0] = in[x];
+                        out[1] = 128;
+                    }
+                }
+            }
+        };
+
+
+        /*
+         * Row kernels of the hot pairs. The scalar versions are the reference.
+         */
+        void swizzleRowScalar( const uint8* src, uint8* dst, int n )
+        {
+            for (int i = 0; i < n; i++, src += 4, dst += 4)
+            {
+                uint8 r = src[0];
+                dst[0] = src[2];
+                dst[1] = src[1];
+                dst[2] = r;
+                dst[3] = src[3];
+            }
+        }
+
+        // the color of one pixel and the red channel of another one as alpha;
+        // SRC_BGRA and DST_BGRA are true for ECF_A8R8G8B8, false for ECF_A8B8G8R8
+        template<bool SRC_BGRA, bool DST_BGRA>
+        void mergeAlphaRowScalar( const uint8* color, const uint8* alpha, uint8* dst, int n )
+        {
+            for (int i = 0; i < n; i++, color += 4, alpha += 4, dst += 4)
+            {
+                uint8 r = color[SRC_BGRA ? 2 : 0];
+                uint8 b = color[SRC_BGRA ? 0 : 2];
+                dst[0] = DST_BGRA ? b : r;
+                dst[1] = color[1];
+                dst[2] = DST_BGRA ? r : b;
+                dst[3] = alpha[SRC_BGRA ? 2 : 0];
+            }
+        }
+
+        // BGRA = true writes ECF_A8R8G8B8, false writes ECF_A8B8G8R8
+        template<bool BGRA>
+        void nv21RowScalar( const uint8* luma, const uint8* vu, uint8* dst, int n )
+        {
+            for (int i = 0; i < n; i++, dst += 4)
+            {
+                const uint8* c = vu + (i & ~1);
+                uint8 rgba[4];
+                yuvToRgba(luma[i], c[1], c[0], rgba);
+                dst[0] = BGRA ? rgba[2] : rgba[0];
+                dst[1] = rgba[1];
+                dst[2] = BGRA ? rgba[0] : rgba[2];
+                dst[3] = 255;
+            }
+        }
+
+        template<bool BGRA>
+        void grayRowScalar( const uint8* src, uint8* dst, int n )
+        {
+            for (int i = 0; i < n; i++, src += 4)
+            {
+                uint8 rgba[4] = { BGRA ? src[2] : src[0], src[1], BGRA ? src[0] : src[2], src[3] };
+                dst[i] = rgbaToGray(rgba);
+            }
+        }
+
+#if defined(UNIFEYE_COLORCONVERT_NEON)
+
+        void swizzleRowSIMD( const uint8* src, uint8* dst, int n )
+        {
+            int i = 0;
+            for (; i + 16 <= n; i += 16, src += 64, dst += 64)
+            {
+                uint8x16x4_t v = vld4q_u8(src);
+                uint8x16_t t = v.val[0];
+                v.val[0] = v.val[2];
+                v.val[2] = t;
+                vst4q_u8(dst, v);
+            }
+            swizzleRowScalar(src, dst, n - i);
+        }
+
+        template<bool SRC_BGRA, bool DST_BGRA>
+        void mergeAlphaRowSIMD( const uint8* color, const uint8* alpha, uint8* dst, int n )
+        {
+            int i = 0;
+            for (; i + 16 <= n; i += 16, color += 64, alpha += 64, dst += 64)
+            {
+                uint8x16x4_t c = vld4q_u8(color);
+                uint8x16x4_t a = vld4q_u8(alpha);
+                if (SRC_BGRA != DST_BGRA)
+                {
+                    uint8x16_t t = c.val[0];
+                    c.val[0] = c.val[2];
+                    c.val[2] = t;
+                }
+                c.val[3] = a.val[SRC_BGRA ? 2 : 0];
+                vst4q_u8(dst, c);
+            }
+            mergeAlphaRowScalar<SRC_BGRA, DST_BGRA>(color, alpha, dst, n - i);
+        }
+
+        template<bool BGRA>
+        void nv21RowSIMD( const uint8* luma, const uint8* vu, uint8* dst, int n )
+        {
+            const int16x8_t c16 = vdupq_n_s16(16);
+            const int16x8_t c128 = vdupq_n_s16(128);
+            const int16x8_t c32 = vdupq_n_s16(32);
+
+            int i = 0;
+            for (; i + 8 <= n; i += 8, dst += 32)
+            {
+                uint8x8_t y8 = vld1_u8(luma + i);
+                uint8x8x2_t split = vuzp_u8(vld1_u8(vu + i), vld1_u8(vu + i));
+                uint8x8_t v8 = vzip_u8(split.val[0], split.val[0]).val[0];
+                uint8x8_t u8 = vzip_u8(split.val[1], split.val[1]).val[0];
+
+                int16x8_t c = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(y8)), c16);
+                c = vaddq_s16(vmulq_n_s16(c, 74), vshrq_n_s16(c, 1));
+                int16x8_t d = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), c128);
+                int16x8_t e = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), c128);
+
+                int16x8_t r = vqaddq_s16(vqaddq_s16(c, c32), vmulq_n_s16(e, 102));
+                int16x8_t g = vqsubq_s16(vqsubq_s16(vqaddq_s16(c, c32), vmulq_n_s16(d, 25)), vmulq_n_s16(e, 52));
+                int16x8_t b = vqaddq_s16(vqaddq_s16(c, c32), vmulq_n_s16(d, 129));
+
+                uint8x8x4_t out;
+                out.val[BGRA ? 2 : 0] = vqmovun_s16(vshrq_n_s16(r, 6));
+                out.val[1] = vqmovun_s16(vshrq_n_s16(g, 6));
+                out.val[BGRA ? 0 : 2] = vqmovun_s16(vshrq_n_s16(b, 6));
+                out.val[3] = vdup_n_u8(255);
+                vst4_u8(dst, out);
+            }
+            nv21RowScalar<BGRA>(luma + i, vu + i, dst, n - i);
+        }
+
+        template<bool BGRA>
+        void grayRowSIMD( const uint8* src, uint8* dst, int n )
+        {
+            int i = 0;
+            for (; i + 8 <= n; i += 8, src += 32)
+            {
+                uint8x8x4_t v = vld4_u8(src);
+                uint16x8_t sum = vmull_u8(v.val[BGRA ? 2 : 0], vdup_n_u8(77));
+                sum = vmlal_u8(sum, v.val[1], vdup_n_u8(150));
+                sum = vmlal_u8(sum, v.val[BGRA ? 0 : 2], vdup_n_u8(29));
+                vst1_u8(dst + i, vrshrn_n_u16(sum, 8));
+            }
+            grayRowScalar<BGRA>(src, dst + i, n - i);
+        }
+
+#elif defined(UNIFEYE_COLORCONVERT_SSE2)
+
+        void swizzleRowSIMD( const uint8* src, uint8* dst, int n )
+        {
+            const __m128i maskAG = _mm_set1_epi32(0xFF00FF00);
+            const __m128i maskRB = _mm_set1_epi32(0x00FF00FF);
+
+            int i = 0;
+            for (; i + 4 <= n; i += 4, src += 16, dst += 16)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i*)src);
+                __m128i rb = _mm_and_si128(v, maskRB);
+                rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+                _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_and_si128(v, maskAG), rb));
+            }
+            swizzleRowScalar(src, dst, n - i);
+        }
+
+        template<bool SRC_BGRA, bool DST_BGRA>
+        void mergeAlphaRowSIMD( const uint8* color, const uint8* alpha, uint8* dst, int n )
+        {
+            const __m128i maskAG = _mm_set1_epi32(0xFF00FF00);
+            const __m128i maskRB = _mm_set1_epi32(0x00FF00FF);
+            const __m128i maskRGB = _mm_set1_epi32(0x00FFFFFF);
+
+            int i = 0;
+            for (; i + 4 <= n; i += 4, color += 16, alpha += 16, dst += 16)
+            {
+                __m128i c = _mm_loadu_si128((const __m128i*)color);
+                __m128i a = _mm_loadu_si128((const __m128i*)alpha);
+                if (SRC_BGRA != DST_BGRA)
+                {
+                    __m128i rb = _mm_and_si128(c, maskRB);
+                    rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+                    c = _mm_or_si128(_mm_and_si128(c, maskAG), rb);
+                }
+
+                // the red byte of the alpha pixel moves to the top, the rest shifts out
+                a = SRC_BGRA ? _mm_slli_epi32(_mm_srli_epi32(a, 16), 24) : _mm_slli_epi32(a, 24);
+                _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_and_si128(c, maskRGB), a));
+            }
+            mergeAlphaRowScalar<SRC_BGRA, DST_BGRA>(color, alpha, dst, n - i);
+        }
+
+        template<bool BGRA>
+        void nv21RowSIMD( const uint8* luma, const uint8* vu, uint8* dst, int n )
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i c16 = _mm_set1_epi16(16);
+            const __m128i c128 = _mm_set1_epi16(128);
+            const __m128i c32 = _mm_set1_epi16(32);
+            const __m128i lowHalf = _mm_set1_epi32(0x0000FFFF);
+            const __m128i alpha = _mm_set1_epi8((char)255);
+
+            int i = 0;
+            for (; i + 8 <= n; i += 8, dst += 32)
+            {
+                __m128i y16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(luma + i)), zero);
+                __m128i vu16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(vu + i)), zero);
+
+                // every 32 bit lane holds V | U << 16, duplicate them for both pixels
+                __m128i v16 = _mm_and_si128(vu16, lowHalf);
+                __m128i u16 = _mm_srli_epi32(vu16, 16);
+                v16 = _mm_or_si128(v16, _mm_slli_epi32(v16, 16));
+                u16 = _mm_or_si128(u16, _mm_slli_epi32(u16, 16));
+
+                __m128i c = _mm_sub_epi16(y16, c16);
+                c = _mm_adds_epi16(_mm_add_epi16(_mm_mullo_epi16(c, _mm_set1_epi16(74)), _mm_srai_epi16(c, 1)), c32);
+                __m128i d = _mm_sub_epi16(u16, c128);
+                __m128i e = _mm_sub_epi16(v16, c128);
+
+                __m128i r = _mm_adds_epi16(c, _mm_mullo_epi16(e, _mm_set1_epi16(102)));
+                __m128i g = _mm_subs_epi16(_mm_subs_epi16(c, _mm_mullo_epi16(d, _mm_set1_epi16(25))), _mm_mullo_epi16(e, _mm_set1_epi16(52)));
+                __m128i b = _mm_adds_epi16(c, _mm_mullo_epi16(d, _mm_set1_epi16(129)));
+
+                __m128i r8 = _mm_packus_epi16(_mm_srai_epi16(r, 6), zero);
+                __m128i g8 = _mm_packus_epi16(_mm_srai_epi16(g, 6), zero);
+                __m128i b8 = _mm_packus_epi16(_mm_srai_epi16(b, 6), zero);
+
+                __m128i first = _mm_unpacklo_epi8(BGRA ? b8 : r8, g8);
+                __m128i second = _mm_unpacklo_epi8(BGRA ? r8 : b8, alpha);
+                _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(first, second));
+                _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(first, second));
+            }
+            nv21RowScalar<BGRA>(luma + i, vu + i, dst, n - i);
+        }
+
+        template<bool BGRA>
+        void grayRowSIMD( const uint8* src, uint8* dst, int n )
+        {
+            const __m128i mask = _mm_set1_epi32(0xFF);
+            const __m128i zero = _mm_setzero_si128();
+
+            int i = 0;
+            for (; i + 8 <= n; i += 8, src += 32)
+            {
+                __m128i lo = _mm_loadu_si128((const __m128i*)src);
+                __m128i hi = _mm_loadu_si128((const __m128i*)(src + 16));
+
+                __m128i c0 = _mm_packs_epi32(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask));
+                __m128i c1 = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), mask), _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+                __m128i c2 = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), mask), _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+
+                // the weighted sum stays below 2^16, so unsigned 16 bit math is exact
+                __m128i sum = _mm_mullo_epi16(BGRA ? c2 : c0, _mm_set1_epi16(77));
+                sum = _mm_add_epi16(sum, _mm_mullo_epi16(c1, _mm_set1_epi16(150)));
+                sum = _mm_add_epi16(sum, _mm_mullo_epi16(BGRA ? c0 : c2, _mm_set1_epi16(29)));
+                sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(128)), 8);
+
+                _mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(sum, zero));
+            }
+            grayRowScalar<BGRA>(src, dst + i, n - i);
+        }
+
+#endif
+
+#if defined(UNIFEYE_COLORCONVERT_NEON) || defined(UNIFEYE_COLORCONVERT_SSE2)
+        inline bool useSIMD() { return simdEnabled; }
+#else
+        inline bool useSIMD() { return false; }
+        void swizzleRowSIMD( const uint8* src, uint8* dst, int n ) { swizzleRowScalar(src, dst, n); }
+        template<bool SRC_BGRA, bool DST_BGRA> void mergeAlphaRowSIMD( const uint8* color, const uint8* alpha, uint8* dst, int n ) { mergeAlphaRowScalar<SRC_BGRA, DST_BGRA>(color, alpha, dst, n); }
+        template<bool BGRA> void nv21RowSIMD( const uint8* luma, const uint8* vu, uint8* dst, int n ) { nv21RowScalar<BGRA>(luma, vu, dst, n); }
+        template<bool BGRA> void grayRowSIMD( const uint8* src, uint8* dst, int n ) { grayRowScalar<BGRA>(src, dst, n); }
+#endif
+
+        typedef void (*PackedRowKernel)( const uint8* src, uint8* dst, int n );
+
+        void runPackedRows( const ImageStruct& src, ImageStruct& dst, bool flip, int srcBpp, int dstBpp, PackedRowKernel kernel )
+        {
+            for (int y = 0; y < src.height; y++)
+            {
+                const uint8* in = src.buffer + (size_t)srcRow(src, y, flip) * src.width * srcBpp;
+                kernel(in, dst.buffer + (size_t)y * src.width * dstBpp, src.width);
+            }
+        }
+
+        template<> struct Convert<ECF_A8R8G8B8, ECF_A8B8G8R8>
+        {
+            static void run( const ImageStruct& src, ImageStruct& dst, bool flip )
+            {
+                runPackedRows(src, dst, flip, 4, 4, useSIMD() ? swizzleRowSIMD : swizzleRowScalar);
+            }
+        };
+
+        template<> struct Convert<ECF_A8B8G8R8, ECF_A8R8G8B8> : Convert<ECF_A8R8G8B8, ECF_A8B8G8R8>
+        {
+        };
+
+        template<> struct Convert<ECF_A8R8G8B8, ECF_GRAY>
+        {
+            static void run( const ImageStruct& src, ImageStruct& dst, bool flip )
+            {
+                runPackedRows(src, dst, flip, 4, 1, useSIMD() ? grayRowSIMD<true> : grayRowScalar<true>);
+            }
+        };
+
+        template<> struct Convert<ECF_A8B8G8R8, ECF_GRAY>
+        {
+            static void run( const ImageStruct& src, ImageStruct& dst, bool flip )
+            {
+                runPackedRows(src, dst, flip, 4, 1, useSIMD() ? grayRowSIMD<false> : grayRowScalar<false>);
+            }
+        };
+
+        template<bool BGRA>
+        void convertNV21( const ImageStruct& src, ImageStruct& dst, bool flip )
+        {
+            void (*kernel)( const uint8*, const uint8*, uint8*, int ) = useSIMD() ? nv21RowSIMD<BGRA> : nv21RowScalar<BGRA>;
+            for (int y = 0; y < src.height; y++)
+            {
+                int row = srcRow(src, y, flip);
+                kernel(src.buffer + (size_t)row * src.width, Format<ECF_YUV420SP>::chromaRow(src, row),
+                    dst.buffer + (size_t)y * src.width * 4, src.width);
+            }
+        }
+
+        template<> struct Convert<ECF_YUV420SP, ECF_A8R8G8B8>
+        {
+            static void run( const ImageStruct& src, ImageStruct& dst, bool flip )
+            {
+                convertNV21<true>(src, dst, flip);
+            }
+        };
+
+        template<> struct Convert<ECF_YUV420SP, ECF_A8B8G8R8>
+        {
+            static void run( const ImageStruct& src, ImageStruct& dst, bool flip )
+            {
+                convertNV21<false>(src, dst, flip);
+            }
+        };
+
+
+        /*
+         * Side by side alpha
+         */
+        typedef void (*MergeRowKernel)( const uint8* color, const uint8* alpha, uint8* dst, int n );
+
+        template<bool SRC_BGRA, bool DST_BGRA>
+        MergeRowKernel selectMergeKernel()
+        {
+            return useSIMD() ? mergeAlphaRowSIMD<SRC_BGRA, DST_BGRA> : mergeAlphaRowScalar<SRC_BGRA, DST_BGRA>;
+        }
+
+
+        /*
+         * Dispatch
+         */
+        typedef void (*ConvertFunction)( const ImageStruct& src, ImageStruct& dst, bool flip );
+
+#define UNIFEYE_COLOR_FORMATS(X) \
+        X(ECF_A1R5G5B5) X(ECF_R5G6B5) X(ECF_R8G8B8) X(ECF_B8G8R8) X(ECF_A8R8G8B8) \
+        X(ECF_A8B8G8R8) X(ECF_V8Y8U8Y8) X(ECF_GRAY) X(ECF_YUV420SP)
+
+        template<int S>
+        ConvertFunction selectDestination( ECOLOR_FORMAT dst )
+        {
+            switch (dst)
+            {
+#define UNIFEYE_DST_CASE(F) case F: return &Convert<S, F>::run;
+                UNIFEYE_COLOR_FORMATS(UNIFEYE_DST_CASE)
+#undef UNIFEYE_DST_CASE
+                default: return 0;
+            }
+        }
+
+        ConvertFunction selectConversion( ECOLOR_FORMAT src, ECOLOR_FORMAT dst )
+        {
+            switch (src)
+            {
+#define UNIFEYE_SRC_CASE(F) case F: return selectDestination<F>(dst);
+                UNIFEYE_COLOR_FORMATS(UNIFEYE_SRC_CASE)
+#undef UNIFEYE_SRC_CASE
+                default: return 0;
+            }
+        }
+    }
+
+    bool isColorConversionSupported( ECOLOR_FORMAT src, ECOLOR_FORMAT dst )
+    {
+        return selectConversion(src, dst) != 0;
+    }
+
+    bool convertImage( const ImageStruct& src, ImageStruct& dst )
+    {
+        ConvertFunction convert = selectConversion(src.colorFormat, dst.colorFormat);
+        if (!convert || !src.buffer || !dst.buffer)
+            return false;
+
+        if (src.width != dst.width || src.height != dst.height || src.width <= 0 || src.height <= 0)
+            return false;
+
+        if ((src.colorFormat == ECF_V8Y8U8Y8 || dst.colorFormat == ECF_V8Y8U8Y8) && (src.width & 1))
+            return false;
+
+        convert(src, dst, src.originIsUpperLeft != dst.originIsUpperLeft);
+        return true;
+    }
+
+    bool mergeSideBySideAlpha( const ImageStruct& src, int srcStride, ImageStruct& dst )
+    {
+        bool srcBGRA = src.colorFormat == ECF_A8R8G8B8;
+        bool dstBGRA = dst.colorFormat == ECF_A8R8G8B8;
+        if ((!srcBGRA && src.colorFormat != ECF_A8B8G8R8) || (!dstBGRA && dst.colorFormat != ECF_A8B8G8R8) ||
+            !src.buffer || !dst.buffer)
+        {
+            return false;
+        }
+
+        if (src.width != dst.width * 2 || src.height != dst.height || dst.width <= 0 || dst.height <= 0)
+            return false;
+
+        size_t stride = srcStride > 0 ? (size_t)srcStride : (size_t)src.width * 4;
+        if (stride < (size_t)src.width * 4)
+            return false;
+
+        MergeRowKernel kernel = srcBGRA ? (dstBGRA ? selectMergeKernel<true, true>() : selectMergeKernel<true, false>())
+                                        : (dstBGRA ? selectMergeKernel<false, true>() : selectMergeKernel<false, false>());
+        bool flip = src.originIsUpperLeft != dst.originIsUpperLeft;
+        for (int y = 0; y < dst.height; y++)
+        {
+            const uint8* color = src.buffer + (size_t)srcRow(src, y, flip) * stride;
+            kernel(color, color + (size_t)dst.width * 4, dst.buffer + (size_t)y * dst.width * 4, dst.width);
+        }
+        return true;
+    }
+
+    void setColorConvertSIMDEnabled( bool enabled )
+    {
+        simdEnabled = enabled;
+    }
+
+    const char* getColorConvertSIMDPath()
+    {
+#if defined(UNIFEYE_COLORCONVERT_NEON)
+        return simdEnabled ? "NEON" : "scalar";
+#elif defined(UNIFEYE_COLORCONVERT_SSE2)
+        return simdEnabled ? "SSE2" : "scalar";
+#else
+        return "scalar";
+#endif
+    }
+}
@@ -0,0 +1,84 @@
+//
+//  ColorConvert.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Conversion between the ECOLOR_FORMATs of camera frames and textures.
+//
+//  Memory layout assumed for each format (little endian):
+//      ECF_A1R5G5B5    16 bit word ARRRRRGGGGGBBBBB
+//      ECF_R5G6B5      16 bit word RRRRRGGGGGGBBBBB
+//      ECF_R8G8B8      bytes R, G, B
+//      ECF_B8G8R8      bytes B, G, R
+//      ECF_A8R8G8B8    32 bit word 0xAARRGGBB, i.e. bytes B, G, R, A
+//      ECF_A8B8G8R8    32 bit word 0xAABBGGRR, i.e. bytes R, G, B, A (GL_RGBA)
+//      ECF_V8Y8U8Y8    bytes Y0, U, Y1, V for every pair of pixels (YUY2)
+//      ECF_GRAY        one byte luminance
+//      ECF_YUV420SP    Y plane followed by an interleaved V/U plane at half
+//                      resolution (NV21, as delivered by Android cameras)
+//
+//  YUV is BT.601 with video range luminance. Converting a YUV format to
+//  ECF_GRAY copies the luminance, converting ECF_GRAY to YUV sets neutral chroma.
+//
+#ifndef __UNIFEYE_COLORCONVERT_H__
+#define __UNIFEYE_COLORCONVERT_H__
+
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+namespace unifeye
+{
+    /**
+     * \brief Check whether a pair of formats can be converted
+     * \param src the source format
+     * \param dst the destination format
+     * \return true if convertImage supports the pair
+     */
+    bool isColorConversionSupported( metaio::common::ECOLOR_FORMAT src, metaio::common::ECOLOR_FORMAT dst );
+
+    /**
+     * \brief Convert an image into another color format
+     *
+     * Both images must have the same dimensions and allocated buffers. If the
+     * origins differ (ImageStruct::originIsUpperLeft), the image is flipped
+     * vertically in the same pass. ECF_V8Y8U8Y8 requires an even width.
+     *
+     * \param src the source image
+     * \param dst the destination image, its buffer is overwritten
+     * \return false if the formats or the dimensions are not supported
+     */
+    bool convertImage( const metaio::ImageStruct& src, metaio::ImageStruct& dst );
+
+    /**
+     * \brief Merge a side by side movie frame into one image with alpha
+     *
+     * The left half of the source is the color, the red channel of the
+     * right half is the alpha, like the movies of setMovieTexture(). Source
+     * and destination are ECF_A8R8G8B8 or ECF_A8B8G8R8, the source twice as
+     * wide. The origins are handled like in convertImage.
+     *
+     * \param src the source frame
+     * \param srcStride bytes per source row, 0 if the rows are packed
+     * \param dst the destination image, its buffer is overwritten
+     * \return false if the formats or the dimensions are not supported
+     */
+    bool mergeSideBySideAlpha( const metaio::ImageStruct& src, int srcStride, metaio::ImageStruct& dst );
+
+    /**
+     * \brief Enable or disable the vectorized kernels
+     *
+     * The vectorized kernels produce the same output as the scalar ones.
+     * Disabling them is only useful to compare the two.
+     *
+     * \param enabled false to always use the scalar kernels
+     */
+    void setColorConvertSIMDEnabled( bool enabled );
+
+    /**
+     * \brief Name of the instruction set used by the vectorized kernels
+     * \return "NEON", "SSE2" or "scalar" if there are none or they are disabled
+     */
+    const char* getColorConvertSIMDPath();
+}
+
+#endif
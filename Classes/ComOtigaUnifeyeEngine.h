@@ -0,0 +1,81 @@
+//
+//  ComOtigaUnifeyeEngine.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  The SDK instance and the GL context its renderer was initialized with,
+//  shared by all views through an EngineManager. The module starts the
+//  warm-up when it loads; views acquire the instance in -init and release
+//  it in -dealloc, an unused instance is torn down after the grace period
+//  or on a memory warning. The models loaded with it are cached along with
+//  it, so a view opened again finds them loaded.
+//
+//  The delegate, the camera and the frozen tracking are state of the one
+//  instance, not of a view. The view that registered itself last owns them,
+//  a view going away only resets them while it still is the owner.
+//
+
+#import <Foundation/Foundation.h>
+#import <OpenGLES/EAGL.h>
+
+@protocol UnifeyeMobileDelegate;    // forward declaration
+
+namespace metaio
+{
+    class IUnifeyeMobileIPhone;     // forward declaration
+}
+
+namespace unifeye
+{
+    class EngineManager;            // forward declaration
+    class GeometryCache;            // forward declaration
+    class IFrameClock;              // forward declaration
+    class UnifeyeEngineBackend;     // forward declaration
+}
+
+@interface ComOtigaUnifeyeEngine : NSObject {
+    unifeye::IFrameClock* clock;
+    unifeye::UnifeyeEngineBackend* backend;
+    unifeye::EngineManager* manager;
+    id owner;                       // not retained, resigns in its -dealloc
+}
+
+// The engine of the module, created on first use.
++ (ComOtigaUnifeyeEngine*)sharedEngine;
+
+@property (nonatomic, readonly) unifeye::EngineManager* manager;
+
+// Bring up the SDK instance on a thread of its own, if it is not up yet.
+- (void)warmUp;
+
+// Take a reference to the SDK instance, blocks while it is brought up.
+// Returns NULL if it could not be created. Call from the main thread.
+- (metaio::IUnifeyeMobileIPhone*)acquireUnifeye;
+
+// Give back a reference, the instance is kept for the grace period.
+- (void)releaseUnifeye;
+
+// The context the renderer was initialized with, while a reference is held.
+- (EAGLContext*)context;
+
+// The models loaded with the instance, while a reference is held. Views
+// acquire and release them on the main thread, they are unloaded with the
+// instance.
+- (unifeye::GeometryCache*)geometryCache;
+
+// Register a view as the delegate of the instance, it owns the camera and
+// the tracking state from now on. Call while a reference is held.
+- (void)takeOwnership:(NSObject<UnifeyeMobileDelegate>*)view;
+
+// YES while the view is the one registered last.
+- (BOOL)isOwner:(id)view;
+
+// If the view still is the owner: stop the camera, unfreeze the tracking and
+// unregister the delegate. Returns NO, changing nothing, if another view took over.
+- (BOOL)resignOwnership:(id)view;
+
+// Tear down the instance if no view uses it.
+- (void)purge;
+
+@end
@@ -0,0 +1,258 @@
+//
+//  ComOtigaUnifeyeEngine.mm
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+
+#import "ComOtigaUnifeyeEngine.h"
+#import <UIKit/UIKit.h>
+#import <OpenGLES/ES2/gl.h>
+#import <UnifeyeSDKMobile/AS_IUnifeyeMobileIPhone.h>
+#include "EngineManager.h"
+#include "FrameScheduler.h"
+#include "GeometryCache.h"
+
+// Define your License here
+// for more information, please visit http://docs.metaio.com
+#define UNIFEYE_LICENSE "LLVMA/d0+x862jdnA79Wz32Gv7l3Vx4011SQa6GY6S8="
+#if !defined (UNIFEYE_LICENSE)
+#error Please provide the license string for your application
+#endif
+
+namespace unifeye
+{
+    // Creates the SDK instance with a context of its own, and the cache of
+    // the models loaded with it
+    class UnifeyeEngineBackend : public IEngineBackend
+    {
+    public:
+        UnifeyeEngineBackend( IFrameClock* _clock ) :
+            unifeyeMobile(NULL), geometryFactory(NULL), geometryCache(NULL), clock(_clock), context(nil), pool(nil)
+        {
+            // the renderer size is that of the screen the views are on
+            float scaleFactor = [UIScreen mainScreen].scale;
+            if (UI_USER_INTERFACE_IDIOM() == UIUserInterfaceIdiomPad)
+            {
+                width = 768;
+                height = 1024;
+            }
+            else
+            {
+                // Note: the dimensions of the EAGLView should match the dimensions below (360x480)
+                // the camera image has an aspect ratio of 360/480, the screen has an aspect ratio of 320/480
+                width = 360 * scaleFactor;
+                height = 480 * scaleFactor;
+            }
+        }
+
+        virtual bool runStep( ENGINE_STEP step )
+        {
+            switch (step)
+            {
+                case ENGINE_STEP_CREATE:
+                    context = [[EAGLContext alloc] initWithAPI:kEAGLRenderingAPIOpenGLES2];
+                    if (!context)
+                    {
+                        NSLog(@"Failed to create ES context");
+                        return false;
+                    }
+                    unifeyeMobile = metaio::CreateUnifeyeMobileIPhone(UNIFEYE_LICENSE);
+                    if (!unifeyeMobile)
+                    {
+                        NSLog(@"Unifeye instance could not be created. Please verify the signature string");
+                        return false;
+                    }
+                    geometryFactory = new UnifeyeGeometryFactory(unifeyeMobile);
+                    geometryCache = new GeometryCache(geometryFactory, clock);
+                    return true;
+
+                case ENGINE_STEP_RENDERER:
+                    if (![EAGLContext setCurrentContext:context])
+                    {
+                        NSLog(@"Failed to set ES context current");
+                        return false;
+                    }
+                    unifeyeMobile->initializeRenderer(width, height);
+                    return true;
+
+                case ENGINE_STEP_CALIBRATION:
+                {
+                    // a bundled calibration, else the SDK detects the device
+                    NSString* calibrationFile = [[NSBundle mainBundle] pathForResource:@"CameraCalibration" ofType:@"xml" inDirectory:@"Assets"];
+                    if (!unifeyeMobile->loadStandardCameraCalibration(calibrationFile ? [calibrationFile UTF8String] : ""))
+                        NSLog(@"No success loading the camera calibration");
+                    return true;
+                }
+
+                case ENGINE_STEP_TRACKING_DATA:
+                {
+                    // load our tracking configuration
+                    NSString* trackingDataFile = [[NSBundle mainBundle] pathForResource:@"TrackingData_MarkerlessFast" ofType:@"xml" inDirectory:@"Assets"];
+                    if (trackingDataFile && !unifeyeMobile->setTrackingData([trackingDataFile UTF8String]))
+                        NSLog(@"No success loading the tracking configuration");
+                    return true;
+                }
+
+                default:
+                    return false;
+            }
+        }
+
+        virtual void destroy()
+        {
+            // the GL objects of the renderer and the cached models go with the instance
+            if (context)
+                [EAGLContext setCurrentContext:context];
+            delete geometryCache;
+            geometryCache = NULL;
+            delete geometryFactory;
+            geometryFactory = NULL;
+            delete unifeyeMobile;
+            unifeyeMobile = NULL;
+
+            if ([EAGLContext currentContext] == context)
+                [EAGLContext setCurrentContext:nil];
+            [context release];
+            context = nil;
+        }
+
+        virtual void beginWarmUp()
+        {
+            pool = [[NSAutoreleasePool alloc] init];
+        }
+
+        virtual void endWarmUp()
+        {
+            // the views render with the context on the main thread
+            if (context && [EAGLContext currentContext] == context)
+            {
+                glFlush();
+                [EAGLContext setCurrentContext:nil];
+            }
+            [pool drain];
+            pool = nil;
+        }
+
+        metaio::IUnifeyeMobileIPhone* getUnifeye() const { return unifeyeMobile; }
+        GeometryCache* getGeometryCache() const { return geometryCache; }
+        EAGLContext* getContext() const { return context; }
+
+    private:
+        metaio::IUnifeyeMobileIPhone* unifeyeMobile;
+        IGeometryFactory* geometryFactory;
+        GeometryCache* geometryCache;
+        IFrameClock* clock;             // measures the evictions
+        EAGLContext* context;
+        NSAutoreleasePool* pool;        // of the warm-up thread
+        int width, height;
+    };
+}
+
+@interface ComOtigaUnifeyeEngine ()
+- (void)update;
+@end
+
+@implementation ComOtigaUnifeyeEngine
+
+@synthesize manager;
+
++ (ComOtigaUnifeyeEngine*)sharedEngine
+{
+    static ComOtigaUnifeyeEngine* engine = nil;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        engine = [[ComOtigaUnifeyeEngine alloc] init];
+    });
+    return engine;
+}
+
+- (id)init
+{
+    if ((self = [super init]))
+    {
+        clock = new unifeye::SystemFrameClock();
+        backend = new unifeye::UnifeyeEngineBackend(clock);
+        manager = new unifeye::EngineManager(backend, clock);
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [NSObject cancelPreviousPerformRequestsWithTarget:self];
+    delete manager;
+    delete backend;
+    delete clock;
+    [super dealloc];
+}
+
+- (void)warmUp
+{
+    manager->warmUp();
+}
+
+- (metaio::IUnifeyeMobileIPhone*)acquireUnifeye
+{
+    if (!manager->acquire())
+        return NULL;
+    return backend->getUnifeye();
+}
+
+- (void)releaseUnifeye
+{
+    manager->release();
+    [self update];
+}
+
+- (EAGLContext*)context
+{
+    return backend->getContext();
+}
+
+- (unifeye::GeometryCache*)geometryCache
+{
+    return backend->getGeometryCache();
+}
+
+- (void)update
+{
+    [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(update) object:nil];
+
+    // check again once the grace period is over
+    double remaining = manager->update();
+    if (remaining > 0)
+        [self performSelector:@selector(update) withObject:nil afterDelay:remaining];
+}
+
+- (void)takeOwnership:(NSObject<UnifeyeMobileDelegate>*)view
+{
+    owner = view;
+    backend->getUnifeye()->registerDelegate(view);
+}
+
+- (BOOL)isOwner:(id)view
+{
+    return view && owner == view;
+}
+
+- (BOOL)resignOwnership:(id)view
+{
+    if (![self isOwner:view])
+        return NO;
+    
+    // leave the instance the way the next view expects it
+    metaio::IUnifeyeMobileIPhone* unifeyeMobile = backend->getUnifeye();
+    unifeyeMobile->stopCamera();
+    unifeyeMobile->setFreezeTracking(false);
+    unifeyeMobile->registerDelegate(nil);
+    owner = nil;
+    return YES;
+}
+
+- (void)purge
+{
+    manager->purge();
+}
+
+@end
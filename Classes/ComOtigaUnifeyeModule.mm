@@ -8,6 +8,11 @@
 #import "TiBase.h"
 #import "TiHost.h"
 #import "TiUtils.h"
+#import "EAGLView.h"
+#include "GeometryCache.h"
+#include "PerfTrace.h"
+#include "EngineManager.h"
+#import "ComOtigaUnifeyeEngine.h"
 
 @implementation ComOtigaUnifeyeModule
 
@@ -33,6 +38,9 @@
 	// you *must* call the superclass
 	[super startup];
 	
+	// the SDK instance is ready by the time the first view opens
+	[[ComOtigaUnifeyeEngine sharedEngine] warmUp];
+	
 	NSLog(@"[INFO] %@ loaded",self);
 }
 
@@ -60,6 +68,9 @@
 {
 	// optionally release any resources that can be dynamically
 	// reloaded once memory is available - such as caches
+	unifeye::GeometryCache::purgeAll();
+	[EAGLView purgeScreenshotBuffers];
+	[[ComOtigaUnifeyeEngine sharedEngine] purge];
 	[super didReceiveMemoryWarning:notification];
 }
 
@@ -86,5 +97,123 @@
 
 #pragma Public APIs
 
+// Timings of the frame stages since the last resetPerfStats(), in milliseconds:
+// { render: { count, mean, min, max, p50, p90, p99, histogram: [[upTo, count], ...] }, ... }
+-(id)getPerfStats:(id)args
+{
+	std::vector<unifeye::PerfStageStats> stats;
+	unifeye::PerfTrace::getStats(stats);
+	
+	NSMutableDictionary* result = [NSMutableDictionary dictionaryWithCapacity:stats.size()];
+	for (size_t i = 0; i < stats.size(); i++)
+	{
+		const unifeye::PerfStageStats& stage = stats[i];
+		
+		// only the buckets with samples
+		NSMutableArray* histogram = [NSMutableArray array];
+		for (size_t bucket = 0; bucket < stage.histogram.size(); bucket++)
+		{
+			if (stage.histogram[bucket] == 0)
+				continue;
+			[histogram addObject:[NSArray arrayWithObjects:
+				[NSNumber numberWithDouble:unifeye::PerfTrace::getBucketLimit((int)bucket)],
+				[NSNumber numberWithUnsignedLong:stage.histogram[bucket]], nil]];
+		}
+		
+		NSDictionary* entry = [NSDictionary dictionaryWithObjectsAndKeys:
+			[NSNumber numberWithUnsignedLong:stage.count], @"count",
+			[NSNumber numberWithDouble:stage.mean], @"mean",
+			[NSNumber numberWithDouble:stage.min], @"min",
+			[NSNumber numberWithDouble:stage.max], @"max",
+			[NSNumber numberWithDouble:stage.p50], @"p50",
+			[NSNumber numberWithDouble:stage.p90], @"p90",
+			[NSNumber numberWithDouble:stage.p99], @"p99",
+			histogram, @"histogram", nil];
+		[result setObject:entry forKey:[NSString stringWithUTF8String:stage.name.c_str()]];
+	}
+	return result;
+}
+
+-(void)resetPerfStats:(id)args
+{
+	unifeye::PerfTrace::resetStats();
+}
+
+// Write the last samples of every thread as a Chrome trace (chrome://tracing).
+// Takes an optional path, returns the path written or null.
+-(id)dumpPerfTrace:(id)args
+{
+	NSString* path = [args count] > 0 ? [TiUtils stringValue:[args objectAtIndex:0]] : nil;
+	if (!path)
+	{
+		NSString* caches = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) objectAtIndex:0];
+		path = [caches stringByAppendingPathComponent:@"unifeye-trace.json"];
+	}
+	
+	if (!unifeye::PerfTrace::writeChromeTrace([path UTF8String]))
+	{
+		NSLog(@"[ERROR] could not write the trace to %@", path);
+		return [NSNull null];
+	}
+	return path;
+}
+
+-(void)setPerfTraceEnabled:(id)value
+{
+	unifeye::PerfTrace::setEnabled([TiUtils boolValue:value]);
+}
+
+-(id)perfTraceEnabled
+{
+	return [NSNumber numberWithBool:unifeye::PerfTrace::isEnabled()];
+}
+
+// What happened to the shared SDK instance since the module loaded, in milliseconds:
+// [{ name, start, duration, background, ok }, ...]
+-(id)getEngineTimeline:(id)args
+{
+	std::vector<unifeye::EngineEvent> timeline;
+	[ComOtigaUnifeyeEngine sharedEngine].manager->getTimeline(timeline);
+	
+	NSMutableArray* result = [NSMutableArray arrayWithCapacity:timeline.size()];
+	for (size_t i = 0; i < timeline.size(); i++)
+	{
+		const unifeye::EngineEvent& event = timeline[i];
+		[result addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+			[NSString stringWithUTF8String:event.name.c_str()], @"name",
+			[NSNumber numberWithDouble:event.start * 1000.0], @"start",
+			[NSNumber numberWithDouble:event.duration * 1000.0], @"duration",
+			[NSNumber numberWithBool:event.background], @"background",
+			[NSNumber numberWithBool:event.ok], @"ok", nil]];
+	}
+	return result;
+}
+
+-(id)getEngineStats:(id)args
+{
+	unifeye::EngineManager* manager = [ComOtigaUnifeyeEngine sharedEngine].manager;
+	unifeye::EngineStats stats = manager->getStats();
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+		[NSString stringWithUTF8String:unifeye::getEngineStateName(manager->getState())], @"state",
+		[NSNumber numberWithInt:manager->getReferences()], @"references",
+		[NSNumber numberWithUnsignedLong:stats.creations], @"creations",
+		[NSNumber numberWithUnsignedLong:stats.failures], @"failures",
+		[NSNumber numberWithUnsignedLong:stats.acquires], @"acquires",
+		[NSNumber numberWithUnsignedLong:stats.reuses], @"reuses",
+		[NSNumber numberWithUnsignedLong:stats.destroys], @"destroys",
+		[NSNumber numberWithDouble:stats.lastWait * 1000.0], @"lastWait", nil];
+}
+
+// Seconds the SDK instance is kept after the last view closed
+-(void)setEngineGracePeriod:(id)value
+{
+	[ComOtigaUnifeyeEngine sharedEngine].manager->setGracePeriod([TiUtils floatValue:value]);
+}
+
+-(id)engineGracePeriod
+{
+	return [NSNumber numberWithDouble:[ComOtigaUnifeyeEngine sharedEngine].manager->getGracePeriod()];
+}
+
 
 @end
@@ -0,0 +1,54 @@
+//
+//  ComOtigaUnifeyeMovieSource.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Decodes the video track of a movie file with AVAssetReader for a
+//  MoviePlayer. The frames come as 32BGRA pixel buffers, read straight out
+//  of the buffer without a copy; rewind() starts a new reader, AVAssetReader
+//  can not seek.
+//
+
+#import <AVFoundation/AVFoundation.h>
+#include "MovieTexture.h"
+
+namespace unifeye
+{
+    class AssetMovieSource : public IMovieSource
+    {
+    public:
+        /**
+         * \brief Open a movie
+         * \param path the movie file, any format AVFoundation plays
+         * \return the source or NULL if the file has no video track that can be read
+         */
+        static AssetMovieSource* open( const char* path );
+
+        virtual ~AssetMovieSource();
+
+        virtual int getWidth() const { return width; }
+        virtual int getHeight() const { return height; }
+        virtual metaio::common::ECOLOR_FORMAT getColorFormat() const { return metaio::common::ECF_A8R8G8B8; }
+        virtual double getFrameRate() const { return frameRate; }
+
+        virtual bool read( MovieSourceFrame& frame );
+        virtual bool rewind();
+
+    private:
+        AssetMovieSource( AVURLAsset* asset, AVAssetTrack* track );
+        AssetMovieSource( const AssetMovieSource& );
+        AssetMovieSource& operator=( const AssetMovieSource& );
+
+        bool startReading();
+        void releaseSample();
+
+        AVURLAsset* asset;
+        AVAssetTrack* track;
+        AVAssetReader* reader;
+        AVAssetReaderTrackOutput* output;
+        CMSampleBufferRef sample;       // the frame handed out last, its pixels locked
+        int width, height;
+        double frameRate;
+    };
+}
@@ -0,0 +1,113 @@
+//
+//  ComOtigaUnifeyeMovieSource.mm
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+
+#import "ComOtigaUnifeyeMovieSource.h"
+#import <CoreVideo/CoreVideo.h>
+
+namespace unifeye
+{
+    AssetMovieSource* AssetMovieSource::open( const char* path )
+    {
+        NSURL* url = [NSURL fileURLWithPath:[NSString stringWithUTF8String:path]];
+        AVURLAsset* asset = [[AVURLAsset alloc] initWithURL:url options:nil];
+        NSArray* tracks = [asset tracksWithMediaType:AVMediaTypeVideo];
+        if ([tracks count] == 0)
+        {
+            [asset release];
+            return NULL;
+        }
+
+        AssetMovieSource* source = new AssetMovieSource(asset, [tracks objectAtIndex:0]);
+        [asset release];
+        if (!source->startReading())
+        {
+            delete source;
+            return NULL;
+        }
+        return source;
+    }
+
+    AssetMovieSource::AssetMovieSource( AVURLAsset* _asset, AVAssetTrack* _track ) :
+        asset([_asset retain]), track([_track retain]), reader(nil), output(nil), sample(NULL)
+    {
+        CGSize size = [track naturalSize];
+        width = (int)size.width;
+        height = (int)size.height;
+        frameRate = [track nominalFrameRate];
+    }
+
+    AssetMovieSource::~AssetMovieSource()
+    {
+        releaseSample();
+        [reader cancelReading];
+        [reader release];
+        [output release];
+        [track release];
+        [asset release];
+    }
+
+    bool AssetMovieSource::startReading()
+    {
+        releaseSample();
+        [reader cancelReading];
+        [reader release];
+        [output release];
+
+        NSError* error = nil;
+        reader = [[AVAssetReader alloc] initWithAsset:asset error:&error];
+        NSDictionary* settings = [NSDictionary dictionaryWithObject:[NSNumber numberWithInt:kCVPixelFormatType_32BGRA]
+                                                             forKey:(id)kCVPixelBufferPixelFormatTypeKey];
+        output = [[AVAssetReaderTrackOutput alloc] initWithTrack:track outputSettings:settings];
+        if (!reader || ![reader canAddOutput:output])
+        {
+            NSLog(@"[ERROR] the movie can not be read: %@", error);
+            return false;
+        }
+        [reader addOutput:output];
+        return [reader startReading];
+    }
+
+    void AssetMovieSource::releaseSample()
+    {
+        if (!sample)
+            return;
+        CVPixelBufferUnlockBaseAddress(CMSampleBufferGetImageBuffer(sample), 0);
+        CFRelease(sample);
+        sample = NULL;
+    }
+
+    bool AssetMovieSource::read( MovieSourceFrame& frame )
+    {
+        releaseSample();
+
+        // the thread of the player has no pool of its own
+        NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+        sample = [output copyNextSampleBuffer];
+        [pool drain];
+        if (!sample)
+            return false;
+
+        CVImageBufferRef image = CMSampleBufferGetImageBuffer(sample);
+        if (!image || (int)CVPixelBufferGetWidth(image) != width || (int)CVPixelBufferGetHeight(image) != height)
+        {
+            CFRelease(sample);
+            sample = NULL;
+            return false;
+        }
+
+        CVPixelBufferLockBaseAddress(image, 0);
+        frame.pixels = (const unsigned char*)CVPixelBufferGetBaseAddress(image);
+        frame.stride = (int)CVPixelBufferGetBytesPerRow(image);
+        frame.time = CMTimeGetSeconds(CMSampleBufferGetPresentationTimeStamp(sample));
+        return true;
+    }
+
+    bool AssetMovieSource::rewind()
+    {
+        return startReading();
+    }
+}
@@ -0,0 +1,46 @@
+//
+//  ComOtigaUnifeyeSensorSource.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Feeds the accelerometer, the compass heading and the GPS position into
+//  a SensorPipeline. CoreMotion delivers on a background queue, CoreLocation
+//  on the main run loop; neither waits for the render loop.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreMotion/CoreMotion.h>
+#import <CoreLocation/CoreLocation.h>
+
+namespace unifeye
+{
+    class SensorPipeline;           // forward declaration
+    class IFrameClock;              // forward declaration
+}
+
+@interface ComOtigaUnifeyeSensorSource : NSObject <CLLocationManagerDelegate> {
+    unifeye::SensorPipeline* pipeline;      // not owned
+    unifeye::IFrameClock* clock;            // not owned, the timestamps are on this clock
+
+    CMMotionManager* motionManager;
+    NSOperationQueue* motionQueue;          // serial, so the accelerometer has one producer
+    CLLocationManager* locationManager;
+
+    double accelerometerRate;
+    BOOL running;
+}
+
+// Samples per second of the accelerometer, default 100.
+@property (nonatomic, assign) double accelerometerRate;
+
+@property (nonatomic, readonly) BOOL running;
+
+- (id)initWithPipeline:(unifeye::SensorPipeline*)aPipeline clock:(unifeye::IFrameClock*)aClock;
+
+// Start or stop all sensors, call from the main thread. Once stop returns
+// no sample reaches the pipeline any more.
+- (void)start;
+- (void)stop;
+
+@end
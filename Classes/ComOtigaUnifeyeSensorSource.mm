@@ -0,0 +1,123 @@
+//
+//  ComOtigaUnifeyeSensorSource.mm
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+
+#import "ComOtigaUnifeyeSensorSource.h"
+#include "SensorPipeline.h"
+#include "FrameScheduler.h"
+
+@implementation ComOtigaUnifeyeSensorSource
+
+@synthesize accelerometerRate, running;
+
+- (id)initWithPipeline:(unifeye::SensorPipeline*)aPipeline clock:(unifeye::IFrameClock*)aClock
+{
+    if ((self = [super init]))
+    {
+        pipeline = aPipeline;
+        clock = aClock;
+        accelerometerRate = 100.0;
+
+        motionManager = [[CMMotionManager alloc] init];
+        motionQueue = [[NSOperationQueue alloc] init];
+        [motionQueue setMaxConcurrentOperationCount:1];
+
+        locationManager = [[CLLocationManager alloc] init];
+        locationManager.delegate = self;
+        locationManager.desiredAccuracy = kCLLocationAccuracyBest;
+        locationManager.headingFilter = 1.0;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self stop];
+    locationManager.delegate = nil;
+    [locationManager release];
+    [motionQueue release];
+    [motionManager release];
+    [super dealloc];
+}
+
+- (void)setAccelerometerRate:(double)rate
+{
+    accelerometerRate = rate > 1.0 ? rate : 1.0;
+    motionManager.accelerometerUpdateInterval = 1.0 / accelerometerRate;
+}
+
+- (void)start
+{
+    if (running)
+        return;
+    running = YES;
+
+    // CoreMotion timestamps are seconds since boot, the same clock as mach_absolute_time()
+    if (motionManager.accelerometerAvailable)
+    {
+        unifeye::SensorPipeline* target = pipeline;
+        motionManager.accelerometerUpdateInterval = 1.0 / accelerometerRate;
+        [motionManager startAccelerometerUpdatesToQueue:motionQueue withHandler:^(CMAccelerometerData* data, NSError* error) {
+            if (data)
+            {
+                CMAcceleration a = data.acceleration;
+                target->pushAccelerometer(metaio::Vector3d((float)a.x, (float)a.y, (float)a.z), data.timestamp);
+            }
+        }];
+    }
+
+    if ([CLLocationManager headingAvailable])
+        [locationManager startUpdatingHeading];
+    [locationManager startUpdatingLocation];
+}
+
+- (void)stop
+{
+    if (!running)
+        return;
+    running = NO;
+
+    // the handlers already queued hold the pipeline, it may be deleted once we return
+    [motionManager stopAccelerometerUpdates];
+    [motionQueue cancelAllOperations];
+    [motionQueue waitUntilAllOperationsAreFinished];
+    [locationManager stopUpdatingHeading];
+    [locationManager stopUpdatingLocation];
+}
+
+// CoreLocation stamps with wall clock dates, move them onto the frame clock
+- (double)timestampOf:(NSDate*)date
+{
+    return clock->now() + [date timeIntervalSinceNow];
+}
+
+#pragma mark CLLocationManagerDelegate
+
+- (void)locationManager:(CLLocationManager*)manager didUpdateHeading:(CLHeading*)heading
+{
+    if (heading.headingAccuracy < 0)
+        return;
+
+    double angle = heading.trueHeading >= 0 ? heading.trueHeading : heading.magneticHeading;
+    pipeline->pushCompassAngle((float)angle, [self timestampOf:heading.timestamp]);
+}
+
+- (void)locationManager:(CLLocationManager*)manager didUpdateToLocation:(CLLocation*)location fromLocation:(CLLocation*)oldLocation
+{
+    if (location.horizontalAccuracy < 0)
+        return;
+
+    metaio::LLACoordinate position(location.coordinate.latitude, location.coordinate.longitude, location.altitude,
+                                   location.horizontalAccuracy);
+    pipeline->pushLLA(position, [self timestampOf:location.timestamp]);
+}
+
+- (void)locationManager:(CLLocationManager*)manager didFailWithError:(NSError*)error
+{
+    NSLog(@"[Sensors] location failed: %@", error);
+}
+
+@end
@@ -0,0 +1,454 @@
+//
+//  CommandBuffer.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "CommandBuffer.h"
+#include "FrustumCuller.h"
+
+#include <float.h>
+#include <string.h>
+#include <UnifeyeSDKMobile/AS_IUnifeyeMobileGeometry.h>
+
+namespace unifeye
+{
+    namespace
+    {
+        inline unsigned int readWord( const unsigned char* p )
+        {
+            return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+        }
+
+        inline float readFloat( const unsigned char* p )
+        {
+            unsigned int word = readWord(p);
+            float value;
+            memcpy(&value, &word, sizeof(value));
+            return value;
+        }
+
+        inline bool isFinite( float value )
+        {
+            return value == value && value <= FLT_MAX && value >= -FLT_MAX;
+        }
+
+        // true if the words at p are finite floats
+        bool areFinite( const unsigned char* p, int words )
+        {
+            for (int i = 0; i < words; i++)
+            {
+                if (!isFinite(readFloat(p + 4 * i)))
+                    return false;
+            }
+            return true;
+        }
+
+        /**
+         * Walk the commands after the magic. Without a target they are only
+         * checked; with one they must have been checked before.
+         */
+        CommandResult decode( const unsigned char* data, size_t size, ICommandTarget* target )
+        {
+            CommandResult result;
+            size_t offset = 0;
+            while (offset < size)
+            {
+                const unsigned char* p = data + offset;
+                size_t left = size - offset;
+                if (left < 4)
+                    break;
+
+                unsigned int word = readWord(p);
+                int handle = (int)(word >> 8);
+                size_t length = 0;
+                bool valid = false;
+                switch (word & 0xff)
+                {
+                    case COMMAND_SET_TRANSLATION:
+                    case COMMAND_SET_SCALE:
+                        length = 16;
+                        valid = left >= length && (target || areFinite(p + 4, 3));
+                        if (valid && target)
+                        {
+                            metaio::Vector3d vector(readFloat(p + 4), readFloat(p + 8), readFloat(p + 12));
+                            if ((word & 0xff) == COMMAND_SET_TRANSLATION)
+                                target->setMoveTranslation(handle, vector);
+                            else
+                                target->setMoveScale(handle, vector);
+                        }
+                        break;
+
+                    case COMMAND_SET_ROTATION:
+                        length = 20;
+                        valid = left >= length && (target || areFinite(p + 4, 4));
+                        if (valid && target)
+                        {
+                            target->setMoveRotation(handle, metaio::Vector4d(readFloat(p + 4), readFloat(p + 8),
+                                readFloat(p + 12), readFloat(p + 16)));
+                        }
+                        break;
+
+                    case COMMAND_SET_VISIBLE:
+                        length = 8;
+                        valid = left >= length && readWord(p + 4) <= 1;
+                        if (valid && target)
+                            target->setVisible(handle, readWord(p + 4) != 0);
+                        break;
+
+                    case COMMAND_SET_TRANSPARENCY:
+                        length = 8;
+                        valid = left >= length && readWord(p + 4) <= 255;
+                        if (valid && target)
+                            target->setTransparency(handle, (unsigned char)readWord(p + 4));
+                        break;
+
+                    case COMMAND_START_ANIMATION:
+                    {
+                        valid = left >= 12 && readWord(p + 4) <= 1;
+                        if (!valid)
+                            break;
+                        size_t nameLength = readWord(p + 8);
+                        valid = nameLength <= left - 12;
+                        length = 12 + ((nameLength + 3) & ~(size_t)3);
+                        valid = valid && length <= left;
+                        if (valid && target)
+                        {
+                            target->startAnimation(handle, std::string((const char*)p + 12, nameLength),
+                                readWord(p + 4) != 0);
+                        }
+                        break;
+                    }
+
+                    default:
+                        break;
+                }
+
+                if (!valid)
+                {
+                    result.ok = false;
+                    result.errorOffset = offset;
+                    return result;
+                }
+                offset += length;
+                result.commands++;
+            }
+
+            // a partial word at the end
+            if (offset != size)
+            {
+                result.ok = false;
+                result.errorOffset = offset;
+            }
+            return result;
+        }
+
+        CommandResult checkMagic( const unsigned char* data, size_t size )
+        {
+            CommandResult result;
+            if (size < 4 || readWord(data) != COMMAND_MAGIC)
+                result.ok = false;
+            return result;
+        }
+    }
+
+    const char* getCommandName( COMMAND_OP op )
+    {
+        switch (op)
+        {
+            case COMMAND_SET_TRANSLATION: return "setMoveTranslation";
+            case COMMAND_SET_ROTATION: return "setMoveRotation";
+            case COMMAND_SET_SCALE: return "setMoveScale";
+            case COMMAND_SET_VISIBLE: return "setVisible";
+            case COMMAND_SET_TRANSPARENCY: return "setTransparency";
+            case COMMAND_START_ANIMATION: return "startAnimation";
+            default: return "unknown";
+        }
+    }
+
+    CommandEncoder::CommandEncoder()
+    {
+        clear();
+    }
+
+    void CommandEncoder::clear()
+    {
+        data.clear();
+        count = 0;
+        putWord(COMMAND_MAGIC);
+    }
+
+    void CommandEncoder::putWord( unsigned int word )
+    {
+        unsigned char bytes[4] = { (unsigned char)word, (unsigned char)(word >> 8), (unsigned char)(word >> 16),
+            (unsigned char)(word >> 24) };
+        data.insert(data.end(), bytes, bytes + 4);
+    }
+
+    void CommandEncoder::putFloat( float value )
+    {
+        unsigned int word;
+        memcpy(&word, &value, sizeof(word));
+        putWord(word);
+    }
+
+    void CommandEncoder::putCommand( COMMAND_OP op, int handle )
+    {
+        putWord((unsigned int)op | ((unsigned int)handle & COMMAND_MAX_HANDLE) << 8);
+        count++;
+    }
+
+    void CommandEncoder::setMoveTranslation( int handle, float x, float y, float z )
+    {
+        putCommand(COMMAND_SET_TRANSLATION, handle);
+        putFloat(x);
+        putFloat(y);
+        putFloat(z);
+    }
+
+    void CommandEncoder::setMoveRotation( int handle, float x, float y, float z, float angle )
+    {
+        putCommand(COMMAND_SET_ROTATION, handle);
+        putFloat(x);
+        putFloat(y);
+        putFloat(z);
+        putFloat(angle);
+    }
+
+    void CommandEncoder::setMoveScale( int handle, float x, float y, float z )
+    {
+        putCommand(COMMAND_SET_SCALE, handle);
+        putFloat(x);
+        putFloat(y);
+        putFloat(z);
+    }
+
+    void CommandEncoder::setVisible( int handle, bool visible )
+    {
+        putCommand(COMMAND_SET_VISIBLE, handle);
+        putWord(visible ? 1 : 0);
+    }
+
+    void CommandEncoder::setTransparency( int handle, unsigned char transparency )
+    {
+        putCommand(COMMAND_SET_TRANSPARENCY, handle);
+        putWord(transparency);
+    }
+
+    void CommandEncoder::startAnimation( int handle, const std::string& name, bool loop )
+    {
+        putCommand(COMMAND_START_ANIMATION, handle);
+        putWord(loop ? 1 : 0);
+        putWord((unsigned int)name.size());
+        data.insert(data.end(), name.begin(), name.end());
+        data.resize((data.size() + 3) & ~(size_t)3, 0);
+    }
+
+    CommandResult checkCommands( const void* data, size_t size )
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        CommandResult result = checkMagic(bytes, size);
+        if (!result.ok)
+            return result;
+
+        result = decode(bytes + 4, size - 4, NULL);
+        result.errorOffset += 4;
+        return result;
+    }
+
+    CommandResult applyCommands( const void* data, size_t size, ICommandTarget& target )
+    {
+        CommandResult result = checkCommands(data, size);
+        if (!result.ok)
+            return result;
+
+        decode(static_cast<const unsigned char*>(data) + 4, size - 4, &target);
+        target.endBatch();
+        return result;
+    }
+
+    CommandResult CommandQueue::submit( const void* data, size_t size )
+    {
+        CommandResult result = checkCommands(data, size);
+
+        ScopedLock lock(mutex);
+        stats.batches++;
+        if (!result.ok)
+        {
+            stats.rejected++;
+            return result;
+        }
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        pending.insert(pending.end(), bytes + 4, bytes + size);
+        return result;
+    }
+
+    unsigned long CommandQueue::apply( ICommandTarget& target )
+    {
+        {
+            ScopedLock lock(mutex);
+            if (pending.empty())
+                return 0;
+            pending.swap(applying);
+        }
+
+        // checked by submit(), the lock is not held while the SDK is called
+        unsigned long commands = decode(&applying[0], applying.size(), &target).commands;
+        target.endBatch();
+        applying.clear();
+
+        ScopedLock lock(mutex);
+        stats.commands += commands;
+        stats.frames++;
+        return commands;
+    }
+
+    CommandQueueStats CommandQueue::getStats() const
+    {
+        ScopedLock lock(mutex);
+        return stats;
+    }
+
+    UnifeyeCommandTarget::UnifeyeCommandTarget( UnifeyeFrustumCulling* _culling ) :
+        culling(_culling), unknownHandles(0)
+    {
+    }
+
+    int UnifeyeCommandTarget::addGeometry( metaio::IUnifeyeMobileGeometry* geometry )
+    {
+        if (!geometry || (int)geometries.size() >= COMMAND_MAX_HANDLE)
+            return 0;
+        geometries.push_back(geometry);
+        hidden.push_back(false);
+        dirty.push_back(false);
+        if (culling)
+            culling->addGeometry(geometry);
+        return (int)geometries.size();
+    }
+
+    metaio::IUnifeyeMobileGeometry* UnifeyeCommandTarget::removeGeometry( int handle )
+    {
+        metaio::IUnifeyeMobileGeometry* geometry = getGeometry(handle);
+        if (!geometry)
+            return NULL;
+
+        // left visible, like the culling leaves the geometries it stops culling
+        if (hidden[handle - 1])
+            geometry->setVisible(true);
+        else if (culling)
+            culling->removeGeometry(geometry);
+        geometries[handle - 1] = NULL;
+        dirty[handle - 1] = false;
+        return geometry;
+    }
+
+    metaio::IUnifeyeMobileGeometry* UnifeyeCommandTarget::getGeometry( int handle ) const
+    {
+        return handle >= 1 && handle <= (int)geometries.size() ? geometries[handle - 1] : NULL;
+    }
+
+    int UnifeyeCommandTarget::findHandle( const metaio::IUnifeyeMobileGeometry* geometry ) const
+    {
+        for (size_t i = 0; geometry && i < geometries.size(); i++)
+        {
+            if (geometries[i] == geometry)
+                return (int)i + 1;
+        }
+        return 0;
+    }
+
+    metaio::IUnifeyeMobileGeometry* UnifeyeCommandTarget::find( int handle )
+    {
+        metaio::IUnifeyeMobileGeometry* geometry = getGeometry(handle);
+        if (!geometry)
+            unknownHandles++;
+        return geometry;
+    }
+
+    void UnifeyeCommandTarget::moved( int handle )
+    {
+        if (dirty[handle - 1])
+            return;
+        dirty[handle - 1] = true;
+        movedHandles.push_back(handle);
+    }
+
+    void UnifeyeCommandTarget::setMoveTranslation( int handle, const metaio::Vector3d& translation )
+    {
+        metaio::IUnifeyeMobileGeometry* geometry = find(handle);
+        if (!geometry)
+            return;
+        geometry->setMoveTranslation(translation);
+        moved(handle);
+    }
+
+    void UnifeyeCommandTarget::setMoveRotation( int handle, const metaio::Vector4d& rotation )
+    {
+        metaio::IUnifeyeMobileGeometry* geometry = find(handle);
+        if (!geometry)
+            return;
+        geometry->setMoveRotation(rotation);
+        moved(handle);
+    }
+
+    void UnifeyeCommandTarget::setMoveScale( int handle, const metaio::Vector3d& scale )
+    {
+        metaio::IUnifeyeMobileGeometry* geometry = find(handle);
+        if (!geometry)
+            return;
+        geometry->setMoveScale(scale);
+        moved(handle);
+    }
+
+    void UnifeyeCommandTarget::setVisible( int handle, bool visible )
+    {
+        metaio::IUnifeyeMobileGeometry* geometry = find(handle);
+        if (!geometry || hidden[handle - 1] == !visible)
+            return;
+        hidden[handle - 1] = !visible;
+
+        // the culling would show a hidden geometry again
+        if (culling && visible)
+        {
+            geometry->setVisible(true);
+            culling->addGeometry(geometry);
+        }
+        else if (culling)
+        {
+            culling->removeGeometry(geometry);
+            geometry->setVisible(false);
+        }
+        else
+        {
+            geometry->setVisible(visible);
+        }
+    }
+
+    void UnifeyeCommandTarget::setTransparency( int handle, unsigned char transparency )
+    {
+        metaio::IUnifeyeMobileGeometry* geometry = find(handle);
+        if (geometry)
+            geometry->setTransparency(transparency);
+    }
+
+    void UnifeyeCommandTarget::startAnimation( int handle, const std::string& name, bool loop )
+    {
+        metaio::IUnifeyeMobileGeometry* geometry = find(handle);
+        if (geometry)
+            geometry->startAnimation(name, loop);
+    }
+
+    void UnifeyeCommandTarget::endBatch()
+    {
+        // one new box per moved geometry, however often it moved
+        for (size_t i = 0; i < movedHandles.size(); i++)
+        {
+            int handle = movedHandles[i];
+            dirty[handle - 1] = false;
+            metaio::IUnifeyeMobileGeometry* geometry = geometries[handle - 1];
+            if (culling && geometry && !hidden[handle - 1])
+                culling->refresh(geometry);
+        }
+        movedHandles.clear();
+    }
+}
@@ -0,0 +1,248 @@
+//
+//  CommandBuffer.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Scene updates from JavaScript in one call per frame instead of one per
+//  geometry and property. A batch is a binary buffer of commands that
+//  address geometries by handle; it is checked when it is submitted and
+//  applied in one pass at the start of the next frame.
+//
+//  The format is little endian and made of 32 bit words, so it can be
+//  written with Ti.Codec or a DataView:
+//
+//      magic       "UCB1" (0x31424355)
+//      command*    op (low 8 bits) | handle << 8, followed by
+//          SET_TRANSLATION     x, y, z             float32
+//          SET_ROTATION        x, y, z, angle      float32, axis and angle in radians
+//          SET_SCALE           x, y, z             float32
+//          SET_VISIBLE         visible             uint32, 0 or 1
+//          SET_TRANSPARENCY    transparency        uint32, 0 (opaque) to 255 (invisible)
+//          START_ANIMATION     loop, length        uint32, then the UTF-8 name padded to 4 bytes
+//
+#ifndef __UNIFEYE_COMMANDBUFFER_H__
+#define __UNIFEYE_COMMANDBUFFER_H__
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+#include "Threading.h"
+
+namespace metaio
+{
+    class IUnifeyeMobileGeometry;   // forward declaration
+}
+
+namespace unifeye
+{
+    class UnifeyeFrustumCulling;    // forward declaration
+
+    /// First word of a batch
+    const unsigned int COMMAND_MAGIC = 0x31424355;
+
+    /// The largest geometry handle, it has 24 bits
+    const int COMMAND_MAX_HANDLE = 0xffffff;
+
+    /// The commands of a batch
+    enum COMMAND_OP
+    {
+        COMMAND_SET_TRANSLATION = 1,
+        COMMAND_SET_ROTATION = 2,
+        COMMAND_SET_SCALE = 3,
+        COMMAND_SET_VISIBLE = 4,
+        COMMAND_SET_TRANSPARENCY = 5,
+        COMMAND_START_ANIMATION = 6
+    };
+
+    /// Name of a command for logs
+    const char* getCommandName( COMMAND_OP op );
+
+    /**
+     * \brief Receives the commands of a batch
+     */
+    class ICommandTarget
+    {
+    public:
+        virtual ~ICommandTarget() {};
+
+        virtual void setMoveTranslation( int handle, const metaio::Vector3d& translation ) = 0;
+        virtual void setMoveRotation( int handle, const metaio::Vector4d& rotation ) = 0;
+        virtual void setMoveScale( int handle, const metaio::Vector3d& scale ) = 0;
+        virtual void setVisible( int handle, bool visible ) = 0;
+        virtual void setTransparency( int handle, unsigned char transparency ) = 0;
+        virtual void startAnimation( int handle, const std::string& name, bool loop ) = 0;
+
+        /// Called after the last command of the batches applied together
+        virtual void endBatch() {};
+    };
+
+    /**
+     * \brief Writes a batch
+     */
+    class CommandEncoder
+    {
+    public:
+        CommandEncoder();
+
+        void setMoveTranslation( int handle, float x, float y, float z );
+        void setMoveRotation( int handle, float x, float y, float z, float angle );
+        void setMoveScale( int handle, float x, float y, float z );
+        void setVisible( int handle, bool visible );
+        void setTransparency( int handle, unsigned char transparency );
+        void startAnimation( int handle, const std::string& name, bool loop );
+
+        /// Start a new batch
+        void clear();
+
+        const unsigned char* getData() const { return &data[0]; }
+        size_t getSize() const { return data.size(); }
+
+        /// Commands written since clear()
+        unsigned long getCount() const { return count; }
+
+    private:
+        void putCommand( COMMAND_OP op, int handle );
+        void putWord( unsigned int word );
+        void putFloat( float value );
+
+        std::vector<unsigned char> data;
+        unsigned long count;
+    };
+
+    /**
+     * \brief What checking or applying a batch found
+     */
+    struct CommandResult
+    {
+        bool ok;                        ///< false if the batch is malformed, nothing was applied then
+        size_t errorOffset;             ///< byte offset of the first malformed command
+        unsigned long commands;         ///< commands in the batch
+
+        CommandResult() : ok(true), errorOffset(0), commands(0) {};
+    };
+
+    /**
+     * \brief Check a batch without applying it
+     * \param data the batch, with the magic
+     * \param size its size in bytes
+     */
+    CommandResult checkCommands( const void* data, size_t size );
+
+    /**
+     * \brief Check a batch and apply it if it is well formed
+     * \return the result of the check
+     */
+    CommandResult applyCommands( const void* data, size_t size, ICommandTarget& target );
+
+    /**
+     * \brief Counters of a CommandQueue
+     */
+    struct CommandQueueStats
+    {
+        unsigned long batches;          ///< batches submitted
+        unsigned long rejected;         ///< batches that were malformed
+        unsigned long commands;         ///< commands applied
+        unsigned long frames;           ///< apply() calls that had commands
+
+        CommandQueueStats() : batches(0), rejected(0), commands(0), frames(0) {};
+    };
+
+    /**
+     * \brief Batches from JavaScript, applied by the render loop
+     *
+     * submit() may be called from any thread, apply() from the render
+     * loop; batches submitted between two frames are applied together, in
+     * order.
+     */
+    class CommandQueue
+    {
+    public:
+        CommandQueue() {};
+
+        /**
+         * \brief Check a batch and queue it for the next frame
+         * \return the result of the check, a malformed batch is dropped
+         */
+        CommandResult submit( const void* data, size_t size );
+
+        /**
+         * \brief Apply the queued batches
+         * \return the number of commands applied
+         */
+        unsigned long apply( ICommandTarget& target );
+
+        CommandQueueStats getStats() const;
+
+    private:
+        CommandQueue( const CommandQueue& );
+        CommandQueue& operator=( const CommandQueue& );
+
+        mutable Mutex mutex;
+        std::vector<unsigned char> pending;     // the commands of the submitted batches, without the magic
+        std::vector<unsigned char> applying;    // swapped with pending, only for the render loop
+        CommandQueueStats stats;
+    };
+
+    /**
+     * \brief Applies commands to geometries of an SDK instance
+     *
+     * Handles are given out by addGeometry() and not reused, so a command
+     * for a removed geometry is skipped. The geometries are frustum culled
+     * while they have a handle, except while they are hidden; moved ones
+     * are culled with their new box from the next frame on.
+     */
+    class UnifeyeCommandTarget : public ICommandTarget
+    {
+    public:
+        /**
+         * \brief Constructor
+         * \param culling the culling of the geometries, not owned, may be NULL
+         */
+        explicit UnifeyeCommandTarget( UnifeyeFrustumCulling* culling );
+
+        /// The handle of a geometry, 0 if there are no more; starts culling it
+        int addGeometry( metaio::IUnifeyeMobileGeometry* geometry );
+
+        /// Forget a handle and leave its geometry visible, returns the geometry or NULL
+        metaio::IUnifeyeMobileGeometry* removeGeometry( int handle );
+
+        /// The geometry of a handle, NULL if unknown
+        metaio::IUnifeyeMobileGeometry* getGeometry( int handle ) const;
+
+        /// The handle of a geometry, 0 if it has none
+        int findHandle( const metaio::IUnifeyeMobileGeometry* geometry ) const;
+
+        /// Handles given out, including removed ones
+        int getHandleCount() const { return (int)geometries.size(); }
+
+        /// Commands skipped for unknown handles
+        unsigned long getUnknownHandles() const { return unknownHandles; }
+
+        virtual void setMoveTranslation( int handle, const metaio::Vector3d& translation );
+        virtual void setMoveRotation( int handle, const metaio::Vector4d& rotation );
+        virtual void setMoveScale( int handle, const metaio::Vector3d& scale );
+        virtual void setVisible( int handle, bool visible );
+        virtual void setTransparency( int handle, unsigned char transparency );
+        virtual void startAnimation( int handle, const std::string& name, bool loop );
+        virtual void endBatch();
+
+    private:
+        UnifeyeCommandTarget( const UnifeyeCommandTarget& );
+        UnifeyeCommandTarget& operator=( const UnifeyeCommandTarget& );
+
+        metaio::IUnifeyeMobileGeometry* find( int handle );
+        void moved( int handle );
+
+        UnifeyeFrustumCulling* culling;
+        std::vector<metaio::IUnifeyeMobileGeometry*> geometries;   // by handle - 1, NULL once removed
+        std::vector<bool> hidden;
+        std::vector<bool> dirty;        // moved in this batch
+        std::vector<int> movedHandles;
+        unsigned long unknownHandles;
+    };
+}
+
+#endif
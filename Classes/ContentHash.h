@@ -0,0 +1,39 @@
+//
+//  ContentHash.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  64 bit FNV-1a, used to recognize files by their content. Not meant to be
+//  cryptographically secure.
+//
+#ifndef __UNIFEYE_CONTENTHASH_H__
+#define __UNIFEYE_CONTENTHASH_H__
+
+#include <stddef.h>
+
+namespace unifeye
+{
+    /// Hash of no data, the start value of hashBytes()
+    const unsigned long long CONTENT_HASH_INITIAL = 14695981039346656037ULL;
+
+    /**
+     * \brief Continue a hash with more data
+     * \param data the bytes to add
+     * \param size number of bytes
+     * \param hash the hash of the data before, CONTENT_HASH_INITIAL to start
+     * \return the hash including the new data
+     */
+    inline unsigned long long hashBytes( const void* data, size_t size, unsigned long long hash = CONTENT_HASH_INITIAL )
+    {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+}
+
+#endif
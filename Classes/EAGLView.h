@@ -14,6 +14,7 @@
 
 @class EAGLContext;
 
+typedef void (^EAGLViewScreenshotHandler)(UIImage* screenshot);
 
 
 // This class wraps the CAEAGLLayer from CoreAnimation into a convenient UIView subclass.
@@ -28,6 +29,9 @@
     
     // The OpenGL ES names for the framebuffer and renderbuffer used to render to this view.
     GLuint defaultFramebuffer, colorRenderbuffer, depthRenderbuffer;
+    
+    // pending asynchronous screenshot requests, only touched on the main thread
+    NSMutableArray* screenshotHandlers;
 }
 
 @property (nonatomic, retain) EAGLContext *context;
@@ -37,6 +41,15 @@
 
 - (UIImage*) getScreenshotImage;
 
+// Read the next presented frame and deliver it on the main thread.
+// Conversion to the image happens on a background queue. Requests made
+// before the frame all get the same image; requests still pending when the
+// view goes away get nil. Can be called from any thread.
+- (void) requestScreenshot:(EAGLViewScreenshotHandler)handler;
+
+// Free the screenshot buffers that are not in use, e.g. on memory warnings.
++ (void) purgeScreenshotBuffers;
+
 
 
 @end
@@ -7,13 +7,71 @@
 #import <QuartzCore/QuartzCore.h>
 
 #import "EAGLView.h"
+#include "ColorConvert.h"
+#include "PixelBufferPool.h"
+#include "PerfTrace.h"
 
 @interface EAGLView (PrivateMethods)
+- (void)setupLayer;
 - (void)createFramebuffer;
 - (void)deleteFramebuffer;
+- (unsigned char*)readFramebuffer;
 @end
 
 
+// Shared by all views, screenshots can outlive the view they were taken from
+static unifeye::PixelBufferPool* screenshotPool()
+{
+    static unifeye::PixelBufferPool* pool = new unifeye::PixelBufferPool();
+    return pool;
+}
+
+static dispatch_queue_t screenshotQueue()
+{
+    static dispatch_queue_t queue;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        queue = dispatch_queue_create("com.otiga.unifeye.screenshot", NULL);
+    });
+    return queue;
+}
+
+static void releaseScreenshotData(void* info, const void* data, size_t size)
+{
+    screenshotPool()->release((unsigned char*)data);
+}
+
+// Turns a glReadPixels result into an image, the readback buffer is released
+static UIImage* imageFromFramebufferPixels(unsigned char* pixels, GLint width, GLint height)
+{
+    size_t size = (size_t)width * height * 4;
+    unsigned char* imgData = screenshotPool()->acquire(size);
+    
+    // GL rows start at the bottom: flip and swizzle to BGRA in a single pass
+    // instead of redrawing through a second bitmap context
+    metaio::ImageStruct src(pixels, width, height, metaio::common::ECF_A8B8G8R8, false);
+    metaio::ImageStruct dst(imgData, width, height, metaio::common::ECF_A8R8G8B8, true);
+    unifeye::convertImage(src, dst);
+    screenshotPool()->release(pixels);
+    
+	CGDataProviderRef provider = CGDataProviderCreateWithData(NULL, imgData, size, releaseScreenshotData);
+	CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Little | kCGImageAlphaNoneSkipFirst;
+	
+	CGColorRenderingIntent intent = kCGRenderingIntentDefault;
+	CGColorSpaceRef space = CGColorSpaceCreateDeviceRGB();
+	
+	CGImageRef imgRef = CGImageCreate(width, height, 8, 32, width*4, space, bitmapInfo, provider, NULL, NO, intent);
+	UIImage* screenshot = [UIImage imageWithCGImage:imgRef];
+    
+	// release all used objects, the pixels go back to the pool with the image
+	CGDataProviderRelease(provider);
+	CGColorSpaceRelease(space);
+	CGImageRelease(imgRef);
+    
+	return screenshot;
+}
+
+
 @implementation EAGLView
 @synthesize context;
 
@@ -24,20 +82,36 @@
     return [CAEAGLLayer class];
 }
 
+- (void)setupLayer
+{
+    CAEAGLLayer *eaglLayer = (CAEAGLLayer *)self.layer;
+    
+    eaglLayer.opaque = TRUE;
+    eaglLayer.drawableProperties = [NSDictionary dictionaryWithObjectsAndKeys:
+                                    [NSNumber numberWithBool:FALSE], kEAGLDrawablePropertyRetainedBacking,
+                                    kEAGLColorFormatRGBA8, kEAGLDrawablePropertyColorFormat,
+                                    nil];
+    
+    self.contentScaleFactor = [UIScreen mainScreen].scale;
+}
+
 //The EAGL view is stored in the nib file. When it's unarchived it's sent -initWithCoder:.
 - (id)initWithCoder:(NSCoder*)coder
 {
     self = [super initWithCoder:coder];
 	if (self) {
-        CAEAGLLayer *eaglLayer = (CAEAGLLayer *)self.layer;
-        
-        eaglLayer.opaque = TRUE;
-        eaglLayer.drawableProperties = [NSDictionary dictionaryWithObjectsAndKeys:
-                                        [NSNumber numberWithBool:FALSE], kEAGLDrawablePropertyRetainedBacking,
-                                        kEAGLColorFormatRGBA8, kEAGLDrawablePropertyColorFormat,
-                                        nil];
-        
-        self.contentScaleFactor = [UIScreen mainScreen].scale;
+        [self setupLayer];
+    }
+    
+    return self;
+}
+
+// When the view is created in code (e.g. by a Titanium view) it's sent -initWithFrame:.
+- (id)initWithFrame:(CGRect)frame
+{
+    self = [super initWithFrame:frame];
+	if (self) {
+        [self setupLayer];
     }
     
     return self;
@@ -48,6 +122,11 @@
     [self deleteFramebuffer];    
     [context release];
     
+    // nobody is waiting for the frame anymore, but the requests are answered
+    for (EAGLViewScreenshotHandler handler in screenshotHandlers)
+        handler(nil);
+    [screenshotHandlers release];
+    
     [super dealloc];
 }
 
@@ -66,6 +145,7 @@
 - (void)createFramebuffer
 {
     if (context && !defaultFramebuffer) {
+        UNIFEYE_PERF_SCOPE("createFramebuffer");
         [EAGLContext setCurrentContext:context];
         
         // Create default framebuffer object.
@@ -137,8 +217,29 @@
     BOOL success = FALSE;
     
     if (context) {
+        UNIFEYE_PERF_SCOPE("present");
         [EAGLContext setCurrentContext:context];
         
+        // the backing is not retained, so a requested screenshot has to be read now
+        if ([screenshotHandlers count])
+        {
+            NSArray* handlers = screenshotHandlers;
+            screenshotHandlers = nil;
+            
+            GLint width = framebufferWidth;
+            GLint height = framebufferHeight;
+            unsigned char* pixels = [self readFramebuffer];
+            
+            dispatch_async(screenshotQueue(), ^{
+                UIImage* screenshot = imageFromFramebufferPixels(pixels, width, height);
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    for (EAGLViewScreenshotHandler handler in handlers)
+                        handler(screenshot);
+                    [handlers release];
+                });
+            });
+        }
+        
         glBindRenderbuffer(GL_RENDERBUFFER, colorRenderbuffer);
         
         success = [context presentRenderbuffer:GL_RENDERBUFFER];
@@ -155,37 +256,34 @@
 
 
 
-- (UIImage*) getScreenshotImage
+- (unsigned char*)readFramebuffer
 {
-    // read image data from openGL
-	unsigned char* imgData = new unsigned char[framebufferWidth * framebufferHeight * 4];
+    // read image data from openGL into a pooled buffer
+	unsigned char* imgData = screenshotPool()->acquire(framebufferWidth * framebufferHeight * 4);
 	glReadPixels(0, 0, framebufferWidth, framebufferHeight, GL_RGBA, GL_UNSIGNED_BYTE, imgData);
-	
-	CGDataProviderRef provider = CGDataProviderCreateWithData(NULL, imgData, framebufferWidth * framebufferHeight * 4, NULL);
-	CGBitmapInfo bitmapInfo = kCGBitmapByteOrderDefault;
-	
-	CGColorRenderingIntent intent = kCGRenderingIntentDefault;
-	CGColorSpaceRef space = CGColorSpaceCreateDeviceRGB();
-	
-	CGImageRef imgRef = CGImageCreate(framebufferWidth, framebufferHeight, 8, 32, framebufferWidth*4, space, bitmapInfo, provider, NULL, NO, intent);
-	
-	// Draw the image using the current graphics context
-	UIGraphicsBeginImageContext(CGSizeMake(framebufferWidth, framebufferHeight));
-	
-	CGContextRef currContext = UIGraphicsGetCurrentContext();
-	CGContextDrawImage(currContext, CGRectMake(0, 0, framebufferWidth, framebufferHeight), imgRef);
-	
-	// retrieve the screenshot from the current context
-	UIImage* screenshot = UIGraphicsGetImageFromCurrentImageContext();	
-	UIGraphicsEndImageContext();
-	
-	// release all used objects
-	CGDataProviderRelease(provider);
-	CGColorSpaceRelease(space);
-	CGImageRelease(imgRef);
-	delete[] imgData;
-	
-	return screenshot;
+    return imgData;
+}
+
+- (UIImage*) getScreenshotImage
+{
+    return imageFromFramebufferPixels([self readFramebuffer], framebufferWidth, framebufferHeight);
+}
+
+- (void) requestScreenshot:(EAGLViewScreenshotHandler)handler
+{
+    // queued on the main thread, where the frames are presented
+    EAGLViewScreenshotHandler copy = [handler copy];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (!screenshotHandlers)
+            screenshotHandlers = [[NSMutableArray alloc] init];
+        [screenshotHandlers addObject:copy];
+        [copy release];
+    });
+}
+
++ (void) purgeScreenshotBuffers
+{
+    screenshotPool()->purge();
 }
 
 
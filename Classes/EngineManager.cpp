@@ -0,0 +1,256 @@
+//
+//  EngineManager.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "EngineManager.h"
+#include "FrameScheduler.h"
+
+namespace unifeye
+{
+    namespace
+    {
+        const double DEFAULT_GRACE_PERIOD = 30.0;
+
+        // views come and go, the start up stays at the front
+        const size_t MAX_EVENTS = 128;
+        const size_t KEEP_EVENTS = 16;
+    }
+
+    const char* getEngineStepName( ENGINE_STEP step )
+    {
+        switch (step)
+        {
+            case ENGINE_STEP_CREATE: return "create";
+            case ENGINE_STEP_RENDERER: return "renderer";
+            case ENGINE_STEP_CALIBRATION: return "calibration";
+            case ENGINE_STEP_TRACKING_DATA: return "trackingData";
+            default: return "unknown";
+        }
+    }
+
+    const char* getEngineStateName( ENGINE_STATE state )
+    {
+        switch (state)
+        {
+            case ENGINE_COLD: return "cold";
+            case ENGINE_WARMING: return "warming";
+            case ENGINE_READY: return "ready";
+            case ENGINE_FAILED: return "failed";
+            default: return "unknown";
+        }
+    }
+
+    EngineManager::EngineManager( IEngineBackend* _backend, IFrameClock* _clock ) :
+        backend(_backend), clock(_clock), threadRunning(false), references(0), teardownAt(-1.0),
+        gracePeriod(DEFAULT_GRACE_PERIOD), state(ENGINE_COLD)
+    {
+        created = clock->now();
+    }
+
+    EngineManager::~EngineManager()
+    {
+        ScopedLock lock(control);
+        joinWarmUp();
+        if (state != ENGINE_COLD)
+            tearDown();
+    }
+
+    double EngineManager::now() const
+    {
+        return clock->now() - created;
+    }
+
+    void EngineManager::setGracePeriod( double seconds )
+    {
+        ScopedLock lock(control);
+        ScopedLock stateLock(mutex);
+        gracePeriod = seconds;
+        if (teardownAt >= 0)
+            teardownAt = now() + gracePeriod;
+    }
+
+    double EngineManager::getGracePeriod() const
+    {
+        ScopedLock lock(mutex);
+        return gracePeriod;
+    }
+
+    void EngineManager::addEvent( const char* name, double start, double duration, bool background, bool ok )
+    {
+        ScopedLock lock(mutex);
+        if (timeline.size() >= MAX_EVENTS)
+            timeline.erase(timeline.begin() + KEEP_EVENTS, timeline.begin() + KEEP_EVENTS + MAX_EVENTS / 2);
+
+        EngineEvent event;
+        event.name = name;
+        event.start = start;
+        event.duration = duration;
+        event.background = background;
+        event.ok = ok;
+        timeline.push_back(event);
+    }
+
+    void* EngineManager::warmUpThread( void* manager )
+    {
+        EngineManager* self = static_cast<EngineManager*>(manager);
+        self->backend->beginWarmUp();
+        self->bringUp(true);
+        self->backend->endWarmUp();
+        return 0;
+    }
+
+    void EngineManager::warmUp()
+    {
+        ScopedLock lock(control);
+        if (threadRunning || getState() != ENGINE_COLD)
+            return;
+
+        addEvent("warmup", now(), 0, false, true);
+        {
+            ScopedLock stateLock(mutex);
+            state = ENGINE_WARMING;
+        }
+        threadRunning = pthread_create(&thread, 0, warmUpThread, this) == 0;
+
+        // no thread, the first acquire() brings it up
+        if (!threadRunning)
+        {
+            ScopedLock stateLock(mutex);
+            state = ENGINE_COLD;
+        }
+    }
+
+    void EngineManager::joinWarmUp()
+    {
+        if (!threadRunning)
+            return;
+        pthread_join(thread, 0);
+        threadRunning = false;
+    }
+
+    bool EngineManager::bringUp( bool background )
+    {
+        bool ok = true;
+        for (int i = 0; i < ENGINE_STEP_COUNT && ok; i++)
+        {
+            ENGINE_STEP step = (ENGINE_STEP)i;
+            double start = now();
+            ok = backend->runStep(step);
+            addEvent(getEngineStepName(step), start, now() - start, background, ok);
+        }
+
+        ScopedLock lock(mutex);
+        state = ok ? ENGINE_READY : ENGINE_FAILED;
+        if (ok)
+            stats.creations++;
+        else
+            stats.failures++;
+        return ok;
+    }
+
+    void EngineManager::tearDown()
+    {
+        double start = now();
+        backend->destroy();
+        addEvent("destroy", start, now() - start, false, true);
+
+        ScopedLock lock(mutex);
+        if (state == ENGINE_READY)
+            stats.destroys++;
+        state = ENGINE_COLD;
+        teardownAt = -1.0;
+    }
+
+    bool EngineManager::acquire()
+    {
+        ScopedLock lock(control);
+        double start = now();
+        if (threadRunning)
+        {
+            joinWarmUp();
+            addEvent("wait", start, now() - start, false, state == ENGINE_READY);
+        }
+
+        bool reused = state == ENGINE_READY;
+        if (!reused)
+        {
+            // a failed start up leaves a part of the engine behind
+            if (state == ENGINE_FAILED)
+                tearDown();
+            if (!bringUp(false))
+                return false;
+        }
+        addEvent("acquire", now(), 0, false, true);
+
+        ScopedLock stateLock(mutex);
+        references++;
+        teardownAt = -1.0;
+        stats.acquires++;
+        if (reused)
+            stats.reuses++;
+        stats.lastWait = now() - start;
+        return true;
+    }
+
+    void EngineManager::release()
+    {
+        ScopedLock lock(control);
+        if (references <= 0)
+            return;
+        addEvent("release", now(), 0, false, true);
+
+        ScopedLock stateLock(mutex);
+        if (--references == 0)
+            teardownAt = now() + gracePeriod;
+    }
+
+    double EngineManager::update()
+    {
+        ScopedLock lock(control);
+        if (references > 0 || teardownAt < 0 || threadRunning)
+            return -1.0;
+
+        double remaining = teardownAt - now();
+        if (remaining > 0)
+            return remaining;
+        tearDown();
+        return -1.0;
+    }
+
+    bool EngineManager::purge()
+    {
+        ScopedLock lock(control);
+
+        // the warm-up is not waited for, whoever asked for it wants the engine soon
+        if (references > 0 || threadRunning || state == ENGINE_COLD)
+            return false;
+        tearDown();
+        return true;
+    }
+
+    ENGINE_STATE EngineManager::getState() const
+    {
+        ScopedLock lock(mutex);
+        return state;
+    }
+
+    int EngineManager::getReferences() const
+    {
+        ScopedLock lock(mutex);
+        return references;
+    }
+
+    EngineStats EngineManager::getStats() const
+    {
+        ScopedLock lock(mutex);
+        return stats;
+    }
+
+    void EngineManager::getTimeline( std::vector<EngineEvent>& _timeline ) const
+    {
+        ScopedLock lock(mutex);
+        _timeline = timeline;
+    }
+}
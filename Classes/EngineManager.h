@@ -0,0 +1,200 @@
+//
+//  EngineManager.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  One SDK instance for all views. The instance is brought up on a thread
+//  of its own as soon as the module loads, so a view that opens later finds
+//  it ready, and it is kept for a grace period after the last view let go
+//  of it, so reopening a view does not pay for the start up again.
+//
+//  The SDK is only reached through IEngineBackend, so the life cycle can be
+//  exercised with a stub that takes any time for the steps.
+//
+#ifndef __UNIFEYE_ENGINEMANAGER_H__
+#define __UNIFEYE_ENGINEMANAGER_H__
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#include "Threading.h"
+
+namespace unifeye
+{
+    class IFrameClock;              // forward declaration
+
+    /// The steps that bring up the engine, in order
+    enum ENGINE_STEP
+    {
+        ENGINE_STEP_CREATE,             ///< create the instance, checks the license
+        ENGINE_STEP_RENDERER,           ///< initialize the renderer
+        ENGINE_STEP_CALIBRATION,        ///< load the camera calibration
+        ENGINE_STEP_TRACKING_DATA,      ///< load the tracking configuration
+        ENGINE_STEP_COUNT
+    };
+
+    /// Name of a step for logs and the timeline
+    const char* getEngineStepName( ENGINE_STEP step );
+
+    enum ENGINE_STATE
+    {
+        ENGINE_COLD,                    ///< no engine
+        ENGINE_WARMING,                 ///< the warm-up thread brings it up
+        ENGINE_READY,                   ///< all steps succeeded
+        ENGINE_FAILED                   ///< a step failed, the next acquire() tries again
+    };
+
+    /// Name of a state for logs and events
+    const char* getEngineStateName( ENGINE_STATE state );
+
+    /**
+     * \brief Brings up and tears down the engine for an EngineManager
+     *
+     * The steps run on the warm-up thread or on the thread that calls
+     * acquire(), never on two threads at once.
+     */
+    class IEngineBackend
+    {
+    public:
+        virtual ~IEngineBackend() {};
+
+        /**
+         * \brief Run a step
+         * \return false if the engine can not be used
+         */
+        virtual bool runStep( ENGINE_STEP step ) = 0;
+
+        /// Delete whatever the steps created, also after a failed step
+        virtual void destroy() = 0;
+
+        /// Called on the warm-up thread before the first step
+        virtual void beginWarmUp() {};
+
+        /// Called on the warm-up thread after the last step
+        virtual void endWarmUp() {};
+    };
+
+    /**
+     * \brief Something that happened to the engine
+     */
+    struct EngineEvent
+    {
+        std::string name;               ///< a step name, "warmup", "wait", "acquire", "release" or "destroy"
+        double start;                   ///< seconds since the manager was created
+        double duration;                ///< seconds, 0 for "acquire" and "release"
+        bool background;                ///< on the warm-up thread
+        bool ok;                        ///< false if the step failed
+
+        EngineEvent() : start(0), duration(0), background(false), ok(true) {};
+    };
+
+    /**
+     * \brief Counters of an EngineManager
+     */
+    struct EngineStats
+    {
+        unsigned long creations;        ///< start ups that succeeded
+        unsigned long failures;         ///< start ups that failed
+        unsigned long acquires;
+        unsigned long reuses;           ///< acquires that found the engine ready
+        unsigned long destroys;
+        double lastWait;                ///< seconds the last acquire() took
+
+        EngineStats() : creations(0), failures(0), acquires(0), reuses(0), destroys(0), lastWait(0) {};
+    };
+
+    /**
+     * \brief Shares one engine between its users
+     *
+     * acquire() and release() count the users. When the count drops to
+     * zero the engine is torn down by the first update() after the grace
+     * period, or at once by purge(). All methods may be called from any
+     * thread; acquire() blocks while the engine is brought up.
+     */
+    class EngineManager
+    {
+    public:
+        /**
+         * \brief Constructor
+         * \param backend the engine, not owned
+         * \param clock the time for the timeline and the grace period, not owned
+         */
+        EngineManager( IEngineBackend* backend, IFrameClock* clock );
+
+        /// Waits for the warm-up and tears the engine down
+        ~EngineManager();
+
+        /// Seconds an unused engine is kept, 30 by default
+        void setGracePeriod( double seconds );
+        double getGracePeriod() const;
+
+        /// Bring up the engine on a thread of its own, nothing happens unless it is cold
+        void warmUp();
+
+        /**
+         * \brief Take a reference to the engine
+         *
+         * Waits for a running warm-up, or brings up the engine on the
+         * calling thread if there was none.
+         *
+         * \return false if the engine could not be brought up, no reference is taken then
+         */
+        bool acquire();
+
+        /// Give back a reference taken with acquire()
+        void release();
+
+        /**
+         * \brief Tear down the engine once its grace period is over
+         * \return seconds until the engine would be torn down, negative if it is not about to be
+         */
+        double update();
+
+        /**
+         * \brief Tear down the engine now if nobody uses it, e.g. on a memory warning
+         * \return true if it was torn down
+         */
+        bool purge();
+
+        ENGINE_STATE getState() const;
+        int getReferences() const;
+        EngineStats getStats() const;
+
+        /// The events so far, the oldest ones are dropped after a while
+        void getTimeline( std::vector<EngineEvent>& timeline ) const;
+
+    private:
+        EngineManager( const EngineManager& );
+        EngineManager& operator=( const EngineManager& );
+
+        static void* warmUpThread( void* manager );
+
+        bool bringUp( bool background );
+        void tearDown();
+        void joinWarmUp();
+        void addEvent( const char* name, double start, double duration, bool background, bool ok );
+        double now() const;
+
+        IEngineBackend* backend;
+        IFrameClock* clock;
+        double created;
+
+        // held by the public methods, never by the warm-up thread
+        Mutex control;
+        pthread_t thread;
+        bool threadRunning;
+        int references;
+        double teardownAt;              // negative while in use
+        double gracePeriod;
+
+        // shared with the warm-up thread
+        mutable Mutex mutex;
+        ENGINE_STATE state;
+        EngineStats stats;
+        std::vector<EngineEvent> timeline;
+    };
+}
+
+#endif
@@ -0,0 +1,286 @@
+//
+//  FrameGovernor.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "FrameGovernor.h"
+#include "PoseSnapshot.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace unifeye
+{
+    namespace
+    {
+        // time constant of the accelerometer mean and deviation in seconds
+        const double MOTION_SMOOTHING = 0.25;
+
+        // without accelerometer samples for this long the device counts as moving
+        const double SENSOR_TIMEOUT = 1.0;
+
+        // the tracking rate needs this long in GOVERNOR_FULL to settle, it is a mean over 25 frames
+        const double TRACKING_RATE_SETTLE = 1.0;
+
+        // an overload is forgotten after this long, to find out if the device recovered
+        const double OVERLOAD_RETRY = 30.0;
+
+        const double PI = 3.14159265358979;
+
+        // true if a pose is within the move distance and angle of another one
+        bool isNear( const float* position, const float* rotation, const float* otherPosition,
+            const float* otherRotation, const GovernorParameters& parameters )
+        {
+            float dx = position[0] - otherPosition[0];
+            float dy = position[1] - otherPosition[1];
+            float dz = position[2] - otherPosition[2];
+            if (dx * dx + dy * dy + dz * dz > parameters.moveDistance * parameters.moveDistance)
+                return false;
+
+            double dot = fabs(rotation[0] * otherRotation[0] + rotation[1] * otherRotation[1] +
+                rotation[2] * otherRotation[2] + rotation[3] * otherRotation[3]);
+            double angle = 2.0 * acos(dot < 1.0 ? dot : 1.0) * 180.0 / PI;
+            return angle <= parameters.moveAngle;
+        }
+    }
+
+    const char* getGovernorModeName( GOVERNOR_MODE mode )
+    {
+        switch (mode)
+        {
+            case GOVERNOR_FULL: return "full";
+            case GOVERNOR_REDUCED: return "reduced";
+            case GOVERNOR_FROZEN: return "frozen";
+            case GOVERNOR_IDLE: return "idle";
+            default: return "unknown";
+        }
+    }
+
+    FrameGovernor::FrameGovernor() : batteryLevel(-1.0f), charging(false), thermalState(0)
+    {
+        reset();
+    }
+
+    void FrameGovernor::setParameters( const GovernorParameters& _parameters )
+    {
+        parameters = _parameters;
+    }
+
+    void FrameGovernor::reset()
+    {
+        decision = GovernorDecision();
+        decision.frameRate = parameters.fullFrameRate;
+        decisionChanged = false;
+        stats = GovernorStats();
+
+        accelerationMean[0] = accelerationMean[1] = accelerationMean[2] = 0;
+        accelerationVariance = 0;
+        lastSampleTime = -1.0;
+        motion = 0;
+        still = false;
+        stillSince = 0;
+
+        poseCosID = 0;
+        tracked = false;
+        trackedSince = 0;
+        stableSince = 0;
+        frozenSince = -1.0;
+        recheckUntil = -1.0;
+        overloadedSince = -1.0;
+        modeSince = 0;
+        lastUpdate = -1.0;
+    }
+
+    void FrameGovernor::addAccelerometer( const metaio::Vector3d& values, double timestamp )
+    {
+        double sample[3] = { values.x, values.y, values.z };
+        if (lastSampleTime < 0)
+        {
+            memcpy(accelerationMean, sample, sizeof(sample));
+            lastSampleTime = timestamp;
+            return;
+        }
+
+        double dt = timestamp - lastSampleTime;
+        if (dt <= 0)
+            return;
+        lastSampleTime = timestamp;
+
+        // exponentially weighted mean and variance, for samples at any rate
+        double alpha = 1.0 - exp(-dt / MOTION_SMOOTHING);
+        double squared = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            double d = sample[i] - accelerationMean[i];
+            accelerationMean[i] += alpha * d;
+            squared += d * d;
+        }
+        accelerationVariance = (1.0 - alpha) * (accelerationVariance + alpha * squared);
+        motion = sqrt(accelerationVariance);
+
+        // two thresholds, so the noise around one of them does not switch back and forth
+        if (still && motion > parameters.motionThreshold)
+        {
+            still = false;
+        }
+        else if (!still && motion < parameters.stillThreshold)
+        {
+            still = true;
+            stillSince = timestamp;
+        }
+    }
+
+    void FrameGovernor::setPowerState( float _batteryLevel, bool _charging, int _thermalState )
+    {
+        batteryLevel = _batteryLevel;
+        charging = _charging;
+        thermalState = _thermalState;
+    }
+
+    void FrameGovernor::updatePose( double time, const PoseSnapshot& poses )
+    {
+        // stay with the coordinate system we have as long as it is tracked
+        int best = -1;
+        for (int i = 0; i < poses.getCount(); i++)
+        {
+            if (poses.quality[i] < parameters.minQuality)
+                continue;
+            if (poses.cosID[i] == poseCosID)
+            {
+                best = i;
+                break;
+            }
+            if (best < 0 || poses.quality[i] > poses.quality[best])
+                best = i;
+        }
+
+        if ((best >= 0) != tracked)
+        {
+            tracked = best >= 0;
+            trackedSince = time;
+        }
+        if (!tracked)
+        {
+            poseCosID = 0;
+            return;
+        }
+
+        position[0] = poses.tx[best];
+        position[1] = poses.ty[best];
+        position[2] = poses.tz[best];
+        rotation[0] = poses.qx[best];
+        rotation[1] = poses.qy[best];
+        rotation[2] = poses.qz[best];
+        rotation[3] = poses.qw[best];
+
+        // at rest while the pose stays near where it stopped, the tracking jitters too much for speeds
+        if (poses.cosID[best] != poseCosID || !isNear(position, rotation, anchorPosition, anchorRotation, parameters))
+        {
+            poseCosID = poses.cosID[best];
+            memcpy(anchorPosition, position, sizeof(position));
+            memcpy(anchorRotation, rotation, sizeof(rotation));
+            stableSince = time;
+        }
+    }
+
+    GOVERNOR_MODE FrameGovernor::choose( double time, float trackingFrameRate )
+    {
+        bool isStill = still && lastSampleTime >= 0 && time - lastSampleTime < SENSOR_TIMEOUT;
+        double stillFor = isStill ? time - stillSince : 0;
+
+        // the tracking rate is only comparable to the full frame rate, and never exceeds the camera's
+        float expectedRate = parameters.fullFrameRate;
+        if (parameters.cameraFrameRate > 0 && parameters.cameraFrameRate < expectedRate)
+            expectedRate = parameters.cameraFrameRate;
+        if (decision.mode == GOVERNOR_FULL && time - modeSince >= TRACKING_RATE_SETTLE && trackingFrameRate > 0)
+        {
+            if (trackingFrameRate >= parameters.minTrackingRatio * expectedRate)
+                overloadedSince = -1.0;
+            else if (overloadedSince < 0)
+                overloadedSince = time;
+        }
+        else if (decision.mode != GOVERNOR_FULL && overloadedSince >= 0 && time - overloadedSince > OVERLOAD_RETRY)
+        {
+            overloadedSince = -1.0;
+        }
+
+        bool constrained = (batteryLevel >= 0 && batteryLevel < parameters.lowBattery && !charging) ||
+            thermalState >= 2 || (overloadedSince >= 0 && time - overloadedSince >= parameters.overloadDelay);
+        GOVERNOR_MODE moving = constrained ? GOVERNOR_REDUCED : GOVERNOR_FULL;
+
+        if (decision.mode == GOVERNOR_FROZEN)
+        {
+            if (!isStill)
+                return moving;
+            if (time - frozenSince < parameters.recheckInterval)
+                return GOVERNOR_FROZEN;
+
+            // the target may have moved while the device did not, track again for a moment
+            recheckUntil = time + parameters.recheckDuration;
+            stats.rechecks++;
+            return GOVERNOR_REDUCED;
+        }
+
+        if (recheckUntil >= 0)
+        {
+            bool moved = tracked && !isNear(position, rotation, frozenPosition, frozenRotation, parameters);
+            if (isStill && !moved && time < recheckUntil)
+                return GOVERNOR_REDUCED;
+
+            recheckUntil = -1.0;
+            if (isStill && tracked && !moved)
+            {
+                frozenSince = time;
+                return GOVERNOR_FROZEN;
+            }
+        }
+
+        if (!isStill)
+            return moving;
+
+        if (tracked && stillFor >= parameters.freezeDelay && time - stableSince >= parameters.freezeDelay)
+        {
+            frozenSince = time;
+            memcpy(frozenPosition, position, sizeof(position));
+            memcpy(frozenRotation, rotation, sizeof(rotation));
+            return GOVERNOR_FROZEN;
+        }
+
+        if (!tracked && stillFor >= parameters.idleDelay && time - trackedSince >= parameters.idleDelay)
+            return GOVERNOR_IDLE;
+
+        if (stillFor >= parameters.reduceDelay)
+            return GOVERNOR_REDUCED;
+        return moving;
+    }
+
+    const GovernorDecision& FrameGovernor::update( double time, const PoseSnapshot& poses, float trackingFrameRate )
+    {
+        if (lastUpdate >= 0 && time > lastUpdate)
+            stats.timeInMode[decision.mode] += time - lastUpdate;
+        lastUpdate = time;
+
+        GOVERNOR_MODE mode = GOVERNOR_FULL;
+        if (parameters.enabled)
+        {
+            updatePose(time, poses);
+            mode = choose(time, trackingFrameRate);
+        }
+
+        GovernorDecision next;
+        next.mode = mode;
+        next.frameRate = mode == GOVERNOR_FULL ? parameters.fullFrameRate :
+            mode == GOVERNOR_IDLE ? parameters.idleFrameRate : parameters.reducedFrameRate;
+        next.freezeTracking = mode == GOVERNOR_FROZEN;
+
+        decisionChanged = next.mode != decision.mode || next.frameRate != decision.frameRate;
+        if (next.mode != decision.mode)
+        {
+            stats.transitions++;
+            modeSince = time;
+        }
+        decision = next;
+        return decision;
+    }
+}
@@ -0,0 +1,190 @@
+//
+//  FrameGovernor.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Chooses the frame rate of the render loop and whether the tracking is
+//  frozen from what the device is doing: moving, held still on a tracked
+//  target, or lying still with nothing tracked. A low battery or a tracking
+//  rate that can not keep up with the frame rate lower it further.
+//
+//  Like the pose filter it has no clock of its own; the decisions only
+//  depend on the samples and times passed in, so recorded sessions can be
+//  run through it on the host.
+//
+#ifndef __UNIFEYE_FRAMEGOVERNOR_H__
+#define __UNIFEYE_FRAMEGOVERNOR_H__
+
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+namespace unifeye
+{
+    class PoseSnapshot;     // forward declaration
+
+    /// Modes of the FrameGovernor, from the most to the least work per second
+    enum GOVERNOR_MODE
+    {
+        GOVERNOR_FULL,          ///< the full frame rate, tracking on every frame
+        GOVERNOR_REDUCED,       ///< the reduced frame rate, tracking on every frame
+        GOVERNOR_FROZEN,        ///< the reduced frame rate, the tracking frozen at the last pose
+        GOVERNOR_IDLE,          ///< the idle frame rate, tracking to notice a target
+        GOVERNOR_MODE_COUNT
+    };
+
+    /// Name of a mode for logs and events
+    const char* getGovernorModeName( GOVERNOR_MODE mode );
+
+    /**
+     * \brief Parameters of the FrameGovernor
+     *
+     * The delays are how long a condition has to hold before the mode drops;
+     * motion raises it to GOVERNOR_FULL right away.
+     */
+    struct GovernorParameters
+    {
+        bool enabled;                   ///< false stays in GOVERNOR_FULL
+        float fullFrameRate;            ///< frames per second in GOVERNOR_FULL
+        float cameraFrameRate;          ///< frames per second the camera delivers, the tracking can not be faster; 0 if unknown
+        float reducedFrameRate;         ///< frames per second in GOVERNOR_REDUCED and GOVERNOR_FROZEN
+        float idleFrameRate;            ///< frames per second in GOVERNOR_IDLE
+        float stillThreshold;           ///< accelerometer deviation in g below which the device is still
+        float motionThreshold;          ///< accelerometer deviation in g above which it moves again
+        float moveDistance;             ///< mm a pose may move before the target counts as moving
+        float moveAngle;                ///< degrees a pose may turn before the target counts as moving
+        float minQuality;               ///< tracking quality a pose needs to count as tracked
+        float reduceDelay;              ///< seconds still before GOVERNOR_REDUCED
+        float freezeDelay;              ///< seconds still on a target at rest before GOVERNOR_FROZEN
+        float idleDelay;                ///< seconds still without a target before GOVERNOR_IDLE
+        float recheckInterval;          ///< seconds frozen before the tracking runs again to check the target
+        float recheckDuration;          ///< seconds the tracking runs for a check
+        float lowBattery;               ///< battery level in [0, 1] below which GOVERNOR_FULL is not used
+        float minTrackingRatio;         ///< tracking rate per frame rate below which the device is overloaded
+        float overloadDelay;            ///< seconds overloaded before GOVERNOR_FULL is not used
+
+        GovernorParameters() : enabled(true), fullFrameRate(30.0f), cameraFrameRate(30.0f), reducedFrameRate(15.0f),
+            idleFrameRate(5.0f), stillThreshold(0.01f), motionThreshold(0.025f), moveDistance(15.0f), moveAngle(3.0f),
+            minQuality(0.5f), reduceDelay(1.0f), freezeDelay(2.0f), idleDelay(3.0f), recheckInterval(5.0f),
+            recheckDuration(0.5f), lowBattery(0.2f), minTrackingRatio(0.6f), overloadDelay(3.0f) {};
+    };
+
+    /**
+     * \brief What the render loop should do
+     */
+    struct GovernorDecision
+    {
+        GOVERNOR_MODE mode;
+        float frameRate;                ///< frames per second to render at
+        bool freezeTracking;            ///< argument for setFreezeTracking()
+
+        GovernorDecision() : mode(GOVERNOR_FULL), frameRate(30.0f), freezeTracking(false) {};
+    };
+
+    /**
+     * \brief Time spent in the modes since the last reset()
+     */
+    struct GovernorStats
+    {
+        double timeInMode[GOVERNOR_MODE_COUNT];     ///< seconds
+        unsigned long transitions;                  ///< mode changes
+        unsigned long rechecks;                     ///< times the frozen tracking ran again to check the target
+
+        GovernorStats() : transitions(0), rechecks(0)
+        {
+            for (int i = 0; i < GOVERNOR_MODE_COUNT; i++)
+                timeInMode[i] = 0;
+        }
+    };
+
+    /**
+     * \brief Power policy of the render loop
+     *
+     * Feed it the accelerometer and, once per rendered frame, the poses
+     * and the tracking rate; apply the decision when it changes.
+     */
+    class FrameGovernor
+    {
+    public:
+        FrameGovernor();
+
+        void setParameters( const GovernorParameters& parameters );
+        const GovernorParameters& getParameters() const { return parameters; }
+
+        /**
+         * \brief Add an accelerometer sample
+         * \param values acceleration in g
+         * \param timestamp seconds, on the clock of the frame times
+         */
+        void addAccelerometer( const metaio::Vector3d& values, double timestamp );
+
+        /**
+         * \brief Set the power state of the device
+         * \param batteryLevel in [0, 1], negative if unknown
+         * \param charging true if the device is plugged in
+         * \param thermalState 0 nominal, 1 fair, 2 serious, 3 critical
+         */
+        void setPowerState( float batteryLevel, bool charging, int thermalState );
+
+        /**
+         * \brief Decide for the next frame
+         * \param time the frame time in seconds
+         * \param poses the poses of this frame
+         * \param trackingFrameRate getTrackingFrameRate(), 0 if unknown
+         * \return the decision, changed() tells if it differs from the previous one
+         */
+        const GovernorDecision& update( double time, const PoseSnapshot& poses, float trackingFrameRate );
+
+        /// True if the last update() changed the decision
+        bool changed() const { return decisionChanged; }
+
+        const GovernorDecision& getDecision() const { return decision; }
+
+        /// Accelerometer deviation in g, smoothed over the last quarter second
+        float getMotion() const { return (float)motion; }
+
+        const GovernorStats& getStats() const { return stats; }
+
+        /// Back to GOVERNOR_FULL, forgets the history and the statistics
+        void reset();
+
+    private:
+        GOVERNOR_MODE choose( double time, float trackingFrameRate );
+        void updatePose( double time, const PoseSnapshot& poses );
+
+        GovernorParameters parameters;
+        GovernorDecision decision;
+        bool decisionChanged;
+        GovernorStats stats;
+
+        // accelerometer, exponentially weighted
+        double accelerationMean[3];
+        double accelerationVariance;
+        double lastSampleTime;          // negative before the first sample
+        double motion;
+        bool still;
+        double stillSince;
+
+        // the pose of the best tracked coordinate system
+        int poseCosID;
+        float position[3], rotation[4];
+        bool tracked;
+        double trackedSince;            // or lost since, if not tracked
+        float anchorPosition[3], anchorRotation[4];     // where the target came to rest
+        double stableSince;             // since when the pose stays near the anchor
+
+        // frozen tracking
+        double frozenSince;             // negative unless frozen
+        double recheckUntil;            // the end of the running check, negative if there is none
+        float frozenPosition[3], frozenRotation[4];
+
+        float batteryLevel;
+        bool charging;
+        int thermalState;
+        double overloadedSince;         // negative if the tracking keeps up
+
+        double modeSince;
+        double lastUpdate;              // negative before the first update
+    };
+}
+
+#endif
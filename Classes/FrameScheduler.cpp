@@ -0,0 +1,151 @@
+//
+//  FrameScheduler.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "FrameScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+namespace unifeye
+{
+    SystemFrameClock::SystemFrameClock() : ticksToSeconds(1e-9)
+    {
+#if defined(__APPLE__)
+        mach_timebase_info_data_t info;
+        mach_timebase_info(&info);
+        ticksToSeconds = 1e-9 * (double)info.numer / (double)info.denom;
+#endif
+    }
+
+    double SystemFrameClock::now()
+    {
+#if defined(__APPLE__)
+        return (double)mach_absolute_time() * ticksToSeconds;
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec + (double)ts.tv_nsec * ticksToSeconds;
+#endif
+    }
+
+
+    FrameScheduler::FrameScheduler( IFrameClock* _clock, IFrameTarget* _target ) :
+        clock(_clock), target(_target), targetFrameRate(30.0f), frameBudget(1.0f), period(1.0 / 30.0),
+        running(false), nextDeadline(0), lastFrameStart(-1), totalFrameCost(0),
+        jitterCount(0), jitterIndex(0)
+    {
+    }
+
+    void FrameScheduler::setTargetFrameRate( float fps )
+    {
+        targetFrameRate = std::max(1.0f, std::min(60.0f, fps));
+        period = 1.0 / targetFrameRate;
+    }
+
+    void FrameScheduler::setFrameBudget( float budget )
+    {
+        if (budget > 0.0f)
+            frameBudget = std::min(1.0f, budget);
+    }
+
+    int FrameScheduler::getTickInterval( float displayRate ) const
+    {
+        int interval = (int)floorf(displayRate / targetFrameRate + 0.5f);
+        return std::max(1, interval);
+    }
+
+    void FrameScheduler::start()
+    {
+        stats = FramePacingStats();
+        totalFrameCost = 0;
+        jitterCount = 0;
+        jitterIndex = 0;
+        lastFrameStart = -1;
+        nextDeadline = clock->now();
+        running = true;
+    }
+
+    void FrameScheduler::stop()
+    {
+        running = false;
+    }
+
+    bool FrameScheduler::tick()
+    {
+        if (!running)
+            return false;
+
+        stats.ticks++;
+        double now = clock->now();
+
+        // accept ticks that arrive slightly early, display links are not exact
+        double tolerance = std::min(0.5 * period, 1.0 / 120.0);
+        if (lastFrameStart >= 0 && now + tolerance < nextDeadline)
+            return false;
+
+        bool late = false;
+        if (lastFrameStart >= 0)
+        {
+            double delay = now - nextDeadline;
+            late = delay > tolerance;
+            if (delay > period)
+                stats.framesDropped += (unsigned long)(delay / period);
+
+            recordInterval(now - lastFrameStart);
+        }
+
+        double frameTime = lastFrameStart >= 0 ? nextDeadline : now;
+        lastFrameStart = now;
+
+        target->renderFrame(frameTime);
+
+        double cost = clock->now() - now;
+        totalFrameCost += cost;
+        stats.framesRendered++;
+        stats.lastFrameCost = cost * 1000.0;
+        stats.meanFrameCost = totalFrameCost * 1000.0 / stats.framesRendered;
+        if (late || cost > frameBudget * period)
+            stats.framesMissed++;
+
+        // keep the phase of the deadlines, unless we fell behind completely
+        nextDeadline = frameTime + period;
+        if (nextDeadline + tolerance <= now)
+            nextDeadline = now + period;
+
+        return true;
+    }
+
+    void FrameScheduler::recordInterval( double interval )
+    {
+        jitter[jitterIndex] = fabs(interval - period) * 1000.0;
+        jitterIndex = (jitterIndex + 1) % JITTER_WINDOW;
+        if (jitterCount < JITTER_WINDOW)
+            jitterCount++;
+    }
+
+    FramePacingStats FrameScheduler::getStats() const
+    {
+        FramePacingStats result = stats;
+        if (jitterCount == 0)
+            return result;
+
+        double sorted[JITTER_WINDOW];
+        std::copy(jitter, jitter + jitterCount, sorted);
+        std::sort(sorted, sorted + jitterCount);
+
+        result.jitterP50 = sorted[(jitterCount - 1) * 50 / 100];
+        result.jitterP95 = sorted[(jitterCount - 1) * 95 / 100];
+        result.jitterP99 = sorted[(jitterCount - 1) * 99 / 100];
+        result.jitterMax = sorted[jitterCount - 1];
+        return result;
+    }
+}
@@ -0,0 +1,165 @@
+//
+//  FrameScheduler.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Frame pacing for the Unifeye render loop. The core is plain C++ so it can
+//  be driven by a CADisplayLink on the device or by a fake clock elsewhere.
+//
+#ifndef __UNIFEYE_FRAMESCHEDULER_H__
+#define __UNIFEYE_FRAMESCHEDULER_H__
+
+namespace unifeye
+{
+    /**
+     * \brief Source of time for the scheduler.
+     */
+    class IFrameClock
+    {
+    public:
+        virtual ~IFrameClock() {};
+
+        /**
+         * \brief Current time of a monotonic clock
+         * \return the time in seconds
+         */
+        virtual double now() = 0;
+    };
+
+    /**
+     * \brief Monotonic system clock (mach_absolute_time on iOS, CLOCK_MONOTONIC elsewhere)
+     */
+    class SystemFrameClock : public IFrameClock
+    {
+    public:
+        SystemFrameClock();
+        virtual double now();
+
+    private:
+        double ticksToSeconds;
+    };
+
+    /**
+     * \brief Whatever has to happen once per frame, e.g. render() and present.
+     */
+    class IFrameTarget
+    {
+    public:
+        virtual ~IFrameTarget() {};
+
+        /**
+         * \brief Render one frame
+         * \param frameTime the time (seconds) the frame was scheduled for
+         */
+        virtual void renderFrame( double frameTime ) = 0;
+    };
+
+    /**
+     * \brief Statistics of the scheduler since the last start()
+     *
+     * All durations are in milliseconds. Jitter is the absolute difference
+     * between the actual and the ideal interval of two rendered frames.
+     */
+    struct FramePacingStats
+    {
+        unsigned long ticks;            ///< number of ticks received
+        unsigned long framesRendered;   ///< number of frames rendered
+        unsigned long framesMissed;     ///< frames that started late or went over the budget, each counted once
+        unsigned long framesDropped;    ///< whole frame periods that passed without a tick
+        double meanFrameCost;           ///< mean time spent inside renderFrame
+        double lastFrameCost;           ///< time spent inside the last renderFrame
+        double jitterP50;               ///< median jitter over the last frames
+        double jitterP95;               ///< 95th percentile of the jitter
+        double jitterP99;               ///< 99th percentile of the jitter
+        double jitterMax;               ///< maximal jitter over the last frames
+
+        FramePacingStats() : ticks(0), framesRendered(0), framesMissed(0), framesDropped(0),
+            meanFrameCost(0), lastFrameCost(0), jitterP50(0), jitterP95(0), jitterP99(0), jitterMax(0) {};
+    };
+
+    /**
+     * \brief Decides on every tick whether a frame is due and accounts for missed frames.
+     *
+     * A tick source (CADisplayLink on iOS) calls tick() regularly, typically once
+     * per display refresh. A frame is rendered when its deadline is reached; a frame
+     * that starts later than the tick tolerance after its deadline or whose render
+     * cost exceeds the frame budget is counted as missed.
+     */
+    class FrameScheduler
+    {
+    public:
+        /// Number of frame intervals kept for the jitter percentiles
+        enum { JITTER_WINDOW = 128 };
+
+        /**
+         * \brief Constructor
+         * \param clock the clock to use, not owned
+         * \param target the frame target, not owned
+         */
+        FrameScheduler( IFrameClock* clock, IFrameTarget* target );
+
+        /**
+         * \brief Set the target frame rate
+         * \param fps frames per second, clamped to [1, 60]
+         */
+        void setTargetFrameRate( float fps );
+        float getTargetFrameRate() const { return targetFrameRate; }
+
+        /**
+         * \brief Set the time a frame may take before it is counted as missed
+         * \param budget fraction of the frame period in (0, 1], default is 1
+         */
+        void setFrameBudget( float budget );
+
+        /**
+         * \brief Display link frame interval that matches the target frame rate
+         * \param displayRate refresh rate of the display in Hz
+         * \return number of display refreshes per tick, at least 1
+         */
+        int getTickInterval( float displayRate = 60.0f ) const;
+
+        /// Start pacing; resets the statistics
+        void start();
+
+        /// Stop pacing; further ticks are ignored
+        void stop();
+
+        bool isRunning() const { return running; }
+
+        /**
+         * \brief Called by the tick source
+         * \return true if a frame was rendered
+         */
+        bool tick();
+
+        /**
+         * \brief Get the statistics, percentiles are computed on demand
+         * \return the statistics since the last start()
+         */
+        FramePacingStats getStats() const;
+
+    private:
+        void recordInterval( double interval );
+
+        IFrameClock* clock;
+        IFrameTarget* target;
+
+        float targetFrameRate;
+        float frameBudget;
+        double period;
+
+        bool running;
+        double nextDeadline;
+        double lastFrameStart;
+        double totalFrameCost;
+
+        FramePacingStats stats;
+
+        double jitter[JITTER_WINDOW];
+        int jitterCount;
+        int jitterIndex;
+    };
+}
+
+#endif
@@ -0,0 +1,412 @@
+//
+//  FrustumCuller.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  A box is outside if it is completely behind one of the planes taken from
+//  the rows of projection * modelView (Gribb and Hartmann): the distance of
+//  its center plus the extent projected onto the plane normal is negative.
+//  The test is conservative, boxes near the corners of the frustum may
+//  count as inside.
+//
+#include "FrustumCuller.h"
+#include "PoseSnapshot.h"
+#include "VectorMath.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <UnifeyeSDKMobile/AS_IUnifeyeMobile.h>
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#define UNIFEYE_FRUSTUMCULLER_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define UNIFEYE_FRUSTUMCULLER_SSE2 1
+#endif
+
+namespace unifeye
+{
+    namespace
+    {
+        // left, right, bottom, top, near and far plane, four floats each
+        void getPlanes( const float clip[16], float planes[24] )
+        {
+            for (int plane = 0; plane < 6; plane++)
+            {
+                int row = plane / 2;
+                float sign = (plane & 1) ? -1.0f : 1.0f;
+                for (int k = 0; k < 4; k++)
+                    planes[plane * 4 + k] = clip[k * 4 + 3] + sign * clip[k * 4 + row];
+            }
+        }
+    }
+
+    FrustumCuller::FrustumCuller() : simdEnabled(true)
+    {
+        memset(projection, 0, sizeof(projection));
+    }
+
+    int FrustumCuller::addBox( int cosID, const metaio::BoundingBox& box )
+    {
+        int id;
+        if (freeIDs.empty())
+        {
+            id = (int)boxes.size();
+            boxes.push_back(Box());
+        }
+        else
+        {
+            id = freeIDs.back();
+            freeIDs.pop_back();
+        }
+
+        int groupIndex = findGroup(cosID);
+        Group& group = groups[groupIndex];
+
+        Box& added = boxes[id];
+        added.active = true;
+        added.inside = true;
+        added.group = groupIndex;
+        added.slot = (int)group.members.size();
+        group.members.push_back(id);
+
+        resize(group);
+        store(group, added.slot, box);
+        return id;
+    }
+
+    void FrustumCuller::setBox( int id, const metaio::BoundingBox& box )
+    {
+        Group& group = groups[boxes[id].group];
+        store(group, boxes[id].slot, box);
+    }
+
+    void FrustumCuller::removeBox( int id )
+    {
+        Box& removed = boxes[id];
+        if (!removed.active)
+            return;
+
+        // move the last box of the group into the slot
+        Group& group = groups[removed.group];
+        int last = group.members.back();
+        int slot = removed.slot;
+        group.members[slot] = last;
+        boxes[last].slot = slot;
+        group.centerX[slot] = group.centerX[group.members.size() - 1];
+        group.centerY[slot] = group.centerY[group.members.size() - 1];
+        group.centerZ[slot] = group.centerZ[group.members.size() - 1];
+        group.extentX[slot] = group.extentX[group.members.size() - 1];
+        group.extentY[slot] = group.extentY[group.members.size() - 1];
+        group.extentZ[slot] = group.extentZ[group.members.size() - 1];
+        group.members.pop_back();
+        resize(group);
+        group.dirty = true;
+
+        removed.active = false;
+        freeIDs.push_back(id);
+    }
+
+    void FrustumCuller::setProjection( const float _projection[16] )
+    {
+        if (memcmp(projection, _projection, sizeof(projection)) == 0)
+            return;
+
+        memcpy(projection, _projection, sizeof(projection));
+        for (size_t i = 0; i < groups.size(); i++)
+            groups[i].dirty = true;
+    }
+
+    void FrustumCuller::setCosMatrix( int cosID, const float modelView[16] )
+    {
+        Group& group = groups[findGroup(cosID)];
+        if (group.hasMatrix && memcmp(group.modelView, modelView, sizeof(group.modelView)) == 0)
+            return;
+
+        memcpy(group.modelView, modelView, sizeof(group.modelView));
+        group.hasMatrix = true;
+        group.dirty = true;
+    }
+
+    int FrustumCuller::cull()
+    {
+        stats.frames++;
+        changed.clear();
+
+        stats.inside = stats.outside = 0;
+        for (size_t g = 0; g < groups.size(); g++)
+        {
+            Group& group = groups[g];
+            if (group.hasMatrix && group.dirty)
+            {
+                test(group);
+                group.dirty = false;
+                stats.cosTested++;
+                stats.boxesTested += group.members.size();
+
+                for (size_t i = 0; i < group.members.size(); i++)
+                {
+                    Box& box = boxes[group.members[i]];
+                    bool inside = !group.outside[i];
+                    if (inside != box.inside)
+                    {
+                        box.inside = inside;
+                        changed.push_back(group.members[i]);
+                    }
+                }
+            }
+            else
+                stats.cosSkipped++;
+
+            for (size_t i = 0; i < group.members.size(); i++)
+            {
+                if (boxes[group.members[i]].inside)
+                    stats.inside++;
+                else
+                    stats.outside++;
+            }
+        }
+        return (int)changed.size();
+    }
+
+    const char* FrustumCuller::getSIMDPath()
+    {
+#if defined(UNIFEYE_FRUSTUMCULLER_NEON)
+        return "neon";
+#elif defined(UNIFEYE_FRUSTUMCULLER_SSE2)
+        return "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    int FrustumCuller::findGroup( int cosID )
+    {
+        for (size_t i = 0; i < groups.size(); i++)
+        {
+            if (groups[i].cosID == cosID)
+                return (int)i;
+        }
+
+        Group group;
+        group.cosID = cosID;
+        group.hasMatrix = false;
+        group.dirty = true;
+        groups.push_back(group);
+        return (int)groups.size() - 1;
+    }
+
+    void FrustumCuller::store( Group& group, int slot, const metaio::BoundingBox& box )
+    {
+        group.centerX[slot] = 0.5f * (box.min.x + box.max.x);
+        group.centerY[slot] = 0.5f * (box.min.y + box.max.y);
+        group.centerZ[slot] = 0.5f * (box.min.z + box.max.z);
+        group.extentX[slot] = 0.5f * fabsf(box.max.x - box.min.x);
+        group.extentY[slot] = 0.5f * fabsf(box.max.y - box.min.y);
+        group.extentZ[slot] = 0.5f * fabsf(box.max.z - box.min.z);
+        group.dirty = true;
+    }
+
+    void FrustumCuller::resize( Group& group )
+    {
+        // the padding boxes are empty and at the origin, their results are never read
+        size_t padded = (group.members.size() + 3) & ~(size_t)3;
+        group.centerX.resize(padded, 0.0f);
+        group.centerY.resize(padded, 0.0f);
+        group.centerZ.resize(padded, 0.0f);
+        group.extentX.resize(padded, 0.0f);
+        group.extentY.resize(padded, 0.0f);
+        group.extentZ.resize(padded, 0.0f);
+        group.outside.resize(padded, 0);
+    }
+
+    void FrustumCuller::test( Group& group )
+    {
+        float clip[16], planes[24];
+        multiplyMatrices(projection, group.modelView, clip);
+        getPlanes(clip, planes);
+
+#if defined(UNIFEYE_FRUSTUMCULLER_NEON) || defined(UNIFEYE_FRUSTUMCULLER_SSE2)
+        if (simdEnabled)
+        {
+            testSIMD(group, planes);
+            return;
+        }
+#endif
+        testScalar(group, planes, 0);
+    }
+
+    void FrustumCuller::testScalar( Group& group, const float planes[24], int begin )
+    {
+        for (size_t i = begin; i < group.members.size(); i++)
+        {
+            bool outside = false;
+            for (int p = 0; p < 6 && !outside; p++)
+            {
+                const float* plane = planes + p * 4;
+                float distance = plane[0] * group.centerX[i] + plane[1] * group.centerY[i] +
+                    plane[2] * group.centerZ[i] + plane[3];
+                float radius = fabsf(plane[0]) * group.extentX[i] + fabsf(plane[1]) * group.extentY[i] +
+                    fabsf(plane[2]) * group.extentZ[i];
+                outside = distance + radius < 0.0f;
+            }
+            group.outside[i] = outside;
+        }
+    }
+
+#if defined(UNIFEYE_FRUSTUMCULLER_NEON)
+
+    void FrustumCuller::testSIMD( Group& group, const float planes[24] )
+    {
+        for (size_t i = 0; i < group.members.size(); i += 4)
+        {
+            float32x4_t cx = vld1q_f32(&group.centerX[i]), cy = vld1q_f32(&group.centerY[i]), cz = vld1q_f32(&group.centerZ[i]);
+            float32x4_t ex = vld1q_f32(&group.extentX[i]), ey = vld1q_f32(&group.extentY[i]), ez = vld1q_f32(&group.extentZ[i]);
+
+            uint32x4_t outside = vdupq_n_u32(0);
+            for (int p = 0; p < 6; p++)
+            {
+                const float* plane = planes + p * 4;
+                float32x4_t distance = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(plane[3]), cx, plane[0]),
+                    cy, plane[1]), cz, plane[2]);
+                distance = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(distance, ex, fabsf(plane[0])), ey, fabsf(plane[1])),
+                    ez, fabsf(plane[2]));
+                outside = vorrq_u32(outside, vcltq_f32(distance, vdupq_n_f32(0.0f)));
+            }
+
+            uint32_t lanes[4];
+            vst1q_u32(lanes, outside);
+            for (int k = 0; k < 4; k++)
+                group.outside[i + k] = lanes[k] != 0;
+        }
+    }
+
+#elif defined(UNIFEYE_FRUSTUMCULLER_SSE2)
+
+    void FrustumCuller::testSIMD( Group& group, const float planes[24] )
+    {
+        for (size_t i = 0; i < group.members.size(); i += 4)
+        {
+            __m128 cx = _mm_loadu_ps(&group.centerX[i]), cy = _mm_loadu_ps(&group.centerY[i]), cz = _mm_loadu_ps(&group.centerZ[i]);
+            __m128 ex = _mm_loadu_ps(&group.extentX[i]), ey = _mm_loadu_ps(&group.extentY[i]), ez = _mm_loadu_ps(&group.extentZ[i]);
+
+            __m128 outside = _mm_setzero_ps();
+            for (int p = 0; p < 6; p++)
+            {
+                const float* plane = planes + p * 4;
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane[0])),
+                    _mm_mul_ps(cy, _mm_set1_ps(plane[1]))), _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane[2])),
+                    _mm_set1_ps(plane[3])));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(fabsf(plane[0]))),
+                    _mm_mul_ps(ey, _mm_set1_ps(fabsf(plane[1])))), _mm_mul_ps(ez, _mm_set1_ps(fabsf(plane[2]))));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+            }
+
+            int mask = _mm_movemask_ps(outside);
+            for (int k = 0; k < 4; k++)
+                group.outside[i + k] = (mask >> k) & 1;
+        }
+    }
+
+#else
+
+    void FrustumCuller::testSIMD( Group& group, const float planes[24] )
+    {
+        testScalar(group, planes, 0);
+    }
+
+#endif
+
+    UnifeyeFrustumCulling::UnifeyeFrustumCulling( metaio::IUnifeyeMobile* _unifeye ) : unifeye(_unifeye)
+    {
+    }
+
+    void UnifeyeFrustumCulling::addGeometry( metaio::IUnifeyeMobileGeometry* geometry )
+    {
+        if (ids.count(geometry))
+            return;
+
+        int id = culler.addBox(geometry->getCos(), getBox(geometry));
+        ids[geometry] = id;
+        if ((int)geometries.size() <= id)
+            geometries.resize(id + 1, NULL);
+        geometries[id] = geometry;
+    }
+
+    void UnifeyeFrustumCulling::removeGeometry( metaio::IUnifeyeMobileGeometry* geometry )
+    {
+        std::map<metaio::IUnifeyeMobileGeometry*, int>::iterator found = ids.find(geometry);
+        if (found == ids.end())
+            return;
+
+        if (!culler.isInside(found->second))
+            geometry->setVisible(true);
+        culler.removeBox(found->second);
+        geometries[found->second] = NULL;
+        ids.erase(found);
+    }
+
+    void UnifeyeFrustumCulling::refresh( metaio::IUnifeyeMobileGeometry* geometry )
+    {
+        std::map<metaio::IUnifeyeMobileGeometry*, int>::iterator found = ids.find(geometry);
+        if (found != ids.end())
+            culler.setBox(found->second, getBox(geometry));
+    }
+
+    void UnifeyeFrustumCulling::update( const PoseSnapshot& poses )
+    {
+        float matrix[16];
+        unifeye->getProjectionMatrix(matrix);
+        culler.setProjection(matrix);
+
+        for (int i = 0; i < poses.getCount(); i++)
+        {
+            unifeye->getTrackingValues(poses.cosID[i], matrix, true);
+            culler.setCosMatrix(poses.cosID[i], matrix);
+        }
+
+        culler.cull();
+        const std::vector<int>& changed = culler.getChanged();
+        for (size_t i = 0; i < changed.size(); i++)
+            geometries[changed[i]]->setVisible(culler.isInside(changed[i]));
+    }
+
+    metaio::BoundingBox UnifeyeFrustumCulling::getBox( metaio::IUnifeyeMobileGeometry* geometry )
+    {
+        metaio::BoundingBox box = geometry->getBoundingBox();
+        metaio::Vector3d scale = geometry->getMoveScale();
+        metaio::Vector4d rotation = geometry->getMoveRotation();
+        metaio::Vector3d translation = geometry->getMoveTranslation();
+
+        float r[16];
+        quaternionToMatrix(axisAngleToQuaternion(rotation), r);
+
+        // the box around the scaled and rotated box
+        float center[3] = { 0.5f * (box.min.x + box.max.x) * scale.x, 0.5f * (box.min.y + box.max.y) * scale.y,
+            0.5f * (box.min.z + box.max.z) * scale.z };
+        float extent[3] = { 0.5f * fabsf((box.max.x - box.min.x) * scale.x),
+            0.5f * fabsf((box.max.y - box.min.y) * scale.y), 0.5f * fabsf((box.max.z - box.min.z) * scale.z) };
+        float offset[3] = { translation.x, translation.y, translation.z };
+
+        float outMin[3], outMax[3];
+        for (int row = 0; row < 3; row++)
+        {
+            float c = offset[row], e = 0.0f;
+            for (int k = 0; k < 3; k++)
+            {
+                c += r[k * 4 + row] * center[k];
+                e += fabsf(r[k * 4 + row]) * extent[k];
+            }
+            outMin[row] = c - e;
+            outMax[row] = c + e;
+        }
+
+        metaio::BoundingBox moved;
+        moved.min = metaio::Vector3d(outMin[0], outMin[1], outMin[2]);
+        moved.max = metaio::Vector3d(outMax[0], outMax[1], outMax[2]);
+        return moved;
+    }
+}
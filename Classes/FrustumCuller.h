@@ -0,0 +1,177 @@
+//
+//  FrustumCuller.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Hides geometries whose bounding box is outside the view frustum. The SDK
+//  draws every visible geometry of a tracked coordinate system, wherever it
+//  is. The boxes are grouped by coordinate system and stored as arrays of
+//  centers and extents, so four of them are tested against the six planes
+//  at once with SSE2/NEON. A coordinate system whose model view matrix and
+//  projection did not change since the last frame is not tested again.
+//
+#ifndef __UNIFEYE_FRUSTUMCULLER_H__
+#define __UNIFEYE_FRUSTUMCULLER_H__
+
+#include <map>
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+namespace metaio
+{
+    class IUnifeyeMobile;           // forward declaration
+    class IUnifeyeMobileGeometry;   // forward declaration
+}
+
+namespace unifeye
+{
+    class PoseSnapshot;             // forward declaration
+
+    /**
+     * \brief Statistics of a FrustumCuller
+     */
+    struct FrustumCullerStats
+    {
+        unsigned long frames;           ///< calls to cull()
+        unsigned long cosTested;        ///< coordinate systems tested
+        unsigned long cosSkipped;       ///< coordinate systems skipped because nothing changed
+        unsigned long boxesTested;      ///< boxes tested
+        int inside;                     ///< boxes in the frustum after the last cull()
+        int outside;                    ///< boxes outside the frustum after the last cull()
+
+        FrustumCullerStats() : frames(0), cosTested(0), cosSkipped(0), boxesTested(0), inside(0), outside(0) {};
+    };
+
+    /**
+     * \brief Frustum test of bounding boxes per coordinate system
+     *
+     * Matrices are column major, as returned by getTrackingValues and
+     * getProjectionMatrix. Boxes of coordinate systems without a matrix
+     * keep their last state.
+     */
+    class FrustumCuller
+    {
+    public:
+        FrustumCuller();
+
+        /**
+         * \brief Add a box
+         * \param cosID the (one-based) coordinate system the box is in
+         * \param box the box in the coordinates of the coordinate system
+         * \return the ID of the box, it starts out inside
+         */
+        int addBox( int cosID, const metaio::BoundingBox& box );
+
+        /// Move a box
+        void setBox( int id, const metaio::BoundingBox& box );
+
+        /// Remove a box, its ID can be reused
+        void removeBox( int id );
+
+        /// Set the projection matrix
+        void setProjection( const float projection[16] );
+
+        /// Set the model view matrix of a coordinate system for this frame
+        void setCosMatrix( int cosID, const float modelView[16] );
+
+        /**
+         * \brief Test the boxes of the coordinate systems that changed
+         * \return the number of boxes that entered or left the frustum
+         */
+        int cull();
+
+        /// The boxes that entered or left the frustum in the last cull()
+        const std::vector<int>& getChanged() const { return changed; }
+
+        /// true if a box was in the frustum at the last cull()
+        bool isInside( int id ) const { return boxes[id].inside; }
+
+        /// Use the SSE2/NEON path where available, for comparisons
+        void setSIMDEnabled( bool enabled ) { simdEnabled = enabled; }
+
+        /// The SIMD path cull uses, "neon", "sse2" or "scalar"
+        static const char* getSIMDPath();
+
+        const FrustumCullerStats& getStats() const { return stats; }
+
+    private:
+        struct Box
+        {
+            bool active;
+            bool inside;
+            int group;
+            int slot;       // index within the group
+        };
+
+        // the boxes of one coordinate system, padded to a multiple of four
+        struct Group
+        {
+            int cosID;
+            float modelView[16];
+            bool hasMatrix;
+            bool dirty;
+            std::vector<int> members;
+            std::vector<float> centerX, centerY, centerZ, extentX, extentY, extentZ;
+            std::vector<unsigned char> outside;
+        };
+
+        FrustumCuller( const FrustumCuller& );
+        FrustumCuller& operator=( const FrustumCuller& );
+
+        int findGroup( int cosID );
+        void store( Group& group, int slot, const metaio::BoundingBox& box );
+        void resize( Group& group );
+        void test( Group& group );
+        void testScalar( Group& group, const float planes[24], int begin );
+        void testSIMD( Group& group, const float planes[24] );
+
+        std::vector<Box> boxes;
+        std::vector<int> freeIDs;
+        std::vector<Group> groups;
+
+        float projection[16];
+        std::vector<int> changed;
+        bool simdEnabled;
+        FrustumCullerStats stats;
+    };
+
+    /**
+     * \brief Culls geometries of an SDK instance with a FrustumCuller
+     *
+     * The box of a geometry is its getBoundingBox() moved by its move
+     * scale, rotation and translation. Call refresh() after changing those.
+     */
+    class UnifeyeFrustumCulling
+    {
+    public:
+        explicit UnifeyeFrustumCulling( metaio::IUnifeyeMobile* unifeye );
+
+        /// Start culling a geometry
+        void addGeometry( metaio::IUnifeyeMobileGeometry* geometry );
+
+        /// Stop culling a geometry and show it again
+        void removeGeometry( metaio::IUnifeyeMobileGeometry* geometry );
+
+        /// Read the box of a geometry again
+        void refresh( metaio::IUnifeyeMobileGeometry* geometry );
+
+        /**
+         * \brief Hide and show the geometries for a frame
+         * \param poses the coordinate systems tracked in the frame
+         */
+        void update( const PoseSnapshot& poses );
+
+        const FrustumCuller& getCuller() const { return culler; }
+
+    private:
+        static metaio::BoundingBox getBox( metaio::IUnifeyeMobileGeometry* geometry );
+
+        metaio::IUnifeyeMobile* unifeye;
+        FrustumCuller culler;
+        std::map<metaio::IUnifeyeMobileGeometry*, int> ids;
+        std::vector<metaio::IUnifeyeMobileGeometry*> geometries;    // by box ID
+    };
+}
+
+#endif
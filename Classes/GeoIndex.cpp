@@ -0,0 +1,131 @@
+//
+//  GeoIndex.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "GeoIndex.h"
+
+#include <algorithm>
+#include <math.h>
+
+namespace unifeye
+{
+    namespace
+    {
+        // WGS84
+        const double SEMI_MAJOR_AXIS = 6378137.0;
+        const double FLATTENING = 1.0 / 298.257223563;
+        const double ECCENTRICITY_SQUARED = FLATTENING * (2.0 - FLATTENING);
+
+        const double DEGREES_TO_RADIANS = 3.14159265358979323846 / 180.0;
+
+        // keeps the rows and columns of keys positive
+        const long long CELL_OFFSET = 1LL << 30;
+
+        inline int getCell( double degrees, double cellDegrees )
+        {
+            return (int)floor(degrees / cellDegrees);
+        }
+
+        inline long long getCellKey( int row, int column )
+        {
+            return ((row + CELL_OFFSET) << 32) | (column + CELL_OFFSET);
+        }
+    }
+
+    GeoIndex::GeoIndex( double _cellSize ) : cellSize(_cellSize), cellLatitude(1.0), cellLongitude(1.0)
+    {
+    }
+
+    void GeoIndex::getMetersPerDegree( double latitude, double& north, double& east )
+    {
+        double sinLatitude = sin(latitude * DEGREES_TO_RADIANS);
+        double w = 1.0 - ECCENTRICITY_SQUARED * sinLatitude * sinLatitude;
+
+        // radii of curvature in the meridian and the prime vertical
+        double meridian = SEMI_MAJOR_AXIS * (1.0 - ECCENTRICITY_SQUARED) / (w * sqrt(w));
+        double prime = SEMI_MAJOR_AXIS / sqrt(w);
+
+        north = meridian * DEGREES_TO_RADIANS;
+        east = prime * cos(latitude * DEGREES_TO_RADIANS) * DEGREES_TO_RADIANS;
+    }
+
+    void GeoIndex::build( const metaio::LLACoordinate* _points, int count )
+    {
+        points.assign(_points, _points + count);
+
+        // cells are square at the mean latitude of the dataset
+        double meanLatitude = 0.0;
+        for (int i = 0; i < count; i++)
+            meanLatitude += points[i].latitude;
+        meanLatitude = count > 0 ? meanLatitude / count : 0.0;
+
+        double north, east;
+        getMetersPerDegree(meanLatitude, north, east);
+        cellLatitude = cellSize / north;
+        cellLongitude = cellSize / std::max(east, 1.0);
+
+        std::vector<std::pair<long long, int> > cells(count);
+        for (int i = 0; i < count; i++)
+        {
+            long long key = getCellKey(getCell(points[i].latitude, cellLatitude),
+                getCell(points[i].longitude, cellLongitude));
+            cells[i] = std::make_pair(key, i);
+        }
+        std::sort(cells.begin(), cells.end());
+
+        keys.resize(count);
+        sorted.resize(count);
+        latitudes.resize(count);
+        longitudes.resize(count);
+        for (int i = 0; i < count; i++)
+        {
+            keys[i] = cells[i].first;
+            sorted[i] = cells[i].second;
+            latitudes[i] = points[sorted[i]].latitude;
+            longitudes[i] = points[sorted[i]].longitude;
+        }
+    }
+
+    void GeoIndex::query( const metaio::LLACoordinate& center, double radius, std::vector<GeoHit>& hits ) const
+    {
+        hits.clear();
+        if (points.empty())
+            return;
+
+        double north, east;
+        getMetersPerDegree(center.latitude, north, east);
+        double radiusLatitude = radius / north;
+        double radiusLongitude = radius / std::max(east, 1.0);
+
+        int firstRow = getCell(center.latitude - radiusLatitude, cellLatitude);
+        int lastRow = getCell(center.latitude + radiusLatitude, cellLatitude);
+        int firstColumn = getCell(center.longitude - radiusLongitude, cellLongitude);
+        int lastColumn = getCell(center.longitude + radiusLongitude, cellLongitude);
+
+        double radiusSquared = radius * radius;
+        for (int row = firstRow; row <= lastRow; row++)
+        {
+            // the cells of a row are contiguous in the sorted keys
+            long long lastKey = getCellKey(row, lastColumn);
+            size_t i = std::lower_bound(keys.begin(), keys.end(), getCellKey(row, firstColumn)) - keys.begin();
+            for (; i < keys.size() && keys[i] <= lastKey; i++)
+            {
+                double dy = (latitudes[i] - center.latitude) * north;
+                double dx = (longitudes[i] - center.longitude) * east;
+                double distanceSquared = dx * dx + dy * dy;
+                if (distanceSquared > radiusSquared)
+                    continue;
+
+                GeoHit hit;
+                hit.point = sorted[i];
+                hit.distance = (float)sqrt(distanceSquared);
+                hit.bearing = (float)(atan2(dx, dy) / DEGREES_TO_RADIANS);
+                if (hit.bearing < 0.0f)
+                    hit.bearing += 360.0f;
+                hits.push_back(hit);
+            }
+        }
+    }
+}
@@ -0,0 +1,88 @@
+//
+//  GeoIndex.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Finds the POIs around a position without looking at all of them. The
+//  POIs are bucketed into cells of a fixed size in meters and sorted by
+//  cell, so a query is a binary search per row of cells it covers plus a
+//  linear scan over the POIs of those cells.
+//
+//  Distances use a local flat earth approximation around the query
+//  position, which is within 0.1% for the few kilometers POIs are shown
+//  in. Datasets crossing the 180th meridian are not supported.
+//
+#ifndef __UNIFEYE_GEOINDEX_H__
+#define __UNIFEYE_GEOINDEX_H__
+
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+namespace unifeye
+{
+    /**
+     * \brief A POI found by GeoIndex::query
+     */
+    struct GeoHit
+    {
+        int point;          ///< index of the POI in the dataset
+        float distance;     ///< distance in meters
+        float bearing;      ///< direction in degrees, 0 is north, 90 east
+    };
+
+    /**
+     * \brief Static grid index over LLA coordinates
+     */
+    class GeoIndex
+    {
+    public:
+        /**
+         * \brief Constructor
+         * \param cellSize cell size in meters, about the usual query radius works well
+         */
+        explicit GeoIndex( double cellSize = 250.0 );
+
+        /**
+         * \brief Index a dataset, replacing the previous one
+         * \param points the POIs
+         * \param count number of POIs
+         */
+        void build( const metaio::LLACoordinate* points, int count );
+
+        /// Number of POIs
+        int getPointCount() const { return (int)points.size(); }
+
+        /// A POI of the dataset
+        const metaio::LLACoordinate& getPoint( int point ) const { return points[point]; }
+
+        /**
+         * \brief Find the POIs within a radius
+         * \param center the position to search around
+         * \param radius the radius in meters
+         * \param[out] hits the POIs found, in no particular order
+         */
+        void query( const metaio::LLACoordinate& center, double radius, std::vector<GeoHit>& hits ) const;
+
+        /**
+         * \brief Meters per degree of latitude and longitude
+         * \param latitude latitude in degrees
+         * \param[out] north meters per degree of latitude
+         * \param[out] east meters per degree of longitude
+         */
+        static void getMetersPerDegree( double latitude, double& north, double& east );
+
+    private:
+        std::vector<metaio::LLACoordinate> points;
+
+        // the POIs sorted by cell, with copies of their coordinates for the scan
+        std::vector<long long> keys;
+        std::vector<int> sorted;
+        std::vector<double> latitudes, longitudes;
+
+        double cellSize;
+        double cellLatitude, cellLongitude;     // cell size in degrees
+    };
+}
+
+#endif
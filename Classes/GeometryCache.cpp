@@ -0,0 +1,308 @@
+//
+//  GeometryCache.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "GeometryCache.h"
+#include "ContentHash.h"
+#include "FrameScheduler.h"
+#include "PerfTrace.h"
+#include "Threading.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <UnifeyeSDKMobile/AS_IUnifeyeMobile.h>
+
+namespace unifeye
+{
+    namespace
+    {
+        // all caches alive, for purgeAll()
+        Mutex registryMutex;
+        std::vector<GeometryCache*> registry;
+
+        // Pixel size of a PNG or JPEG from its header, without decoding it
+        bool readImageSize( const std::string& path, unsigned int& width, unsigned int& height )
+        {
+            FILE* file = fopen(path.c_str(), "rb");
+            if (!file)
+                return false;
+
+            unsigned char header[24];
+            bool found = false;
+            if (fread(header, 1, sizeof(header), file) == sizeof(header))
+            {
+                if (memcmp(header, "\x89PNG", 4) == 0 && memcmp(header + 12, "IHDR", 4) == 0)
+                {
+                    width = (header[16] << 24) | (header[17] << 16) | (header[18] << 8) | header[19];
+                    height = (header[20] << 24) | (header[21] << 16) | (header[22] << 8) | header[23];
+                    found = true;
+                }
+                else if (header[0] == 0xFF && header[1] == 0xD8)
+                {
+                    // walk the segments up to the start of frame
+                    long offset = 2;
+                    unsigned char segment[9];
+                    while (!found && fseek(file, offset, SEEK_SET) == 0 && fread(segment, 1, 9, file) == 9)
+                    {
+                        if (segment[0] != 0xFF)
+                            break;
+                        unsigned char marker = segment[1];
+                        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+                        {
+                            height = (segment[5] << 8) | segment[6];
+                            width = (segment[7] << 8) | segment[8];
+                            found = true;
+                        }
+                        offset += 2 + ((segment[2] << 8) | segment[3]);
+                    }
+                }
+            }
+
+            fclose(file);
+            return found;
+        }
+    }
+
+    metaio::IUnifeyeMobileGeometry* UnifeyeGeometryFactory::loadGeometry( const std::string& path )
+    {
+        UNIFEYE_PERF_SCOPE("loadGeometry");
+        return unifeye->loadGeometry(path);
+    }
+
+    void UnifeyeGeometryFactory::unloadGeometry( metaio::IUnifeyeMobileGeometry* geometry )
+    {
+        unifeye->unloadGeometry(geometry);
+    }
+
+    void UnifeyeGeometryFactory::setVisible( metaio::IUnifeyeMobileGeometry* geometry, bool visible )
+    {
+        geometry->setVisible(visible);
+    }
+
+    bool UnifeyeGeometryFactory::isRendered( metaio::IUnifeyeMobileGeometry* geometry )
+    {
+        return geometry->getIsRendered();
+    }
+
+    size_t UnifeyeGeometryFactory::estimateBytes( const std::string& path, size_t fileSize )
+    {
+        size_t bytes = fileSize * 2;
+
+        std::string base = path.substr(0, path.rfind('.'));
+        const char* extensions[] = { ".png", ".jpg", ".jpeg" };
+        for (int i = 0; i < 3; i++)
+        {
+            unsigned int width, height;
+            if (readImageSize(base + extensions[i], width, height))
+            {
+                bytes += (size_t)width * height * 4;
+                break;
+            }
+        }
+
+        return bytes;
+    }
+
+    GeometryCache::GeometryCache( IGeometryFactory* _factory, IFrameClock* _clock, size_t _budget ) :
+        factory(_factory), clock(_clock), budget(_budget), frame(0)
+    {
+        ScopedLock lock(registryMutex);
+        registry.push_back(this);
+    }
+
+    GeometryCache::~GeometryCache()
+    {
+        {
+            ScopedLock lock(registryMutex);
+            for (size_t i = 0; i < registry.size(); i++)
+            {
+                if (registry[i] == this)
+                {
+                    registry.erase(registry.begin() + i);
+                    break;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < entries.size(); i++)
+            factory->unloadGeometry(entries[i].geometry);
+    }
+
+    metaio::IUnifeyeMobileGeometry* GeometryCache::acquire( const std::string& path )
+    {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            return 0;
+
+        unsigned long long hash;
+        if (!hashFile(path, (long)info.st_mtime, hash))
+            return 0;
+
+        Entry* entry = findReleased(path, hash);
+        if (entry)
+        {
+            stats.hits++;
+            entry->references = 1;
+            factory->setVisible(entry->geometry, true);
+            stats.bytesPinned += entry->bytes;
+            return entry->geometry;
+        }
+
+        stats.misses++;
+
+        // an older version of the file is not needed any more once released
+        for (size_t i = entries.size(); i > 0; i--)
+        {
+            if (entries[i - 1].path == path && entries[i - 1].hash != hash && entries[i - 1].references == 0)
+                unload(entries[i - 1]);
+        }
+
+        metaio::IUnifeyeMobileGeometry* geometry = factory->loadGeometry(path);
+        if (!geometry)
+            return 0;
+
+        Entry newEntry;
+        newEntry.path = path;
+        newEntry.hash = hash;
+        newEntry.modified = (long)info.st_mtime;
+        newEntry.fileSize = (size_t)info.st_size;
+        newEntry.bytes = factory->estimateBytes(path, newEntry.fileSize);
+        newEntry.geometry = geometry;
+        newEntry.references = 1;
+        newEntry.lastVisible = frame;
+        entries.push_back(newEntry);
+
+        stats.bytesLoaded += newEntry.bytes;
+        stats.bytesPinned += newEntry.bytes;
+
+        // make room for it among the released geometries
+        evict(budget);
+        return geometry;
+    }
+
+    void GeometryCache::release( metaio::IUnifeyeMobileGeometry* geometry )
+    {
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            Entry& entry = entries[i];
+            if (entry.geometry != geometry || entry.references == 0)
+                continue;
+
+            if (--entry.references == 0)
+            {
+                factory->setVisible(geometry, false);
+                stats.bytesPinned -= entry.bytes;
+                evict(budget);
+            }
+            return;
+        }
+    }
+
+    void GeometryCache::update()
+    {
+        frame++;
+
+        // released geometries are hidden, only the acquired ones can be visible
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            Entry& entry = entries[i];
+            if (entry.references > 0 && factory->isRendered(entry.geometry))
+                entry.lastVisible = frame;
+        }
+
+        evict(budget);
+    }
+
+    void GeometryCache::setBudget( size_t _budget )
+    {
+        budget = _budget;
+        evict(budget);
+    }
+
+    void GeometryCache::purge()
+    {
+        evict(0);
+    }
+
+    void GeometryCache::purgeAll()
+    {
+        ScopedLock lock(registryMutex);
+        for (size_t i = 0; i < registry.size(); i++)
+            registry[i]->purge();
+    }
+
+    GeometryCache::Entry* GeometryCache::findReleased( const std::string& path, unsigned long long hash )
+    {
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (entries[i].references == 0 && entries[i].hash == hash && entries[i].path == path)
+                return &entries[i];
+        }
+        return 0;
+    }
+
+    bool GeometryCache::hashFile( const std::string& path, long modified, unsigned long long& hash )
+    {
+        // the file has not changed since it was loaded, skip reading it
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (entries[i].modified == modified && entries[i].path == path)
+            {
+                hash = entries[i].hash;
+                return true;
+            }
+        }
+
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+
+        hash = CONTENT_HASH_INITIAL;
+        unsigned char buffer[16 * 1024];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            hash = hashBytes(buffer, read, hash);
+
+        fclose(file);
+        return true;
+    }
+
+    void GeometryCache::evict( size_t targetBytes )
+    {
+        while (stats.bytesLoaded > targetBytes)
+        {
+            // least recently visible of the released geometries
+            size_t victim = entries.size();
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                if (entries[i].references > 0)
+                    continue;
+                if (victim == entries.size() || entries[i].lastVisible < entries[victim].lastVisible)
+                    victim = i;
+            }
+
+            if (victim == entries.size())
+                return;
+
+            double start = clock ? clock->now() : 0.0;
+            unload(entries[victim]);
+            double duration = clock ? clock->now() - start : 0.0;
+
+            stats.evictions++;
+            stats.totalEvictionTime += duration;
+            if (duration > stats.maxEvictionTime)
+                stats.maxEvictionTime = duration;
+        }
+    }
+
+    void GeometryCache::unload( Entry& entry )
+    {
+        factory->unloadGeometry(entry.geometry);
+        stats.bytesLoaded -= entry.bytes;
+        entries.erase(entries.begin() + (&entry - &entries[0]));
+    }
+}
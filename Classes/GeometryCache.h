@@ -0,0 +1,207 @@
+//
+//  GeometryCache.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Keeps loaded geometries around so that opening a view again does not
+//  parse the same model twice, and unloads the ones that have not been
+//  visible for the longest time when the memory budget is exceeded or the
+//  system sends a memory warning.
+//
+//  The SDK is only reached through IGeometryFactory, so the policy can be
+//  exercised with a fake factory and clock.
+//
+#ifndef __UNIFEYE_GEOMETRYCACHE_H__
+#define __UNIFEYE_GEOMETRYCACHE_H__
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace metaio
+{
+    class IUnifeyeMobile;           // forward declaration
+    class IUnifeyeMobileGeometry;   // forward declaration
+}
+
+namespace unifeye
+{
+    class IFrameClock;              // forward declaration
+
+    /**
+     * \brief Loads and unloads geometries for a GeometryCache
+     */
+    class IGeometryFactory
+    {
+    public:
+        virtual ~IGeometryFactory() {};
+
+        /// Load a geometry, NULL on failure
+        virtual metaio::IUnifeyeMobileGeometry* loadGeometry( const std::string& path ) = 0;
+
+        /// Unload a geometry returned by loadGeometry()
+        virtual void unloadGeometry( metaio::IUnifeyeMobileGeometry* geometry ) = 0;
+
+        /// Show or hide a geometry
+        virtual void setVisible( metaio::IUnifeyeMobileGeometry* geometry, bool visible ) = 0;
+
+        /// true if the geometry was drawn in the last frame
+        virtual bool isRendered( metaio::IUnifeyeMobileGeometry* geometry ) = 0;
+
+        /**
+         * \brief Estimate the memory used by a loaded geometry
+         * \param path the file the geometry was loaded from
+         * \param fileSize size of that file in bytes
+         * \return mesh and texture memory in bytes
+         */
+        virtual size_t estimateBytes( const std::string& path, size_t fileSize ) = 0;
+    };
+
+    /**
+     * \brief IGeometryFactory on top of an SDK instance
+     *
+     * Models are loaded from their source files. Compiled meshes (.umesh,
+     * see MeshFile.h) are not, the SDK would parse a file written from them
+     * and that is slower than parsing the source (see meshbench).
+     *
+     * The estimate is twice the model file (vertex buffers are expanded on
+     * load) plus the decoded size of a PNG or JPEG texture with the same base
+     * name next to it, which is where the SDK looks for MD2 textures.
+     */
+    class UnifeyeGeometryFactory : public IGeometryFactory
+    {
+    public:
+        /**
+         * \brief Constructor
+         * \param unifeye the SDK instance
+         */
+        UnifeyeGeometryFactory( metaio::IUnifeyeMobile* _unifeye ) : unifeye(_unifeye) {};
+
+        virtual metaio::IUnifeyeMobileGeometry* loadGeometry( const std::string& path );
+        virtual void unloadGeometry( metaio::IUnifeyeMobileGeometry* geometry );
+        virtual void setVisible( metaio::IUnifeyeMobileGeometry* geometry, bool visible );
+        virtual bool isRendered( metaio::IUnifeyeMobileGeometry* geometry );
+        virtual size_t estimateBytes( const std::string& path, size_t fileSize );
+
+    private:
+        metaio::IUnifeyeMobile* unifeye;
+    };
+
+    /**
+     * \brief Counters of a GeometryCache
+     */
+    struct GeometryCacheStats
+    {
+        unsigned long hits;             ///< acquire() calls served by a loaded geometry
+        unsigned long misses;           ///< acquire() calls that had to load
+        unsigned long evictions;        ///< geometries unloaded to free memory
+        size_t bytesLoaded;             ///< estimated bytes of all loaded geometries
+        size_t bytesPinned;             ///< the part of bytesLoaded that is acquired
+        double totalEvictionTime;       ///< seconds spent in unloadGeometry() for evictions
+        double maxEvictionTime;         ///< longest single eviction in seconds
+
+        GeometryCacheStats() : hits(0), misses(0), evictions(0), bytesLoaded(0), bytesPinned(0),
+            totalEvictionTime(0), maxEvictionTime(0) {};
+
+        /// Fraction of acquire() calls that were hits
+        double getHitRate() const { return hits + misses ? (double)hits / (hits + misses) : 0.0; }
+    };
+
+    /**
+     * \brief Geometry cache of one SDK instance with a memory budget
+     *
+     * Entries are keyed by path and content hash, so a file that changed on
+     * disk is loaded again. A geometry is acquired by one caller at a time,
+     * acquiring a path that is in use loads another instance, so callers
+     * never move or hide each other's geometry. Acquired geometries are
+     * never unloaded; released ones are hidden and kept until they are
+     * evicted. Eviction goes from the
+     * least recently visible entry to the most recent one.
+     *
+     * All caches are registered so that purgeAll() can free them on a
+     * memory warning. The cache itself is not thread safe and must be used
+     * from the thread that renders.
+     */
+    class GeometryCache
+    {
+    public:
+        /**
+         * \brief Constructor
+         * \param factory loads the geometries, not owned
+         * \param clock used to measure evictions, not owned
+         * \param budget memory budget in bytes
+         */
+        GeometryCache( IGeometryFactory* factory, IFrameClock* clock, size_t budget = 16 * 1024 * 1024 );
+
+        /// Destructor, unloads all geometries
+        ~GeometryCache();
+
+        /**
+         * \brief Get a geometry, loading it if no released one is cached
+         *
+         * A cached geometry keeps the transformation it had when it was
+         * released.
+         *
+         * \param path the model file
+         * \return the visible geometry, NULL if it could not be loaded
+         */
+        metaio::IUnifeyeMobileGeometry* acquire( const std::string& path );
+
+        /**
+         * \brief Give a geometry back, it is hidden and may be evicted
+         * \param geometry a geometry returned by acquire()
+         */
+        void release( metaio::IUnifeyeMobileGeometry* geometry );
+
+        /**
+         * \brief Record which geometries are visible and enforce the budget
+         *
+         * Call once per frame after render().
+         */
+        void update();
+
+        /// Set the budget in bytes and evict down to it
+        void setBudget( size_t budget );
+
+        size_t getBudget() const { return budget; }
+
+        /// Unload all geometries that are not acquired
+        void purge();
+
+        /// purge() every cache, e.g. on a memory warning
+        static void purgeAll();
+
+        GeometryCacheStats getStats() const { return stats; }
+
+    private:
+        GeometryCache( const GeometryCache& );
+        GeometryCache& operator=( const GeometryCache& );
+
+        struct Entry
+        {
+            std::string path;
+            unsigned long long hash;            // FNV-1a of the file content
+            long modified;                      // file time the hash was computed for
+            size_t fileSize;
+            size_t bytes;                       // estimated memory
+            metaio::IUnifeyeMobileGeometry* geometry;
+            int references;                     // 1 while acquired
+            unsigned long lastVisible;          // frame the geometry was last rendered in
+        };
+
+        Entry* findReleased( const std::string& path, unsigned long long hash );
+        bool hashFile( const std::string& path, long modified, unsigned long long& hash );
+        void evict( size_t targetBytes );
+        void unload( Entry& entry );
+
+        IGeometryFactory* factory;
+        IFrameClock* clock;
+        size_t budget;
+        unsigned long frame;
+        std::vector<Entry> entries;
+        GeometryCacheStats stats;
+    };
+}
+
+#endif
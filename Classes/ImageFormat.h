@@ -0,0 +1,72 @@
+//
+//  ImageFormat.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Memory layout of the ECOLOR_FORMATs used in metaio::ImageStruct.
+//  ImageStructs carry no stride, all rows are tightly packed.
+//
+#ifndef __UNIFEYE_IMAGEFORMAT_H__
+#define __UNIFEYE_IMAGEFORMAT_H__
+
+#include <stddef.h>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+namespace unifeye
+{
+    /**
+     * \brief Bytes per pixel of a packed color format
+     * \param format the color format
+     * \return bytes per pixel, 0 for planar or unknown formats
+     */
+    inline int getBytesPerPixel( metaio::common::ECOLOR_FORMAT format )
+    {
+        switch (format)
+        {
+            case metaio::common::ECF_A1R5G5B5:
+            case metaio::common::ECF_R5G6B5:
+            case metaio::common::ECF_V8Y8U8Y8:
+            case metaio::common::ECF_V8A8U8Y8:
+                return 2;
+            case metaio::common::ECF_R8G8B8:
+            case metaio::common::ECF_B8G8R8:
+            case metaio::common::ECF_HSV:
+                return 3;
+            case metaio::common::ECF_A8R8G8B8:
+            case metaio::common::ECF_A8B8G8R8:
+                return 4;
+            case metaio::common::ECF_GRAY:
+                return 1;
+            default:
+                return 0;
+        }
+    }
+
+    /**
+     * \brief Size of the pixel buffer of an image
+     * \param format the color format
+     * \param width width in pixels
+     * \param height height in pixels
+     * \return size in bytes, 0 for unknown formats
+     */
+    inline size_t getImageBufferSize( metaio::common::ECOLOR_FORMAT format, int width, int height )
+    {
+        if (width <= 0 || height <= 0)
+            return 0;
+
+        // full resolution luminance plane followed by the subsampled chroma plane
+        if (format == metaio::common::ECF_YUV420SP)
+            return (size_t)width * height + (size_t)((width + 1) / 2) * ((height + 1) / 2) * 2;
+
+        return (size_t)width * height * getBytesPerPixel(format);
+    }
+
+    /// Size of the pixel buffer of an image
+    inline size_t getImageBufferSize( const metaio::ImageStruct& image )
+    {
+        return getImageBufferSize(image.colorFormat, image.width, image.height);
+    }
+}
+
+#endif
@@ -0,0 +1,250 @@
+//
+//  LLAConverter.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Only 64 bit ARM has NEON instructions for doubles, 32 bit ARM uses the
+//  scalar path, which the VFP still runs in double precision.
+//
+#include "LLAConverter.h"
+
+#include <math.h>
+
+#include <UnifeyeSDKMobile/AS_IUnifeyeMobileGeometry.h>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define UNIFEYE_LLACONVERTER_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define UNIFEYE_LLACONVERTER_SSE2 1
+#endif
+
+namespace unifeye
+{
+    namespace
+    {
+        // WGS84
+        const double SEMI_MAJOR_AXIS = 6378137.0;
+        const double FLATTENING = 1.0 / 298.257223563;
+        const double ECCENTRICITY_SQUARED = FLATTENING * (2.0 - FLATTENING);
+
+        const double DEGREES_TO_RADIANS = 3.14159265358979323846 / 180.0;
+        const double METERS_TO_MILLIMETERS = 1000.0;
+    }
+
+    void convertLLAToECEF( const metaio::LLACoordinate& coordinate, double ecef[3] )
+    {
+        double latitude = coordinate.latitude * DEGREES_TO_RADIANS;
+        double longitude = coordinate.longitude * DEGREES_TO_RADIANS;
+        double sinLatitude = sin(latitude), cosLatitude = cos(latitude);
+
+        // radius of curvature in the prime vertical
+        double normal = SEMI_MAJOR_AXIS / sqrt(1.0 - ECCENTRICITY_SQUARED * sinLatitude * sinLatitude);
+
+        ecef[0] = (normal + coordinate.altitude) * cosLatitude * cos(longitude);
+        ecef[1] = (normal + coordinate.altitude) * cosLatitude * sin(longitude);
+        ecef[2] = (normal * (1.0 - ECCENTRICITY_SQUARED) + coordinate.altitude) * sinLatitude;
+    }
+
+    LLAConverter::LLAConverter() : altitudeEnabled(false), simdEnabled(true)
+    {
+        setReference(metaio::LLACoordinate());
+    }
+
+    int LLAConverter::addPoint( const metaio::LLACoordinate& coordinate )
+    {
+        int index = getPointCount();
+        coordinates.push_back(coordinate);
+        ecefX.push_back(0.0);
+        ecefY.push_back(0.0);
+        ecefZ.push_back(0.0);
+        east.push_back(0.0f);
+        north.push_back(0.0f);
+        up.push_back(0.0f);
+        setPoint(index, coordinate);
+        return index;
+    }
+
+    void LLAConverter::setPoint( int index, const metaio::LLACoordinate& coordinate )
+    {
+        coordinates[index] = coordinate;
+        if (!altitudeEnabled)
+            coordinates[index].altitude = 0.0;
+
+        double ecef[3];
+        convertLLAToECEF(coordinates[index], ecef);
+        ecefX[index] = ecef[0];
+        ecefY[index] = ecef[1];
+        ecefZ[index] = ecef[2];
+        coordinates[index].altitude = coordinate.altitude;
+    }
+
+    void LLAConverter::setPoints( const metaio::LLACoordinate* points, int count )
+    {
+        clear();
+        coordinates.reserve(count);
+        for (int i = 0; i < count; i++)
+            addPoint(points[i]);
+    }
+
+    void LLAConverter::clear()
+    {
+        coordinates.clear();
+        ecefX.clear();
+        ecefY.clear();
+        ecefZ.clear();
+        east.clear();
+        north.clear();
+        up.clear();
+    }
+
+    void LLAConverter::setReference( const metaio::LLACoordinate& coordinate )
+    {
+        reference = coordinate;
+
+        metaio::LLACoordinate sensor = coordinate;
+        if (!altitudeEnabled)
+            sensor.altitude = 0.0;
+        convertLLAToECEF(sensor, origin);
+
+        double latitude = coordinate.latitude * DEGREES_TO_RADIANS;
+        double longitude = coordinate.longitude * DEGREES_TO_RADIANS;
+        double sinLatitude = sin(latitude), cosLatitude = cos(latitude);
+        double sinLongitude = sin(longitude), cosLongitude = cos(longitude);
+
+        double rows[9] = {
+            -sinLongitude, cosLongitude, 0.0,
+            -sinLatitude * cosLongitude, -sinLatitude * sinLongitude, cosLatitude,
+            cosLatitude * cosLongitude, cosLatitude * sinLongitude, sinLatitude };
+        for (int i = 0; i < 9; i++)
+            rotation[i] = rows[i] * METERS_TO_MILLIMETERS;
+    }
+
+    void LLAConverter::setAltitudeEnabled( bool enabled )
+    {
+        if (enabled == altitudeEnabled)
+            return;
+
+        altitudeEnabled = enabled;
+        for (int i = 0; i < getPointCount(); i++)
+            setPoint(i, coordinates[i]);
+        setReference(reference);
+    }
+
+    void LLAConverter::convert()
+    {
+        int count = getPointCount();
+        int done = 0;
+#if defined(UNIFEYE_LLACONVERTER_NEON) || defined(UNIFEYE_LLACONVERTER_SSE2)
+        if (simdEnabled)
+        {
+            done = count & ~1;
+            convertSIMD(done);
+        }
+#endif
+        convertScalar(done, count);
+
+        // without altitudes everything is at the height of the sensor, as with setMoveTranslationLLA
+        if (!altitudeEnabled)
+        {
+            for (int i = 0; i < count; i++)
+                up[i] = 0.0f;
+        }
+    }
+
+    void LLAConverter::apply( metaio::IUnifeyeMobileGeometry* const* geometries ) const
+    {
+        for (int i = 0; i < getPointCount(); i++)
+        {
+            if (geometries[i])
+                geometries[i]->setMoveTranslation(metaio::Vector3d(east[i], north[i], up[i]));
+        }
+    }
+
+    const char* LLAConverter::getSIMDPath()
+    {
+#if defined(UNIFEYE_LLACONVERTER_NEON)
+        return "neon";
+#elif defined(UNIFEYE_LLACONVERTER_SSE2)
+        return "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    void LLAConverter::convertScalar( int begin, int end )
+    {
+        const double* r = rotation;
+        for (int i = begin; i < end; i++)
+        {
+            double dx = ecefX[i] - origin[0];
+            double dy = ecefY[i] - origin[1];
+            double dz = ecefZ[i] - origin[2];
+            east[i] = (float)(r[0] * dx + r[1] * dy);
+            north[i] = (float)(r[3] * dx + r[4] * dy + r[5] * dz);
+            up[i] = (float)(r[6] * dx + r[7] * dy + r[8] * dz);
+        }
+    }
+
+#if defined(UNIFEYE_LLACONVERTER_NEON)
+
+    void LLAConverter::convertSIMD( int end )
+    {
+        float64x2_t ox = vdupq_n_f64(origin[0]), oy = vdupq_n_f64(origin[1]), oz = vdupq_n_f64(origin[2]);
+        float64x2_t r0 = vdupq_n_f64(rotation[0]), r1 = vdupq_n_f64(rotation[1]);
+        float64x2_t r3 = vdupq_n_f64(rotation[3]), r4 = vdupq_n_f64(rotation[4]), r5 = vdupq_n_f64(rotation[5]);
+        float64x2_t r6 = vdupq_n_f64(rotation[6]), r7 = vdupq_n_f64(rotation[7]), r8 = vdupq_n_f64(rotation[8]);
+
+        for (int i = 0; i < end; i += 2)
+        {
+            float64x2_t dx = vsubq_f64(vld1q_f64(&ecefX[i]), ox);
+            float64x2_t dy = vsubq_f64(vld1q_f64(&ecefY[i]), oy);
+            float64x2_t dz = vsubq_f64(vld1q_f64(&ecefZ[i]), oz);
+
+            float64x2_t e = vfmaq_f64(vmulq_f64(r0, dx), r1, dy);
+            float64x2_t n = vfmaq_f64(vfmaq_f64(vmulq_f64(r3, dx), r4, dy), r5, dz);
+            float64x2_t u = vfmaq_f64(vfmaq_f64(vmulq_f64(r6, dx), r7, dy), r8, dz);
+
+            vst1_f32(&east[i], vcvt_f32_f64(e));
+            vst1_f32(&north[i], vcvt_f32_f64(n));
+            vst1_f32(&up[i], vcvt_f32_f64(u));
+        }
+    }
+
+#elif defined(UNIFEYE_LLACONVERTER_SSE2)
+
+    void LLAConverter::convertSIMD( int end )
+    {
+        __m128d ox = _mm_set1_pd(origin[0]), oy = _mm_set1_pd(origin[1]), oz = _mm_set1_pd(origin[2]);
+        __m128d r0 = _mm_set1_pd(rotation[0]), r1 = _mm_set1_pd(rotation[1]);
+        __m128d r3 = _mm_set1_pd(rotation[3]), r4 = _mm_set1_pd(rotation[4]), r5 = _mm_set1_pd(rotation[5]);
+        __m128d r6 = _mm_set1_pd(rotation[6]), r7 = _mm_set1_pd(rotation[7]), r8 = _mm_set1_pd(rotation[8]);
+
+        for (int i = 0; i < end; i += 2)
+        {
+            __m128d dx = _mm_sub_pd(_mm_loadu_pd(&ecefX[i]), ox);
+            __m128d dy = _mm_sub_pd(_mm_loadu_pd(&ecefY[i]), oy);
+            __m128d dz = _mm_sub_pd(_mm_loadu_pd(&ecefZ[i]), oz);
+
+            __m128d e = _mm_add_pd(_mm_mul_pd(r0, dx), _mm_mul_pd(r1, dy));
+            __m128d n = _mm_add_pd(_mm_add_pd(_mm_mul_pd(r3, dx), _mm_mul_pd(r4, dy)), _mm_mul_pd(r5, dz));
+            __m128d u = _mm_add_pd(_mm_add_pd(_mm_mul_pd(r6, dx), _mm_mul_pd(r7, dy)), _mm_mul_pd(r8, dz));
+
+            // the two floats of each result are in the low half
+            _mm_storel_pi((__m64*)&east[i], _mm_cvtpd_ps(e));
+            _mm_storel_pi((__m64*)&north[i], _mm_cvtpd_ps(n));
+            _mm_storel_pi((__m64*)&up[i], _mm_cvtpd_ps(u));
+        }
+    }
+
+#else
+
+    void LLAConverter::convertSIMD( int end )
+    {
+        convertScalar(0, end);
+    }
+
+#endif
+}
@@ -0,0 +1,122 @@
+//
+//  LLAConverter.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Places sets of POIs given in latitude, longitude and altitude relative
+//  to the sensor position. IUnifeyeMobileGeometry::setMoveTranslationLLA
+//  converts each POI on its own, and again after every setSensorLLA. Here
+//  the earth centered (ECEF) coordinates of every POI are computed once,
+//  so a new sensor position only costs a subtraction and a rotation per
+//  POI, done in double precision with two POIs per SSE2/NEON register.
+//
+//  The results are local East-North-Up offsets in millimeters on the
+//  WGS84 ellipsoid, pushed to the geometries with setMoveTranslation.
+//
+#ifndef __UNIFEYE_LLACONVERTER_H__
+#define __UNIFEYE_LLACONVERTER_H__
+
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+namespace metaio
+{
+    class IUnifeyeMobileGeometry;   // forward declaration
+}
+
+namespace unifeye
+{
+    /**
+     * \brief Convert a geodetic coordinate to earth centered, earth fixed coordinates
+     * \param coordinate latitude and longitude in degrees, altitude in meters
+     * \param[out] ecef x, y and z in meters
+     */
+    void convertLLAToECEF( const metaio::LLACoordinate& coordinate, double ecef[3] );
+
+    /**
+     * \brief Batch conversion of POIs to local coordinates
+     */
+    class LLAConverter
+    {
+    public:
+        LLAConverter();
+
+        /**
+         * \brief Add a POI
+         * \param coordinate the position of the POI
+         * \return the index of the POI
+         */
+        int addPoint( const metaio::LLACoordinate& coordinate );
+
+        /// Move a POI
+        void setPoint( int index, const metaio::LLACoordinate& coordinate );
+
+        /// Replace all POIs
+        void setPoints( const metaio::LLACoordinate* coordinates, int count );
+
+        /// Remove all POIs
+        void clear();
+
+        /// Number of POIs
+        int getPointCount() const { return (int)ecefX.size(); }
+
+        /**
+         * \brief Set the position the local coordinates are relative to
+         *
+         * Usually the position passed to IUnifeyeMobile::setSensorLLA.
+         *
+         * \param coordinate the sensor position
+         */
+        void setReference( const metaio::LLACoordinate& coordinate );
+
+        /**
+         * \brief Use the altitudes or place everything at the height of the sensor
+         *
+         * Off by default, like setMoveTranslationLLA which ignores the altitude.
+         *
+         * \param enabled true to use the altitudes
+         */
+        void setAltitudeEnabled( bool enabled );
+
+        /// Use the SSE2/NEON path where available, for comparisons
+        void setSIMDEnabled( bool enabled ) { simdEnabled = enabled; }
+
+        /// Convert all POIs to the current reference
+        void convert();
+
+        /// Local coordinates of a POI after the last convert, in millimeters
+        metaio::Vector3d getTranslation( int index ) const
+        {
+            return metaio::Vector3d(east[index], north[index], up[index]);
+        }
+
+        /**
+         * \brief Move the geometries of the POIs to their local coordinates
+         * \param geometries one geometry per POI, NULL entries are skipped
+         */
+        void apply( metaio::IUnifeyeMobileGeometry* const* geometries ) const;
+
+        /// The SIMD path convert uses, "neon", "sse2" or "scalar"
+        static const char* getSIMDPath();
+
+    private:
+        void convertScalar( int begin, int end );
+        void convertSIMD( int end );
+
+        // ECEF coordinates of the POIs in meters, with or without their altitude
+        std::vector<double> ecefX, ecefY, ecefZ;
+        std::vector<metaio::LLACoordinate> coordinates;
+
+        // local coordinates in millimeters
+        std::vector<float> east, north, up;
+
+        metaio::LLACoordinate reference;
+        double origin[3];
+        double rotation[9];     // rows east, north and up in ECEF
+        bool altitudeEnabled;
+        bool simdEnabled;
+    };
+}
+
+#endif
@@ -0,0 +1,354 @@
+//
+//  MeshBVH.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "MeshBVH.h"
+#include "MeshFile.h"
+
+#include <float.h>
+#include <algorithm>
+
+namespace unifeye
+{
+    namespace
+    {
+        const int BINS = 8;
+        const int MAX_LEAF_SIZE = 4;
+
+        // traversal stack on the C stack for trees up to this depth, deeper ones use the heap
+        const int STACK_SIZE = 64;
+
+        inline float getArea( const float min[3], const float max[3] )
+        {
+            float x = max[0] - min[0], y = max[1] - min[1], z = max[2] - min[2];
+            return x * y + y * z + z * x;
+        }
+
+        struct Bin
+        {
+            float min[3], max[3];
+            int count;
+
+            Bin() : count(0)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    min[k] = FLT_MAX;
+                    max[k] = -FLT_MAX;
+                }
+            }
+
+            void grow( const float* triangle )
+            {
+                for (int v = 0; v < 3; v++)
+                {
+                    for (int k = 0; k < 3; k++)
+                    {
+                        min[k] = std::min(min[k], triangle[v * 3 + k]);
+                        max[k] = std::max(max[k], triangle[v * 3 + k]);
+                    }
+                }
+            }
+
+            void grow( const Bin& other )
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    min[k] = std::min(min[k], other.min[k]);
+                    max[k] = std::max(max[k], other.max[k]);
+                }
+                count += other.count;
+            }
+
+            float getCost() const { return count > 0 ? count * getArea(min, max) : 0.0f; }
+        };
+
+        // distance along the ray to the box, FLT_MAX if it is missed
+        inline float intersectBox( const float min[3], const float max[3], const float origin[3],
+            const float inverse[3], float maxDistance )
+        {
+            float near = 0.0f, far = maxDistance;
+            for (int k = 0; k < 3; k++)
+            {
+                float t0 = (min[k] - origin[k]) * inverse[k];
+                float t1 = (max[k] - origin[k]) * inverse[k];
+                near = std::max(near, std::min(t0, t1));
+                far = std::min(far, std::max(t0, t1));
+            }
+            return near <= far ? near : FLT_MAX;
+        }
+
+        // Moeller-Trumbore
+        inline bool intersectTriangle( const float* triangle, const float origin[3], const float direction[3],
+            float& distance )
+        {
+            const float* a = triangle;
+            float e1[3] = { triangle[3] - a[0], triangle[4] - a[1], triangle[5] - a[2] };
+            float e2[3] = { triangle[6] - a[0], triangle[7] - a[1], triangle[8] - a[2] };
+
+            float p[3] = { direction[1] * e2[2] - direction[2] * e2[1], direction[2] * e2[0] - direction[0] * e2[2],
+                direction[0] * e2[1] - direction[1] * e2[0] };
+            float determinant = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+            if (determinant > -1e-12f && determinant < 1e-12f)
+                return false;
+
+            float inverse = 1.0f / determinant;
+            float s[3] = { origin[0] - a[0], origin[1] - a[1], origin[2] - a[2] };
+            float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverse;
+            if (u < 0.0f || u > 1.0f)
+                return false;
+
+            float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+            float v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inverse;
+            if (v < 0.0f || u + v > 1.0f)
+                return false;
+
+            distance = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverse;
+            return distance >= 0.0f;
+        }
+    }
+
+    MeshBVH::MeshBVH() : depth(0)
+    {
+    }
+
+    void MeshBVH::build( const float* xyz, int vertexCount, const uint16_t* indices, int indexCount )
+    {
+        // indices without vertices have nothing to point at
+        int triangleCount = xyz && indices && vertexCount > 0 ? indexCount / 3 : 0;
+        nodes.clear();
+        depth = 0;
+        vertices.resize(triangleCount * 9);
+        triangleIDs.resize(triangleCount);
+
+        std::vector<float> centers(triangleCount * 3);
+        for (int i = 0; i < triangleCount; i++)
+        {
+            for (int v = 0; v < 3; v++)
+            {
+                int index = indices[i * 3 + v];
+                if (index >= vertexCount)
+                    index = 0;
+                for (int k = 0; k < 3; k++)
+                    vertices[i * 9 + v * 3 + k] = xyz[index * 3 + k];
+            }
+            for (int k = 0; k < 3; k++)
+                centers[i * 3 + k] = (vertices[i * 9 + k] + vertices[i * 9 + 3 + k] + vertices[i * 9 + 6 + k]) / 3.0f;
+            triangleIDs[i] = i;
+        }
+
+        if (triangleCount == 0)
+            return;
+
+        // a binary tree has at most twice as many nodes as leaves, so the nodes never move while subdividing
+        nodes.reserve(2 * triangleCount);
+        Node root;
+        root.first = 0;
+        root.count = triangleCount;
+        updateBounds(root);
+        nodes.push_back(root);
+        subdivide(0, 1, centers);
+
+        std::vector<Node>(nodes).swap(nodes);
+    }
+
+    void MeshBVH::build( const MeshFile& mesh, int frame )
+    {
+        std::vector<float> xyz(mesh.getVertexCount() * 3);
+        if (!xyz.empty())
+            mesh.decodePositions(frame, &xyz[0]);
+        build(xyz.empty() ? NULL : &xyz[0], mesh.getVertexCount(), mesh.getIndices(), mesh.getIndexCount());
+    }
+
+    void MeshBVH::updateBounds( Node& node ) const
+    {
+        Bin bounds;
+        for (int i = node.first; i < node.first + node.count; i++)
+            bounds.grow(&vertices[i * 9]);
+        for (int k = 0; k < 3; k++)
+        {
+            node.min[k] = bounds.min[k];
+            node.max[k] = bounds.max[k];
+        }
+    }
+
+    void MeshBVH::subdivide( int index, int level, std::vector<float>& centers )
+    {
+        depth = std::max(depth, level);
+        Node& node = nodes[index];
+        if (node.count <= MAX_LEAF_SIZE)
+            return;
+
+        // the cheapest split between the bins of the triangle centers along any axis
+        float bestCost = node.count * getArea(node.min, node.max);
+        int bestAxis = -1, bestSplit = 0;
+        float bestLow = 0.0f, bestScale = 0.0f;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float low = FLT_MAX, high = -FLT_MAX;
+            for (int i = node.first; i < node.first + node.count; i++)
+            {
+                low = std::min(low, centers[i * 3 + axis]);
+                high = std::max(high, centers[i * 3 + axis]);
+            }
+            if (high <= low)
+                continue;
+
+            float scale = BINS / (high - low);
+            Bin bins[BINS];
+            for (int i = node.first; i < node.first + node.count; i++)
+            {
+                int bin = std::min(BINS - 1, (int)((centers[i * 3 + axis] - low) * scale));
+                bins[bin].grow(&vertices[i * 9]);
+                bins[bin].count++;
+            }
+
+            Bin left[BINS - 1], right;
+            left[0] = bins[0];
+            for (int split = 1; split < BINS - 1; split++)
+            {
+                left[split] = left[split - 1];
+                left[split].grow(bins[split]);
+            }
+            for (int split = BINS - 1; split > 0; split--)
+            {
+                right.grow(bins[split]);
+                float cost = left[split - 1].getCost() + right.getCost();
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                    bestLow = low;
+                    bestScale = scale;
+                }
+            }
+        }
+
+        if (bestAxis < 0)
+            return;
+
+        // partition the triangles, with their vertices and centers
+        int i = node.first, j = node.first + node.count - 1;
+        while (i <= j)
+        {
+            int bin = std::min(BINS - 1, (int)((centers[i * 3 + bestAxis] - bestLow) * bestScale));
+            if (bin < bestSplit)
+            {
+                i++;
+                continue;
+            }
+            std::swap_ranges(&vertices[i * 9], &vertices[i * 9] + 9, &vertices[j * 9]);
+            std::swap_ranges(&centers[i * 3], &centers[i * 3] + 3, &centers[j * 3]);
+            std::swap(triangleIDs[i], triangleIDs[j]);
+            j--;
+        }
+
+        int leftCount = i - node.first;
+        if (leftCount == 0 || leftCount == node.count)
+            return;
+
+        Node left, right;
+        left.first = node.first;
+        left.count = leftCount;
+        right.first = i;
+        right.count = node.count - leftCount;
+        updateBounds(left);
+        updateBounds(right);
+
+        int children = (int)nodes.size();
+        nodes.push_back(left);
+        nodes.push_back(right);
+        nodes[index].first = children;
+        nodes[index].count = 0;
+
+        subdivide(children, level + 1, centers);
+        subdivide(children + 1, level + 1, centers);
+    }
+
+    bool MeshBVH::intersect( const float origin[3], const float direction[3], float maxDistance, float& distance,
+        int& triangle ) const
+    {
+        if (nodes.empty())
+            return false;
+
+        float inverse[3];
+        for (int k = 0; k < 3; k++)
+            inverse[k] = direction[k] != 0.0f ? 1.0f / direction[k] : FLT_MAX;
+
+        float nearest = maxDistance;
+        int hit = -1;
+
+        // every level leaves at most one node behind, plus the two children of the deepest
+        int fixedStack[STACK_SIZE];
+        std::vector<int> heapStack;
+        int* stack = fixedStack;
+        if (depth + 1 > STACK_SIZE)
+        {
+            heapStack.resize(depth + 1);
+            stack = &heapStack[0];
+        }
+
+        int size = 0;
+        if (intersectBox(nodes[0].min, nodes[0].max, origin, inverse, nearest) != FLT_MAX)
+            stack[size++] = 0;
+
+        while (size > 0)
+        {
+            const Node& node = nodes[stack[--size]];
+            if (node.count > 0)
+            {
+                for (int i = node.first; i < node.first + node.count; i++)
+                {
+                    float t;
+                    if (intersectTriangle(&vertices[i * 9], origin, direction, t) && t < nearest)
+                    {
+                        nearest = t;
+                        hit = i;
+                    }
+                }
+                continue;
+            }
+
+            // the nearer child is visited first, so it can cut off the other one
+            float t0 = intersectBox(nodes[node.first].min, nodes[node.first].max, origin, inverse, nearest);
+            float t1 = intersectBox(nodes[node.first + 1].min, nodes[node.first + 1].max, origin, inverse, nearest);
+            int first = node.first, second = node.first + 1;
+            if (t1 < t0)
+            {
+                std::swap(t0, t1);
+                std::swap(first, second);
+            }
+            if (t1 != FLT_MAX)
+                stack[size++] = second;
+            if (t0 != FLT_MAX)
+                stack[size++] = first;
+        }
+
+        if (hit < 0)
+            return false;
+
+        distance = nearest;
+        triangle = triangleIDs[hit];
+        return true;
+    }
+
+    metaio::BoundingBox MeshBVH::getBoundingBox() const
+    {
+        metaio::BoundingBox box;
+        if (!nodes.empty())
+        {
+            box.min = metaio::Vector3d(nodes[0].min[0], nodes[0].min[1], nodes[0].min[2]);
+            box.max = metaio::Vector3d(nodes[0].max[0], nodes[0].max[1], nodes[0].max[2]);
+        }
+        return box;
+    }
+
+    size_t MeshBVH::getMemoryUsage() const
+    {
+        return nodes.capacity() * sizeof(Node) + vertices.capacity() * sizeof(float) +
+            triangleIDs.capacity() * sizeof(int);
+    }
+}
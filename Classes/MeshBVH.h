@@ -0,0 +1,92 @@
+//
+//  MeshBVH.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Bounding volume hierarchy over the triangles of a mesh, built once when
+//  the mesh is loaded, for exact ray tests in model coordinates. The tree
+//  is split by the surface area heuristic over a few bins per axis and
+//  stored depth first, with the triangles of each leaf next to each other.
+//
+#ifndef __UNIFEYE_MESHBVH_H__
+#define __UNIFEYE_MESHBVH_H__
+
+#include <stdint.h>
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+namespace unifeye
+{
+    class MeshFile;     // forward declaration
+
+    /**
+     * \brief Ray intersection with the triangles of a static mesh
+     */
+    class MeshBVH
+    {
+    public:
+        MeshBVH();
+
+        /**
+         * \brief Build the hierarchy
+         *
+         * Without vertices the hierarchy is empty, whatever the indices.
+         *
+         * \param xyz three floats per vertex
+         * \param vertexCount number of vertices
+         * \param indices three indices per triangle
+         * \param indexCount number of indices
+         */
+        void build( const float* xyz, int vertexCount, const uint16_t* indices, int indexCount );
+
+        /**
+         * \brief Build the hierarchy for one frame of a compiled mesh
+         * \param mesh an open mesh
+         * \param frame the frame, animated meshes are only exact for this one
+         */
+        void build( const MeshFile& mesh, int frame = 0 );
+
+        /**
+         * \brief Find the nearest triangle hit by a ray
+         * \param origin start of the ray
+         * \param direction direction of the ray, not necessarily normalized
+         * \param maxDistance hits further than this many times the direction are ignored
+         * \param[out] distance the hit is at origin + distance * direction
+         * \param[out] triangle index of the triangle hit, as in the index list
+         * \return true if a triangle was hit
+         */
+        bool intersect( const float origin[3], const float direction[3], float maxDistance, float& distance,
+            int& triangle ) const;
+
+        /// Bounding box of all triangles
+        metaio::BoundingBox getBoundingBox() const;
+
+        int getTriangleCount() const { return (int)triangleIDs.size(); }
+        int getNodeCount() const { return (int)nodes.size(); }
+
+        /// Levels of the tree, 1 for a single leaf, 0 if empty
+        int getDepth() const { return depth; }
+
+        /// Memory used in bytes
+        size_t getMemoryUsage() const;
+
+    private:
+        struct Node
+        {
+            float min[3], max[3];
+            int first;      // first triangle of a leaf, first child of an inner node
+            int count;      // triangles of a leaf, 0 for inner nodes
+        };
+
+        void subdivide( int node, int level, std::vector<float>& centers );
+        void updateBounds( Node& node ) const;
+
+        std::vector<Node> nodes;
+        std::vector<float> vertices;    // nine floats per triangle, in leaf order
+        std::vector<int> triangleIDs;
+        int depth;
+    };
+}
+
+#endif
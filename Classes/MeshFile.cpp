@@ -0,0 +1,366 @@
+//
+//  MeshFile.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "MeshFile.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include <UnifeyeSDKMobile/AS_IUnifeyeMobile.h>
+
+namespace unifeye
+{
+    namespace
+    {
+        // MD2 files start with "IDP2", version 8
+        const int32_t MD2_IDENT = 0x32504449;
+        const int32_t MD2_VERSION = 8;
+
+        // true if [offset, offset + length) is an aligned range inside the file
+        bool isSection( uint32_t offset, uint64_t length, size_t size )
+        {
+            return offset % MESH_SECTION_ALIGNMENT == 0 && offset >= sizeof(MeshFileHeader) &&
+                (uint64_t)offset + length <= size;
+        }
+
+        bool writeFile( const std::string& path, const std::vector<unsigned char>& bytes )
+        {
+            // write next to the target and rename, so a half written file is never loaded
+            std::string temporary = path + ".tmp";
+            FILE* file = fopen(temporary.c_str(), "wb");
+            if (!file)
+                return false;
+
+            bool success = fwrite(&bytes[0], 1, bytes.size(), file) == bytes.size();
+            success = fclose(file) == 0 && success;
+            if (success)
+                success = rename(temporary.c_str(), path.c_str()) == 0;
+            if (!success)
+                unlink(temporary.c_str());
+            return success;
+        }
+
+        template <typename T>
+        void append( std::vector<unsigned char>& bytes, const T& value )
+        {
+            const unsigned char* data = (const unsigned char*)&value;
+            bytes.insert(bytes.end(), data, data + sizeof(T));
+        }
+    }
+
+    MeshFile::MeshFile() : data(0), size(0), header(0), frames(0), positions(0), normals(0),
+        texCoords(0), indices(0)
+    {
+    }
+
+    MeshFile::~MeshFile()
+    {
+        close();
+    }
+
+    bool MeshFile::open( const std::string& _path )
+    {
+        close();
+
+        int fd = ::open(_path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(MeshFileHeader))
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void* mapping = mmap(0, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+            return false;
+
+        path = _path;
+        data = mapping;
+        size = (size_t)info.st_size;
+
+        const unsigned char* base = (const unsigned char*)data;
+        header = (const MeshFileHeader*)base;
+        if (!validate())
+        {
+            close();
+            return false;
+        }
+
+        frames = (const MeshFrame*)(base + header->framesOffset);
+        positions = (const uint16_t*)(base + header->positionsOffset);
+        normals = (const int8_t*)(base + header->normalsOffset);
+        texCoords = (const uint16_t*)(base + header->texCoordsOffset);
+        indices = (const uint16_t*)(base + header->indicesOffset);
+        return true;
+    }
+
+    void MeshFile::close()
+    {
+        if (data)
+            munmap(data, size);
+
+        path.clear();
+        data = 0;
+        size = 0;
+        header = 0;
+        frames = 0;
+        positions = 0;
+        normals = 0;
+        texCoords = 0;
+        indices = 0;
+    }
+
+    bool MeshFile::validate() const
+    {
+        if (header->magic != MESH_FILE_MAGIC || header->version != MESH_FILE_VERSION || header->fileSize != size)
+            return false;
+
+        if (header->frameCount == 0 || header->vertexCount == 0 || header->vertexCount > 65536 ||
+            header->indexCount % 3 != 0)
+            return false;
+
+        // the indices themselves are not checked, that would read the whole stream
+        uint64_t vertices = (uint64_t)header->frameCount * header->vertexCount;
+        return isSection(header->framesOffset, (uint64_t)header->frameCount * sizeof(MeshFrame), size) &&
+            isSection(header->positionsOffset, vertices * 4 * sizeof(uint16_t), size) &&
+            isSection(header->normalsOffset, vertices * 4, size) &&
+            isSection(header->texCoordsOffset, (uint64_t)header->vertexCount * 2 * sizeof(uint16_t), size) &&
+            isSection(header->indicesOffset, (uint64_t)header->indexCount * sizeof(uint16_t), size) &&
+            header->source <= MESH_SOURCE_MD2;
+    }
+
+    metaio::BoundingBox MeshFile::getBoundingBox() const
+    {
+        metaio::BoundingBox box;
+        box.min = metaio::Vector3d(header->boxMin[0], header->boxMin[1], header->boxMin[2]);
+        box.max = metaio::Vector3d(header->boxMax[0], header->boxMax[1], header->boxMax[2]);
+        return box;
+    }
+
+    metaio::BoundingBox MeshFile::getBoundingBox( int frame ) const
+    {
+        metaio::BoundingBox box;
+        box.min = metaio::Vector3d(frames[frame].boxMin[0], frames[frame].boxMin[1], frames[frame].boxMin[2]);
+        box.max = metaio::Vector3d(frames[frame].boxMax[0], frames[frame].boxMax[1], frames[frame].boxMax[2]);
+        return box;
+    }
+
+    void MeshFile::decodePositions( int frame, float* xyz ) const
+    {
+        const MeshFrame& f = frames[frame];
+        const uint16_t* q = getPositions(frame);
+        for (uint32_t i = 0; i < header->vertexCount; i++, q += 4, xyz += 3)
+        {
+            xyz[0] = f.offset[0] + q[0] * f.scale[0];
+            xyz[1] = f.offset[1] + q[1] * f.scale[1];
+            xyz[2] = f.offset[2] + q[2] * f.scale[2];
+        }
+    }
+
+    metaio::IUnifeyeMobileGeometry* NullMeshBackend::createGeometry( const MeshFile& mesh )
+    {
+        const MeshFileHeader& header = mesh.getHeader();
+        size_t words = (size_t)header.frameCount * header.vertexCount * 4;
+
+        unsigned int sum = 0;
+        const uint16_t* positions = mesh.getPositions(0);
+        for (size_t i = 0; i < words; i++)
+            sum += positions[i];
+        const uint8_t* normals = (const uint8_t*)mesh.getNormals(0);
+        for (size_t i = 0; i < words; i++)
+            sum += normals[i];
+        const uint16_t* texCoords = mesh.getTexCoords();
+        for (size_t i = 0; i < header.vertexCount * 2; i++)
+            sum += texCoords[i];
+        const uint16_t* indices = mesh.getIndices();
+        for (size_t i = 0; i < header.indexCount; i++)
+            sum += indices[i];
+
+        meshes++;
+        bytesRead += words * 3 + header.vertexCount * 4 + header.indexCount * 2;
+        checksum += sum;
+        return 0;
+    }
+
+    UnifeyeMeshBackend::UnifeyeMeshBackend( metaio::IUnifeyeMobile* _unifeye, const std::string& _cacheDirectory ) :
+        unifeye(_unifeye), cacheDirectory(_cacheDirectory)
+    {
+    }
+
+    metaio::IUnifeyeMobileGeometry* UnifeyeMeshBackend::createGeometry( const MeshFile& mesh )
+    {
+        std::string file = materialize(mesh);
+        if (file.empty())
+            return 0;
+
+        metaio::IUnifeyeMobileGeometry* geometry = unifeye->loadGeometry(file);
+
+        // the SDK has parsed it, keeping it would only fill the disk
+        unlink(file.c_str());
+
+        // the converted file is not next to the texture any more
+        char skinName[sizeof(mesh.getHeader().skinName) + 1];
+        memcpy(skinName, mesh.getHeader().skinName, sizeof(skinName) - 1);
+        skinName[sizeof(skinName) - 1] = 0;
+        if (geometry && skinName[0])
+        {
+            std::string directory = mesh.getPath().substr(0, mesh.getPath().rfind('/') + 1);
+            std::string texture = directory + skinName;
+            if (access(texture.c_str(), R_OK) == 0)
+                geometry->setTexture(texture);
+        }
+
+        return geometry;
+    }
+
+    std::string UnifeyeMeshBackend::materialize( const MeshFile& mesh )
+    {
+        bool md2 = mesh.getHeader().source == MESH_SOURCE_MD2;
+
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx%s", mesh.getContentHash(), md2 ? ".md2" : ".obj");
+        std::string file = cacheDirectory + name;
+        bool written = md2 ? writeMD2(mesh, file) : writeOBJ(mesh, file);
+        return written ? file : std::string();
+    }
+
+    bool writeMD2( const MeshFile& mesh, const std::string& path )
+    {
+        const MeshFileHeader& header = mesh.getHeader();
+        if (header.source != MESH_SOURCE_MD2)
+            return false;
+
+        // one MD2 vertex and texture coordinate per mesh vertex
+        int32_t vertexCount = (int32_t)header.vertexCount;
+        int32_t triangleCount = (int32_t)header.indexCount / 3;
+        int32_t frameSize = 40 + 4 * vertexCount;
+
+        int32_t offsetSkins = 68;
+        int32_t offsetST = offsetSkins + 64;
+        int32_t offsetTriangles = offsetST + 4 * vertexCount;
+        int32_t offsetFrames = offsetTriangles + 12 * triangleCount;
+        int32_t offsetCommands = offsetFrames + frameSize * (int32_t)header.frameCount;
+        int32_t offsetEnd = offsetCommands + 4;
+
+        std::vector<unsigned char> bytes;
+        bytes.reserve(offsetEnd);
+
+        int32_t md2Header[17] = { MD2_IDENT, MD2_VERSION, (int32_t)header.skinWidth, (int32_t)header.skinHeight,
+            frameSize, 1, vertexCount, vertexCount, triangleCount, 1, (int32_t)header.frameCount,
+            offsetSkins, offsetST, offsetTriangles, offsetFrames, offsetCommands, offsetEnd };
+        for (int i = 0; i < 17; i++)
+            append(bytes, md2Header[i]);
+
+        char skin[64];
+        memcpy(skin, header.skinName, sizeof(skin));
+        skin[63] = 0;
+        bytes.insert(bytes.end(), skin, skin + sizeof(skin));
+
+        const uint16_t* texCoords = mesh.getTexCoords();
+        for (int32_t i = 0; i < vertexCount; i++)
+        {
+            float u = header.texCoordOffset[0] + texCoords[i * 2] * header.texCoordScale[0];
+            float v = header.texCoordOffset[1] + texCoords[i * 2 + 1] * header.texCoordScale[1];
+            append(bytes, (int16_t)floorf(u * header.skinWidth + 0.5f));
+            append(bytes, (int16_t)floorf(v * header.skinHeight + 0.5f));
+        }
+
+        const uint16_t* indices = mesh.getIndices();
+        for (int32_t i = 0; i < triangleCount; i++)
+        {
+            for (int k = 0; k < 3; k++)
+                append(bytes, (int16_t)indices[i * 3 + k]);
+            for (int k = 0; k < 3; k++)
+                append(bytes, (int16_t)indices[i * 3 + k]);
+        }
+
+        for (int frame = 0; frame < mesh.getFrameCount(); frame++)
+        {
+            const MeshFrame& f = mesh.getFrame(frame);
+            const uint16_t* q = mesh.getPositions(frame);
+
+            // compiled from MD2 the positions still fit in a byte, rescale if not
+            uint16_t maximum = 0;
+            for (int32_t i = 0; i < vertexCount * 4; i++)
+                maximum = i % 4 != 3 && q[i] > maximum ? q[i] : maximum;
+            float requantize = maximum > 255 ? 255.0f / maximum : 1.0f;
+
+            for (int k = 0; k < 3; k++)
+                append(bytes, f.scale[k] / requantize);
+            for (int k = 0; k < 3; k++)
+                append(bytes, f.offset[k]);
+            bytes.insert(bytes.end(), f.name, f.name + sizeof(f.name));
+
+            for (int32_t i = 0; i < vertexCount; i++)
+            {
+                for (int k = 0; k < 3; k++)
+                    bytes.push_back((unsigned char)floorf(q[i * 4 + k] * requantize + 0.5f));
+                bytes.push_back((unsigned char)q[i * 4 + 3]);
+            }
+        }
+
+        // no GL commands, only the terminator
+        append(bytes, (int32_t)0);
+
+        return writeFile(path, bytes);
+    }
+
+    bool writeOBJ( const MeshFile& mesh, const std::string& path )
+    {
+        const MeshFileHeader& header = mesh.getHeader();
+        int vertexCount = mesh.getVertexCount();
+
+        std::vector<float> xyz(vertexCount * 3);
+        mesh.decodePositions(0, &xyz[0]);
+
+        std::string text;
+        text.reserve(vertexCount * 96 + header.indexCount * 12);
+
+        char line[128];
+        for (int i = 0; i < vertexCount; i++)
+        {
+            snprintf(line, sizeof(line), "v %.6g %.6g %.6g\n", xyz[i * 3], xyz[i * 3 + 1], xyz[i * 3 + 2]);
+            text += line;
+        }
+
+        const uint16_t* texCoords = mesh.getTexCoords();
+        for (int i = 0; i < vertexCount; i++)
+        {
+            float u = header.texCoordOffset[0] + texCoords[i * 2] * header.texCoordScale[0];
+            float v = header.texCoordOffset[1] + texCoords[i * 2 + 1] * header.texCoordScale[1];
+            snprintf(line, sizeof(line), "vt %.6g %.6g\n", u, 1.0f - v);
+            text += line;
+        }
+
+        const int8_t* normals = mesh.getNormals(0);
+        for (int i = 0; i < vertexCount; i++)
+        {
+            snprintf(line, sizeof(line), "vn %.4g %.4g %.4g\n", normals[i * 4] / 127.0f,
+                normals[i * 4 + 1] / 127.0f, normals[i * 4 + 2] / 127.0f);
+            text += line;
+        }
+
+        const uint16_t* indices = mesh.getIndices();
+        for (uint32_t i = 0; i < header.indexCount; i += 3)
+        {
+            int a = indices[i] + 1, b = indices[i + 1] + 1, c = indices[i + 2] + 1;
+            snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, c, c, c);
+            text += line;
+        }
+
+        return writeFile(path, std::vector<unsigned char>(text.begin(), text.end()));
+    }
+}
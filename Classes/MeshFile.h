@@ -0,0 +1,194 @@
+//
+//  MeshFile.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Read only view of a compiled mesh file (see MeshFormat.h). The file is
+//  mapped into memory and validated once; nothing is parsed or copied, the
+//  pages are only read in when a stream is touched.
+//
+#ifndef __UNIFEYE_MESHFILE_H__
+#define __UNIFEYE_MESHFILE_H__
+
+#include <stddef.h>
+#include <string>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+#include "MeshFormat.h"
+
+namespace metaio
+{
+    class IUnifeyeMobile;           // forward declaration
+    class IUnifeyeMobileGeometry;   // forward declaration
+}
+
+namespace unifeye
+{
+    /**
+     * \brief A memory mapped compiled mesh
+     */
+    class MeshFile
+    {
+    public:
+        MeshFile();
+
+        /// Destructor, unmaps the file
+        ~MeshFile();
+
+        /**
+         * \brief Map a file
+         * \param path path of the compiled mesh
+         * \return false if the file can not be mapped or is not a valid mesh of this version
+         */
+        bool open( const std::string& path );
+
+        /// Unmap the file, all pointers returned before become invalid
+        void close();
+
+        bool isOpen() const { return header != 0; }
+
+        /// Path passed to open()
+        const std::string& getPath() const { return path; }
+
+        const MeshFileHeader& getHeader() const { return *header; }
+
+        int getVertexCount() const { return (int)header->vertexCount; }
+        int getIndexCount() const { return (int)header->indexCount; }
+        int getFrameCount() const { return (int)header->frameCount; }
+        unsigned long long getContentHash() const { return header->contentHash; }
+
+        const MeshFrame& getFrame( int frame ) const { return frames[frame]; }
+
+        /// Quantized positions of a frame, four per vertex, w is the MD2 normal index
+        const uint16_t* getPositions( int frame ) const { return positions + (size_t)frame * header->vertexCount * 4; }
+
+        /// Normals of a frame, four per vertex
+        const int8_t* getNormals( int frame ) const { return normals + (size_t)frame * header->vertexCount * 4; }
+
+        /// Quantized texture coordinates, two per vertex
+        const uint16_t* getTexCoords() const { return texCoords; }
+
+        /// Triangle indices
+        const uint16_t* getIndices() const { return indices; }
+
+        /// Bounding box over all frames
+        metaio::BoundingBox getBoundingBox() const;
+
+        /// Bounding box of one frame
+        metaio::BoundingBox getBoundingBox( int frame ) const;
+
+        /**
+         * \brief Dequantize the positions of a frame
+         * \param frame the frame
+         * \param[out] xyz three floats per vertex
+         */
+        void decodePositions( int frame, float* xyz ) const;
+
+        /// Size of the mapping in bytes
+        size_t getMappedSize() const { return size; }
+
+    private:
+        MeshFile( const MeshFile& );
+        MeshFile& operator=( const MeshFile& );
+
+        bool validate() const;
+
+        std::string path;
+        void* data;
+        size_t size;
+
+        const MeshFileHeader* header;
+        const MeshFrame* frames;
+        const uint16_t* positions;
+        const int8_t* normals;
+        const uint16_t* texCoords;
+        const uint16_t* indices;
+    };
+
+    /**
+     * \brief Turns a mapped mesh into something that can be rendered
+     */
+    class IMeshBackend
+    {
+    public:
+        virtual ~IMeshBackend() {};
+
+        /**
+         * \brief Create a geometry from a mesh
+         * \param mesh the mapped mesh, only valid during the call
+         * \return the geometry, NULL on failure or if the backend has none
+         */
+        virtual metaio::IUnifeyeMobileGeometry* createGeometry( const MeshFile& mesh ) = 0;
+    };
+
+    /**
+     * \brief Backend that only reads the streams, for tests and benchmarks
+     */
+    class NullMeshBackend : public IMeshBackend
+    {
+    public:
+        NullMeshBackend() : meshes(0), bytesRead(0), checksum(0) {};
+
+        virtual metaio::IUnifeyeMobileGeometry* createGeometry( const MeshFile& mesh );
+
+        unsigned long meshes;       ///< number of createGeometry() calls
+        size_t bytesRead;           ///< stream bytes touched
+        unsigned int checksum;      ///< sum of all stream words, keeps the reads from being optimized away
+    };
+
+    /**
+     * \brief Backend that loads the mesh into an SDK instance
+     *
+     * The SDK only loads OBJ and MD2 files and has no way to take a mesh
+     * from memory, so the mesh is written to a temporary file, passed to
+     * loadGeometry() and deleted again. Meshes compiled from MD2 are written
+     * back without loss, meshes compiled from OBJ as a compact OBJ; MD2
+     * would need the normal table of the original engine. The SDK parses
+     * that file like the source, so writing it makes a load slower than
+     * loading the source (see meshbench); the gain of mapping only reaches
+     * backends that take the streams themselves. The module therefore loads
+     * the source models, meshbench uses this backend to measure the detour.
+     */
+    class UnifeyeMeshBackend : public IMeshBackend
+    {
+    public:
+        /**
+         * \brief Constructor
+         * \param unifeye the SDK instance
+         * \param cacheDirectory existing directory for the temporary files
+         */
+        UnifeyeMeshBackend( metaio::IUnifeyeMobile* unifeye, const std::string& cacheDirectory );
+
+        virtual metaio::IUnifeyeMobileGeometry* createGeometry( const MeshFile& mesh );
+
+        /**
+         * \brief Write the file the SDK loads for a mesh
+         * \param mesh the mapped mesh
+         * \return the path, named after the content hash, empty if it could not be written
+         */
+        std::string materialize( const MeshFile& mesh );
+
+    private:
+        metaio::IUnifeyeMobile* unifeye;
+        std::string cacheDirectory;
+    };
+
+    /**
+     * \brief Write a mesh as MD2
+     * \param mesh a mesh compiled from MD2
+     * \param path the file to write
+     * \return false if the mesh is not from MD2 or can not be written
+     */
+    bool writeMD2( const MeshFile& mesh, const std::string& path );
+
+    /**
+     * \brief Write a mesh as OBJ, only the first frame
+     * \param mesh the mesh
+     * \param path the file to write
+     * \return false if the file can not be written
+     */
+    bool writeOBJ( const MeshFile& mesh, const std::string& path );
+}
+
+#endif
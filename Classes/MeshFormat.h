@@ -0,0 +1,94 @@
+//
+//  MeshFormat.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Layout of the compiled mesh files written by tools/meshc and read by
+//  MeshFile. Everything is little endian (ARM and x86) and every section
+//  starts on a 16 byte boundary, so the file can be mapped and used in place.
+//
+//  A file holds one indexed triangle mesh with one or more frames:
+//
+//      MeshFileHeader
+//      MeshFrame               [frameCount]
+//      positions               [frameCount][vertexCount][4] uint16
+//      normals                 [frameCount][vertexCount][4] int8, w unused
+//      texture coordinates     [vertexCount][2] uint16
+//      indices                 [indexCount] uint16, three per triangle
+//
+//  Position = frame.offset + q * frame.scale, normal = n / 127 and texture
+//  coordinate = texCoordOffset + q * texCoordScale with v = 0 at the top of
+//  the texture, as in MD2. The w of a position is the index into the MD2
+//  normal table for meshes compiled from MD2, 0 otherwise.
+//
+#ifndef __UNIFEYE_MESHFORMAT_H__
+#define __UNIFEYE_MESHFORMAT_H__
+
+#include <stdint.h>
+
+namespace unifeye
+{
+    /// "UMSH" read as little endian 32 bit value
+    const uint32_t MESH_FILE_MAGIC = 0x48534D55;
+
+    /// Incremented on every incompatible change of the layout
+    const uint32_t MESH_FILE_VERSION = 1;
+
+    /// Alignment of all sections
+    const uint32_t MESH_SECTION_ALIGNMENT = 16;
+
+    /// Format the mesh was compiled from
+    enum MESH_SOURCE
+    {
+        MESH_SOURCE_OBJ = 0,
+        MESH_SOURCE_MD2 = 1
+    };
+
+    /**
+     * \brief One animation frame, the first frame is the rest pose
+     */
+    struct MeshFrame
+    {
+        char name[16];          ///< MD2 frame name, zero terminated
+        float offset[3];        ///< dequantization offset of the positions
+        float scale[3];         ///< dequantization scale of the positions
+        float boxMin[3];        ///< bounding box of the frame
+        float boxMax[3];
+    };
+
+    /**
+     * \brief Start of every mesh file
+     */
+    struct MeshFileHeader
+    {
+        uint32_t magic;                 ///< MESH_FILE_MAGIC
+        uint32_t version;               ///< MESH_FILE_VERSION
+        uint32_t source;                ///< MESH_SOURCE the mesh was compiled from
+        uint32_t fileSize;              ///< size of the whole file in bytes
+        uint64_t contentHash;           ///< hashBytes() of the source file
+        uint32_t vertexCount;           ///< vertices per frame, at most 65536
+        uint32_t indexCount;            ///< three per triangle
+        uint32_t frameCount;            ///< at least one
+        uint32_t skinWidth;             ///< MD2 skin size, texture coordinates are stored in [0, 1]
+        uint32_t skinHeight;
+        float boxMin[3];                ///< bounding box over all frames
+        float boxMax[3];
+        float texCoordOffset[2];        ///< dequantization of the texture coordinates
+        float texCoordScale[2];
+        char skinName[64];              ///< MD2 skin or OBJ texture, zero terminated, may be empty
+
+        uint32_t framesOffset;          ///< offsets of the sections from the start of the file
+        uint32_t positionsOffset;
+        uint32_t normalsOffset;
+        uint32_t texCoordsOffset;
+        uint32_t indicesOffset;
+        uint32_t reserved[4];
+    };
+
+    // the layout must not depend on the compiler or the architecture
+    typedef char MeshFrameSizeCheck[sizeof(MeshFrame) == 64 ? 1 : -1];
+    typedef char MeshFileHeaderSizeCheck[sizeof(MeshFileHeader) == 184 ? 1 : -1];
+}
+
+#endif
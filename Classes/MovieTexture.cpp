@@ -0,0 +1,219 @@
+//
+//  MovieTexture.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "MovieTexture.h"
+#include "ColorConvert.h"
+
+using namespace metaio;
+using namespace metaio::common;
+
+namespace unifeye
+{
+    namespace
+    {
+        // frame times jitter, a frame due this much later is shown already
+        const double TIME_TOLERANCE = 0.002;
+
+        // late frames skipped in a row at most, so a decoder slower than the
+        // movie still shows something
+        const int MAX_SKIPPED = 4;
+    }
+
+    MoviePlayer::MoviePlayer( IMovieSource* _source, const MovieParameters& _parameters ) :
+        source(_source), parameters(_parameters), shown(0), loopOffset(0), lastTime(0), nextIndex(0),
+        finished(false), playbackTime(0), stopping(false), threadRunning(false)
+    {
+        width = parameters.transparent ? source->getWidth() / 2 : source->getWidth();
+        height = source->getHeight();
+        double frameRate = source->getFrameRate();
+        period = frameRate > 0 ? 1.0 / frameRate : 1.0 / 30.0;
+
+        // the frames read ahead and the one shown
+        size_t count = (parameters.readAhead > 1 ? parameters.readAhead : 1) + 1;
+        frames.resize(count);
+        available.reserve(count);
+        ready.reserve(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            frames[i].pixels.resize((size_t)width * height * 4);
+            available.push_back(&frames[i]);
+        }
+    }
+
+    MoviePlayer::~MoviePlayer()
+    {
+        stop();
+        delete source;
+    }
+
+    bool MoviePlayer::start()
+    {
+        if (threadRunning)
+            return true;
+        stopping = false;
+        threadRunning = pthread_create(&thread, 0, decodeThread, this) == 0;
+        return threadRunning;
+    }
+
+    void MoviePlayer::stop()
+    {
+        if (!threadRunning)
+            return;
+        {
+            ScopedLock lock(mutex);
+            stopping = true;
+            condition.signal();
+        }
+        pthread_join(thread, 0);
+        threadRunning = false;
+    }
+
+    const MovieFrame* MoviePlayer::update( double time )
+    {
+        ScopedLock lock(mutex);
+        playbackTime = time;
+
+        size_t due = 0;
+        while (due < ready.size() && ready[due]->time <= time + TIME_TOLERANCE)
+            due++;
+
+        if (due == 0)
+        {
+            double next = shown ? shown->time + period : 0;
+            if (ready.empty() && !finished && threadRunning && time >= next + TIME_TOLERANCE)
+                stats.stalls++;
+            return 0;
+        }
+
+        // only the newest one due is shown, the older ones are dropped
+        for (size_t i = 0; i + 1 < due; i++)
+            available.push_back(ready[i]);
+        stats.dropped += due - 1;
+        if (shown)
+            available.push_back(shown);
+        shown = ready[due - 1];
+        ready.erase(ready.begin(), ready.begin() + due);
+        stats.shown++;
+
+        condition.signal();
+        return shown;
+    }
+
+    bool MoviePlayer::isFinished() const
+    {
+        ScopedLock lock(mutex);
+        return finished && ready.empty();
+    }
+
+    MovieStats MoviePlayer::getStats() const
+    {
+        ScopedLock lock(mutex);
+        return stats;
+    }
+
+    void* MoviePlayer::decodeThread( void* player )
+    {
+        static_cast<MoviePlayer*>(player)->decode();
+        return 0;
+    }
+
+    bool MoviePlayer::fill( MovieFrame& frame, const MovieSourceFrame& sourceFrame )
+    {
+        ImageStruct dst(&frame.pixels[0], width, height, parameters.format, true);
+        ImageStruct src(const_cast<unsigned char*>(sourceFrame.pixels), source->getWidth(), height,
+            source->getColorFormat(), true);
+        if (parameters.transparent)
+            return mergeSideBySideAlpha(src, sourceFrame.stride, dst);
+
+        // convertImage takes packed rows only
+        if (sourceFrame.stride == width * 4)
+            return convertImage(src, dst);
+        for (int y = 0; y < height; y++)
+        {
+            ImageStruct srcRow(src.buffer + (size_t)y * sourceFrame.stride, width, 1, src.colorFormat, true);
+            ImageStruct dstRow(dst.buffer + (size_t)y * width * 4, width, 1, dst.colorFormat, true);
+            if (!convertImage(srcRow, dstRow))
+                return false;
+        }
+        return true;
+    }
+
+    void MoviePlayer::decode()
+    {
+        for (;;)
+        {
+            MovieFrame* frame;
+            double now;
+            {
+                ScopedLock lock(mutex);
+                while (!stopping && (available.empty() || finished))
+                    condition.wait(mutex);
+                if (stopping)
+                    return;
+                frame = available.back();
+                available.pop_back();
+                now = playbackTime;
+            }
+
+            // read until a frame is not late yet, the decoder's counters are added when it is queued
+            MovieStats counted;
+            MovieSourceFrame sourceFrame;
+            bool read = false;
+            bool rewound = false;
+            int skipped = 0;
+            for (;;)
+            {
+                if (!source->read(sourceFrame))
+                {
+                    // a movie that ends right after a rewind has no frames
+                    if (!parameters.loop || rewound || !source->rewind())
+                        break;
+                    rewound = true;
+                    loopOffset = lastTime + period;
+                    counted.loops++;
+                    continue;
+                }
+                rewound = false;
+                lastTime = loopOffset + sourceFrame.time;
+                nextIndex++;
+                counted.decoded++;
+
+                // late once the frame after it is due
+                if (!parameters.dropLate || skipped >= MAX_SKIPPED || lastTime + period > now + TIME_TOLERANCE)
+                {
+                    read = true;
+                    break;
+                }
+                skipped++;
+                counted.skipped++;
+
+                ScopedLock lock(mutex);
+                if (stopping)
+                    break;
+                now = playbackTime;
+            }
+
+            bool filled = read && fill(*frame, sourceFrame);
+            if (filled)
+            {
+                frame->time = lastTime;
+                frame->index = nextIndex - 1;
+            }
+
+            ScopedLock lock(mutex);
+            if (filled)
+                ready.push_back(frame);
+            else
+            {
+                available.push_back(frame);
+                finished = !stopping;
+            }
+            stats.decoded += counted.decoded;
+            stats.skipped += counted.skipped;
+            stats.loops += counted.loops;
+        }
+    }
+}
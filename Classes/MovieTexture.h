@@ -0,0 +1,190 @@
+//
+//  MovieTexture.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Plays a movie into the texture of a geometry. A thread of its own reads
+//  the frames ahead into a fixed pool, so the render loop only uploads one.
+//  Transparent movies are side by side: the left half is the color, the red
+//  channel of the right half the alpha; they are merged into RGBA on that
+//  thread too. The frame shown is the one due at the playback time, frames
+//  that fall behind are dropped instead of slowing the movie down.
+//
+#ifndef __UNIFEYE_MOVIETEXTURE_H__
+#define __UNIFEYE_MOVIETEXTURE_H__
+
+#include <pthread.h>
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+#include "Threading.h"
+
+namespace unifeye
+{
+    /**
+     * \brief One frame of a movie source
+     */
+    struct MovieSourceFrame
+    {
+        const unsigned char* pixels;    ///< valid until the next read() or rewind()
+        int stride;                     ///< bytes per row
+        double time;                    ///< presentation time in seconds, from the start of the movie
+
+        MovieSourceFrame() : pixels(0), stride(0), time(0) {};
+    };
+
+    /**
+     * \brief Decodes the frames of a movie, used by the thread of a MoviePlayer only
+     */
+    class IMovieSource
+    {
+    public:
+        virtual ~IMovieSource() {};
+
+        /// Size of the decoded frames, twice the width of the texture for transparent movies
+        virtual int getWidth() const = 0;
+        virtual int getHeight() const = 0;
+
+        /// ECF_A8R8G8B8 or ECF_A8B8G8R8
+        virtual metaio::common::ECOLOR_FORMAT getColorFormat() const = 0;
+
+        /// Frames per second, nominal
+        virtual double getFrameRate() const = 0;
+
+        /**
+         * \brief Decode the next frame
+         * \param frame receives the frame
+         * \return false at the end of the movie or on an error
+         */
+        virtual bool read( MovieSourceFrame& frame ) = 0;
+
+        /**
+         * \brief Start over from the first frame
+         * \return false if the source can not seek
+         */
+        virtual bool rewind() = 0;
+    };
+
+    /**
+     * \brief How a MoviePlayer plays
+     */
+    struct MovieParameters
+    {
+        bool loop;                      ///< start over at the end
+        bool transparent;               ///< the movie is side by side, color and alpha
+        int readAhead;                  ///< frames decoded ahead of the one shown, at least 1
+        bool dropLate;                  ///< skip the merge of frames that are late when decoded
+        metaio::common::ECOLOR_FORMAT format;   ///< of the frames handed to the texture
+
+        MovieParameters() : loop(false), transparent(false), readAhead(4), dropLate(true),
+            format(metaio::common::ECF_A8B8G8R8) {};
+    };
+
+    /**
+     * \brief A decoded frame, owned by the MoviePlayer
+     */
+    struct MovieFrame
+    {
+        std::vector<unsigned char> pixels;  ///< packed rows in MovieParameters::format
+        double time;                        ///< playback time, grows across loops
+        unsigned long index;                ///< frames read before, across loops
+
+        MovieFrame() : time(0), index(0) {};
+    };
+
+    /**
+     * \brief Counters of a MoviePlayer
+     */
+    struct MovieStats
+    {
+        unsigned long decoded;          ///< frames read from the source
+        unsigned long skipped;          ///< frames late when decoded, never merged
+        unsigned long dropped;          ///< frames merged but superseded before they were shown
+        unsigned long shown;            ///< frames returned by update()
+        unsigned long stalls;           ///< updates that found the next frame overdue but not decoded
+        unsigned long loops;            ///< times the movie started over
+
+        MovieStats() : decoded(0), skipped(0), dropped(0), shown(0), stalls(0), loops(0) {};
+    };
+
+    /**
+     * \brief Decodes a movie on a thread and hands out the frame due
+     *
+     * All frames are allocated by the constructor, playing never allocates.
+     * update() is called from the render loop, the frame it returns stays
+     * untouched until update() returns another one.
+     */
+    class MoviePlayer
+    {
+    public:
+        /**
+         * \brief Constructor
+         * \param source the movie, owned
+         * \param parameters how to play it
+         */
+        MoviePlayer( IMovieSource* source, const MovieParameters& parameters );
+
+        /// Stops the thread, deletes the source
+        ~MoviePlayer();
+
+        /// Width and height of the frames handed out
+        int getWidth() const { return width; }
+        int getHeight() const { return height; }
+        metaio::common::ECOLOR_FORMAT getColorFormat() const { return parameters.format; }
+
+        /// Start decoding from the current position
+        bool start();
+
+        /// Stop decoding, the frames decoded so far are kept
+        void stop();
+
+        /**
+         * \brief Get the frame due
+         * \param time seconds since the movie started
+         * \return the newest frame due that was not returned before, NULL if there is none
+         */
+        const MovieFrame* update( double time );
+
+        /// Whether the movie ended and every frame was handed out
+        bool isFinished() const;
+
+        MovieStats getStats() const;
+
+    private:
+        MoviePlayer( const MoviePlayer& );
+        MoviePlayer& operator=( const MoviePlayer& );
+
+        static void* decodeThread( void* player );
+        void decode();
+        bool fill( MovieFrame& frame, const MovieSourceFrame& sourceFrame );
+
+        IMovieSource* source;
+        MovieParameters parameters;
+        int width, height;
+        double period;
+
+        // the pool, frames move from available to ready to shown and back to available
+        std::vector<MovieFrame> frames;
+        std::vector<MovieFrame*> available;
+        std::vector<MovieFrame*> ready;     // in playback order
+        MovieFrame* shown;
+
+        // written by the decoder
+        double loopOffset;
+        double lastTime;
+        unsigned long nextIndex;
+        bool finished;
+
+        double playbackTime;                // set by update()
+        MovieStats stats;
+
+        mutable Mutex mutex;
+        Condition condition;
+        bool stopping;
+        pthread_t thread;
+        bool threadRunning;
+    };
+}
+
+#endif
@@ -0,0 +1,387 @@
+//
+//  PerfTrace.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Every thread that records gets a ThreadBuffer through a pthread key.
+//  Only that thread writes to it; it publishes a sample by incrementing
+//  its written counter after the sample is stored. Readers take the
+//  registry mutex, which writers never touch, copy the ring and drop the
+//  samples the writer may have overwritten meanwhile. Buffers of threads
+//  that ended are reused by new threads, so short lived GCD workers do not
+//  add a buffer each.
+//
+#include "PerfTrace.h"
+#include "Threading.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+namespace unifeye
+{
+    namespace
+    {
+        struct Sample
+        {
+            unsigned long long start;   // ticks
+            unsigned int duration;      // ticks
+            int stage;
+        };
+
+        struct ThreadBuffer
+        {
+            int id;
+            bool alive;
+            std::string name;
+            volatile unsigned int written;  // samples ever written, the next goes to written % RING_SIZE
+            unsigned int generation;        // resetStats() counter the statistics belong to
+            Sample ring[PerfTrace::RING_SIZE];
+            unsigned int histogram[PerfTrace::MAX_STAGES][PerfTrace::BUCKET_COUNT];
+            unsigned int count[PerfTrace::MAX_STAGES];
+            unsigned long long total[PerfTrace::MAX_STAGES];
+            unsigned int min[PerfTrace::MAX_STAGES];
+            unsigned int max[PerfTrace::MAX_STAGES];
+
+            ThreadBuffer() : id(0), alive(true), written(0), generation(0)
+            {
+                memset(ring, 0, sizeof(ring));
+                clearStats();
+            }
+
+            void clearStats()
+            {
+                memset(histogram, 0, sizeof(histogram));
+                memset(count, 0, sizeof(count));
+                memset(total, 0, sizeof(total));
+                memset(min, 0xff, sizeof(min));
+                memset(max, 0, sizeof(max));
+            }
+        };
+
+        // guards the stage names and the list of buffers, never taken while recording
+        Mutex registryMutex;
+        const char* stageNames[PerfTrace::MAX_STAGES];
+        int stageCount = 0;
+        std::vector<ThreadBuffer*> buffers;
+
+        volatile int enabled = 1;
+        volatile unsigned int generation = 0;
+
+        pthread_key_t bufferKey;
+        pthread_once_t bufferKeyOnce = PTHREAD_ONCE_INIT;
+
+        void retireBuffer( void* buffer )
+        {
+            ScopedLock lock(registryMutex);
+            static_cast<ThreadBuffer*>(buffer)->alive = false;
+        }
+
+        void createBufferKey()
+        {
+            pthread_key_create(&bufferKey, retireBuffer);
+        }
+
+        ThreadBuffer* getBuffer()
+        {
+            pthread_once(&bufferKeyOnce, createBufferKey);
+            ThreadBuffer* buffer = static_cast<ThreadBuffer*>(pthread_getspecific(bufferKey));
+            if (buffer)
+                return buffer;
+
+            ScopedLock lock(registryMutex);
+            for (size_t i = 0; i < buffers.size() && !buffer; i++)
+            {
+                if (!buffers[i]->alive)
+                    buffer = buffers[i];
+            }
+            if (!buffer)
+            {
+                buffer = new ThreadBuffer();
+                buffer->id = (int)buffers.size() + 1;
+                buffers.push_back(buffer);
+            }
+
+            buffer->alive = true;
+            char name[32];
+            snprintf(name, sizeof(name), "thread %d", buffer->id);
+            buffer->name = name;
+#if defined(__APPLE__)
+            if (pthread_main_np())
+                buffer->name = "main";
+#endif
+            pthread_setspecific(bufferKey, buffer);
+            return buffer;
+        }
+
+        double getTicksToMilliseconds()
+        {
+#if defined(__APPLE__)
+            static double factor = 0.0;
+            if (factor == 0.0)
+            {
+                mach_timebase_info_data_t info;
+                mach_timebase_info(&info);
+                factor = 1e-6 * (double)info.numer / (double)info.denom;
+            }
+            return factor;
+#else
+            return 1e-6;
+#endif
+        }
+
+        // four buckets per power of two, the first four are one tick wide
+        inline int getBucket( unsigned int ticks )
+        {
+            if (ticks < 4)
+                return (int)ticks;
+            int exponent = 31 - __builtin_clz(ticks);
+            return 4 * (exponent - 1) + (int)((ticks >> (exponent - 2)) & 3);
+        }
+
+        void getBucketRange( int bucket, unsigned long long& lower, unsigned long long& upper )
+        {
+            if (bucket < 4)
+            {
+                lower = bucket;
+                upper = bucket + 1;
+                return;
+            }
+            int exponent = bucket / 4 + 1;
+            unsigned long long sub = bucket % 4;
+            lower = (4 + sub) << (exponent - 2);
+            upper = (5 + sub) << (exponent - 2);
+        }
+
+        // the time below which a fraction of the samples are, interpolated within its bucket
+        double getPercentile( const std::vector<unsigned long>& histogram, unsigned long count, double fraction )
+        {
+            double target = fraction * count;
+            unsigned long below = 0;
+            for (int bucket = 0; bucket < (int)histogram.size(); bucket++)
+            {
+                if (histogram[bucket] == 0)
+                    continue;
+                if (below + histogram[bucket] >= target)
+                {
+                    unsigned long long lower, upper;
+                    getBucketRange(bucket, lower, upper);
+                    double t = (target - below) / histogram[bucket];
+                    return (lower + t * (upper - lower)) * getTicksToMilliseconds();
+                }
+                below += histogram[bucket];
+            }
+            return 0.0;
+        }
+
+        void appendEscaped( std::string& json, const std::string& text )
+        {
+            for (size_t i = 0; i < text.size(); i++)
+            {
+                char c = text[i];
+                if (c == '"' || c == '\\')
+                    json += '\\';
+                if ((unsigned char)c >= 0x20)
+                    json += c;
+            }
+        }
+    }
+
+    int PerfTrace::getStage( const char* name )
+    {
+        ScopedLock lock(registryMutex);
+        for (int i = 0; i < stageCount; i++)
+        {
+            if (strcmp(stageNames[i], name) == 0)
+                return i;
+        }
+        if (stageCount == MAX_STAGES)
+            return -1;
+        stageNames[stageCount] = name;
+        return stageCount++;
+    }
+
+    void PerfTrace::setEnabled( bool _enabled )
+    {
+        atomicStore(&enabled, _enabled ? 1 : 0);
+    }
+
+    bool PerfTrace::isEnabled()
+    {
+        return enabled != 0;
+    }
+
+    void PerfTrace::setThreadName( const char* name )
+    {
+        ThreadBuffer* buffer = getBuffer();
+        ScopedLock lock(registryMutex);
+        buffer->name = name;
+    }
+
+    unsigned long long PerfTrace::now()
+    {
+#if defined(__APPLE__)
+        return mach_absolute_time();
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+#endif
+    }
+
+    void PerfTrace::record( int stage, unsigned long long start, unsigned long long end )
+    {
+        if (stage < 0 || stage >= MAX_STAGES || end < start)
+            return;
+
+        ThreadBuffer* buffer = getBuffer();
+        unsigned int duration = end - start > 0xffffffffULL ? 0xffffffffU : (unsigned int)(end - start);
+
+        unsigned int written = buffer->written;
+        Sample& sample = buffer->ring[written & (RING_SIZE - 1)];
+        sample.start = start;
+        sample.duration = duration;
+        sample.stage = stage;
+        atomicStore(&buffer->written, written + 1);
+
+        if (buffer->generation != generation)
+        {
+            buffer->clearStats();
+            buffer->generation = generation;
+        }
+        buffer->histogram[stage][getBucket(duration)]++;
+        buffer->count[stage]++;
+        buffer->total[stage] += duration;
+        buffer->min[stage] = std::min(buffer->min[stage], duration);
+        buffer->max[stage] = std::max(buffer->max[stage], duration);
+    }
+
+    double PerfTrace::getBucketLimit( int bucket )
+    {
+        unsigned long long lower, upper;
+        getBucketRange(bucket, lower, upper);
+        return upper * getTicksToMilliseconds();
+    }
+
+    void PerfTrace::getStats( std::vector<PerfStageStats>& stats )
+    {
+        stats.clear();
+        double toMilliseconds = getTicksToMilliseconds();
+        unsigned int current = atomicLoad(&generation);
+
+        ScopedLock lock(registryMutex);
+        for (int stage = 0; stage < stageCount; stage++)
+        {
+            PerfStageStats result;
+            result.name = stageNames[stage];
+            result.histogram.resize(BUCKET_COUNT, 0);
+            unsigned long long total = 0;
+            unsigned int min = 0xffffffffU, max = 0;
+            for (size_t i = 0; i < buffers.size(); i++)
+            {
+                const ThreadBuffer& buffer = *buffers[i];
+                if (buffer.generation != current || buffer.count[stage] == 0)
+                    continue;
+                for (int bucket = 0; bucket < BUCKET_COUNT; bucket++)
+                    result.histogram[bucket] += buffer.histogram[stage][bucket];
+                result.count += buffer.count[stage];
+                total += buffer.total[stage];
+                min = std::min(min, buffer.min[stage]);
+                max = std::max(max, buffer.max[stage]);
+            }
+            if (result.count == 0)
+                continue;
+
+            result.mean = (double)total / result.count * toMilliseconds;
+            result.min = min * toMilliseconds;
+            result.max = max * toMilliseconds;
+            result.p50 = std::max(result.min, std::min(result.max, getPercentile(result.histogram, result.count, 0.5)));
+            result.p90 = std::max(result.min, std::min(result.max, getPercentile(result.histogram, result.count, 0.9)));
+            result.p99 = std::max(result.min, std::min(result.max, getPercentile(result.histogram, result.count, 0.99)));
+            stats.push_back(result);
+        }
+    }
+
+    void PerfTrace::resetStats()
+    {
+        __sync_add_and_fetch(&generation, 1);
+    }
+
+    void PerfTrace::getChromeTrace( std::string& json )
+    {
+        double toMicroseconds = getTicksToMilliseconds() * 1000.0;
+
+        ScopedLock lock(registryMutex);
+
+        // copy the rings first, the oldest sample is the origin of the trace
+        std::vector<std::vector<Sample> > samples(buffers.size());
+        unsigned long long origin = ~0ULL;
+        for (size_t i = 0; i < buffers.size(); i++)
+        {
+            ThreadBuffer& buffer = *buffers[i];
+            unsigned int written = atomicLoad(&buffer.written);
+            unsigned int available = std::min(written, (unsigned int)RING_SIZE);
+            std::vector<Sample> copy(available);
+            for (unsigned int k = 0; k < available; k++)
+                copy[k] = buffer.ring[(written - available + k) & (RING_SIZE - 1)];
+
+            // the samples the writer got to again while copying are dropped
+            unsigned int after = atomicLoad(&buffer.written);
+            for (unsigned int k = 0; k < available; k++)
+            {
+                if (after - (written - available + k) < (unsigned int)RING_SIZE)
+                {
+                    samples[i].push_back(copy[k]);
+                    origin = std::min(origin, copy[k].start);
+                }
+            }
+        }
+
+        json = "{\"traceEvents\":[";
+        bool first = true;
+        char text[128];
+        for (size_t i = 0; i < buffers.size(); i++)
+        {
+            if (samples[i].empty())
+                continue;
+
+            json += first ? "\n" : ",\n";
+            first = false;
+            snprintf(text, sizeof(text), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"",
+                buffers[i]->id);
+            json += text;
+            appendEscaped(json, buffers[i]->name);
+            json += "\"}}";
+
+            for (size_t k = 0; k < samples[i].size(); k++)
+            {
+                const Sample& sample = samples[i][k];
+                json += ",\n{\"name\":\"";
+                appendEscaped(json, stageNames[sample.stage]);
+                snprintf(text, sizeof(text), "\",\"cat\":\"unifeye\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                    (sample.start - origin) * toMicroseconds, sample.duration * toMicroseconds, buffers[i]->id);
+                json += text;
+            }
+        }
+        json += "\n],\"displayTimeUnit\":\"ms\"}\n";
+    }
+
+    bool PerfTrace::writeChromeTrace( const std::string& path )
+    {
+        std::string json;
+        getChromeTrace(json);
+
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+        bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+        return fclose(file) == 0 && written;
+    }
+}
@@ -0,0 +1,134 @@
+//
+//  PerfTrace.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Timing of the stages of a frame. A PerfScope measures the block it is
+//  declared in and records the sample into a ring owned by the calling
+//  thread, so recording takes no lock: two clock reads, a few stores and a
+//  histogram increment. The rings keep the last samples of every thread
+//  for a Chrome trace (chrome://tracing, "Load"), the histograms count
+//  every sample since the last reset for the percentiles.
+//
+//      void render()
+//      {
+//          UNIFEYE_PERF_SCOPE("render");
+//          ...
+//      }
+//
+#ifndef __UNIFEYE_PERFTRACE_H__
+#define __UNIFEYE_PERFTRACE_H__
+
+#include <string>
+#include <vector>
+
+namespace unifeye
+{
+    /**
+     * \brief Timing statistics of one stage, over all threads
+     */
+    struct PerfStageStats
+    {
+        std::string name;
+        unsigned long count;            ///< samples since the last reset
+        double mean;                    ///< milliseconds
+        double min;                     ///< milliseconds
+        double max;                     ///< milliseconds
+        double p50;                     ///< median in milliseconds
+        double p90;                     ///< milliseconds
+        double p99;                     ///< milliseconds
+        std::vector<unsigned long> histogram;   ///< samples per bucket, see PerfTrace::getBucketLimit
+
+        PerfStageStats() : count(0), mean(0), min(0), max(0), p50(0), p90(0), p99(0) {};
+    };
+
+    /**
+     * \brief Process wide recorder of stage timings
+     *
+     * Stages are identified by the index getStage() returns for their name.
+     * The statistics and the trace can be read from any thread while others
+     * record; a sample being written at that moment may be left out.
+     */
+    class PerfTrace
+    {
+    public:
+        enum
+        {
+            MAX_STAGES = 32,            ///< stages beyond this are not recorded
+            RING_SIZE = 4096,           ///< samples kept per thread for the trace, a power of two
+            BUCKET_COUNT = 124          ///< histogram buckets, four per power of two
+        };
+
+        /**
+         * \brief Register a stage
+         * \param name the name of the stage, must stay valid (a literal)
+         * \return the index of the stage, the same for the same name, -1 if there are too many
+         */
+        static int getStage( const char* name );
+
+        /// Enable or disable recording, it is enabled by default
+        static void setEnabled( bool enabled );
+
+        static bool isEnabled();
+
+        /// Name of the calling thread in the trace
+        static void setThreadName( const char* name );
+
+        /// The clock samples are recorded with, in ticks
+        static unsigned long long now();
+
+        /// Record a sample of the calling thread, start and end from now()
+        static void record( int stage, unsigned long long start, unsigned long long end );
+
+        /// The upper end of a histogram bucket in milliseconds
+        static double getBucketLimit( int bucket );
+
+        /// Statistics of the stages with samples since the last reset
+        static void getStats( std::vector<PerfStageStats>& stats );
+
+        /// Start counting the statistics anew, the trace is kept
+        static void resetStats();
+
+        /**
+         * \brief The samples in the rings as Chrome trace_event JSON
+         * \param[out] json the JSON object, with "X" (complete) events in microseconds
+         */
+        static void getChromeTrace( std::string& json );
+
+        /// Write getChromeTrace() to a file, false if it could not be written
+        static bool writeChromeTrace( const std::string& path );
+    };
+
+    /**
+     * \brief Records the time from its construction to its destruction
+     */
+    class PerfScope
+    {
+    public:
+        explicit PerfScope( int _stage ) : stage(_stage), start(PerfTrace::isEnabled() ? PerfTrace::now() : 0) {};
+
+        ~PerfScope()
+        {
+            if (start != 0)
+                PerfTrace::record(stage, start, PerfTrace::now());
+        }
+
+    private:
+        PerfScope( const PerfScope& );
+        PerfScope& operator=( const PerfScope& );
+
+        int stage;
+        unsigned long long start;
+    };
+}
+
+#define UNIFEYE_PERF_CONCAT2( a, b ) a##b
+#define UNIFEYE_PERF_CONCAT( a, b ) UNIFEYE_PERF_CONCAT2(a, b)
+
+/// Time the rest of the enclosing block as the stage name, a string literal
+#define UNIFEYE_PERF_SCOPE( name ) \
+    static const int UNIFEYE_PERF_CONCAT(perfStage, __LINE__) = unifeye::PerfTrace::getStage(name); \
+    unifeye::PerfScope UNIFEYE_PERF_CONCAT(perfScope, __LINE__)(UNIFEYE_PERF_CONCAT(perfStage, __LINE__))
+
+#endif
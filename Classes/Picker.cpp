@@ -0,0 +1,418 @@
+//
+//  Picker.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "Picker.h"
+#include "MeshBVH.h"
+#include "MeshFile.h"
+#include "PoseSnapshot.h"
+#include "VectorMath.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include <UnifeyeSDKMobile/AS_IUnifeyeMobile.h>
+
+namespace unifeye
+{
+    namespace
+    {
+        // bucket size in pixels
+        const int CELL_SIZE = 32;
+
+        // distance along the ray to the box, FLT_MAX if it is missed
+        inline float intersectBox( const metaio::BoundingBox& box, const float origin[3], const float direction[3],
+            float maxDistance )
+        {
+            const float min[3] = { box.min.x, box.min.y, box.min.z };
+            const float max[3] = { box.max.x, box.max.y, box.max.z };
+            float near = 0.0f, far = maxDistance;
+            for (int k = 0; k < 3; k++)
+            {
+                if (direction[k] == 0.0f)
+                {
+                    if (origin[k] < min[k] || origin[k] > max[k])
+                        return FLT_MAX;
+                    continue;
+                }
+                float t0 = (min[k] - origin[k]) / direction[k];
+                float t1 = (max[k] - origin[k]) / direction[k];
+                near = std::max(near, std::min(t0, t1));
+                far = std::min(far, std::max(t0, t1));
+            }
+            return near <= far ? near : FLT_MAX;
+        }
+    }
+
+    Picker::Picker() : width(0), height(0), dirty(true), columns(0), rows(0), rebuildCount(0)
+    {
+        memset(projection, 0, sizeof(projection));
+        memset(inverseProjection, 0, sizeof(inverseProjection));
+    }
+
+    void Picker::setProjection( int _width, int _height, const float _projection[16] )
+    {
+        width = _width;
+        height = _height;
+        memcpy(projection, _projection, sizeof(projection));
+        invertMatrix(projection, inverseProjection);
+        dirty = true;
+    }
+
+    int Picker::addGeometry( const metaio::BoundingBox& box, const MeshBVH* bvh )
+    {
+        int id;
+        if (freeIDs.empty())
+        {
+            id = (int)geometries.size();
+            geometries.push_back(Geometry());
+        }
+        else
+        {
+            id = freeIDs.back();
+            freeIDs.pop_back();
+        }
+
+        Geometry& geometry = geometries[id];
+        geometry.active = true;
+        geometry.visible = true;
+        geometry.box = box;
+        geometry.bvh = bvh;
+        geometry.onScreen = false;
+
+        static const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+        setModelView(id, identity);
+        return id;
+    }
+
+    void Picker::removeGeometry( int id )
+    {
+        if (!geometries[id].active)
+            return;
+
+        geometries[id].active = false;
+        freeIDs.push_back(id);
+        dirty = true;
+    }
+
+    void Picker::setModelView( int id, const float modelView[16] )
+    {
+        Geometry& geometry = geometries[id];
+        memcpy(geometry.modelView, modelView, sizeof(geometry.modelView));
+        invertAffineMatrix(geometry.modelView, geometry.inverse);
+        dirty = true;
+    }
+
+    void Picker::setVisible( int id, bool visible )
+    {
+        if (geometries[id].visible != visible)
+        {
+            geometries[id].visible = visible;
+            dirty = true;
+        }
+    }
+
+    PickResult Picker::pick( float x, float y, bool useTriangleTest )
+    {
+        PickResult result;
+        float xy[2] = { x, y };
+        pick(xy, 1, useTriangleTest, &result);
+        return result;
+    }
+
+    void Picker::pick( const float* xy, int count, bool useTriangleTest, PickResult* results )
+    {
+        if (dirty)
+            rebuild();
+
+        for (int i = 0; i < count; i++)
+        {
+            float x = xy[i * 2], y = xy[i * 2 + 1];
+            PickResult& result = results[i];
+            result.geometry = -1;
+            result.depth = 1.0f;
+            result.triangle = -1;
+            if (x < 0.0f || y < 0.0f || x >= width || y >= height)
+                continue;
+
+            float nearPoint[3], farPoint[3];
+            getRay(x, y, nearPoint, farPoint);
+
+            int cell = ((int)y / CELL_SIZE) * columns + (int)x / CELL_SIZE;
+            for (int b = bucketStart[cell]; b < bucketStart[cell + 1]; b++)
+            {
+                int id = bucketGeometries[b];
+                const Geometry& geometry = geometries[id];
+                if (x < geometry.rect[0] || x > geometry.rect[2] || y < geometry.rect[1] || y > geometry.rect[3])
+                    continue;
+
+                float depth;
+                int triangle;
+                if (test(geometry, nearPoint, farPoint, useTriangleTest, result.depth, depth, triangle))
+                {
+                    result.geometry = id;
+                    result.depth = depth;
+                    result.triangle = triangle;
+                }
+            }
+        }
+    }
+
+    PickResult Picker::pickLinear( float x, float y, bool useTriangleTest )
+    {
+        PickResult result;
+        result.geometry = -1;
+        result.depth = 1.0f;
+        result.triangle = -1;
+
+        float nearPoint[3], farPoint[3];
+        getRay(x, y, nearPoint, farPoint);
+        for (size_t id = 0; id < geometries.size(); id++)
+        {
+            const Geometry& geometry = geometries[id];
+            if (!geometry.active || !geometry.visible)
+                continue;
+
+            float depth;
+            int triangle;
+            if (test(geometry, nearPoint, farPoint, useTriangleTest, result.depth, depth, triangle))
+            {
+                result.geometry = (int)id;
+                result.depth = depth;
+                result.triangle = triangle;
+            }
+        }
+        return result;
+    }
+
+    void Picker::rebuild()
+    {
+        dirty = false;
+        rebuildCount++;
+
+        columns = std::max(1, (width + CELL_SIZE - 1) / CELL_SIZE);
+        rows = std::max(1, (height + CELL_SIZE - 1) / CELL_SIZE);
+        bucketStart.assign(columns * rows + 1, 0);
+
+        // count the geometries per cell, then place them
+        for (size_t id = 0; id < geometries.size(); id++)
+        {
+            Geometry& geometry = geometries[id];
+            geometry.onScreen = false;
+            if (!geometry.active || !geometry.visible)
+                continue;
+
+            project(geometry);
+            if (!geometry.onScreen)
+                continue;
+
+            for (int row = (int)geometry.rect[1] / CELL_SIZE; row <= (int)geometry.rect[3] / CELL_SIZE; row++)
+            {
+                for (int column = (int)geometry.rect[0] / CELL_SIZE; column <= (int)geometry.rect[2] / CELL_SIZE; column++)
+                    bucketStart[row * columns + column + 1]++;
+            }
+        }
+
+        for (int cell = 0; cell < columns * rows; cell++)
+            bucketStart[cell + 1] += bucketStart[cell];
+        bucketGeometries.resize(bucketStart[columns * rows]);
+
+        std::vector<int> fill(bucketStart.begin(), bucketStart.end() - 1);
+        for (size_t id = 0; id < geometries.size(); id++)
+        {
+            const Geometry& geometry = geometries[id];
+            if (!geometry.onScreen)
+                continue;
+
+            for (int row = (int)geometry.rect[1] / CELL_SIZE; row <= (int)geometry.rect[3] / CELL_SIZE; row++)
+            {
+                for (int column = (int)geometry.rect[0] / CELL_SIZE; column <= (int)geometry.rect[2] / CELL_SIZE; column++)
+                    bucketGeometries[fill[row * columns + column]++] = (int)id;
+            }
+        }
+    }
+
+    void Picker::project( Geometry& geometry ) const
+    {
+        float mvp[16];
+        multiplyMatrices(projection, geometry.modelView, mvp);
+
+        float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX;
+        int behind = 0;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            float p[3] = { (corner & 1) ? geometry.box.max.x : geometry.box.min.x,
+                (corner & 2) ? geometry.box.max.y : geometry.box.min.y,
+                (corner & 4) ? geometry.box.max.z : geometry.box.min.z };
+            float w = mvp[3] * p[0] + mvp[7] * p[1] + mvp[11] * p[2] + mvp[15];
+            if (w <= 1e-6f)
+            {
+                behind++;
+                continue;
+            }
+
+            float clip[3];
+            transformPoint(mvp, p, clip);
+            float sx = (clip[0] / w * 0.5f + 0.5f) * width;
+            float sy = (0.5f - clip[1] / w * 0.5f) * height;
+            x0 = std::min(x0, sx);
+            x1 = std::max(x1, sx);
+            y0 = std::min(y0, sy);
+            y1 = std::max(y1, sy);
+        }
+
+        if (behind == 8)
+            return;
+
+        // a box crossing the camera plane can cover any part of the screen
+        if (behind > 0)
+        {
+            x0 = y0 = 0.0f;
+            x1 = (float)width;
+            y1 = (float)height;
+        }
+
+        if (x1 < 0.0f || y1 < 0.0f || x0 >= width || y0 >= height)
+            return;
+
+        geometry.rect[0] = std::max(x0, 0.0f);
+        geometry.rect[1] = std::max(y0, 0.0f);
+        geometry.rect[2] = std::min(x1, width - 1.0f);
+        geometry.rect[3] = std::min(y1, height - 1.0f);
+        geometry.onScreen = true;
+    }
+
+    void Picker::getRay( float x, float y, float nearPoint[3], float farPoint[3] ) const
+    {
+        float ndcX = 2.0f * x / width - 1.0f;
+        float ndcY = 1.0f - 2.0f * y / height;
+
+        for (int i = 0; i < 2; i++)
+        {
+            float ndc[4] = { ndcX, ndcY, i == 0 ? -1.0f : 1.0f, 1.0f };
+            float camera[4];
+            for (int row = 0; row < 4; row++)
+            {
+                camera[row] = inverseProjection[row] * ndc[0] + inverseProjection[4 + row] * ndc[1] +
+                    inverseProjection[8 + row] * ndc[2] + inverseProjection[12 + row] * ndc[3];
+            }
+
+            float* point = i == 0 ? nearPoint : farPoint;
+            for (int k = 0; k < 3; k++)
+                point[k] = camera[k] / camera[3];
+        }
+    }
+
+    bool Picker::test( const Geometry& geometry, const float nearPoint[3], const float farPoint[3],
+        bool useTriangleTest, float maxDepth, float& depth, int& triangle ) const
+    {
+        // the ray from the near to the far plane in model coordinates; the model view matrix is
+        // affine, so the distance along it is the same for all geometries
+        float origin[3], end[3], direction[3];
+        transformPoint(geometry.inverse, nearPoint, origin);
+        transformPoint(geometry.inverse, farPoint, end);
+        for (int k = 0; k < 3; k++)
+            direction[k] = end[k] - origin[k];
+
+        float boxDepth = intersectBox(geometry.box, origin, direction, maxDepth);
+        if (boxDepth == FLT_MAX || boxDepth >= maxDepth)
+            return false;
+
+        if (useTriangleTest && geometry.bvh)
+            return geometry.bvh->intersect(origin, direction, maxDepth, depth, triangle);
+
+        depth = boxDepth;
+        triangle = -1;
+        return true;
+    }
+
+    UnifeyePicking::UnifeyePicking( metaio::IUnifeyeMobile* _unifeye ) : unifeye(_unifeye)
+    {
+    }
+
+    UnifeyePicking::~UnifeyePicking()
+    {
+        for (std::map<metaio::IUnifeyeMobileGeometry*, Entry>::iterator i = entries.begin(); i != entries.end(); ++i)
+            delete i->second.bvh;
+    }
+
+    void UnifeyePicking::addGeometry( metaio::IUnifeyeMobileGeometry* geometry, const std::string& meshPath )
+    {
+        if (entries.count(geometry))
+            return;
+
+        // the BVH keeps its own copy of the triangles, the mesh is unmapped again
+        Entry entry;
+        entry.bvh = NULL;
+        MeshFile mesh;
+        if (!meshPath.empty() && mesh.open(meshPath))
+        {
+            entry.bvh = new MeshBVH();
+            entry.bvh->build(mesh);
+        }
+
+        entry.id = picker.addGeometry(geometry->getBoundingBox(), entry.bvh);
+        entries[geometry] = entry;
+        if ((int)geometries.size() <= entry.id)
+            geometries.resize(entry.id + 1, NULL);
+        geometries[entry.id] = geometry;
+    }
+
+    void UnifeyePicking::removeGeometry( metaio::IUnifeyeMobileGeometry* geometry )
+    {
+        std::map<metaio::IUnifeyeMobileGeometry*, Entry>::iterator found = entries.find(geometry);
+        if (found == entries.end())
+            return;
+
+        picker.removeGeometry(found->second.id);
+        geometries[found->second.id] = NULL;
+        delete found->second.bvh;
+        entries.erase(found);
+    }
+
+    metaio::IUnifeyeMobileGeometry* UnifeyePicking::pick( const PoseSnapshot& poses, int width, int height, float x,
+        float y, bool useTriangleTest, float& depth )
+    {
+        float matrix[16], move[16], modelView[16];
+        unifeye->getProjectionMatrix(matrix);
+        picker.setProjection(width, height, matrix);
+
+        for (std::map<metaio::IUnifeyeMobileGeometry*, Entry>::iterator i = entries.begin(); i != entries.end(); ++i)
+        {
+            metaio::IUnifeyeMobileGeometry* geometry = i->first;
+            int cosID = geometry->getCos();
+            bool visible = geometry->getIsVisible() && poses.find(cosID) >= 0;
+            picker.setVisible(i->second.id, visible);
+            if (!visible)
+                continue;
+
+            // picks are rare, the move is read here instead of tracking every setter
+            unifeye->getTrackingValues(cosID, matrix, true);
+            getMoveMatrix(geometry, move);
+            multiplyMatrices(matrix, move, modelView);
+            picker.setModelView(i->second.id, modelView);
+        }
+
+        PickResult result = picker.pick(x, y, useTriangleTest);
+        if (result.geometry < 0)
+            return NULL;
+
+        depth = result.depth;
+        return geometries[result.geometry];
+    }
+
+    void UnifeyePicking::getMoveMatrix( metaio::IUnifeyeMobileGeometry* geometry, float move[16] )
+    {
+        metaio::Vector3d scale = geometry->getMoveScale();
+        quaternionToMatrix(axisAngleToQuaternion(geometry->getMoveRotation()), geometry->getMoveTranslation(), move);
+
+        const float factors[3] = { scale.x, scale.y, scale.z };
+        for (int column = 0; column < 3; column++)
+            for (int row = 0; row < 3; row++)
+                move[column * 4 + row] *= factors[column];
+    }
+}
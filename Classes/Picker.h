@@ -0,0 +1,209 @@
+//
+//  Picker.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Finds the geometry under a touch in two steps. The bounding boxes of all
+//  geometries are projected to the screen and sorted into a grid of
+//  buckets, rebuilt only when a pose or the projection changed since the
+//  last pick, so a touch only looks at the geometries whose screen
+//  rectangle covers it. Those are tested with the ray through the touch,
+//  against their bounding box or, for exact picking, against the triangles
+//  in their MeshBVH.
+//
+//  Matrices are column major, as returned by getTrackingValues and
+//  getProjectionMatrix. UnifeyePicking feeds a Picker from the geometries
+//  of an SDK instance.
+//
+#ifndef __UNIFEYE_PICKER_H__
+#define __UNIFEYE_PICKER_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+namespace metaio
+{
+    class IUnifeyeMobile;           // forward declaration
+    class IUnifeyeMobileGeometry;   // forward declaration
+}
+
+namespace unifeye
+{
+    class MeshBVH;      // forward declaration
+    class PoseSnapshot; // forward declaration
+
+    /**
+     * \brief Result of a pick
+     */
+    struct PickResult
+    {
+        int geometry;       ///< ID of the geometry hit, -1 if none
+        float depth;        ///< 0 at the near plane, 1 at the far plane
+        int triangle;       ///< triangle hit with the triangle test, else -1
+    };
+
+    /**
+     * \brief Screen space picking of geometries
+     */
+    class Picker
+    {
+    public:
+        Picker();
+
+        /**
+         * \brief Set the viewport and the projection
+         * \param width viewport width in pixels
+         * \param height viewport height in pixels
+         * \param projection projection matrix
+         */
+        void setProjection( int width, int height, const float projection[16] );
+
+        /**
+         * \brief Add a geometry
+         * \param box bounding box in model coordinates
+         * \param bvh triangles for exact picking, may be NULL, must outlive the geometry
+         * \return the ID of the geometry
+         */
+        int addGeometry( const metaio::BoundingBox& box, const MeshBVH* bvh = NULL );
+
+        /// Remove a geometry, its ID can be reused
+        void removeGeometry( int geometry );
+
+        /// Set the model view matrix of a geometry
+        void setModelView( int geometry, const float modelView[16] );
+
+        /// Only visible geometries can be picked
+        void setVisible( int geometry, bool visible );
+
+        /**
+         * \brief Pick the nearest geometry at a screen position
+         * \param x horizontal position in pixels from the left
+         * \param y vertical position in pixels from the top
+         * \param useTriangleTest test the triangles of geometries with a BVH instead of their box
+         * \return the result
+         */
+        PickResult pick( float x, float y, bool useTriangleTest = false );
+
+        /**
+         * \brief Pick several touches at once
+         * \param xy two floats per touch, in pixels from the top left
+         * \param count number of touches
+         * \param useTriangleTest as in pick()
+         * \param[out] results one result per touch
+         */
+        void pick( const float* xy, int count, bool useTriangleTest, PickResult* results );
+
+        /**
+         * \brief Pick by testing every geometry, for reference
+         */
+        PickResult pickLinear( float x, float y, bool useTriangleTest = false );
+
+        /// Number of bucket grid rebuilds so far
+        unsigned long getRebuildCount() const { return rebuildCount; }
+
+    private:
+        struct Geometry
+        {
+            bool active;
+            bool visible;
+            metaio::BoundingBox box;
+            const MeshBVH* bvh;
+            float modelView[16];
+            float inverse[16];      // camera to model coordinates
+            float rect[4];          // screen rectangle, x0, y0, x1, y1
+            bool onScreen;
+        };
+
+        Picker( const Picker& );
+        Picker& operator=( const Picker& );
+
+        void rebuild();
+        void project( Geometry& geometry ) const;
+        void getRay( float x, float y, float nearPoint[3], float farPoint[3] ) const;
+        bool test( const Geometry& geometry, const float nearPoint[3], const float farPoint[3], bool useTriangleTest,
+            float maxDepth, float& depth, int& triangle ) const;
+
+        std::vector<Geometry> geometries;
+        std::vector<int> freeIDs;
+
+        int width, height;
+        float projection[16];
+        float inverseProjection[16];
+
+        // buckets of the grid, the geometries of cell i are in bucketGeometries[bucketStart[i], bucketStart[i + 1])
+        bool dirty;
+        int columns, rows;
+        std::vector<int> bucketStart;
+        std::vector<int> bucketGeometries;
+        unsigned long rebuildCount;
+    };
+
+    /**
+     * \brief Picks geometries of an SDK instance with a Picker
+     *
+     * The box of a geometry is its getBoundingBox(), its model view matrix
+     * the pose of its coordinate system times its move scale, rotation and
+     * translation, read again by every pick(). Only geometries that are
+     * visible and whose coordinate system is tracked can be picked.
+     */
+    class UnifeyePicking
+    {
+    public:
+        explicit UnifeyePicking( metaio::IUnifeyeMobile* unifeye );
+
+        /// Frees the BVHs
+        ~UnifeyePicking();
+
+        /**
+         * \brief Start picking a geometry
+         * \param geometry the geometry
+         * \param meshPath mesh compiled from the model of the geometry, its BVH allows exact picks; may be empty
+         */
+        void addGeometry( metaio::IUnifeyeMobileGeometry* geometry, const std::string& meshPath = std::string() );
+
+        /// Stop picking a geometry
+        void removeGeometry( metaio::IUnifeyeMobileGeometry* geometry );
+
+        /**
+         * \brief Pick the nearest geometry at a screen position
+         *
+         * Reads the projection and the poses of the coordinate systems of the
+         * geometries, so call it where the SDK renders.
+         *
+         * \param poses the coordinate systems tracked in the last frame
+         * \param width viewport width, in the unit of x
+         * \param height viewport height, in the unit of y
+         * \param x horizontal position from the left
+         * \param y vertical position from the top
+         * \param useTriangleTest test the triangles of geometries with a BVH instead of their box
+         * \param[out] depth 0 at the near plane, 1 at the far plane
+         * \return the geometry, NULL if none was hit
+         */
+        metaio::IUnifeyeMobileGeometry* pick( const PoseSnapshot& poses, int width, int height, float x, float y,
+            bool useTriangleTest, float& depth );
+
+        const Picker& getPicker() const { return picker; }
+
+    private:
+        struct Entry
+        {
+            int id;
+            MeshBVH* bvh;           // owned, NULL without a mesh
+        };
+
+        UnifeyePicking( const UnifeyePicking& );
+        UnifeyePicking& operator=( const UnifeyePicking& );
+
+        static void getMoveMatrix( metaio::IUnifeyeMobileGeometry* geometry, float move[16] );
+
+        metaio::IUnifeyeMobile* unifeye;
+        Picker picker;
+        std::map<metaio::IUnifeyeMobileGeometry*, Entry> entries;
+        std::vector<metaio::IUnifeyeMobileGeometry*> geometries;    // by picker ID
+    };
+}
+
+#endif
@@ -0,0 +1,105 @@
+//
+//  PixelBufferPool.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "PixelBufferPool.h"
+
+namespace unifeye
+{
+    PixelBufferPool::PixelBufferPool( int _maxFreeBuffers ) : maxFreeBuffers(_maxFreeBuffers)
+    {
+    }
+
+    PixelBufferPool::~PixelBufferPool()
+    {
+        for (size_t i = 0; i < entries.size(); i++)
+            delete[] entries[i].buffer;
+    }
+
+    unsigned char* PixelBufferPool::acquire( size_t size )
+    {
+        ScopedLock lock(mutex);
+        stats.acquired++;
+
+        // best fit among the free buffers
+        Entry* best = 0;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            Entry& entry = entries[i];
+            if (entry.inUse || entry.capacity < size)
+                continue;
+            if (!best || entry.capacity < best->capacity)
+                best = &entry;
+        }
+
+        if (best)
+        {
+            best->inUse = true;
+            return best->buffer;
+        }
+
+        Entry entry;
+        entry.buffer = new unsigned char[size];
+        entry.capacity = size;
+        entry.inUse = true;
+        entries.push_back(entry);
+
+        stats.allocated++;
+        stats.bytesInPool += size;
+        return entry.buffer;
+    }
+
+    void PixelBufferPool::release( unsigned char* buffer )
+    {
+        if (!buffer)
+            return;
+
+        ScopedLock lock(mutex);
+
+        int freeBuffers = 0;
+        size_t index = entries.size();
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (entries[i].buffer == buffer)
+                index = i;
+            else if (!entries[i].inUse)
+                freeBuffers++;
+        }
+
+        if (index == entries.size())
+            return;
+
+        if (freeBuffers < maxFreeBuffers)
+        {
+            entries[index].inUse = false;
+            return;
+        }
+
+        stats.bytesInPool -= entries[index].capacity;
+        delete[] entries[index].buffer;
+        entries.erase(entries.begin() + index);
+    }
+
+    void PixelBufferPool::purge()
+    {
+        ScopedLock lock(mutex);
+
+        for (size_t i = entries.size(); i > 0; i--)
+        {
+            Entry& entry = entries[i - 1];
+            if (entry.inUse)
+                continue;
+            stats.bytesInPool -= entry.capacity;
+            delete[] entry.buffer;
+            entries.erase(entries.begin() + (i - 1));
+        }
+    }
+
+    PixelBufferPoolStats PixelBufferPool::getStats()
+    {
+        ScopedLock lock(mutex);
+        return stats;
+    }
+}
@@ -0,0 +1,86 @@
+//
+//  PixelBufferPool.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Reusable pixel buffers for readbacks and conversions, so that repeated
+//  screenshots do not allocate once the pool is warm.
+//
+#ifndef __UNIFEYE_PIXELBUFFERPOOL_H__
+#define __UNIFEYE_PIXELBUFFERPOOL_H__
+
+#include <stddef.h>
+#include <vector>
+
+#include "Threading.h"
+
+namespace unifeye
+{
+    /**
+     * \brief Counters of a PixelBufferPool
+     */
+    struct PixelBufferPoolStats
+    {
+        unsigned long acquired;     ///< buffers handed out
+        unsigned long allocated;    ///< buffers that had to be allocated
+        size_t bytesInPool;         ///< bytes currently owned by the pool, in use or not
+
+        PixelBufferPoolStats() : acquired(0), allocated(0), bytesInPool(0) {};
+    };
+
+    /**
+     * \brief Thread safe pool of byte buffers
+     *
+     * Buffers can be released from any thread, e.g. from the release callback
+     * of a CGDataProvider.
+     */
+    class PixelBufferPool
+    {
+    public:
+        /**
+         * \brief Constructor
+         * \param maxFreeBuffers number of unused buffers kept for reuse
+         */
+        explicit PixelBufferPool( int maxFreeBuffers = 4 );
+
+        /// Destructor, all buffers must have been released
+        ~PixelBufferPool();
+
+        /**
+         * \brief Get a buffer of at least the given size
+         * \param size size in bytes
+         * \return the buffer, its content is undefined
+         */
+        unsigned char* acquire( size_t size );
+
+        /**
+         * \brief Give a buffer back to the pool
+         * \param buffer a buffer returned by acquire()
+         */
+        void release( unsigned char* buffer );
+
+        /// Free all buffers that are not in use, e.g. on memory warnings
+        void purge();
+
+        PixelBufferPoolStats getStats();
+
+    private:
+        PixelBufferPool( const PixelBufferPool& );
+        PixelBufferPool& operator=( const PixelBufferPool& );
+
+        struct Entry
+        {
+            unsigned char* buffer;
+            size_t capacity;
+            bool inUse;
+        };
+
+        std::vector<Entry> entries;
+        int maxFreeBuffers;
+        PixelBufferPoolStats stats;
+        Mutex mutex;
+    };
+}
+
+#endif
@@ -0,0 +1,233 @@
+//
+//  PoiStreamer.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "PoiStreamer.h"
+
+#include <algorithm>
+#include <math.h>
+
+#include <UnifeyeSDKMobile/AS_IUnifeyeMobile.h>
+
+namespace unifeye
+{
+    namespace
+    {
+        // angle between a bearing and the heading, [0, 180]
+        inline float getAngleToHeading( float bearing, float heading )
+        {
+            float angle = fabsf(fmodf(bearing - heading, 360.0f));
+            return angle > 180.0f ? 360.0f - angle : angle;
+        }
+    }
+
+    UnifeyePoiFactory::~UnifeyePoiFactory()
+    {
+        for (std::map<int, Billboard>::iterator i = billboards.begin(); i != billboards.end(); ++i)
+            textures->releaseBillboard(i->second.geometry);
+    }
+
+    metaio::IUnifeyeMobileGeometry* UnifeyePoiFactory::getBillboard( int point ) const
+    {
+        std::map<int, Billboard>::const_iterator found = billboards.find(point);
+        return found != billboards.end() ? found->second.geometry : NULL;
+    }
+
+    void UnifeyePoiFactory::update( const metaio::LLACoordinate& _sensor, float heading )
+    {
+        bool convert = moved || !(_sensor == sensor);
+        if (convert)
+        {
+            sensor = _sensor;
+            moved = false;
+            converter.setReference(sensor);
+            converter.convert();
+        }
+
+        if (!declutterEnabled)
+        {
+            if (convert && !slots.empty())
+                converter.apply(&slots[0]);
+            return;
+        }
+
+        // the sensor is the origin of the converted coordinates, so the camera stays there
+        std::map<int, Billboard>::const_iterator i;
+        if (convert)
+        {
+            for (i = billboards.begin(); i != billboards.end(); ++i)
+                declutter.setPosition(i->second.declutterID, converter.getTranslation(i->second.slot));
+        }
+
+        float direction = (heading < 0.0f ? 0.0f : heading) * (float)M_PI / 180.0f;
+        declutter.update(metaio::Vector3d(sinf(direction), cosf(direction), 0.0f), fieldOfView);
+        for (i = billboards.begin(); i != billboards.end(); ++i)
+            i->second.geometry->setMoveTranslation(declutter.getPosition(i->second.declutterID));
+    }
+
+    void UnifeyePoiFactory::setDeclutterEnabled( bool enabled )
+    {
+        if (enabled == declutterEnabled)
+            return;
+
+        declutterEnabled = enabled;
+        for (std::map<int, Billboard>::iterator i = billboards.begin(); i != billboards.end(); ++i)
+        {
+            if (enabled)
+                addToDeclutter(i->second);
+            else
+            {
+                declutter.removeBillboard(i->second.declutterID);
+                i->second.declutterID = -1;
+            }
+        }
+
+        // back to the converted positions, or into the declutter at them
+        moved = true;
+    }
+
+    void UnifeyePoiFactory::addToDeclutter( Billboard& billboard )
+    {
+        metaio::BoundingBox box = billboard.geometry->getBoundingBox();
+        billboard.declutterID = declutter.addBillboard(converter.getTranslation(billboard.slot),
+            box.max.x - box.min.x, box.max.y - box.min.y);
+    }
+
+    bool UnifeyePoiFactory::load( int point, const metaio::LLACoordinate& coordinate )
+    {
+        std::map<int, std::string>::const_iterator id = imageIDs.find(point);
+        metaio::IUnifeyeMobileGeometry* geometry = textures->createBillboard(id != imageIDs.end() ? id->second : imageID);
+        if (!geometry)
+            return false;
+
+        // placed by the next update
+        Billboard billboard;
+        billboard.geometry = geometry;
+        billboard.declutterID = -1;
+        if (freeSlots.empty())
+        {
+            billboard.slot = converter.addPoint(coordinate);
+            slots.push_back(geometry);
+        }
+        else
+        {
+            billboard.slot = freeSlots.back();
+            freeSlots.pop_back();
+            converter.setPoint(billboard.slot, coordinate);
+            slots[billboard.slot] = geometry;
+        }
+        if (declutterEnabled)
+            addToDeclutter(billboard);
+        billboards[point] = billboard;
+        moved = true;
+        return true;
+    }
+
+    void UnifeyePoiFactory::unload( int point )
+    {
+        std::map<int, Billboard>::iterator found = billboards.find(point);
+        if (found == billboards.end())
+            return;
+
+        textures->releaseBillboard(found->second.geometry);
+        if (found->second.declutterID >= 0)
+            declutter.removeBillboard(found->second.declutterID);
+        slots[found->second.slot] = NULL;
+        freeSlots.push_back(found->second.slot);
+        billboards.erase(found);
+    }
+
+    PoiStreamer::PoiStreamer( const GeoIndex& _index, IPoiFactory* _factory ) :
+        index(_index), factory(_factory), states(_index.getPointCount(), UNLOADED),
+        keepUpdate(_index.getPointCount(), 0), loadedSlot(_index.getPointCount(), -1)
+    {
+    }
+
+    PoiStreamer::~PoiStreamer()
+    {
+        unloadAll();
+    }
+
+    void PoiStreamer::update( const metaio::LLACoordinate& sensor, float heading )
+    {
+        stats.updates++;
+        bool anyDirection = heading < 0.0f;
+
+        // everything within the unload limits stays, the load limits are checked for POIs not loaded yet
+        index.query(sensor, std::max(parameters.loadRadius, parameters.unloadRadius), hits);
+        stats.candidates = (int)hits.size();
+
+        loads.clear();
+        for (size_t i = 0; i < hits.size(); i++)
+        {
+            const GeoHit& hit = hits[i];
+            float angle = anyDirection ? 0.0f : getAngleToHeading(hit.bearing, heading);
+            bool near = hit.distance <= parameters.nearRadius;
+
+            if (states[hit.point] == LOADED)
+            {
+                if (hit.distance <= parameters.unloadRadius && (near || angle <= 0.5f * parameters.unloadFieldOfView))
+                    keepUpdate[hit.point] = stats.updates;
+            }
+            else if (states[hit.point] == UNLOADED)
+            {
+                if (hit.distance <= parameters.loadRadius && (near || angle <= 0.5f * parameters.fieldOfView))
+                    loads.push_back(std::make_pair(hit.distance, hit.point));
+            }
+        }
+
+        // loaded POIs that were not confirmed above have left the unload limits
+        unloads.clear();
+        for (size_t i = 0; i < loaded.size() && (int)unloads.size() < parameters.maxUnloadsPerUpdate; i++)
+        {
+            if (keepUpdate[loaded[i]] != stats.updates)
+                unloads.push_back(loaded[i]);
+        }
+        for (size_t i = 0; i < unloads.size(); i++)
+            unload(unloads[i]);
+
+        // nearest first
+        int loadCount = std::min((int)loads.size(), parameters.maxLoadsPerUpdate);
+        loadCount = std::max(0, std::min(loadCount, parameters.maxLoaded - (int)loaded.size()));
+        std::partial_sort(loads.begin(), loads.begin() + loadCount, loads.end());
+        for (int i = 0; i < loadCount; i++)
+        {
+            int point = loads[i].second;
+            if (!factory->load(point, index.getPoint(point)))
+            {
+                states[point] = FAILED;
+                stats.failures++;
+                continue;
+            }
+
+            states[point] = LOADED;
+            keepUpdate[point] = stats.updates;
+            loadedSlot[point] = (int)loaded.size();
+            loaded.push_back(point);
+            stats.loads++;
+        }
+        stats.pending = (int)loads.size() - loadCount;
+    }
+
+    void PoiStreamer::unloadAll()
+    {
+        while (!loaded.empty())
+            unload(loaded.back());
+    }
+
+    void PoiStreamer::unload( int point )
+    {
+        factory->unload(point);
+        states[point] = UNLOADED;
+        stats.unloads++;
+
+        // move the last loaded POI into the slot
+        int slot = loadedSlot[point];
+        loaded[slot] = loaded.back();
+        loadedSlot[loaded[slot]] = slot;
+        loaded.pop_back();
+        loadedSlot[point] = -1;
+    }
+}
@@ -0,0 +1,234 @@
+//
+//  PoiStreamer.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Keeps only the POIs around the sensor loaded. A POI is loaded once it is
+//  within the load radius and in the field of view (or very close), and is
+//  only unloaded again after leaving the larger unload radius or the wider
+//  unload field of view, so POIs on the border don't flicker in and out.
+//  Loads and unloads are limited per update, nearest POIs first, so a
+//  jump of the sensor is spread over several frames.
+//
+//  The SDK is only reached through IPoiFactory, so the streamer can run
+//  against synthetic datasets and GPS traces.
+//
+#ifndef __UNIFEYE_POISTREAMER_H__
+#define __UNIFEYE_POISTREAMER_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "BillboardDeclutter.h"
+#include "BillboardTextures.h"
+#include "GeoIndex.h"
+#include "LLAConverter.h"
+
+namespace unifeye
+{
+    /**
+     * \brief Materializes POIs for a PoiStreamer
+     */
+    class IPoiFactory
+    {
+    public:
+        virtual ~IPoiFactory() {};
+
+        /**
+         * \brief Create the geometry or billboard of a POI
+         * \param point index of the POI in the dataset
+         * \param coordinate position of the POI
+         * \return false if the POI could not be loaded, it is not tried again
+         */
+        virtual bool load( int point, const metaio::LLACoordinate& coordinate ) = 0;
+
+        /// Remove the geometry or billboard of a POI loaded before
+        virtual void unload( int point ) = 0;
+    };
+
+    /**
+     * \brief IPoiFactory creating image billboards placed by LLA
+     *
+     * The billboards are placed with setMoveTranslation at offsets from the
+     * sensor that an LLAConverter computes for all loaded POIs at once,
+     * instead of setMoveTranslationLLA converting every POI on its own.
+     * With decluttering enabled, a BillboardDeclutter stacks billboards
+     * that cover each other, with the camera at the sensor.
+     */
+    class UnifeyePoiFactory : public IPoiFactory
+    {
+    public:
+        /**
+         * \brief Constructor
+         * \param textures creates the billboards, must outlive the factory
+         * \param imageID image of POIs without their own, registered with textures
+         */
+        UnifeyePoiFactory( BillboardTextures* _textures, const std::string& _imageID ) :
+            textures(_textures), imageID(_imageID), moved(true), declutter(2000.0f, 10000.0f),
+            declutterEnabled(false), fieldOfView(1.0f) {};
+
+        /// Releases the billboards still loaded
+        virtual ~UnifeyePoiFactory();
+
+        /// Give a POI its own image, registered with the BillboardTextures
+        void setImage( int point, const std::string& id ) { imageIDs[point] = id; }
+
+        /// The billboard of a loaded POI, NULL if it is not loaded
+        metaio::IUnifeyeMobileGeometry* getBillboard( int point ) const;
+
+        /**
+         * \brief Move the loaded billboards for the sensor position
+         *
+         * Call after PoiStreamer::update with the same values. Converts again
+         * if the sensor moved or POIs were loaded since the last call, the
+         * declutter expansion follows the heading on every call.
+         *
+         * \param sensor the sensor position
+         * \param heading compass heading in degrees, negative if unknown
+         */
+        void update( const metaio::LLACoordinate& sensor, float heading );
+
+        /// Stack billboards that cover each other, off by default
+        void setDeclutterEnabled( bool enabled );
+        bool isDeclutterEnabled() const { return declutterEnabled; }
+
+        /// The declutter, for its parameters; distances are in millimeters
+        BillboardDeclutter& getDeclutter() { return declutter; }
+
+        /// Horizontal field of view of the camera in radians, for the declutter expansion
+        void setFieldOfView( float radians ) { fieldOfView = radians; }
+
+        virtual bool load( int point, const metaio::LLACoordinate& coordinate );
+        virtual void unload( int point );
+
+    private:
+        struct Billboard
+        {
+            metaio::IUnifeyeMobileGeometry* geometry;
+            int slot;                               // index in the converter
+            int declutterID;                        // -1 while decluttering is off
+        };
+
+        UnifeyePoiFactory( const UnifeyePoiFactory& );
+        UnifeyePoiFactory& operator=( const UnifeyePoiFactory& );
+
+        void addToDeclutter( Billboard& billboard );
+
+        BillboardTextures* textures;
+        std::string imageID;
+        std::map<int, std::string> imageIDs;
+        std::map<int, Billboard> billboards;
+
+        LLAConverter converter;
+        std::vector<metaio::IUnifeyeMobileGeometry*> slots;     // geometry per converter index, NULL if free
+        std::vector<int> freeSlots;
+        metaio::LLACoordinate sensor;
+        bool moved;                                 // POIs were loaded since the last update
+
+        BillboardDeclutter declutter;
+        bool declutterEnabled;
+        float fieldOfView;
+    };
+
+    /**
+     * \brief Parameters of a PoiStreamer
+     */
+    struct PoiStreamerParameters
+    {
+        float loadRadius;           ///< POIs closer than this in meters are loaded
+        float unloadRadius;         ///< POIs further than this in meters are unloaded
+        float nearRadius;           ///< POIs closer than this in meters are loaded in any direction
+        float fieldOfView;          ///< POIs within this angle in degrees around the heading are loaded
+        float unloadFieldOfView;    ///< POIs outside this angle in degrees around the heading are unloaded
+        int maxLoadsPerUpdate;      ///< loads per update
+        int maxUnloadsPerUpdate;    ///< unloads per update
+        int maxLoaded;              ///< POIs loaded at the same time
+
+        PoiStreamerParameters() : loadRadius(500.0f), unloadRadius(600.0f), nearRadius(50.0f), fieldOfView(120.0f),
+            unloadFieldOfView(200.0f), maxLoadsPerUpdate(8), maxUnloadsPerUpdate(16), maxLoaded(300) {};
+    };
+
+    /**
+     * \brief Statistics of a PoiStreamer
+     */
+    struct PoiStreamerStats
+    {
+        unsigned long updates;      ///< calls to update()
+        unsigned long loads;        ///< POIs loaded
+        unsigned long unloads;      ///< POIs unloaded
+        unsigned long failures;     ///< loads that failed
+        int candidates;             ///< POIs within the unload radius at the last update
+        int pending;                ///< POIs that should be loaded but had to wait at the last update
+
+        PoiStreamerStats() : updates(0), loads(0), unloads(0), failures(0), candidates(0), pending(0) {};
+    };
+
+    /**
+     * \brief Streams the POIs of a GeoIndex in and out
+     */
+    class PoiStreamer
+    {
+    public:
+        /**
+         * \brief Constructor
+         * \param index the POIs, must outlive the streamer and not be rebuilt
+         * \param factory loads and unloads the POIs
+         */
+        PoiStreamer( const GeoIndex& index, IPoiFactory* factory );
+
+        /// Unloads all POIs
+        ~PoiStreamer();
+
+        void setParameters( const PoiStreamerParameters& parameters ) { this->parameters = parameters; }
+        const PoiStreamerParameters& getParameters() const { return parameters; }
+
+        /**
+         * \brief Load and unload POIs for a sensor position and heading
+         *
+         * Call with the values passed to setSensorLLA and setSensorCompassAngle,
+         * once per frame or whenever they change.
+         *
+         * \param sensor the sensor position
+         * \param heading compass heading in degrees, negative if unknown, which loads in all directions
+         */
+        void update( const metaio::LLACoordinate& sensor, float heading );
+
+        /// Unload all POIs at once
+        void unloadAll();
+
+        /// true if a POI is loaded
+        bool isLoaded( int point ) const { return states[point] == LOADED; }
+
+        /// The loaded POIs
+        const std::vector<int>& getLoaded() const { return loaded; }
+
+        const PoiStreamerStats& getStats() const { return stats; }
+
+    private:
+        enum State { UNLOADED, LOADED, FAILED };
+
+        PoiStreamer( const PoiStreamer& );
+        PoiStreamer& operator=( const PoiStreamer& );
+
+        void unload( int point );
+
+        const GeoIndex& index;
+        IPoiFactory* factory;
+        PoiStreamerParameters parameters;
+        PoiStreamerStats stats;
+
+        std::vector<unsigned char> states;
+        std::vector<unsigned long> keepUpdate;      // last update the POI was inside the unload limits
+        std::vector<int> loaded;
+        std::vector<int> loadedSlot;                // position of a POI in loaded
+
+        // reused between updates
+        std::vector<GeoHit> hits;
+        std::vector<std::pair<float, int> > loads;
+        std::vector<int> unloads;
+    };
+}
+
+#endif
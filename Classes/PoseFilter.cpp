@@ -0,0 +1,337 @@
+//
+//  PoseFilter.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "PoseFilter.h"
+
+#include <math.h>
+
+namespace unifeye
+{
+    namespace
+    {
+        const float PI = 3.14159265358979f;
+
+        // smoothing factor of a first order low pass
+        inline float smoothingFactor( float cutoff, float dt )
+        {
+            float tau = 1.0f / (2.0f * PI * cutoff);
+            return 1.0f / (1.0f + tau / dt);
+        }
+
+        inline float length3( const float* v )
+        {
+            return sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        }
+
+        inline void normalize4( float* q )
+        {
+            float norm = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+            if (norm <= 0.0f)
+            {
+                q[0] = q[1] = q[2] = 0.0f;
+                q[3] = 1.0f;
+                return;
+            }
+            for (int k = 0; k < 4; k++)
+                q[k] /= norm;
+        }
+
+        // a * b for quaternions stored as (x, y, z, w)
+        inline void multiply( const float* a, const float* b, float* result )
+        {
+            float x = a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1];
+            float y = a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0];
+            float z = a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3];
+            float w = a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2];
+            result[0] = x;
+            result[1] = y;
+            result[2] = z;
+            result[3] = w;
+        }
+
+        // q * v * q^-1 for a unit quaternion q
+        inline void rotate( const float* q, const float* v, float* result )
+        {
+            float t[3] = { 2.0f * (q[1] * v[2] - q[2] * v[1]), 2.0f * (q[2] * v[0] - q[0] * v[2]),
+                2.0f * (q[0] * v[1] - q[1] * v[0]) };
+            result[0] = v[0] + q[3] * t[0] + q[1] * t[2] - q[2] * t[1];
+            result[1] = v[1] + q[3] * t[1] + q[2] * t[0] - q[0] * t[2];
+            result[2] = v[2] + q[3] * t[2] + q[0] * t[1] - q[1] * t[0];
+        }
+    }
+
+    PoseFilter::PoseFilter() : cosParameterCount(0), stateCount(0)
+    {
+    }
+
+    void PoseFilter::setDefaultParameters( const PoseFilterParameters& parameters )
+    {
+        defaultParameters = parameters;
+    }
+
+    bool PoseFilter::setParameters( int cosID, const PoseFilterParameters& parameters )
+    {
+        for (int i = 0; i < cosParameterCount; i++)
+        {
+            if (cosParameters[i].cosID == cosID)
+            {
+                cosParameters[i].parameters = parameters;
+                return true;
+            }
+        }
+
+        if (cosParameterCount == MAX_STATES)
+            return false;
+
+        cosParameters[cosParameterCount].cosID = cosID;
+        cosParameters[cosParameterCount].parameters = parameters;
+        cosParameterCount++;
+        return true;
+    }
+
+    PoseFilterParameters PoseFilter::getParameters( int cosID ) const
+    {
+        for (int i = 0; i < cosParameterCount; i++)
+        {
+            if (cosParameters[i].cosID == cosID)
+                return cosParameters[i].parameters;
+        }
+        return defaultParameters;
+    }
+
+    void PoseFilter::reset()
+    {
+        stateCount = 0;
+    }
+
+    PoseFilter::State* PoseFilter::findState( int cosID )
+    {
+        for (int i = 0; i < stateCount; i++)
+        {
+            if (states[i].cosID == cosID)
+                return &states[i];
+        }
+
+        // reuse the slot of a coordinate system that is no longer tracked
+        for (int i = 0; i < stateCount; i++)
+        {
+            if (!states[i].active)
+            {
+                states[i].cosID = cosID;
+                return &states[i];
+            }
+        }
+
+        if (stateCount == MAX_STATES)
+            return 0;
+
+        State* state = &states[stateCount++];
+        state->cosID = cosID;
+        state->active = false;
+        return state;
+    }
+
+    void PoseFilter::filter( const PoseSnapshot& measured, PoseSnapshot& filtered, double renderTime )
+    {
+        filtered = measured;
+
+        bool seen[MAX_STATES] = { false };
+        for (int i = 0; i < measured.getCount(); i++)
+        {
+            PoseFilterParameters parameters = getParameters(measured.cosID[i]);
+            if (!parameters.enabled)
+                continue;
+
+            State* state = findState(measured.cosID[i]);
+            if (!state)
+                continue;
+            seen[state - states] = true;
+
+            float raw[7] = { measured.tx[i], measured.ty[i], measured.tz[i],
+                measured.qx[i], measured.qy[i], measured.qz[i], measured.qw[i] };
+
+            if (!state->active)
+            {
+                // first pose after (re)acquiring the target, nothing to smooth yet
+                state->active = true;
+                state->time = measured.getTimestamp();
+                for (int k = 0; k < 3; k++)
+                {
+                    state->position[k] = raw[k];
+                    state->velocity[k] = 0.0f;
+                    state->angularVelocity[k] = 0.0f;
+                }
+                for (int k = 0; k < 4; k++)
+                    state->rotation[k] = raw[3 + k];
+                normalize4(state->rotation);
+                for (int k = 0; k < 7; k++)
+                    state->raw[k] = raw[k];
+            }
+            else
+            {
+                bool changed = false;
+                for (int k = 0; k < 7; k++)
+                    changed = changed || raw[k] != state->raw[k];
+                if (changed)
+                    correct(*state, measured, i, parameters);
+            }
+
+            float dt = (float)(renderTime - state->time);
+            dt = dt < 0.0f ? 0.0f : (dt > parameters.maxPrediction ? parameters.maxPrediction : dt);
+            predict(*state, dt, filtered, i);
+        }
+
+        for (int i = 0; i < stateCount; i++)
+        {
+            if (!seen[i])
+                states[i].active = false;
+        }
+
+        filtered.updateMatrices();
+    }
+
+    void PoseFilter::correct( State& state, const PoseSnapshot& measured, int i, const PoseFilterParameters& parameters )
+    {
+        float dt = (float)(measured.getTimestamp() - state.time);
+        if (dt < 1e-3f)
+            dt = 1e-3f;
+
+        float dAlpha = smoothingFactor(parameters.derivativeCutoff, dt);
+
+        // translation
+        float x[3] = { measured.tx[i], measured.ty[i], measured.tz[i] };
+        for (int k = 0; k < 3; k++)
+        {
+            float speed = (x[k] - state.position[k]) / dt;
+            state.velocity[k] += dAlpha * (speed - state.velocity[k]);
+        }
+
+        float alpha = smoothingFactor(parameters.translationMinCutoff + parameters.translationBeta * length3(state.velocity), dt);
+        for (int k = 0; k < 3; k++)
+            state.position[k] += alpha * (x[k] - state.position[k]);
+
+        // rotation, on the hemisphere of the previous estimate
+        float q[4] = { measured.qx[i], measured.qy[i], measured.qz[i], measured.qw[i] };
+        normalize4(q);
+        float dot = q[0] * state.rotation[0] + q[1] * state.rotation[1] + q[2] * state.rotation[2] + q[3] * state.rotation[3];
+        if (dot < 0.0f)
+        {
+            for (int k = 0; k < 4; k++)
+                q[k] = -q[k];
+        }
+
+        // rotation from the estimate to the measurement as angular speed
+        float inverse[4] = { -state.rotation[0], -state.rotation[1], -state.rotation[2], state.rotation[3] };
+        float delta[4];
+        multiply(q, inverse, delta);
+        float sinHalf = length3(delta);
+        float angle = 2.0f * atan2f(sinHalf, fabsf(delta[3]));
+        float sign = delta[3] < 0.0f ? -1.0f : 1.0f;
+        for (int k = 0; k < 3; k++)
+        {
+            float omega = sinHalf > 1e-9f ? sign * delta[k] / sinHalf * angle / dt : 0.0f;
+            state.angularVelocity[k] += dAlpha * (omega - state.angularVelocity[k]);
+        }
+
+        alpha = smoothingFactor(parameters.rotationMinCutoff + parameters.rotationBeta * length3(state.angularVelocity), dt);
+        for (int k = 0; k < 4; k++)
+            state.rotation[k] += alpha * (q[k] - state.rotation[k]);
+        normalize4(state.rotation);
+
+        state.time = measured.getTimestamp();
+        state.raw[0] = measured.tx[i];
+        state.raw[1] = measured.ty[i];
+        state.raw[2] = measured.tz[i];
+        state.raw[3] = measured.qx[i];
+        state.raw[4] = measured.qy[i];
+        state.raw[5] = measured.qz[i];
+        state.raw[6] = measured.qw[i];
+    }
+
+    void PoseFilter::predict( const State& state, float dt, PoseSnapshot& filtered, int i ) const
+    {
+        filtered.tx[i] = state.position[0] + state.velocity[0] * dt;
+        filtered.ty[i] = state.position[1] + state.velocity[1] * dt;
+        filtered.tz[i] = state.position[2] + state.velocity[2] * dt;
+
+        float rotation[4] = { state.rotation[0], state.rotation[1], state.rotation[2], state.rotation[3] };
+        float speed = length3(state.angularVelocity);
+        if (speed > 1e-6f && dt > 0.0f)
+        {
+            float halfAngle = 0.5f * speed * dt;
+            float s = sinf(halfAngle) / speed;
+            float step[4] = { state.angularVelocity[0] * s, state.angularVelocity[1] * s,
+                state.angularVelocity[2] * s, cosf(halfAngle) };
+            multiply(step, state.rotation, rotation);
+            normalize4(rotation);
+        }
+
+        filtered.qx[i] = rotation[0];
+        filtered.qy[i] = rotation[1];
+        filtered.qz[i] = rotation[2];
+        filtered.qw[i] = rotation[3];
+    }
+
+
+    PoseCorrection::PoseCorrection() : count(0), resetCount(0)
+    {
+    }
+
+    const metaio::Pose& PoseCorrection::identity()
+    {
+        static const metaio::Pose pose;
+        return pose;
+    }
+
+    void PoseCorrection::update( const PoseSnapshot& measured, const PoseSnapshot& filtered, const PoseFilter& filter )
+    {
+        int previous[PoseSnapshot::MAX_POSES];
+        int previousCount = count;
+        for (int i = 0; i < count; i++)
+            previous[i] = cosIDs[i];
+
+        count = 0;
+        for (int i = 0; i < measured.getCount(); i++)
+        {
+            int f = filtered.find(measured.cosID[i]);
+            if (f < 0 || !filter.getParameters(measured.cosID[i]).draw)
+                continue;
+
+            float t[3] = { filtered.tx[f] - measured.tx[i], filtered.ty[f] - measured.ty[i], filtered.tz[f] - measured.tz[i] };
+            float q[4] = { measured.qx[i], measured.qy[i], measured.qz[i], measured.qw[i] };
+            float target[4] = { filtered.qx[f], filtered.qy[f], filtered.qz[f], filtered.qw[f] };
+
+            // a coordinate system the filter passed through needs no offset
+            if (t[0] == 0.0f && t[1] == 0.0f && t[2] == 0.0f &&
+                q[0] == target[0] && q[1] == target[1] && q[2] == target[2] && q[3] == target[3])
+                continue;
+
+            // measured^-1 * filtered: the rotation between the two, the translation in the measured frame
+            normalize4(q);
+            float inverse[4] = { -q[0], -q[1], -q[2], q[3] };
+            float rotation[4], translation[3];
+            multiply(inverse, target, rotation);
+            normalize4(rotation);
+            rotate(inverse, t, translation);
+
+            metaio::Pose& offset = offsets[count];
+            offset.cosID = measured.cosID[i];
+            offset.translation = metaio::Vector3d(translation[0], translation[1], translation[2]);
+            offset.rotation = metaio::Vector4d(rotation[0], rotation[1], rotation[2], rotation[3]);
+            cosIDs[count++] = measured.cosID[i];
+        }
+
+        resetCount = 0;
+        for (int i = 0; i < previousCount; i++)
+        {
+            bool kept = false;
+            for (int j = 0; j < count && !kept; j++)
+                kept = cosIDs[j] == previous[i];
+            if (!kept)
+                resetIDs[resetCount++] = previous[i];
+        }
+    }
+}
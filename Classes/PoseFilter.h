@@ -0,0 +1,174 @@
+//
+//  PoseFilter.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Smooths the poses of each coordinate system with a One-Euro filter and
+//  extrapolates them to the render time with a constant velocity model.
+//  Tracking usually runs at a fraction of the render rate, so without this
+//  content jumps whenever a new tracking result arrives.
+//
+//  The filter is deterministic: it has no clock of its own and only depends
+//  on the snapshots and times passed in.
+//
+#ifndef __UNIFEYE_POSEFILTER_H__
+#define __UNIFEYE_POSEFILTER_H__
+
+#include "PoseSnapshot.h"
+
+namespace unifeye
+{
+    /**
+     * \brief Parameters of the filter of one coordinate system
+     *
+     * See Casiez et al., "1 Euro Filter", CHI 2012. A low minimum cutoff
+     * removes jitter at rest, a high beta reduces lag during fast motion.
+     */
+    struct PoseFilterParameters
+    {
+        bool enabled;                   ///< false passes the poses through unchanged
+        float translationMinCutoff;     ///< minimum cutoff frequency for the translation in Hz
+        float translationBeta;          ///< cutoff increase per mm/s of translation speed
+        float rotationMinCutoff;        ///< minimum cutoff frequency for the rotation in Hz
+        float rotationBeta;             ///< cutoff increase per rad/s of rotation speed
+        float derivativeCutoff;         ///< cutoff frequency of the speed estimates in Hz
+        float maxPrediction;            ///< maximum extrapolation in seconds, 0 disables prediction
+        bool draw;                      ///< true draws the content at the filtered pose, see PoseCorrection
+
+        PoseFilterParameters() : enabled(true), translationMinCutoff(1.0f), translationBeta(0.05f),
+            rotationMinCutoff(1.0f), rotationBeta(0.5f), derivativeCutoff(1.0f), maxPrediction(0.05f),
+            draw(false) {};
+    };
+
+    /**
+     * \brief Per coordinate system pose filter
+     */
+    class PoseFilter
+    {
+    public:
+        PoseFilter();
+
+        /**
+         * \brief Set the parameters used for coordinate systems without their own
+         * \param parameters the parameters
+         */
+        void setDefaultParameters( const PoseFilterParameters& parameters );
+
+        /**
+         * \brief Set the parameters of one coordinate system
+         * \param cosID the (one-based) coordinate system ID
+         * \param parameters the parameters
+         * \return false if too many coordinate systems have their own parameters
+         */
+        bool setParameters( int cosID, const PoseFilterParameters& parameters );
+
+        /// Get the parameters that apply to a coordinate system
+        PoseFilterParameters getParameters( int cosID ) const;
+
+        /**
+         * \brief Filter a snapshot
+         *
+         * A pose counts as a new measurement when it differs from the previous
+         * one; repeated poses between two tracking frames are only extrapolated.
+         *
+         * \param measured the poses as tracked, their timestamp is the measurement time
+         * \param[out] filtered the smoothed and extrapolated poses
+         * \param renderTime the time the poses are used for, in seconds
+         */
+        void filter( const PoseSnapshot& measured, PoseSnapshot& filtered, double renderTime );
+
+        /// Forget the history of all coordinate systems
+        void reset();
+
+    private:
+        enum { MAX_STATES = PoseSnapshot::MAX_POSES };
+
+        struct State
+        {
+            int cosID;
+            bool active;
+            double time;            // time of the last measurement
+            float raw[7];           // last measured translation and quaternion
+            float position[3];      // filtered translation
+            float velocity[3];      // filtered translation speed in mm/s
+            float rotation[4];      // filtered quaternion (x, y, z, w)
+            float angularVelocity[3];   // filtered rotation speed, axis * rad/s
+        };
+
+        struct CosParameters
+        {
+            int cosID;
+            PoseFilterParameters parameters;
+        };
+
+        State* findState( int cosID );
+        void correct( State& state, const PoseSnapshot& measured, int index, const PoseFilterParameters& parameters );
+        void predict( const State& state, float dt, PoseSnapshot& filtered, int index ) const;
+
+        PoseFilterParameters defaultParameters;
+        CosParameters cosParameters[MAX_STATES];
+        int cosParameterCount;
+
+        State states[MAX_STATES];
+        int stateCount;
+    };
+
+    /**
+     * \brief Coordinate system offsets that make render() draw the filtered poses
+     *
+     * render() draws every coordinate system at the pose it tracked. Offset
+     * by the measured pose inverted and followed by the filtered one, the
+     * content is drawn at the filtered pose instead. The offsets are computed
+     * before render() from the poses of the frame before, so on the frames
+     * where a new tracking result arrives the content is drawn at the
+     * filtered pose moved by that result, the next frame corrects it. At
+     * rest that one frame step is about as large as the noise the filter
+     * removes (tools/filterbench), which is why coordinate systems are only
+     * corrected when their parameters ask for it. The SDK reports the
+     * tracked poses without the offsets, so the filter keeps seeing the
+     * measurements.
+     */
+    class PoseCorrection
+    {
+    public:
+        PoseCorrection();
+
+        /**
+         * \brief Compute the offsets
+         * \param measured the poses as tracked
+         * \param filtered the output of PoseFilter::filter for measured
+         * \param filter the filter, only coordinate systems whose parameters have draw set are corrected
+         */
+        void update( const PoseSnapshot& measured, const PoseSnapshot& filtered, const PoseFilter& filter );
+
+        /// Number of coordinate systems with an offset
+        int getCount() const { return count; }
+
+        /// Coordinate system ID and offset, for indices below getCount()
+        int getCosID( int index ) const { return cosIDs[index]; }
+        const metaio::Pose& getOffset( int index ) const { return offsets[index]; }
+
+        /// Number of coordinate systems that had an offset before but not anymore
+        int getResetCount() const { return resetCount; }
+
+        /// A coordinate system whose offset has to go back to identity()
+        int getResetCosID( int index ) const { return resetIDs[index]; }
+
+        /// The offset of a coordinate system that is not corrected
+        static const metaio::Pose& identity();
+
+    private:
+        PoseCorrection( const PoseCorrection& );
+        PoseCorrection& operator=( const PoseCorrection& );
+
+        // built once, the strings of metaio::Pose allocate
+        metaio::Pose offsets[PoseSnapshot::MAX_POSES];
+        int cosIDs[PoseSnapshot::MAX_POSES];
+        int count;
+        int resetIDs[PoseSnapshot::MAX_POSES];
+        int resetCount;
+    };
+}
+
+#endif
@@ -0,0 +1,70 @@
+//
+//  PoseSnapshot.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "PoseSnapshot.h"
+#include "VectorMath.h"
+
+#include <UnifeyeSDKMobile/AS_IUnifeyeMobile.h>
+
+namespace unifeye
+{
+    PoseSnapshot::PoseSnapshot() : count(0), timestamp(0), sequence(0)
+    {
+    }
+
+    void PoseSnapshot::update( metaio::IUnifeyeMobile* unifeye, double _timestamp )
+    {
+        // the only place where the SDK's vector and strings are created
+        update(unifeye->getValidTrackingValues(), _timestamp);
+    }
+
+    void PoseSnapshot::update( const std::vector<metaio::Pose>& poses, double _timestamp )
+    {
+        count = poses.size() < (size_t)MAX_POSES ? (int)poses.size() : (int)MAX_POSES;
+        for (int i = 0; i < count; i++)
+        {
+            const metaio::Pose& pose = poses[i];
+            tx[i] = pose.translation.x;
+            ty[i] = pose.translation.y;
+            tz[i] = pose.translation.z;
+            qx[i] = pose.rotation.x;
+            qy[i] = pose.rotation.y;
+            qz[i] = pose.rotation.z;
+            qw[i] = pose.rotation.w;
+            quality[i] = pose.quality;
+            cosID[i] = pose.cosID;
+            latitude[i] = pose.llaCoordinate.latitude;
+            longitude[i] = pose.llaCoordinate.longitude;
+            altitude[i] = pose.llaCoordinate.altitude;
+            accuracy[i] = pose.llaCoordinate.accuracy;
+        }
+
+        timestamp = _timestamp;
+        sequence++;
+        updateMatrices();
+    }
+
+    void PoseSnapshot::clear()
+    {
+        count = 0;
+        sequence++;
+    }
+
+    int PoseSnapshot::find( int id ) const
+    {
+        for (int i = 0; i < count; i++)
+        {
+            if (cosID[i] == id)
+                return i;
+        }
+        return -1;
+    }
+
+    void PoseSnapshot::updateMatrices()
+    {
+        quaternionsToMatrices(qx, qy, qz, qw, tx, ty, tz, count, matrices);
+    }
+}
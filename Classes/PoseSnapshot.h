@@ -0,0 +1,109 @@
+//
+//  PoseSnapshot.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  The valid tracking values of one frame in a structure-of-arrays layout.
+//  It is filled once per frame and then read by every consumer without
+//  going through std::vector<metaio::Pose> and its strings again.
+//
+#ifndef __UNIFEYE_POSESNAPSHOT_H__
+#define __UNIFEYE_POSESNAPSHOT_H__
+
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+namespace metaio
+{
+    class IUnifeyeMobile;   // forward declaration
+}
+
+namespace unifeye
+{
+    /**
+     * \brief Fixed capacity snapshot of the tracked coordinate systems
+     *
+     * The snapshot does not allocate and can be copied by value.
+     */
+    class PoseSnapshot
+    {
+    public:
+        /// Maximum number of coordinate systems in a snapshot
+        enum { MAX_POSES = 16 };
+
+        PoseSnapshot();
+
+        /**
+         * \brief Fill the snapshot from the SDK
+         *
+         * Calls getValidTrackingValues() once. This should happen once per
+         * frame, right after render().
+         *
+         * \param unifeye the SDK instance
+         * \param timestamp the time of the frame in seconds
+         */
+        void update( metaio::IUnifeyeMobile* unifeye, double timestamp );
+
+        /**
+         * \brief Fill the snapshot from a list of poses
+         * \param poses the poses, everything beyond MAX_POSES is ignored
+         * \param timestamp the time of the poses in seconds
+         */
+        void update( const std::vector<metaio::Pose>& poses, double timestamp );
+
+        /// Remove all poses
+        void clear();
+
+        /// Recompute the matrices after the arrays were modified directly
+        void updateMatrices();
+
+        /// Number of poses in the snapshot
+        int getCount() const { return count; }
+
+        /// Time passed to update()
+        double getTimestamp() const { return timestamp; }
+
+        /// Incremented by every update()
+        unsigned long getSequence() const { return sequence; }
+
+        /**
+         * \brief Find the pose of a coordinate system
+         * \param cosID the (one-based) coordinate system ID
+         * \return the index of the pose, -1 if it is not tracked
+         */
+        int find( int cosID ) const;
+
+        /// Translation of a pose in millimeters
+        metaio::Vector3d getTranslation( int index ) const { return metaio::Vector3d(tx[index], ty[index], tz[index]); }
+
+        /// Rotation of a pose as quaternion
+        metaio::Vector4d getRotation( int index ) const { return metaio::Vector4d(qx[index], qy[index], qz[index], qw[index]); }
+
+        /// LLA coordinate of a pose
+        metaio::LLACoordinate getLLA( int index ) const { return metaio::LLACoordinate(latitude[index], longitude[index], altitude[index], accuracy[index]); }
+
+        /**
+         * \brief Column major 4x4 matrix of a pose (rotation and translation)
+         * \param index index of the pose
+         * \return 16 floats, as used by OpenGL
+         */
+        const float* getMatrix( int index ) const { return matrices + index * 16; }
+
+        // The arrays, valid for indices below getCount()
+        float tx[MAX_POSES], ty[MAX_POSES], tz[MAX_POSES];                  ///< translation in millimeters
+        float qx[MAX_POSES], qy[MAX_POSES], qz[MAX_POSES], qw[MAX_POSES];   ///< rotation quaternion
+        float quality[MAX_POSES];                                           ///< tracking quality
+        int cosID[MAX_POSES];                                               ///< coordinate system IDs
+        double latitude[MAX_POSES], longitude[MAX_POSES];                   ///< global position, if any
+        double altitude[MAX_POSES], accuracy[MAX_POSES];
+
+    private:
+        int count;
+        double timestamp;
+        unsigned long sequence;
+        float matrices[MAX_POSES * 16];
+    };
+}
+
+#endif
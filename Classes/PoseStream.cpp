@@ -0,0 +1,152 @@
+//
+//  PoseStream.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "PoseStream.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace unifeye
+{
+    namespace
+    {
+        const double PI = 3.14159265358979;
+
+        // frame times jitter, a frame that comes this much early still starts the next interval
+        const double INTERVAL_TOLERANCE = 0.002;
+
+        inline unsigned char* putWord( unsigned char* p, unsigned int word )
+        {
+            p[0] = (unsigned char)word;
+            p[1] = (unsigned char)(word >> 8);
+            p[2] = (unsigned char)(word >> 16);
+            p[3] = (unsigned char)(word >> 24);
+            return p + 4;
+        }
+
+        inline unsigned char* putFloat( unsigned char* p, float value )
+        {
+            unsigned int word;
+            memcpy(&word, &value, sizeof(word));
+            return putWord(p, word);
+        }
+
+        inline unsigned char* putDouble( unsigned char* p, double value )
+        {
+            unsigned int words[2];
+            memcpy(words, &value, sizeof(words));
+#if defined(__BIG_ENDIAN__)
+            p = putWord(p, words[1]);
+            return putWord(p, words[0]);
+#else
+            p = putWord(p, words[0]);
+            return putWord(p, words[1]);
+#endif
+        }
+    }
+
+    PoseStream::PoseStream() : publishNext(true), publishedTime(0), sequence(0)
+    {
+    }
+
+    void PoseStream::setParameters( const PoseStreamParameters& _parameters )
+    {
+        parameters = _parameters;
+        reset();
+    }
+
+    void PoseStream::reset()
+    {
+        publishNext = true;
+    }
+
+    bool PoseStream::hasChanged( const PoseSnapshot& poses ) const
+    {
+        if (poses.getCount() != published.getCount())
+            return true;
+
+        // against the last published frame, so a slow drift adds up
+        float translationEpsilon = parameters.translationEpsilon * parameters.translationEpsilon;
+        double rotationEpsilon = cos(parameters.rotationEpsilon * PI / 360.0);
+        for (int i = 0; i < poses.getCount(); i++)
+        {
+            int j = published.cosID[i] == poses.cosID[i] ? i : published.find(poses.cosID[i]);
+            if (j < 0)
+                return true;
+
+            float dx = poses.tx[i] - published.tx[j];
+            float dy = poses.ty[i] - published.ty[j];
+            float dz = poses.tz[i] - published.tz[j];
+            if (dx * dx + dy * dy + dz * dz > translationEpsilon)
+                return true;
+
+            // the cosine of half the angle between the rotations
+            double dot = fabs(poses.qx[i] * published.qx[j] + poses.qy[i] * published.qy[j] +
+                poses.qz[i] * published.qz[j] + poses.qw[i] * published.qw[j]);
+            if (dot < rotationEpsilon)
+                return true;
+
+            if (fabsf(poses.quality[i] - published.quality[j]) > parameters.qualityEpsilon)
+                return true;
+        }
+        return false;
+    }
+
+    bool PoseStream::update( const PoseSnapshot& poses, double time )
+    {
+        stats.updates++;
+        if (!publishNext)
+        {
+            if (time - publishedTime < parameters.interval - INTERVAL_TOLERANCE)
+                return false;
+            if (!hasChanged(poses))
+            {
+                stats.unchanged++;
+                return false;
+            }
+        }
+
+        published = poses;
+        publishedTime = time;
+        publishNext = false;
+        sequence++;
+        stats.published++;
+        encode(poses);
+        return true;
+    }
+
+    void PoseStream::encode( const PoseSnapshot& poses )
+    {
+        size_t poseSize = parameters.matrices ? 100 : 36;
+        data.resize(POSE_STREAM_HEADER_SIZE + poses.getCount() * poseSize);
+
+        unsigned char* p = &data[0];
+        p = putWord(p, POSE_STREAM_MAGIC);
+        p = putWord(p, sequence);
+        p = putDouble(p, poses.getTimestamp());
+        p = putWord(p, (unsigned int)poses.getCount());
+        p = putWord(p, parameters.matrices ? 1 : 0);
+
+        for (int i = 0; i < poses.getCount(); i++)
+        {
+            p = putWord(p, (unsigned int)poses.cosID[i]);
+            p = putFloat(p, poses.tx[i]);
+            p = putFloat(p, poses.ty[i]);
+            p = putFloat(p, poses.tz[i]);
+            p = putFloat(p, poses.qx[i]);
+            p = putFloat(p, poses.qy[i]);
+            p = putFloat(p, poses.qz[i]);
+            p = putFloat(p, poses.qw[i]);
+            p = putFloat(p, poses.quality[i]);
+            if (parameters.matrices)
+            {
+                const float* matrix = poses.getMatrix(i);
+                for (int k = 0; k < 16; k++)
+                    p = putFloat(p, matrix[k]);
+            }
+        }
+    }
+}
@@ -0,0 +1,119 @@
+//
+//  PoseStream.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Publishes the tracked poses to JavaScript without polling. The poses of
+//  a frame are written into a binary buffer, at most once per interval and
+//  only when a pose moved, turned or changed its quality by more than an
+//  epsilon since the last published frame, or a coordinate system was
+//  found or lost. Everything in between is coalesced into the next frame.
+//
+//  The buffer is little endian:
+//
+//      magic       "UPS1" (0x31535055)         uint32
+//      sequence    incremented per frame       uint32
+//      timestamp   of the frame in seconds     float64
+//      count       poses                       uint32
+//      flags       1 if matrices follow        uint32
+//      count times
+//          cosID                               int32
+//          translation x, y, z in mm           float32
+//          rotation x, y, z, w (quaternion)    float32
+//          quality                             float32
+//          matrix, column major, if flagged    16 float32
+//
+#ifndef __UNIFEYE_POSESTREAM_H__
+#define __UNIFEYE_POSESTREAM_H__
+
+#include <stddef.h>
+#include <vector>
+
+#include "PoseSnapshot.h"
+
+namespace unifeye
+{
+    /// First word of a frame of the pose stream
+    const unsigned int POSE_STREAM_MAGIC = 0x31535055;
+
+    /// Bytes before the first pose
+    const size_t POSE_STREAM_HEADER_SIZE = 24;
+
+    /**
+     * \brief Parameters of a PoseStream
+     */
+    struct PoseStreamParameters
+    {
+        float interval;                 ///< seconds at least between two frames
+        float translationEpsilon;       ///< mm a pose has to move to be published again
+        float rotationEpsilon;          ///< degrees a pose has to turn to be published again
+        float qualityEpsilon;           ///< change of the quality to be published again
+        bool matrices;                  ///< add the matrix of every pose
+
+        PoseStreamParameters() : interval(0.1f), translationEpsilon(1.0f), rotationEpsilon(0.5f),
+            qualityEpsilon(0.05f), matrices(false) {};
+    };
+
+    /**
+     * \brief Counters of a PoseStream
+     */
+    struct PoseStreamStats
+    {
+        unsigned long updates;          ///< frames passed to update()
+        unsigned long published;        ///< frames published
+        unsigned long unchanged;        ///< frames after the interval that were not published, nothing changed
+
+        PoseStreamStats() : updates(0), published(0), unchanged(0) {};
+    };
+
+    /**
+     * \brief Decides which frames of poses are published and encodes them
+     *
+     * For the render loop only; the encoded frame stays valid until the
+     * next update() that publishes.
+     */
+    class PoseStream
+    {
+    public:
+        PoseStream();
+
+        /// Set the parameters, the next update() publishes
+        void setParameters( const PoseStreamParameters& parameters );
+        const PoseStreamParameters& getParameters() const { return parameters; }
+
+        /// Publish the next update() whatever it contains
+        void reset();
+
+        /**
+         * \brief Pass the poses of a frame
+         * \param poses the poses
+         * \param time the frame time in seconds
+         * \return true if they were published, getData() has them then
+         */
+        bool update( const PoseSnapshot& poses, double time );
+
+        /// The last published frame
+        const unsigned char* getData() const { return data.empty() ? NULL : &data[0]; }
+        size_t getSize() const { return data.size(); }
+
+        /// Sequence number of the last published frame, 0 before the first
+        unsigned int getSequence() const { return sequence; }
+
+        PoseStreamStats getStats() const { return stats; }
+
+    private:
+        bool hasChanged( const PoseSnapshot& poses ) const;
+        void encode( const PoseSnapshot& poses );
+
+        PoseStreamParameters parameters;
+        PoseSnapshot published;         // the poses of the last published frame
+        bool publishNext;
+        double publishedTime;
+        unsigned int sequence;
+        std::vector<unsigned char> data;
+        PoseStreamStats stats;
+    };
+}
+
+#endif
@@ -0,0 +1,166 @@
+//
+//  SensorPipeline.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "SensorPipeline.h"
+#include "PerfTrace.h"
+
+#include <UnifeyeSDKMobile/AS_IUnifeyeMobile.h>
+
+namespace unifeye
+{
+    namespace
+    {
+        // an update due in less than this is not delayed to the next frame
+        const double APPLY_TOLERANCE = 0.002;
+
+        // the mean covers at most this much when the last update is long ago
+        const double MAX_WINDOW = 0.1;
+    }
+
+    void UnifeyeSensorTarget::setAccelerometer( const metaio::Vector3d& values, double timestamp )
+    {
+        unifeye->setSensorAccelerometer(values);
+    }
+
+    void UnifeyeSensorTarget::setCompassAngle( float angle, double timestamp )
+    {
+        unifeye->setSensorCompassAngle(angle);
+    }
+
+    void UnifeyeSensorTarget::setLLA( const metaio::LLACoordinate& position, double timestamp )
+    {
+        unifeye->setSensorLLA(position);
+    }
+
+    SensorPipeline::SensorPipeline( ISensorTarget* _target, int ringCapacity ) :
+        target(_target), applyRate(0), lastApply(-1.0), nextApply(-1.0)
+    {
+        resamplers[SENSOR_ACCELEROMETER] = SensorResampler(SENSOR_RESAMPLE_MEAN, 3);
+        resamplers[SENSOR_COMPASS] = SensorResampler(SENSOR_RESAMPLE_ANGLE, 1);
+        resamplers[SENSOR_LLA] = SensorResampler(SENSOR_RESAMPLE_LATEST, 4);
+        for (int s = 0; s < SENSOR_COUNT; s++)
+        {
+            rings[s] = new SensorRing(ringCapacity);
+            pending[s] = 0;
+            applied[s] = 0;
+            coalesced[s] = 0;
+            latency[s] = 0;
+        }
+    }
+
+    SensorPipeline::~SensorPipeline()
+    {
+        for (int s = 0; s < SENSOR_COUNT; s++)
+            delete rings[s];
+    }
+
+    bool SensorPipeline::pushAccelerometer( const metaio::Vector3d& values, double timestamp )
+    {
+        SensorSample sample;
+        sample.timestamp = timestamp;
+        sample.values[0] = values.x;
+        sample.values[1] = values.y;
+        sample.values[2] = values.z;
+        return rings[SENSOR_ACCELEROMETER]->push(sample);
+    }
+
+    bool SensorPipeline::pushCompassAngle( float angle, double timestamp )
+    {
+        // the heading could not be determined
+        if (angle < 0)
+            return false;
+
+        SensorSample sample;
+        sample.timestamp = timestamp;
+        sample.values[0] = angle;
+        return rings[SENSOR_COMPASS]->push(sample);
+    }
+
+    bool SensorPipeline::pushLLA( const metaio::LLACoordinate& position, double timestamp )
+    {
+        SensorSample sample;
+        sample.timestamp = timestamp;
+        sample.values[0] = position.latitude;
+        sample.values[1] = position.longitude;
+        sample.values[2] = position.altitude;
+        sample.values[3] = position.accuracy;
+        return rings[SENSOR_LLA]->push(sample);
+    }
+
+    void SensorPipeline::setApplyRate( double rate )
+    {
+        applyRate = rate > 0 ? rate : 0;
+        nextApply = -1.0;
+    }
+
+    int SensorPipeline::apply( double time )
+    {
+        UNIFEYE_PERF_SCOPE("sensors");
+
+        // the samples leave the rings on every frame, so they do not fill up between updates
+        SensorSample sample;
+        for (int s = 0; s < SENSOR_COUNT; s++)
+        {
+            while (rings[s]->pop(sample))
+            {
+                if (resamplers[s].add(sample))
+                    pending[s]++;
+            }
+        }
+
+        if (applyRate > 0)
+        {
+            // updates keep to a fixed schedule, so a late frame does not push all later ones back
+            double interval = 1.0 / applyRate;
+            if (nextApply >= 0 && time < nextApply - APPLY_TOLERANCE)
+                return 0;
+            nextApply = nextApply >= 0 && time - nextApply < interval ? nextApply + interval : time + interval;
+        }
+
+        double window = lastApply >= 0 && time - lastApply < MAX_WINDOW ? time - lastApply : MAX_WINDOW;
+        lastApply = time;
+
+        int count = 0;
+        for (int s = 0; s < SENSOR_COUNT; s++)
+        {
+            if (pending[s] == 0 || !resamplers[s].resample(time, window, sample))
+                continue;
+
+            switch (s)
+            {
+                case SENSOR_ACCELEROMETER:
+                    target->setAccelerometer(metaio::Vector3d((float)sample.values[0], (float)sample.values[1],
+                        (float)sample.values[2]), sample.timestamp);
+                    break;
+                case SENSOR_COMPASS:
+                    target->setCompassAngle((float)sample.values[0], sample.timestamp);
+                    break;
+                case SENSOR_LLA:
+                    target->setLLA(metaio::LLACoordinate(sample.values[0], sample.values[1], sample.values[2],
+                        sample.values[3]), sample.timestamp);
+                    break;
+            }
+
+            latency[s] = time - resamplers[s].getLatest().timestamp;
+            coalesced[s] += pending[s];
+            pending[s] = 0;
+            applied[s]++;
+            count++;
+        }
+        return count;
+    }
+
+    SensorStats SensorPipeline::getStats( SENSOR sensor ) const
+    {
+        SensorStats stats;
+        stats.received = rings[sensor]->getPushed();
+        stats.dropped = rings[sensor]->getDropped();
+        stats.applied = applied[sensor];
+        stats.coalesced = coalesced[sensor];
+        stats.latency = latency[sensor];
+        return stats;
+    }
+}
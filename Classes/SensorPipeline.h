@@ -0,0 +1,154 @@
+//
+//  SensorPipeline.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Collects accelerometer, compass and GPS samples from the threads they
+//  arrive on and applies them to the SDK from the render loop, at most at
+//  the tracking rate and one value per sensor: the accelerometer averaged
+//  over the time since the last update, the compass interpolated to the
+//  frame time and the last GPS fix.
+//
+#ifndef __UNIFEYE_SENSORPIPELINE_H__
+#define __UNIFEYE_SENSORPIPELINE_H__
+
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+#include "SensorRing.h"
+
+namespace metaio
+{
+    class IUnifeyeMobile;   // forward declaration
+}
+
+namespace unifeye
+{
+    /// The sensors of a SensorPipeline
+    enum SENSOR
+    {
+        SENSOR_ACCELEROMETER,
+        SENSOR_COMPASS,
+        SENSOR_LLA,
+        SENSOR_COUNT
+    };
+
+    /**
+     * \brief Receives the resampled sensor values
+     */
+    class ISensorTarget
+    {
+    public:
+        virtual ~ISensorTarget() {};
+
+        virtual void setAccelerometer( const metaio::Vector3d& values, double timestamp ) = 0;
+        virtual void setCompassAngle( float angle, double timestamp ) = 0;
+        virtual void setLLA( const metaio::LLACoordinate& position, double timestamp ) = 0;
+    };
+
+    /**
+     * \brief Applies the sensor values to the SDK
+     */
+    class UnifeyeSensorTarget : public ISensorTarget
+    {
+    public:
+        UnifeyeSensorTarget( metaio::IUnifeyeMobile* _unifeye ) : unifeye(_unifeye) {};
+
+        virtual void setAccelerometer( const metaio::Vector3d& values, double timestamp );
+        virtual void setCompassAngle( float angle, double timestamp );
+        virtual void setLLA( const metaio::LLACoordinate& position, double timestamp );
+
+    private:
+        metaio::IUnifeyeMobile* unifeye;
+    };
+
+    /**
+     * \brief Counters of one sensor of a SensorPipeline
+     */
+    struct SensorStats
+    {
+        unsigned long received;         ///< samples pushed
+        unsigned long dropped;          ///< samples lost because the ring was full
+        unsigned long applied;          ///< values given to the target
+        unsigned long coalesced;        ///< samples that went into the applied values
+        double latency;                 ///< age of the newest sample at the last update, in seconds
+
+        SensorStats() : received(0), dropped(0), applied(0), coalesced(0), latency(0) {};
+    };
+
+    /**
+     * \brief Hands sensor samples from their threads to the render loop
+     *
+     * Each sensor may be pushed from one thread at a time, apply() is
+     * called from the render loop. Neither side blocks the other.
+     */
+    class SensorPipeline
+    {
+    public:
+        /// Default size of the ring of each sensor, a second at 200 Hz
+        enum { DEFAULT_RING_CAPACITY = 256 };
+
+        /**
+         * \brief Constructor
+         * \param target receives the values, not owned
+         * \param ringCapacity samples each sensor can queue between two apply() calls
+         */
+        SensorPipeline( ISensorTarget* target, int ringCapacity = DEFAULT_RING_CAPACITY );
+
+        /// Destructor
+        ~SensorPipeline();
+
+        /**
+         * \brief Queue an accelerometer sample
+         * \param values acceleration in g
+         * \param timestamp seconds, on the clock of the frame times passed to apply()
+         * \return false if the sample was dropped
+         */
+        bool pushAccelerometer( const metaio::Vector3d& values, double timestamp );
+
+        /// Queue a compass heading in degrees, negative values are ignored
+        bool pushCompassAngle( float angle, double timestamp );
+
+        /// Queue a GPS fix
+        bool pushLLA( const metaio::LLACoordinate& position, double timestamp );
+
+        /**
+         * \brief Limit how often the target is updated
+         * \param rate updates per second, 0 to update on every apply()
+         */
+        void setApplyRate( double rate );
+
+        double getApplyRate() const { return applyRate; }
+
+        /**
+         * \brief Take the queued samples and update the target if it is due
+         *
+         * A sensor without new samples since the last update is not applied
+         * again.
+         *
+         * \param time the frame time in seconds
+         * \return the number of values applied
+         */
+        int apply( double time );
+
+        /// Counters of a sensor, call from the thread that calls apply()
+        SensorStats getStats( SENSOR sensor ) const;
+
+    private:
+        SensorPipeline( const SensorPipeline& );
+        SensorPipeline& operator=( const SensorPipeline& );
+
+        ISensorTarget* target;
+        SensorRing* rings[SENSOR_COUNT];
+        SensorResampler resamplers[SENSOR_COUNT];
+        int pending[SENSOR_COUNT];          // samples taken since the last update
+        unsigned long applied[SENSOR_COUNT];
+        unsigned long coalesced[SENSOR_COUNT];
+        double latency[SENSOR_COUNT];
+        double applyRate;
+        double lastApply;                   // negative before the first update
+        double nextApply;                   // when the next update is due, negative before the first one
+    };
+}
+
+#endif
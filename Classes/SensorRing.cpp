@@ -0,0 +1,154 @@
+//
+//  SensorRing.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "SensorRing.h"
+#include "Threading.h"
+
+#include <math.h>
+
+namespace unifeye
+{
+    namespace
+    {
+        // difference of two angles in degrees, along the shorter way round
+        inline double angleDifference( double from, double to )
+        {
+            double difference = fmod(to - from, 360.0);
+            if (difference > 180.0)
+                difference -= 360.0;
+            else if (difference < -180.0)
+                difference += 360.0;
+            return difference;
+        }
+
+        inline double wrapAngle( double angle )
+        {
+            angle = fmod(angle, 360.0);
+            return angle < 0 ? angle + 360.0 : angle;
+        }
+    }
+
+    SensorRing::SensorRing( int capacity ) : head(0), tail(0), dropped(0)
+    {
+        unsigned int size = 1;
+        while (size < (unsigned int)capacity)
+            size <<= 1;
+        samples.resize(size);
+        mask = size - 1;
+    }
+
+    bool SensorRing::push( const SensorSample& sample )
+    {
+        unsigned int written = head;
+        if (written - atomicLoad(&tail) >= samples.size())
+        {
+            atomicStore(&dropped, dropped + 1);
+            return false;
+        }
+        samples[written & mask] = sample;
+        atomicStore(&head, written + 1);
+        return true;
+    }
+
+    bool SensorRing::pop( SensorSample& sample )
+    {
+        unsigned int read = tail;
+        if (read == atomicLoad(&head))
+            return false;
+        sample = samples[read & mask];
+        atomicStore(&tail, read + 1);
+        return true;
+    }
+
+    unsigned long SensorRing::getPushed() const
+    {
+        return atomicLoad(const_cast<volatile unsigned int*>(&head));
+    }
+
+    unsigned long SensorRing::getDropped() const
+    {
+        return atomicLoad(const_cast<volatile unsigned int*>(&dropped));
+    }
+
+    SensorResampler::SensorResampler( SENSOR_RESAMPLE _mode, int _valueCount ) :
+        mode(_mode), valueCount(_valueCount), first(0), count(0)
+    {
+        if (valueCount < 1 || valueCount > SensorSample::MAX_VALUES)
+            valueCount = SensorSample::MAX_VALUES;
+    }
+
+    bool SensorResampler::add( const SensorSample& sample )
+    {
+        if (count > 0 && sample.timestamp < getLatest().timestamp)
+            return false;
+
+        if (count == HISTORY_SIZE)
+        {
+            first = (first + 1) % HISTORY_SIZE;
+            count--;
+        }
+        history[(first + count) % HISTORY_SIZE] = sample;
+        count++;
+        return true;
+    }
+
+    bool SensorResampler::resample( double time, double window, SensorSample& result ) const
+    {
+        if (count == 0)
+            return false;
+
+        // the last sample at or before the time, -1 if all are after it
+        int before = count - 1;
+        while (before >= 0 && get(before).timestamp > time)
+            before--;
+
+        if (mode == SENSOR_RESAMPLE_LATEST)
+        {
+            result = get(before >= 0 ? before : 0);
+            return true;
+        }
+
+        result = SensorSample();
+        result.timestamp = time < get(0).timestamp ? get(0).timestamp : time > getLatest().timestamp ? getLatest().timestamp : time;
+
+        if (mode == SENSOR_RESAMPLE_MEAN && window > 0)
+        {
+            int samples = 0;
+            for (int i = before; i >= 0 && get(i).timestamp > time - window; i--, samples++)
+            {
+                for (int k = 0; k < valueCount; k++)
+                    result.values[k] += get(i).values[k];
+            }
+            if (samples > 0)
+            {
+                for (int k = 0; k < valueCount; k++)
+                    result.values[k] /= samples;
+                return true;
+            }
+            // no sample in the window, interpolate instead
+        }
+
+        if (before < 0 || before == count - 1)
+        {
+            const SensorSample& nearest = get(before < 0 ? 0 : before);
+            for (int k = 0; k < valueCount; k++)
+                result.values[k] = nearest.values[k];
+            return true;
+        }
+
+        const SensorSample& a = get(before);
+        const SensorSample& b = get(before + 1);
+        double t = (time - a.timestamp) / (b.timestamp - a.timestamp);
+        for (int k = 0; k < valueCount; k++)
+        {
+            if (mode == SENSOR_RESAMPLE_ANGLE)
+                result.values[k] = wrapAngle(a.values[k] + t * angleDifference(a.values[k], b.values[k]));
+            else
+                result.values[k] = a.values[k] + t * (b.values[k] - a.values[k]);
+        }
+        return true;
+    }
+}
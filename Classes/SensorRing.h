@@ -0,0 +1,144 @@
+//
+//  SensorRing.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Timestamped sensor samples on their way from the thread that receives
+//  them to the render loop: a lock-free ring for the hand over and a
+//  resampler that turns the samples of a frame into one value at the time
+//  of the frame.
+//
+#ifndef __UNIFEYE_SENSORRING_H__
+#define __UNIFEYE_SENSORRING_H__
+
+#include <vector>
+
+namespace unifeye
+{
+    /**
+     * \brief One reading of a sensor
+     */
+    struct SensorSample
+    {
+        enum { MAX_VALUES = 4 };
+
+        double timestamp;               ///< seconds, on the clock of the frames
+        double values[MAX_VALUES];      ///< as many as the sensor has, the rest is 0
+
+        SensorSample() : timestamp(0)
+        {
+            for (int i = 0; i < MAX_VALUES; i++)
+                values[i] = 0;
+        }
+    };
+
+    /**
+     * \brief Single producer, single consumer ring of samples
+     *
+     * One thread pushes, another one pops, neither blocks. When the ring is
+     * full the new sample is dropped and counted; the consumer still gets
+     * the older ones in order.
+     */
+    class SensorRing
+    {
+    public:
+        /**
+         * \brief Constructor
+         * \param capacity number of samples, rounded up to a power of two
+         */
+        explicit SensorRing( int capacity );
+
+        /**
+         * \brief Add a sample, producer thread only
+         * \return false if the ring was full and the sample was dropped
+         */
+        bool push( const SensorSample& sample );
+
+        /**
+         * \brief Take the oldest sample, consumer thread only
+         * \return false if the ring is empty
+         */
+        bool pop( SensorSample& sample );
+
+        int getCapacity() const { return (int)samples.size(); }
+
+        /// Samples pushed successfully, from any thread
+        unsigned long getPushed() const;
+
+        /// Samples dropped because the ring was full, from any thread
+        unsigned long getDropped() const;
+
+    private:
+        SensorRing( const SensorRing& );
+        SensorRing& operator=( const SensorRing& );
+
+        std::vector<SensorSample> samples;
+        unsigned int mask;
+        volatile unsigned int head;     // samples ever pushed, written by the producer
+        volatile unsigned int tail;     // samples ever popped, written by the consumer
+        volatile unsigned int dropped;  // written by the producer
+    };
+
+    /// How SensorResampler computes the value at a time
+    enum SENSOR_RESAMPLE
+    {
+        SENSOR_RESAMPLE_LATEST,     ///< the last sample at or before the time, for GPS fixes
+        SENSOR_RESAMPLE_LINEAR,     ///< interpolated between the samples around the time
+        SENSOR_RESAMPLE_ANGLE,      ///< like LINEAR, for a single angle in degrees that wraps at 360
+        SENSOR_RESAMPLE_MEAN        ///< mean of the samples in the window before the time, to coalesce noise
+    };
+
+    /**
+     * \brief Value of a sensor at a given time from its recent samples
+     *
+     * Times outside the samples it has are clamped to the first or last
+     * one; nothing is extrapolated.
+     */
+    class SensorResampler
+    {
+    public:
+        /// Samples kept, more than a frame's worth at 200 Hz
+        enum { HISTORY_SIZE = 64 };
+
+        /**
+         * \brief Constructor
+         * \param mode how values are computed
+         * \param valueCount number of values of the sensor
+         */
+        explicit SensorResampler( SENSOR_RESAMPLE _mode = SENSOR_RESAMPLE_LINEAR, int _valueCount = 3 );
+
+        /**
+         * \brief Add the next sample
+         * \return false if it is older than the last one and was ignored
+         */
+        bool add( const SensorSample& sample );
+
+        /**
+         * \brief Compute the value at a time
+         * \param time the time in seconds
+         * \param window for SENSOR_RESAMPLE_MEAN, the samples after time - window are averaged
+         * \param[out] result the value, its timestamp is the clamped time
+         * \return false if there are no samples
+         */
+        bool resample( double time, double window, SensorSample& result ) const;
+
+        void clear() { count = 0; }
+
+        int getCount() const { return count; }
+
+        /// The newest sample, only valid if getCount() > 0
+        const SensorSample& getLatest() const { return history[(first + count - 1) % HISTORY_SIZE]; }
+
+    private:
+        const SensorSample& get( int i ) const { return history[(first + i) % HISTORY_SIZE]; }
+
+        SENSOR_RESAMPLE mode;
+        int valueCount;
+        SensorSample history[HISTORY_SIZE];
+        int first;
+        int count;
+    };
+}
+
+#endif
@@ -0,0 +1,164 @@
+//
+//  SessionFormat.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  The differences are zigzag coded (0, -1, 1, -2, ... become 0, 1, 2, 3,
+//  ...) and split into runs, each introduced by a control byte c:
+//
+//      c < 0x80            c + 1 zeros
+//      0x80 <= c < 0xc0    c - 0x7f bytes follow, each with two values below 16
+//      c >= 0xc0           c - 0xbf literal values follow
+//
+#include "SessionFormat.h"
+#include "ImageFormat.h"
+
+namespace unifeye
+{
+    namespace
+    {
+        const int MAX_ZERO_RUN = 128;
+        const int MAX_PAIR_RUN = 64;
+        const int MAX_LITERAL_RUN = 64;
+
+        // zero runs shorter than this are cheaper as part of a pair run
+        const int MIN_ZERO_RUN = 4;
+
+        inline unsigned char zigzag( unsigned char difference )
+        {
+            signed char value = (signed char)difference;
+            return (unsigned char)((value << 1) ^ (value >> 7));
+        }
+
+        inline unsigned char unzigzag( unsigned char value )
+        {
+            return (unsigned char)((value >> 1) ^ -(value & 1));
+        }
+
+        size_t countZeros( const unsigned char* values, size_t begin, size_t end, size_t limit )
+        {
+            size_t i = begin;
+            while (i < end && i - begin < limit && values[i] == 0)
+                i++;
+            return i - begin;
+        }
+    }
+
+    int getSessionPixelSize( uint32_t colorFormat )
+    {
+        metaio::common::ECOLOR_FORMAT format = (metaio::common::ECOLOR_FORMAT)colorFormat;
+        if (format == metaio::common::ECF_V8Y8U8Y8 || format == metaio::common::ECF_V8A8U8Y8)
+            return 4;
+        int bytes = getBytesPerPixel(format);
+        return bytes > 0 ? bytes : 1;
+    }
+
+    void encodeSessionFrame( const unsigned char* pixels, const unsigned char* previous, size_t size, int pixelSize,
+        std::vector<unsigned char>& encoded, std::vector<unsigned char>& scratch )
+    {
+        // the zigzag coded differences first, then the runs
+        std::vector<unsigned char>& values = scratch;
+        if (values.size() < size)
+            values.resize(size);
+        if (previous)
+        {
+            for (size_t i = 0; i < size; i++)
+                values[i] = zigzag((unsigned char)(pixels[i] - previous[i]));
+        }
+        else
+        {
+            size_t step = pixelSize > 0 ? (size_t)pixelSize : 1;
+            for (size_t i = 0; i < size && i < step; i++)
+                values[i] = zigzag(pixels[i]);
+            for (size_t i = step; i < size; i++)
+                values[i] = zigzag((unsigned char)(pixels[i] - pixels[i - step]));
+        }
+
+        const unsigned char* v = size > 0 ? &values[0] : 0;
+        size_t i = 0;
+        while (i < size)
+        {
+            size_t zeros = countZeros(v, i, size, MAX_ZERO_RUN);
+            if (zeros >= (size_t)MIN_ZERO_RUN || zeros == size - i)
+            {
+                encoded.push_back((unsigned char)(zeros - 1));
+                i += zeros;
+                continue;
+            }
+
+            // pairs of small values, up to the next long zero run
+            size_t pairs = 0;
+            while (pairs < (size_t)MAX_PAIR_RUN && i + pairs * 2 + 1 < size)
+            {
+                size_t at = i + pairs * 2;
+                if (v[at] >= 16 || v[at + 1] >= 16 || countZeros(v, at, size, MIN_ZERO_RUN) == (size_t)MIN_ZERO_RUN)
+                    break;
+                pairs++;
+            }
+            if (pairs > 0)
+            {
+                encoded.push_back((unsigned char)(0x7f + pairs));
+                for (size_t k = 0; k < pairs; k++)
+                    encoded.push_back((unsigned char)(v[i + k * 2] | (v[i + k * 2 + 1] << 4)));
+                i += pairs * 2;
+                continue;
+            }
+
+            // literals, up to where a pair or a zero run would start
+            size_t literals = 1;
+            while (literals < (size_t)MAX_LITERAL_RUN && i + literals < size)
+            {
+                size_t at = i + literals;
+                if (v[at] == 0 && countZeros(v, at, size, MIN_ZERO_RUN) == (size_t)MIN_ZERO_RUN)
+                    break;
+                if (at + 1 < size && v[at] < 16 && v[at + 1] < 16)
+                    break;
+                literals++;
+            }
+            encoded.push_back((unsigned char)(0xbf + literals));
+            encoded.insert(encoded.end(), v + i, v + i + literals);
+            i += literals;
+        }
+    }
+
+    bool decodeSessionFrame( const unsigned char* encoded, size_t encodedSize, const unsigned char* previous,
+        size_t size, int pixelSize, unsigned char* pixels )
+    {
+        size_t step = pixelSize > 0 ? (size_t)pixelSize : 1;
+        size_t in = 0, out = 0;
+        while (in < encodedSize)
+        {
+            unsigned char control = encoded[in++];
+            size_t count;
+            if (control < 0x80)
+                count = control + 1;
+            else if (control < 0xc0)
+                count = (control - 0x7f) * 2;
+            else
+                count = control - 0xbf;
+
+            if (out + count > size)
+                return false;
+            if (control >= 0x80 && in + (control < 0xc0 ? count / 2 : count) > encodedSize)
+                return false;
+
+            for (size_t k = 0; k < count; k++, out++)
+            {
+                unsigned char value;
+                if (control < 0x80)
+                    value = 0;
+                else if (control < 0xc0)
+                    value = (k & 1) ? (encoded[in + k / 2] >> 4) : (encoded[in + k / 2] & 15);
+                else
+                    value = encoded[in + k];
+
+                unsigned char prediction = previous ? previous[out] : (out >= step ? pixels[out - step] : 0);
+                pixels[out] = (unsigned char)(prediction + unzigzag(value));
+            }
+            if (control >= 0x80)
+                in += control < 0xc0 ? count / 2 : count;
+        }
+        return out == size;
+    }
+}
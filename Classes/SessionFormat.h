@@ -0,0 +1,181 @@
+//
+//  SessionFormat.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Layout of the session files written by SessionRecorder and read by
+//  SessionPlayer. Everything is little endian (ARM and x86). A file is a
+//  sequence of records in the order they were recorded:
+//
+//      SessionFileHeader
+//      SessionRecordHeader + payload       [any number]
+//      SessionRecordHeader + index         (SESSION_RECORD_INDEX)
+//      SessionFileFooter
+//
+//  Payloads by record type:
+//
+//      SESSION_RECORD_FRAME            SessionFrame + encoded pixels
+//      SESSION_RECORD_LLA              double latitude, longitude, altitude, accuracy
+//      SESSION_RECORD_ACCELEROMETER    float x, y, z
+//      SESSION_RECORD_COMPASS          float heading in degrees
+//      SESSION_RECORD_POSES            uint32 count + SessionPose [count]
+//      SESSION_RECORD_INDEX            SessionIndexEntry [one per key frame]
+//
+//  Frames are stored as byte differences to a prediction, see
+//  encodeSessionFrame. Every key frame is preceded by the last sensor
+//  values again, flagged SESSION_RECORD_STATE, so playback can start at
+//  any key frame. A file without index and footer (the app was killed) is
+//  still readable, the player scans it instead.
+//
+#ifndef __UNIFEYE_SESSIONFORMAT_H__
+#define __UNIFEYE_SESSIONFORMAT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace unifeye
+{
+    /// "USES" read as little endian 32 bit value
+    const uint32_t SESSION_FILE_MAGIC = 0x53455355;
+
+    /// "USIX", the last four bytes of a complete file
+    const uint32_t SESSION_FOOTER_MAGIC = 0x58495355;
+
+    /// Incremented on every incompatible change of the layout
+    const uint32_t SESSION_FILE_VERSION = 1;
+
+    /// Type of a record
+    enum SESSION_RECORD
+    {
+        SESSION_RECORD_FRAME = 1,
+        SESSION_RECORD_LLA = 2,
+        SESSION_RECORD_ACCELEROMETER = 3,
+        SESSION_RECORD_COMPASS = 4,
+        SESSION_RECORD_POSES = 5,
+        SESSION_RECORD_INDEX = 6
+    };
+
+    /// Flags of a record
+    enum SESSION_RECORD_FLAG
+    {
+        SESSION_RECORD_STATE = 1,       ///< a sensor value repeated before a key frame
+        SESSION_RECORD_KEY_FRAME = 2    ///< a frame that does not depend on the previous one
+    };
+
+    /**
+     * \brief Start of every session file
+     */
+    struct SessionFileHeader
+    {
+        uint32_t magic;                 ///< SESSION_FILE_MAGIC
+        uint32_t version;               ///< SESSION_FILE_VERSION
+        uint32_t keyFrameInterval;      ///< frames from one key frame to the next
+        uint32_t reserved;
+    };
+
+    /**
+     * \brief Start of every record
+     */
+    struct SessionRecordHeader
+    {
+        uint16_t type;                  ///< SESSION_RECORD
+        uint16_t flags;                 ///< SESSION_RECORD_FLAGs
+        uint32_t size;                  ///< bytes of payload that follow
+        double timestamp;               ///< seconds since the first record
+    };
+
+    /**
+     * \brief Camera frame, followed by the encoded pixels
+     */
+    struct SessionFrame
+    {
+        int32_t width;
+        int32_t height;
+        uint32_t colorFormat;           ///< metaio::common::ECOLOR_FORMAT
+        uint32_t originIsUpperLeft;     ///< 1 or 0
+    };
+
+    /**
+     * \brief One tracked coordinate system
+     */
+    struct SessionPose
+    {
+        int32_t cosID;
+        float translation[3];           ///< millimeters
+        float rotation[4];              ///< quaternion x, y, z, w
+        float quality;
+    };
+
+    /**
+     * \brief Position of a key frame
+     */
+    struct SessionIndexEntry
+    {
+        double timestamp;               ///< of the key frame
+        uint64_t offset;                ///< of the first record to read, from the start of the file
+    };
+
+    /**
+     * \brief End of a complete session file
+     */
+    struct SessionFileFooter
+    {
+        uint64_t indexOffset;           ///< of the index record header
+        uint32_t entryCount;
+        uint32_t magic;                 ///< SESSION_FOOTER_MAGIC
+    };
+
+    // the layout must not depend on the compiler or the architecture
+    typedef char SessionFileHeaderSizeCheck[sizeof(SessionFileHeader) == 16 ? 1 : -1];
+    typedef char SessionRecordHeaderSizeCheck[sizeof(SessionRecordHeader) == 16 ? 1 : -1];
+    typedef char SessionFrameSizeCheck[sizeof(SessionFrame) == 16 ? 1 : -1];
+    typedef char SessionPoseSizeCheck[sizeof(SessionPose) == 36 ? 1 : -1];
+    typedef char SessionIndexEntrySizeCheck[sizeof(SessionIndexEntry) == 16 ? 1 : -1];
+    typedef char SessionFileFooterSizeCheck[sizeof(SessionFileFooter) == 16 ? 1 : -1];
+
+    /**
+     * \brief Distance of the byte that predicts a byte of a key frame
+     *
+     * One pixel for packed formats, one byte for YUV420SP and a macro pixel
+     * for the 4:2:2 formats, so Y is predicted by Y and U by U.
+     *
+     * \param colorFormat metaio::common::ECOLOR_FORMAT of the frame
+     * \return the distance in bytes
+     */
+    int getSessionPixelSize( uint32_t colorFormat );
+
+    /**
+     * \brief Compress the pixels of a frame
+     *
+     * Every byte is predicted by the same byte of the previous frame, or for
+     * key frames by the byte one pixel to the left. The differences are
+     * stored as runs of zeros, pairs of small values in one byte each, or
+     * literals, which suits a mostly still camera with some sensor noise.
+     *
+     * \param pixels the frame
+     * \param previous the previous frame of the same size, NULL for a key frame
+     * \param size bytes in the frame
+     * \param pixelSize distance of the left neighbour in bytes, for key frames
+     * \param[out] encoded the compressed bytes are appended
+     * \param scratch holds the differences, pass the same one for every frame to allocate it once
+     */
+    void encodeSessionFrame( const unsigned char* pixels, const unsigned char* previous, size_t size, int pixelSize,
+        std::vector<unsigned char>& encoded, std::vector<unsigned char>& scratch );
+
+    /**
+     * \brief Decompress the pixels of a frame
+     * \param encoded the compressed bytes
+     * \param encodedSize number of compressed bytes
+     * \param previous the previous frame, NULL for a key frame
+     * \param size bytes in the frame
+     * \param pixelSize as passed to encodeSessionFrame
+     * \param[out] pixels the frame, may be previous
+     * \return false if the data is corrupt
+     */
+    bool decodeSessionFrame( const unsigned char* encoded, size_t encodedSize, const unsigned char* previous,
+        size_t size, int pixelSize, unsigned char* pixels );
+}
+
+#endif
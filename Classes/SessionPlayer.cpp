@@ -0,0 +1,478 @@
+//
+//  SessionPlayer.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "SessionPlayer.h"
+#include "ColorConvert.h"
+#include "ImageFormat.h"
+#include "PerfTrace.h"
+
+#include <string.h>
+#include <sys/types.h>
+
+#include <UnifeyeSDKMobile/AS_IUnifeyeMobile.h>
+
+namespace unifeye
+{
+    namespace
+    {
+        // zlib stored blocks hold at most this many bytes
+        const size_t MAX_STORED_BLOCK = 65535;
+
+        void appendBigEndian( std::vector<unsigned char>& data, unsigned int value )
+        {
+            data.push_back((unsigned char)(value >> 24));
+            data.push_back((unsigned char)(value >> 16));
+            data.push_back((unsigned char)(value >> 8));
+            data.push_back((unsigned char)value);
+        }
+
+        // a chunk whose data was already appended after its length and type
+        void finishChunk( std::vector<unsigned char>& png, size_t chunkStart, const unsigned int* crcTable )
+        {
+            unsigned int length = (unsigned int)(png.size() - chunkStart - 8);
+            for (int i = 0; i < 4; i++)
+                png[chunkStart + i] = (unsigned char)(length >> (24 - 8 * i));
+
+            unsigned int crc = 0xffffffffU;
+            for (size_t i = chunkStart + 4; i < png.size(); i++)
+                crc = crcTable[(crc ^ png[i]) & 0xff] ^ (crc >> 8);
+            appendBigEndian(png, crc ^ 0xffffffffU);
+        }
+
+        size_t startChunk( std::vector<unsigned char>& png, const char* type )
+        {
+            size_t chunkStart = png.size();
+            appendBigEndian(png, 0);
+            png.insert(png.end(), type, type + 4);
+            return chunkStart;
+        }
+
+        // an uncompressed PNG, writing it costs about as much as copying the pixels
+        void encodePNG( const unsigned char* rgb, int width, int height, const unsigned int* crcTable,
+            std::vector<unsigned char>& png )
+        {
+            static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+            png.assign(signature, signature + 8);
+
+            size_t chunk = startChunk(png, "IHDR");
+            appendBigEndian(png, (unsigned int)width);
+            appendBigEndian(png, (unsigned int)height);
+            png.push_back(8);       // bits per channel
+            png.push_back(2);       // RGB
+            png.push_back(0);       // deflate
+            png.push_back(0);       // adaptive filtering
+            png.push_back(0);       // not interlaced
+            finishChunk(png, chunk, crcTable);
+
+            // rows with filter type 0 in stored deflate blocks
+            size_t rowSize = (size_t)width * 3;
+            size_t total = (rowSize + 1) * height;
+            png.reserve(png.size() + total + total / MAX_STORED_BLOCK * 5 + 64);
+            chunk = startChunk(png, "IDAT");
+            png.push_back(0x78);
+            png.push_back(0x01);
+
+            unsigned int a = 1, b = 0;
+            size_t remaining = total;
+            size_t blockLeft = 0;
+            for (int y = 0; y < height; y++)
+            {
+                const unsigned char* row = rgb + rowSize * y;
+                for (size_t x = 0; x <= rowSize; x++)
+                {
+                    if (blockLeft == 0)
+                    {
+                        blockLeft = remaining < MAX_STORED_BLOCK ? remaining : MAX_STORED_BLOCK;
+                        png.push_back(blockLeft == remaining ? 1 : 0);
+                        png.push_back((unsigned char)blockLeft);
+                        png.push_back((unsigned char)(blockLeft >> 8));
+                        png.push_back((unsigned char)~blockLeft);
+                        png.push_back((unsigned char)(~blockLeft >> 8));
+                    }
+                    unsigned char value = x == 0 ? 0 : row[x - 1];
+                    png.push_back(value);
+                    a = (a + value) % 65521;
+                    b = (b + a) % 65521;
+                    blockLeft--;
+                    remaining--;
+                }
+            }
+            appendBigEndian(png, (b << 16) | a);
+            finishChunk(png, chunk, crcTable);
+
+            chunk = startChunk(png, "IEND");
+            finishChunk(png, chunk, crcTable);
+        }
+
+        bool readAt( FILE* file, uint64_t offset, void* data, size_t size )
+        {
+            return fseeko(file, (off_t)offset, SEEK_SET) == 0 && fread(data, 1, size, file) == size;
+        }
+    }
+
+    UnifeyeSessionSink::UnifeyeSessionSink( metaio::IUnifeyeMobile* _unifeye, const std::string& _imagePath ) :
+        unifeye(_unifeye), imagePath(_imagePath)
+    {
+        for (unsigned int n = 0; n < 256; n++)
+        {
+            unsigned int c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320U ^ (c >> 1) : c >> 1;
+            crcTable[n] = c;
+        }
+    }
+
+    void UnifeyeSessionSink::onCameraFrame( const metaio::ImageStruct& frame, double timestamp )
+    {
+        UNIFEYE_PERF_SCOPE("sessionImageSource");
+        rgb.resize(getImageBufferSize(metaio::common::ECF_R8G8B8, frame.width, frame.height));
+        if (rgb.empty())
+            return;
+
+        metaio::ImageStruct converted(&rgb[0], frame.width, frame.height, metaio::common::ECF_R8G8B8, true);
+        if (!convertImage(frame, converted))
+            return;
+
+        encodePNG(&rgb[0], frame.width, frame.height, crcTable, png);
+        FILE* file = fopen(imagePath.c_str(), "wb");
+        if (!file)
+            return;
+        bool written = fwrite(&png[0], 1, png.size(), file) == png.size();
+        if (fclose(file) == 0 && written)
+            unifeye->setImageSource(imagePath);
+    }
+
+    void UnifeyeSessionSink::onSensorLLA( const metaio::LLACoordinate& position, double timestamp )
+    {
+        unifeye->setSensorLLA(position);
+    }
+
+    void UnifeyeSessionSink::onAccelerometer( const metaio::Vector3d& values, double timestamp )
+    {
+        unifeye->setSensorAccelerometer(values);
+    }
+
+    void UnifeyeSessionSink::onCompassAngle( float angle, double timestamp )
+    {
+        unifeye->setSensorCompassAngle(angle);
+    }
+
+    void UnifeyeSessionSink::onPoses( const PoseSnapshot& poses )
+    {
+        recordedPoses = poses;
+    }
+
+    SessionPlayer::SessionPlayer() :
+        file(0), indexed(false), duration(0), dataEnd(0), position(0), pending(false), restating(false), time(0),
+        hasFrame(false)
+    {
+        memset(&header, 0, sizeof(header));
+        memset(&pendingRecord, 0, sizeof(pendingRecord));
+        memset(&frame, 0, sizeof(frame));
+    }
+
+    SessionPlayer::~SessionPlayer()
+    {
+        close();
+    }
+
+    bool SessionPlayer::open( const std::string& path )
+    {
+        close();
+
+        file = fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+
+        off_t fileSize = -1;
+        if (fseeko(file, 0, SEEK_END) == 0)
+            fileSize = ftello(file);
+        if (fileSize < (off_t)sizeof(header) || !readAt(file, 0, &header, sizeof(header)) ||
+            header.magic != SESSION_FILE_MAGIC || header.version != SESSION_FILE_VERSION)
+        {
+            close();
+            return false;
+        }
+
+        indexed = readIndex((uint64_t)fileSize);
+        if (!indexed)
+            scan((uint64_t)fileSize);
+
+        rewind();
+        return true;
+    }
+
+    void SessionPlayer::close()
+    {
+        if (file)
+            fclose(file);
+        file = 0;
+        index.clear();
+        indexed = false;
+        duration = 0;
+        dataEnd = position = 0;
+        pending = restating = hasFrame = false;
+        time = 0;
+        stats = SessionPlayerStats();
+    }
+
+    bool SessionPlayer::readIndex( uint64_t fileSize )
+    {
+        SessionFileFooter footer;
+        if (fileSize < sizeof(header) + sizeof(SessionRecordHeader) + sizeof(footer) ||
+            !readAt(file, fileSize - sizeof(footer), &footer, sizeof(footer)) || footer.magic != SESSION_FOOTER_MAGIC)
+            return false;
+
+        // the index record must end where the footer starts
+        SessionRecordHeader record;
+        uint64_t indexSize = (uint64_t)footer.entryCount * sizeof(SessionIndexEntry);
+        if (footer.indexOffset < sizeof(header) ||
+            footer.indexOffset + sizeof(record) + indexSize + sizeof(footer) != fileSize ||
+            !readAt(file, footer.indexOffset, &record, sizeof(record)) || record.type != SESSION_RECORD_INDEX ||
+            record.size != indexSize)
+            return false;
+
+        index.resize(footer.entryCount);
+        if (!index.empty() && fread(&index[0], sizeof(SessionIndexEntry), index.size(), file) != index.size())
+        {
+            index.clear();
+            return false;
+        }
+
+        duration = record.timestamp;
+        dataEnd = footer.indexOffset;
+        return true;
+    }
+
+    void SessionPlayer::scan( uint64_t fileSize )
+    {
+        index.clear();
+        duration = 0;
+
+        // the repeated sensor values right before a key frame belong to it
+        uint64_t offset = sizeof(header);
+        uint64_t stateStart = 0;
+        SessionRecordHeader record;
+        while (offset + sizeof(record) <= fileSize && readAt(file, offset, &record, sizeof(record)) &&
+            offset + sizeof(record) + record.size <= fileSize && record.type != SESSION_RECORD_INDEX)
+        {
+            if (record.flags & SESSION_RECORD_STATE)
+            {
+                if (stateStart == 0)
+                    stateStart = offset;
+            }
+            else
+            {
+                if (record.type == SESSION_RECORD_FRAME && (record.flags & SESSION_RECORD_KEY_FRAME))
+                {
+                    SessionIndexEntry entry;
+                    entry.timestamp = record.timestamp;
+                    entry.offset = stateStart != 0 ? stateStart : offset;
+                    index.push_back(entry);
+                }
+                stateStart = 0;
+            }
+
+            duration = record.timestamp;
+            offset += sizeof(record) + record.size;
+        }
+        dataEnd = offset;
+    }
+
+    bool SessionPlayer::setPosition( uint64_t offset )
+    {
+        pending = false;
+        hasFrame = false;
+        position = offset;
+        return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+    }
+
+    bool SessionPlayer::seek( double _time )
+    {
+        if (!file || index.empty())
+            return false;
+
+        size_t entry = 0;
+        while (entry + 1 < index.size() && index[entry + 1].timestamp <= _time)
+            entry++;
+
+        restating = true;
+        time = index[entry].timestamp;
+        return setPosition(index[entry].offset);
+    }
+
+    void SessionPlayer::rewind()
+    {
+        if (!file)
+            return;
+
+        restating = false;
+        time = 0;
+        setPosition(sizeof(header));
+    }
+
+    bool SessionPlayer::readPending()
+    {
+        if (pending)
+            return true;
+        if (!file || position + sizeof(pendingRecord) > dataEnd)
+            return false;
+        if (fread(&pendingRecord, sizeof(pendingRecord), 1, file) != 1 ||
+            position + sizeof(pendingRecord) + pendingRecord.size > dataEnd)
+        {
+            // a corrupt size, nothing after it can be trusted
+            dataEnd = position;
+            return false;
+        }
+        pending = true;
+        return true;
+    }
+
+    double SessionPlayer::peekTime()
+    {
+        return readPending() ? pendingRecord.timestamp : -1.0;
+    }
+
+    bool SessionPlayer::next( ISessionSink& sink )
+    {
+        while (readPending())
+        {
+            SessionRecordHeader record = pendingRecord;
+            pending = false;
+            position += sizeof(record) + record.size;
+            stats.bytesRead += sizeof(record) + record.size;
+
+            payload.resize(record.size);
+            if (record.size > 0 && fread(&payload[0], 1, record.size, file) != record.size)
+            {
+                dataEnd = position - sizeof(record) - record.size;
+                return false;
+            }
+
+            // the repeated sensor values only matter after a seek
+            if ((record.flags & SESSION_RECORD_STATE) && !restating)
+                continue;
+
+            time = record.timestamp;
+            deliver(record, sink);
+            return true;
+        }
+        return false;
+    }
+
+    int SessionPlayer::advance( ISessionSink& sink, double _time )
+    {
+        int delivered = 0;
+        double nextTime;
+        while ((nextTime = peekTime()) >= 0 && nextTime <= _time && next(sink))
+            delivered++;
+        return delivered;
+    }
+
+    void SessionPlayer::deliver( const SessionRecordHeader& record, ISessionSink& sink )
+    {
+        const unsigned char* data = payload.empty() ? 0 : &payload[0];
+        switch (record.type)
+        {
+            case SESSION_RECORD_FRAME:
+                deliverFrame(record, sink);
+                break;
+
+            case SESSION_RECORD_LLA:
+                if (record.size == 4 * sizeof(double))
+                {
+                    double values[4];
+                    memcpy(values, data, sizeof(values));
+                    sink.onSensorLLA(metaio::LLACoordinate(values[0], values[1], values[2], values[3]), record.timestamp);
+                    stats.sensorRecords++;
+                }
+                break;
+
+            case SESSION_RECORD_ACCELEROMETER:
+                if (record.size == 3 * sizeof(float))
+                {
+                    float values[3];
+                    memcpy(values, data, sizeof(values));
+                    sink.onAccelerometer(metaio::Vector3d(values[0], values[1], values[2]), record.timestamp);
+                    stats.sensorRecords++;
+                }
+                break;
+
+            case SESSION_RECORD_COMPASS:
+                if (record.size == sizeof(float))
+                {
+                    float angle;
+                    memcpy(&angle, data, sizeof(angle));
+                    sink.onCompassAngle(angle, record.timestamp);
+                    stats.sensorRecords++;
+                }
+                break;
+
+            case SESSION_RECORD_POSES:
+            {
+                uint32_t count = 0;
+                if (record.size >= sizeof(count))
+                    memcpy(&count, data, sizeof(count));
+                if (record.size != sizeof(count) + count * sizeof(SessionPose))
+                    break;
+
+                poseList.resize(count);
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    SessionPose pose;
+                    memcpy(&pose, data + sizeof(count) + i * sizeof(SessionPose), sizeof(pose));
+                    poseList[i] = metaio::Pose(pose.translation[0], pose.translation[1], pose.translation[2],
+                        pose.rotation[0], pose.rotation[1], pose.rotation[2], pose.rotation[3], pose.quality, pose.cosID);
+                }
+                poses.update(poseList, record.timestamp);
+                sink.onPoses(poses);
+                stats.poseRecords++;
+                break;
+            }
+
+            default:
+                // written by a newer version
+                break;
+        }
+    }
+
+    void SessionPlayer::deliverFrame( const SessionRecordHeader& record, ISessionSink& sink )
+    {
+        UNIFEYE_PERF_SCOPE("sessionDecodeFrame");
+        SessionFrame incoming;
+        size_t size = 0;
+        if (record.size >= sizeof(incoming))
+        {
+            memcpy(&incoming, &payload[0], sizeof(incoming));
+            size = getImageBufferSize((metaio::common::ECOLOR_FORMAT)incoming.colorFormat, incoming.width, incoming.height);
+        }
+
+        // a delta frame needs the frame before it
+        bool keyFrame = (record.flags & SESSION_RECORD_KEY_FRAME) != 0;
+        if (size == 0 || (!keyFrame && (!hasFrame || memcmp(&incoming, &frame, sizeof(incoming)) != 0)))
+        {
+            stats.skippedFrames++;
+            return;
+        }
+
+        restating = false;
+        frame = incoming;
+        pixels.resize(size);
+        if (!decodeSessionFrame(&payload[sizeof(incoming)], record.size - sizeof(incoming), keyFrame ? 0 : &pixels[0], size,
+            getSessionPixelSize(incoming.colorFormat), &pixels[0]))
+        {
+            hasFrame = false;
+            stats.skippedFrames++;
+            return;
+        }
+
+        hasFrame = true;
+        metaio::ImageStruct image(&pixels[0], frame.width, frame.height,
+            (metaio::common::ECOLOR_FORMAT)frame.colorFormat, frame.originIsUpperLeft != 0);
+        sink.onCameraFrame(image, record.timestamp);
+        stats.frames++;
+    }
+}
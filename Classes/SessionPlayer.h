@@ -0,0 +1,213 @@
+//
+//  SessionPlayer.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Replays a session file written by SessionRecorder. The records are
+//  handed to an ISessionSink in the order they were recorded, either as
+//  fast as the sink takes them (next) or paced by a clock (advance).
+//
+#ifndef __UNIFEYE_SESSIONPLAYER_H__
+#define __UNIFEYE_SESSIONPLAYER_H__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+#include "SessionFormat.h"
+#include "PoseSnapshot.h"
+
+namespace metaio
+{
+    class IUnifeyeMobile;   // forward declaration
+}
+
+namespace unifeye
+{
+    /**
+     * \brief Receives the records of a session
+     *
+     * Timestamps are seconds since the start of the session.
+     */
+    class ISessionSink
+    {
+    public:
+        virtual ~ISessionSink() {};
+
+        /// A camera frame, the buffer is only valid during the call
+        virtual void onCameraFrame( const metaio::ImageStruct& frame, double timestamp ) = 0;
+
+        virtual void onSensorLLA( const metaio::LLACoordinate& position, double timestamp ) = 0;
+        virtual void onAccelerometer( const metaio::Vector3d& values, double timestamp ) = 0;
+        virtual void onCompassAngle( float angle, double timestamp ) = 0;
+
+        /// The poses that were tracked when recording, with their timestamp
+        virtual void onPoses( const PoseSnapshot& poses ) = 0;
+    };
+
+    /**
+     * \brief Feeds a session to the SDK
+     *
+     * setImageSource() only takes JPEG and PNG files, so every frame is
+     * converted to RGB and written to an uncompressed PNG first. The poses
+     * of the recording are kept to compare them with what the SDK tracks.
+     */
+    class UnifeyeSessionSink : public ISessionSink
+    {
+    public:
+        /**
+         * \brief Constructor
+         * \param unifeye the SDK instance
+         * \param imagePath the PNG file the frames are written to
+         */
+        UnifeyeSessionSink( metaio::IUnifeyeMobile* _unifeye, const std::string& _imagePath );
+
+        virtual void onCameraFrame( const metaio::ImageStruct& frame, double timestamp );
+        virtual void onSensorLLA( const metaio::LLACoordinate& position, double timestamp );
+        virtual void onAccelerometer( const metaio::Vector3d& values, double timestamp );
+        virtual void onCompassAngle( float angle, double timestamp );
+        virtual void onPoses( const PoseSnapshot& poses );
+
+        /// The poses recorded with the last frame
+        const PoseSnapshot& getRecordedPoses() const { return recordedPoses; }
+
+    private:
+        metaio::IUnifeyeMobile* unifeye;
+        std::string imagePath;
+        std::vector<unsigned char> rgb;
+        std::vector<unsigned char> png;
+        unsigned int crcTable[256];
+        PoseSnapshot recordedPoses;
+    };
+
+    /**
+     * \brief Counters of a SessionPlayer
+     */
+    struct SessionPlayerStats
+    {
+        unsigned long frames;           ///< camera frames delivered
+        unsigned long sensorRecords;    ///< sensor values delivered
+        unsigned long poseRecords;      ///< pose snapshots delivered
+        unsigned long skippedFrames;    ///< frames that could not be decoded
+        unsigned long long bytesRead;
+
+        SessionPlayerStats() : frames(0), sensorRecords(0), poseRecords(0), skippedFrames(0), bytesRead(0) {};
+    };
+
+    /**
+     * \brief Reads a session file
+     *
+     * Not thread safe, use it from one thread.
+     */
+    class SessionPlayer
+    {
+    public:
+        SessionPlayer();
+
+        /// Destructor, closes the file
+        ~SessionPlayer();
+
+        /**
+         * \brief Open a session file
+         *
+         * A file that was not closed by the recorder has no index; it is
+         * scanned up to the last complete record instead.
+         *
+         * \param path the session file
+         * \return false if the file can not be read or is not a session
+         */
+        bool open( const std::string& path );
+
+        void close();
+
+        bool isOpen() const { return file != 0; }
+
+        /// Whether the file had an index, false if it was scanned
+        bool hasIndex() const { return indexed; }
+
+        /// Time of the last record in seconds
+        double getDuration() const { return duration; }
+
+        /// Number of key frames, the positions seek() can go to
+        int getKeyFrameCount() const { return (int)index.size(); }
+
+        /// Time of the last record delivered
+        double getTime() const { return time; }
+
+        /**
+         * \brief Continue at the last key frame at or before a time
+         *
+         * The sensor values at the key frame are delivered again.
+         *
+         * \param time seconds since the start of the session
+         * \return false if the session has no key frame
+         */
+        bool seek( double time );
+
+        /// Start over from the beginning
+        void rewind();
+
+        /**
+         * \brief Deliver the next record
+         * \param sink receives the record
+         * \return false at the end of the session
+         */
+        bool next( ISessionSink& sink );
+
+        /**
+         * \brief Deliver all records up to a time
+         * \param sink receives the records
+         * \param time seconds since the start of the session
+         * \return the number of records delivered
+         */
+        int advance( ISessionSink& sink, double time );
+
+        /**
+         * \brief Time of the record next() would deliver
+         * \return the time, or a negative value at the end
+         */
+        double peekTime();
+
+        /// Whether the end of the session was reached
+        bool isFinished() { return peekTime() < 0; }
+
+        const SessionPlayerStats& getStats() const { return stats; }
+
+    private:
+        SessionPlayer( const SessionPlayer& );
+        SessionPlayer& operator=( const SessionPlayer& );
+
+        bool readIndex( uint64_t fileSize );
+        void scan( uint64_t fileSize );
+        bool readPending();
+        bool setPosition( uint64_t offset );
+        void deliver( const SessionRecordHeader& record, ISessionSink& sink );
+        void deliverFrame( const SessionRecordHeader& record, ISessionSink& sink );
+
+        FILE* file;
+        SessionFileHeader header;
+        std::vector<SessionIndexEntry> index;
+        bool indexed;
+        double duration;
+        uint64_t dataEnd;           // offset after the last record
+        uint64_t position;          // offset of the next record
+
+        bool pending;               // pendingRecord was read, its payload not yet
+        SessionRecordHeader pendingRecord;
+        bool restating;             // a seek is delivering the repeated sensor values
+        double time;
+
+        std::vector<unsigned char> payload;
+        SessionFrame frame;
+        std::vector<unsigned char> pixels;
+        bool hasFrame;              // pixels predict the next delta frame
+        std::vector<metaio::Pose> poseList;
+        PoseSnapshot poses;
+
+        SessionPlayerStats stats;
+    };
+}
+
+#endif
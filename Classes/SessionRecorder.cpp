@@ -0,0 +1,395 @@
+//
+//  SessionRecorder.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "SessionRecorder.h"
+#include "ImageFormat.h"
+#include "PerfTrace.h"
+
+#include <string.h>
+
+namespace unifeye
+{
+    SessionRecorder::SessionRecorder( int frameSlots ) :
+        queueHead(0), queueCount(0), slots(frameSlots > 0 ? frameSlots : 1), slotInUse(slots.size(), false),
+        accepting(false), stopping(false), recording(0), threadRunning(false),
+        file(0), failed(false), keyFrameInterval(30), framesSinceKeyFrame(0), started(false), start(0), last(0),
+        hasLLA(false), hasAccelerometer(false), hasCompass(false), compass(0)
+    {
+        memset(&previousFrame, 0, sizeof(previousFrame));
+    }
+
+    SessionRecorder::~SessionRecorder()
+    {
+        close();
+    }
+
+    bool SessionRecorder::open( const std::string& path, int _keyFrameInterval )
+    {
+        close();
+
+        file = fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+
+        // the writer thread is not running, its state can be set from here
+        failed = false;
+        keyFrameInterval = _keyFrameInterval > 0 ? _keyFrameInterval : 1;
+        framesSinceKeyFrame = 0;
+        started = false;
+        start = last = 0;
+        memset(&previousFrame, 0, sizeof(previousFrame));
+        previous.clear();
+        hasLLA = hasAccelerometer = hasCompass = false;
+        index.clear();
+        written = SessionRecorderStats();
+
+        SessionFileHeader header;
+        header.magic = SESSION_FILE_MAGIC;
+        header.version = SESSION_FILE_VERSION;
+        header.keyFrameInterval = (uint32_t)keyFrameInterval;
+        header.reserved = 0;
+        failed = fwrite(&header, sizeof(header), 1, file) != 1;
+        written.fileBytes = sizeof(header);
+
+        {
+            ScopedLock lock(mutex);
+            stats = written;
+            queueHead = queueCount = 0;
+            slotInUse.assign(slots.size(), false);
+            stopping = false;
+            accepting = true;
+        }
+
+        threadRunning = pthread_create(&thread, 0, writerThread, this) == 0;
+        if (!threadRunning)
+        {
+            ScopedLock lock(mutex);
+            accepting = false;
+            fclose(file);
+            file = 0;
+            return false;
+        }
+        atomicStore(&recording, 1);
+        return !failed;
+    }
+
+    bool SessionRecorder::close()
+    {
+        if (!threadRunning)
+            return false;
+
+        {
+            ScopedLock lock(mutex);
+            accepting = false;
+            stopping = true;
+            wakeCondition.signal();
+        }
+        atomicStore(&recording, 0);
+
+        // the writer empties the queue before it ends
+        pthread_join(thread, 0);
+        threadRunning = false;
+
+        // the index and the footer, without them the player scans the file
+        uint64_t indexOffset = written.fileBytes;
+        writeRecord(SESSION_RECORD_INDEX, 0, last, index.empty() ? 0 : &index[0],
+            index.size() * sizeof(SessionIndexEntry));
+
+        SessionFileFooter footer;
+        footer.indexOffset = indexOffset;
+        footer.entryCount = (uint32_t)index.size();
+        footer.magic = SESSION_FOOTER_MAGIC;
+        if (fwrite(&footer, sizeof(footer), 1, file) != 1)
+            failed = true;
+        written.fileBytes += sizeof(footer);
+
+        if (fclose(file) != 0)
+            failed = true;
+        file = 0;
+        previous.clear();
+
+        ScopedLock lock(mutex);
+        publish();
+        return !failed;
+    }
+
+    void SessionRecorder::flush()
+    {
+        ScopedLock lock(mutex);
+        while (queueCount > 0)
+            writtenCondition.wait(mutex);
+    }
+
+    void SessionRecorder::queue( int type, double timestamp, const void* data, size_t size )
+    {
+        ScopedLock lock(mutex);
+        if (!accepting)
+            return;
+        if (queueCount == QUEUE_SIZE)
+        {
+            stats.droppedRecords++;
+            return;
+        }
+
+        QueuedRecord& record = queued[(queueHead + queueCount) % QUEUE_SIZE];
+        record.type = type;
+        record.timestamp = timestamp;
+        record.size = size;
+        memcpy(&record.data, data, size);
+        queueCount++;
+        wakeCondition.signal();
+    }
+
+    void* SessionRecorder::writerThread( void* recorder )
+    {
+        static_cast<SessionRecorder*>(recorder)->writeQueued();
+        return 0;
+    }
+
+    void SessionRecorder::writeQueued()
+    {
+        mutex.lock();
+        for (;;)
+        {
+            while (queueCount == 0 && !stopping)
+                wakeCondition.wait(mutex);
+            if (queueCount == 0)
+                break;
+
+            // producers only fill entries behind the head, this one stays as it is
+            const QueuedRecord& record = queued[queueHead];
+            mutex.unlock();
+            write(record);
+            mutex.lock();
+
+            if (record.type == SESSION_RECORD_FRAME)
+                slotInUse[record.slot] = false;
+            queueHead = (queueHead + 1) % QUEUE_SIZE;
+            queueCount--;
+            publish();
+            writtenCondition.signal();
+        }
+        mutex.unlock();
+    }
+
+    void SessionRecorder::publish()
+    {
+        unsigned long droppedFrames = stats.droppedFrames, droppedRecords = stats.droppedRecords;
+        stats = written;
+        stats.droppedFrames = droppedFrames;
+        stats.droppedRecords = droppedRecords;
+    }
+
+    double SessionRecorder::getTime( double timestamp )
+    {
+        if (!started)
+        {
+            start = timestamp;
+            started = true;
+        }
+        double time = timestamp - start;
+        if (time < last)
+            time = last;
+        last = time;
+        return time;
+    }
+
+    void SessionRecorder::writeRecord( int type, int flags, double time, const void* data, size_t size,
+        const void* extra, size_t extraSize )
+    {
+        SessionRecordHeader header;
+        header.type = (uint16_t)type;
+        header.flags = (uint16_t)flags;
+        header.size = (uint32_t)(size + extraSize);
+        header.timestamp = time;
+
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+        if (ok && size > 0)
+            ok = fwrite(data, 1, size, file) == size;
+        if (ok && extraSize > 0)
+            ok = fwrite(extra, 1, extraSize, file) == extraSize;
+        if (!ok)
+            failed = true;
+        written.fileBytes += sizeof(header) + size + extraSize;
+    }
+
+    void SessionRecorder::writeSensorState( double time )
+    {
+        if (hasLLA)
+        {
+            double values[4] = { lla.latitude, lla.longitude, lla.altitude, lla.accuracy };
+            writeRecord(SESSION_RECORD_LLA, SESSION_RECORD_STATE, time, values, sizeof(values));
+        }
+        if (hasAccelerometer)
+        {
+            float values[3] = { accelerometer.x, accelerometer.y, accelerometer.z };
+            writeRecord(SESSION_RECORD_ACCELEROMETER, SESSION_RECORD_STATE, time, values, sizeof(values));
+        }
+        if (hasCompass)
+            writeRecord(SESSION_RECORD_COMPASS, SESSION_RECORD_STATE, time, &compass, sizeof(compass));
+    }
+
+    void SessionRecorder::write( const QueuedRecord& record )
+    {
+        double time = getTime(record.timestamp);
+        switch (record.type)
+        {
+        case SESSION_RECORD_FRAME:
+        {
+            bool keyFrame = previous.empty() || framesSinceKeyFrame >= keyFrameInterval ||
+                memcmp(&record.frame, &previousFrame, sizeof(previousFrame)) != 0;
+            if (keyFrame)
+            {
+                // playback from here needs the sensor values, so they come first
+                SessionIndexEntry entry;
+                entry.timestamp = time;
+                entry.offset = written.fileBytes;
+                index.push_back(entry);
+                writeSensorState(time);
+                framesSinceKeyFrame = 0;
+                written.keyFrames++;
+            }
+
+            UNIFEYE_PERF_SCOPE("sessionEncodeFrame");
+            std::vector<unsigned char>& pixels = slots[record.slot];
+            encoded.clear();
+            encodeSessionFrame(&pixels[0], keyFrame ? 0 : &previous[0], record.size,
+                getSessionPixelSize(record.frame.colorFormat), encoded, scratch);
+            writeRecord(SESSION_RECORD_FRAME, keyFrame ? SESSION_RECORD_KEY_FRAME : 0, time, &record.frame,
+                sizeof(record.frame), encoded.empty() ? 0 : &encoded[0], encoded.size());
+
+            // the frame becomes the prediction, the old prediction the slot
+            previousFrame = record.frame;
+            pixels.swap(previous);
+            framesSinceKeyFrame++;
+            written.frames++;
+            written.rawBytes += record.size;
+            break;
+        }
+        case SESSION_RECORD_LLA:
+            writeRecord(SESSION_RECORD_LLA, 0, time, record.data.lla, sizeof(record.data.lla));
+            lla = metaio::LLACoordinate(record.data.lla[0], record.data.lla[1], record.data.lla[2], record.data.lla[3]);
+            hasLLA = true;
+            written.sensorRecords++;
+            break;
+        case SESSION_RECORD_ACCELEROMETER:
+            writeRecord(SESSION_RECORD_ACCELEROMETER, 0, time, record.data.values, sizeof(record.data.values));
+            accelerometer = metaio::Vector3d(record.data.values[0], record.data.values[1], record.data.values[2]);
+            hasAccelerometer = true;
+            written.sensorRecords++;
+            break;
+        case SESSION_RECORD_COMPASS:
+            writeRecord(SESSION_RECORD_COMPASS, 0, time, &record.data.compass, sizeof(record.data.compass));
+            compass = record.data.compass;
+            hasCompass = true;
+            written.sensorRecords++;
+            break;
+        case SESSION_RECORD_POSES:
+            writeRecord(SESSION_RECORD_POSES, 0, time, record.data.poses, record.size);
+            written.poseRecords++;
+            break;
+        }
+    }
+
+    void SessionRecorder::recordCameraFrame( const metaio::ImageStruct& frame, double timestamp )
+    {
+        size_t size = getImageBufferSize(frame);
+        if (!frame.buffer || size == 0)
+            return;
+
+        UNIFEYE_PERF_SCOPE("sessionRecordFrame");
+        int slot = -1;
+        {
+            ScopedLock lock(mutex);
+            if (!accepting)
+                return;
+            for (size_t i = 0; i < slotInUse.size() && slot < 0; i++)
+            {
+                if (!slotInUse[i])
+                    slot = (int)i;
+            }
+            if (slot < 0)
+            {
+                stats.droppedFrames++;
+                return;
+            }
+            slotInUse[slot] = true;
+        }
+
+        // the slot is ours until it is queued, the copy needs no lock
+        std::vector<unsigned char>& pixels = slots[slot];
+        if (pixels.size() < size)
+            pixels.resize(size);
+        memcpy(&pixels[0], frame.buffer, size);
+
+        ScopedLock lock(mutex);
+        if (!accepting || queueCount == QUEUE_SIZE)
+        {
+            if (accepting)
+                stats.droppedFrames++;
+            slotInUse[slot] = false;
+            return;
+        }
+
+        QueuedRecord& record = queued[(queueHead + queueCount) % QUEUE_SIZE];
+        record.type = SESSION_RECORD_FRAME;
+        record.timestamp = timestamp;
+        record.slot = slot;
+        record.size = size;
+        record.frame.width = frame.width;
+        record.frame.height = frame.height;
+        record.frame.colorFormat = (uint32_t)frame.colorFormat;
+        record.frame.originIsUpperLeft = frame.originIsUpperLeft ? 1 : 0;
+        queueCount++;
+        wakeCondition.signal();
+    }
+
+    void SessionRecorder::recordSensorLLA( const metaio::LLACoordinate& position, double timestamp )
+    {
+        double values[4] = { position.latitude, position.longitude, position.altitude, position.accuracy };
+        queue(SESSION_RECORD_LLA, timestamp, values, sizeof(values));
+    }
+
+    void SessionRecorder::recordAccelerometer( const metaio::Vector3d& values, double timestamp )
+    {
+        float data[3] = { values.x, values.y, values.z };
+        queue(SESSION_RECORD_ACCELEROMETER, timestamp, data, sizeof(data));
+    }
+
+    void SessionRecorder::recordCompassAngle( float angle, double timestamp )
+    {
+        queue(SESSION_RECORD_COMPASS, timestamp, &angle, sizeof(angle));
+    }
+
+    void SessionRecorder::recordPoses( const PoseSnapshot& poses )
+    {
+        // uint32 count + SessionPose [count], as stored
+        unsigned char payload[sizeof(uint32_t) + PoseSnapshot::MAX_POSES * sizeof(SessionPose)];
+        uint32_t count = (uint32_t)poses.getCount();
+        memcpy(payload, &count, sizeof(count));
+        for (uint32_t i = 0; i < count; i++)
+        {
+            SessionPose pose;
+            pose.cosID = poses.cosID[i];
+            pose.translation[0] = poses.tx[i];
+            pose.translation[1] = poses.ty[i];
+            pose.translation[2] = poses.tz[i];
+            pose.rotation[0] = poses.qx[i];
+            pose.rotation[1] = poses.qy[i];
+            pose.rotation[2] = poses.qz[i];
+            pose.rotation[3] = poses.qw[i];
+            pose.quality = poses.quality[i];
+            memcpy(payload + sizeof(count) + i * sizeof(SessionPose), &pose, sizeof(pose));
+        }
+        queue(SESSION_RECORD_POSES, poses.getTimestamp(), payload, sizeof(count) + count * sizeof(SessionPose));
+    }
+
+    SessionRecorderStats SessionRecorder::getStats()
+    {
+        ScopedLock lock(mutex);
+        return stats;
+    }
+}
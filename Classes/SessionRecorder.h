@@ -0,0 +1,206 @@
+//
+//  SessionRecorder.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Writes the input of the SDK (camera frames, sensor values) and the
+//  poses it tracked to a session file (see SessionFormat.h), so a run can
+//  be replayed later with SessionPlayer.
+//
+//  The record calls only queue: a camera frame is copied into one of a few
+//  slots that are reused for the whole session, a thread of the recorder
+//  encodes and writes the queue in order. When the thread falls behind,
+//  frames are dropped instead of stalling the camera.
+//
+#ifndef __UNIFEYE_SESSIONRECORDER_H__
+#define __UNIFEYE_SESSIONRECORDER_H__
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+#include "PoseSnapshot.h"
+#include "SessionFormat.h"
+#include "Threading.h"
+
+namespace unifeye
+{
+    /**
+     * \brief Counters of a SessionRecorder
+     */
+    struct SessionRecorderStats
+    {
+        unsigned long frames;           ///< camera frames recorded
+        unsigned long keyFrames;        ///< of which key frames
+        unsigned long sensorRecords;    ///< LLA, accelerometer and compass values, without repeated ones
+        unsigned long poseRecords;      ///< pose snapshots recorded
+        unsigned long long rawBytes;    ///< pixels of the recorded frames
+        unsigned long long fileBytes;   ///< bytes written so far
+        unsigned long droppedFrames;    ///< camera frames not recorded because every slot was in use
+        unsigned long droppedRecords;   ///< sensor values and poses not recorded because the queue was full
+
+        SessionRecorderStats() : frames(0), keyFrames(0), sensorRecords(0), poseRecords(0), rawBytes(0), fileBytes(0),
+            droppedFrames(0), droppedRecords(0) {};
+    };
+
+    /**
+     * \brief Records a session to a file
+     *
+     * All methods may be called from any thread. Timestamps are seconds of
+     * any clock, but the same one for all records; they are stored relative
+     * to the first record. A record with an earlier timestamp than the one
+     * before is stored with the previous timestamp, so the file is always in
+     * order. Records are written in the order they were queued, the stats
+     * count them once written. Only open() and close() must not be called
+     * from two threads at once.
+     */
+    class SessionRecorder
+    {
+    public:
+        /**
+         * \brief Constructor
+         * \param frameSlots camera frames queued at most, further ones are dropped
+         */
+        explicit SessionRecorder( int frameSlots = 4 );
+
+        /// Destructor, closes the file
+        ~SessionRecorder();
+
+        /**
+         * \brief Start recording to a file
+         *
+         * A session that is still open is closed first.
+         *
+         * \param path the file, it is overwritten
+         * \param keyFrameInterval every how many frames a key frame is stored
+         * \return false if the file can not be created
+         */
+        bool open( const std::string& path, int keyFrameInterval = 30 );
+
+        /**
+         * \brief Write what is queued, the index, and close the file
+         * \return false if writing failed at any point of the session
+         */
+        bool close();
+
+        bool isOpen() { return atomicLoad(&recording) != 0; }
+
+        /// Wait until everything queued so far is written
+        void flush();
+
+        /**
+         * \brief Record a camera frame
+         *
+         * A frame with a different size or color format than the one before
+         * is stored as key frame. The pixels are copied, the frame can be
+         * reused when this returns.
+         *
+         * \param frame the frame, any color format ImageFormat knows
+         * \param timestamp time the frame was captured, in seconds
+         */
+        void recordCameraFrame( const metaio::ImageStruct& frame, double timestamp );
+
+        /// Record a setSensorLLA() call
+        void recordSensorLLA( const metaio::LLACoordinate& position, double timestamp );
+
+        /// Record a setSensorAccelerometer() call
+        void recordAccelerometer( const metaio::Vector3d& values, double timestamp );
+
+        /// Record a setSensorCompassAngle() call
+        void recordCompassAngle( float angle, double timestamp );
+
+        /**
+         * \brief Record the poses tracked for a frame
+         * \param poses the poses, stored with their timestamp
+         */
+        void recordPoses( const PoseSnapshot& poses );
+
+        SessionRecorderStats getStats();
+
+    private:
+        // what the writer thread gets, in the order it was queued
+        struct QueuedRecord
+        {
+            int type;                   // SESSION_RECORD_*
+            double timestamp;           // as passed in
+            int slot;                   // SESSION_RECORD_FRAME: index in slots
+            SessionFrame frame;         // SESSION_RECORD_FRAME
+            size_t size;                // bytes used of data, or of the slot
+            union
+            {
+                double lla[4];
+                float values[3];
+                float compass;
+                unsigned char poses[sizeof(uint32_t) + PoseSnapshot::MAX_POSES * sizeof(SessionPose)];
+            } data;
+        };
+
+        enum { QUEUE_SIZE = 64 };
+
+        SessionRecorder( const SessionRecorder& );
+        SessionRecorder& operator=( const SessionRecorder& );
+
+        void queue( int type, double timestamp, const void* data, size_t size );
+
+        static void* writerThread( void* recorder );
+        void writeQueued();
+        void write( const QueuedRecord& record );
+
+        // copy the counters of the writer to stats; mutex locked
+        void publish();
+
+        // time relative to the first record, never decreasing
+        double getTime( double timestamp );
+
+        void writeRecord( int type, int flags, double time, const void* data, size_t size,
+            const void* extra = 0, size_t extraSize = 0 );
+        void writeSensorState( double time );
+
+        // queue and slots, shared with the writer thread
+        Mutex mutex;
+        Condition wakeCondition;        // the writer has work or is to stop
+        Condition writtenCondition;     // the writer emptied a queue entry
+        QueuedRecord queued[QUEUE_SIZE];
+        int queueHead;
+        int queueCount;
+        std::vector<std::vector<unsigned char> > slots;     // grown to the largest frame, then reused
+        std::vector<bool> slotInUse;
+        bool accepting;
+        bool stopping;
+        volatile int recording;
+        SessionRecorderStats stats;
+
+        pthread_t thread;
+        bool threadRunning;
+
+        // only touched by the writer thread while it runs
+        FILE* file;
+        bool failed;
+        int keyFrameInterval;
+        int framesSinceKeyFrame;
+
+        bool started;
+        double start;
+        double last;
+
+        // the previous frame, the prediction of the next one
+        SessionFrame previousFrame;
+        std::vector<unsigned char> previous;
+        std::vector<unsigned char> encoded;
+        std::vector<unsigned char> scratch;
+
+        // the last sensor values, repeated before every key frame
+        bool hasLLA, hasAccelerometer, hasCompass;
+        metaio::LLACoordinate lla;
+        metaio::Vector3d accelerometer;
+        float compass;
+
+        std::vector<SessionIndexEntry> index;
+        SessionRecorderStats written;
+    };
+}
+
+#endif
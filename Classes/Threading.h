@@ -0,0 +1,124 @@
+//
+//  Threading.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Minimal portable threading helpers. The module is built against the
+//  libstdc++ the Unifeye SDK uses, so there is no <atomic> or <mutex>;
+//  these wrap pthreads and the GCC/clang __sync builtins instead.
+//
+#ifndef __UNIFEYE_THREADING_H__
+#define __UNIFEYE_THREADING_H__
+
+#include <pthread.h>
+
+namespace unifeye
+{
+    /// Atomically increment a value and return the new value
+    inline int atomicIncrement( volatile int* value )
+    {
+        return __sync_add_and_fetch(value, 1);
+    }
+
+    /// Atomically decrement a value and return the new value
+    inline int atomicDecrement( volatile int* value )
+    {
+        return __sync_sub_and_fetch(value, 1);
+    }
+
+    /// Read a value written by another thread
+    inline int atomicLoad( volatile int* value )
+    {
+        int result = *value;
+        __sync_synchronize();
+        return result;
+    }
+
+    /// Publish a value to other threads
+    inline void atomicStore( volatile int* value, int newValue )
+    {
+        __sync_synchronize();
+        *value = newValue;
+    }
+
+    /// Read a counter written by another thread
+    inline unsigned int atomicLoad( volatile unsigned int* value )
+    {
+        unsigned int result = *value;
+        __sync_synchronize();
+        return result;
+    }
+
+    /// Publish a counter to other threads
+    inline void atomicStore( volatile unsigned int* value, unsigned int newValue )
+    {
+        __sync_synchronize();
+        *value = newValue;
+    }
+
+    /// Order the memory accesses before and after it for other threads
+    inline void memoryBarrier()
+    {
+        __sync_synchronize();
+    }
+
+    /**
+     * \brief Non-recursive mutex
+     */
+    class Mutex
+    {
+    public:
+        Mutex() { pthread_mutex_init(&mutex, 0); }
+        ~Mutex() { pthread_mutex_destroy(&mutex); }
+
+        void lock() { pthread_mutex_lock(&mutex); }
+        void unlock() { pthread_mutex_unlock(&mutex); }
+
+    private:
+        Mutex( const Mutex& );
+        Mutex& operator=( const Mutex& );
+
+        friend class Condition;
+        pthread_mutex_t mutex;
+    };
+
+    /**
+     * \brief Condition variable for a Mutex
+     */
+    class Condition
+    {
+    public:
+        Condition() { pthread_cond_init(&condition, 0); }
+        ~Condition() { pthread_cond_destroy(&condition); }
+
+        /// Wait for signal(), with the mutex locked; may also wake up spuriously
+        void wait( Mutex& mutex ) { pthread_cond_wait(&condition, &mutex.mutex); }
+
+        void signal() { pthread_cond_signal(&condition); }
+
+    private:
+        Condition( const Condition& );
+        Condition& operator=( const Condition& );
+
+        pthread_cond_t condition;
+    };
+
+    /**
+     * \brief Locks a mutex for the lifetime of the object
+     */
+    class ScopedLock
+    {
+    public:
+        explicit ScopedLock( Mutex& _mutex ) : mutex(_mutex) { mutex.lock(); }
+        ~ScopedLock() { mutex.unlock(); }
+
+    private:
+        ScopedLock( const ScopedLock& );
+        ScopedLock& operator=( const ScopedLock& );
+
+        Mutex& mutex;
+    };
+}
+
+#endif
@@ -0,0 +1,516 @@
+//
+//  VectorMath.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Matrix and quaternion math for the values of the SDK. Matrices are 4x4,
+//  column major float[16], as returned by getTrackingValues and
+//  getProjectionMatrix. Quaternions are metaio::Vector4d (x, y, z, w) as in
+//  metaio::Pose, axis angle rotations are metaio::Vector4d (x, y, z, angle in
+//  radians) as in setMoveRotation.
+//
+//  The functions that run per point or per pose have an SSE2/NEON version
+//  and a scalar version with the suffix Scalar, transformPoints only on
+//  NEON, transformPointsSoA on both. Both give the same results
+//  up to rounding, the scalar ones are only called directly to compare.
+//
+#ifndef __UNIFEYE_VECTORMATH_H__
+#define __UNIFEYE_VECTORMATH_H__
+
+#include <math.h>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#define UNIFEYE_VECTORMATH_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define UNIFEYE_VECTORMATH_SSE2 1
+#endif
+
+namespace unifeye
+{
+    // transformPoints reads and writes arrays of Vector3d as packed floats
+    typedef char VectorMathVector3dIsPacked[sizeof(metaio::Vector3d) == 3 * sizeof(float) ? 1 : -1];
+
+    /// The SIMD path of the functions below, "neon", "sse2" or "scalar"
+    inline const char* getVectorMathSIMDPath()
+    {
+#if defined(UNIFEYE_VECTORMATH_NEON)
+        return "neon";
+#elif defined(UNIFEYE_VECTORMATH_SSE2)
+        return "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    /// Set a matrix to the identity
+    inline void setIdentityMatrix( float out[16] )
+    {
+        for (int i = 0; i < 16; i++)
+            out[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+    }
+
+    /// out = a * b, out must not be a or b
+    inline void multiplyMatricesScalar( const float a[16], const float b[16], float out[16] )
+    {
+        for (int column = 0; column < 4; column++)
+        {
+            for (int row = 0; row < 4; row++)
+            {
+                out[column * 4 + row] = a[row] * b[column * 4] + a[4 + row] * b[column * 4 + 1] +
+                    a[8 + row] * b[column * 4 + 2] + a[12 + row] * b[column * 4 + 3];
+            }
+        }
+    }
+
+    /// out = a * b, out must not be a or b
+    inline void multiplyMatrices( const float a[16], const float b[16], float out[16] )
+    {
+#if defined(UNIFEYE_VECTORMATH_NEON)
+        float32x4_t a0 = vld1q_f32(a), a1 = vld1q_f32(a + 4), a2 = vld1q_f32(a + 8), a3 = vld1q_f32(a + 12);
+        for (int column = 0; column < 4; column++)
+        {
+            const float* c = b + column * 4;
+            float32x4_t result = vmulq_n_f32(a0, c[0]);
+            result = vmlaq_n_f32(result, a1, c[1]);
+            result = vmlaq_n_f32(result, a2, c[2]);
+            result = vmlaq_n_f32(result, a3, c[3]);
+            vst1q_f32(out + column * 4, result);
+        }
+#elif defined(UNIFEYE_VECTORMATH_SSE2)
+        __m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+        for (int column = 0; column < 4; column++)
+        {
+            const float* c = b + column * 4;
+            __m128 result = _mm_mul_ps(a0, _mm_set1_ps(c[0]));
+            result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_set1_ps(c[1])));
+            result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_set1_ps(c[2])));
+            result = _mm_add_ps(result, _mm_mul_ps(a3, _mm_set1_ps(c[3])));
+            _mm_storeu_ps(out + column * 4, result);
+        }
+#else
+        multiplyMatricesScalar(a, b, out);
+#endif
+    }
+
+    /**
+     * \brief General inverse by cofactors
+     * \param m the matrix
+     * \param[out] out the inverse, may be m, all zero if m is singular
+     * \return false if m is singular
+     */
+    inline bool invertMatrix( const float m[16], float out[16] )
+    {
+        float inv[16];
+        inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+        inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+        inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+        inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+        inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+        inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+        inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+        inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+        inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+        inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+        inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+        inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+        inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+        inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+        inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+        inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+        float determinant = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+        float s = determinant != 0.0f ? 1.0f / determinant : 0.0f;
+        for (int i = 0; i < 16; i++)
+            out[i] = inv[i] * s;
+        return determinant != 0.0f;
+    }
+
+    /**
+     * \brief Inverse of a rotation, scale and translation
+     *
+     * The last row of m is taken to be (0, 0, 0, 1). This is cheaper and
+     * more accurate than invertMatrix for model view matrices.
+     *
+     * \param m the matrix
+     * \param[out] out the inverse, must not be m
+     * \return false if m is singular
+     */
+    inline bool invertAffineMatrix( const float m[16], float out[16] )
+    {
+        float a = m[0], b = m[4], c = m[8];
+        float d = m[1], e = m[5], f = m[9];
+        float g = m[2], h = m[6], i = m[10];
+        float determinant = a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+        float s = determinant != 0.0f ? 1.0f / determinant : 0.0f;
+
+        out[0] = (e * i - f * h) * s;  out[4] = (c * h - b * i) * s;  out[8] = (b * f - c * e) * s;
+        out[1] = (f * g - d * i) * s;  out[5] = (a * i - c * g) * s;  out[9] = (c * d - a * f) * s;
+        out[2] = (d * h - e * g) * s;  out[6] = (b * g - a * h) * s;  out[10] = (a * e - b * d) * s;
+        out[3] = out[7] = out[11] = 0.0f;
+        out[15] = 1.0f;
+        for (int row = 0; row < 3; row++)
+            out[12 + row] = -(out[row] * m[12] + out[4 + row] * m[13] + out[8 + row] * m[14]);
+        return determinant != 0.0f;
+    }
+
+    /// out = m * (p, 1), without the division by w, out may be p
+    inline void transformPoint( const float m[16], const float p[3], float out[3] )
+    {
+        float x = p[0], y = p[1], z = p[2];
+        for (int row = 0; row < 3; row++)
+            out[row] = m[row] * x + m[4 + row] * y + m[8 + row] * z + m[12 + row];
+    }
+
+    /// m * (p, 1), without the division by w
+    inline metaio::Vector3d transformPoint( const float m[16], const metaio::Vector3d& p )
+    {
+        return metaio::Vector3d(m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12],
+            m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+            m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14]);
+    }
+
+    /// Transform an array of points with m, without the division by w, out may be points
+    inline void transformPointsScalar( const float m[16], const metaio::Vector3d* points, int count,
+        metaio::Vector3d* out )
+    {
+        for (int i = 0; i < count; i++)
+            out[i] = transformPoint(m, points[i]);
+    }
+
+    /// Transform an array of points with m, without the division by w, out may be points
+    inline void transformPoints( const float m[16], const metaio::Vector3d* points, int count,
+        metaio::Vector3d* out )
+    {
+        int i = 0;
+#if defined(UNIFEYE_VECTORMATH_NEON)
+        // four points at a time, vld3 splits them into x, y and z
+        for (; i + 4 <= count; i += 4)
+        {
+            float32x4x3_t p = vld3q_f32(&points[i].x);
+            float32x4x3_t result;
+            for (int row = 0; row < 3; row++)
+            {
+                float32x4_t v = vmulq_n_f32(p.val[0], m[row]);
+                v = vmlaq_n_f32(v, p.val[1], m[4 + row]);
+                v = vmlaq_n_f32(v, p.val[2], m[8 + row]);
+                result.val[row] = vaddq_f32(v, vdupq_n_f32(m[12 + row]));
+            }
+            vst3q_f32(&out[i].x, result);
+        }
+#endif
+        // SSE2 has no deinterleaving load: the shuffles cost more than the scalar
+        // loop, which the compiler vectorizes. Use transformPointsSoA instead.
+        transformPointsScalar(m, points + i, count - i, out + i);
+    }
+
+    /// As transformPointsSoA
+    inline void transformPointsSoAScalar( const float m[16], const float* x, const float* y, const float* z, int count,
+        float* outX, float* outY, float* outZ )
+    {
+        for (int i = 0; i < count; i++)
+        {
+            float px = x[i], py = y[i], pz = z[i];
+            outX[i] = m[0] * px + m[4] * py + m[8] * pz + m[12];
+            outY[i] = m[1] * px + m[5] * py + m[9] * pz + m[13];
+            outZ[i] = m[2] * px + m[6] * py + m[10] * pz + m[14];
+        }
+    }
+
+    /**
+     * \brief Transform points stored as arrays of coordinates, without the division by w
+     *
+     * The layout the SIMD units want: four points are three plain loads and
+     * stores, where transformPoints has to split the packed Vector3d first.
+     *
+     * \param m the matrix
+     * \param x, y, z the coordinates
+     * \param count number of points
+     * \param[out] outX, outY, outZ the transformed coordinates, may be x, y and z
+     */
+    inline void transformPointsSoA( const float m[16], const float* x, const float* y, const float* z, int count,
+        float* outX, float* outY, float* outZ )
+    {
+        int i = 0;
+#if defined(UNIFEYE_VECTORMATH_NEON)
+        for (; i + 4 <= count; i += 4)
+        {
+            float32x4_t px = vld1q_f32(x + i), py = vld1q_f32(y + i), pz = vld1q_f32(z + i);
+            float32x4_t result[3];
+            for (int row = 0; row < 3; row++)
+            {
+                float32x4_t v = vmulq_n_f32(px, m[row]);
+                v = vmlaq_n_f32(v, py, m[4 + row]);
+                v = vmlaq_n_f32(v, pz, m[8 + row]);
+                result[row] = vaddq_f32(v, vdupq_n_f32(m[12 + row]));
+            }
+            vst1q_f32(outX + i, result[0]);
+            vst1q_f32(outY + i, result[1]);
+            vst1q_f32(outZ + i, result[2]);
+        }
+#elif defined(UNIFEYE_VECTORMATH_SSE2)
+        // the rows are spelled out, a loop over them keeps the matrix in memory
+        __m128 m0 = _mm_set1_ps(m[0]), m1 = _mm_set1_ps(m[1]), m2 = _mm_set1_ps(m[2]);
+        __m128 m4 = _mm_set1_ps(m[4]), m5 = _mm_set1_ps(m[5]), m6 = _mm_set1_ps(m[6]);
+        __m128 m8 = _mm_set1_ps(m[8]), m9 = _mm_set1_ps(m[9]), m10 = _mm_set1_ps(m[10]);
+        __m128 m12 = _mm_set1_ps(m[12]), m13 = _mm_set1_ps(m[13]), m14 = _mm_set1_ps(m[14]);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+            __m128 rx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m0), _mm_mul_ps(py, m4)), _mm_mul_ps(pz, m8)), m12);
+            __m128 ry = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m1), _mm_mul_ps(py, m5)), _mm_mul_ps(pz, m9)), m13);
+            __m128 rz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m2), _mm_mul_ps(py, m6)), _mm_mul_ps(pz, m10)), m14);
+            _mm_storeu_ps(outX + i, rx);
+            _mm_storeu_ps(outY + i, ry);
+            _mm_storeu_ps(outZ + i, rz);
+        }
+#endif
+        transformPointsSoAScalar(m, x + i, y + i, z + i, count - i, outX + i, outY + i, outZ + i);
+    }
+
+    /// a * b, the rotation b followed by a
+    inline metaio::Vector4d multiplyQuaternions( const metaio::Vector4d& a, const metaio::Vector4d& b )
+    {
+        return metaio::Vector4d(a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+            a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+            a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+            a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z);
+    }
+
+    /// The inverse rotation of a unit quaternion
+    inline metaio::Vector4d conjugateQuaternion( const metaio::Vector4d& q )
+    {
+        return metaio::Vector4d(-q.x, -q.y, -q.z, q.w);
+    }
+
+    /// q with length one, the identity if q is zero
+    inline metaio::Vector4d normalizeQuaternion( const metaio::Vector4d& q )
+    {
+        float norm = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+        if (norm <= 0.0f)
+            return metaio::Vector4d(0.0f, 0.0f, 0.0f, 1.0f);
+        float s = 1.0f / norm;
+        return metaio::Vector4d(q.x * s, q.y * s, q.z * s, q.w * s);
+    }
+
+    /**
+     * \brief Spherical linear interpolation of unit quaternions
+     *
+     * Takes the shorter way, and falls back to normalized linear
+     * interpolation where the two are too close for the sine.
+     *
+     * \param a the rotation at t = 0
+     * \param b the rotation at t = 1
+     * \param t the interpolation parameter
+     * \return the interpolated unit quaternion
+     */
+    inline metaio::Vector4d slerp( const metaio::Vector4d& a, const metaio::Vector4d& b, float t )
+    {
+        float dot = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+        float sign = 1.0f;
+        if (dot < 0.0f)
+        {
+            dot = -dot;
+            sign = -1.0f;
+        }
+
+        float wa = 1.0f - t, wb = t;
+        if (dot < 0.9995f)
+        {
+            float angle = acosf(dot);
+            float s = 1.0f / sinf(angle);
+            wa = sinf(wa * angle) * s;
+            wb = sinf(wb * angle) * s;
+        }
+        wb *= sign;
+        return normalizeQuaternion(metaio::Vector4d(wa * a.x + wb * b.x, wa * a.y + wb * b.y,
+            wa * a.z + wb * b.z, wa * a.w + wb * b.w));
+    }
+
+    /// Unit quaternion of an axis angle rotation, the identity for a zero axis
+    inline metaio::Vector4d axisAngleToQuaternion( const metaio::Vector4d& axisAngle )
+    {
+        float length = sqrtf(axisAngle.x * axisAngle.x + axisAngle.y * axisAngle.y + axisAngle.z * axisAngle.z);
+        if (length <= 0.0f)
+            return metaio::Vector4d(0.0f, 0.0f, 0.0f, 1.0f);
+        float s = sinf(0.5f * axisAngle.w) / length;
+        return metaio::Vector4d(axisAngle.x * s, axisAngle.y * s, axisAngle.z * s, cosf(0.5f * axisAngle.w));
+    }
+
+    /// Axis angle rotation of a unit quaternion, the angle is in [0, pi]
+    inline metaio::Vector4d quaternionToAxisAngle( const metaio::Vector4d& q )
+    {
+        float sign = q.w < 0.0f ? -1.0f : 1.0f;
+        float sinHalf = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z);
+        if (sinHalf <= 0.0f)
+            return metaio::Vector4d(1.0f, 0.0f, 0.0f, 0.0f);
+        float s = sign / sinHalf;
+        return metaio::Vector4d(q.x * s, q.y * s, q.z * s, 2.0f * atan2f(sinHalf, sign * q.w));
+    }
+
+    /**
+     * \brief Rotation and translation matrix
+     * \param q unit quaternion
+     * \param translation the translation
+     * \param[out] out the matrix
+     */
+    inline void quaternionToMatrix( const metaio::Vector4d& q, const metaio::Vector3d& translation, float out[16] )
+    {
+        float x = q.x, y = q.y, z = q.z, w = q.w;
+
+        out[0] = 1.0f - 2.0f * (y * y + z * z);
+        out[1] = 2.0f * (x * y + z * w);
+        out[2] = 2.0f * (x * z - y * w);
+        out[3] = 0.0f;
+
+        out[4] = 2.0f * (x * y - z * w);
+        out[5] = 1.0f - 2.0f * (x * x + z * z);
+        out[6] = 2.0f * (y * z + x * w);
+        out[7] = 0.0f;
+
+        out[8] = 2.0f * (x * z + y * w);
+        out[9] = 2.0f * (y * z - x * w);
+        out[10] = 1.0f - 2.0f * (x * x + y * y);
+        out[11] = 0.0f;
+
+        out[12] = translation.x;
+        out[13] = translation.y;
+        out[14] = translation.z;
+        out[15] = 1.0f;
+    }
+
+    /// Rotation matrix of a unit quaternion
+    inline void quaternionToMatrix( const metaio::Vector4d& q, float out[16] )
+    {
+        quaternionToMatrix(q, metaio::Vector3d(0.0f, 0.0f, 0.0f), out);
+    }
+
+    /// Matrix of a pose, the same as getTrackingValues
+    inline void poseToMatrix( const metaio::Pose& pose, float out[16] )
+    {
+        quaternionToMatrix(pose.rotation, pose.translation, out);
+    }
+
+    /**
+     * \brief Unit quaternion of the rotation in a matrix
+     *
+     * Uses the largest of w, x, y and z to divide by (Shepperd), so it is
+     * stable for all rotations. The matrix must not be scaled.
+     *
+     * \param m the matrix
+     * \return the quaternion with w >= 0
+     */
+    inline metaio::Vector4d matrixToQuaternion( const float m[16] )
+    {
+        float trace = m[0] + m[5] + m[10];
+        metaio::Vector4d q;
+        if (trace > 0.0f)
+        {
+            float s = 2.0f * sqrtf(1.0f + trace);
+            q = metaio::Vector4d((m[6] - m[9]) / s, (m[8] - m[2]) / s, (m[1] - m[4]) / s, 0.25f * s);
+        }
+        else if (m[0] > m[5] && m[0] > m[10])
+        {
+            float s = 2.0f * sqrtf(1.0f + m[0] - m[5] - m[10]);
+            q = metaio::Vector4d(0.25f * s, (m[4] + m[1]) / s, (m[8] + m[2]) / s, (m[6] - m[9]) / s);
+        }
+        else if (m[5] > m[10])
+        {
+            float s = 2.0f * sqrtf(1.0f + m[5] - m[0] - m[10]);
+            q = metaio::Vector4d((m[4] + m[1]) / s, 0.25f * s, (m[9] + m[6]) / s, (m[8] - m[2]) / s);
+        }
+        else
+        {
+            float s = 2.0f * sqrtf(1.0f + m[10] - m[0] - m[5]);
+            q = metaio::Vector4d((m[8] + m[2]) / s, (m[9] + m[6]) / s, 0.25f * s, (m[1] - m[4]) / s);
+        }
+        if (q.w < 0.0f)
+            q = metaio::Vector4d(-q.x, -q.y, -q.z, -q.w);
+        return normalizeQuaternion(q);
+    }
+
+    /// As quaternionsToMatrices
+    inline void quaternionsToMatricesScalar( const float* qx, const float* qy, const float* qz, const float* qw,
+        const float* tx, const float* ty, const float* tz, int count, float* out )
+    {
+        for (int i = 0; i < count; i++)
+        {
+            quaternionToMatrix(metaio::Vector4d(qx[i], qy[i], qz[i], qw[i]),
+                metaio::Vector3d(tx[i], ty[i], tz[i]), out + i * 16);
+        }
+    }
+
+    /**
+     * \brief Rotation and translation matrices of poses stored as arrays
+     * \param qx, qy, qz, qw the unit quaternions
+     * \param tx, ty, tz the translations
+     * \param count number of poses
+     * \param[out] out 16 floats per pose
+     */
+    inline void quaternionsToMatrices( const float* qx, const float* qy, const float* qz, const float* qw,
+        const float* tx, const float* ty, const float* tz, int count, float* out )
+    {
+        int i = 0;
+#if defined(UNIFEYE_VECTORMATH_NEON) || defined(UNIFEYE_VECTORMATH_SSE2)
+        // four poses at a time, one register per matrix element, transposed into the matrices
+        for (; i + 4 <= count; i += 4)
+        {
+#if defined(UNIFEYE_VECTORMATH_NEON)
+            float32x4_t x = vld1q_f32(qx + i), y = vld1q_f32(qy + i), z = vld1q_f32(qz + i), w = vld1q_f32(qw + i);
+            float32x4_t one = vdupq_n_f32(1.0f), zero = vdupq_n_f32(0.0f);
+            float32x4_t x2 = vaddq_f32(x, x), y2 = vaddq_f32(y, y), z2 = vaddq_f32(z, z);
+            float32x4_t xx = vmulq_f32(x, x2), yy = vmulq_f32(y, y2), zz = vmulq_f32(z, z2);
+            float32x4_t xy = vmulq_f32(x, y2), xz = vmulq_f32(x, z2), yz = vmulq_f32(y, z2);
+            float32x4_t wx = vmulq_f32(w, x2), wy = vmulq_f32(w, y2), wz = vmulq_f32(w, z2);
+
+            float32x4_t e[16] = {
+                vsubq_f32(one, vaddq_f32(yy, zz)), vaddq_f32(xy, wz), vsubq_f32(xz, wy), zero,
+                vsubq_f32(xy, wz), vsubq_f32(one, vaddq_f32(xx, zz)), vaddq_f32(yz, wx), zero,
+                vaddq_f32(xz, wy), vsubq_f32(yz, wx), vsubq_f32(one, vaddq_f32(xx, yy)), zero,
+                vld1q_f32(tx + i), vld1q_f32(ty + i), vld1q_f32(tz + i), one };
+
+            for (int column = 0; column < 4; column++)
+            {
+                float32x4x2_t t01 = vtrnq_f32(e[column * 4], e[column * 4 + 1]);
+                float32x4x2_t t23 = vtrnq_f32(e[column * 4 + 2], e[column * 4 + 3]);
+                float* o = out + i * 16 + column * 4;
+                vst1q_f32(o, vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0])));
+                vst1q_f32(o + 16, vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1])));
+                vst1q_f32(o + 32, vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0])));
+                vst1q_f32(o + 48, vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1])));
+            }
+#else
+            __m128 x = _mm_loadu_ps(qx + i), y = _mm_loadu_ps(qy + i), z = _mm_loadu_ps(qz + i), w = _mm_loadu_ps(qw + i);
+            __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+            __m128 x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+            __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+            __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+            __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+            __m128 e[16] = {
+                _mm_sub_ps(one, _mm_add_ps(yy, zz)), _mm_add_ps(xy, wz), _mm_sub_ps(xz, wy), zero,
+                _mm_sub_ps(xy, wz), _mm_sub_ps(one, _mm_add_ps(xx, zz)), _mm_add_ps(yz, wx), zero,
+                _mm_add_ps(xz, wy), _mm_sub_ps(yz, wx), _mm_sub_ps(one, _mm_add_ps(xx, yy)), zero,
+                _mm_loadu_ps(tx + i), _mm_loadu_ps(ty + i), _mm_loadu_ps(tz + i), one };
+
+            for (int column = 0; column < 4; column++)
+            {
+                __m128 r0 = e[column * 4], r1 = e[column * 4 + 1], r2 = e[column * 4 + 2], r3 = e[column * 4 + 3];
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                float* o = out + i * 16 + column * 4;
+                _mm_storeu_ps(o, r0);
+                _mm_storeu_ps(o + 16, r1);
+                _mm_storeu_ps(o + 32, r2);
+                _mm_storeu_ps(o + 48, r3);
+            }
+#endif
+        }
+#endif
+        quaternionsToMatricesScalar(qx + i, qy + i, qz + i, qw + i, tx + i, ty + i, tz + i, count - i, out + i * 16);
+    }
+}
+
+#endif
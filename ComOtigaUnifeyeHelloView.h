@@ -7,6 +7,7 @@
 #import "TiUIView.h"
 #import <UnifeyeSDKMobile/AS_IUnifeyeMobileIPhone.h>
 #import "EAGLView.h"
+#import "ComOtigaUnifeyeSensorSource.h"
 
 namespace metaio
 {
@@ -14,8 +15,40 @@ namespace metaio
     class IUnifeyeMobileGeometry;   // forward declaration
 }
 
+namespace unifeye
+{
+    class FrameScheduler;           // forward declaration
+    class IFrameClock;              // forward declaration
+    class IFrameTarget;             // forward declaration
+    class CameraFrameRing;          // forward declaration
+    class PoseSnapshot;             // forward declaration
+    class PoseFilter;               // forward declaration
+    class PoseCorrection;           // forward declaration
+    class GeometryCache;            // forward declaration
+    class UnifeyeFrustumCulling;    // forward declaration
+    class UnifeyePicking;           // forward declaration
+    class SessionRecorder;          // forward declaration
+    class SessionPlayer;            // forward declaration
+    class UnifeyeSessionSink;       // forward declaration
+    class SensorPipeline;           // forward declaration
+    class ISensorTarget;            // forward declaration
+    class FrameGovernor;            // forward declaration
+    class ICaptureCamera;           // forward declaration
+    class CaptureResolutionManager; // forward declaration
+    class CommandQueue;             // forward declaration
+    class UnifeyeCommandTarget;     // forward declaration
+    class PoseStream;               // forward declaration
+    class CallbackDispatcher;       // forward declaration
+    class ICallbackListener;        // forward declaration
+    class UnifeyeCallbackAdapter;   // forward declaration
+}
+
+struct HelloViewMovies;             // forward declaration
+struct HelloViewPois;               // forward declaration
+struct HelloViewSensorValues;       // forward declaration
+
 @interface ComOtigaUnifeyeHelloView : TiUIView <UnifeyeMobileDelegate>{
-metaio::IUnifeyeMobileIPhone*			unifeyeMobile;	
+metaio::IUnifeyeMobileIPhone*			unifeyeMobile;	// shared, see ComOtigaUnifeyeEngine
     
     EAGLContext *context;               // our OpenGL Context
     NSInteger animationFrameInterval;   // refresh interval
@@ -23,9 +56,68 @@ metaio::IUnifeyeMobileIPhone*			unifeyeMobile;
     
     EAGLView *glView;                   // our OpenGL View
 
+    unifeye::FrameScheduler* frameScheduler;    // paces render() on the display link
+    unifeye::IFrameClock* frameClock;
+    unifeye::IFrameTarget* frameTarget;
+    
+    unifeye::CameraFrameRing* cameraFrames;     // frames delivered by onNewCameraFrame
+    unifeye::PoseSnapshot* poses;               // tracking values of the last rendered frame
+    unifeye::PoseFilter* poseFilter;
+    unifeye::PoseSnapshot* filteredPoses;       // poses smoothed and predicted to the frame time
+    unifeye::PoseCorrection* poseCorrection;    // offsets that render the filtered poses
+    unifeye::PoseStream* poseStream;            // publishes the poses to "pose" listeners
+    BOOL poseStreamEnabled;
+    BOOL poseStreamFiltered;                    // publish filteredPoses instead of poses
+    
+    unifeye::GeometryCache* geometryCache;      // of the shared SDK instance, not owned
+    metaio::IUnifeyeMobileGeometry* model;      // acquired from the cache
+    unifeye::UnifeyeFrustumCulling* frustumCulling;     // hides geometries outside the view
+    unifeye::UnifeyePicking* picking;                   // finds the geometry under a touch
+    unifeye::CommandQueue* commandQueue;                // batches from applyBatch(), applied once per frame
+    unifeye::UnifeyeCommandTarget* commandTarget;       // the geometries loaded by handle
+    
+    unifeye::CallbackDispatcher* callbackDispatcher;    // fires the SDK callbacks as events, off the render loop
+    unifeye::ICallbackListener* callbackListener;
+    unifeye::UnifeyeCallbackAdapter* callbackAdapter;
+    
+    HelloViewMovies* movies;                    // decoded on threads of their own, uploaded once per frame
+    HelloViewPois* pois;                        // billboards streamed around the sensor, NULL before loadPois()
+    
+    unifeye::SessionRecorder* sessionRecorder;  // records camera frames and poses while open
+    unifeye::SessionPlayer* sessionPlayer;      // replaces the camera while open
+    unifeye::UnifeyeSessionSink* sessionSink;
+    BOOL sessionRealTime;                       // replay paced by the frame time, else a frame per render
+    double sessionStart;                        // frame time the replay started at, negative before
+    
+    unifeye::ISensorTarget* sensorTarget;
+    unifeye::SensorPipeline* sensorPipeline;    // sensor samples, applied once per frame
+    ComOtigaUnifeyeSensorSource* sensorSource;
+    BOOL sensorsEnabled;
+    HelloViewSensorValues* sensorValues;        // the position and heading last applied, for the POIs
+    
+    unifeye::FrameGovernor* governor;           // lowers the frame rate and freezes the tracking when idle
+    
+    unifeye::ICaptureCamera* captureCamera;
+    unifeye::CaptureResolutionManager* captureResolution;  // starts the camera at what the tracking manages
 }
 @property (nonatomic, retain) IBOutlet EAGLView *glView;
 @property (nonatomic, retain) EAGLContext *context;
 @property (nonatomic, assign) CADisplayLink *displayLink;
 
+- (void)startAnimation;
+- (void)stopAnimation;
+- (void)drawFrame:(double)frameTime;
+
+// Camera frames requested with requestCameraImage(). Take a lease to read them.
+- (unifeye::CameraFrameRing*)cameraFrames;
+
+// Tracking values of the last rendered frame, updated once per frame.
+- (const unifeye::PoseSnapshot*)poses;
+
+// The same poses filtered and extrapolated to the time of the frame.
+- (const unifeye::PoseSnapshot*)filteredPoses;
+
+// Titanium's count of listeners of an event changed.
+- (void)listenerCountChanged:(NSString*)type count:(int)count;
+
 @end
@@ -10,13 +10,244 @@
 #import <UnifeyeSDKMobile/AS_IUnifeyeMobileGeometry.h>
 #import "EAGLView.h"
 #import "TiUtils.h"
+#import "TiBlob.h"
+#import "TiBuffer.h"
+#include "FrameScheduler.h"
+#include "CameraFrameRing.h"
+#include "PoseSnapshot.h"
+#include "PoseFilter.h"
+#include "PoseStream.h"
+#include "GeometryCache.h"
+#include "FrustumCuller.h"
+#include "Picker.h"
+#include "PerfTrace.h"
+#include "SessionRecorder.h"
+#include "SessionPlayer.h"
+#include "SensorPipeline.h"
+#include "FrameGovernor.h"
+#include "CaptureResolution.h"
+#include "CommandBuffer.h"
+#include "CallbackDispatcher.h"
+#include "MovieTexture.h"
+#include "PoiStreamer.h"
+#import "ComOtigaUnifeyeEngine.h"
+#import "ComOtigaUnifeyeMovieSource.h"
+#include <map>
+#include <string>
+
+@interface ComOtigaUnifeyeHelloView ()
+- (void)tick;
+- (void)replaySession:(double)frameTime;
+- (void)applyGovernorDecision;
+- (void)captureResolutionChanged;
+- (void)publishPoses:(double)frameTime;
+- (void)updateMovies:(double)frameTime;
+- (id)resultOnMainThread:(SEL)selector withObject:(id)args;
+- (void)performOnMainThread:(SEL)selector withObject:(id)args;
+- (void)batteryChanged:(NSNotification*)notification;
+@end
+
+// CADisplayLink retains its target, so it points at this trampoline instead
+// of the view. Otherwise the view would never be deallocated while running.
+@interface ComOtigaUnifeyeDisplayLinkTarget : NSObject {
+    ComOtigaUnifeyeHelloView* view;     // not retained
+}
+- (id)initWithView:(ComOtigaUnifeyeHelloView*)aView;
+- (void)tick:(CADisplayLink*)sender;
+@end
+
+@implementation ComOtigaUnifeyeDisplayLinkTarget
+- (id)initWithView:(ComOtigaUnifeyeHelloView*)aView
+{
+    if ((self = [super init]))
+    {
+        view = aView;
+    }
+    return self;
+}
+
+- (void)tick:(CADisplayLink*)sender
+{
+    [view tick];
+}
+@end
+
+// Forwards frames of the scheduler to the view
+class HelloViewFrameTarget : public unifeye::IFrameTarget
+{
+public:
+    HelloViewFrameTarget( ComOtigaUnifeyeHelloView* _view ) : view(_view) {};
+
+    virtual void renderFrame( double frameTime )
+    {
+        [view drawFrame:frameTime];
+    }
+
+private:
+    ComOtigaUnifeyeHelloView* view;     // not retained
+};
+
+// The sensor values last given to the SDK, live or replayed
+struct HelloViewSensorValues
+{
+    metaio::LLACoordinate lla;
+    float heading;                      // compass angle in degrees, negative before the first one
+
+    HelloViewSensorValues() : heading(-1.0f) {};
+};
+
+// Applies the sensor values to the SDK, records them while a session is
+// recorded and tells the governor how much the device moves
+class HelloViewSensorTarget : public unifeye::UnifeyeSensorTarget
+{
+public:
+    HelloViewSensorTarget( metaio::IUnifeyeMobile* unifeye, unifeye::SessionRecorder* _recorder,
+                           unifeye::FrameGovernor* _governor, HelloViewSensorValues* _values ) :
+        unifeye::UnifeyeSensorTarget(unifeye), recorder(_recorder), governor(_governor), values(_values) {};
+
+    virtual void setAccelerometer( const metaio::Vector3d& values, double timestamp )
+    {
+        unifeye::UnifeyeSensorTarget::setAccelerometer(values, timestamp);
+        recorder->recordAccelerometer(values, timestamp);
+        governor->addAccelerometer(values, timestamp);
+    }
+
+    virtual void setCompassAngle( float angle, double timestamp )
+    {
+        unifeye::UnifeyeSensorTarget::setCompassAngle(angle, timestamp);
+        recorder->recordCompassAngle(angle, timestamp);
+        values->heading = angle;
+    }
+
+    virtual void setLLA( const metaio::LLACoordinate& position, double timestamp )
+    {
+        unifeye::UnifeyeSensorTarget::setLLA(position, timestamp);
+        recorder->recordSensorLLA(position, timestamp);
+        values->lla = position;
+    }
+
+private:
+    unifeye::SessionRecorder* recorder;     // not owned
+    unifeye::FrameGovernor* governor;       // not owned
+    HelloViewSensorValues* values;          // not owned
+};
+
+// Feeds a replayed session to the SDK and keeps its sensor values for the POIs
+class HelloViewSessionSink : public unifeye::UnifeyeSessionSink
+{
+public:
+    HelloViewSessionSink( metaio::IUnifeyeMobile* unifeye, const std::string& imagePath, HelloViewSensorValues* _values ) :
+        unifeye::UnifeyeSessionSink(unifeye, imagePath), values(_values) {};
+
+    virtual void onSensorLLA( const metaio::LLACoordinate& position, double timestamp )
+    {
+        unifeye::UnifeyeSessionSink::onSensorLLA(position, timestamp);
+        values->lla = position;
+    }
+
+    virtual void onCompassAngle( float angle, double timestamp )
+    {
+        unifeye::UnifeyeSessionSink::onCompassAngle(angle, timestamp);
+        values->heading = angle;
+    }
+
+private:
+    HelloViewSensorValues* values;          // not owned
+};
+
+// Fires the SDK callbacks as Titanium events, on the thread of the dispatcher
+class HelloViewCallbackListener : public unifeye::ICallbackListener
+{
+public:
+    HelloViewCallbackListener( ComOtigaUnifeyeHelloView* _view ) : view(_view) {};
+
+    virtual void deliver( const unifeye::CallbackEvent& event )
+    {
+        NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+        NSDictionary* properties;
+        if (event.type == unifeye::CALLBACK_ANIMATION_END)
+        {
+            properties = [NSDictionary dictionaryWithObjectsAndKeys:
+                [NSNumber numberWithInt:event.handle], @"handle",
+                [NSString stringWithUTF8String:event.name], @"name", nil];
+        }
+        else
+        {
+            properties = [NSDictionary dictionaryWithObjectsAndKeys:
+                [NSNumber numberWithInt:event.width], @"width",
+                [NSNumber numberWithInt:event.height], @"height",
+                [NSNumber numberWithUnsignedLong:event.frame], @"frame",
+                [NSNumber numberWithUnsignedLong:event.coalesced], @"skipped", nil];
+        }
+        [view.proxy fireEvent:[NSString stringWithUTF8String:unifeye::getCallbackEventName(event.type)] withObject:properties];
+        [pool drain];
+    }
+
+private:
+    ComOtigaUnifeyeHelloView* view;     // not retained
+};
+
+// A movie played into the texture of a geometry
+struct HelloViewMovie
+{
+    unifeye::MoviePlayer* player;
+    std::string textureName;
+    double start;                       // frame time of its first frame, negative before
+};
+
+// The movies by the handle of their geometry
+struct HelloViewMovies : public std::map<int, HelloViewMovie> {};
+
+// The POIs of loadPois(), streamed in and out around the sensor position
+struct HelloViewPois
+{
+    unifeye::BillboardTextures textures;    // the images of the POIs, by path
+    unifeye::GeoIndex index;
+    unifeye::UnifeyePoiFactory factory;
+    unifeye::PoiStreamer* streamer;         // needs the index built
+
+    HelloViewPois( metaio::IUnifeyeMobile* unifeye, const std::vector<metaio::LLACoordinate>& points ) :
+        textures(unifeye), factory(&textures, std::string()), streamer(NULL)
+    {
+        index.build(points.empty() ? NULL : &points[0], (int)points.size());
+        streamer = new unifeye::PoiStreamer(index, &factory);
+    }
+
+    ~HelloViewPois()
+    {
+        delete streamer;
+    }
+};
+
+// The mesh compiled from a model by meshc, next to it, or an empty path
+static std::string compiledMeshFor( NSString* path )
+{
+    NSString* mesh = [[path stringByDeletingPathExtension] stringByAppendingPathExtension:@"umesh"];
+    return [[NSFileManager defaultManager] isReadableFileAtPath:mesh] ? [mesh UTF8String] : std::string();
+}
+
+// Decodes an image file for BillboardTextures, BGRA in memory like ECF_A8R8G8B8
+static bool loadPoiImage( NSString* path, std::vector<unsigned char>& pixels, metaio::ImageStruct& image )
+{
+    CGImageRef decoded = [UIImage imageWithContentsOfFile:path].CGImage;
+    if (!decoded)
+        return false;
+    
+    size_t width = CGImageGetWidth(decoded), height = CGImageGetHeight(decoded);
+    pixels.assign(width * height * 4, 0);
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef bitmap = CGBitmapContextCreate(&pixels[0], width, height, 8, width * 4, colorSpace,
+                                                kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Little);
+    CGColorSpaceRelease(colorSpace);
+    if (!bitmap)
+        return false;
+    
+    CGContextDrawImage(bitmap, CGRectMake(0, 0, width, height), decoded);
+    CGContextRelease(bitmap);
+    image = metaio::ImageStruct(&pixels[0], (int)width, (int)height, metaio::common::ECF_A8R8G8B8, true);
+    return true;
+}
 
-// Define your License here
-// for more information, please visit http://docs.metaio.com
-#define UNIFEYE_LICENSE "LLVMA/d0+x862jdnA79Wz32Gv7l3Vx4011SQa6GY6S8="
-#if !defined (UNIFEYE_LICENSE)
-#error Please provide the license string for your application
-#endif
 
 @implementation ComOtigaUnifeyeHelloView
 
@@ -28,54 +259,86 @@
     NSLog(@"[Proxy] init");
 	if ((self = [super init]))
 	{
-        if( !context )
-        {
-            EAGLContext *aContext = [[EAGLContext alloc] initWithAPI:kEAGLRenderingAPIOpenGLES2];
-            
-            if (!aContext) {
-                NSLog(@"Failed to create ES context");
-            } else if (![EAGLContext setCurrentContext:aContext]) {
-                NSLog(@"Failed to set ES context current");
-            }
-            self.context = aContext;
-            [aContext release];
-        }
-        
-        
-        // set the openGL context
-        [glView setContext:context];
-        [glView setFramebuffer];
-
         self.displayLink = nil;
         
         // limit OpenGL framerate to 30FPS, as the camera has a maximum of 30FPS anyway
         animationFrameInterval = 2;
         
-        // create unifeye instance
-        unifeyeMobile = metaio::CreateUnifeyeMobileIPhone(UNIFEYE_LICENSE);
+        frameClock = new unifeye::SystemFrameClock();
+        frameTarget = new HelloViewFrameTarget(self);
+        frameScheduler = new unifeye::FrameScheduler(frameClock, frameTarget);
+        frameScheduler->setTargetFrameRate(60.0f / animationFrameInterval);
+        
+        // room for the largest capture resolution the manager may switch to, in any color format
+        metaio::Vector2di largest = unifeye::getLargestCaptureResolution();
+        cameraFrames = new unifeye::CameraFrameRing(4, largest.x, largest.y, metaio::common::ECF_A8R8G8B8);
+        poses = new unifeye::PoseSnapshot();
+        poseFilter = new unifeye::PoseFilter();
+        filteredPoses = new unifeye::PoseSnapshot();
+        poseCorrection = new unifeye::PoseCorrection();
+        poseStream = new unifeye::PoseStream();
+        movies = new HelloViewMovies();
+        sensorValues = new HelloViewSensorValues();
+        commandQueue = new unifeye::CommandQueue();
+        
+        // the callbacks arrive inside render(), the events are fired from another thread
+        callbackListener = new HelloViewCallbackListener(self);
+        callbackDispatcher = new unifeye::CallbackDispatcher(callbackListener, frameClock);
+        callbackDispatcher->start();
+        
+        sessionRecorder = new unifeye::SessionRecorder();
+        sessionPlayer = new unifeye::SessionPlayer();
+        
+        // starts at the frame rate above, lower when nothing happens
+        governor = new unifeye::FrameGovernor();
+        unifeye::GovernorParameters governorParameters;
+        governorParameters.fullFrameRate = frameScheduler->getTargetFrameRate();
+        governor->setParameters(governorParameters);
+        
+        [UIDevice currentDevice].batteryMonitoringEnabled = YES;
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(batteryChanged:)
+                                                     name:UIDeviceBatteryLevelDidChangeNotification object:nil];
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(batteryChanged:)
+                                                     name:UIDeviceBatteryStateDidChangeNotification object:nil];
+        [self batteryChanged:nil];
+        
+        // the instance is shared by the views and usually warmed up since the module loaded
+        unifeyeMobile = [[ComOtigaUnifeyeEngine sharedEngine] acquireUnifeye];
         if( !unifeyeMobile )
         {
-            NSLog(@"Unifeye instance could not be created. Please verify the signature string");
-            return;
+            NSLog(@"Unifeye instance could not be created, see unifeye.getEngineTimeline()");
+            return self;
         }
         
-        // Create our Unifeye instance
-        float scaleFactor = [UIScreen mainScreen].scale;	
-        if (UI_USER_INTERFACE_IDIOM() == UIUserInterfaceIdiomPad)
-        {
-            // don't limit framerate on iPad
-            unifeyeMobile->initializeRenderer(768, 1024);
-            NSLog(@"iPad mode");
-        }
-        else
-        {
-            // Note: the dimensions of the EAGLView should match the dimensions below (360x480)
-            // the camera image has an aspect ratio of 360/480, the screen has an aspect ratio of 320/480
-            unifeyeMobile->initializeRenderer(360 * scaleFactor, 480 * scaleFactor);
-        }
+        // set the openGL context, the one the renderer was initialized with
+        self.context = [[ComOtigaUnifeyeEngine sharedEngine] context];
+        [EAGLContext setCurrentContext:context];
+        [glView setContext:context];
+        [glView setFramebuffer];
+        
+        // register our callback method for animations and camera frames
+        [[ComOtigaUnifeyeEngine sharedEngine] takeOwnership:self];
+        
+        // the models outlive the view, opening it again finds them loaded
+        geometryCache = [[ComOtigaUnifeyeEngine sharedEngine] geometryCache];
+        frustumCulling = new unifeye::UnifeyeFrustumCulling(unifeyeMobile);
+        picking = new unifeye::UnifeyePicking(unifeyeMobile);
+        commandTarget = new unifeye::UnifeyeCommandTarget(frustumCulling);
+        callbackAdapter = new unifeye::UnifeyeCallbackAdapter(callbackDispatcher, commandTarget);
+        
+        NSString* caches = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) objectAtIndex:0];
+        sessionSink = new HelloViewSessionSink(unifeyeMobile, [[caches stringByAppendingPathComponent:@"unifeye-session-frame.png"] UTF8String], sensorValues);
         
-        // register our callback method for animations
-        //unifeyeMobile->registerDelegate(self);
+        // 480x360 until the tracking cost is known
+        captureCamera = new unifeye::UnifeyeCaptureCamera(unifeyeMobile);
+        captureResolution = new unifeye::CaptureResolutionManager(captureCamera);
+        
+        // the sensors update the SDK at most at the tracking rate
+        sensorTarget = new HelloViewSensorTarget(unifeyeMobile, sessionRecorder, governor, sensorValues);
+        sensorPipeline = new unifeye::SensorPipeline(sensorTarget);
+        sensorPipeline->setApplyRate(30.0);
+        sensorSource = [[ComOtigaUnifeyeSensorSource alloc] initWithPipeline:sensorPipeline clock:frameClock];
+        sensorsEnabled = YES;
 
         
 	}
@@ -90,54 +353,1137 @@
 
 - (void)dealloc
 {
+    [self stopAnimation];
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+    
+    // no samples may arrive once the pipeline is gone
+    [sensorSource stop];
+    [sensorSource release];
+    delete sensorPipeline;
+    delete sensorTarget;
+    delete governor;
+    
+    // the decoders stop before the geometries go
+    for (HelloViewMovies::iterator it = movies->begin(); it != movies->end(); ++it)
+        delete it->second.player;
+    delete movies;
+    
+    // render() no longer runs, so no more callbacks; the thread uses the clock
+    delete callbackDispatcher;
+    delete callbackAdapter;
+    delete callbackListener;
+    
+    delete frameScheduler;
+    delete frameTarget;
+    delete frameClock;
+    
+    // the instance outlives the view, its camera and delegate may belong to a newer view by now
+    if (unifeyeMobile) {
+        if ([[ComOtigaUnifeyeEngine sharedEngine] isOwner:self]) {
+            [self resetPoseCorrection];
+            [[ComOtigaUnifeyeEngine sharedEngine] resignOwnership:self];
+        }
+        [EAGLContext setCurrentContext:context];
+    }
+
+    // the model and the geometries loaded by handle go back to the cache
+    if (model) {
+        frustumCulling->removeGeometry(model);
+        picking->removeGeometry(model);
+        geometryCache->release(model);
+        model = NULL;
+    }
+    for (int handle = 1; commandTarget && handle <= commandTarget->getHandleCount(); handle++) {
+        metaio::IUnifeyeMobileGeometry* geometry = commandTarget->removeGeometry(handle);
+        if (geometry)
+            geometryCache->release(geometry);
+    }
+    delete picking;
+    delete commandTarget;
+    delete commandQueue;
+    delete pois;
+
+    // the cached geometries stay with the SDK instance
+    delete captureResolution;
+    delete captureCamera;
+    delete frustumCulling;
+    delete sessionRecorder;
+    delete sessionPlayer;
+    delete sessionSink;
+    
     if ([EAGLContext currentContext] == context) {
         [EAGLContext setCurrentContext:nil];
     }
-
+    
     if (unifeyeMobile) {
-        delete unifeyeMobile;
+        [[ComOtigaUnifeyeEngine sharedEngine] releaseUnifeye];
         unifeyeMobile = NULL;
     }
+    
+    delete cameraFrames;
+    delete poses;
+    delete poseFilter;
+    delete filteredPoses;
+    delete poseCorrection;
+    delete poseStream;
+    delete sensorValues;
 
     [context release];
     [glView release];
 	[super dealloc];
 }
 
+#pragma mark Threads
+
+// The render loop owns the SDK and the scene on the main thread, methods
+// called from JavaScript that change them run there
+- (id)resultOnMainThread:(SEL)selector withObject:(id)args
+{
+    __block id result = nil;
+    TiThreadPerformOnMainThread(^{
+        result = [[self performSelector:selector withObject:args] retain];
+    }, YES);
+    return [result autorelease];
+}
+
+- (void)performOnMainThread:(SEL)selector withObject:(id)args
+{
+    TiThreadPerformOnMainThread(^{
+        [self performSelector:selector withObject:args];
+    }, YES);
+}
+
+#pragma mark Render loop
+
+- (void)startAnimation
+{
+    if (displayLink || !frameScheduler)
+        return;
+    
+    ComOtigaUnifeyeDisplayLinkTarget* linkTarget = [[ComOtigaUnifeyeDisplayLinkTarget alloc] initWithView:self];
+    CADisplayLink *aDisplayLink = [CADisplayLink displayLinkWithTarget:linkTarget selector:@selector(tick:)];
+    [linkTarget release];
+    
+    [aDisplayLink setFrameInterval:frameScheduler->getTickInterval()];
+    [aDisplayLink addToRunLoop:[NSRunLoop currentRunLoop] forMode:NSDefaultRunLoopMode];
+    self.displayLink = aDisplayLink;
+    
+    frameScheduler->start();
+}
+
+- (void)stopAnimation
+{
+    if (!displayLink)
+        return;
+    
+    frameScheduler->stop();
+    
+    [displayLink invalidate];
+    self.displayLink = nil;
+}
+
+- (void)tick
+{
+    frameScheduler->tick();
+}
+
+-(id)getFrameStats:(id)args
+{
+    // tick() updates the counters on the main thread
+    if (![NSThread isMainThread])
+        return [self resultOnMainThread:_cmd withObject:args];
+    unifeye::FramePacingStats stats = frameScheduler->getStats();
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithFloat:frameScheduler->getTargetFrameRate()], @"frameRate",
+        [NSNumber numberWithUnsignedLong:stats.ticks], @"ticks",
+        [NSNumber numberWithUnsignedLong:stats.framesRendered], @"rendered",
+        [NSNumber numberWithUnsignedLong:stats.framesMissed], @"missed",
+        [NSNumber numberWithUnsignedLong:stats.framesDropped], @"dropped",
+        [NSNumber numberWithDouble:stats.meanFrameCost], @"meanCost",
+        [NSNumber numberWithDouble:stats.lastFrameCost], @"lastCost",
+        [NSNumber numberWithDouble:stats.jitterP50], @"jitterP50",
+        [NSNumber numberWithDouble:stats.jitterP95], @"jitterP95",
+        [NSNumber numberWithDouble:stats.jitterP99], @"jitterP99",
+        [NSNumber numberWithDouble:stats.jitterMax], @"jitterMax", nil];
+}
+
+- (void)drawFrame:(double)frameTime
+{
+    if (!unifeyeMobile)
+        return;
+    
+    UNIFEYE_PERF_SCOPE("frame");
+    if (sessionPlayer->isOpen())
+        [self replaySession:frameTime];
+    else
+        sensorPipeline->apply(frameTime);
+    
+    // the POIs around the position just given to the SDK
+    if (pois && !sensorValues->lla.isNull())
+    {
+        UNIFEYE_PERF_SCOPE("pois");
+        pois->streamer->update(sensorValues->lla, sensorValues->heading);
+        pois->factory.update(sensorValues->lla, sensorValues->heading);
+    }
+    
+    // the scene updates of applyBatch() since the last frame
+    {
+        UNIFEYE_PERF_SCOPE("commands");
+        commandQueue->apply(*commandTarget);
+    }
+    
+    // the movie frames due, decoded and merged already
+    if (!movies->empty())
+    {
+        UNIFEYE_PERF_SCOPE("movies");
+        [self updateMovies:frameTime];
+    }
+    
+    // the poses of the last frame filtered and predicted to this one, drawn there if asked to
+    {
+        UNIFEYE_PERF_SCOPE("poseFilter");
+        poseFilter->filter(*poses, *filteredPoses, frameTime);
+        [self applyPoseCorrection];
+    }
+    
+    // render() captures and tracks too, its time is the cost of a tracked frame
+    [glView setFramebuffer];
+    double renderStart = frameClock->now();
+    {
+        UNIFEYE_PERF_SCOPE("render");
+        unifeyeMobile->render();
+    }
+    double renderCost = frameClock->now() - renderStart;
+    [glView presentFramebuffer];
+    
+    // the one place per frame that asks the SDK for the poses
+    {
+        UNIFEYE_PERF_SCOPE("poses");
+        poses->update(unifeyeMobile, frameTime);
+    }
+    [self publishPoses:frameTime];
+    
+    // a replay runs at the full rate, the recorded motion is not the device's
+    if (!sessionPlayer->isOpen())
+    {
+        float trackingFrameRate = unifeyeMobile->getTrackingFrameRate();
+        governor->update(frameTime, *poses, trackingFrameRate);
+        if (governor->changed())
+            [self applyGovernorDecision];
+        
+        // frozen tracking tells nothing about its cost
+        const unifeye::GovernorDecision& decision = governor->getDecision();
+        bool profiling = captureResolution->isProfiling();
+        if (!decision.freezeTracking &&
+            (captureResolution->update(frameTime, trackingFrameRate, renderCost, decision.frameRate) ||
+             profiling != captureResolution->isProfiling()))
+        {
+            [self captureResolutionChanged];
+        }
+    }
+    
+    // the camera frames only arrive on request
+    if (sessionRecorder->isOpen())
+        sessionRecorder->recordPoses(*poses);
+    if (sessionRecorder->isOpen() || callbackDispatcher->isListening(unifeye::CALLBACK_CAMERA_FRAME))
+        unifeyeMobile->requestCameraImage();
+    
+    // hides what is off screen from the next render() on
+    {
+        UNIFEYE_PERF_SCOPE("frustumCulling");
+        frustumCulling->update(*poses);
+    }
+    
+    geometryCache->update();
+}
+
+#pragma mark UnifeyeMobileDelegate
+
+- (void)onNewCameraFrame:(metaio::ImageStruct*)cameraFrame
+{
+    // the SDK reuses the buffer, this is the only copy consumers will need
+    UNIFEYE_PERF_SCOPE("cameraFrameCallback");
+    double timestamp = frameClock->now();
+    cameraFrames->push(*cameraFrame, timestamp);
+    sessionRecorder->recordCameraFrame(*cameraFrame, timestamp);
+    
+    callbackAdapter->setFrameSequence(cameraFrames->getLatestSequence());
+    callbackAdapter->onNewCameraFrame(cameraFrame);
+}
+
+- (void)onAnimationEnd:(metaio::IUnifeyeMobileGeometry*)geometry andName:(NSString*)animationName
+{
+    if (callbackDispatcher->isListening(unifeye::CALLBACK_ANIMATION_END))
+        callbackAdapter->onAnimationEnd(geometry, [animationName UTF8String]);
+}
+
+- (unifeye::CameraFrameRing*)cameraFrames
+{
+    return cameraFrames;
+}
+
+- (const unifeye::PoseSnapshot*)poses
+{
+    return poses;
+}
+
+- (const unifeye::PoseSnapshot*)filteredPoses
+{
+    return filteredPoses;
+}
+
+#pragma mark Pose filter
+
+// Offsets the coordinate systems so that render() draws the filtered poses
+// (see PoseCorrection), and takes them away from those no longer drawn so.
+- (void)applyPoseCorrection
+{
+    poseCorrection->update(*poses, *filteredPoses, *poseFilter);
+    for (int i = 0; i < poseCorrection->getResetCount(); i++)
+        unifeyeMobile->setCosOffset(poseCorrection->getResetCosID(i), unifeye::PoseCorrection::identity());
+    for (int i = 0; i < poseCorrection->getCount(); i++)
+        unifeyeMobile->setCosOffset(poseCorrection->getCosID(i), poseCorrection->getOffset(i));
+}
+
+// The instance is shared, the next view must not inherit our offsets
+- (void)resetPoseCorrection
+{
+    for (int i = 0; i < poseCorrection->getCount(); i++)
+        unifeyeMobile->setCosOffset(poseCorrection->getCosID(i), unifeye::PoseCorrection::identity());
+}
+
+#pragma mark Pose stream
+
+// Publishes a frame of poses when the stream decides to (see PoseStream.h).
+// The event is delivered later on the JavaScript thread, so it gets a buffer
+// of its own that the next frame does not touch.
+- (void)publishPoses:(double)frameTime
+{
+    if (!poseStreamEnabled || ![self.proxy _hasListeners:@"pose"])
+    {
+        // whoever listens next gets the current poses right away
+        poseStream->reset();
+        return;
+    }
+    
+    UNIFEYE_PERF_SCOPE("poseStream");
+    if (!poseStream->update(poseStreamFiltered ? *filteredPoses : *poses, frameTime))
+        return;
+    
+    TiBuffer* poseBuffer = [[[TiBuffer alloc] _initWithPageContext:[self.proxy pageContext]] autorelease];
+    [poseBuffer setData:[NSMutableData dataWithBytes:poseStream->getData() length:poseStream->getSize()]];
+    
+    [self.proxy fireEvent:@"pose" withObject:[NSDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithUnsignedInt:poseStream->getSequence()], @"sequence",
+        poseBuffer, @"buffer", nil]];
+}
+
+-(id)getPoseStreamStats:(id)args
+{
+    // publishPoses updates the stream on the main thread
+    if (![NSThread isMainThread])
+        return [self resultOnMainThread:_cmd withObject:args];
+    unifeye::PoseStreamStats stats = poseStream->getStats();
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithUnsignedLong:stats.updates], @"frames",
+        [NSNumber numberWithUnsignedLong:stats.published], @"published",
+        [NSNumber numberWithUnsignedLong:stats.unchanged], @"unchanged",
+        [NSNumber numberWithUnsignedInt:poseStream->getSequence()], @"sequence", nil];
+}
+
+#pragma mark Callback events
+
+- (void)initializeState
+{
+    [super initializeState];
+    
+    // listeners added before the view existed
+    for (int i = 0; callbackDispatcher && i < unifeye::CALLBACK_EVENT_COUNT; i++)
+    {
+        unifeye::CALLBACK_EVENT type = (unifeye::CALLBACK_EVENT)i;
+        NSString* name = [NSString stringWithUTF8String:unifeye::getCallbackEventName(type)];
+        callbackDispatcher->setListenerCount(type, [self.proxy _hasListeners:name] ? 1 : 0);
+    }
+}
+
+- (void)listenerCountChanged:(NSString*)type count:(int)count
+{
+    for (int i = 0; callbackDispatcher && i < unifeye::CALLBACK_EVENT_COUNT; i++)
+    {
+        unifeye::CALLBACK_EVENT event = (unifeye::CALLBACK_EVENT)i;
+        if ([type isEqualToString:[NSString stringWithUTF8String:unifeye::getCallbackEventName(event)]])
+            callbackDispatcher->setListenerCount(event, count);
+    }
+}
+
+-(id)getCallbackStats:(id)args
+{
+    if (!callbackDispatcher)
+        return [NSNull null];
+    
+    unifeye::CallbackStats stats = callbackDispatcher->getStats();
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithUnsignedLong:stats.posted], @"posted",
+        [NSNumber numberWithUnsignedLong:stats.ignored], @"ignored",
+        [NSNumber numberWithUnsignedLong:stats.coalesced], @"coalesced",
+        [NSNumber numberWithUnsignedLong:stats.dropped], @"dropped",
+        [NSNumber numberWithUnsignedLong:stats.delivered], @"delivered",
+        [NSNumber numberWithDouble:stats.meanLatency * 1000.0], @"meanLatency",
+        [NSNumber numberWithDouble:stats.maxLatency * 1000.0], @"maxLatency", nil];
+}
+
+#pragma mark Screenshots
+
+-(void)takeScreenshot:(id)args
+{
+    // the image is read when the next frame is presented and arrives as an event
+    [glView requestScreenshot:^(UIImage* screenshot) {
+        UNIFEYE_PERF_SCOPE("screenshotCallback");
+        if (screenshot && [self.proxy _hasListeners:@"screenshot"])
+        {
+            TiBlob* blob = [[[TiBlob alloc] initWithImage:screenshot] autorelease];
+            [self.proxy fireEvent:@"screenshot" withObject:[NSDictionary dictionaryWithObject:blob forKey:@"image"]];
+        }
+    }];
+}
+
+#pragma mark Scene
+
+// Load a model to move with applyBatch(). The path is relative to the
+// resources unless it is absolute; returns the handle or null.
+-(id)loadGeometry:(id)args
+{
+    // the SDK uploads the model with the context of the main thread
+    if (![NSThread isMainThread])
+        return [self resultOnMainThread:_cmd withObject:args];
+    ENSURE_SINGLE_ARG(args, NSString);
+    NSString* path = [args isAbsolutePath] ? args : [[[NSBundle mainBundle] resourcePath] stringByAppendingPathComponent:args];
+    
+    if (geometryCache)
+        [EAGLContext setCurrentContext:context];
+    metaio::IUnifeyeMobileGeometry* geometry = geometryCache ? geometryCache->acquire([path UTF8String]) : NULL;
+    if (!geometry)
+    {
+        NSLog(@"[ERROR] could not load %@", path);
+        return [NSNull null];
+    }
+    
+    int handle = commandTarget->addGeometry(geometry);
+    if (!handle)
+    {
+        geometryCache->release(geometry);
+        return [NSNull null];
+    }
+    
+    // a compiled mesh next to the model lets pick() test the triangles
+    picking->addGeometry(geometry, compiledMeshFor(path));
+    return [NSNumber numberWithInt:handle];
+}
+
+-(void)unloadGeometry:(id)args
+{
+    if (![NSThread isMainThread])
+    {
+        [self performOnMainThread:_cmd withObject:args];
+        return;
+    }
+    ENSURE_SINGLE_ARG(args, NSNumber);
+    [self stopMovieTexture:args];
+    metaio::IUnifeyeMobileGeometry* geometry = commandTarget ? commandTarget->removeGeometry([TiUtils intValue:args]) : NULL;
+    if (geometry)
+    {
+        // an evicted model is unloaded with the context it was loaded with
+        [EAGLContext setCurrentContext:context];
+        picking->removeGeometry(geometry);
+        geometryCache->release(geometry);
+    }
+}
+
+// The model under a position of the view, in points: {handle, depth} with
+// handle 0 for the built-in model, or null.
+-(id)pick:(id)args
+{
+    if (![NSThread isMainThread])
+        return [self resultOnMainThread:_cmd withObject:args];
+    ENSURE_SINGLE_ARG(args, NSDictionary);
+    if (!picking)
+        return [NSNull null];
+    
+    float depth = 0;
+    CGSize size = self.bounds.size;
+    metaio::IUnifeyeMobileGeometry* geometry = picking->pick(*poses, (int)size.width, (int)size.height,
+        [TiUtils floatValue:@"x" properties:args def:0], [TiUtils floatValue:@"y" properties:args def:0],
+        [TiUtils boolValue:@"exact" properties:args def:YES], depth);
+    if (!geometry)
+        return [NSNull null];
+    
+    int handle = 0;
+    for (int i = 1; geometry != model && i <= commandTarget->getHandleCount(); i++) {
+        if (commandTarget->getGeometry(i) == geometry)
+            handle = i;
+    }
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithInt:handle], @"handle",
+        [NSNumber numberWithFloat:depth], @"depth", nil];
+}
+
+// Queue a batch of commands (see CommandBuffer.h) for the next frame. Takes
+// a Ti.Buffer or a Ti.Blob, returns the number of commands or null if the
+// batch is malformed; nothing of a malformed batch is applied.
+-(id)applyBatch:(id)args
+{
+    ENSURE_SINGLE_ARG(args, NSObject);
+    NSData* data = nil;
+    if ([args isKindOfClass:[TiBuffer class]])
+        data = [(TiBuffer*)args data];
+    else if ([args isKindOfClass:[TiBlob class]])
+        data = [(TiBlob*)args data];
+    
+    if (!data || !commandQueue)
+    {
+        NSLog(@"[ERROR] applyBatch takes a Ti.Buffer or a Ti.Blob");
+        return [NSNull null];
+    }
+    
+    unifeye::CommandResult result = commandQueue->submit([data bytes], [data length]);
+    if (!result.ok)
+    {
+        NSLog(@"[ERROR] malformed batch at byte %lu", (unsigned long)result.errorOffset);
+        return [NSNull null];
+    }
+    return [NSNumber numberWithUnsignedLong:result.commands];
+}
+
+-(id)getCommandStats:(id)args
+{
+    // the target counts the unknown handles while applying on the main thread
+    if (![NSThread isMainThread])
+        return [self resultOnMainThread:_cmd withObject:args];
+    if (!commandQueue)
+        return [NSNull null];
+    
+    unifeye::CommandQueueStats stats = commandQueue->getStats();
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithUnsignedLong:stats.batches], @"batches",
+        [NSNumber numberWithUnsignedLong:stats.rejected], @"rejected",
+        [NSNumber numberWithUnsignedLong:stats.commands], @"commands",
+        [NSNumber numberWithUnsignedLong:stats.frames], @"frames",
+        [NSNumber numberWithUnsignedLong:commandTarget ? commandTarget->getUnknownHandles() : 0], @"unknownHandles", nil];
+}
+
+#pragma mark Movie textures
+
+// Play a movie into the texture of a geometry loaded by handle, {handle,
+// path, loop, transparent}. Transparent movies are side by side like the
+// ones of the SDK's setMovieTexture(): the left half is the color, the red
+// channel of the right half the alpha. Returns whether it plays.
+-(id)startMovieTexture:(id)args
+{
+    // updateMovies() walks the players on the main thread
+    if (![NSThread isMainThread])
+        return [self resultOnMainThread:_cmd withObject:args];
+    ENSURE_SINGLE_ARG(args, NSDictionary);
+    int handle = [TiUtils intValue:@"handle" properties:args def:0];
+    NSString* path = [TiUtils stringValue:@"path" properties:args];
+    if (!commandTarget || !commandTarget->getGeometry(handle) || !path)
+    {
+        NSLog(@"[ERROR] startMovieTexture takes the handle of a loaded geometry and a path");
+        return [NSNumber numberWithBool:NO];
+    }
+    [self stopMovieTexture:[NSNumber numberWithInt:handle]];
+    
+    if (![path isAbsolutePath])
+        path = [[[NSBundle mainBundle] resourcePath] stringByAppendingPathComponent:path];
+    unifeye::AssetMovieSource* source = unifeye::AssetMovieSource::open([path UTF8String]);
+    if (!source)
+    {
+        NSLog(@"[ERROR] could not play the movie %@", path);
+        return [NSNumber numberWithBool:NO];
+    }
+    
+    unifeye::MovieParameters parameters;
+    parameters.loop = [TiUtils boolValue:@"loop" properties:args def:NO];
+    parameters.transparent = [TiUtils boolValue:@"transparent" properties:args def:NO];
+    
+    HelloViewMovie movie;
+    movie.player = new unifeye::MoviePlayer(source, parameters);
+    movie.textureName = [[NSString stringWithFormat:@"unifeye-movie-%d", handle] UTF8String];
+    movie.start = -1.0;
+    if (!movie.player->start())
+    {
+        delete movie.player;
+        return [NSNumber numberWithBool:NO];
+    }
+    (*movies)[handle] = movie;
+    return [NSNumber numberWithBool:YES];
+}
+
+-(void)stopMovieTexture:(id)args
+{
+    if (![NSThread isMainThread])
+    {
+        [self performOnMainThread:_cmd withObject:args];
+        return;
+    }
+    ENSURE_SINGLE_ARG(args, NSNumber);
+    HelloViewMovies::iterator it = movies->find([TiUtils intValue:args]);
+    if (it == movies->end())
+        return;
+    delete it->second.player;
+    movies->erase(it);
+}
+
+// Hands the frames due to the geometries. setTexture() with an updateable
+// texture keeps its name and only uploads the pixels.
+- (void)updateMovies:(double)frameTime
+{
+    HelloViewMovies::iterator it = movies->begin();
+    while (it != movies->end())
+    {
+        HelloViewMovie& movie = it->second;
+        if (movie.start < 0.0)
+            movie.start = frameTime;
+        
+        const unifeye::MovieFrame* frame = movie.player->update(frameTime - movie.start);
+        metaio::IUnifeyeMobileGeometry* geometry = commandTarget->getGeometry(it->first);
+        if (frame && geometry)
+        {
+            metaio::ImageStruct image(const_cast<unsigned char*>(&frame->pixels[0]), movie.player->getWidth(),
+                movie.player->getHeight(), movie.player->getColorFormat(), true);
+            geometry->setTexture(movie.textureName, image, true);
+        }
+        
+        if (!movie.player->isFinished())
+        {
+            ++it;
+            continue;
+        }
+        
+        unifeye::MovieStats stats = movie.player->getStats();
+        NSDictionary* event = [NSDictionary dictionaryWithObjectsAndKeys:
+            [NSNumber numberWithInt:it->first], @"handle",
+            [NSNumber numberWithUnsignedLong:stats.shown], @"shown",
+            [NSNumber numberWithUnsignedLong:stats.dropped + stats.skipped], @"dropped", nil];
+        delete movie.player;
+        movies->erase(it++);
+        if ([self.proxy _hasListeners:@"movieend"])
+            [self.proxy fireEvent:@"movieend" withObject:event];
+    }
+}
+
+-(id)getMovieStats:(id)args
+{
+    if (![NSThread isMainThread])
+        return [self resultOnMainThread:_cmd withObject:args];
+    ENSURE_SINGLE_ARG(args, NSNumber);
+    HelloViewMovies::iterator it = movies->find([TiUtils intValue:args]);
+    if (it == movies->end())
+        return [NSNull null];
+    
+    unifeye::MovieStats stats = it->second.player->getStats();
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithUnsignedLong:stats.decoded], @"decoded",
+        [NSNumber numberWithUnsignedLong:stats.skipped], @"skipped",
+        [NSNumber numberWithUnsignedLong:stats.dropped], @"dropped",
+        [NSNumber numberWithUnsignedLong:stats.shown], @"shown",
+        [NSNumber numberWithUnsignedLong:stats.stalls], @"stalls",
+        [NSNumber numberWithUnsignedLong:stats.loops], @"loops", nil];
+}
+
+#pragma mark POIs
+
+// Stream billboards in and out around the sensor position, {pois:
+// [{latitude, longitude, altitude, image}], image, loadRadius, unloadRadius,
+// fieldOfView, maxLoaded, declutter}. Image paths are relative to the
+// resources unless absolute, a POI without one gets the image of all.
+// Replaces the POIs loaded before and returns the number of POIs.
+-(id)loadPois:(id)args
+{
+    if (![NSThread isMainThread])
+        return [self resultOnMainThread:_cmd withObject:args];
+    
+    ENSURE_SINGLE_ARG(args, NSDictionary);
+    [self unloadPois:nil];
+    NSArray* entries = [args objectForKey:@"pois"];
+    if (!unifeyeMobile || ![entries isKindOfClass:[NSArray class]])
+    {
+        NSLog(@"[ERROR] loadPois takes an array of pois");
+        return [NSNumber numberWithInt:0];
+    }
+    
+    NSString* defaultImage = [TiUtils stringValue:@"image" properties:args];
+    std::vector<metaio::LLACoordinate> points;
+    NSMutableArray* images = [NSMutableArray arrayWithCapacity:[entries count]];
+    for (NSDictionary* entry in entries)
+    {
+        if (![entry isKindOfClass:[NSDictionary class]])
+            continue;
+        NSString* image = [TiUtils stringValue:@"image" properties:entry];
+        image = image ? image : defaultImage;
+        if (!image)
+            continue;
+        
+        points.push_back(metaio::LLACoordinate([TiUtils doubleValue:@"latitude" properties:entry def:0.0],
+                                               [TiUtils doubleValue:@"longitude" properties:entry def:0.0],
+                                               [TiUtils doubleValue:@"altitude" properties:entry def:0.0], 0.0));
+        [images addObject:[image isAbsolutePath] ? image :
+            [[[NSBundle mainBundle] resourcePath] stringByAppendingPathComponent:image]];
+    }
+    
+    [EAGLContext setCurrentContext:context];
+    pois = new HelloViewPois(unifeyeMobile, points);
+    
+    // every image is decoded once, the POIs showing it share its texture
+    std::vector<unsigned char> pixels;
+    for (int i = 0; i < (int)points.size(); i++)
+    {
+        std::string path = [[images objectAtIndex:i] UTF8String];
+        metaio::ImageStruct image;
+        if (!pois->textures.hasImage(path) &&
+            (!loadPoiImage([images objectAtIndex:i], pixels, image) || !pois->textures.addImage(path, image)))
+        {
+            NSLog(@"[ERROR] could not load the POI image %@", [images objectAtIndex:i]);
+        }
+        pois->factory.setImage(i, path);
+    }
+    
+    unifeye::PoiStreamerParameters parameters;
+    parameters.loadRadius = [TiUtils floatValue:@"loadRadius" properties:args def:parameters.loadRadius];
+    parameters.unloadRadius = [TiUtils floatValue:@"unloadRadius" properties:args def:parameters.loadRadius * 1.2f];
+    parameters.fieldOfView = [TiUtils floatValue:@"fieldOfView" properties:args def:parameters.fieldOfView];
+    parameters.maxLoaded = [TiUtils intValue:@"maxLoaded" properties:args def:parameters.maxLoaded];
+    pois->streamer->setParameters(parameters);
+    pois->factory.setDeclutterEnabled([TiUtils boolValue:@"declutter" properties:args def:NO]);
+    return [NSNumber numberWithInt:(int)points.size()];
+}
+
+-(void)unloadPois:(id)args
+{
+    if (![NSThread isMainThread])
+    {
+        [self performOnMainThread:_cmd withObject:args];
+        return;
+    }
+    if (!pois)
+        return;
+    
+    [EAGLContext setCurrentContext:context];
+    delete pois;
+    pois = NULL;
+}
+
+// The POIs loaded and what it took.
+-(id)getPoiStats:(id)args
+{
+    if (![NSThread isMainThread])
+        return [self resultOnMainThread:_cmd withObject:args];
+    if (!pois)
+        return [NSNull null];
+    
+    const unifeye::PoiStreamerStats& stats = pois->streamer->getStats();
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithInt:pois->index.getPointCount()], @"pois",
+        [NSNumber numberWithInt:(int)pois->streamer->getLoaded().size()], @"loaded",
+        [NSNumber numberWithUnsignedLong:stats.loads], @"loads",
+        [NSNumber numberWithUnsignedLong:stats.unloads], @"unloads",
+        [NSNumber numberWithUnsignedLong:stats.failures], @"failures",
+        [NSNumber numberWithInt:stats.pending], @"pending",
+        [NSNumber numberWithInt:pois->textures.getTextureCount()], @"images",
+        [NSNumber numberWithUnsignedLong:(unsigned long)pois->textures.getImageBytes()], @"imageBytes", nil];
+}
+
+#pragma mark Sessions
+
+// Record camera frames and poses to a file (see SessionRecorder.h). Takes an
+// optional path, returns the path recorded to or null.
+-(id)startRecording:(id)args
+{
+    NSString* path = [args count] > 0 ? [TiUtils stringValue:[args objectAtIndex:0]] : nil;
+    if (!path)
+    {
+        NSString* caches = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) objectAtIndex:0];
+        path = [caches stringByAppendingPathComponent:@"unifeye-session.uses"];
+    }
+    
+    if (!sessionRecorder->open([path UTF8String]))
+    {
+        NSLog(@"[ERROR] could not record to %@", path);
+        return [NSNull null];
+    }
+    return path;
+}
+
+-(void)stopRecording:(id)args
+{
+    if (sessionRecorder->isOpen() && !sessionRecorder->close())
+        NSLog(@"[ERROR] the session could not be written completely");
+}
+
+// Replay a recorded session instead of the camera, {path, realTime}.
+-(id)playSession:(id)args
+{
+    // the render loop reads the player on the main thread
+    if (![NSThread isMainThread])
+        return [self resultOnMainThread:_cmd withObject:args];
+    ENSURE_SINGLE_ARG(args, NSDictionary);
+    NSString* path = [TiUtils stringValue:@"path" properties:args];
+    [self stopSession:nil];
+    
+    if (!path || !unifeyeMobile || !sessionPlayer->open([path UTF8String]))
+    {
+        NSLog(@"[ERROR] could not play the session %@", path);
+        return [NSNumber numberWithBool:NO];
+    }
+    
+    captureResolution->stop();
+    [sensorSource stop];
+    governor->reset();
+    [self applyGovernorDecision];
+    sessionRealTime = [TiUtils boolValue:@"realTime" properties:args def:YES];
+    sessionStart = -1.0;
+    return [NSNumber numberWithBool:YES];
+}
+
+-(void)stopSession:(id)args
+{
+    if (![NSThread isMainThread])
+    {
+        [self performOnMainThread:_cmd withObject:args];
+        return;
+    }
+    if (!sessionPlayer->isOpen())
+        return;
+    
+    sessionPlayer->close();
+    if (unifeyeMobile)
+        captureResolution->start(frameClock->now());
+    if (sensorsEnabled)
+        [sensorSource start];
+}
+
+- (void)replaySession:(double)frameTime
+{
+    UNIFEYE_PERF_SCOPE("sessionReplay");
+    if (sessionStart < 0.0)
+        sessionStart = frameTime;
+    
+    if (sessionRealTime)
+    {
+        sessionPlayer->advance(*sessionSink, frameTime - sessionStart);
+    }
+    else
+    {
+        // as fast as the render loop goes: one camera frame per rendered frame
+        unsigned long frames = sessionPlayer->getStats().frames;
+        while (sessionPlayer->getStats().frames == frames && sessionPlayer->next(*sessionSink))
+            ;
+    }
+    
+    if (!sessionPlayer->isFinished())
+        return;
+    
+    const unifeye::SessionPlayerStats& stats = sessionPlayer->getStats();
+    NSDictionary* event = [NSDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithUnsignedLong:stats.frames], @"frames",
+        [NSNumber numberWithUnsignedLong:stats.skippedFrames], @"skippedFrames",
+        [NSNumber numberWithDouble:sessionPlayer->getDuration()], @"duration",
+        [NSNumber numberWithDouble:frameTime - sessionStart], @"elapsed", nil];
+    [self stopSession:nil];
+    if ([self.proxy _hasListeners:@"sessionend"])
+        [self.proxy fireEvent:@"sessionend" withObject:event];
+}
+
+#pragma mark Sensors
+
+// Counters of the sensor pipeline, one entry per sensor.
+-(id)getSensorStats:(id)args
+{
+    static const char* names[unifeye::SENSOR_COUNT] = { "accelerometer", "compass", "lla" };
+    if (!sensorPipeline)
+        return [NSNull null];
+    
+    NSMutableDictionary* result = [NSMutableDictionary dictionaryWithCapacity:unifeye::SENSOR_COUNT];
+    for (int s = 0; s < unifeye::SENSOR_COUNT; s++)
+    {
+        unifeye::SensorStats stats = sensorPipeline->getStats((unifeye::SENSOR)s);
+        NSDictionary* entry = [NSDictionary dictionaryWithObjectsAndKeys:
+            [NSNumber numberWithUnsignedLong:stats.received], @"received",
+            [NSNumber numberWithUnsignedLong:stats.dropped], @"dropped",
+            [NSNumber numberWithUnsignedLong:stats.applied], @"applied",
+            [NSNumber numberWithUnsignedLong:stats.coalesced], @"coalesced",
+            [NSNumber numberWithDouble:stats.latency * 1000.0], @"latency", nil];
+        [result setObject:entry forKey:[NSString stringWithUTF8String:names[s]]];
+    }
+    return result;
+}
+
+#pragma mark Governor
+
+- (void)applyGovernorDecision
+{
+    const unifeye::GovernorDecision& decision = governor->getDecision();
+    frameScheduler->setTargetFrameRate(decision.frameRate);
+    animationFrameInterval = frameScheduler->getTickInterval();
+    [displayLink setFrameInterval:animationFrameInterval];
+    if (unifeyeMobile && [[ComOtigaUnifeyeEngine sharedEngine] isOwner:self])
+        unifeyeMobile->setFreezeTracking(decision.freezeTracking);
+    
+    if ([self.proxy _hasListeners:@"governorchange"])
+    {
+        NSDictionary* event = [NSDictionary dictionaryWithObjectsAndKeys:
+            [NSString stringWithUTF8String:unifeye::getGovernorModeName(decision.mode)], @"mode",
+            [NSNumber numberWithFloat:decision.frameRate], @"frameRate",
+            [NSNumber numberWithBool:decision.freezeTracking], @"trackingFrozen", nil];
+        [self.proxy fireEvent:@"governorchange" withObject:event];
+    }
+}
+
+// iOS has no thermal state to go with it, a tracking rate that falls behind stands in for that
+- (void)batteryChanged:(NSNotification*)notification
+{
+    UIDevice* device = [UIDevice currentDevice];
+    BOOL charging = device.batteryState == UIDeviceBatteryStateCharging || device.batteryState == UIDeviceBatteryStateFull;
+    governor->setPowerState(device.batteryLevel, charging, 0);
+}
+
+// The mode of the governor and the seconds spent in each mode.
+-(id)getGovernorStats:(id)args
+{
+    // drawFrame updates the decision and the times on the main thread
+    if (![NSThread isMainThread])
+        return [self resultOnMainThread:_cmd withObject:args];
+    const unifeye::GovernorStats& stats = governor->getStats();
+    NSMutableDictionary* timeInMode = [NSMutableDictionary dictionaryWithCapacity:unifeye::GOVERNOR_MODE_COUNT];
+    for (int m = 0; m < unifeye::GOVERNOR_MODE_COUNT; m++)
+    {
+        [timeInMode setObject:[NSNumber numberWithDouble:stats.timeInMode[m]]
+                       forKey:[NSString stringWithUTF8String:unifeye::getGovernorModeName((unifeye::GOVERNOR_MODE)m)]];
+    }
+    
+    const unifeye::GovernorDecision& decision = governor->getDecision();
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+        [NSString stringWithUTF8String:unifeye::getGovernorModeName(decision.mode)], @"mode",
+        [NSNumber numberWithFloat:decision.frameRate], @"frameRate",
+        [NSNumber numberWithFloat:governor->getMotion()], @"motion",
+        timeInMode, @"timeInMode",
+        [NSNumber numberWithUnsignedLong:stats.transitions], @"transitions",
+        [NSNumber numberWithUnsignedLong:stats.rechecks], @"rechecks", nil];
+}
+
+#pragma mark Capture resolution
+
+- (void)captureResolutionChanged
+{
+    // the camera refused the new resolution and the one before
+    if (!captureResolution->isRunning())
+        NSLog(@"[ERROR] the camera could not be restarted");
+    
+    metaio::Vector2di resolution = captureResolution->getActualResolution();
+    NSLog(@"[View] capturing at %dx%d (%s)", resolution.x, resolution.y,
+          unifeye::getCaptureReasonName(captureResolution->getReason()));
+    
+    if ([self.proxy _hasListeners:@"captureresolution"])
+    {
+        NSDictionary* event = [NSDictionary dictionaryWithObjectsAndKeys:
+            [NSNumber numberWithInt:resolution.x], @"width",
+            [NSNumber numberWithInt:resolution.y], @"height",
+            [NSString stringWithUTF8String:unifeye::getCaptureReasonName(captureResolution->getReason())], @"reason", nil];
+        [self.proxy fireEvent:@"captureresolution" withObject:event];
+    }
+}
+
+// The capture resolution, why it was chosen and the tracking it gets.
+-(id)getCaptureStats:(id)args
+{
+    // the render loop switches the resolution on the main thread
+    if (![NSThread isMainThread])
+        return [self resultOnMainThread:_cmd withObject:args];
+    if (!captureResolution)
+        return [NSNull null];
+    
+    metaio::Vector2di resolution = captureResolution->getResolution();
+    metaio::Vector2di actual = captureResolution->getActualResolution();
+    unifeye::CaptureStats stats = captureResolution->getStats();
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithInt:resolution.x], @"width",
+        [NSNumber numberWithInt:resolution.y], @"height",
+        [NSNumber numberWithInt:actual.x], @"actualWidth",
+        [NSNumber numberWithInt:actual.y], @"actualHeight",
+        [NSString stringWithUTF8String:unifeye::getCaptureReasonName(captureResolution->getReason())], @"reason",
+        [NSNumber numberWithBool:captureResolution->isProfiling()], @"profiling",
+        [NSNumber numberWithFloat:stats.trackingRate], @"trackingRate",
+        [NSNumber numberWithDouble:stats.trackingCost * 1000.0], @"trackingCost",
+        [NSNumber numberWithUnsignedLong:stats.switches], @"switches",
+        [NSNumber numberWithUnsignedLong:stats.failures], @"failures", nil];
+}
+
+#pragma mark Properties
+
+-(void)setTargetFrameRate_:(id)value
+{
+    // the rate of the full mode, the governor starts over from it
+    unifeye::GovernorParameters parameters = governor->getParameters();
+    parameters.fullFrameRate = [TiUtils floatValue:value];
+    governor->setParameters(parameters);
+    governor->reset();
+    [self applyGovernorDecision];
+}
+
+-(void)setCaptureResolution_:(id)value
+{
+    ENSURE_SINGLE_ARG(value, NSDictionary);
+    if (!captureResolution)
+        return;
+    
+    unifeye::CaptureParameters parameters = captureResolution->getParameters();
+    parameters.targetTrackingRate = [TiUtils floatValue:@"targetTrackingRate" properties:value def:parameters.targetTrackingRate];
+    captureResolution->setParameters(parameters);
+    
+    // a width and height fix the resolution, automatic chooses it again
+    metaio::Vector2di fixed = [TiUtils boolValue:@"automatic" properties:value def:NO] ? metaio::Vector2di() :
+        captureResolution->getActualResolution();
+    if ([value objectForKey:@"width"] && [value objectForKey:@"height"])
+        fixed = metaio::Vector2di([TiUtils intValue:@"width" properties:value def:0], [TiUtils intValue:@"height" properties:value def:0]);
+    else if (![value objectForKey:@"automatic"])
+        return;
+    
+    bool wasRunning = captureResolution->isRunning();
+    if (!captureResolution->setFixedResolution(fixed))
+        NSLog(@"[ERROR] the camera could not start at %dx%d", fixed.x, fixed.y);
+    if (wasRunning)
+        [self captureResolutionChanged];
+}
+
+-(void)setGovernor_:(id)value
+{
+    ENSURE_SINGLE_ARG(value, NSDictionary);
+    
+    unifeye::GovernorParameters parameters = governor->getParameters();
+    parameters.enabled = [TiUtils boolValue:@"enabled" properties:value def:parameters.enabled];
+    parameters.cameraFrameRate = [TiUtils floatValue:@"cameraFrameRate" properties:value def:parameters.cameraFrameRate];
+    parameters.reducedFrameRate = [TiUtils floatValue:@"reducedFrameRate" properties:value def:parameters.reducedFrameRate];
+    parameters.idleFrameRate = [TiUtils floatValue:@"idleFrameRate" properties:value def:parameters.idleFrameRate];
+    parameters.freezeDelay = [TiUtils floatValue:@"freezeDelay" properties:value def:parameters.freezeDelay];
+    parameters.idleDelay = [TiUtils floatValue:@"idleDelay" properties:value def:parameters.idleDelay];
+    parameters.recheckInterval = [TiUtils floatValue:@"recheckInterval" properties:value def:parameters.recheckInterval];
+    parameters.lowBattery = [TiUtils floatValue:@"lowBattery" properties:value def:parameters.lowBattery];
+    governor->setParameters(parameters);
+    governor->reset();
+    [self applyGovernorDecision];
+}
+
+-(void)setGeometryCacheBudget_:(id)value
+{
+    // in megabytes
+    if (geometryCache)
+        geometryCache->setBudget((size_t)([TiUtils floatValue:value] * 1024 * 1024));
+}
+
+-(void)setSensors_:(id)value
+{
+    ENSURE_SINGLE_ARG(value, NSDictionary);
+    if (!sensorPipeline)
+        return;
+    
+    sensorsEnabled = [TiUtils boolValue:@"enabled" properties:value def:sensorsEnabled];
+    sensorSource.accelerometerRate = [TiUtils floatValue:@"accelerometerRate" properties:value def:sensorSource.accelerometerRate];
+    sensorPipeline->setApplyRate([TiUtils floatValue:@"updateRate" properties:value def:sensorPipeline->getApplyRate()]);
+    
+    // a replay feeds its own sensor values
+    if (sensorsEnabled && displayLink && !sessionPlayer->isOpen())
+        [sensorSource start];
+    else if (!sensorsEnabled)
+        [sensorSource stop];
+}
+
+-(void)setPoseFilter_:(id)value
+{
+    ENSURE_SINGLE_ARG(value, NSDictionary);
+    
+    // without a cosID the parameters apply to all coordinate systems
+    id cosID = [value objectForKey:@"cosID"];
+    unifeye::PoseFilterParameters parameters = cosID ? poseFilter->getParameters([TiUtils intValue:cosID])
+                                                     : unifeye::PoseFilterParameters();
+    
+    parameters.enabled = [TiUtils boolValue:@"enabled" properties:value def:parameters.enabled];
+    parameters.translationMinCutoff = [TiUtils floatValue:@"translationMinCutoff" properties:value def:parameters.translationMinCutoff];
+    parameters.translationBeta = [TiUtils floatValue:@"translationBeta" properties:value def:parameters.translationBeta];
+    parameters.rotationMinCutoff = [TiUtils floatValue:@"rotationMinCutoff" properties:value def:parameters.rotationMinCutoff];
+    parameters.rotationBeta = [TiUtils floatValue:@"rotationBeta" properties:value def:parameters.rotationBeta];
+    parameters.derivativeCutoff = [TiUtils floatValue:@"derivativeCutoff" properties:value def:parameters.derivativeCutoff];
+    parameters.maxPrediction = [TiUtils floatValue:@"maxPrediction" properties:value def:parameters.maxPrediction];
+    parameters.draw = [TiUtils boolValue:@"draw" properties:value def:parameters.draw];
+    
+    if (cosID)
+    {
+        if (!poseFilter->setParameters([TiUtils intValue:cosID], parameters))
+            NSLog(@"[View] too many coordinate systems with their own pose filter");
+    }
+    else
+    {
+        poseFilter->setDefaultParameters(parameters);
+    }
+}
+
+-(void)setPoseStream_:(id)value
+{
+    ENSURE_SINGLE_ARG(value, NSDictionary);
+    
+    unifeye::PoseStreamParameters parameters = poseStream->getParameters();
+    parameters.interval = [TiUtils floatValue:@"interval" properties:value def:parameters.interval];
+    parameters.translationEpsilon = [TiUtils floatValue:@"translationEpsilon" properties:value def:parameters.translationEpsilon];
+    parameters.rotationEpsilon = [TiUtils floatValue:@"rotationEpsilon" properties:value def:parameters.rotationEpsilon];
+    parameters.qualityEpsilon = [TiUtils floatValue:@"qualityEpsilon" properties:value def:parameters.qualityEpsilon];
+    parameters.matrices = [TiUtils boolValue:@"matrices" properties:value def:parameters.matrices];
+    poseStream->setParameters(parameters);
+    
+    poseStreamEnabled = [TiUtils boolValue:@"enabled" properties:value def:YES];
+    poseStreamFiltered = [TiUtils boolValue:@"filtered" properties:value def:poseStreamFiltered];
+}
+
 -(id)open:(id)args{
     NSLog(@"[View]open Camera");     
     if( unifeyeMobile )
     {
-        unifeyeMobile->activateCamera(0, 480, 360);
+        // a view opened after this one may have taken the camera and the delegate
+        [[ComOtigaUnifeyeEngine sharedEngine] takeOwnership:self];
+        if( !captureResolution->start(frameClock->now()) )
+            NSLog(@"[ERROR] the camera could not be started");
+    }
+    
+    // the GL view is not loaded from a nib, so create it the first time we open
+    if( !glView )
+    {
+        EAGLView* aView = [[EAGLView alloc] initWithFrame:[self bounds]];
+        aView.autoresizingMask = UIViewAutoresizingFlexibleWidth | UIViewAutoresizingFlexibleHeight;
+        [self addSubview:aView];
+        self.glView = aView;
+        [aView release];
+        
+        [glView setContext:context];
+        [glView setFramebuffer];
     }
  
     // if we start up in landscape mode after having portrait before, we want to make sure that the renderer is rotated correctly
 //    UIInterfaceOrientation interfaceOrientation = self.interfaceOrientation;    
 //    [self willAnimateRotationToInterfaceOrientation:interfaceOrientation duration:0];
 //    
-    // load our tracking configuration
-//    NSString* trackingDataFile = [[NSBundle mainBundle] pathForResource:@"TrackingData_MarkerlessFast" ofType:@"xml" inDirectory:@"Assets"];	
-//	if(trackingDataFile)
-//	{
-//        NSLog(@"Load Tracking Data");
-//        bool success = unifeyeMobile->setTrackingData([trackingDataFile UTF8String]);
-//		if( !success)
-//			NSLog(@"No success loading the tracking configuration");
-//	}
-//    
+    // the tracking configuration was loaded with the instance, see ComOtigaUnifeyeEngine
     
-    // load content
+    // load content once per view, the engine's cache hands it out and takes it back in -dealloc
     NSString* metaioManModel = [[NSBundle mainBundle] pathForResource:@"metaioman" ofType:@"md2" inDirectory:@"Assets"];
     
-	if(metaioManModel)
+	if(metaioManModel && !model && geometryCache)
 	{
         NSLog(@"Load 3D Modal");
-		// if this call was successful, theLoadedModel will contain a pointer to the 3D model
-        metaio::IUnifeyeMobileGeometry* theLoadedModel =  unifeyeMobile->loadGeometry([metaioManModel UTF8String]);			
-        if( theLoadedModel )
+		// if this call was successful, model will contain a pointer to the 3D model
+        model = geometryCache->acquire([metaioManModel UTF8String]);
+        if( model )
         {
             // scale it a bit down
-            theLoadedModel->setMoveScale(metaio::Vector3d(0.8,0.8,0.8));
+            model->setMoveScale(metaio::Vector3d(0.8,0.8,0.8));
+            frustumCulling->addGeometry(model);
+            picking->addGeometry(model, compiledMeshFor(metaioManModel));
         }
         else
         {
@@ -146,6 +1492,10 @@
     }
 
     
+    // drive render() from the display link from now on
+    [self startAnimation];
+    if (sensorsEnabled && !sessionPlayer->isOpen())
+        [sensorSource start];
 
     return self;
 }
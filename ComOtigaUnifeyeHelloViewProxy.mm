@@ -6,6 +6,7 @@
  */
 
 #import "ComOtigaUnifeyeHelloViewProxy.h"
+#import "ComOtigaUnifeyeHelloView.h"
 #import "TiUtils.h"
 
 @implementation ComOtigaUnifeyeHelloViewProxy
@@ -13,4 +14,105 @@
     NSLog(@"[Proxy] open");
     [[self view] performSelector:@selector(open:)];
 }
+
+-(void)takeScreenshot:(id)args{
+    [[self view] performSelector:@selector(takeScreenshot:) withObject:args];
+}
+
+-(id)startRecording:(id)args{
+    return [[self view] performSelector:@selector(startRecording:) withObject:args];
+}
+
+-(void)stopRecording:(id)args{
+    [[self view] performSelector:@selector(stopRecording:) withObject:args];
+}
+
+-(id)playSession:(id)args{
+    return [[self view] performSelector:@selector(playSession:) withObject:args];
+}
+
+-(void)stopSession:(id)args{
+    [[self view] performSelector:@selector(stopSession:) withObject:args];
+}
+
+-(id)getFrameStats:(id)args{
+    return [[self view] performSelector:@selector(getFrameStats:) withObject:args];
+}
+
+-(id)getSensorStats:(id)args{
+    return [[self view] performSelector:@selector(getSensorStats:) withObject:args];
+}
+
+-(id)getGovernorStats:(id)args{
+    return [[self view] performSelector:@selector(getGovernorStats:) withObject:args];
+}
+
+-(id)getCaptureStats:(id)args{
+    return [[self view] performSelector:@selector(getCaptureStats:) withObject:args];
+}
+
+-(id)loadGeometry:(id)args{
+    return [[self view] performSelector:@selector(loadGeometry:) withObject:args];
+}
+
+-(void)unloadGeometry:(id)args{
+    [[self view] performSelector:@selector(unloadGeometry:) withObject:args];
+}
+
+-(id)applyBatch:(id)args{
+    return [[self view] performSelector:@selector(applyBatch:) withObject:args];
+}
+
+-(id)getCommandStats:(id)args{
+    return [[self view] performSelector:@selector(getCommandStats:) withObject:args];
+}
+
+-(id)getPoseStreamStats:(id)args{
+    return [[self view] performSelector:@selector(getPoseStreamStats:) withObject:args];
+}
+
+-(id)getCallbackStats:(id)args{
+    return [[self view] performSelector:@selector(getCallbackStats:) withObject:args];
+}
+
+-(id)startMovieTexture:(id)args{
+    return [[self view] performSelector:@selector(startMovieTexture:) withObject:args];
+}
+
+-(void)stopMovieTexture:(id)args{
+    [[self view] performSelector:@selector(stopMovieTexture:) withObject:args];
+}
+
+-(id)getMovieStats:(id)args{
+    return [[self view] performSelector:@selector(getMovieStats:) withObject:args];
+}
+
+-(id)loadPois:(id)args{
+    return [[self view] performSelector:@selector(loadPois:) withObject:args];
+}
+
+-(void)unloadPois:(id)args{
+    [[self view] performSelector:@selector(unloadPois:) withObject:args];
+}
+
+-(id)getPoiStats:(id)args{
+    return [[self view] performSelector:@selector(getPoiStats:) withObject:args];
+}
+
+-(id)pick:(id)args{
+    return [[self view] performSelector:@selector(pick:) withObject:args];
+}
+
+// the view stops posting the SDK callbacks nobody listens to
+-(void)_listenerAdded:(NSString*)type count:(int)count{
+    [super _listenerAdded:type count:count];
+    if ([self viewAttached])
+        [(ComOtigaUnifeyeHelloView*)[self view] listenerCountChanged:type count:count];
+}
+
+-(void)_listenerRemoved:(NSString*)type count:(int)count{
+    [super _listenerRemoved:type count:count];
+    if ([self viewAttached])
+        [(ComOtigaUnifeyeHelloView*)[self view] listenerCountChanged:type count:count];
+}
 @end
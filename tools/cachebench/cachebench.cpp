@@ -0,0 +1,393 @@
+//
+//  cachebench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Hit rate and eviction policy of GeometryCache:
+//
+//      cachebench [views]
+//
+//  40 model files of 0.2 to 3 MB are written to a temporary directory and
+//  an app opens views on them: each view shows 1 to 6 models, picked with
+//  a skewed popularity like a catalogue where a few models are opened
+//  most, keeps them a few frames while only some are in sight, and closes.
+//  A fake factory stands in for the SDK and counts the loads. Prints the
+//  hit rate and the megabytes loaded for a range of budgets next to no
+//  cache at all, and the cost of a hit. Then checks the policy: acquired
+//  models are never evicted, the least recently visible released model
+//  goes first, a changed file is loaded again and purgeAll() frees what is
+//  released. Exits with 1 if a check fails.
+//
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "FrameScheduler.h"
+#include "GeometryCache.h"
+
+using namespace unifeye;
+
+namespace
+{
+    const int MODELS = 40;
+
+    int failures = 0;
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    double now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    // the clock of the evictions, advanced by the fake factory
+    class FakeClock : public IFrameClock
+    {
+    public:
+        FakeClock() : time(0) {};
+        virtual double now() { return time; }
+        double time;
+    };
+
+    // geometries are addresses in a block that is never dereferenced
+    class FakeFactory : public IGeometryFactory
+    {
+    public:
+        FakeFactory( FakeClock* _clock ) : clock(_clock), loads(0), unloads(0), bytesRead(0) {};
+
+        virtual metaio::IUnifeyeMobileGeometry* loadGeometry( const std::string& path )
+        {
+            int index = modelIndex(path);
+            loads++;
+            bytesRead += size(path);
+            loaded.insert(index);
+            shown.insert(index);
+            return reinterpret_cast<metaio::IUnifeyeMobileGeometry*>(&block[index]);
+        }
+
+        virtual void unloadGeometry( metaio::IUnifeyeMobileGeometry* geometry )
+        {
+            // unloading takes time in proportion to the model
+            clock->time += 0.0005;
+            loaded.erase(index(geometry));
+            unloads++;
+        }
+
+        virtual void setVisible( metaio::IUnifeyeMobileGeometry* geometry, bool visible )
+        {
+            if (visible)
+                shown.insert(index(geometry));
+            else
+                shown.erase(index(geometry));
+        }
+
+        virtual bool isRendered( metaio::IUnifeyeMobileGeometry* geometry )
+        {
+            return shown.count(index(geometry)) && inSight.count(index(geometry));
+        }
+
+        virtual size_t estimateBytes( const std::string& path, size_t fileSize )
+        {
+            return fileSize * 2;
+        }
+
+        int index( metaio::IUnifeyeMobileGeometry* geometry ) const
+        {
+            return (int)(reinterpret_cast<const char*>(geometry) - block);
+        }
+
+        static int modelIndex( const std::string& path )
+        {
+            return atoi(path.c_str() + path.rfind('/') + 6);
+        }
+
+        static size_t size( const std::string& path )
+        {
+            FILE* file = fopen(path.c_str(), "rb");
+            if (!file)
+                return 0;
+            fseek(file, 0, SEEK_END);
+            size_t bytes = (size_t)ftell(file);
+            fclose(file);
+            return bytes;
+        }
+
+        FakeClock* clock;
+        unsigned long loads, unloads;
+        size_t bytesRead;
+        std::set<int> loaded, shown, inSight;
+        char block[MODELS + 1];
+    };
+
+    std::string directory;
+
+    std::string modelPath( int index )
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "/model%d.md2", index);
+        return directory + name;
+    }
+
+    void writeModel( int index, size_t bytes, unsigned char seed )
+    {
+        std::vector<unsigned char> content(bytes);
+        for (size_t i = 0; i < bytes; i++)
+            content[i] = (unsigned char)(i * 31 + seed);
+        FILE* file = fopen(modelPath(index).c_str(), "wb");
+        fwrite(&content[0], 1, bytes, file);
+        fclose(file);
+    }
+
+    size_t modelBytes( int index )
+    {
+        // 0.2 to 3 MB, the popular ones are not the smallest
+        return (size_t)((0.2 + 2.8 * ((index * 7) % MODELS) / (MODELS - 1)) * 1024 * 1024);
+    }
+
+    unsigned int randomState = 1;
+
+    unsigned int nextRandom()
+    {
+        randomState = randomState * 1664525U + 1013904223U;
+        return randomState >> 8;
+    }
+
+    // Zipf with s = 1: model i is opened about 1/(i+1) as often as the first
+    int pickModel()
+    {
+        static std::vector<double> cumulative;
+        if (cumulative.empty())
+        {
+            double sum = 0;
+            for (int i = 0; i < MODELS; i++)
+                cumulative.push_back(sum += 1.0 / (i + 1));
+            for (int i = 0; i < MODELS; i++)
+                cumulative[i] /= sum;
+        }
+        double u = nextRandom() / 16777216.0;
+        for (int i = 0; i < MODELS; i++)
+        {
+            if (u < cumulative[i])
+                return i;
+        }
+        return MODELS - 1;
+    }
+
+    struct Run
+    {
+        GeometryCacheStats stats;
+        unsigned long loads;
+        size_t bytesRead;
+        bool withinBudget;
+        bool pinnedKept;
+
+        Run() : loads(0), bytesRead(0), withinBudget(true), pinnedKept(true) {};
+    };
+
+    // opens the views, budget 0 is no cache: everything is unloaded on release
+    Run openViews( size_t budget, int views )
+    {
+        randomState = 1;
+        FakeClock clock;
+        FakeFactory factory(&clock);
+        GeometryCache cache(&factory, &clock, budget);
+        Run run;
+
+        for (int v = 0; v < views; v++)
+        {
+            int count = 1 + nextRandom() % 6;
+            std::vector<metaio::IUnifeyeMobileGeometry*> open;
+            std::set<int> picked;
+            for (int i = 0; i < count; i++)
+            {
+                int model = pickModel();
+                if (!picked.insert(model).second)
+                    continue;
+                metaio::IUnifeyeMobileGeometry* geometry = cache.acquire(modelPath(model));
+                if (geometry)
+                    open.push_back(geometry);
+            }
+
+            // some models are in sight in some frames
+            int frames = 5 + nextRandom() % 20;
+            for (int f = 0; f < frames; f++)
+            {
+                factory.inSight.clear();
+                for (size_t i = 0; i < open.size(); i++)
+                {
+                    if (nextRandom() % 3 != 0)
+                        factory.inSight.insert(factory.index(open[i]));
+                }
+                cache.update();
+
+                GeometryCacheStats stats = cache.getStats();
+                if (stats.bytesLoaded > budget && stats.bytesLoaded > stats.bytesPinned)
+                    run.withinBudget = false;
+                for (size_t i = 0; i < open.size(); i++)
+                {
+                    if (!factory.loaded.count(factory.index(open[i])))
+                        run.pinnedKept = false;
+                }
+            }
+
+            for (size_t i = 0; i < open.size(); i++)
+                cache.release(open[i]);
+        }
+
+        run.stats = cache.getStats();
+        run.loads = factory.loads;
+        run.bytesRead = factory.bytesRead;
+        return run;
+    }
+}
+
+int main( int argc, char** argv )
+{
+    int views = argc > 1 ? atoi(argv[1]) : 2000;
+
+    char pattern[] = "/tmp/cachebenchXXXXXX";
+    if (!mkdtemp(pattern))
+    {
+        printf("can not create a temporary directory\n");
+        return 1;
+    }
+    directory = pattern;
+
+    size_t total = 0;
+    for (int i = 0; i < MODELS; i++)
+    {
+        writeModel(i, modelBytes(i), (unsigned char)i);
+        total += modelBytes(i) * 2;
+    }
+    printf("%d models, %.1f MB loaded when all are, %d views\n\n", MODELS, total / 1048576.0, views);
+
+    // the hit rate against the budget, 0 unloads every model on release
+    printf("%-10s %9s %8s %12s %10s %14s\n", "budget", "hit rate", "loads", "MB loaded", "evictions", "eviction time");
+    const int budgets[] = { 0, 4, 8, 16, 32, 64, 128 };
+    Run none, standard;
+    bool withinBudget = true, pinnedKept = true, growing = true;
+    double lastHitRate = -1;
+    for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++)
+    {
+        Run run = openViews((size_t)budgets[b] * 1024 * 1024, views);
+        printf("%4d MB    %8.1f%% %8lu %12.1f %10lu %11.1f ms\n", budgets[b], run.stats.getHitRate() * 100.0, run.loads,
+               run.bytesRead / 1048576.0, run.stats.evictions, run.stats.totalEvictionTime * 1000.0);
+        withinBudget = withinBudget && run.withinBudget;
+        pinnedKept = pinnedKept && run.pinnedKept;
+        growing = growing && run.stats.getHitRate() >= lastHitRate;
+        lastHitRate = run.stats.getHitRate();
+        if (budgets[b] == 0)
+            none = run;
+        if (budgets[b] == 16)
+            standard = run;
+    }
+    printf("\n");
+
+    check("the loaded models stay within the budget", withinBudget);
+    check("acquired models are never evicted", pinnedKept);
+    check("a larger budget never hits less", growing);
+    check("the default budget saves loads", standard.loads < none.loads);
+
+    // a hit costs a stat and no read of the file
+    {
+        FakeClock clock;
+        FakeFactory factory(&clock);
+        GeometryCache cache(&factory, &clock);
+        std::string path = modelPath(0);
+        cache.release(cache.acquire(path));
+        const int runs = 20000;
+        double start = now();
+        for (int i = 0; i < runs; i++)
+            cache.release(cache.acquire(path));
+        double hit = (now() - start) / runs;
+
+        // the first acquire hashes the whole file
+        GeometryCache cold(&factory, &clock);
+        start = now();
+        cold.release(cold.acquire(path));
+        double miss = now() - start;
+        printf("a hit %.2f us, a miss on %.1f MB %.2f ms before the SDK loads it\n", hit * 1e6,
+               modelBytes(0) / 1048576.0, miss * 1000.0);
+        check("a hit does not read the file", hit * 20 < miss);
+    }
+
+    // the least recently visible released model goes first
+    {
+        FakeClock clock;
+        FakeFactory factory(&clock);
+        size_t two = (modelBytes(1) + modelBytes(2)) * 2;
+        GeometryCache cache(&factory, &clock, two + modelBytes(3) * 2 - 1);
+        metaio::IUnifeyeMobileGeometry* a = cache.acquire(modelPath(1));
+        metaio::IUnifeyeMobileGeometry* b = cache.acquire(modelPath(2));
+        factory.inSight.insert(factory.index(a));
+        factory.inSight.insert(factory.index(b));
+        cache.update();
+        factory.inSight.erase(factory.index(a));
+        cache.update();
+        cache.release(a);
+        cache.release(b);
+        metaio::IUnifeyeMobileGeometry* c = cache.acquire(modelPath(3));
+        check("the least recently visible model is evicted", !factory.loaded.count(1) && factory.loaded.count(2) == 1);
+        check("a released model is hidden", !factory.shown.count(2) && factory.shown.count(3) == 1);
+
+        // a model still acquired survives a budget of nothing
+        cache.setBudget(0);
+        check("setBudget keeps the acquired models", factory.loaded.size() == 1 && factory.loaded.count(3) == 1);
+        cache.release(c);
+        check("and frees them once released", factory.loaded.empty());
+    }
+
+    // a file that changed on disk is loaded again, the old version dropped
+    {
+        FakeClock clock;
+        FakeFactory factory(&clock);
+        GeometryCache cache(&factory, &clock);
+        std::string path = modelPath(4);
+        cache.release(cache.acquire(path));
+        sleep(1);
+        writeModel(4, modelBytes(4), 99);
+        cache.release(cache.acquire(path));
+        GeometryCacheStats stats = cache.getStats();
+        check("a changed file is loaded again", factory.loads == 2 && stats.misses == 2);
+        check("the old version is unloaded", factory.unloads == 1 && stats.bytesLoaded == modelBytes(4) * 2);
+        writeModel(4, modelBytes(4), 4);
+    }
+
+    // a memory warning frees every cache
+    {
+        FakeClock clock;
+        FakeFactory first(&clock), second(&clock);
+        GeometryCache a(&first, &clock), b(&second, &clock);
+        metaio::IUnifeyeMobileGeometry* kept = a.acquire(modelPath(5));
+        b.release(b.acquire(modelPath(6)));
+        a.release(a.acquire(modelPath(7)));
+        GeometryCache::purgeAll();
+        check("purgeAll frees the released models of all caches", first.loaded.size() == 1 && second.loaded.empty());
+        a.release(kept);
+    }
+
+    for (int i = 0; i < MODELS; i++)
+        unlink(modelPath(i).c_str());
+    rmdir(directory.c_str());
+
+    if (failures)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,329 @@
+//
+//  callbackbench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Loss and latency of the callback dispatcher:
+//
+//      callbackbench
+//
+//  Checks on one thread that events nobody listens to are not queued,
+//  that camera frames are coalesced to the latest, animation ends are
+//  delivered in order and a full ring drops and counts. Then a producer
+//  thread posts the callbacks of a render loop to the dispatcher thread:
+//  paced, flat out, to a slow listener and while the listeners come and
+//  go. No animation end may be lost or reordered unless the ring was full,
+//  the last camera frame always arrives. Prints the latency from post to
+//  delivery. Exits with 1 if a check fails.
+//
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+#include "CallbackDispatcher.h"
+#include "FrameScheduler.h"
+
+using namespace unifeye;
+
+namespace
+{
+    int failures = 0;
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    void sleepFor( double seconds )
+    {
+        struct timespec time;
+        time.tv_sec = (time_t)seconds;
+        time.tv_nsec = (long)((seconds - time.tv_sec) * 1e9);
+        nanosleep(&time, 0);
+    }
+
+    SystemFrameClock frameClock;
+
+    // records what is delivered, on the thread of the dispatcher
+    class RecordingListener : public ICallbackListener
+    {
+    public:
+        RecordingListener() : cameraDelay(0) {};
+
+        std::vector<CallbackEvent> events;
+        std::vector<double> latencies;
+        double cameraDelay;             // seconds each camera frame takes
+
+        virtual void deliver( const CallbackEvent& event )
+        {
+            latencies.push_back(frameClock.now() - event.timestamp);
+            events.push_back(event);
+            if (event.type == CALLBACK_CAMERA_FRAME && cameraDelay > 0)
+                sleepFor(cameraDelay);
+        }
+
+        int count( CALLBACK_EVENT type ) const
+        {
+            int result = 0;
+            for (size_t i = 0; i < events.size(); i++)
+                result += events[i].type == type ? 1 : 0;
+            return result;
+        }
+
+        // the animation ends carry handles step apart, none may be missing or out of order
+        bool animationsInOrder( int first, int step, bool allowGaps ) const
+        {
+            int expected = first;
+            for (size_t i = 0; i < events.size(); i++)
+            {
+                if (events[i].type != CALLBACK_ANIMATION_END)
+                    continue;
+                if (events[i].handle < expected || (!allowGaps && events[i].handle != expected))
+                    return false;
+                expected = events[i].handle + step;
+            }
+            return true;
+        }
+
+        // camera frames only go forward
+        unsigned long lastFrame( bool& increasing ) const
+        {
+            unsigned long last = 0;
+            increasing = true;
+            for (size_t i = 0; i < events.size(); i++)
+            {
+                if (events[i].type != CALLBACK_CAMERA_FRAME)
+                    continue;
+                if (events[i].frame <= last)
+                    increasing = false;
+                last = events[i].frame;
+            }
+            return last;
+        }
+
+        void printLatency( const char* name ) const
+        {
+            std::vector<double> sorted(latencies);
+            std::sort(sorted.begin(), sorted.end());
+            if (sorted.empty())
+                return;
+            printf("    %-12s %8lu events, latency p50 %7.1f us, p99 %7.1f us, max %8.1f us\n", name,
+                (unsigned long)sorted.size(), sorted[sorted.size() / 2] * 1e6,
+                sorted[sorted.size() * 99 / 100] * 1e6, sorted.back() * 1e6);
+        }
+    };
+
+    CallbackEvent animationEnd( int handle )
+    {
+        CallbackEvent event;
+        event.type = CALLBACK_ANIMATION_END;
+        event.handle = handle;
+        event.setName("idle");
+        return event;
+    }
+
+    CallbackEvent cameraFrame( unsigned long frame )
+    {
+        CallbackEvent event;
+        event.type = CALLBACK_CAMERA_FRAME;
+        event.width = 480;
+        event.height = 360;
+        event.frame = frame;
+        return event;
+    }
+
+    // posts like the render loop does: a camera frame per call, an animation end every few
+    struct Producer
+    {
+        CallbackDispatcher* dispatcher;
+        int posts;
+        int animationEvery;
+        double pause;                   // seconds between two posts
+        bool toggleListeners;
+
+        int animations;                 // animation ends posted successfully
+        unsigned long lastFrame;        // the last camera frame posted successfully
+
+        static void* run( void* argument )
+        {
+            Producer* self = static_cast<Producer*>(argument);
+            for (int i = 1; i <= self->posts; i++)
+            {
+                if (self->toggleListeners && i % 1000 == 0)
+                {
+                    int count = (i / 1000) % 3;
+                    self->dispatcher->setListenerCount(CALLBACK_ANIMATION_END, count);
+                    self->dispatcher->setListenerCount(CALLBACK_CAMERA_FRAME, count);
+                }
+                if (i % self->animationEvery == 0 && self->dispatcher->post(animationEnd(i)))
+                    self->animations++;
+                if (self->dispatcher->post(cameraFrame(i)))
+                    self->lastFrame = i;
+                if (self->pause > 0)
+                    sleepFor(self->pause);
+            }
+            return 0;
+        }
+    };
+
+    // runs a producer against the thread of a dispatcher
+    CallbackStats runThreads( RecordingListener& listener, Producer& producer, int capacity )
+    {
+        CallbackDispatcher dispatcher(&listener, &frameClock, capacity);
+        dispatcher.setListenerCount(CALLBACK_ANIMATION_END, 1);
+        dispatcher.setListenerCount(CALLBACK_CAMERA_FRAME, 1);
+        dispatcher.start();
+
+        producer.dispatcher = &dispatcher;
+        producer.animations = 0;
+        producer.lastFrame = 0;
+        pthread_t thread;
+        pthread_create(&thread, 0, Producer::run, &producer);
+        pthread_join(thread, 0);
+
+        dispatcher.stop();
+        return dispatcher.getStats();
+    }
+}
+
+int main()
+{
+    // on one thread
+    {
+        RecordingListener listener;
+        CallbackDispatcher dispatcher(&listener, &frameClock, 8);
+
+        bool posted = dispatcher.post(animationEnd(1)) || dispatcher.post(cameraFrame(1));
+        check("nothing is queued without listeners", !posted && dispatcher.dispatch() == 0 &&
+            dispatcher.getStats().ignored == 2);
+
+        dispatcher.setListenerCount(CALLBACK_ANIMATION_END, 2);
+        dispatcher.setListenerCount(CALLBACK_CAMERA_FRAME, 1);
+        for (int i = 1; i <= 10; i++)
+            dispatcher.post(cameraFrame(i));
+        dispatcher.dispatch();
+        check("camera frames are coalesced to the latest", listener.events.size() == 1 &&
+            listener.events[0].frame == 10 && listener.events[0].coalesced == 9);
+
+        listener.events.clear();
+        dispatcher.post(animationEnd(1));
+        dispatcher.post(cameraFrame(11));
+        dispatcher.post(animationEnd(2));
+        dispatcher.post(cameraFrame(12));
+        dispatcher.post(animationEnd(3));
+        dispatcher.dispatch();
+        check("animation ends keep their order", listener.events.size() == 4 && listener.animationsInOrder(1, 1, false) &&
+            listener.events[1].type == CALLBACK_CAMERA_FRAME && listener.events[1].frame == 12 &&
+            listener.events[1].coalesced == 1);
+
+        listener.events.clear();
+        for (int i = 1; i <= 10; i++)
+            dispatcher.post(animationEnd(i));
+        dispatcher.dispatch();
+        check("a full ring drops and counts", listener.events.size() == 8 && listener.animationsInOrder(1, 1, false) &&
+            dispatcher.getStats().dropped == 2);
+
+        listener.events.clear();
+        dispatcher.post(animationEnd(1));
+        dispatcher.post(cameraFrame(13));
+        dispatcher.setListenerCount(CALLBACK_ANIMATION_END, 0);
+        dispatcher.setListenerCount(CALLBACK_CAMERA_FRAME, 0);
+        dispatcher.dispatch();
+        check("events queued when listeners go are not delivered", listener.events.empty() &&
+            dispatcher.getStats().ignored == 4);
+
+        std::string longName(100, 'a');
+        CallbackEvent event;
+        event.setName(longName.c_str());
+        check("long animation names are truncated", strlen(event.name) == CallbackEvent::MAX_NAME - 1);
+        std::string accented = std::string(CallbackEvent::MAX_NAME - 2, 'a') + "\xc3\xa9";
+        event.setName(accented.c_str());
+        check("truncation keeps UTF-8 characters whole", strlen(event.name) == CallbackEvent::MAX_NAME - 2);
+
+        dispatcher.setListenerCount(CALLBACK_ANIMATION_END, 1);
+        dispatcher.setListenerCount(CALLBACK_CAMERA_FRAME, 1);
+        listener.events.clear();
+        UnifeyeCallbackAdapter adapter(&dispatcher, NULL);
+        metaio::ImageStruct image(NULL, 640, 480, metaio::common::ECF_A8R8G8B8, true);
+        adapter.setFrameSequence(42);
+        adapter.onNewCameraFrame(&image);
+        adapter.onAnimationEnd(NULL, "walk");
+        dispatcher.dispatch();
+        check("the adapter posts the SDK callbacks", listener.events.size() == 2 &&
+            listener.events[0].width == 640 && listener.events[0].frame == 42 &&
+            strcmp(listener.events[1].name, "walk") == 0);
+    }
+
+    printf("\n");
+
+    // a render loop's worth, 20000 posts 50 us apart
+    {
+        RecordingListener listener;
+        Producer producer = { NULL, 20000, 10, 50e-6, false, 0, 0 };
+        CallbackStats stats = runThreads(listener, producer, CallbackDispatcher::DEFAULT_CAPACITY);
+        bool increasing;
+        unsigned long last = listener.lastFrame(increasing);
+        listener.printLatency("paced");
+        check("paced: no event is lost", stats.dropped == 0 && listener.count(CALLBACK_ANIMATION_END) == producer.animations &&
+            listener.animationsInOrder(10, 10, false));
+        check("paced: the last camera frame arrives", increasing && last == producer.lastFrame);
+        check("paced: every camera frame is counted", (unsigned long)listener.count(CALLBACK_CAMERA_FRAME) + stats.coalesced == 20000);
+    }
+
+    // as fast as the producer can
+    {
+        RecordingListener listener;
+        Producer producer = { NULL, 1000000, 10, 0, false, 0, 0 };
+        CallbackStats stats = runThreads(listener, producer, CallbackDispatcher::DEFAULT_CAPACITY);
+        bool increasing;
+        listener.lastFrame(increasing);
+        listener.printLatency("flat out");
+        printf("    %lu posted, %lu delivered, %lu coalesced, %lu dropped\n",
+            stats.posted, stats.delivered, stats.coalesced, stats.dropped);
+        check("flat out: what is not dropped arrives in order", listener.animationsInOrder(10, 10, true) &&
+            (unsigned long)listener.count(CALLBACK_ANIMATION_END) == (unsigned long)producer.animations && increasing);
+    }
+
+    // a listener that takes a millisecond per camera frame
+    {
+        RecordingListener listener;
+        listener.cameraDelay = 0.001;
+        Producer producer = { NULL, 2000, 10, 100e-6, false, 0, 0 };
+        CallbackStats stats = runThreads(listener, producer, CallbackDispatcher::DEFAULT_CAPACITY);
+        bool increasing;
+        unsigned long last = listener.lastFrame(increasing);
+        listener.printLatency("slow");
+        printf("    %d camera frames delivered, %lu coalesced\n", listener.count(CALLBACK_CAMERA_FRAME), stats.coalesced);
+        check("slow listener: camera frames are coalesced", stats.coalesced > 0 && increasing && last == producer.lastFrame);
+        check("slow listener: no animation end is lost", stats.dropped == 0 &&
+            listener.count(CALLBACK_ANIMATION_END) == producer.animations && listener.animationsInOrder(10, 10, false));
+    }
+
+    // listeners come and go
+    {
+        RecordingListener listener;
+        Producer producer = { NULL, 200000, 10, 0, true, 0, 0 };
+        CallbackStats stats = runThreads(listener, producer, CallbackDispatcher::DEFAULT_CAPACITY);
+        bool increasing;
+        listener.lastFrame(increasing);
+        printf("    listeners come and go: %lu posted, %lu ignored, %lu delivered\n",
+            stats.posted, stats.ignored, stats.delivered);
+        check("listeners come and go: nothing arrives unasked", stats.ignored > 0 && listener.animationsInOrder(10, 10, true) &&
+            increasing && stats.delivered == listener.events.size());
+    }
+
+    printf("\n");
+    if (failures > 0)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,323 @@
+//
+//  capturebench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Decisions of CaptureResolutionManager against a stub camera:
+//
+//      capturebench
+//
+//  The stub tracks every frame at a cost that depends on the resolution,
+//  either a fixed part plus a cost per pixel or a table, times a factor
+//  that stands in for thermal throttling. A tracked frame takes at least a
+//  frame period and delays the render loop when it takes longer; the
+//  tracking rate is the mean over the last 25 frames like the SDK's. The
+//  stub can refuse resolutions, as a camera without that preset would. Each
+//  scenario prints where the manager settled, how often it restarted the
+//  camera and the tracking rate it got. Exits with 1 if a check fails.
+//
+#include <math.h>
+#include <stdio.h>
+#include <map>
+#include <vector>
+
+#include "CaptureResolution.h"
+
+using namespace unifeye;
+
+namespace
+{
+    const double FRAME_RATE = 30.0;
+
+    // no frames for this long while the camera restarts
+    const double RESTART_TIME = 0.3;
+
+    int failures = 0;
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    class StubCamera : public ICaptureCamera
+    {
+    public:
+        StubCamera() : fixedCost(0), pixelCost(0), factor(1), noise(1), width(0), height(0), activations(0),
+            restartedAt(-1.0), time(0) {};
+
+        double fixedCost;                   // seconds per frame
+        double pixelCost;                   // seconds per pixel and frame
+        std::map<int, double> table;        // seconds per frame by width, instead of the above
+        std::map<int, bool> refused;        // widths the camera can not start with
+        double factor;
+        unsigned int noise;
+        int width, height;
+        int activations;
+        double restartedAt;
+        double time;
+
+        virtual metaio::Vector2di activate( int _width, int _height )
+        {
+            activations++;
+            if (refused.count(_width))
+            {
+                width = height = 0;
+                return metaio::Vector2di();
+            }
+            width = _width;
+            height = _height;
+            restartedAt = time;
+            return metaio::Vector2di(width, height);
+        }
+
+        virtual void stop()
+        {
+            width = height = 0;
+        }
+
+        double cost()
+        {
+            double base = table.count(width) ? table[width] : fixedCost + pixelCost * width * height;
+            noise = noise * 1664525U + 1013904223U;
+            return base * factor * (0.95 + 0.1 * (noise >> 8) / 16777216.0);
+        }
+    };
+
+    struct Run
+    {
+        std::map<int, double> timeAtWidth;
+        double rateSum;
+        unsigned long frames;
+
+        Run() : rateSum(0), frames(0) {};
+    };
+
+    // runs the render loop for a while, the camera and the manager keep their state between calls
+    class Simulation
+    {
+    public:
+        Simulation( bool _reportCost = true ) : manager(&camera), time(0), reportCost(_reportCost), durationIndex(0)
+        {
+            for (int i = 0; i < 25; i++)
+                durations[i] = 1.0 / FRAME_RATE;
+        }
+
+        StubCamera camera;
+        CaptureResolutionManager manager;
+        double time;
+        bool reportCost;
+
+        void run( double until, Run& result, double frameRate = FRAME_RATE )
+        {
+            if (!manager.isRunning())
+                manager.start(time);
+
+            while (time < until)
+            {
+                camera.time = time;
+                double period = 1.0 / frameRate;
+                if (camera.restartedAt >= 0 && time - camera.restartedAt < RESTART_TIME)
+                {
+                    time += period;
+                    continue;
+                }
+
+                // tracking inside the frame, the next one waits for it
+                double cost = camera.cost();
+                double duration = cost > period ? cost : period;
+                durations[durationIndex++ % 25] = duration;
+                double sum = 0;
+                for (int i = 0; i < 25; i++)
+                    sum += durations[i];
+                float trackingRate = (float)(25.0 / sum);
+
+                result.timeAtWidth[camera.width] += duration;
+                result.rateSum += trackingRate;
+                result.frames++;
+                manager.update(time, trackingRate, reportCost ? cost : 0.0, (float)frameRate);
+                time += duration;
+            }
+        }
+
+    private:
+        double durations[25];
+        int durationIndex;
+    };
+
+    void report( const char* name, Simulation& simulation, const Run& run )
+    {
+        metaio::Vector2di resolution = simulation.manager.getResolution();
+        printf("%-36s %4dx%-4d %-8s %2lu switches, %5.1f fps", name, resolution.x, resolution.y,
+            getCaptureReasonName(simulation.manager.getReason()), simulation.manager.getStats().switches,
+            run.frames ? run.rateSum / run.frames : 0.0);
+        for (std::map<int, double>::const_iterator i = run.timeAtWidth.begin(); i != run.timeAtWidth.end(); ++i)
+            printf(", %.0f s at %d", i->second, i->first);
+        printf("\n");
+    }
+}
+
+int main( int argc, char** argv )
+{
+    // roughly an iPad 2: 9 ms at 480x360
+    {
+        Simulation simulation;
+        simulation.camera.fixedCost = 0.002;
+        simulation.camera.pixelCost = 40e-9;
+        Run run;
+        simulation.run(300.0, run);
+        report("fast device", simulation, run);
+        check("fast device profiles up to 640x480", simulation.manager.getResolution().x == 640 &&
+            simulation.manager.getReason() == CAPTURE_REASON_PROFILE);
+        check("fast device restarts the camera once", simulation.manager.getStats().switches == 1);
+    }
+
+    // roughly an iPhone 3GS: 57 ms at 480x360
+    {
+        Simulation simulation;
+        simulation.camera.fixedCost = 0.005;
+        simulation.camera.pixelCost = 300e-9;
+        Run run;
+        simulation.run(300.0, run);
+        report("slow device", simulation, run);
+        check("slow device profiles down to 320x240", simulation.manager.getResolution().x == 320 &&
+            simulation.manager.getStats().switches == 1);
+        check("slow device reaches the target rate", run.rateSum / run.frames > 24.0);
+    }
+
+    // the same without a cost, only the tracking rate to go by
+    {
+        Simulation simulation(false);
+        simulation.camera.fixedCost = 0.005;
+        simulation.camera.pixelCost = 300e-9;
+        Run run;
+        simulation.run(300.0, run);
+        report("slow device, rate only", simulation, run);
+        check("without the cost a step down at startup", simulation.manager.getResolution().x == 320 &&
+            simulation.manager.getStats().switches == 1);
+    }
+
+    // throttled to a quarter of the speed for two minutes
+    {
+        Simulation simulation;
+        simulation.camera.fixedCost = 0.002;
+        simulation.camera.pixelCost = 40e-9;
+        Run before, throttled, after;
+        simulation.run(60.0, before);
+        simulation.camera.factor = 4.0;
+        simulation.run(66.0, throttled);
+        int throttledWidth = simulation.manager.getResolution().x;
+        simulation.run(180.0, throttled);
+        simulation.camera.factor = 1.0;
+        simulation.run(195.0, after);
+        int recoveredWidth = simulation.manager.getResolution().x;
+        simulation.run(300.0, after);
+        report("throttled from 60 s to 180 s", simulation, throttled);
+        check("throttling steps down within 6 s", throttledWidth == 480 &&
+            simulation.manager.getReason() == CAPTURE_REASON_HEADROOM);
+        check("steps up again within 15 s of recovering", recoveredWidth == 640);
+        check("throttled device keeps up at the smaller size", throttled.rateSum / throttled.frames > 22.0);
+        check("three restarts for throttling", simulation.manager.getStats().switches == 3);
+    }
+
+    // 640x480 is far slower than its pixels suggest
+    {
+        Simulation simulation;
+        simulation.camera.table[192] = 0.004;
+        simulation.camera.table[320] = 0.006;
+        simulation.camera.table[480] = 0.010;
+        simulation.camera.table[640] = 0.060;
+        simulation.camera.table[1280] = 0.200;
+        Run run;
+        simulation.run(600.0, run);
+        report("prediction too optimistic", simulation, run);
+        check("a resolution that falls behind is backed off", simulation.manager.getStats().switches <= 12 &&
+            run.timeAtWidth[640] < 60.0);
+        check("and the one that keeps up is used", simulation.manager.getResolution().x == 480 &&
+            run.timeAtWidth[480] > 500.0);
+    }
+
+    // the governor halves the frame rate for a while
+    {
+        Simulation simulation;
+        simulation.camera.fixedCost = 0.002;
+        simulation.camera.pixelCost = 40e-9;
+        Run full, reduced;
+        simulation.run(30.0, full);
+        unsigned long switches = simulation.manager.getStats().switches;
+        simulation.run(90.0, reduced, 15.0);
+        simulation.run(120.0, full);
+        report("15 fps from 30 s to 90 s", simulation, reduced);
+        check("a lower frame rate is not an overload", simulation.manager.getStats().switches == switches &&
+            simulation.manager.getResolution().x == 640);
+    }
+
+    // a fixed resolution stays even when the tracking falls behind
+    {
+        Simulation simulation;
+        simulation.camera.fixedCost = 0.005;
+        simulation.camera.pixelCost = 300e-9;
+        simulation.manager.setFixedResolution(metaio::Vector2di(640, 480));
+        Run run;
+        simulation.run(120.0, run);
+        report("fixed 640x480 on a slow device", simulation, run);
+        check("a fixed resolution is kept", simulation.camera.width == 640 && simulation.camera.activations == 1 &&
+            simulation.manager.getReason() == CAPTURE_REASON_FIXED);
+        simulation.manager.setFixedResolution(metaio::Vector2di());
+        simulation.run(240.0, run);
+        check("automatic again after unfixing", simulation.manager.getResolution().x == 320);
+    }
+
+    // the camera has no 640x480 preset: back to 480x360, not again before the back-off
+    {
+        Simulation simulation;
+        simulation.camera.fixedCost = 0.002;
+        simulation.camera.pixelCost = 40e-9;
+        simulation.camera.refused[640] = true;
+        Run run;
+        simulation.run(300.0, run);
+        report("640x480 refused", simulation, run);
+        CaptureStats stats = simulation.manager.getStats();
+        check("a refused resolution goes back to the one before", simulation.manager.isRunning() &&
+            simulation.camera.width == 480 && simulation.manager.getActualResolution().x == 480);
+        check("and is backed off", stats.failures >= 1 && stats.failures <= 5 && stats.failures == stats.switches);
+    }
+
+    // throttled when nothing starts any more: the manager stops instead of pretending to run
+    {
+        Simulation simulation;
+        simulation.camera.fixedCost = 0.002;
+        simulation.camera.pixelCost = 40e-9;
+        Run run;
+        simulation.run(10.0, run);
+        for (int width = 192; width <= 1280; width++)
+            simulation.camera.refused[width] = true;
+        simulation.camera.factor = 4.0;
+        simulation.run(60.0, run);
+        check("the manager stops when no resolution starts", !simulation.manager.isRunning() &&
+            simulation.manager.getActualResolution().isNull());
+    }
+
+    // a fixed resolution the camera refuses keeps the one before
+    {
+        Simulation simulation;
+        simulation.camera.fixedCost = 0.002;
+        simulation.camera.pixelCost = 40e-9;
+        simulation.camera.refused[1280] = true;
+        Run run;
+        simulation.run(30.0, run);
+        bool fixed = simulation.manager.setFixedResolution(metaio::Vector2di(1280, 720));
+        check("a refused fixed resolution keeps the one before", !fixed && simulation.manager.isRunning() &&
+            simulation.camera.width == 640 && simulation.manager.getReason() == CAPTURE_REASON_FAILED);
+    }
+
+    printf("\n");
+    if (failures > 0)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,231 @@
+//
+//  colorbench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Exactness and speed of the color conversions:
+//
+//      colorbench
+//
+//  Every supported pair of formats is converted from random pixels at
+//  widths that leave every tail length of the vectorized kernels, with and
+//  without a flip, once with the vectorized kernels and once with the
+//  scalar ones; the two must be equal byte for byte. Then the conversions
+//  of camera frames and textures are timed at 480x360 and 1280x720 in
+//  megapixels per second. Exits with 1 if a check fails.
+//
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include "ColorConvert.h"
+#include "ImageFormat.h"
+
+using namespace unifeye;
+using namespace metaio::common;
+
+namespace
+{
+    int failures = 0;
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    double now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    const ECOLOR_FORMAT FORMATS[] = { ECF_A1R5G5B5, ECF_R5G6B5, ECF_R8G8B8, ECF_B8G8R8, ECF_A8R8G8B8,
+        ECF_A8B8G8R8, ECF_V8Y8U8Y8, ECF_GRAY, ECF_YUV420SP };
+    const int FORMAT_COUNT = sizeof(FORMATS) / sizeof(FORMATS[0]);
+
+    const char* getFormatName( ECOLOR_FORMAT format )
+    {
+        switch (format)
+        {
+            case ECF_A1R5G5B5: return "A1R5G5B5";
+            case ECF_R5G6B5: return "R5G6B5";
+            case ECF_R8G8B8: return "R8G8B8";
+            case ECF_B8G8R8: return "B8G8R8";
+            case ECF_A8R8G8B8: return "A8R8G8B8";
+            case ECF_A8B8G8R8: return "A8B8G8R8";
+            case ECF_V8Y8U8Y8: return "V8Y8U8Y8";
+            case ECF_GRAY: return "GRAY";
+            case ECF_YUV420SP: return "YUV420SP";
+            default: return "unknown";
+        }
+    }
+
+    struct Image
+    {
+        std::vector<unsigned char> pixels;
+        metaio::ImageStruct image;
+
+        Image( ECOLOR_FORMAT format, int width, int height, bool upperLeft ) :
+            pixels(getImageBufferSize(format, width, height) + 1),
+            image(&pixels[0], width, height, format, upperLeft) {};
+    };
+
+    void randomize( Image& image, unsigned int seed )
+    {
+        for (size_t i = 0; i < image.pixels.size(); i++)
+        {
+            seed = seed * 1664525U + 1013904223U;
+            image.pixels[i] = (unsigned char)(seed >> 24);
+        }
+    }
+
+    // converts with the scalar and the vectorized kernels, false if they differ
+    bool compare( ECOLOR_FORMAT srcFormat, ECOLOR_FORMAT dstFormat, int width, int height, bool flip, unsigned int seed )
+    {
+        Image src(srcFormat, width, height, true);
+        randomize(src, seed);
+        Image scalar(dstFormat, width, height, !flip);
+        Image simd(dstFormat, width, height, !flip);
+        randomize(scalar, 1);
+        simd.pixels = scalar.pixels;
+
+        setColorConvertSIMDEnabled(false);
+        bool scalarOk = convertImage(src.image, scalar.image);
+        setColorConvertSIMDEnabled(true);
+        bool simdOk = convertImage(src.image, simd.image);
+
+        // the byte after the image is never written
+        return scalarOk == simdOk && scalar.pixels == simd.pixels;
+    }
+
+    double throughput( ECOLOR_FORMAT srcFormat, ECOLOR_FORMAT dstFormat, int width, int height, bool simd, bool flip )
+    {
+        Image src(srcFormat, width, height, true);
+        randomize(src, 7);
+        Image dst(dstFormat, width, height, !flip);
+        setColorConvertSIMDEnabled(simd);
+
+        // at least a quarter of a second
+        int runs = 0;
+        double start = now(), elapsed = 0;
+        do
+        {
+            convertImage(src.image, dst.image);
+            runs++;
+            elapsed = now() - start;
+        } while (elapsed < 0.25);
+
+        setColorConvertSIMDEnabled(true);
+        return (double)width * height * runs / elapsed / 1e6;
+    }
+}
+
+int main()
+{
+    printf("vectorized kernels: %s\n", getColorConvertSIMDPath());
+
+    // every pair, at widths around the 16 and 32 pixel blocks and odd heights
+    int pairs = 0, mismatches = 0;
+    for (int s = 0; s < FORMAT_COUNT; s++)
+    {
+        for (int d = 0; d < FORMAT_COUNT; d++)
+        {
+            if (!isColorConversionSupported(FORMATS[s], FORMATS[d]))
+                continue;
+            pairs++;
+            bool same = true;
+            for (int width = 1; width <= 70 && same; width++)
+            {
+                same = compare(FORMATS[s], FORMATS[d], width, 3, false, width) &&
+                       compare(FORMATS[s], FORMATS[d], width, 5, true, width * 31);
+            }
+            same = same && compare(FORMATS[s], FORMATS[d], 480, 360, true, 5);
+            if (!same)
+            {
+                printf("  %s to %s differs from scalar\n", getFormatName(FORMATS[s]), getFormatName(FORMATS[d]));
+                mismatches++;
+            }
+        }
+    }
+    printf("%d pairs compared\n", pairs);
+    check("vectorized output equals scalar for every pair", mismatches == 0);
+
+    // known values: white and black in video range, a swap of red and blue
+    {
+        Image nv21(ECF_YUV420SP, 4, 2, true);
+        memset(&nv21.pixels[0], 235, 8);
+        memset(&nv21.pixels[8], 128, 4);
+        Image rgba(ECF_A8B8G8R8, 4, 2, true);
+        convertImage(nv21.image, rgba.image);
+        bool white = true;
+        for (int i = 0; i < 32; i++)
+            white = white && rgba.pixels[i] == 255;
+        memset(&nv21.pixels[0], 16, 8);
+        convertImage(nv21.image, rgba.image);
+        bool black = true;
+        for (int i = 0; i < 32; i++)
+            black = black && rgba.pixels[i] == (i % 4 == 3 ? 255 : 0);
+        check("NV21 video range maps to full range RGBA", white && black);
+
+        Image bgra(ECF_A8R8G8B8, 1, 1, true);
+        bgra.pixels[0] = 30;
+        bgra.pixels[1] = 20;
+        bgra.pixels[2] = 10;
+        bgra.pixels[3] = 40;
+        Image swapped(ECF_A8B8G8R8, 1, 1, true);
+        convertImage(bgra.image, swapped.image);
+        check("A8R8G8B8 to A8B8G8R8 swaps red and blue", swapped.pixels[0] == 10 && swapped.pixels[1] == 20 &&
+            swapped.pixels[2] == 30 && swapped.pixels[3] == 40);
+    }
+
+    // the conversions of camera frames, screenshots and textures
+    struct Pair
+    {
+        ECOLOR_FORMAT src, dst;
+    };
+    const Pair timed[] = {
+        { ECF_YUV420SP, ECF_A8B8G8R8 },
+        { ECF_YUV420SP, ECF_GRAY },
+        { ECF_A8R8G8B8, ECF_A8B8G8R8 },
+        { ECF_A8R8G8B8, ECF_GRAY },
+        { ECF_V8Y8U8Y8, ECF_A8B8G8R8 },
+        { ECF_A8R8G8B8, ECF_R5G6B5 },
+    };
+    const int sizes[][2] = { { 480, 360 }, { 1280, 720 } };
+
+    printf("\n%-24s %-10s %11s %9s %9s %8s\n", "conversion", "size", "scalar", "vector", "flipped", "speedup");
+    bool faster = true;
+    for (size_t p = 0; p < sizeof(timed) / sizeof(timed[0]); p++)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            int width = sizes[i][0], height = sizes[i][1];
+            double scalar = throughput(timed[p].src, timed[p].dst, width, height, false, false);
+            double simd = throughput(timed[p].src, timed[p].dst, width, height, true, false);
+            double flipped = throughput(timed[p].src, timed[p].dst, width, height, true, true);
+            char name[32], size[16];
+            snprintf(name, sizeof(name), "%s > %s", getFormatName(timed[p].src), getFormatName(timed[p].dst));
+            snprintf(size, sizeof(size), "%dx%d", width, height);
+            printf("%-24s %-10s %6.0f MP/s %4.0f MP/s %4.0f MP/s %7.2fx\n", name, size, scalar, simd, flipped, simd / scalar);
+
+            // the pairs with a vectorized kernel must not be slower than scalar
+            bool vectorized = timed[p].src == ECF_A8R8G8B8 ? timed[p].dst != ECF_R5G6B5 :
+                timed[p].src == ECF_YUV420SP && timed[p].dst != ECF_GRAY;
+            if (vectorized && strcmp(getColorConvertSIMDPath(), "scalar") != 0 && simd < scalar * 0.9)
+                faster = false;
+        }
+    }
+    check("vectorized kernels are not slower than scalar", faster);
+
+    if (failures)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
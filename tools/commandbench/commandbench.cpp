@@ -0,0 +1,550 @@
+//
+//  commandbench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Correctness and speed of the scene command batches:
+//
+//      commandbench [seed]
+//
+//  Encodes random batches and checks that decoding them gives back the
+//  same commands, then mutates, truncates and replaces valid batches with
+//  random bytes and checks that a malformed batch is rejected as a whole,
+//  at the right offset, and never read past its end. A producer thread
+//  submits batches while the render loop applies them. Stub geometries
+//  check the handles, the visibility and the frustum culling of
+//  UnifeyeCommandTarget, and that a model loaded twice through the
+//  GeometryCache gets two geometries. Finally times a frame that moves, turns, scales
+//  and shows 300 objects: encoding, checking and applying. Exits with 1 if
+//  a check fails.
+//
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <UnifeyeSDKMobile/AS_IUnifeyeMobileGeometry.h>
+
+#include "CommandBuffer.h"
+#include "FrameScheduler.h"
+#include "FrustumCuller.h"
+#include "GeometryCache.h"
+
+using namespace unifeye;
+
+namespace
+{
+    const int OBJECTS = 300;
+    const int FRAMES = 1000;
+
+    int failures = 0;
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    double now()
+    {
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec + time.tv_nsec * 1e-9;
+    }
+
+    unsigned int randomState = 1;
+
+    unsigned int random32()
+    {
+        randomState = randomState * 1664525U + 1013904223U;
+        return randomState ^ (randomState >> 16);
+    }
+
+    int randomInt( int count )
+    {
+        return (int)((random32() >> 4) % (unsigned int)count);
+    }
+
+    float randomFloat()
+    {
+        return (float)((int)random32() / 65536.0);
+    }
+
+    // writes what it receives into an encoder again
+    class RecordingTarget : public ICommandTarget
+    {
+    public:
+        RecordingTarget() : batches(0) {};
+
+        CommandEncoder encoder;
+        int batches;
+
+        virtual void setMoveTranslation( int handle, const metaio::Vector3d& v ) { encoder.setMoveTranslation(handle, v.x, v.y, v.z); }
+        virtual void setMoveRotation( int handle, const metaio::Vector4d& v ) { encoder.setMoveRotation(handle, v.x, v.y, v.z, v.w); }
+        virtual void setMoveScale( int handle, const metaio::Vector3d& v ) { encoder.setMoveScale(handle, v.x, v.y, v.z); }
+        virtual void setVisible( int handle, bool visible ) { encoder.setVisible(handle, visible); }
+        virtual void setTransparency( int handle, unsigned char transparency ) { encoder.setTransparency(handle, transparency); }
+        virtual void startAnimation( int handle, const std::string& name, bool loop ) { encoder.startAnimation(handle, name, loop); }
+        virtual void endBatch() { batches++; }
+    };
+
+    void randomCommand( CommandEncoder& encoder )
+    {
+        int handle = randomInt(4) == 0 ? randomInt(COMMAND_MAX_HANDLE + 1) : randomInt(OBJECTS) + 1;
+        switch (randomInt(6))
+        {
+            case 0: encoder.setMoveTranslation(handle, randomFloat(), randomFloat(), randomFloat()); break;
+            case 1: encoder.setMoveRotation(handle, randomFloat(), randomFloat(), randomFloat(), randomFloat()); break;
+            case 2: encoder.setMoveScale(handle, randomFloat(), randomFloat(), randomFloat()); break;
+            case 3: encoder.setVisible(handle, randomInt(2) != 0); break;
+            case 4: encoder.setTransparency(handle, (unsigned char)randomInt(256)); break;
+            default:
+            {
+                std::string name(randomInt(24), ' ');
+                for (size_t i = 0; i < name.size(); i++)
+                    name[i] = (char)(randomInt(255) + 1);
+                encoder.startAnimation(handle, name, randomInt(2) != 0);
+                break;
+            }
+        }
+    }
+
+    // the offsets of the commands of a valid batch, and its end
+    std::vector<size_t> commandOffsets( const CommandEncoder& encoder )
+    {
+        std::vector<size_t> offsets;
+        for (size_t length = 4; length <= encoder.getSize(); length += 4)
+        {
+            if (checkCommands(encoder.getData(), length).ok)
+                offsets.push_back(length);
+        }
+        return offsets;
+    }
+
+    class StubGeometry : public metaio::IUnifeyeMobileGeometry
+    {
+    public:
+        StubGeometry() : visible(true), transparency(0), animations(0), boxReads(0)
+        {
+            box.min = metaio::Vector3d(-1, -1, -1);
+            box.max = metaio::Vector3d(1, 1, 1);
+            scale = metaio::Vector3d(1, 1, 1);
+            rotation = metaio::Vector4d(0, 0, 1, 0);
+        };
+
+        metaio::BoundingBox box;
+        metaio::Vector3d translation, scale;
+        metaio::Vector4d rotation;
+        bool visible;
+        unsigned char transparency;
+        int animations;
+        int boxReads;
+
+        virtual void setMoveTranslation( const metaio::Vector3d& value, bool concat ) { translation = value; }
+        virtual metaio::Vector3d getMoveTranslation() { return translation; }
+        virtual void setMoveTranslationLLA( metaio::LLACoordinate ) {}
+        virtual metaio::LLACoordinate getMoveTranslationLLA() { return metaio::LLACoordinate(); }
+        virtual metaio::Vector3d getMoveTranslationLLACartesian() { return metaio::Vector3d(); }
+        virtual void setMoveScale( const metaio::Vector3d& value, bool concat ) { scale = value; }
+        virtual metaio::Vector3d getMoveScale() { return scale; }
+        virtual void setMoveRotation( const metaio::Vector4d& value, bool concat ) { rotation = value; }
+        virtual metaio::Vector4d getMoveRotation() { return rotation; }
+        virtual void setMoveRotation( const metaio::Vector3d& value, bool concat ) {}
+        virtual bool getIsRendered() { return visible; }
+        virtual bool getIsVisible() { return visible; }
+        virtual void setVisible( bool value ) { visible = value; }
+        virtual void setRenderAsXray( bool ) {}
+        virtual void setOcclusionMode( bool ) {}
+        virtual void setTransparency( unsigned char value ) { transparency = value; }
+        virtual void startAnimation( const std::string&, bool ) { animations++; }
+        virtual void setAnimationSpeed( float ) {}
+        virtual metaio::BoundingBox getBoundingBox() { boxReads++; return box; }
+        virtual void setCos( int ) {}
+        virtual int getCos() { return 1; }
+        virtual metaio::UnifeyeMobileGeometryType getType() { return metaio::GEOMETRYTYPE_GEOMETRY3D; }
+        virtual void setLLALimitsEnabled( bool ) {}
+        virtual void setPickingEnabled( bool ) {}
+        virtual void setTexture( const std::string& ) {}
+        virtual void setTexture( const std::string&, const metaio::ImageStruct&, const bool ) {}
+        virtual void setMovieTexture( const std::string&, const bool, const bool ) {}
+        virtual void removeMovieTexture() {}
+        virtual void stopMovieTexture() {}
+        virtual void playMovieTexture() {}
+        virtual void pauseMovieTexture() {}
+    };
+
+    // loads a StubGeometry for every path, like the SDK loads a file
+    class StubFactory : public IGeometryFactory, public IFrameClock
+    {
+    public:
+        StubFactory() : loads(0), unloads(0) {};
+
+        virtual metaio::IUnifeyeMobileGeometry* loadGeometry( const std::string& ) { loads++; return new StubGeometry(); }
+        virtual void unloadGeometry( metaio::IUnifeyeMobileGeometry* geometry ) { unloads++; delete geometry; }
+        virtual void setVisible( metaio::IUnifeyeMobileGeometry* geometry, bool visible ) { geometry->setVisible(visible); }
+        virtual bool isRendered( metaio::IUnifeyeMobileGeometry* geometry ) { return geometry->getIsRendered(); }
+        virtual size_t estimateBytes( const std::string&, size_t fileSize ) { return fileSize; }
+        virtual double now() { return ::now(); }
+
+        int loads, unloads;
+    };
+
+    struct Producer
+    {
+        CommandQueue* queue;
+        int batches;
+        int commandsPerBatch;
+    };
+
+    void* produce( void* argument )
+    {
+        Producer* producer = static_cast<Producer*>(argument);
+        CommandEncoder encoder;
+        int value = 0;
+        for (int i = 0; i < producer->batches; i++)
+        {
+            encoder.clear();
+            for (int j = 0; j < producer->commandsPerBatch; j++)
+            {
+                encoder.setMoveTranslation(1, (float)value, 0, 0);
+                value++;
+            }
+            producer->queue->submit(encoder.getData(), encoder.getSize());
+
+            // about as often as a script would
+            if (i % 10 == 9)
+            {
+                struct timespec pause = { 0, 100000 };
+                nanosleep(&pause, 0);
+            }
+        }
+        return 0;
+    }
+
+    // checks that the translations arrive in the order they were submitted
+    class SequenceTarget : public ICommandTarget
+    {
+    public:
+        SequenceTarget() : next(0), outOfOrder(0) {};
+
+        int next;
+        int outOfOrder;
+
+        virtual void setMoveTranslation( int, const metaio::Vector3d& v )
+        {
+            if ((int)v.x != next)
+                outOfOrder++;
+            next = (int)v.x + 1;
+        }
+        virtual void setMoveRotation( int, const metaio::Vector4d& ) {}
+        virtual void setMoveScale( int, const metaio::Vector3d& ) {}
+        virtual void setVisible( int, bool ) {}
+        virtual void setTransparency( int, unsigned char ) {}
+        virtual void startAnimation( int, const std::string&, bool ) {}
+    };
+}
+
+int main( int argc, char** argv )
+{
+    if (argc > 1)
+        randomState = (unsigned int)atoi(argv[1]);
+
+    // random batches come back unchanged
+    {
+        int mismatches = 0;
+        unsigned long commands = 0;
+        for (int i = 0; i < 2000; i++)
+        {
+            CommandEncoder encoder;
+            int count = randomInt(200);
+            for (int j = 0; j < count; j++)
+                randomCommand(encoder);
+
+            RecordingTarget target;
+            CommandResult result = applyCommands(encoder.getData(), encoder.getSize(), target);
+            commands += result.commands;
+            if (!result.ok || result.commands != encoder.getCount() || target.batches != 1 ||
+                target.encoder.getSize() != encoder.getSize() ||
+                memcmp(target.encoder.getData(), encoder.getData(), encoder.getSize()) != 0)
+            {
+                mismatches++;
+            }
+        }
+        printf("round trip: %lu commands in 2000 batches\n", commands);
+        check("random batches round trip", mismatches == 0);
+    }
+
+    // cut at every byte: only whole commands are accepted
+    {
+        CommandEncoder encoder;
+        for (int j = 0; j < 50; j++)
+            randomCommand(encoder);
+        std::vector<size_t> offsets = commandOffsets(encoder);
+
+        int wrong = 0;
+        size_t boundary = 0;
+        for (size_t length = 0; length <= encoder.getSize(); length++)
+        {
+            // a copy of exactly this length, so reading past it would be caught by a checker
+            std::vector<unsigned char> cut(encoder.getData(), encoder.getData() + length);
+            CommandResult result = checkCommands(length ? &cut[0] : NULL, length);
+            bool atBoundary = false;
+            for (size_t k = 0; k < offsets.size(); k++)
+            {
+                if (offsets[k] == length)
+                    atBoundary = true;
+                if (offsets[k] <= length)
+                    boundary = offsets[k];
+            }
+            if (result.ok != atBoundary || (!result.ok && length >= 4 && result.errorOffset != boundary))
+                wrong++;
+        }
+        check("truncated batches fail at the cut command", wrong == 0 && offsets.size() == 51);
+    }
+
+    // mutated and random batches are rejected or still decode consistently
+    {
+        int inconsistent = 0;
+        int partial = 0;
+        unsigned long accepted = 0, rejected = 0;
+        for (int i = 0; i < 20000; i++)
+        {
+            CommandEncoder encoder;
+            int count = randomInt(20) + 1;
+            for (int j = 0; j < count; j++)
+                randomCommand(encoder);
+            std::vector<unsigned char> bytes(encoder.getData(), encoder.getData() + encoder.getSize());
+
+            switch (randomInt(4))
+            {
+                case 0:
+                    bytes[4 + randomInt((int)bytes.size() - 4)] ^= (unsigned char)(1 << randomInt(8));
+                    break;
+                case 1:
+                    bytes[4 + randomInt((int)bytes.size() - 4)] = (unsigned char)random32();
+                    break;
+                case 2:
+                {
+                    unsigned int word = random32();
+                    size_t at = 4 + 4 * randomInt((int)(bytes.size() - 4) / 4 + 1);
+                    bytes.insert(bytes.begin() + at, (unsigned char*)&word, (unsigned char*)&word + 4);
+                    break;
+                }
+                default:
+                    for (size_t k = 4; k < bytes.size(); k++)
+                        bytes[k] = (unsigned char)random32();
+                    break;
+            }
+
+            RecordingTarget target;
+            CommandResult result = applyCommands(&bytes[0], bytes.size(), target);
+            if (!result.ok)
+            {
+                rejected++;
+                if (target.encoder.getCount() != 0 || target.batches != 0)
+                    partial++;
+                continue;
+            }
+
+            // accepted: the same commands again, only the padding of names may differ
+            accepted++;
+            RecordingTarget again;
+            CommandResult second = applyCommands(target.encoder.getData(), target.encoder.getSize(), again);
+            if (!second.ok || second.commands != result.commands || target.encoder.getCount() != result.commands ||
+                again.encoder.getSize() != target.encoder.getSize() ||
+                memcmp(again.encoder.getData(), target.encoder.getData(), target.encoder.getSize()) != 0)
+            {
+                inconsistent++;
+            }
+        }
+        printf("mutations: %lu accepted, %lu rejected\n", accepted, rejected);
+        check("malformed batches are not applied at all", partial == 0 && rejected > 10000);
+        check("accepted mutations decode consistently", inconsistent == 0);
+    }
+
+    // values the SDK should never see
+    {
+        CommandEncoder encoder;
+        encoder.setMoveTranslation(1, 0, NAN, 0);
+        bool nan = checkCommands(encoder.getData(), encoder.getSize()).ok;
+        encoder.clear();
+        encoder.setMoveScale(1, INFINITY, 1, 1);
+        bool infinite = checkCommands(encoder.getData(), encoder.getSize()).ok;
+        encoder.clear();
+        encoder.setVisible(1, true);
+        std::vector<unsigned char> bytes(encoder.getData(), encoder.getData() + encoder.getSize());
+        bytes[0] = 'X';
+        bool magic = checkCommands(&bytes[0], bytes.size()).ok;
+        bytes[0] = encoder.getData()[0];
+        bytes[8] = 2;
+        bool flag = checkCommands(&bytes[0], bytes.size()).ok;
+        check("NaN, infinity, bad magic and flags rejected", !nan && !infinite && !magic && !flag);
+    }
+
+    // a producer thread submits while the render loop applies
+    {
+        CommandQueue queue;
+        Producer producer;
+        producer.queue = &queue;
+        producer.batches = 2000;
+        producer.commandsPerBatch = 25;
+        pthread_t thread;
+        pthread_create(&thread, 0, produce, &producer);
+
+        SequenceTarget target;
+        unsigned long applied = 0;
+        int frames = 0;
+        while (applied < (unsigned long)(producer.batches * producer.commandsPerBatch) && frames < 10000000)
+        {
+            applied += queue.apply(target);
+            frames++;
+        }
+        pthread_join(thread, 0);
+        applied += queue.apply(target);
+
+        CommandQueueStats stats = queue.getStats();
+        printf("queue: %lu batches in %lu frames\n", stats.batches, stats.frames);
+        check("queued batches arrive complete and in order", applied == 50000 && target.outOfOrder == 0 &&
+            stats.commands == 50000 && stats.rejected == 0 && stats.frames > 1);
+
+        std::vector<unsigned char> garbage(64, 0xff);
+        CommandResult result = queue.submit(&garbage[0], garbage.size());
+        check("a malformed batch is not queued", !result.ok && queue.apply(target) == 0 &&
+            queue.getStats().rejected == 1);
+    }
+
+    // handles, visibility and culling of the SDK target
+    {
+        UnifeyeFrustumCulling culling(NULL);
+        UnifeyeCommandTarget target(&culling);
+        StubGeometry geometries[3];
+        int handles[3];
+        for (int i = 0; i < 3; i++)
+            handles[i] = target.addGeometry(&geometries[i]);
+        int reads = geometries[0].boxReads;
+
+        CommandEncoder encoder;
+        for (int i = 0; i < 10; i++)
+            encoder.setMoveTranslation(handles[0], (float)i, 0, 0);
+        encoder.setVisible(handles[1], false);
+        encoder.setMoveTranslation(handles[1], 1, 0, 0);
+        encoder.setTransparency(handles[2], 128);
+        encoder.startAnimation(handles[2], "walk", true);
+        encoder.setMoveScale(99, 1, 1, 1);
+        applyCommands(encoder.getData(), encoder.getSize(), target);
+
+        check("a moved geometry is culled with its new box once", geometries[0].boxReads == reads + 1 &&
+            geometries[0].translation.x == 9.0f);
+        check("a hidden geometry is taken out of the culling", !geometries[1].visible &&
+            geometries[1].boxReads == reads);
+        check("transparency and animation reach the geometry", geometries[2].transparency == 128 &&
+            geometries[2].animations == 1);
+        check("unknown handles are skipped", target.getUnknownHandles() == 1);
+
+        encoder.clear();
+        encoder.setVisible(handles[1], true);
+        applyCommands(encoder.getData(), encoder.getSize(), target);
+        bool shown = geometries[1].visible && geometries[1].boxReads == reads + 1;
+
+        target.removeGeometry(handles[0]);
+        encoder.clear();
+        encoder.setMoveTranslation(handles[0], 5, 5, 5);
+        applyCommands(encoder.getData(), encoder.getSize(), target);
+        check("shown again it is culled again", shown);
+        check("a removed handle is not reused", geometries[0].translation.x == 9.0f &&
+            target.getUnknownHandles() == 2 && target.addGeometry(&geometries[0]) == 4);
+    }
+
+    // the same model loaded twice, like loadGeometry() does for the handles
+    {
+        char path[] = "/tmp/commandbench-XXXXXX";
+        int file = mkstemp(path);
+        bool written = file >= 0 && write(file, "model", 5) == 5;
+        if (file >= 0)
+            close(file);
+
+        StubFactory factory;
+        GeometryCache cache(&factory, &factory);
+        UnifeyeCommandTarget target(NULL);
+        metaio::IUnifeyeMobileGeometry* first = written ? cache.acquire(path) : NULL;
+        metaio::IUnifeyeMobileGeometry* second = written ? cache.acquire(path) : NULL;
+        int a = first ? target.addGeometry(first) : 0;
+        int b = second ? target.addGeometry(second) : 0;
+        check("a model loaded twice gets two geometries", a && b && first != second && factory.loads == 2);
+
+        CommandEncoder encoder;
+        encoder.setMoveTranslation(a, 3, 0, 0);
+        encoder.setVisible(a, false);
+        applyCommands(encoder.getData(), encoder.getSize(), target);
+        check("commands for one handle leave the other alone", a && b &&
+            first->getMoveTranslation().x == 3.0f && second->getMoveTranslation().x == 0.0f &&
+            !first->getIsVisible() && second->getIsVisible());
+
+        cache.release(target.removeGeometry(a));
+        bool kept = b && second->getIsVisible() && target.getGeometry(b) == second;
+        metaio::IUnifeyeMobileGeometry* third = written ? cache.acquire(path) : NULL;
+        check("unloading one keeps the other shown", kept);
+        check("and the released one is reused", third == first && factory.loads == 2);
+        if (third)
+            cache.release(third);
+        if (b)
+            cache.release(target.removeGeometry(b));
+        unlink(path);
+    }
+
+    // a frame that moves, turns, scales and shows 300 objects
+    {
+        std::vector<StubGeometry> geometries(OBJECTS);
+        UnifeyeFrustumCulling culling(NULL);
+        UnifeyeCommandTarget target(&culling);
+        for (int i = 0; i < OBJECTS; i++)
+            target.addGeometry(&geometries[i]);
+
+        CommandEncoder encoder;
+        CommandQueue queue;
+        double encodeTime = 0, submitTime = 0, applyTime = 0;
+        for (int frame = 0; frame < FRAMES; frame++)
+        {
+            double start = now();
+            encoder.clear();
+            for (int i = 0; i < OBJECTS; i++)
+            {
+                float t = frame * 0.01f + i;
+                encoder.setMoveTranslation(i + 1, cosf(t) * 100.0f, sinf(t) * 100.0f, 0.0f);
+                encoder.setMoveRotation(i + 1, 0.0f, 0.0f, 1.0f, t);
+                encoder.setMoveScale(i + 1, 1.0f, 1.0f, 1.0f);
+                encoder.setVisible(i + 1, ((frame / 30 + i) & 7) != 0);
+            }
+            double encoded = now();
+            queue.submit(encoder.getData(), encoder.getSize());
+            double submitted = now();
+            queue.apply(target);
+            double applied = now();
+
+            encodeTime += encoded - start;
+            submitTime += submitted - encoded;
+            applyTime += applied - submitted;
+        }
+
+        double commands = (double)FRAMES * OBJECTS * 4;
+        printf("\n%d objects, %d commands, %lu bytes per frame\n", OBJECTS, OBJECTS * 4, (unsigned long)encoder.getSize());
+        printf("    encode  %8.1f us per frame\n", encodeTime / FRAMES * 1e6);
+        printf("    check   %8.1f us per frame\n", submitTime / FRAMES * 1e6);
+        printf("    apply   %8.1f us per frame, %.1f M commands/s with culling boxes\n",
+            applyTime / FRAMES * 1e6, commands / applyTime * 1e-6);
+        check("300 objects are applied in under a millisecond", applyTime / FRAMES < 0.001);
+    }
+
+    printf("\n");
+    if (failures > 0)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,169 @@
+//
+//  cullbench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Frustum culling cost of FrustumCuller while the camera pans:
+//
+//      cullbench [frames]
+//
+//  Boxes are spread around four coordinate systems. Every frame the camera
+//  turns a bit; only one coordinate system is tracked in half of the
+//  frames, so the others keep their results. The SIMD results are checked
+//  against the scalar path and against testing the eight corners of every
+//  box.
+//
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+#include "FrustumCuller.h"
+
+namespace
+{
+    const float PI = 3.14159265f;
+    const int COS_COUNT = 4;
+
+    double now()
+    {
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec + time.tv_nsec * 1e-9;
+    }
+
+    float random( float low, float high )
+    {
+        return low + (high - low) * (float)rand() / RAND_MAX;
+    }
+
+    // camera turned by a heading, looking at a coordinate system offset sideways
+    void getModelView( float heading, int cos, float m[16] )
+    {
+        float c = cosf(heading), s = sinf(heading);
+        float r[16] = { c, 0, -s, 0, 0, 1, 0, 0, s, 0, c, 0, 0, 0, 0, 1 };
+        for (int i = 0; i < 16; i++)
+            m[i] = r[i];
+        m[12] = c * (cos - 1.5f) * 500.0f;
+        m[14] = -s * (cos - 1.5f) * 500.0f - 1000.0f;
+    }
+
+    bool cornersOutside( const float clip[16], const metaio::BoundingBox& box )
+    {
+        // outside if all corners are beyond the same clip plane
+        for (int plane = 0; plane < 6; plane++)
+        {
+            int axis = plane / 2;
+            float sign = (plane & 1) ? -1.0f : 1.0f;
+            bool allOutside = true;
+            for (int corner = 0; corner < 8 && allOutside; corner++)
+            {
+                float p[3] = { (corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y,
+                    (corner & 4) ? box.max.z : box.min.z };
+                float v[4];
+                for (int row = 0; row < 4; row++)
+                    v[row] = clip[row] * p[0] + clip[4 + row] * p[1] + clip[8 + row] * p[2] + clip[12 + row];
+                allOutside = v[3] + sign * v[axis] < 0.0f;
+            }
+            if (allOutside)
+                return true;
+        }
+        return false;
+    }
+}
+
+int main( int argc, char** argv )
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 1000;
+    if (frames <= 0)
+    {
+        fprintf(stderr, "usage: cullbench [frames]\n");
+        return 2;
+    }
+
+    // 60 degrees vertical field of view, 3:4, near 10 mm, far 10 m
+    float f = 1.0f / tanf(PI / 6.0f), nearPlane = 10.0f, farPlane = 10000.0f;
+    float projection[16] = { f * 0.75f, 0, 0, 0, 0, f, 0, 0,
+        0, 0, (farPlane + nearPlane) / (nearPlane - farPlane), -1, 0, 0, 2 * farPlane * nearPlane / (nearPlane - farPlane), 0 };
+
+    printf("SIMD path: %s\n", unifeye::FrustumCuller::getSIMDPath());
+    printf("%8s %10s %10s %12s %12s %12s %10s\n", "boxes", "inside", "outside", "scalar us", "simd us", "cached us",
+        "mismatch");
+
+    const int counts[] = { 100, 1000, 10000 };
+    for (int c = 0; c < 3; c++)
+    {
+        int count = counts[c];
+        srand(1);
+
+        std::vector<metaio::BoundingBox> boxes(count);
+        std::vector<int> cosIDs(count);
+        for (int i = 0; i < count; i++)
+        {
+            float x = random(-3000.0f, 3000.0f), y = random(-1000.0f, 1000.0f), z = random(-3000.0f, 3000.0f);
+            float size = random(10.0f, 200.0f);
+            boxes[i].min = metaio::Vector3d(x - size, y - size, z - size);
+            boxes[i].max = metaio::Vector3d(x + size, y + size, z + size);
+            cosIDs[i] = 1 + i % COS_COUNT;
+        }
+
+        double times[3];
+        int mismatches = 0, inside = 0, outside = 0;
+        std::vector<std::vector<bool> > results(2, std::vector<bool>(count));
+        for (int mode = 0; mode < 3; mode++)
+        {
+            unifeye::FrustumCuller culler;
+            culler.setSIMDEnabled(mode != 0);
+            culler.setProjection(projection);
+            for (int i = 0; i < count; i++)
+                culler.addBox(cosIDs[i], boxes[i]);
+
+            double start = now();
+            for (int frame = 0; frame < frames; frame++)
+            {
+                float heading = 2.0f * PI * frame / frames;
+                float m[16];
+                for (int cos = 1; cos <= COS_COUNT; cos++)
+                {
+                    // the cached run only tracks the first coordinate system every other frame
+                    if (mode == 2 && cos > 1 && (frame & 1))
+                        continue;
+                    getModelView(heading, cos, m);
+                    culler.setCosMatrix(cos, m);
+                }
+                culler.cull();
+            }
+            times[mode] = (now() - start) / frames;
+
+            if (mode < 2)
+            {
+                for (int i = 0; i < count; i++)
+                    results[mode][i] = culler.isInside(i);
+                inside = culler.getStats().inside;
+                outside = culler.getStats().outside;
+            }
+        }
+
+        // the last frame against the scalar path and the corners
+        float heading = 2.0f * PI * (frames - 1) / frames;
+        for (int i = 0; i < count; i++)
+        {
+            float m[16], clip[16];
+            getModelView(heading, cosIDs[i], m);
+            for (int column = 0; column < 4; column++)
+                for (int row = 0; row < 4; row++)
+                    clip[column * 4 + row] = projection[row] * m[column * 4] + projection[4 + row] * m[column * 4 + 1] +
+                        projection[8 + row] * m[column * 4 + 2] + projection[12 + row] * m[column * 4 + 3];
+            bool corners = !cornersOutside(clip, boxes[i]);
+            if (results[0][i] != results[1][i] || results[1][i] != corners)
+                mismatches++;
+        }
+
+        printf("%8d %10d %10d %12.2f %12.2f %12.2f %10d\n", count, inside, outside, times[0] * 1e6, times[1] * 1e6,
+            times[2] * 1e6, mismatches);
+    }
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+//
+//  declutterbench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Layout time of BillboardDeclutter for POIs around the camera:
+//
+//      declutterbench [iterations]
+//
+//  Compares a full layout with the grid against the same stacking done by
+//  comparing all pairs, checks that both stack every billboard the same
+//  way, and measures an update where the camera only rotates.
+//
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "BillboardDeclutter.h"
+
+namespace
+{
+    const float PI = 3.14159265f;
+    const float NEAR_VALUE = 200.0f, FAR_VALUE = 1000.0f;
+    const int WEIGHT = 10, MAX_OVERLAP = 10;
+
+    double now()
+    {
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec + time.tv_nsec * 1e-9;
+    }
+
+    float random( float low, float high )
+    {
+        return low + (high - low) * (float)rand() / RAND_MAX;
+    }
+
+    float wrapAngle( float angle )
+    {
+        if (angle >= PI || angle < -PI)
+            angle -= 2.0f * PI * floorf((angle + PI) / (2.0f * PI));
+        return angle;
+    }
+
+    struct Poi
+    {
+        float x, y, z, width, height;
+        float azimuth, elevation, halfWidth, angularHeight, lift;
+    };
+
+    // the stacking of BillboardDeclutter, every billboard checked against all stacked before it
+    void allPairsLayout( std::vector<Poi>& pois )
+    {
+        std::vector<std::pair<float, int> > order;
+        float maxDistance = 0.0f;
+        for (size_t i = 0; i < pois.size(); i++)
+        {
+            const Poi& poi = pois[i];
+            float range = sqrtf(poi.x * poi.x + poi.y * poi.y + poi.z * poi.z);
+            maxDistance = std::max(maxDistance, range);
+            order.push_back(std::make_pair(range, (int)i));
+        }
+        std::sort(order.begin(), order.end());
+
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            Poi& poi = pois[order[i].second];
+            float distance = NEAR_VALUE + (FAR_VALUE - NEAR_VALUE) * powf(order[i].first / maxDistance, (float)WEIGHT);
+            poi.azimuth = atan2f(poi.x, poi.y);
+            poi.elevation = atan2f(poi.z, sqrtf(poi.x * poi.x + poi.y * poi.y));
+            poi.halfWidth = atanf(0.5f * poi.width / distance);
+            poi.angularHeight = 2.0f * atanf(0.5f * poi.height / distance);
+            poi.lift = 0.0f;
+
+            for (int level = 0; ; level++)
+            {
+                float bottom = poi.elevation + poi.lift;
+                float top = bottom + poi.angularHeight;
+                bool covered = false;
+                float maxTop = 0.0f, maxBottom = 0.0f;
+                for (size_t j = 0; j < i; j++)
+                {
+                    const Poi& other = pois[order[j].second];
+                    float otherBottom = other.elevation + other.lift;
+                    float otherTop = otherBottom + other.angularHeight;
+                    if (otherBottom >= top || bottom >= otherTop ||
+                        fabsf(wrapAngle(poi.azimuth - other.azimuth)) >= poi.halfWidth + other.halfWidth)
+                        continue;
+                    maxTop = covered ? std::max(maxTop, otherTop) : otherTop;
+                    maxBottom = covered ? std::max(maxBottom, otherBottom) : otherBottom;
+                    covered = true;
+                }
+
+                if (!covered)
+                    break;
+                if (level >= MAX_OVERLAP)
+                {
+                    poi.lift = maxBottom + 0.1f * poi.angularHeight - poi.elevation;
+                    break;
+                }
+                poi.lift = maxTop - poi.elevation;
+            }
+        }
+    }
+}
+
+int main( int argc, char** argv )
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 10;
+    if (iterations <= 0)
+    {
+        fprintf(stderr, "usage: declutterbench [iterations]\n");
+        return 2;
+    }
+
+    printf("%8s %12s %12s %12s %10s\n", "pois", "pairs ms", "grid ms", "rotate ms", "mismatch");
+    const int counts[] = { 100, 1000, 5000, 20000 };
+    for (int c = 0; c < 4; c++)
+    {
+        int count = counts[c];
+        srand(1);
+
+        // POIs within 5 km, a few stories above or below the camera
+        std::vector<Poi> pois(count);
+        unifeye::BillboardDeclutter declutter(NEAR_VALUE, FAR_VALUE);
+        declutter.setDistanceWeightFactor(WEIGHT);
+        declutter.setBillboardExpandFactors(0.8f, 5, MAX_OVERLAP);
+        for (int i = 0; i < count; i++)
+        {
+            Poi& poi = pois[i];
+            float angle = random(-PI, PI), range = random(50.0f, 5000.0f);
+            poi.x = range * sinf(angle);
+            poi.y = range * cosf(angle);
+            poi.z = random(-20.0f, 20.0f);
+            poi.width = random(10.0f, 30.0f);
+            poi.height = 0.5f * poi.width;
+            declutter.addBillboard(metaio::Vector3d(poi.x, poi.y, poi.z), poi.width, poi.height);
+        }
+
+        // all pairs once, it is too slow to repeat
+        double start = now();
+        allPairsLayout(pois);
+        double pairsTime = now() - start;
+
+        // every camera move lays out again
+        start = now();
+        for (int i = 0; i < iterations; i++)
+        {
+            declutter.setCameraPosition(metaio::Vector3d(0.0f, 0.0f, (i & 1) ? 0.001f : 0.0f));
+            declutter.update(metaio::Vector3d(0.0f, 1.0f, 0.0f), 1.0f);
+        }
+        double gridTime = (now() - start) / iterations;
+
+        declutter.setCameraPosition(metaio::Vector3d(0.0f, 0.0f, 0.0f));
+        declutter.update(metaio::Vector3d(0.0f, 1.0f, 0.0f), 1.0f);
+        int mismatches = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (fabsf(declutter.getLift(i) - pois[i].lift) > 1e-5f)
+                mismatches++;
+        }
+
+        // rotations only expand the stacks again
+        unsigned long layouts = declutter.getLayoutCount();
+        start = now();
+        for (int i = 0; i < iterations; i++)
+        {
+            float heading = 2.0f * PI * i / iterations;
+            declutter.update(metaio::Vector3d(sinf(heading), cosf(heading), 0.0f), 1.0f);
+        }
+        double rotateTime = (now() - start) / iterations;
+        if (declutter.getLayoutCount() != layouts)
+            fprintf(stderr, "rotation caused a layout\n");
+
+        printf("%8d %12.2f %12.2f %12.3f %10d\n", count, pairsTime * 1e3, gridTime * 1e3, rotateTime * 1e3,
+            mismatches);
+    }
+
+    return 0;
+}
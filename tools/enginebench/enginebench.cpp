@@ -0,0 +1,334 @@
+//
+//  enginebench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Life cycle of the shared engine against a stub backend:
+//
+//      enginebench
+//
+//  The stub sleeps for each start up step about as long as the SDK takes
+//  on an iPhone 4 (license check, renderer, calibration, tracking data)
+//  and counts what it creates and destroys. The scenarios time how long a
+//  view waits for the engine with and without a warm-up at module load,
+//  reopen views within and after the grace period, purge on a memory
+//  warning, fail the license check, and hammer acquire() and release()
+//  from several threads. The grace period runs on a clock that can be
+//  moved ahead. Prints the start up timelines and exits with 1 if a check
+//  fails.
+//
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+
+#include "EngineManager.h"
+#include "FrameScheduler.h"
+
+using namespace unifeye;
+
+namespace
+{
+    // seconds per step, roughly an iPhone 4
+    const double STEP_COSTS[ENGINE_STEP_COUNT] = { 0.150, 0.080, 0.040, 0.120 };
+    const double TOTAL_COST = 0.390;
+
+    int failures = 0;
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    void sleepFor( double seconds )
+    {
+        struct timespec duration;
+        duration.tv_sec = (time_t)seconds;
+        duration.tv_nsec = (long)((seconds - duration.tv_sec) * 1e9);
+        nanosleep(&duration, 0);
+    }
+
+    // the system clock, moved ahead for the grace period
+    class AdvancingClock : public SystemFrameClock
+    {
+    public:
+        AdvancingClock() : offset(0) {};
+
+        virtual double now()
+        {
+            ScopedLock lock(mutex);
+            return SystemFrameClock::now() + offset;
+        }
+
+        void advance( double seconds )
+        {
+            ScopedLock lock(mutex);
+            offset += seconds;
+        }
+
+    private:
+        Mutex mutex;
+        double offset;
+    };
+
+    class StubBackend : public IEngineBackend
+    {
+    public:
+        StubBackend() : failStep(-1), steps(0), creations(0), destroys(0), inside(0), overlaps(0), alive(false),
+            backgroundSteps(0), warmUps(0), scale(1.0) {};
+
+        int failStep;                   // this step fails, -1 for none
+        volatile int steps;
+        volatile int creations;
+        volatile int destroys;
+        volatile int inside;
+        volatile int overlaps;          // steps or destroys that ran at the same time
+        bool alive;
+        volatile int backgroundSteps;
+        volatile int warmUps;
+        double scale;                   // of the step costs
+
+        virtual bool runStep( ENGINE_STEP step )
+        {
+            enter();
+            atomicIncrement(&steps);
+            if (!pthread_equal(pthread_self(), mainThread))
+                atomicIncrement(&backgroundSteps);
+            sleepFor(STEP_COSTS[step] * scale);
+            bool ok = step != failStep;
+            if (ok && step == ENGINE_STEP_COUNT - 1)
+            {
+                alive = true;
+                atomicIncrement(&creations);
+            }
+            leave();
+            return ok;
+        }
+
+        virtual void destroy()
+        {
+            enter();
+            if (alive)
+                atomicIncrement(&destroys);
+            alive = false;
+            sleepFor(0.010 * scale);
+            leave();
+        }
+
+        virtual void beginWarmUp() { atomicIncrement(&warmUps); }
+
+        static pthread_t mainThread;
+
+    private:
+        void enter()
+        {
+            if (atomicIncrement(&inside) > 1)
+                atomicIncrement(&overlaps);
+        }
+
+        void leave() { atomicDecrement(&inside); }
+    };
+
+    pthread_t StubBackend::mainThread;
+
+    void printTimeline( const char* name, const EngineManager& manager )
+    {
+        std::vector<EngineEvent> timeline;
+        manager.getTimeline(timeline);
+        printf("%s\n", name);
+        for (size_t i = 0; i < timeline.size(); i++)
+        {
+            const EngineEvent& event = timeline[i];
+            printf("    %-14s %8.1f ms %+8.1f ms  %-10s %s\n", event.name.c_str(), event.start * 1000.0,
+                event.duration * 1000.0, event.background ? "background" : "main", event.ok ? "" : "failed");
+        }
+    }
+
+    struct Hammer
+    {
+        EngineManager* manager;
+        int iterations;
+        volatile int failed;
+    };
+
+    void* hammer( void* argument )
+    {
+        Hammer* hammer = static_cast<Hammer*>(argument);
+        for (int i = 0; i < hammer->iterations; i++)
+        {
+            if (!hammer->manager->acquire())
+            {
+                atomicIncrement(&hammer->failed);
+                continue;
+            }
+            hammer->manager->update();
+            hammer->manager->release();
+            hammer->manager->purge();
+        }
+        return 0;
+    }
+}
+
+int main( int argc, char** argv )
+{
+    StubBackend::mainThread = pthread_self();
+
+    // the module loads, the view opens half a second later
+    {
+        AdvancingClock clock;
+        StubBackend backend;
+        EngineManager manager(&backend, &clock);
+        manager.warmUp();
+        sleepFor(0.5);
+        bool acquired = manager.acquire();
+        printTimeline("view opens 500 ms after the module loads", manager);
+        check("the engine is warm when the view opens", acquired && manager.getStats().lastWait < 0.010);
+        check("all steps ran in the background", backend.backgroundSteps == ENGINE_STEP_COUNT);
+        manager.release();
+    }
+
+    // the view opens right away and waits for the rest of the warm-up
+    double warmWait = 0;
+    {
+        AdvancingClock clock;
+        StubBackend backend;
+        EngineManager manager(&backend, &clock);
+        manager.warmUp();
+        sleepFor(0.1);
+        manager.acquire();
+        warmWait = manager.getStats().lastWait;
+        printTimeline("view opens 100 ms after the module loads", manager);
+        check("the view waits only for the rest", warmWait > TOTAL_COST - 0.1 - 0.05 && warmWait < TOTAL_COST - 0.1 + 0.05);
+        manager.release();
+    }
+
+    // no warm-up, the view brings the engine up itself
+    {
+        AdvancingClock clock;
+        StubBackend backend;
+        EngineManager manager(&backend, &clock);
+        manager.acquire();
+        double coldWait = manager.getStats().lastWait;
+        printTimeline("view opens without a warm-up", manager);
+        check("a cold start pays for all steps", coldWait >= TOTAL_COST && backend.backgroundSteps == 0);
+        check("the warm-up saves the time before the view", warmWait < coldWait - 0.08);
+
+        // reopened within the grace period
+        manager.release();
+        clock.advance(10.0);
+        double remaining = manager.update();
+        bool kept = manager.getState() == ENGINE_READY && remaining > 19.0 && remaining < 21.0;
+        manager.acquire();
+        check("reopening within the grace period reuses it", kept && backend.creations == 1 &&
+            manager.getStats().reuses == 1 && manager.getStats().lastWait < 0.010);
+
+        // and after it
+        manager.release();
+        clock.advance(31.0);
+        manager.update();
+        bool destroyed = manager.getState() == ENGINE_COLD && backend.destroys == 1;
+        manager.acquire();
+        check("after the grace period it is torn down", destroyed && backend.creations == 2);
+
+        // a second view keeps it
+        manager.acquire();
+        manager.release();
+        clock.advance(60.0);
+        manager.update();
+        check("a view still using it keeps it", manager.getState() == ENGINE_READY && manager.getReferences() == 1);
+
+        // memory warnings
+        bool purgedInUse = manager.purge();
+        manager.release();
+        bool purged = manager.purge();
+        check("a memory warning purges it once unused", !purgedInUse && purged &&
+            manager.getState() == ENGINE_COLD && backend.destroys == 2);
+        check("steps never overlap", backend.overlaps == 0);
+    }
+
+    // the license check fails in the warm-up, then the key is fixed
+    {
+        AdvancingClock clock;
+        StubBackend backend;
+        backend.failStep = ENGINE_STEP_CREATE;
+        EngineManager manager(&backend, &clock);
+        manager.warmUp();
+        bool acquired = manager.acquire();
+        bool failed = !acquired && manager.getState() == ENGINE_FAILED && manager.getReferences() == 0 &&
+            manager.getStats().failures == 2 && backend.steps == 2;
+        backend.failStep = -1;
+        acquired = manager.acquire();
+        printTimeline("license check fails", manager);
+        check("a failed start up takes no reference", failed);
+        check("and is tried again by the next view", acquired && manager.getState() == ENGINE_READY);
+        manager.release();
+    }
+
+    // a memory warning during the warm-up does not wait for it
+    {
+        AdvancingClock clock;
+        StubBackend backend;
+        EngineManager manager(&backend, &clock);
+        manager.warmUp();
+        sleepFor(0.05);
+        bool purged = manager.purge();
+        manager.acquire();
+        check("a purge leaves the warm-up alone", !purged && backend.creations == 1 && backend.destroys == 0);
+        manager.release();
+    }
+
+    // the module unloads in the middle of the warm-up
+    {
+        AdvancingClock clock;
+        StubBackend backend;
+        {
+            EngineManager manager(&backend, &clock);
+            manager.warmUp();
+            sleepFor(0.05);
+        }
+        check("unloading waits for the warm-up and tears down", backend.creations == 1 && backend.destroys == 1 &&
+            backend.inside == 0);
+    }
+
+    // views on several threads while the warm-up runs
+    {
+        AdvancingClock clock;
+        StubBackend backend;
+        backend.scale = 0.01;
+        EngineManager manager(&backend, &clock);
+        manager.warmUp();
+
+        const int THREADS = 4;
+        Hammer hammers[THREADS];
+        pthread_t threads[THREADS];
+        for (int i = 0; i < THREADS; i++)
+        {
+            hammers[i].manager = &manager;
+            hammers[i].iterations = 200;
+            hammers[i].failed = 0;
+            pthread_create(&threads[i], 0, hammer, &hammers[i]);
+        }
+        int failed = 0;
+        for (int i = 0; i < THREADS; i++)
+        {
+            pthread_join(threads[i], 0);
+            failed += hammers[i].failed;
+        }
+        EngineStats stats = manager.getStats();
+        printf("concurrent views: %lu acquires, %lu start ups, %lu reuses, %lu purges\n", stats.acquires,
+            stats.creations, stats.reuses, stats.destroys);
+        check("concurrent views never overlap the steps", backend.overlaps == 0 && failed == 0);
+        check("and leave no reference behind", manager.getReferences() == 0 && stats.acquires == THREADS * 200 &&
+            backend.creations - backend.destroys == (manager.getState() == ENGINE_READY ? 1 : 0));
+    }
+
+    printf("\n");
+    if (failures > 0)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
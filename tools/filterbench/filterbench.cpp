@@ -0,0 +1,426 @@
+//
+//  filterbench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Jitter and lag of the pose filter as the view applies it:
+//
+//      filterbench [session.uses]
+//
+//  A 20 second trace of a target, still, panning, shaking and still again,
+//  is tracked at 25 Hz with noise and rendered at 60 Hz. Every frame runs
+//  like drawFrame: the poses of the frame before are filtered to the frame
+//  time, which is what the pose stream gets, and turned into coordinate
+//  system offsets; the pose render() would draw with the draw parameter is
+//  the newly tracked one moved by the offset. Prints for both the jitter
+//  (RMS of the second difference at rest), the error against the true pose
+//  and the lag while panning, unfiltered, filtered without prediction and
+//  filtered. The frames that track a new camera image draw the unfiltered
+//  change, so the drawn poses keep most of the jitter. With a session file
+//  the recorded poses are replayed instead and only the jitter is
+//  reported, as there is no truth.
+//  Exits with 1 if a check fails.
+//
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "PoseFilter.h"
+#include "PoseSnapshot.h"
+#include "SessionPlayer.h"
+#include "VectorMath.h"
+
+using namespace unifeye;
+
+namespace
+{
+    const double PI = 3.14159265358979;
+    const double RENDER_RATE = 60.0;
+    const double TRACKING_RATE = 25.0;
+    const double DURATION = 20.0;
+
+    int failures = 0;
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    unsigned int randomState = 1;
+
+    // standard normal, Box-Muller
+    double gaussian()
+    {
+        randomState = randomState * 1664525U + 1013904223U;
+        double u = ((randomState >> 8) + 1.0) / 16777217.0;
+        randomState = randomState * 1664525U + 1013904223U;
+        double v = (randomState >> 8) / 16777216.0;
+        return sqrt(-2.0 * log(u)) * cos(2.0 * PI * v);
+    }
+
+    enum PHASE { STILL, PAN, SHAKE, PHASE_COUNT };
+
+    PHASE getPhase( double t )
+    {
+        return t < 5.0 || t >= 15.0 ? STILL : (t < 10.0 ? PAN : SHAKE);
+    }
+
+    // the true pose: x in mm and the angle about y in radians
+    void truth( double t, double& x, double& yaw )
+    {
+        const double speed = 60.0, turn = 20.0 * PI / 180.0;
+        if (t < 5.0)
+        {
+            x = 0.0;
+            yaw = 0.0;
+        }
+        else if (t < 10.0)
+        {
+            x = speed * (t - 5.0);
+            yaw = turn * (t - 5.0);
+        }
+        else if (t < 15.0)
+        {
+            double s = sin(2.0 * PI * 1.5 * (t - 10.0));
+            x = speed * 5.0 + 40.0 * s;
+            yaw = turn * 5.0 + 0.2 * s;
+        }
+        else
+        {
+            x = speed * 5.0;
+            yaw = turn * 5.0;
+        }
+    }
+
+    void setPose( metaio::Pose& pose, double x, double yaw )
+    {
+        pose.cosID = 1;
+        pose.translation = metaio::Vector3d((float)x, 20.0f, 600.0f);
+        pose.rotation = metaio::Vector4d(0.0f, (float)sin(0.5 * yaw), 0.0f, (float)cos(0.5 * yaw));
+        pose.quality = 0.9f;
+    }
+
+    // the pose render() draws: the tracked one followed by the offset
+    void drawnPose( const metaio::Pose& tracked, const metaio::Pose& offset, float matrix[16] )
+    {
+        float trackedMatrix[16], offsetMatrix[16];
+        quaternionToMatrix(tracked.rotation, tracked.translation, trackedMatrix);
+        quaternionToMatrix(offset.rotation, offset.translation, offsetMatrix);
+        multiplyMatricesScalar(trackedMatrix, offsetMatrix, matrix);
+    }
+
+    double yawOfMatrix( const float m[16] )
+    {
+        // column major, the rotation about y moves the z axis into x
+        return atan2(m[8], m[10]);
+    }
+
+    // second differences and errors of one series of drawn poses
+    struct Metrics
+    {
+        double jitterSum[PHASE_COUNT], rotationJitterSum[PHASE_COUNT];
+        double errorSum[PHASE_COUNT], rotationErrorSum[PHASE_COUNT], signedError[PHASE_COUNT];
+        int samples[PHASE_COUNT];
+        double previous[2], beforePrevious[2];
+        int frames;
+
+        Metrics() : frames(0)
+        {
+            for (int p = 0; p < PHASE_COUNT; p++)
+                jitterSum[p] = rotationJitterSum[p] = errorSum[p] = rotationErrorSum[p] = signedError[p] = samples[p] = 0;
+        }
+
+        void add( double t, double x, double yaw, double trueX, double trueYaw )
+        {
+            PHASE phase = getPhase(t);
+            if (frames >= 2)
+            {
+                double dx = x - 2.0 * previous[0] + beforePrevious[0];
+                double dyaw = yaw - 2.0 * previous[1] + beforePrevious[1];
+                jitterSum[phase] += dx * dx;
+                rotationJitterSum[phase] += dyaw * dyaw;
+            }
+            errorSum[phase] += (x - trueX) * (x - trueX);
+            rotationErrorSum[phase] += (yaw - trueYaw) * (yaw - trueYaw);
+            signedError[phase] += trueX - x;
+            samples[phase]++;
+
+            beforePrevious[0] = previous[0];
+            beforePrevious[1] = previous[1];
+            previous[0] = x;
+            previous[1] = yaw;
+            frames++;
+        }
+
+        double jitter( PHASE p ) const { return samples[p] ? sqrt(jitterSum[p] / samples[p]) : 0.0; }
+        double rotationJitter( PHASE p ) const { return samples[p] ? sqrt(rotationJitterSum[p] / samples[p]) * 180.0 / PI : 0.0; }
+        double error( PHASE p ) const { return samples[p] ? sqrt(errorSum[p] / samples[p]) : 0.0; }
+        double rotationError( PHASE p ) const { return samples[p] ? sqrt(rotationErrorSum[p] / samples[p]) * 180.0 / PI : 0.0; }
+
+        // the mean position error while panning at 60 mm/s, as a delay
+        double lag() const { return samples[PAN] ? signedError[PAN] / samples[PAN] / 60.0 * 1000.0 : 0.0; }
+    };
+
+    struct Result
+    {
+        Metrics stream;             // the filtered poses, as the pose stream gets them
+        Metrics drawn;              // where render() draws the content
+        double maxCorrectionError;  // drawn against filtered on frames without a new measurement, mm
+        int corrected;              // frames with an offset
+    };
+
+    Result run( const PoseFilterParameters& parameters )
+    {
+        randomState = 1;
+        PoseFilter filter;
+        filter.setDefaultParameters(parameters);
+        PoseCorrection correction;
+        PoseSnapshot poses, filtered;
+        double trueX, trueYaw;
+
+        std::vector<metaio::Pose> tracked(1);
+        double nextTracking = 0.0;
+        Result result;
+        result.maxCorrectionError = 0.0;
+        result.corrected = 0;
+
+        int frames = (int)(DURATION * RENDER_RATE);
+        for (int n = 0; n < frames; n++)
+        {
+            double frameTime = n / RENDER_RATE;
+
+            // before render(): last frame's poses filtered to this one
+            filter.filter(poses, filtered, frameTime);
+            correction.update(poses, filtered, filter);
+            truth(frameTime, trueX, trueYaw);
+            if (filtered.getCount())
+            {
+                const float* m = filtered.getMatrix(0);
+                result.stream.add(frameTime, m[12], yawOfMatrix(m), trueX, trueYaw);
+            }
+
+            // render() tracks a new camera frame now and then
+            bool measured = frameTime >= nextTracking;
+            if (measured)
+            {
+                double x, yaw;
+                truth(frameTime, x, yaw);
+                setPose(tracked[0], x + 1.5 * gaussian(), yaw + 0.3 * PI / 180.0 * gaussian());
+                nextTracking += 1.0 / TRACKING_RATE;
+            }
+
+            const metaio::Pose& offset = correction.getCount() ? correction.getOffset(0) : PoseCorrection::identity();
+            result.corrected += correction.getCount() ? 1 : 0;
+            float matrix[16];
+            drawnPose(tracked[0], offset, matrix);
+            result.drawn.add(frameTime, matrix[12], yawOfMatrix(matrix), trueX, trueYaw);
+
+            if (!measured && correction.getCount())
+            {
+                const float* expected = filtered.getMatrix(0);
+                for (int k = 12; k < 15; k++)
+                {
+                    double error = fabs(matrix[k] - expected[k]);
+                    result.maxCorrectionError = error > result.maxCorrectionError ? error : result.maxCorrectionError;
+                }
+            }
+
+            // after render(): the poses of this frame
+            poses.update(tracked, frameTime);
+        }
+        return result;
+    }
+
+    void print( const char* name, const Metrics& m )
+    {
+        printf("%-22s %7.3f mm %6.3f deg %8.2f mm %6.2f deg %8.2f mm %6.2f deg %7.1f ms\n", name,
+               m.jitter(STILL), m.rotationJitter(STILL), m.error(PAN), m.rotationError(PAN),
+               m.error(SHAKE), m.rotationError(SHAKE), m.lag());
+    }
+
+    // the recorded poses of a session, rendered at the recorded frame times
+    class PoseSink : public ISessionSink
+    {
+    public:
+        virtual void onCameraFrame( const metaio::ImageStruct& frame, double timestamp ) {}
+        virtual void onSensorLLA( const metaio::LLACoordinate& position, double timestamp ) {}
+        virtual void onAccelerometer( const metaio::Vector3d& values, double timestamp ) {}
+        virtual void onCompassAngle( float angle, double timestamp ) {}
+
+        virtual void onPoses( const PoseSnapshot& poses )
+        {
+            frames.push_back(poses);
+        }
+
+        std::vector<PoseSnapshot> frames;
+    };
+
+    // RMS of the second difference of the translation of every coordinate system, mm
+    double replayJitter( const std::vector<PoseSnapshot>& frames, bool filtered )
+    {
+        PoseFilterParameters parameters;
+        parameters.enabled = filtered;
+        parameters.draw = filtered;
+        PoseFilter filter;
+        filter.setDefaultParameters(parameters);
+        PoseCorrection correction;
+        PoseSnapshot poses, output;
+        double sum = 0;
+        int samples = 0;
+        std::vector<float> history[2];      // x, y, z of cosID 1..MAX_POSES for the last two frames
+        history[0].assign(PoseSnapshot::MAX_POSES * 3, NAN);
+        history[1] = history[0];
+
+        for (size_t n = 0; n < frames.size(); n++)
+        {
+            filter.filter(poses, output, frames[n].getTimestamp());
+            correction.update(poses, output, filter);
+
+            std::vector<float> current(PoseSnapshot::MAX_POSES * 3, NAN);
+            for (int i = 0; i < frames[n].getCount(); i++)
+            {
+                int id = frames[n].cosID[i];
+                if (id < 1 || id > PoseSnapshot::MAX_POSES)
+                    continue;
+                metaio::Pose tracked;
+                tracked.translation = frames[n].getTranslation(i);
+                tracked.rotation = frames[n].getRotation(i);
+                const metaio::Pose* offset = &PoseCorrection::identity();
+                for (int c = 0; c < correction.getCount(); c++)
+                {
+                    if (correction.getCosID(c) == id)
+                        offset = &correction.getOffset(c);
+                }
+                float matrix[16];
+                drawnPose(tracked, *offset, matrix);
+                for (int k = 0; k < 3; k++)
+                {
+                    float* slot = &current[(id - 1) * 3 + k];
+                    *slot = matrix[12 + k];
+                    float d = *slot - 2.0f * history[1][(id - 1) * 3 + k] + history[0][(id - 1) * 3 + k];
+                    if (d == d)
+                    {
+                        sum += d * d;
+                        samples++;
+                    }
+                }
+            }
+            history[0] = history[1];
+            history[1] = current;
+            poses = frames[n];
+        }
+        return samples ? sqrt(sum / samples) : 0.0;
+    }
+}
+
+int main( int argc, char** argv )
+{
+    if (argc > 1)
+    {
+        SessionPlayer player;
+        PoseSink sink;
+        if (!player.open(argv[1]))
+        {
+            printf("can not read %s\n", argv[1]);
+            return 1;
+        }
+        while (player.next(sink))
+            ;
+        printf("%s: %d frames of poses over %.1f s\n", argv[1], (int)sink.frames.size(), player.getDuration());
+        printf("jitter of the drawn poses unfiltered %.3f mm, filtered with draw %.3f mm\n", replayJitter(sink.frames, false),
+               replayJitter(sink.frames, true));
+        return 0;
+    }
+
+    printf("tracking at %.0f Hz with 1.5 mm and 0.3 degrees of noise, rendered at %.0f Hz\n", TRACKING_RATE, RENDER_RATE);
+
+    PoseFilterParameters unfiltered;
+    unfiltered.enabled = false;
+    unfiltered.draw = true;
+    Result raw = run(unfiltered);
+
+    PoseFilterParameters noPrediction;
+    noPrediction.maxPrediction = 0.0f;
+    noPrediction.draw = true;
+    Result smoothed = run(noPrediction);
+
+    PoseFilterParameters drawn;
+    drawn.draw = true;
+    Result predicted = run(drawn);
+
+    const char* header = "%-22s %22s %22s %22s %10s\n";
+    printf("\n");
+    printf(header, "pose stream", "jitter at rest", "error panning", "error shaking", "lag");
+    print("unfiltered", raw.stream);
+    print("without prediction", smoothed.stream);
+    print("filtered", predicted.stream);
+    printf("\n");
+    printf(header, "drawn with draw", "jitter at rest", "error panning", "error shaking", "lag");
+    print("unfiltered", raw.drawn);
+    print("without prediction", smoothed.drawn);
+    print("filtered", predicted.drawn);
+    printf("\n");
+
+    // prediction extrapolates the noise too, the smoothing alone halves the jitter
+    check("the filter halves the jitter at rest", smoothed.stream.jitter(STILL) < 0.5 * raw.stream.jitter(STILL));
+    check("the filter halves the rotation jitter at rest", smoothed.stream.rotationJitter(STILL) < 0.5 * raw.stream.rotationJitter(STILL));
+    check("predicted poses still jitter less at rest", predicted.stream.jitter(STILL) < raw.stream.jitter(STILL) &&
+        predicted.stream.rotationJitter(STILL) < raw.stream.rotationJitter(STILL));
+    check("prediction reduces the lag", fabs(predicted.stream.lag()) < fabs(smoothed.stream.lag()));
+    check("prediction reduces the lag of the drawn pose", fabs(predicted.drawn.lag()) < fabs(smoothed.drawn.lag()));
+    check("the offsets draw the filtered pose", predicted.corrected > 0 && predicted.maxCorrectionError < 0.01);
+    check("an unfiltered pose is drawn as tracked", raw.corrected == 0);
+
+    Result filteredOnly = run(PoseFilterParameters());
+    check("without draw nothing is corrected", filteredOnly.corrected == 0);
+
+    // the offset composed with the measurement gives the filtered pose, at any rotation
+    {
+        PoseFilter filter;
+        filter.setDefaultParameters(drawn);
+        PoseSnapshot measured, target;
+        std::vector<metaio::Pose> a(1), b(1);
+        double worst = 0;
+        for (int i = 0; i < 1000; i++)
+        {
+            metaio::Vector4d q = normalizeQuaternion(metaio::Vector4d((float)gaussian(), (float)gaussian(), (float)gaussian(), (float)gaussian()));
+            metaio::Vector4d r = normalizeQuaternion(metaio::Vector4d((float)gaussian(), (float)gaussian(), (float)gaussian(), (float)gaussian()));
+            a[0].cosID = b[0].cosID = 1;
+            a[0].translation = metaio::Vector3d((float)(100 * gaussian()), (float)(100 * gaussian()), (float)(500 + 100 * gaussian()));
+            b[0].translation = metaio::Vector3d((float)(100 * gaussian()), (float)(100 * gaussian()), (float)(500 + 100 * gaussian()));
+            a[0].rotation = q;
+            b[0].rotation = r;
+            measured.update(a, 0.0);
+            target.update(b, 0.0);
+
+            PoseCorrection correction;
+            correction.update(measured, target, filter);
+            float matrix[16];
+            drawnPose(a[0], correction.getOffset(0), matrix);
+            for (int k = 0; k < 16; k++)
+            {
+                double error = fabs(matrix[k] - target.getMatrix(0)[k]) / (k >= 12 ? 100.0 : 1.0);
+                worst = error > worst ? error : worst;
+            }
+        }
+        check("tracked pose and offset compose to the filtered one", worst < 1e-4);
+
+        PoseCorrection correction;
+        correction.update(measured, target, filter);
+        PoseSnapshot none;
+        correction.update(none, none, filter);
+        check("a lost coordinate system gets its offset reset", correction.getCount() == 0 &&
+            correction.getResetCount() == 1 && correction.getResetCosID(0) == 1);
+    }
+
+    if (failures)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+//
+//  geobench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Accuracy and speed of LLAConverter:
+//
+//      geobench [updates]
+//
+//  Converts POIs within 50 km of the sensor after every sensor update and
+//  compares the results with a long double conversion of every POI from
+//  scratch, which is also what a per POI conversion costs.
+//
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+#include "LLAConverter.h"
+
+namespace
+{
+    double now()
+    {
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec + time.tv_nsec * 1e-9;
+    }
+
+    double random( double low, double high )
+    {
+        return low + (high - low) * (double)rand() / RAND_MAX;
+    }
+
+    template<typename Real> void toECEF( const metaio::LLACoordinate& coordinate, Real ecef[3] )
+    {
+        const Real a = 6378137.0L, f = 1.0L / 298.257223563L, e2 = f * (2.0L - f);
+        const Real radians = 3.14159265358979323846264338L / 180.0L;
+        Real latitude = coordinate.latitude * radians, longitude = coordinate.longitude * radians;
+        Real normal = a / std::sqrt(1.0L - e2 * std::sin(latitude) * std::sin(latitude));
+        ecef[0] = (normal + coordinate.altitude) * std::cos(latitude) * std::cos(longitude);
+        ecef[1] = (normal + coordinate.altitude) * std::cos(latitude) * std::sin(longitude);
+        ecef[2] = (normal * (1.0L - e2) + coordinate.altitude) * std::sin(latitude);
+    }
+
+    // East-North-Up in millimeters, converting the POI and the sensor from scratch
+    template<typename Real> void toENU( const metaio::LLACoordinate& point, const metaio::LLACoordinate& sensor,
+        Real enu[3] )
+    {
+        const Real radians = 3.14159265358979323846264338L / 180.0L;
+        Real p[3], o[3];
+        toECEF(point, p);
+        toECEF(sensor, o);
+        Real latitude = sensor.latitude * radians, longitude = sensor.longitude * radians;
+        Real dx = p[0] - o[0], dy = p[1] - o[1], dz = p[2] - o[2];
+        enu[0] = 1000.0L * (-std::sin(longitude) * dx + std::cos(longitude) * dy);
+        enu[1] = 1000.0L * (-std::sin(latitude) * std::cos(longitude) * dx - std::sin(latitude) * std::sin(longitude) * dy +
+            std::cos(latitude) * dz);
+        enu[2] = 1000.0L * (std::cos(latitude) * std::cos(longitude) * dx + std::cos(latitude) * std::sin(longitude) * dy +
+            std::sin(latitude) * dz);
+    }
+}
+
+int main( int argc, char** argv )
+{
+    int updates = argc > 1 ? atoi(argv[1]) : 20;
+    if (updates <= 0)
+    {
+        fprintf(stderr, "usage: geobench [updates]\n");
+        return 2;
+    }
+
+    printf("SIMD path: %s\n", unifeye::LLAConverter::getSIMDPath());
+    printf("%8s %14s %14s %14s %12s %12s\n", "pois", "per poi ms", "scalar ms", "simd ms", "max err mm",
+        "rms err mm");
+
+    const int counts[] = { 10000, 100000 };
+    for (int c = 0; c < 2; c++)
+    {
+        int count = counts[c];
+        srand(1);
+
+        // about 50 km around Taipei 101
+        metaio::LLACoordinate sensor(25.0340, 121.5645, 10.0, 5.0);
+        std::vector<metaio::LLACoordinate> points(count);
+        for (int i = 0; i < count; i++)
+            points[i] = metaio::LLACoordinate(sensor.latitude + random(-0.45, 0.45),
+                sensor.longitude + random(-0.5, 0.5), random(0.0, 500.0), 10.0);
+
+        unifeye::LLAConverter converter;
+        converter.setAltitudeEnabled(true);
+        converter.setPoints(&points[0], count);
+
+        // the sensor walks a few meters per update
+        std::vector<metaio::LLACoordinate> sensors(updates);
+        for (int u = 0; u < updates; u++)
+            sensors[u] = metaio::LLACoordinate(sensor.latitude + u * 1e-5, sensor.longitude + u * 1e-5, 10.0, 5.0);
+
+        std::vector<float> perPoi(count * 3);
+        double start = now();
+        for (int u = 0; u < updates; u++)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                double enu[3];
+                toENU(points[i], sensors[u], enu);
+                for (int k = 0; k < 3; k++)
+                    perPoi[i * 3 + k] = (float)enu[k];
+            }
+        }
+        double perPoiTime = (now() - start) / updates;
+
+        double times[2];
+        for (int simd = 0; simd < 2; simd++)
+        {
+            converter.setSIMDEnabled(simd != 0);
+            start = now();
+            for (int u = 0; u < updates; u++)
+            {
+                converter.setReference(sensors[u]);
+                converter.convert();
+            }
+            times[simd] = (now() - start) / updates;
+        }
+
+        // the last update against long double
+        double maxError = 0.0, sumSquares = 0.0;
+        for (int i = 0; i < count; i++)
+        {
+            long double reference[3];
+            toENU(points[i], sensors[updates - 1], reference);
+            metaio::Vector3d result = converter.getTranslation(i);
+            double d[3] = { result.x - (double)reference[0], result.y - (double)reference[1],
+                result.z - (double)reference[2] };
+            double error = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+            maxError = error > maxError ? error : maxError;
+            sumSquares += error * error;
+        }
+
+        printf("%8d %14.3f %14.3f %14.3f %12.2f %12.2f\n", count, perPoiTime * 1e3, times[0] * 1e3,
+            times[1] * 1e3, maxError, std::sqrt(sumSquares / count));
+    }
+
+    return 0;
+}
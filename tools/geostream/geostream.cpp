@@ -0,0 +1,238 @@
+//
+//  geostream.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  GeoIndex queries and PoiStreamer updates on a synthetic city:
+//
+//      geostream [POIs]
+//
+//  The city has clusters of POIs on top of a uniform spread over 20 km.
+//  Queries are checked against a scan of all POIs, then a walk with GPS
+//  noise, a swaying compass and one GPS jump is streamed with and without
+//  hysteresis.
+//
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+#include "GeoIndex.h"
+#include "PoiStreamer.h"
+
+namespace
+{
+    const double PI = 3.14159265358979323846;
+    const metaio::LLACoordinate CENTER(48.1372, 11.5756, 0.0, 0.0);
+
+    double now()
+    {
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec + time.tv_nsec * 1e-9;
+    }
+
+    double random( double low, double high )
+    {
+        return low + (high - low) * (double)rand() / RAND_MAX;
+    }
+
+    double gaussian()
+    {
+        double u = random(1e-9, 1.0), v = random(0.0, 1.0);
+        return sqrt(-2.0 * log(u)) * cos(2.0 * PI * v);
+    }
+
+    metaio::LLACoordinate offset( const metaio::LLACoordinate& origin, double east, double north )
+    {
+        double metersNorth, metersEast;
+        unifeye::GeoIndex::getMetersPerDegree(origin.latitude, metersNorth, metersEast);
+        return metaio::LLACoordinate(origin.latitude + north / metersNorth, origin.longitude + east / metersEast,
+            0.0, 10.0);
+    }
+
+    double percentile( std::vector<double> values, double p )
+    {
+        std::sort(values.begin(), values.end());
+        return values[std::min(values.size() - 1, (size_t)(p * values.size()))];
+    }
+
+    class CountingFactory : public unifeye::IPoiFactory
+    {
+    public:
+        CountingFactory( int count ) : loadedAt(count, -1), update(0), flickers(0) {};
+
+        virtual bool load( int point, const metaio::LLACoordinate& )
+        {
+            loadedAt[point] = update;
+            return true;
+        }
+
+        virtual void unload( int point )
+        {
+            // unloaded within two seconds of being loaded
+            if (update - loadedAt[point] < 20)
+                flickers++;
+        }
+
+        std::vector<int> loadedAt;
+        int update;
+        int flickers;
+    };
+
+    void stream( const unifeye::GeoIndex& index, const std::vector<metaio::LLACoordinate>& trace,
+        const std::vector<float>& headings, const unifeye::PoiStreamerParameters& parameters, const char* name )
+    {
+        CountingFactory factory(index.getPointCount());
+        unifeye::PoiStreamer streamer(index, &factory);
+        streamer.setParameters(parameters);
+
+        std::vector<double> times;
+        int maxLoaded = 0, maxPending = 0;
+        unsigned long previousLoads = 0;
+        int maxLoadsPerUpdate = 0;
+        for (size_t i = 0; i < trace.size(); i++)
+        {
+            factory.update = (int)i;
+            double start = now();
+            streamer.update(trace[i], headings[i]);
+            times.push_back((now() - start) * 1e6);
+
+            const unifeye::PoiStreamerStats& stats = streamer.getStats();
+            maxLoaded = std::max(maxLoaded, (int)streamer.getLoaded().size());
+            maxPending = std::max(maxPending, stats.pending);
+            maxLoadsPerUpdate = std::max(maxLoadsPerUpdate, (int)(stats.loads - previousLoads));
+            previousLoads = stats.loads;
+        }
+
+        const unifeye::PoiStreamerStats& stats = streamer.getStats();
+        printf("%-14s %8.1f %8.1f %8.1f %8lu %8lu %8d %8d %8d %8d\n", name, percentile(times, 0.5),
+            percentile(times, 0.99), percentile(times, 1.0), stats.loads, stats.unloads, factory.flickers, maxLoaded,
+            maxLoadsPerUpdate, maxPending);
+    }
+}
+
+int main( int argc, char** argv )
+{
+    int count = argc > 1 ? atoi(argv[1]) : 50000;
+    if (count <= 0)
+    {
+        fprintf(stderr, "usage: geostream [POIs]\n");
+        return 2;
+    }
+
+    srand(1);
+    std::vector<metaio::LLACoordinate> points(count);
+    std::vector<double> clusters;
+    for (int c = 0; c < 20; c++)
+    {
+        clusters.push_back(random(-8000.0, 8000.0));
+        clusters.push_back(random(-8000.0, 8000.0));
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (i % 10 < 7)
+        {
+            int c = rand() % 20;
+            points[i] = offset(CENTER, clusters[c * 2] + 300.0 * gaussian(), clusters[c * 2 + 1] + 300.0 * gaussian());
+        }
+        else
+            points[i] = offset(CENTER, random(-10000.0, 10000.0), random(-10000.0, 10000.0));
+    }
+
+    double start = now();
+    unifeye::GeoIndex index(250.0);
+    index.build(&points[0], count);
+    printf("%d POIs indexed in %.1f ms\n\n", count, (now() - start) * 1e3);
+
+    // queries against a scan of all POIs, around the cluster centers and anywhere
+    printf("%8s %8s %10s %10s %10s %10s %10s\n", "radius", "hits", "p50 us", "p99 us", "scan us", "missed", "extra");
+    const double radii[] = { 250.0, 500.0, 1000.0, 2000.0 };
+    std::vector<unifeye::GeoHit> hits;
+    for (int r = 0; r < 4; r++)
+    {
+        std::vector<double> times, scanTimes;
+        long totalHits = 0, missed = 0, extra = 0;
+        for (int q = 0; q < 500; q++)
+        {
+            int c = rand() % 20;
+            metaio::LLACoordinate center = (q & 1) ?
+                offset(CENTER, random(-10000.0, 10000.0), random(-10000.0, 10000.0)) :
+                offset(CENTER, clusters[c * 2] + random(-300.0, 300.0), clusters[c * 2 + 1] + random(-300.0, 300.0));
+
+            start = now();
+            index.query(center, radii[r], hits);
+            times.push_back((now() - start) * 1e6);
+            totalHits += hits.size();
+
+            start = now();
+            double north, east;
+            unifeye::GeoIndex::getMetersPerDegree(center.latitude, north, east);
+            std::vector<char> inside(count, 0);
+            std::vector<unifeye::GeoHit> scanned;
+            for (int i = 0; i < count; i++)
+            {
+                double dx = (points[i].longitude - center.longitude) * east;
+                double dy = (points[i].latitude - center.latitude) * north;
+                inside[i] = dx * dx + dy * dy <= radii[r] * radii[r];
+                if (inside[i])
+                {
+                    unifeye::GeoHit hit = { i, (float)sqrt(dx * dx + dy * dy), (float)(atan2(dx, dy) * 180.0 / PI) };
+                    scanned.push_back(hit);
+                }
+            }
+            scanTimes.push_back((now() - start) * 1e6);
+
+            long found = 0;
+            for (size_t h = 0; h < hits.size(); h++)
+            {
+                if (inside[hits[h].point])
+                    found++;
+                else
+                    extra++;
+            }
+            missed += std::count(inside.begin(), inside.end(), 1) - found;
+        }
+        printf("%8.0f %8ld %10.1f %10.1f %10.1f %10ld %10ld\n", radii[r], totalHits / 500, percentile(times, 0.5),
+            percentile(times, 0.99), percentile(scanTimes, 0.5), missed, extra);
+    }
+
+    // ten minutes of walking at 10 Hz through the first cluster, with 5 m of GPS noise
+    // and a compass swaying by 20 degrees, then a 3 km GPS jump and more walking
+    std::vector<metaio::LLACoordinate> trace;
+    std::vector<float> headings;
+    double east = clusters[0] - 400.0, north = clusters[1] - 400.0, direction = 45.0;
+    double noiseEast = 0.0, noiseNorth = 0.0;
+    for (int i = 0; i < 6000; i++)
+    {
+        if (i == 3000)
+        {
+            east += 3000.0;
+            north -= 1500.0;
+        }
+        if (i % 300 == 0)
+            direction += random(-90.0, 90.0);
+        east += 0.14 * sin(direction * PI / 180.0);
+        north += 0.14 * cos(direction * PI / 180.0);
+        noiseEast = 0.95 * noiseEast + 0.05 * 5.0 * gaussian() * 4.0;
+        noiseNorth = 0.95 * noiseNorth + 0.05 * 5.0 * gaussian() * 4.0;
+
+        trace.push_back(offset(CENTER, east + noiseEast, north + noiseNorth));
+        headings.push_back((float)fmod(direction + 20.0 * sin(i * 0.05) + 360.0, 360.0));
+    }
+
+    printf("\n%-14s %8s %8s %8s %8s %8s %8s %8s %8s %8s\n", "streaming", "p50 us", "p99 us", "max us", "loads",
+        "unloads", "flicker", "loaded", "per upd", "pending");
+    unifeye::PoiStreamerParameters parameters;
+    stream(index, trace, headings, parameters, "hysteresis");
+
+    unifeye::PoiStreamerParameters noHysteresis = parameters;
+    noHysteresis.unloadRadius = noHysteresis.loadRadius;
+    noHysteresis.unloadFieldOfView = noHysteresis.fieldOfView;
+    stream(index, trace, headings, noHysteresis, "no hysteresis");
+
+    return 0;
+}
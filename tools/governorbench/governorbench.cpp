@@ -0,0 +1,442 @@
+//
+//  governorbench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  What FrameGovernor saves and what it costs:
+//
+//      governorbench [session.uses]
+//
+//  Runs the render loop on a simulated 60 Hz display, once always at the
+//  full frame rate and once with the governor, over the accelerometer and
+//  the poses of a trace. The CPU time is estimated with a fixed cost per
+//  rendered and per tracked frame. The pose cost is how far the pose in use
+//  is from the one tracking at the full rate would give, and how old it is,
+//  on every display refresh.
+//
+//  Without a file the trace is a synthetic scenario with known phases:
+//  walking, holding still on a target, the device lying on a table, the
+//  target moved while the device is still, a low battery and a device too
+//  slow for the full frame rate; the checks are about those. A 60 fps
+//  target over a 30 fps camera must not count as overloaded. A recorded
+//  session only gets the report. Exits with 1 if a check fails.
+//
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#include "FrameGovernor.h"
+#include "PoseSnapshot.h"
+#include "SessionPlayer.h"
+
+using namespace unifeye;
+
+namespace
+{
+    const double DISPLAY_RATE = 60.0;
+
+    // estimated cost of a frame on the device, in seconds
+    const double RENDER_COST = 0.005;
+    const double TRACKING_COST = 0.015;
+
+    int failures = 0;
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    // deterministic, so both runs see the same trace
+    double gaussian( unsigned int& state )
+    {
+        double sum = 0;
+        for (int i = 0; i < 12; i++)
+        {
+            state = state * 1664525U + 1013904223U;
+            sum += (state >> 8) / 16777216.0;
+        }
+        return sum - 6.0;
+    }
+
+    struct AccelerometerSample
+    {
+        double time;
+        metaio::Vector3d values;
+    };
+
+    struct Phase
+    {
+        const char* name;
+        double start;
+        bool moving;                // the device, as far as the checks are concerned
+        float batteryLevel;
+        float trackingCapacity;     // frames per second the tracking manages at most
+    };
+
+    struct Trace
+    {
+        std::vector<AccelerometerSample> accelerometer;
+        std::vector<PoseSnapshot> poses;        // the true poses, in time order
+        std::vector<Phase> phases;
+        double duration;
+
+        int findPhase( double time ) const
+        {
+            int phase = 0;
+            while (phase + 1 < (int)phases.size() && phases[phase + 1].start <= time)
+                phase++;
+            return phase;
+        }
+    };
+
+    // the synthetic scenario
+    void makeScenario( Trace& trace )
+    {
+        static const Phase phases[] = {
+            { "walking around the target", 0.0, true, 0.8f, 60.0f },
+            { "holding still on the target", 10.0, false, 0.8f, 60.0f },
+            { "walking around the target", 30.0, true, 0.8f, 60.0f },
+            { "lying on a table", 33.0, false, 0.8f, 60.0f },
+            { "picked up, finding the target", 60.0, true, 0.8f, 60.0f },
+            { "holding still, the target moves at 72 s", 62.0, false, 0.8f, 60.0f },
+            { "walking with a low battery", 85.0, true, 0.15f, 60.0f },
+            { "walking, the tracking manages 12 fps", 95.0, true, 0.8f, 12.0f },
+        };
+        trace.phases.assign(phases, phases + sizeof(phases) / sizeof(phases[0]));
+        trace.duration = 110.0;
+
+        unsigned int state = 1;
+        for (int i = 0; i < (int)(trace.duration * 100); i++)
+        {
+            double t = i / 100.0;
+            int phase = trace.findPhase(t);
+            const Phase& p = trace.phases[phase];
+
+            // walking shakes the device, held in a hand it trembles, on a table it does not move
+            double noise = p.moving ? 0.06 : phase == 3 ? 0.001 : 0.004;
+            double sway = p.moving ? 0.1 * sin(t * 2.0 * 3.14159265358979 * 2.0) : 0.0;
+            AccelerometerSample sample;
+            sample.time = t;
+            sample.values = metaio::Vector3d((float)(noise * gaussian(state) + sway),
+                (float)(-1.0 + noise * gaussian(state)), (float)(noise * gaussian(state)));
+            trace.accelerometer.push_back(sample);
+        }
+
+        // the true poses at 30 Hz, with a millimeter or two of tracking jitter
+        float rest[3] = { 20.0f, -10.0f, 400.0f };
+        for (int i = 0; i < (int)(trace.duration * 30); i++)
+        {
+            double t = i / 30.0;
+            int phase = trace.findPhase(t);
+            std::vector<metaio::Pose> poses;
+            bool visible = phase != 3 && !(phase == 4 && t < 61.0);
+            if (visible)
+            {
+                double x = rest[0], y = rest[1], z = rest[2], angle = 0.2;
+                if (trace.phases[phase].moving)
+                {
+                    x += 100.0 * sin(0.8 * t);
+                    y += 50.0 * cos(0.6 * t);
+                    z += 50.0 * sin(0.3 * t);
+                    angle += 0.3 * sin(0.5 * t);
+                }
+                else if (phase == 5 && t >= 72.0)
+                {
+                    x += 150.0 * (t < 73.0 ? t - 72.0 : 1.0);
+                }
+                x += 1.5 * gaussian(state);
+                y += 1.5 * gaussian(state);
+                z += 1.5 * gaussian(state);
+                angle += 0.003 * gaussian(state);
+                poses.push_back(metaio::Pose((float)x, (float)y, (float)z, 0, (float)sin(angle / 2), 0,
+                    (float)cos(angle / 2), 1.0f, 1));
+            }
+            PoseSnapshot snapshot;
+            snapshot.update(poses, t);
+            trace.poses.push_back(snapshot);
+        }
+    }
+
+    // collects the sensors and poses of a recorded session
+    class TraceSink : public ISessionSink
+    {
+    public:
+        TraceSink( Trace& _trace ) : trace(_trace) {};
+
+        virtual void onCameraFrame( const metaio::ImageStruct& frame, double timestamp ) {}
+        virtual void onSensorLLA( const metaio::LLACoordinate& position, double timestamp ) {}
+        virtual void onCompassAngle( float angle, double timestamp ) {}
+
+        virtual void onAccelerometer( const metaio::Vector3d& values, double timestamp )
+        {
+            AccelerometerSample sample = { timestamp, values };
+            trace.accelerometer.push_back(sample);
+        }
+
+        virtual void onPoses( const PoseSnapshot& poses )
+        {
+            trace.poses.push_back(poses);
+        }
+
+    private:
+        Trace& trace;
+    };
+
+    bool loadSession( const char* path, Trace& trace )
+    {
+        SessionPlayer player;
+        if (!player.open(path))
+            return false;
+        TraceSink sink(trace);
+        while (player.next(sink))
+            ;
+        Phase phase = { "recording", 0.0, false, -1.0f, 60.0f };
+        trace.phases.push_back(phase);
+        trace.duration = player.getDuration();
+        return true;
+    }
+
+    struct PhaseResult
+    {
+        double timeInMode[GOVERNOR_MODE_COUNT];
+        double errorSum;
+        unsigned long errorCount;
+
+        PhaseResult() : errorSum(0), errorCount(0)
+        {
+            for (int i = 0; i < GOVERNOR_MODE_COUNT; i++)
+                timeInMode[i] = 0;
+        }
+    };
+
+    struct Result
+    {
+        double cpu;                     // estimated seconds of CPU per second
+        std::vector<double> errors;     // mm from the pose at the full rate, on every refresh with a tracked target
+        std::vector<double> ages;       // seconds since the pose in use was tracked
+        std::vector<PhaseResult> phases;
+        std::vector<double> reactions;  // seconds from the start of moving phases to the mode for moving
+        double recovered;               // when the pose was right again after the target moved, in the scenario
+        GovernorStats stats;
+    };
+
+    double distance( const PoseSnapshot& a, int i, const PoseSnapshot& b, int j )
+    {
+        double dx = a.tx[i] - b.tx[j], dy = a.ty[i] - b.ty[j], dz = a.tz[i] - b.tz[j];
+        return sqrt(dx * dx + dy * dy + dz * dz);
+    }
+
+    double percentile( std::vector<double> values, double p )
+    {
+        if (values.empty())
+            return 0;
+        std::sort(values.begin(), values.end());
+        return values[(size_t)(p * (values.size() - 1))];
+    }
+
+    double mean( const std::vector<double>& values )
+    {
+        double sum = 0;
+        for (size_t i = 0; i < values.size(); i++)
+            sum += values[i];
+        return values.empty() ? 0 : sum / values.size();
+    }
+
+    Result simulate( const Trace& trace, bool governed )
+    {
+        Result result;
+        result.cpu = 0;
+        result.recovered = -1.0;
+        result.phases.resize(trace.phases.size());
+
+        FrameGovernor governor;
+        GovernorParameters parameters;
+        parameters.enabled = governed;
+        governor.setParameters(parameters);
+        governor.reset();
+
+        size_t accelerometer = 0, truth = 0;
+        PoseSnapshot shown;             // what the SDK returns, the last tracked or the frozen pose
+        double shownTime = 0;
+        int ticksSinceFrame = 1000;
+        int lastPhase = 0;
+        double reactionStart = -1.0;
+
+        int ticks = (int)(trace.duration * DISPLAY_RATE);
+        for (int tick = 0; tick < ticks; tick++)
+        {
+            double t = tick / DISPLAY_RATE;
+            int phase = trace.findPhase(t);
+            const Phase& p = trace.phases[phase];
+
+            for (; accelerometer < trace.accelerometer.size() && trace.accelerometer[accelerometer].time <= t; accelerometer++)
+                governor.addAccelerometer(trace.accelerometer[accelerometer].values, trace.accelerometer[accelerometer].time);
+            while (truth + 1 < trace.poses.size() && trace.poses[truth + 1].getTimestamp() <= t)
+                truth++;
+
+            if (phase != lastPhase && p.moving && !trace.phases[lastPhase].moving)
+                reactionStart = t;
+            lastPhase = phase;
+
+            // the display link calls every so many refreshes
+            const GovernorDecision& decision = governor.getDecision();
+            int interval = (int)(DISPLAY_RATE / decision.frameRate + 0.5);
+            if (++ticksSinceFrame >= interval)
+            {
+                ticksSinceFrame = 0;
+                result.cpu += RENDER_COST;
+                if (!decision.freezeTracking)
+                {
+                    result.cpu += TRACKING_COST;
+                    shown = trace.poses[truth];
+                    shownTime = t;
+                }
+                governor.setPowerState(p.batteryLevel, false, 0);
+                float trackingRate = decision.freezeTracking ? 0 : std::min(decision.frameRate, p.trackingCapacity);
+                governor.update(t, shown, trackingRate);
+            }
+
+            // a low battery keeps the governor from going to full
+            GOVERNOR_MODE mode = governor.getDecision().mode;
+            GOVERNOR_MODE moving = p.batteryLevel >= 0 && p.batteryLevel < parameters.lowBattery ? GOVERNOR_REDUCED : GOVERNOR_FULL;
+            result.phases[phase].timeInMode[mode] += 1.0 / DISPLAY_RATE;
+            if (reactionStart >= 0 && (mode == moving || !governed))
+            {
+                result.reactions.push_back(t - reactionStart);
+                reactionStart = -1.0;
+            }
+
+            const PoseSnapshot& real = trace.poses[truth];
+            if (real.getCount() > 0 && shown.getCount() > 0)
+            {
+                int j = shown.find(real.cosID[0]);
+                if (j >= 0)
+                {
+                    double error = distance(real, 0, shown, j);
+                    result.errors.push_back(error);
+                    result.ages.push_back(t - shownTime);
+                    result.phases[phase].errorSum += error;
+                    result.phases[phase].errorCount++;
+                    if (t >= 73.0 && result.recovered < 0 && error < 10.0 && trace.phases.size() > 5)
+                        result.recovered = t;
+                }
+            }
+        }
+
+        result.cpu /= trace.duration;
+        result.stats = governor.getStats();
+        return result;
+    }
+
+    // seconds in GOVERNOR_FULL of ten seconds of walking at a 60 fps target, the tracking as fast as the camera
+    double timeAtFullRate( float cameraFrameRate )
+    {
+        FrameGovernor governor;
+        GovernorParameters parameters;
+        parameters.fullFrameRate = 60.0f;
+        parameters.cameraFrameRate = cameraFrameRate;
+        governor.setParameters(parameters);
+        governor.reset();
+
+        PoseSnapshot poses;
+        double full = 0;
+        for (int tick = 0; tick < 10 * (int)DISPLAY_RATE; tick++)
+        {
+            double t = tick / DISPLAY_RATE;
+            unsigned int state = tick;
+            governor.addAccelerometer(metaio::Vector3d((float)(0.06 * gaussian(state)), -1.0f, 0.0f), t);
+            const GovernorDecision& decision = governor.update(t, poses, 30.0f);
+            if (decision.mode == GOVERNOR_FULL)
+                full += 1.0 / DISPLAY_RATE;
+        }
+        return full;
+    }
+
+    void report( const char* name, const Result& result )
+    {
+        printf("%-10s cpu %5.1f%%   pose off by mean %5.2f mm p99 %6.2f mm   pose age mean %5.1f ms p99 %6.1f ms\n",
+            name, result.cpu * 100.0, mean(result.errors), percentile(result.errors, 0.99),
+            mean(result.ages) * 1e3, percentile(result.ages, 0.99) * 1e3);
+    }
+
+    double phaseError( const Result& result, int phase )
+    {
+        const PhaseResult& p = result.phases[phase];
+        return p.errorCount > 0 ? p.errorSum / p.errorCount : 0;
+    }
+}
+
+int main( int argc, char** argv )
+{
+    Trace trace;
+    bool scenario = argc < 2;
+    if (scenario)
+    {
+        makeScenario(trace);
+    }
+    else if (!loadSession(argv[1], trace))
+    {
+        fprintf(stderr, "could not read %s\n", argv[1]);
+        return 1;
+    }
+    printf("%.1f s, %lu accelerometer samples, %lu pose snapshots\n\n", trace.duration,
+        (unsigned long)trace.accelerometer.size(), (unsigned long)trace.poses.size());
+
+    Result baseline = simulate(trace, false);
+    Result governed = simulate(trace, true);
+    report("full", baseline);
+    report("governed", governed);
+    double savings = 1.0 - governed.cpu / baseline.cpu;
+    printf("\nestimated CPU savings %.1f%%, %lu mode changes, %lu rechecks of frozen targets\n\n", savings * 100.0,
+        governed.stats.transitions, governed.stats.rechecks);
+
+    printf("%-42s %7s %7s %7s %7s %9s\n", "phase", "full", "reduced", "frozen", "idle", "off by mm");
+    for (size_t i = 0; i < trace.phases.size(); i++)
+    {
+        const PhaseResult& p = governed.phases[i];
+        printf("%5.0f s %-34s %6.1fs %6.1fs %6.1fs %6.1fs %9.2f\n", trace.phases[i].start, trace.phases[i].name,
+            p.timeInMode[GOVERNOR_FULL], p.timeInMode[GOVERNOR_REDUCED], p.timeInMode[GOVERNOR_FROZEN],
+            p.timeInMode[GOVERNOR_IDLE], phaseError(governed, (int)i));
+    }
+    for (size_t i = 0; i < governed.reactions.size(); i++)
+        printf("%.0f ms from the device starting to move to the mode for moving\n", governed.reactions[i] * 1e3);
+    printf("\n");
+
+    if (!scenario)
+        return 0;
+
+    double reaction = 0;
+    for (size_t i = 0; i < governed.reactions.size(); i++)
+        reaction = std::max(reaction, governed.reactions[i]);
+    const PhaseResult* phases = &governed.phases[0];
+
+    check("saves at least a third of the CPU", savings > 0.33);
+    check("reacts within 250 ms of moving", governed.reactions.size() == 3 && reaction < 0.25);
+    check("tracking frozen while held still on a target", phases[1].timeInMode[GOVERNOR_FROZEN] > 14.0);
+    check("idle on the table", phases[3].timeInMode[GOVERNOR_IDLE] > 21.0);
+    check("a target moved while frozen is found again", governed.recovered > 0 && governed.recovered < 73.0 +
+        GovernorParameters().recheckInterval + GovernorParameters().recheckDuration + 0.5);
+    check("no full frame rate on a low battery", phases[6].timeInMode[GOVERNOR_FULL] == 0);
+    check("no full frame rate while overloaded", phases[7].timeInMode[GOVERNOR_FULL] < 5.0 &&
+        phases[7].timeInMode[GOVERNOR_REDUCED] > 9.0);
+    check("the full rate poses while walking", phases[0].timeInMode[GOVERNOR_FULL] > 9.99 && phaseError(governed, 0) == 0);
+    check("modes do not flap", governed.stats.transitions < 30);
+
+    double cameraLimited = timeAtFullRate(30.0f), unlimited = timeAtFullRate(0);
+    printf("\n60 fps target, 30 fps tracking: %.1f s of 10 at the full rate with a 30 fps camera, %.1f s without\n\n",
+        cameraLimited, unlimited);
+    check("a 30 fps camera does not count as overload at 60 fps", cameraLimited > 9.99);
+    check("30 fps tracking at 60 fps is overload otherwise", unlimited < 5.0);
+
+    if (failures > 0)
+    {
+        printf("\n%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
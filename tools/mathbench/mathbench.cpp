@@ -0,0 +1,532 @@
+//
+//  mathbench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Accuracy and speed of the functions in VectorMath.h:
+//
+//      mathbench [iterations]
+//
+//  Every function is checked against a double precision version on random
+//  input and on a sweep over axes and angles including the half turns
+//  where matrixToQuaternion changes its branch. The SIMD versions must
+//  match the scalar ones exactly. Then both are timed. Exits with 1 if a
+//  check fails.
+//
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+#include "VectorMath.h"
+
+using namespace unifeye;
+
+namespace
+{
+    const double PI = 3.14159265358979;
+
+    int failures = 0;
+
+    double now()
+    {
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec + time.tv_nsec * 1e-9;
+    }
+
+    float random( float low, float high )
+    {
+        return low + (high - low) * (float)rand() / RAND_MAX;
+    }
+
+    void check( const char* name, double error, double tolerance )
+    {
+        bool ok = error <= tolerance;
+        printf("%-34s max error %10.3g  %s\n", name, error, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    metaio::Vector4d randomQuaternion()
+    {
+        return normalizeQuaternion(metaio::Vector4d(random(-1, 1), random(-1, 1), random(-1, 1), random(-1, 1)));
+    }
+
+    // a rotation, scale and translation as in a model view matrix
+    void randomAffine( float m[16] )
+    {
+        quaternionToMatrix(randomQuaternion(), metaio::Vector3d(random(-2000, 2000), random(-2000, 2000),
+            random(-2000, 2000)), m);
+        float scale = random(0.1f, 10.0f);
+        for (int i = 0; i < 12; i++)
+            m[i] *= scale;
+    }
+
+    void randomProjection( float m[16] )
+    {
+        float f = 1.0f / tanf(random(0.3f, 1.2f)), nearPlane = random(1, 50), farPlane = random(1000, 20000);
+        float p[16] = { f * random(0.5f, 1.5f), 0, 0, 0, 0, f, 0, 0,
+            random(-0.1f, 0.1f), random(-0.1f, 0.1f), (farPlane + nearPlane) / (nearPlane - farPlane), -1,
+            0, 0, 2 * farPlane * nearPlane / (nearPlane - farPlane), 0 };
+        for (int i = 0; i < 16; i++)
+            m[i] = p[i];
+    }
+
+    void multiplyDouble( const float a[16], const float b[16], double out[16] )
+    {
+        for (int column = 0; column < 4; column++)
+        {
+            for (int row = 0; row < 4; row++)
+            {
+                double sum = 0;
+                for (int k = 0; k < 4; k++)
+                    sum += (double)a[k * 4 + row] * b[column * 4 + k];
+                out[column * 4 + row] = sum;
+            }
+        }
+    }
+
+    double maxDifference( const float* a, const float* b, int count )
+    {
+        double error = 0;
+        for (int i = 0; i < count; i++)
+            error = fmax(error, fabs((double)a[i] - b[i]));
+        return error;
+    }
+
+    // largest element of m * inverse - identity, relative to the size of the products summed up
+    double inverseError( const float m[16], const float inverse[16] )
+    {
+        double error = 0;
+        for (int column = 0; column < 4; column++)
+        {
+            for (int row = 0; row < 4; row++)
+            {
+                double sum = 0, magnitude = 0;
+                for (int k = 0; k < 4; k++)
+                {
+                    double term = (double)m[k * 4 + row] * inverse[column * 4 + k];
+                    sum += term;
+                    magnitude += fabs(term);
+                }
+                error = fmax(error, fabs(sum - (row == column ? 1.0 : 0.0)) / fmax(1.0, magnitude));
+            }
+        }
+        return error;
+    }
+
+    // angle between two rotations in radians, from the rotation between them
+    double quaternionAngle( const metaio::Vector4d& a, const metaio::Vector4d& b )
+    {
+        double x = (double)a.w * b.x - (double)a.x * b.w - (double)a.y * b.z + (double)a.z * b.y;
+        double y = (double)a.w * b.y + (double)a.x * b.z - (double)a.y * b.w - (double)a.z * b.x;
+        double z = (double)a.w * b.z - (double)a.x * b.y + (double)a.y * b.x - (double)a.z * b.w;
+        double w = (double)a.w * b.w + (double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z;
+        return 2.0 * atan2(sqrt(x * x + y * y + z * z), fabs(w));
+    }
+
+    // rotation matrix in double precision from axis and angle (Rodrigues)
+    void axisAngleMatrix( const double axis[3], double angle, double m[16] )
+    {
+        double c = cos(angle), s = sin(angle), t = 1.0 - c;
+        double x = axis[0], y = axis[1], z = axis[2];
+        double r[16] = { t * x * x + c, t * x * y + s * z, t * x * z - s * y, 0,
+            t * x * y - s * z, t * y * y + c, t * y * z + s * x, 0,
+            t * x * z + s * y, t * y * z - s * x, t * z * z + c, 0, 0, 0, 0, 1 };
+        for (int i = 0; i < 16; i++)
+            m[i] = r[i];
+    }
+
+    void checkMatrices( int iterations )
+    {
+        double simdError = 0, referenceError = 0, inverseMaxError = 0, affineError = 0, affineSingular = 0;
+        for (int n = 0; n < iterations; n++)
+        {
+            float a[16], b[16], simd[16], scalar[16];
+            randomProjection(a);
+            randomAffine(b);
+            multiplyMatrices(a, b, simd);
+            multiplyMatricesScalar(a, b, scalar);
+            simdError = fmax(simdError, maxDifference(simd, scalar, 16));
+
+            double reference[16];
+            multiplyDouble(a, b, reference);
+            for (int i = 0; i < 16; i++)
+                referenceError = fmax(referenceError, fabs(scalar[i] - reference[i]) / (1.0 + fabs(reference[i])));
+
+            // the model view inverse through both functions, the projection through the general one
+            float inverse[16];
+            invertMatrix(a, inverse);
+            inverseMaxError = fmax(inverseMaxError, inverseError(a, inverse));
+
+            float affine[16], general[16];
+            invertAffineMatrix(b, affine);
+            invertMatrix(b, general);
+            affineError = fmax(affineError, inverseError(b, affine));
+            inverseMaxError = fmax(inverseMaxError, inverseError(b, general));
+        }
+
+        float singular[16] = { 0 };
+        float out[16];
+        affineSingular = (invertMatrix(singular, out) || invertAffineMatrix(singular, out)) ? 1 : 0;
+
+        check("multiplyMatrices simd vs scalar", simdError, 0.0);
+        check("multiplyMatrices vs double", referenceError, 1e-5);
+        check("invertMatrix", inverseMaxError, 1e-4);
+        check("invertAffineMatrix", affineError, 1e-4);
+        check("singular matrices rejected", affineSingular, 0.0);
+    }
+
+    void checkPoints( int iterations )
+    {
+        double simdError = 0, soaError = 0, referenceError = 0;
+        for (int n = 0; n < iterations / 16 + 1; n++)
+        {
+            float m[16];
+            randomAffine(m);
+
+            // every tail length of the four point loop, in place and not
+            int count = n % 13;
+            std::vector<metaio::Vector3d> points(count), simd(count), scalar(count);
+            for (int i = 0; i < count; i++)
+                points[i] = metaio::Vector3d(random(-5000, 5000), random(-5000, 5000), random(-5000, 5000));
+            if (count == 0)
+                continue;
+
+            transformPoints(m, &points[0], count, &simd[0]);
+            transformPointsScalar(m, &points[0], count, &scalar[0]);
+            simdError = fmax(simdError, maxDifference(&simd[0].x, &scalar[0].x, count * 3));
+
+            std::vector<metaio::Vector3d> inPlace(points);
+            transformPoints(m, &inPlace[0], count, &inPlace[0]);
+            simdError = fmax(simdError, maxDifference(&inPlace[0].x, &scalar[0].x, count * 3));
+
+            // the same points as arrays of coordinates, transformed in place
+            std::vector<float> x(count), y(count), z(count);
+            for (int i = 0; i < count; i++)
+            {
+                x[i] = points[i].x;
+                y[i] = points[i].y;
+                z[i] = points[i].z;
+            }
+            transformPointsSoA(m, &x[0], &y[0], &z[0], count, &x[0], &y[0], &z[0]);
+            for (int i = 0; i < count; i++)
+            {
+                const float p[3] = { x[i], y[i], z[i] };
+                soaError = fmax(soaError, maxDifference(p, &scalar[i].x, 3));
+            }
+
+            for (int i = 0; i < count; i++)
+            {
+                const float p[3] = { points[i].x, points[i].y, points[i].z };
+                const float* q = &scalar[i].x;
+                for (int row = 0; row < 3; row++)
+                {
+                    double terms[4] = { (double)m[row] * p[0], (double)m[4 + row] * p[1], (double)m[8 + row] * p[2],
+                        m[12 + row] };
+                    double reference = terms[0] + terms[1] + terms[2] + terms[3];
+                    double magnitude = fabs(terms[0]) + fabs(terms[1]) + fabs(terms[2]) + fabs(terms[3]);
+                    referenceError = fmax(referenceError, fabs(q[row] - reference) / fmax(1.0, magnitude));
+                }
+            }
+        }
+        check("transformPoints simd vs scalar", simdError, 0.0);
+        check("transformPointsSoA vs scalar", soaError, 0.0);
+        check("transformPoints vs double", referenceError, 1e-5);
+    }
+
+    void checkQuaternions( int iterations )
+    {
+        // sweep of axes on a sphere and angles up to and including a half turn
+        double matrixError = 0, roundTripError = 0, axisAngleError = 0;
+        for (int i = 0; i <= 24; i++)
+        {
+            for (int j = 0; j < 48; j++)
+            {
+                double theta = PI * i / 24, phi = 2 * PI * j / 48;
+                double axis[3] = { sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta) };
+                for (int k = 0; k <= 36; k++)
+                {
+                    double angle = PI * k / 36;
+                    metaio::Vector4d axisAngle((float)axis[0], (float)axis[1], (float)axis[2], (float)angle);
+                    metaio::Vector4d q = axisAngleToQuaternion(axisAngle);
+
+                    float m[16];
+                    double reference[16];
+                    quaternionToMatrix(q, m);
+                    axisAngleMatrix(axis, angle, reference);
+                    for (int e = 0; e < 16; e++)
+                        matrixError = fmax(matrixError, fabs(m[e] - reference[e]));
+
+                    roundTripError = fmax(roundTripError, quaternionAngle(q, matrixToQuaternion(m)));
+
+                    metaio::Vector4d back = quaternionToAxisAngle(q);
+                    axisAngleError = fmax(axisAngleError, quaternionAngle(q, axisAngleToQuaternion(back)));
+                }
+            }
+        }
+
+        // products and conjugates
+        double productError = 0;
+        for (int n = 0; n < iterations; n++)
+        {
+            metaio::Vector4d a = randomQuaternion(), b = randomQuaternion();
+            float ma[16], mb[16], mab[16], product[16];
+            quaternionToMatrix(a, ma);
+            quaternionToMatrix(b, mb);
+            multiplyMatricesScalar(ma, mb, product);
+            quaternionToMatrix(multiplyQuaternions(a, b), mab);
+            productError = fmax(productError, maxDifference(product, mab, 16));
+
+            metaio::Vector4d identity = multiplyQuaternions(a, conjugateQuaternion(a));
+            productError = fmax(productError, quaternionAngle(identity, metaio::Vector4d(0, 0, 0, 1)));
+        }
+
+        // batched matrices for every tail length
+        double batchError = 0, poseError = 0;
+        for (int count = 0; count <= 17; count++)
+        {
+            std::vector<float> qx(count + 1), qy(count + 1), qz(count + 1), qw(count + 1);
+            std::vector<float> tx(count + 1), ty(count + 1), tz(count + 1);
+            for (int i = 0; i < count; i++)
+            {
+                metaio::Vector4d q = randomQuaternion();
+                qx[i] = q.x;
+                qy[i] = q.y;
+                qz[i] = q.z;
+                qw[i] = q.w;
+                tx[i] = random(-1000, 1000);
+                ty[i] = random(-1000, 1000);
+                tz[i] = random(-1000, 1000);
+            }
+            std::vector<float> simd(count * 16 + 1), scalar(count * 16 + 1);
+            quaternionsToMatrices(&qx[0], &qy[0], &qz[0], &qw[0], &tx[0], &ty[0], &tz[0], count, &simd[0]);
+            quaternionsToMatricesScalar(&qx[0], &qy[0], &qz[0], &qw[0], &tx[0], &ty[0], &tz[0], count, &scalar[0]);
+            batchError = fmax(batchError, maxDifference(&simd[0], &scalar[0], count * 16));
+
+            for (int i = 0; i < count; i++)
+            {
+                metaio::Pose pose;
+                pose.rotation = metaio::Vector4d(qx[i], qy[i], qz[i], qw[i]);
+                pose.translation = metaio::Vector3d(tx[i], ty[i], tz[i]);
+                float m[16];
+                poseToMatrix(pose, m);
+                poseError = fmax(poseError, maxDifference(m, &scalar[i * 16], 16));
+            }
+        }
+
+        check("quaternionToMatrix vs Rodrigues", matrixError, 1e-6);
+        check("matrixToQuaternion round trip", roundTripError, 1e-5);
+        check("quaternionToAxisAngle round trip", axisAngleError, 1e-5);
+        check("multiplyQuaternions vs matrices", productError, 1e-3);
+        check("quaternionsToMatrices simd vs scalar", batchError, 0.0);
+        check("poseToMatrix", poseError, 0.0);
+    }
+
+    void checkSlerp( int iterations )
+    {
+        double endError = 0, angleError = 0, lengthError = 0;
+        for (int n = 0; n < iterations; n++)
+        {
+            metaio::Vector4d a = randomQuaternion(), b = randomQuaternion();
+            if (n % 4 == 1)
+            {
+                // close rotations, for the linear fallback
+                b = normalizeQuaternion(metaio::Vector4d(a.x + random(-1e-3f, 1e-3f), a.y, a.z, a.w));
+            }
+            if (n % 4 == 2)
+                b = metaio::Vector4d(-b.x, -b.y, -b.z, -b.w);
+
+            endError = fmax(endError, quaternionAngle(slerp(a, b, 0.0f), a));
+            endError = fmax(endError, quaternionAngle(slerp(a, b, 1.0f), b));
+
+            // the interpolated rotation divides the angle from a to b proportionally
+            double total = quaternionAngle(a, b);
+            float t = random(0, 1);
+            metaio::Vector4d q = slerp(a, b, t);
+            angleError = fmax(angleError, fabs(quaternionAngle(a, q) - t * total));
+            angleError = fmax(angleError, fabs(quaternionAngle(q, b) - (1 - t) * total));
+            lengthError = fmax(lengthError, fabs(sqrt((double)q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w) - 1.0));
+        }
+        check("slerp end points", endError, 1e-5);
+        check("slerp constant speed", angleError, 1e-5);
+        check("slerp unit length", lengthError, 1e-6);
+    }
+
+    void report( const char* name, double scalar, double simd, int count )
+    {
+        printf("%-34s %10.2f ns %10.2f ns %8.2fx\n", name, scalar * 1e9 / count, simd * 1e9 / count, scalar / simd);
+    }
+
+    void benchmark( int iterations )
+    {
+        printf("\n%-34s %13s %13s %9s\n", "per call", "scalar", "simd", "speedup");
+
+        // matrices, chained so the work cannot be dropped
+        float a[16], b[16], c[16];
+        randomProjection(a);
+        randomAffine(b);
+        double start = now();
+        for (int n = 0; n < iterations; n++)
+        {
+            multiplyMatricesScalar(a, b, c);
+            b[12] = c[0] * 1e-9f;
+        }
+        double scalar = now() - start;
+        start = now();
+        for (int n = 0; n < iterations; n++)
+        {
+            multiplyMatrices(a, b, c);
+            b[12] = c[0] * 1e-9f;
+        }
+        report("multiplyMatrices", scalar, now() - start, iterations);
+
+        start = now();
+        for (int n = 0; n < iterations; n++)
+        {
+            invertMatrix(b, c);
+            b[12] = c[0] * 1e-9f;
+        }
+        double general = now() - start;
+        start = now();
+        for (int n = 0; n < iterations; n++)
+        {
+            invertAffineMatrix(b, c);
+            b[12] = c[0] * 1e-9f;
+        }
+        printf("%-34s %10.2f ns %10.2f ns (affine)\n", "invertMatrix", general * 1e9 / iterations,
+            (now() - start) * 1e9 / iterations);
+
+        // points, per point
+        const int POINTS = 4096;
+        std::vector<metaio::Vector3d> points(POINTS), out(POINTS);
+        for (int i = 0; i < POINTS; i++)
+            points[i] = metaio::Vector3d(random(-5000, 5000), random(-5000, 5000), random(-5000, 5000));
+        int rounds = iterations / 64 + 1;
+        start = now();
+        for (int n = 0; n < rounds; n++)
+        {
+            transformPointsScalar(b, &points[0], POINTS, &out[0]);
+            b[12] = out[n % POINTS].x * 1e-9f;
+        }
+        scalar = now() - start;
+        start = now();
+        for (int n = 0; n < rounds; n++)
+        {
+            transformPoints(b, &points[0], POINTS, &out[0]);
+            b[12] = out[n % POINTS].x * 1e-9f;
+        }
+        report("transformPoints (per point)", scalar, now() - start, rounds * POINTS);
+
+        // six arrays in one buffer, apart by more than a multiple of 4 KB so they do not alias in the cache
+        const int STRIDE = POINTS + 16;
+        std::vector<float> coordinates(6 * STRIDE);
+        float* x = &coordinates[0];
+        float* y = x + STRIDE;
+        float* z = y + STRIDE;
+        float* outX = z + STRIDE;
+        float* outY = outX + STRIDE;
+        float* outZ = outY + STRIDE;
+        for (int i = 0; i < POINTS; i++)
+        {
+            x[i] = points[i].x;
+            y[i] = points[i].y;
+            z[i] = points[i].z;
+        }
+        start = now();
+        for (int n = 0; n < rounds; n++)
+        {
+            transformPointsSoAScalar(b, x, y, z, POINTS, outX, outY, outZ);
+            b[12] = outX[n % POINTS] * 1e-9f;
+        }
+        scalar = now() - start;
+        start = now();
+        for (int n = 0; n < rounds; n++)
+        {
+            transformPointsSoA(b, x, y, z, POINTS, outX, outY, outZ);
+            b[12] = outX[n % POINTS] * 1e-9f;
+        }
+        report("transformPointsSoA (per point)", scalar, now() - start, rounds * POINTS);
+
+        // a full pose snapshot, per pose
+        const int POSES = 16;
+        float q[7][POSES];
+        for (int i = 0; i < POSES; i++)
+        {
+            metaio::Vector4d r = randomQuaternion();
+            q[0][i] = r.x;
+            q[1][i] = r.y;
+            q[2][i] = r.z;
+            q[3][i] = r.w;
+            q[4][i] = q[5][i] = q[6][i] = random(-1000, 1000);
+        }
+        float matrices[POSES * 16];
+        rounds = iterations / 4 + 1;
+        start = now();
+        for (int n = 0; n < rounds; n++)
+        {
+            quaternionsToMatricesScalar(q[0], q[1], q[2], q[3], q[4], q[5], q[6], POSES, matrices);
+            q[4][n % POSES] = matrices[n % 256] * 1e-9f;
+        }
+        scalar = now() - start;
+        start = now();
+        for (int n = 0; n < rounds; n++)
+        {
+            quaternionsToMatrices(q[0], q[1], q[2], q[3], q[4], q[5], q[6], POSES, matrices);
+            q[4][n % POSES] = matrices[n % 256] * 1e-9f;
+        }
+        report("quaternionsToMatrices (per pose)", scalar, now() - start, rounds * POSES);
+
+        metaio::Vector4d r0 = randomQuaternion(), r1 = randomQuaternion(), sum;
+        start = now();
+        for (int n = 0; n < iterations; n++)
+        {
+            metaio::Vector4d r = slerp(r0, r1, (n & 255) / 255.0f);
+            sum.x += r.x;
+        }
+        printf("%-34s %10.2f ns\n", "slerp", (now() - start) * 1e9 / iterations);
+
+        start = now();
+        for (int n = 0; n < iterations; n++)
+        {
+            float m[16];
+            quaternionToMatrix(r0, m);
+            r0 = matrixToQuaternion(m);
+            r0.x += 1e-9f;
+        }
+        printf("%-34s %10.2f ns\n", "quaternion to matrix and back", (now() - start) * 1e9 / iterations);
+
+        // keep the results alive
+        if (sum.x + r0.x + c[0] + out[0].x + matrices[0] == 12345.0f)
+            printf("\n");
+    }
+}
+
+int main( int argc, char** argv )
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (iterations <= 0)
+    {
+        fprintf(stderr, "usage: mathbench [iterations]\n");
+        return 2;
+    }
+
+    printf("SIMD path: %s\n\n", getVectorMathSIMDPath());
+    srand(1);
+    int checks = iterations < 100000 ? iterations : 100000;
+    checkMatrices(checks);
+    checkPoints(checks);
+    checkQuaternions(checks);
+    checkSlerp(checks);
+    benchmark(iterations);
+
+    if (failures > 0)
+    {
+        printf("\n%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,545 @@
+//
+//  MeshCompiler.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+#include "MeshCompiler.h"
+#include "ContentHash.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+
+namespace unifeye
+{
+    namespace
+    {
+        const int32_t MD2_IDENT = 0x32504449;   // "IDP2"
+        const int32_t MD2_VERSION = 8;
+
+        struct Corner
+        {
+            int position, texCoord, normal;
+
+            bool operator<( const Corner& other ) const
+            {
+                if (position != other.position)
+                    return position < other.position;
+                if (texCoord != other.texCoord)
+                    return texCoord < other.texCoord;
+                return normal < other.normal;
+            }
+        };
+
+        void normalize( float* v )
+        {
+            float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+            if (length > 0.0f)
+            {
+                v[0] /= length;
+                v[1] /= length;
+                v[2] /= length;
+            }
+            else
+            {
+                v[0] = v[1] = 0.0f;
+                v[2] = 1.0f;
+            }
+        }
+
+        /**
+         * Area weighted vertex normals of one frame. Vertices that share a
+         * position (split at texture seams) get the same normal.
+         */
+        void computeNormals( const float* positions, const std::vector<unsigned int>& indices,
+            const std::vector<int>& positionOf, int positionCount, bool clockwise, float* normals )
+        {
+            std::vector<float> sums(positionCount * 3, 0.0f);
+            for (size_t i = 0; i + 2 < indices.size(); i += 3)
+            {
+                const float* a = positions + indices[i] * 3;
+                const float* b = positions + indices[i + 1] * 3;
+                const float* c = positions + indices[i + 2] * 3;
+                float u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+                float v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+                float n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+                if (clockwise)
+                {
+                    n[0] = -n[0];
+                    n[1] = -n[1];
+                    n[2] = -n[2];
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    float* sum = &sums[positionOf[indices[i + k]] * 3];
+                    sum[0] += n[0];
+                    sum[1] += n[1];
+                    sum[2] += n[2];
+                }
+            }
+
+            for (size_t i = 0; i < positionOf.size(); i++)
+            {
+                float* n = normals + i * 3;
+                memcpy(n, &sums[positionOf[i] * 3], 3 * sizeof(float));
+                normalize(n);
+            }
+        }
+
+        // OBJ index to zero based, negative ones count from the end
+        int resolveIndex( long index, size_t count )
+        {
+            if (index > 0)
+                return index <= (long)count ? (int)(index - 1) : -2;
+            if (index < 0)
+                return -index <= (long)count ? (int)(count + index) : -2;
+            return -2;
+        }
+
+        template <typename T>
+        T read( const unsigned char* bytes )
+        {
+            T value;
+            memcpy(&value, bytes, sizeof(T));
+            return value;
+        }
+
+        template <typename T>
+        void write( std::vector<unsigned char>& file, size_t offset, const T& value )
+        {
+            memcpy(&file[offset], &value, sizeof(T));
+        }
+
+        uint32_t align( size_t offset )
+        {
+            return (uint32_t)((offset + MESH_SECTION_ALIGNMENT - 1) / MESH_SECTION_ALIGNMENT * MESH_SECTION_ALIGNMENT);
+        }
+
+        uint16_t quantize( float value, float offset, float scale )
+        {
+            if (scale <= 0.0f)
+                return 0;
+            float q = floorf((value - offset) / scale + 0.5f);
+            return (uint16_t)(q < 0.0f ? 0.0f : (q > 65535.0f ? 65535.0f : q));
+        }
+    }
+
+    bool importOBJ( const char* text, size_t size, MeshData& mesh, std::string& error )
+    {
+        std::vector<float> positions, texCoords, normals;
+        std::vector<Corner> corners;
+        std::map<Corner, unsigned int> vertexOf;
+        std::vector<Corner> vertices;
+
+        // every line is copied so that strtod can not run into the next one
+        std::string buffer;
+        const char* end = text + size;
+        int lineNumber = 0;
+        for (const char* line = text; line < end; )
+        {
+            const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+            if (!lineEnd)
+                lineEnd = end;
+            lineNumber++;
+            buffer.assign(line, lineEnd);
+            line = lineEnd + 1;
+
+            const char* p = buffer.c_str();
+            while (*p == ' ' || *p == '\t')
+                p++;
+
+            char* next;
+            if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+            {
+                p++;
+                for (int k = 0; k < 3; k++, p = next)
+                    positions.push_back((float)strtod(p, &next));
+            }
+            else if (p[0] == 'v' && p[1] == 't')
+            {
+                float u = (float)strtod(p + 2, &next);
+                float v = (float)strtod(next, &next);
+                texCoords.push_back(u);
+                texCoords.push_back(1.0f - v);      // OBJ counts v from the bottom
+            }
+            else if (p[0] == 'v' && p[1] == 'n')
+            {
+                p += 2;
+                for (int k = 0; k < 3; k++, p = next)
+                    normals.push_back((float)strtod(p, &next));
+            }
+            else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+            {
+                corners.clear();
+                p++;
+                bool valid = true;
+                for (;;)
+                {
+                    while (*p == ' ' || *p == '\t' || *p == '\r')
+                        p++;
+                    if (*p == 0)
+                        break;
+
+                    // v, v/vt, v//vn or v/vt/vn
+                    Corner corner;
+                    corner.position = resolveIndex(strtol(p, &next, 10), positions.size() / 3);
+                    corner.texCoord = -1;
+                    corner.normal = -1;
+                    valid = next != p;
+                    p = next;
+                    if (valid && *p == '/')
+                    {
+                        p++;
+                        if (*p != '/')
+                        {
+                            corner.texCoord = resolveIndex(strtol(p, &next, 10), texCoords.size() / 2);
+                            valid = next != p;
+                            p = next;
+                        }
+                        if (valid && *p == '/')
+                        {
+                            p++;
+                            corner.normal = resolveIndex(strtol(p, &next, 10), normals.size() / 3);
+                            valid = next != p;
+                            p = next;
+                        }
+                    }
+
+                    valid = valid && corner.position >= 0 && corner.texCoord >= -1 && corner.normal >= -1;
+                    if (!valid)
+                        break;
+                    corners.push_back(corner);
+                }
+
+                if (!valid || corners.size() < 3)
+                {
+                    char message[64];
+                    snprintf(message, sizeof(message), "invalid face in line %d", lineNumber);
+                    error = message;
+                    return false;
+                }
+
+                // fan triangulation of convex polygons
+                for (size_t i = 2; i < corners.size(); i++)
+                {
+                    const Corner* triangle[3] = { &corners[0], &corners[i - 1], &corners[i] };
+                    for (int k = 0; k < 3; k++)
+                    {
+                        std::map<Corner, unsigned int>::iterator found = vertexOf.find(*triangle[k]);
+                        if (found == vertexOf.end())
+                        {
+                            found = vertexOf.insert(std::make_pair(*triangle[k], (unsigned int)vertices.size())).first;
+                            vertices.push_back(*triangle[k]);
+                        }
+                        mesh.indices.push_back(found->second);
+                    }
+                }
+            }
+        }
+
+        if (vertices.empty())
+        {
+            error = "no faces";
+            return false;
+        }
+        if (vertices.size() > 65536)
+        {
+            error = "more than 65536 vertices";
+            return false;
+        }
+
+        mesh.source = MESH_SOURCE_OBJ;
+        mesh.vertexCount = (int)vertices.size();
+        mesh.frameNames.assign(1, std::string());
+        mesh.positions.resize(vertices.size() * 3);
+        mesh.normals.resize(vertices.size() * 3);
+        mesh.texCoords.resize(vertices.size() * 2);
+
+        bool hasNormals = true;
+        std::vector<int> positionOf(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            const Corner& vertex = vertices[i];
+            memcpy(&mesh.positions[i * 3], &positions[vertex.position * 3], 3 * sizeof(float));
+            mesh.texCoords[i * 2] = vertex.texCoord >= 0 ? texCoords[vertex.texCoord * 2] : 0.0f;
+            mesh.texCoords[i * 2 + 1] = vertex.texCoord >= 0 ? texCoords[vertex.texCoord * 2 + 1] : 0.0f;
+            if (vertex.normal >= 0)
+            {
+                memcpy(&mesh.normals[i * 3], &normals[vertex.normal * 3], 3 * sizeof(float));
+                normalize(&mesh.normals[i * 3]);
+            }
+            else
+            {
+                hasNormals = false;
+            }
+            positionOf[i] = vertex.position;
+        }
+
+        if (!hasNormals)
+            computeNormals(&mesh.positions[0], mesh.indices, positionOf, (int)positions.size() / 3, false, &mesh.normals[0]);
+
+        return true;
+    }
+
+    bool importMD2( const unsigned char* bytes, size_t size, MeshData& mesh, std::string& error )
+    {
+        if (size < 68 || read<int32_t>(bytes) != MD2_IDENT || read<int32_t>(bytes + 4) != MD2_VERSION)
+        {
+            error = "not an MD2 file";
+            return false;
+        }
+
+        int32_t h[17];
+        for (int i = 0; i < 17; i++)
+            h[i] = read<int32_t>(bytes + i * 4);
+
+        int32_t skinWidth = h[2], skinHeight = h[3], frameSize = h[4], skinCount = h[5];
+        int32_t positionCount = h[6], texCoordCount = h[7], triangleCount = h[8], frameCount = h[10];
+        int32_t offsetSkins = h[11], offsetST = h[12], offsetTriangles = h[13], offsetFrames = h[14];
+
+        if (skinWidth <= 0 || skinHeight <= 0 || positionCount <= 0 || texCoordCount <= 0 ||
+            triangleCount <= 0 || frameCount <= 0 || skinCount < 0 || frameSize < 40 + 4 * positionCount ||
+            offsetSkins < 0 || (size_t)offsetSkins + 64 * (size_t)skinCount > size ||
+            offsetST < 0 || (size_t)offsetST + 4 * (size_t)texCoordCount > size ||
+            offsetTriangles < 0 || (size_t)offsetTriangles + 12 * (size_t)triangleCount > size ||
+            offsetFrames < 0 || (size_t)offsetFrames + (size_t)frameSize * frameCount > size)
+        {
+            error = "corrupt MD2 header";
+            return false;
+        }
+
+        mesh.source = MESH_SOURCE_MD2;
+        mesh.skinWidth = skinWidth;
+        mesh.skinHeight = skinHeight;
+        if (skinCount > 0)
+        {
+            const char* skin = (const char*)bytes + offsetSkins;
+            mesh.skinName.assign(skin, strnlen(skin, 64));
+        }
+
+        // MD2 indexes positions and texture coordinates separately
+        std::map<Corner, unsigned int> vertexOf;
+        std::vector<Corner> vertices;
+        for (int32_t i = 0; i < triangleCount; i++)
+        {
+            const unsigned char* triangle = bytes + offsetTriangles + i * 12;
+            for (int k = 0; k < 3; k++)
+            {
+                Corner corner;
+                corner.position = read<int16_t>(triangle + k * 2);
+                corner.texCoord = read<int16_t>(triangle + 6 + k * 2);
+                corner.normal = 0;
+                if (corner.position < 0 || corner.position >= positionCount ||
+                    corner.texCoord < 0 || corner.texCoord >= texCoordCount)
+                {
+                    error = "triangle index out of range";
+                    return false;
+                }
+
+                std::map<Corner, unsigned int>::iterator found = vertexOf.find(corner);
+                if (found == vertexOf.end())
+                {
+                    found = vertexOf.insert(std::make_pair(corner, (unsigned int)vertices.size())).first;
+                    vertices.push_back(corner);
+                }
+                mesh.indices.push_back(found->second);
+            }
+        }
+
+        if (vertices.size() > 65536)
+        {
+            error = "more than 65536 vertices";
+            return false;
+        }
+
+        size_t vertexCount = vertices.size();
+        mesh.vertexCount = (int)vertexCount;
+        mesh.texCoords.resize(vertexCount * 2);
+        std::vector<int> positionOf(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            const unsigned char* st = bytes + offsetST + vertices[i].texCoord * 4;
+            mesh.texCoords[i * 2] = read<int16_t>(st) / (float)skinWidth;
+            mesh.texCoords[i * 2 + 1] = read<int16_t>(st + 2) / (float)skinHeight;
+            positionOf[i] = vertices[i].position;
+        }
+
+        mesh.frameNames.resize(frameCount);
+        mesh.positions.resize(frameCount * vertexCount * 3);
+        mesh.normals.resize(frameCount * vertexCount * 3);
+        mesh.md2Positions.resize(frameCount * vertexCount * 3);
+        mesh.md2Normals.resize(frameCount * vertexCount);
+        mesh.md2Scale.resize(frameCount * 3);
+        mesh.md2Translate.resize(frameCount * 3);
+
+        for (int32_t frame = 0; frame < frameCount; frame++)
+        {
+            const unsigned char* f = bytes + offsetFrames + (size_t)frame * frameSize;
+            float* scale = &mesh.md2Scale[frame * 3];
+            float* translate = &mesh.md2Translate[frame * 3];
+            for (int k = 0; k < 3; k++)
+            {
+                scale[k] = read<float>(f + k * 4);
+                translate[k] = read<float>(f + 12 + k * 4);
+            }
+            mesh.frameNames[frame].assign((const char*)f + 24, strnlen((const char*)f + 24, 16));
+
+            for (size_t i = 0; i < vertexCount; i++)
+            {
+                const unsigned char* v = f + 40 + vertices[i].position * 4;
+                size_t index = frame * vertexCount + i;
+                for (int k = 0; k < 3; k++)
+                {
+                    mesh.md2Positions[index * 3 + k] = v[k];
+                    mesh.positions[index * 3 + k] = translate[k] + v[k] * scale[k];
+                }
+                mesh.md2Normals[index] = v[3];
+            }
+
+            // MD2 triangles are clockwise
+            computeNormals(&mesh.positions[frame * vertexCount * 3], mesh.indices, positionOf, positionCount,
+                true, &mesh.normals[frame * vertexCount * 3]);
+        }
+
+        return true;
+    }
+
+    bool importMesh( const std::string& path, MeshData& mesh, std::string& error )
+    {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file)
+        {
+            error = "can not open " + path;
+            return false;
+        }
+
+        std::vector<unsigned char> bytes;
+        unsigned char buffer[64 * 1024];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            bytes.insert(bytes.end(), buffer, buffer + read);
+        fclose(file);
+
+        if (bytes.empty())
+        {
+            error = path + " is empty";
+            return false;
+        }
+
+        bool success;
+        if (bytes.size() >= 4 && memcmp(&bytes[0], "IDP2", 4) == 0)
+            success = importMD2(&bytes[0], bytes.size(), mesh, error);
+        else
+            success = importOBJ((const char*)&bytes[0], bytes.size(), mesh, error);
+
+        mesh.contentHash = hashBytes(&bytes[0], bytes.size());
+        return success;
+    }
+
+    void compileMesh( const MeshData& mesh, std::vector<unsigned char>& file )
+    {
+        size_t vertexCount = mesh.vertexCount;
+        size_t frameCount = mesh.frameNames.size();
+        size_t vertices = frameCount * vertexCount;
+        bool md2 = mesh.source == MESH_SOURCE_MD2;
+
+        MeshFileHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = MESH_FILE_MAGIC;
+        header.version = MESH_FILE_VERSION;
+        header.source = mesh.source;
+        header.contentHash = mesh.contentHash;
+        header.vertexCount = (uint32_t)vertexCount;
+        header.indexCount = (uint32_t)mesh.indices.size();
+        header.frameCount = (uint32_t)frameCount;
+        header.skinWidth = mesh.skinWidth;
+        header.skinHeight = mesh.skinHeight;
+        strncpy(header.skinName, mesh.skinName.c_str(), sizeof(header.skinName) - 1);
+
+        header.framesOffset = align(sizeof(MeshFileHeader));
+        header.positionsOffset = align(header.framesOffset + frameCount * sizeof(MeshFrame));
+        header.normalsOffset = align(header.positionsOffset + vertices * 4 * sizeof(uint16_t));
+        header.texCoordsOffset = align(header.normalsOffset + vertices * 4);
+        header.indicesOffset = align(header.texCoordsOffset + vertexCount * 2 * sizeof(uint16_t));
+        header.fileSize = align(header.indicesOffset + mesh.indices.size() * sizeof(uint16_t));
+
+        file.assign(header.fileSize, 0);
+
+        for (int k = 0; k < 3; k++)
+        {
+            header.boxMin[k] = HUGE_VALF;
+            header.boxMax[k] = -HUGE_VALF;
+        }
+
+        for (size_t frame = 0; frame < frameCount; frame++)
+        {
+            MeshFrame f;
+            memset(&f, 0, sizeof(f));
+            strncpy(f.name, mesh.frameNames[frame].c_str(), sizeof(f.name) - 1);
+
+            const float* positions = &mesh.positions[frame * vertexCount * 3];
+            for (int k = 0; k < 3; k++)
+            {
+                f.boxMin[k] = HUGE_VALF;
+                f.boxMax[k] = -HUGE_VALF;
+            }
+            for (size_t i = 0; i < vertexCount; i++)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    f.boxMin[k] = positions[i * 3 + k] < f.boxMin[k] ? positions[i * 3 + k] : f.boxMin[k];
+                    f.boxMax[k] = positions[i * 3 + k] > f.boxMax[k] ? positions[i * 3 + k] : f.boxMax[k];
+                }
+            }
+
+            // MD2 keeps its own quantization, so it can be written back unchanged
+            for (int k = 0; k < 3; k++)
+            {
+                f.offset[k] = md2 ? mesh.md2Translate[frame * 3 + k] : f.boxMin[k];
+                f.scale[k] = md2 ? mesh.md2Scale[frame * 3 + k] : (f.boxMax[k] - f.boxMin[k]) / 65535.0f;
+                header.boxMin[k] = f.boxMin[k] < header.boxMin[k] ? f.boxMin[k] : header.boxMin[k];
+                header.boxMax[k] = f.boxMax[k] > header.boxMax[k] ? f.boxMax[k] : header.boxMax[k];
+            }
+            write(file, header.framesOffset + frame * sizeof(MeshFrame), f);
+
+            const float* normals = &mesh.normals[frame * vertexCount * 3];
+            for (size_t i = 0; i < vertexCount; i++)
+            {
+                size_t index = frame * vertexCount + i;
+                for (int k = 0; k < 3; k++)
+                {
+                    uint16_t q = md2 ? mesh.md2Positions[index * 3 + k] : quantize(positions[i * 3 + k], f.offset[k], f.scale[k]);
+                    write(file, header.positionsOffset + (index * 4 + k) * sizeof(uint16_t), q);
+                    file[header.normalsOffset + index * 4 + k] = (unsigned char)(int8_t)floorf(normals[i * 3 + k] * 127.0f + 0.5f);
+                }
+                if (md2)
+                    write(file, header.positionsOffset + (index * 4 + 3) * sizeof(uint16_t), (uint16_t)mesh.md2Normals[index]);
+            }
+        }
+
+        float texCoordMin[2] = { HUGE_VALF, HUGE_VALF }, texCoordMax[2] = { -HUGE_VALF, -HUGE_VALF };
+        for (size_t i = 0; i < vertexCount * 2; i++)
+        {
+            texCoordMin[i % 2] = mesh.texCoords[i] < texCoordMin[i % 2] ? mesh.texCoords[i] : texCoordMin[i % 2];
+            texCoordMax[i % 2] = mesh.texCoords[i] > texCoordMax[i % 2] ? mesh.texCoords[i] : texCoordMax[i % 2];
+        }
+        for (int k = 0; k < 2; k++)
+        {
+            header.texCoordOffset[k] = texCoordMin[k];
+            header.texCoordScale[k] = (texCoordMax[k] - texCoordMin[k]) / 65535.0f;
+        }
+        for (size_t i = 0; i < vertexCount * 2; i++)
+        {
+            uint16_t q = quantize(mesh.texCoords[i], header.texCoordOffset[i % 2], header.texCoordScale[i % 2]);
+            write(file, header.texCoordsOffset + i * sizeof(uint16_t), q);
+        }
+
+        for (size_t i = 0; i < mesh.indices.size(); i++)
+            write(file, header.indicesOffset + i * sizeof(uint16_t), (uint16_t)mesh.indices[i]);
+
+        write(file, 0, header);
+    }
+}
@@ -0,0 +1,92 @@
+//
+//  MeshCompiler.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Reads OBJ and MD2 files and compiles them into the mesh files described
+//  in Classes/MeshFormat.h. Only used by the command line tools, the module
+//  itself never parses the text formats.
+//
+#ifndef __UNIFEYE_MESHCOMPILER_H__
+#define __UNIFEYE_MESHCOMPILER_H__
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "MeshFormat.h"
+
+namespace unifeye
+{
+    /**
+     * \brief An imported mesh before quantization
+     *
+     * All vertices are unique combinations of position, texture coordinate
+     * and normal, so one index addresses all streams.
+     */
+    struct MeshData
+    {
+        MESH_SOURCE source;
+        unsigned long long contentHash;     ///< hashBytes() of the source file
+        int skinWidth, skinHeight;          ///< MD2 skin size
+        std::string skinName;
+        int vertexCount;                    ///< vertices per frame
+
+        std::vector<std::string> frameNames;
+        std::vector<float> positions;       ///< [frame][vertex][3]
+        std::vector<float> normals;         ///< [frame][vertex][3], unit length
+        std::vector<float> texCoords;       ///< [vertex][2], v = 0 at the top of the texture
+        std::vector<unsigned int> indices;  ///< three per triangle
+
+        // MD2 only: the compressed vertices as stored in the file
+        std::vector<unsigned char> md2Positions;    ///< [frame][vertex][3]
+        std::vector<unsigned char> md2Normals;      ///< [frame][vertex], index into the MD2 normal table
+        std::vector<float> md2Scale;                ///< [frame][3]
+        std::vector<float> md2Translate;            ///< [frame][3]
+
+        MeshData() : source(MESH_SOURCE_OBJ), contentHash(0), skinWidth(0), skinHeight(0), vertexCount(0) {};
+    };
+
+    /**
+     * \brief Parse an OBJ file
+     *
+     * Supports v, vt, vn and f with any number of corners and negative
+     * indices, everything else is ignored. Missing normals are computed.
+     *
+     * \param text the file content
+     * \param size size of the content in bytes
+     * \param[out] mesh the mesh
+     * \param[out] error the reason if the file can not be imported
+     * \return true on success
+     */
+    bool importOBJ( const char* text, size_t size, MeshData& mesh, std::string& error );
+
+    /**
+     * \brief Parse an MD2 file
+     * \param bytes the file content
+     * \param size size of the content in bytes
+     * \param[out] mesh the mesh, normals are computed from the triangles
+     * \param[out] error the reason if the file can not be imported
+     * \return true on success
+     */
+    bool importMD2( const unsigned char* bytes, size_t size, MeshData& mesh, std::string& error );
+
+    /**
+     * \brief Read and parse an OBJ or MD2 file, the format is taken from the content
+     * \param path the file
+     * \param[out] mesh the mesh
+     * \param[out] error the reason if the file can not be imported
+     * \return true on success
+     */
+    bool importMesh( const std::string& path, MeshData& mesh, std::string& error );
+
+    /**
+     * \brief Quantize a mesh and lay it out as a mesh file
+     * \param mesh the imported mesh
+     * \param[out] file the bytes of the mesh file
+     */
+    void compileMesh( const MeshData& mesh, std::vector<unsigned char>& file );
+}
+
+#endif
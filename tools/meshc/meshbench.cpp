@@ -0,0 +1,176 @@
+//
+//  meshbench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Compares loading a model from its text (or MD2) source with mapping the
+//  compiled mesh file:
+//
+//      meshbench [-n iterations] model.obj|model.md2 model.umesh
+//
+//  "mapped" is only the mapping. The SDK can not take the mapped mesh, so
+//  "for the SDK" is what a load of the compiled mesh costs on the device:
+//  map it, write the file UnifeyeMeshBackend hands to the SDK, parse that
+//  file (with the importer of meshc, standing in for the parser of the SDK)
+//  and delete it. "source" parses the source the same way.
+//
+//  Each variant runs in its own process so that the peak resident memory
+//  can be measured. The peak is reported above that of an idle process.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <string>
+
+#include "MeshCompiler.h"
+#include "MeshFile.h"
+
+enum Variant
+{
+    VARIANT_IDLE,
+    VARIANT_SOURCE,
+    VARIANT_MAPPED,
+    VARIANT_WRITTEN         // mapped, written for the SDK and parsed again
+};
+
+struct Result
+{
+    double meanTime;        // seconds per load
+    double minTime;
+    long peakKilobytes;
+};
+
+static double now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+// Runs in the child process, returns false if a load fails
+static bool load( Variant variant, const std::string& path, int iterations, double& meanTime, double& minTime )
+{
+    meanTime = 0.0;
+    minTime = 1e30;
+    unifeye::NullMeshBackend backend;
+    char directory[] = "/tmp/meshbenchXXXXXX";
+    if (variant == VARIANT_WRITTEN && !mkdtemp(directory))
+        return false;
+    unifeye::UnifeyeMeshBackend writer(0, directory);
+
+    for (int i = 0; i < iterations && variant != VARIANT_IDLE; i++)
+    {
+        double start = now();
+        if (variant == VARIANT_SOURCE)
+        {
+            unifeye::MeshData mesh;
+            std::string error;
+            if (!unifeye::importMesh(path, mesh, error))
+                return false;
+        }
+        else if (variant == VARIANT_MAPPED)
+        {
+            unifeye::MeshFile mesh;
+            if (!mesh.open(path))
+                return false;
+            backend.createGeometry(mesh);
+        }
+        else
+        {
+            unifeye::MeshFile mesh;
+            if (!mesh.open(path))
+                return false;
+            std::string file = writer.materialize(mesh);
+            unifeye::MeshData parsed;
+            std::string error;
+            bool success = !file.empty() && unifeye::importMesh(file, parsed, error);
+            if (!file.empty())
+                unlink(file.c_str());
+            if (!success)
+                return false;
+        }
+        double duration = now() - start;
+        meanTime += duration / iterations;
+        minTime = duration < minTime ? duration : minTime;
+    }
+
+    if (variant == VARIANT_WRITTEN)
+        rmdir(directory);
+    return true;
+}
+
+static bool run( Variant variant, const std::string& path, int iterations, Result& result )
+{
+    int channel[2];
+    if (pipe(channel) != 0)
+        return false;
+
+    pid_t child = fork();
+    if (child < 0)
+        return false;
+
+    if (child == 0)
+    {
+        double times[2];
+        bool success = load(variant, path, iterations, times[0], times[1]);
+        ssize_t written = write(channel[1], times, sizeof(times));
+        _exit(success && written == (ssize_t)sizeof(times) ? 0 : 1);
+    }
+
+    close(channel[1]);
+    double times[2];
+    bool received = read(channel[0], times, sizeof(times)) == (ssize_t)sizeof(times);
+    close(channel[0]);
+
+    int status;
+    struct rusage usage;
+    if (wait4(child, &status, 0, &usage) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || !received)
+        return false;
+
+    result.meanTime = times[0];
+    result.minTime = times[1];
+    result.peakKilobytes = usage.ru_maxrss;     // kilobytes on Linux
+    return true;
+}
+
+int main( int argc, char** argv )
+{
+    int iterations = 20;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-n") == 0)
+    {
+        iterations = atoi(argv[2]);
+        first = 3;
+    }
+
+    if (argc - first != 2 || iterations <= 0)
+    {
+        fprintf(stderr, "usage: meshbench [-n iterations] model.obj|model.md2 model.umesh\n");
+        return 2;
+    }
+
+    std::string source = argv[first], compiled = argv[first + 1];
+
+    Result idle, text, mapped, written;
+    if (!run(VARIANT_IDLE, source, iterations, idle) || !run(VARIANT_SOURCE, source, iterations, text) ||
+        !run(VARIANT_MAPPED, compiled, iterations, mapped) || !run(VARIANT_WRITTEN, compiled, iterations, written))
+    {
+        fprintf(stderr, "meshbench: loading failed\n");
+        return 1;
+    }
+
+    printf("%-12s %12s %12s %14s\n", "", "mean ms", "min ms", "peak KB");
+    printf("%-12s %12.3f %12.3f %14ld\n", "source", text.meanTime * 1e3, text.minTime * 1e3, text.peakKilobytes - idle.peakKilobytes);
+    printf("%-12s %12.3f %12.3f %14ld\n", "mapped", mapped.meanTime * 1e3, mapped.minTime * 1e3, mapped.peakKilobytes - idle.peakKilobytes);
+    printf("%-12s %12.3f %12.3f %14ld\n", "for the SDK", written.meanTime * 1e3, written.minTime * 1e3,
+           written.peakKilobytes - idle.peakKilobytes);
+    printf("mapping alone %.1fx faster, a load on the device %.2fx\n", text.meanTime / mapped.meanTime,
+           text.meanTime / written.meanTime);
+    return 0;
+}
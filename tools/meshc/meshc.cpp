@@ -0,0 +1,77 @@
+//
+//  meshc.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Compiles OBJ and MD2 models into mesh files for MeshFile:
+//
+//      meshc [-o output.umesh] model.obj|model.md2
+//
+//  Without -o the output is written next to the input with the extension
+//  replaced by .umesh.
+//
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "MeshCompiler.h"
+
+static void usage()
+{
+    fprintf(stderr, "usage: meshc [-o output.umesh] model.obj|model.md2\n");
+}
+
+int main( int argc, char** argv )
+{
+    std::string input, output;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if (argv[i][0] == '-' || !input.empty())
+        {
+            usage();
+            return 2;
+        }
+        else
+            input = argv[i];
+    }
+
+    if (input.empty())
+    {
+        usage();
+        return 2;
+    }
+
+    if (output.empty())
+    {
+        size_t dot = input.rfind('.');
+        size_t slash = input.rfind('/');
+        output = (dot != std::string::npos && (slash == std::string::npos || dot > slash) ? input.substr(0, dot) : input) + ".umesh";
+    }
+
+    unifeye::MeshData mesh;
+    std::string error;
+    if (!unifeye::importMesh(input, mesh, error))
+    {
+        fprintf(stderr, "meshc: %s: %s\n", input.c_str(), error.c_str());
+        return 1;
+    }
+
+    std::vector<unsigned char> file;
+    unifeye::compileMesh(mesh, file);
+
+    FILE* out = fopen(output.c_str(), "wb");
+    if (!out || fwrite(&file[0], 1, file.size(), out) != file.size() || fclose(out) != 0)
+    {
+        fprintf(stderr, "meshc: can not write %s\n", output.c_str());
+        return 1;
+    }
+
+    printf("%s: %d vertices, %d triangles, %d frames, %lu bytes, hash %016llx\n", output.c_str(),
+        mesh.vertexCount, (int)mesh.indices.size() / 3, (int)mesh.frameNames.size(),
+        (unsigned long)file.size(), mesh.contentHash);
+    return 0;
+}
@@ -0,0 +1,413 @@
+//
+//  moviebench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Side by side alpha merge and the movie texture player:
+//
+//      moviebench
+//
+//  Compares the vectorized merge with the scalar one and a reference for
+//  all format pairs, odd widths, padded rows and flipped origins, then
+//  prints its throughput at movie sizes. Plays synthetic movies, whose
+//  frames carry their number, in real time: the frame shown must be the
+//  one due, in order, the merged alpha right; a slow render loop drops
+//  frames, a stalled decoder skips the late ones to catch up, loops
+//  continue the playback time, a movie without loop ends on its last
+//  frame and the pool is never reallocated. Exits with 1 if a check fails.
+//
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <set>
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+#include "ColorConvert.h"
+#include "MovieTexture.h"
+
+using namespace metaio;
+using namespace metaio::common;
+using namespace unifeye;
+
+namespace
+{
+    int failures = 0;
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    double now()
+    {
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec + time.tv_nsec * 1e-9;
+    }
+
+    void sleepFor( double seconds )
+    {
+        struct timespec time;
+        time.tv_sec = (time_t)seconds;
+        time.tv_nsec = (long)((seconds - time.tv_sec) * 1e9);
+        nanosleep(&time, 0);
+    }
+
+    unsigned int randomState = 1;
+
+    unsigned int randomWord()
+    {
+        randomState = randomState * 1664525U + 1013904223U;
+        return randomState >> 8;
+    }
+
+    void fillRandom( std::vector<unsigned char>& data )
+    {
+        for (size_t i = 0; i < data.size(); i++)
+            data[i] = (unsigned char)randomWord();
+    }
+
+    // byte offsets of red and blue in a pixel
+    int redOffset( ECOLOR_FORMAT format ) { return format == ECF_A8R8G8B8 ? 2 : 0; }
+    int blueOffset( ECOLOR_FORMAT format ) { return format == ECF_A8R8G8B8 ? 0 : 2; }
+
+    // what the merge has to write, one byte at a time
+    void mergeReference( const unsigned char* src, int stride, ECOLOR_FORMAT srcFormat, unsigned char* dst,
+        ECOLOR_FORMAT dstFormat, int width, int height, bool flip )
+    {
+        for (int y = 0; y < height; y++)
+        {
+            const unsigned char* row = src + (size_t)(flip ? height - 1 - y : y) * stride;
+            for (int x = 0; x < width; x++)
+            {
+                const unsigned char* color = row + x * 4;
+                const unsigned char* alpha = row + (width + x) * 4;
+                unsigned char* out = dst + ((size_t)y * width + x) * 4;
+                out[redOffset(dstFormat)] = color[redOffset(srcFormat)];
+                out[1] = color[1];
+                out[blueOffset(dstFormat)] = color[blueOffset(srcFormat)];
+                out[3] = alpha[redOffset(srcFormat)];
+            }
+        }
+    }
+
+    // the merge against the reference, scalar and vectorized
+    bool mergeMatches( int width, int height, int padding, ECOLOR_FORMAT srcFormat, ECOLOR_FORMAT dstFormat, bool flip )
+    {
+        int stride = width * 8 + padding;
+        std::vector<unsigned char> src((size_t)stride * height);
+        fillRandom(src);
+        std::vector<unsigned char> expected((size_t)width * height * 4);
+        mergeReference(&src[0], stride, srcFormat, &expected[0], dstFormat, width, height, flip);
+
+        ImageStruct source(&src[0], width * 2, height, srcFormat, true);
+        for (int simd = 0; simd < 2; simd++)
+        {
+            setColorConvertSIMDEnabled(simd != 0);
+            std::vector<unsigned char> merged((size_t)width * height * 4, 0x55);
+            ImageStruct target(&merged[0], width, height, dstFormat, !flip);
+            if (!mergeSideBySideAlpha(source, padding > 0 ? stride : 0, target) || merged != expected)
+            {
+                setColorConvertSIMDEnabled(true);
+                return false;
+            }
+        }
+        setColorConvertSIMDEnabled(true);
+        return true;
+    }
+
+    double mergeThroughput( int width, int height, bool simd )
+    {
+        std::vector<unsigned char> src((size_t)width * height * 8);
+        std::vector<unsigned char> dst((size_t)width * height * 4);
+        fillRandom(src);
+        ImageStruct source(&src[0], width * 2, height, ECF_A8R8G8B8, true);
+        ImageStruct target(&dst[0], width, height, ECF_A8B8G8R8, true);
+
+        setColorConvertSIMDEnabled(simd);
+        int frames = 0;
+        double start = now(), elapsed = 0;
+        while (elapsed < 0.25)
+        {
+            mergeSideBySideAlpha(source, 0, target);
+            frames++;
+            elapsed = now() - start;
+        }
+        setColorConvertSIMDEnabled(true);
+        return elapsed * 1e3 / frames;
+    }
+
+    // frame n has n in the blue and green of its color half, 255 - n % 256 as alpha
+    class SyntheticMovie : public IMovieSource
+    {
+    public:
+        SyntheticMovie( int _frames, double _frameRate, int _hiccupFrame = -1, double _hiccup = 0 ) :
+            frames(_frames), frameRate(_frameRate), hiccupFrame(_hiccupFrame), hiccup(_hiccup), next(0)
+        {
+            pixels.resize((size_t)WIDTH * 2 * 4 * HEIGHT);
+        }
+
+        enum { WIDTH = 64, HEIGHT = 32 };
+
+        virtual int getWidth() const { return WIDTH * 2; }
+        virtual int getHeight() const { return HEIGHT; }
+        virtual ECOLOR_FORMAT getColorFormat() const { return ECF_A8R8G8B8; }
+        virtual double getFrameRate() const { return frameRate; }
+
+        virtual bool read( MovieSourceFrame& frame )
+        {
+            if (next >= frames)
+                return false;
+            if (next == hiccupFrame)
+                sleepFor(hiccup);
+
+            for (int y = 0; y < HEIGHT; y++)
+            {
+                unsigned char* row = &pixels[(size_t)y * WIDTH * 8];
+                for (int x = 0; x < WIDTH; x++)
+                {
+                    unsigned char* color = row + x * 4;
+                    unsigned char* alpha = row + (WIDTH + x) * 4;
+                    color[0] = (unsigned char)next;
+                    color[1] = (unsigned char)(next >> 8);
+                    color[2] = (unsigned char)x;
+                    color[3] = 0;
+                    alpha[0] = alpha[1] = 0;
+                    alpha[2] = (unsigned char)(255 - next % 256);
+                    alpha[3] = 0;
+                }
+            }
+            frame.pixels = &pixels[0];
+            frame.stride = WIDTH * 8;
+            frame.time = next / frameRate;
+            next++;
+            return true;
+        }
+
+        virtual bool rewind()
+        {
+            next = 0;
+            return true;
+        }
+
+    private:
+        int frames;
+        double frameRate;
+        int hiccupFrame;             // the decoder stalls once before this frame
+        double hiccup;
+        int next;
+        std::vector<unsigned char> pixels;
+    };
+
+    // the number in the pixels of a merged frame, -1 if the frame is torn or the alpha is wrong
+    int frameNumber( const MovieFrame& frame )
+    {
+        const unsigned char* p = &frame.pixels[0];
+        int number = p[2] | (p[1] << 8);
+        for (int i = 0; i < SyntheticMovie::WIDTH * SyntheticMovie::HEIGHT; i++, p += 4)
+        {
+            // ECF_A8B8G8R8: R, G, B, A
+            if ((p[2] | (p[1] << 8)) != number || p[0] != i % SyntheticMovie::WIDTH || p[3] != 255 - number % 256)
+                return -1;
+        }
+        return number;
+    }
+
+    struct Playback
+    {
+        std::vector<unsigned long> indices;
+        std::vector<double> times;
+        std::vector<double> shownAt;
+        std::vector<int> numbers;
+        std::set<const unsigned char*> buffers;
+        unsigned long updates;
+        bool finished;
+        MovieStats stats;
+
+        Playback() : updates(0), finished(false) {};
+
+        bool inOrder() const
+        {
+            for (size_t i = 1; i < indices.size(); i++)
+            {
+                if (indices[i] <= indices[i - 1])
+                    return false;
+            }
+            return true;
+        }
+
+        // no frame before its time, and the number in the pixels is the frame's
+        bool consistent( int movieFrames ) const
+        {
+            for (size_t i = 0; i < indices.size(); i++)
+            {
+                if (times[i] > shownAt[i] + 0.002 || numbers[i] != (int)(indices[i] % movieFrames))
+                    return false;
+            }
+            return true;
+        }
+
+        // shown frames that were the one due when they were shown
+        double onTime( double frameRate ) const
+        {
+            size_t due = 0;
+            for (size_t i = 0; i < indices.size(); i++)
+            {
+                if (indices[i] == (unsigned long)((shownAt[i] + 0.002) * frameRate))
+                    due++;
+            }
+            return indices.empty() ? 0 : (double)due / indices.size();
+        }
+    };
+
+    // a render loop at a rate in real time
+    Playback play( SyntheticMovie* movie, const MovieParameters& parameters, double renderRate, double duration )
+    {
+        Playback playback;
+        MoviePlayer player(movie, parameters);
+        player.start();
+
+        double start = now();
+        for (;;)
+        {
+            double time = now() - start;
+            if (time > duration)
+                break;
+            const MovieFrame* frame = player.update(time);
+            playback.updates++;
+            if (frame)
+            {
+                playback.indices.push_back(frame->index);
+                playback.times.push_back(frame->time);
+                playback.shownAt.push_back(time);
+                playback.numbers.push_back(frameNumber(*frame));
+                playback.buffers.insert(&frame->pixels[0]);
+            }
+            if (player.isFinished())
+            {
+                playback.finished = true;
+                break;
+            }
+            sleepFor(1.0 / renderRate);
+        }
+        player.stop();
+        playback.stats = player.getStats();
+        return playback;
+    }
+
+    void printPlayback( const char* name, const Playback& playback, double frameRate )
+    {
+        printf("    %-20s %4lu updates, %3lu shown, %3lu dropped, %3lu skipped, %2lu stalls, %.0f%% on time\n",
+            name, playback.updates, playback.stats.shown, playback.stats.dropped, playback.stats.skipped,
+            playback.stats.stalls, playback.onTime(frameRate) * 100);
+    }
+}
+
+int main()
+{
+    // merge
+    {
+        const ECOLOR_FORMAT formats[2] = { ECF_A8R8G8B8, ECF_A8B8G8R8 };
+        bool same = true;
+        for (int s = 0; s < 2; s++)
+        {
+            for (int d = 0; d < 2; d++)
+            {
+                for (int width = 1; width <= 37; width++)
+                    same = same && mergeMatches(width, 3, 0, formats[s], formats[d], false);
+            }
+        }
+        check("merge: all formats and odd widths", same);
+        check("merge: padded rows", mergeMatches(33, 7, 12, ECF_A8R8G8B8, ECF_A8B8G8R8, false) &&
+            mergeMatches(17, 5, 4, ECF_A8B8G8R8, ECF_A8B8G8R8, false));
+        check("merge: flipped origin", mergeMatches(21, 9, 0, ECF_A8R8G8B8, ECF_A8B8G8R8, true) &&
+            mergeMatches(640, 4, 64, ECF_A8B8G8R8, ECF_A8R8G8B8, true));
+
+        std::vector<unsigned char> small(64 * 4), half(32 * 4);
+        ImageStruct source(&small[0], 64, 1, ECF_A8R8G8B8, true);
+        ImageStruct wrongWidth(&half[0], 31, 1, ECF_A8B8G8R8, true);
+        ImageStruct wrongFormat(&half[0], 32, 1, ECF_R8G8B8, true);
+        check("merge: refuses wrong sizes and formats", !mergeSideBySideAlpha(source, 0, wrongWidth) &&
+            !mergeSideBySideAlpha(source, 0, wrongFormat) && !mergeSideBySideAlpha(source, 100, wrongWidth));
+
+        printf("\nmerge (%s)\n", getColorConvertSIMDPath());
+        const int sizes[2][2] = { { 480, 360 }, { 1280, 720 } };
+        for (int i = 0; i < 2; i++)
+        {
+            double scalar = mergeThroughput(sizes[i][0], sizes[i][1], false);
+            double simd = mergeThroughput(sizes[i][0], sizes[i][1], true);
+            printf("    %4dx%-4d  scalar %6.3f ms, vectorized %6.3f ms per frame, %.1fx\n",
+                sizes[i][0], sizes[i][1], scalar, simd, scalar / simd);
+        }
+        printf("\n");
+    }
+
+    // playback
+    {
+        const double FPS = 30;
+        MovieParameters parameters;
+        parameters.transparent = true;
+
+        Playback normal = play(new SyntheticMovie(1000, FPS), parameters, 60, 1.5);
+        printPlayback("60 Hz render", normal, FPS);
+        check("play: in order, never early, pixels right", normal.indices.size() > 30 && normal.inOrder() &&
+            normal.consistent(1000));
+        check("play: the frame shown is the one due", normal.onTime(FPS) > 0.9);
+        check("play: the pool is never reallocated", normal.buffers.size() <= (size_t)parameters.readAhead + 1);
+
+        Playback slowRender = play(new SyntheticMovie(1000, FPS), parameters, 8, 1.5);
+        printPlayback("8 Hz render", slowRender, FPS);
+        check("slow render: drops frames and stays in sync", slowRender.stats.dropped > 0 && slowRender.inOrder() &&
+            slowRender.consistent(1000) && slowRender.onTime(FPS) > 0.8);
+
+        Playback hiccup = play(new SyntheticMovie(1000, FPS, 10, 0.4), parameters, 60, 1.5);
+        printPlayback("decoder stalls 0.4 s", hiccup, FPS);
+        bool caughtUp = !hiccup.indices.empty() && hiccup.indices.back() == (unsigned long)((hiccup.shownAt.back() + 0.002) * FPS);
+        check("stalled decoder: skips late frames, catches up", hiccup.stats.skipped > 0 && hiccup.stats.stalls > 0 &&
+            caughtUp && hiccup.inOrder() && hiccup.consistent(1000));
+
+        MovieParameters noSkipping = parameters;
+        noSkipping.dropLate = false;
+        Playback merged = play(new SyntheticMovie(1000, FPS, 10, 0.4), noSkipping, 60, 1.5);
+        printPlayback("without skipping", merged, FPS);
+        check("stalled decoder: without skipping merges for nothing", merged.stats.skipped == 0 &&
+            merged.stats.dropped > 0);
+
+        MovieParameters looping = parameters;
+        looping.loop = true;
+        Playback loop = play(new SyntheticMovie(10, FPS), looping, 60, 1.2);
+        printPlayback("10 frames looped", loop, FPS);
+        check("loop: starts over and the time goes on", loop.stats.loops >= 2 && loop.inOrder() &&
+            loop.consistent(10) && loop.onTime(FPS) > 0.9 && !loop.finished);
+
+        Playback once = play(new SyntheticMovie(10, FPS), parameters, 60, 2.0);
+        printPlayback("10 frames once", once, FPS);
+        check("end: finishes on the last frame", once.finished && !once.indices.empty() && once.indices.back() == 9 &&
+            once.consistent(10));
+
+        MovieParameters opaque;
+        opaque.format = ECF_A8R8G8B8;
+        MoviePlayer player(new SyntheticMovie(5, FPS), opaque);
+        player.start();
+        const MovieFrame* first = 0;
+        for (int i = 0; i < 200 && !first; i++)
+        {
+            first = player.update(0);
+            sleepFor(0.005);
+        }
+        check("opaque: copies the whole frame", player.getWidth() == SyntheticMovie::WIDTH * 2 && first &&
+            first->index == 0 && first->pixels[0] == 0 && first->pixels[2] == 0 && first->pixels[8 * 4 + 2] == 8);
+    }
+
+    printf("\n");
+    if (failures > 0)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
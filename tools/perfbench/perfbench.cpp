@@ -0,0 +1,264 @@
+//
+//  perfbench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Cost and correctness of PerfTrace:
+//
+//      perfbench [trace.json]
+//
+//  Measures a PerfScope enabled and disabled, and what the scopes of a
+//  frame add to a simulated 60 fps frame. Then four threads record known
+//  durations while another one keeps reading the statistics and the trace,
+//  and the counts, percentiles and trace events are checked. The trace of
+//  that run is written to the file if one is given. Exits with 1 if a
+//  check fails.
+//
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "PerfTrace.h"
+
+using unifeye::PerfTrace;
+
+namespace
+{
+    const int WRITERS = 4;
+    const int SAMPLES_PER_WRITER = 200000;
+
+    // the scopes the view records per frame
+    const int SCOPES_PER_FRAME = 10;
+
+    int failures = 0;
+    volatile int sink = 0;
+    volatile int writersStarted = 0;
+    volatile int writersDone = 0;
+
+    double seconds()
+    {
+        return PerfTrace::now() * 1e-9;
+    }
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    // roughly the given time of arithmetic, independent of the clock
+    void work( int iterations )
+    {
+        int value = sink;
+        for (int i = 0; i < iterations; i++)
+            value = value * 1103515245 + 12345;
+        sink = value;
+    }
+
+    double timeScopes( int count )
+    {
+        double start = seconds();
+        for (int i = 0; i < count; i++)
+        {
+            UNIFEYE_PERF_SCOPE("bench scope");
+            sink++;
+        }
+        return (seconds() - start) / count;
+    }
+
+    // one frame, the scopes nested like in the view
+    void frame( int iterations )
+    {
+        UNIFEYE_PERF_SCOPE("bench frame");
+        for (int i = 0; i < SCOPES_PER_FRAME - 1; i++)
+        {
+            UNIFEYE_PERF_SCOPE("bench stage");
+            work(iterations / (SCOPES_PER_FRAME - 1));
+        }
+    }
+
+    double timeFrames( int frames, int iterations )
+    {
+        double start = seconds();
+        for (int i = 0; i < frames; i++)
+            frame(iterations);
+        return (seconds() - start) / frames;
+    }
+
+    // writer w records stage w with durations 1..1000 microseconds, in order
+    void* writer( void* argument )
+    {
+        int w = (int)(size_t)argument;
+        char name[32];
+        snprintf(name, sizeof(name), "writer %d", w);
+        PerfTrace::setThreadName(name);
+
+        // all writers alive at once, a thread that ended would pass its buffer on to the next
+        __sync_add_and_fetch(&writersStarted, 1);
+        while (__sync_add_and_fetch(&writersStarted, 0) < WRITERS)
+            sched_yield();
+
+        static const char* stages[WRITERS] = { "writer stage 0", "writer stage 1", "writer stage 2", "writer stage 3" };
+        int stage = PerfTrace::getStage(stages[w]);
+        unsigned long long time = 1000000000ULL;
+        for (int i = 0; i < SAMPLES_PER_WRITER; i++)
+        {
+            unsigned long long duration = (i % 1000 + 1) * 1000ULL;
+            PerfTrace::record(stage, time, time + duration);
+            time += duration;
+        }
+        __sync_add_and_fetch(&writersDone, 1);
+        return 0;
+    }
+
+    struct ReaderResult
+    {
+        int rounds;
+        bool monotonic;     // counts never went down
+        bool validTrace;    // every event had a duration a writer recorded
+    };
+
+    void* reader( void* argument )
+    {
+        ReaderResult& result = *static_cast<ReaderResult*>(argument);
+        std::vector<unsigned long> lastCounts(WRITERS, 0);
+        std::string json;
+        std::vector<unifeye::PerfStageStats> stats;
+        while (__sync_add_and_fetch(&writersDone, 0) < WRITERS)
+        {
+            PerfTrace::getStats(stats);
+            for (size_t i = 0; i < stats.size(); i++)
+            {
+                int w;
+                if (sscanf(stats[i].name.c_str(), "writer stage %d", &w) != 1)
+                    continue;
+                if (stats[i].count < lastCounts[w])
+                    result.monotonic = false;
+                lastCounts[w] = stats[i].count;
+            }
+
+            PerfTrace::getChromeTrace(json);
+            const char* event = json.c_str();
+            while ((event = strstr(event, "\"dur\":")) != 0)
+            {
+                event += 6;
+                double duration = atof(event);
+                double microseconds = floor(duration + 0.5);
+                if (fabs(duration - microseconds) > 1e-3 || microseconds < 1 || microseconds > 1000)
+                {
+                    // the timing benchmark's scopes are in the trace too
+                    const char* name = event;
+                    while (name > json.c_str() && strncmp(name, "\"name\":\"", 8) != 0)
+                        name--;
+                    if (strncmp(name + 8, "writer", 6) == 0)
+                        result.validTrace = false;
+                }
+            }
+            result.rounds++;
+        }
+        return 0;
+    }
+}
+
+int main( int argc, char** argv )
+{
+    PerfTrace::setThreadName("main");
+
+    // cost of one scope
+    const int SCOPES = 2000000;
+    timeScopes(SCOPES);
+    double enabled = timeScopes(SCOPES);
+    PerfTrace::setEnabled(false);
+    double disabled = timeScopes(SCOPES);
+    PerfTrace::setEnabled(true);
+    printf("scope enabled   %8.1f ns\n", enabled * 1e9);
+    printf("scope disabled  %8.1f ns\n", disabled * 1e9);
+
+    // the frame work is calibrated to 16.7 ms without recording
+    int iterations = 1000000;
+    PerfTrace::setEnabled(false);
+    double frameTime = timeFrames(5, iterations);
+    iterations = (int)(iterations * (1.0 / 60.0) / frameTime);
+    double without = 0, with = 0;
+    for (int round = 0; round < 3; round++)
+    {
+        PerfTrace::setEnabled(false);
+        without += timeFrames(20, iterations);
+        PerfTrace::setEnabled(true);
+        with += timeFrames(20, iterations);
+    }
+    double share = SCOPES_PER_FRAME * enabled / (without / 3);
+    printf("frame           %8.3f ms without, %8.3f ms with %d scopes\n", without / 3 * 1e3, with / 3 * 1e3,
+        SCOPES_PER_FRAME);
+    printf("scope cost      %8.5f %% of the frame\n\n", share * 100);
+    check("scopes of a frame cost less than 0.1% of it", share < 0.001);
+
+    // concurrent writers and a reader
+    PerfTrace::resetStats();
+    ReaderResult readerResult = { 0, true, true };
+    pthread_t readerThread, writerThreads[WRITERS];
+    pthread_create(&readerThread, 0, reader, &readerResult);
+    for (int w = 0; w < WRITERS; w++)
+        pthread_create(&writerThreads[w], 0, writer, (void*)(size_t)w);
+    for (int w = 0; w < WRITERS; w++)
+        pthread_join(writerThreads[w], 0);
+    pthread_join(readerThread, 0);
+    printf("reader          %8d rounds while writing\n", readerResult.rounds);
+
+    std::vector<unifeye::PerfStageStats> stats;
+    PerfTrace::getStats(stats);
+    int writerStages = 0;
+    bool counts = true, percentiles = true, extremes = true;
+    for (size_t i = 0; i < stats.size(); i++)
+    {
+        const unifeye::PerfStageStats& s = stats[i];
+        printf("%-16s %8lu  mean %7.3f  p50 %7.3f  p90 %7.3f  p99 %7.3f  max %7.3f ms\n", s.name.c_str(), s.count,
+            s.mean, s.p50, s.p90, s.p99, s.max);
+        if (s.name.compare(0, 6, "writer") != 0)
+            continue;
+
+        // uniform from 0.001 to 1 ms, the buckets are a quarter of a power of two wide
+        writerStages++;
+        counts = counts && s.count == (unsigned long)SAMPLES_PER_WRITER;
+        extremes = extremes && fabs(s.min - 0.001) < 1e-9 && fabs(s.max - 1.0) < 1e-9 && fabs(s.mean - 0.5005) < 1e-6;
+        percentiles = percentiles && fabs(s.p50 - 0.5) < 0.5 * 0.125 && fabs(s.p90 - 0.9) < 0.9 * 0.125 &&
+            fabs(s.p99 - 0.99) < 0.99 * 0.125;
+    }
+    printf("\n");
+    check("every writer sample counted", writerStages == WRITERS && counts);
+    check("min, max and mean exact", extremes);
+    check("percentiles within a bucket", percentiles);
+    check("counts never decrease while reading", readerResult.monotonic);
+    check("trace events read while writing are intact", readerResult.validTrace);
+
+    std::string json;
+    PerfTrace::getChromeTrace(json);
+    int events = 0;
+    for (const char* event = json.c_str(); (event = strstr(event, "\"ph\":\"X\"")) != 0; event++)
+        events++;
+    printf("trace           %8d events, %lu bytes\n", events, (unsigned long)json.size());
+    // the oldest sample of a ring may be being overwritten and is left out
+    check("trace keeps the last samples of every thread", events >= WRITERS * (PerfTrace::RING_SIZE - 1) &&
+        events <= (WRITERS + 1) * PerfTrace::RING_SIZE);
+
+    PerfTrace::resetStats();
+    PerfTrace::getStats(stats);
+    check("reset clears the statistics", stats.empty());
+
+    if (argc > 1)
+        check("trace written", PerfTrace::writeChromeTrace(argv[1]));
+
+    if (failures > 0)
+    {
+        printf("\n%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
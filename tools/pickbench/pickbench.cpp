@@ -0,0 +1,349 @@
+//
+//  pickbench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Picking latency of Picker on a scene of spheres in front of the camera:
+//
+//      pickbench [geometries]
+//
+//  Checks the bucket grid against testing every geometry and the BVH
+//  against testing every triangle, then times single and multi-touch picks
+//  and the rebuild after all poses changed. Finally checks a BVH deeper
+//  than the traversal stack on the C stack and one built without vertices.
+//  Exits with 1 if a check fails.
+//
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+#include "MeshBVH.h"
+#include "Picker.h"
+
+namespace
+{
+    const float PI = 3.14159265f;
+    const int WIDTH = 480, HEIGHT = 320;
+
+    int failures = 0;
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    double now()
+    {
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec + time.tv_nsec * 1e-9;
+    }
+
+    float random( float low, float high )
+    {
+        return low + (high - low) * (float)rand() / RAND_MAX;
+    }
+
+    struct Placement
+    {
+        float translation[3];
+        float rotation[9];      // row major
+        float scale;
+        float modelView[16];    // column major
+    };
+
+    Placement place()
+    {
+        Placement p;
+        float z = random(-40.0f, -2.0f);
+        float extent = -z * tanf(PI / 6.0f);
+        p.translation[0] = random(-extent * 1.5f, extent * 1.5f);
+        p.translation[1] = random(-extent, extent);
+        p.translation[2] = z;
+        p.scale = random(0.3f, 2.0f);
+
+        // rotation about a random axis
+        float axis[3] = { random(-1, 1), random(-1, 1), random(-1, 1) };
+        float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]) + 1e-6f;
+        for (int k = 0; k < 3; k++)
+            axis[k] /= length;
+        float angle = random(-PI, PI), c = cosf(angle), s = sinf(angle), t = 1.0f - c;
+        float x = axis[0], y = axis[1], w = axis[2];
+        float r[9] = { t * x * x + c, t * x * y - s * w, t * x * w + s * y,
+            t * x * y + s * w, t * y * y + c, t * y * w - s * x,
+            t * x * w - s * y, t * y * w + s * x, t * w * w + c };
+        for (int i = 0; i < 9; i++)
+            p.rotation[i] = r[i];
+
+        for (int column = 0; column < 3; column++)
+        {
+            for (int row = 0; row < 3; row++)
+                p.modelView[column * 4 + row] = r[row * 3 + column] * p.scale;
+            p.modelView[column * 4 + 3] = 0.0f;
+        }
+        for (int row = 0; row < 3; row++)
+            p.modelView[12 + row] = p.translation[row];
+        p.modelView[15] = 1.0f;
+        return p;
+    }
+
+    // reference: the ray in model coordinates by undoing the placement, then every triangle
+    bool bruteForce( const std::vector<float>& xyz, const std::vector<uint16_t>& indices, const Placement& p,
+        const float nearPoint[3], const float farPoint[3], float& depth )
+    {
+        float origin[3], end[3];
+        for (int row = 0; row < 3; row++)
+        {
+            origin[row] = end[row] = 0.0f;
+            for (int k = 0; k < 3; k++)
+            {
+                origin[row] += p.rotation[k * 3 + row] * (nearPoint[k] - p.translation[k]) / p.scale;
+                end[row] += p.rotation[k * 3 + row] * (farPoint[k] - p.translation[k]) / p.scale;
+            }
+        }
+        float d[3] = { end[0] - origin[0], end[1] - origin[1], end[2] - origin[2] };
+
+        bool hit = false;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            const float* a = &xyz[indices[i] * 3];
+            const float* b = &xyz[indices[i + 1] * 3];
+            const float* c = &xyz[indices[i + 2] * 3];
+            float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            float q[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+            float det = e1[0] * q[0] + e1[1] * q[1] + e1[2] * q[2];
+            if (fabsf(det) < 1e-12f)
+                continue;
+            float s[3] = { origin[0] - a[0], origin[1] - a[1], origin[2] - a[2] };
+            float u = (s[0] * q[0] + s[1] * q[1] + s[2] * q[2]) / det;
+            float r[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+            float v = (d[0] * r[0] + d[1] * r[1] + d[2] * r[2]) / det;
+            float t = (e2[0] * r[0] + e2[1] * r[1] + e2[2] * r[2]) / det;
+            if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= 0.0f && t < depth)
+            {
+                depth = t;
+                hit = true;
+            }
+        }
+        return hit;
+    }
+
+    void unproject( const float projection[16], float x, float y, float z, float out[3] )
+    {
+        // perspective projection without skew, inverted by hand
+        float ndcX = 2.0f * x / WIDTH - 1.0f, ndcY = 1.0f - 2.0f * y / HEIGHT;
+        float a = projection[10], b = projection[14];
+        float depth = -b / (z + a);         // camera z of the point, negative
+        out[0] = ndcX * -depth / projection[0];
+        out[1] = ndcY * -depth / projection[5];
+        out[2] = depth;
+    }
+}
+
+int main( int argc, char** argv )
+{
+    int count = argc > 1 ? atoi(argv[1]) : 1000;
+    if (count <= 0)
+    {
+        fprintf(stderr, "usage: pickbench [geometries]\n");
+        return 2;
+    }
+
+    // a sphere of radius 0.5 with 64 x 32 quads
+    const int SLICES = 64, STACKS = 32;
+    std::vector<float> xyz;
+    std::vector<uint16_t> indices;
+    for (int j = 0; j <= STACKS; j++)
+    {
+        for (int i = 0; i <= SLICES; i++)
+        {
+            float theta = PI * j / STACKS, phi = 2.0f * PI * i / SLICES;
+            xyz.push_back(0.5f * sinf(theta) * cosf(phi));
+            xyz.push_back(0.5f * cosf(theta));
+            xyz.push_back(0.5f * sinf(theta) * sinf(phi));
+        }
+    }
+    for (int j = 0; j < STACKS; j++)
+    {
+        for (int i = 0; i < SLICES; i++)
+        {
+            uint16_t a = (uint16_t)(j * (SLICES + 1) + i), b = (uint16_t)(a + SLICES + 1);
+            uint16_t quad[6] = { a, b, (uint16_t)(a + 1), (uint16_t)(a + 1), b, (uint16_t)(b + 1) };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+
+    double start = now();
+    unifeye::MeshBVH bvh;
+    bvh.build(&xyz[0], (int)xyz.size() / 3, &indices[0], (int)indices.size());
+    printf("BVH: %d triangles, %d nodes, %zu bytes, built in %.2f ms\n", bvh.getTriangleCount(), bvh.getNodeCount(),
+        bvh.getMemoryUsage(), (now() - start) * 1e3);
+
+    // 60 degrees vertical field of view, near 0.1, far 100
+    float f = 1.0f / tanf(PI / 6.0f), nearPlane = 0.1f, farPlane = 100.0f;
+    float projection[16] = { f * HEIGHT / WIDTH, 0, 0, 0, 0, f, 0, 0,
+        0, 0, (farPlane + nearPlane) / (nearPlane - farPlane), -1, 0, 0, 2 * farPlane * nearPlane / (nearPlane - farPlane), 0 };
+
+    srand(1);
+    unifeye::Picker picker;
+    picker.setProjection(WIDTH, HEIGHT, projection);
+    std::vector<Placement> placements(count);
+    for (int i = 0; i < count; i++)
+    {
+        placements[i] = place();
+        int id = picker.addGeometry(bvh.getBoundingBox(), &bvh);
+        picker.setModelView(id, placements[i].modelView);
+    }
+
+    // correctness
+    const int TAPS = 2000;
+    std::vector<float> taps(TAPS * 2);
+    for (int i = 0; i < TAPS; i++)
+    {
+        taps[i * 2] = random(0.0f, WIDTH - 1.0f);
+        taps[i * 2 + 1] = random(0.0f, HEIGHT - 1.0f);
+    }
+
+    int boxMismatches = 0, triangleMismatches = 0, triangleHits = 0;
+    for (int i = 0; i < TAPS; i++)
+    {
+        unifeye::PickResult grid = picker.pick(taps[i * 2], taps[i * 2 + 1], false);
+        unifeye::PickResult linear = picker.pickLinear(taps[i * 2], taps[i * 2 + 1], false);
+        if (grid.geometry != linear.geometry && fabsf(grid.depth - linear.depth) > 1e-6f)
+            boxMismatches++;
+
+        unifeye::PickResult exact = picker.pick(taps[i * 2], taps[i * 2 + 1], true);
+        float nearPoint[3], farPoint[3];
+        unproject(projection, taps[i * 2], taps[i * 2 + 1], -1.0f, nearPoint);
+        unproject(projection, taps[i * 2], taps[i * 2 + 1], 1.0f, farPoint);
+        float depth = 1.0f;
+        int reference = -1;
+        for (int g = 0; g < count; g++)
+        {
+            if (bruteForce(xyz, indices, placements[g], nearPoint, farPoint, depth))
+                reference = g;
+        }
+        if (reference >= 0)
+            triangleHits++;
+        if (exact.geometry != reference && fabsf(exact.depth - depth) > 1e-5f)
+            triangleMismatches++;
+    }
+    printf("%d taps: %d box mismatches, %d triangle mismatches (%d hits)\n\n", TAPS, boxMismatches,
+        triangleMismatches, triangleHits);
+
+    // latency
+    const int REPEAT = 20;
+    printf("%-28s %12s\n", "", "us per tap");
+    start = now();
+    for (int r = 0; r < REPEAT; r++)
+        for (int i = 0; i < TAPS; i++)
+            picker.pickLinear(taps[i * 2], taps[i * 2 + 1], false);
+    printf("%-28s %12.2f\n", "all geometries, boxes", (now() - start) * 1e6 / (REPEAT * TAPS));
+
+    start = now();
+    for (int i = 0; i < 50; i++)
+    {
+        float nearPoint[3], farPoint[3], depth = 1.0f;
+        unproject(projection, taps[i * 2], taps[i * 2 + 1], -1.0f, nearPoint);
+        unproject(projection, taps[i * 2], taps[i * 2 + 1], 1.0f, farPoint);
+        for (int g = 0; g < count; g++)
+            bruteForce(xyz, indices, placements[g], nearPoint, farPoint, depth);
+    }
+    printf("%-28s %12.2f\n", "all geometries, triangles", (now() - start) * 1e6 / 50);
+
+    start = now();
+    for (int r = 0; r < REPEAT; r++)
+        for (int i = 0; i < TAPS; i++)
+            picker.pickLinear(taps[i * 2], taps[i * 2 + 1], true);
+    printf("%-28s %12.2f\n", "all geometries, BVH", (now() - start) * 1e6 / (REPEAT * TAPS));
+
+    start = now();
+    for (int r = 0; r < REPEAT; r++)
+        for (int i = 0; i < TAPS; i++)
+            picker.pick(taps[i * 2], taps[i * 2 + 1], false);
+    printf("%-28s %12.2f\n", "grid, boxes", (now() - start) * 1e6 / (REPEAT * TAPS));
+
+    start = now();
+    for (int r = 0; r < REPEAT; r++)
+        for (int i = 0; i < TAPS; i++)
+            picker.pick(taps[i * 2], taps[i * 2 + 1], true);
+    printf("%-28s %12.2f\n", "grid, BVH", (now() - start) * 1e6 / (REPEAT * TAPS));
+
+    std::vector<unifeye::PickResult> results(10);
+    start = now();
+    for (int r = 0; r < REPEAT; r++)
+        for (int i = 0; i + 10 <= TAPS; i += 10)
+            picker.pick(&taps[i * 2], 10, true, &results[0]);
+    printf("%-28s %12.2f\n", "grid, BVH, 10 touches", (now() - start) * 1e6 / (REPEAT * TAPS));
+
+    // all poses change, then the first tap rebuilds the grid
+    start = now();
+    for (int r = 0; r < REPEAT; r++)
+    {
+        for (int i = 0; i < count; i++)
+            picker.setModelView(i, placements[(i + r) % count].modelView);
+        picker.pick(taps[0], taps[1], true);
+    }
+    printf("%-28s %12.2f\n", "new poses, rebuild and tap", (now() - start) * 1e6 / REPEAT);
+    printf("\n");
+
+    check("the grid picks what testing every box picks", boxMismatches == 0);
+    check("the BVH picks what testing every triangle picks", triangleMismatches == 0);
+
+    {
+        // small triangles facing x, y and z at 9^i from 2^-19 to 2^57 along their axis: every binned
+        // split peels off the farthest one, so the tree is about as deep as there are triangles
+        const int CHAIN = 25;
+        const float SIZE = 1e-5f;
+        std::vector<float> chainXYZ;
+        std::vector<uint16_t> chainIndices;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float offset = ldexpf(1.0f, -19);
+            for (int i = 0; i < CHAIN; i++, offset *= 9.0f)
+            {
+                float triangle[9] = { 0 };
+                for (int corner = 0; corner < 3; corner++)
+                    triangle[corner * 3 + axis] = offset;
+                triangle[3 + (axis + 1) % 3] = SIZE;
+                triangle[6 + (axis + 2) % 3] = SIZE;
+                chainXYZ.insert(chainXYZ.end(), triangle, triangle + 9);
+                for (int corner = 0; corner < 3; corner++)
+                    chainIndices.push_back((uint16_t)chainIndices.size());
+            }
+        }
+        unifeye::MeshBVH chain;
+        chain.build(&chainXYZ[0], (int)chainXYZ.size() / 3, &chainIndices[0], (int)chainIndices.size());
+        printf("chain BVH: %d triangles, depth %d\n", chain.getTriangleCount(), chain.getDepth());
+
+        // along x from before the nearest triangle, the deepest leaf, and from beyond the farthest one
+        float below[3] = { 0.0f, 0.25f * SIZE, 0.25f * SIZE }, up[3] = { 1.0f, 0.0f, 0.0f };
+        float above[3] = { ldexpf(1.0f, 58), 0.25f * SIZE, 0.25f * SIZE }, down[3] = { -1.0f, 0.0f, 0.0f };
+        float distance = 0.0f;
+        int triangle = -1;
+        bool first = chain.intersect(below, up, FLT_MAX, distance, triangle) && triangle == 0;
+        bool last = chain.intersect(above, down, FLT_MAX, distance, triangle) && triangle == CHAIN - 1;
+        check("the chain builds deeper than 64 levels", chain.getDepth() > 64);
+        check("a deep BVH finds the nearest triangle from both ends", first && last);
+
+        unifeye::MeshBVH empty;
+        empty.build(NULL, 0, &chainIndices[0], 3);
+        check("indices without vertices build an empty BVH",
+            empty.getTriangleCount() == 0 && !empty.intersect(below, up, FLT_MAX, distance, triangle));
+    }
+
+    if (failures)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,280 @@
+//
+//  poolbench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  The screenshot path of EAGLView without GL: PixelBufferPool and the
+//  flip and swizzle of the readback:
+//
+//      poolbench
+//
+//  A frame is "read back" bottom up in RGBA like glReadPixels does, turned
+//  into a top down BGRA image like imageFromFramebufferPixels and checked
+//  pixel by pixel; the image buffer is released from another thread like
+//  the CGDataProvider callback does. Then threads acquire and release
+//  buffers at random to check that none is handed out twice, and the cost
+//  of a screenshot with a warm pool is compared with fresh allocations.
+//  Exits with 1 if a check fails.
+//
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include "ColorConvert.h"
+#include "PixelBufferPool.h"
+
+using namespace unifeye;
+
+namespace
+{
+    int failures = 0;
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    double now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    // the framebuffer color of a pixel, distinct for every pixel and channel
+    inline void framebufferPixel( int x, int y, unsigned char* rgba )
+    {
+        rgba[0] = (unsigned char)x;
+        rgba[1] = (unsigned char)y;
+        rgba[2] = (unsigned char)(x >> 8 | (y >> 8) << 4);
+        rgba[3] = (unsigned char)(x * 3 + y * 5);
+    }
+
+    // what glReadPixels returns: rows from the bottom, bytes R, G, B, A
+    unsigned char* readFramebuffer( PixelBufferPool& pool, int width, int height )
+    {
+        unsigned char* pixels = pool.acquire((size_t)width * height * 4);
+        for (int row = 0; row < height; row++)
+        {
+            int y = height - 1 - row;
+            for (int x = 0; x < width; x++)
+                framebufferPixel(x, y, pixels + ((size_t)row * width + x) * 4);
+        }
+        return pixels;
+    }
+
+    // imageFromFramebufferPixels without the CGImage
+    unsigned char* imageFromFramebufferPixels( PixelBufferPool& pool, unsigned char* pixels, int width, int height )
+    {
+        unsigned char* image = pool.acquire((size_t)width * height * 4);
+        metaio::ImageStruct src(pixels, width, height, metaio::common::ECF_A8B8G8R8, false);
+        metaio::ImageStruct dst(image, width, height, metaio::common::ECF_A8R8G8B8, true);
+        convertImage(src, dst);
+        pool.release(pixels);
+        return image;
+    }
+
+    // top down rows, bytes B, G, R, A like kCGBitmapByteOrder32Little with alpha first
+    bool checkImage( const unsigned char* image, int width, int height )
+    {
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                unsigned char rgba[4];
+                framebufferPixel(x, y, rgba);
+                const unsigned char* p = image + ((size_t)y * width + x) * 4;
+                if (p[0] != rgba[2] || p[1] != rgba[1] || p[2] != rgba[0] || p[3] != rgba[3])
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    struct Releaser
+    {
+        PixelBufferPool* pool;
+        unsigned char* buffer;
+
+        static void* run( void* argument )
+        {
+            Releaser* self = static_cast<Releaser*>(argument);
+            self->pool->release(self->buffer);
+            return 0;
+        }
+    };
+
+    // acquires and holds a few buffers at random, marking them as its own
+    struct Worker
+    {
+        PixelBufferPool* pool;
+        unsigned char id;
+        int iterations;
+        unsigned long clobbered;
+
+        static void* run( void* argument )
+        {
+            Worker* self = static_cast<Worker*>(argument);
+            const size_t sizes[] = { 4096, 8192, 16384, 6000 };
+            std::vector<std::pair<unsigned char*, size_t> > held;
+            unsigned int random = self->id;
+            for (int i = 0; i < self->iterations; i++)
+            {
+                random = random * 1664525U + 1013904223U;
+                if (held.size() < 3 && (random >> 16) % 2 == 0)
+                {
+                    size_t size = sizes[(random >> 8) % 4];
+                    unsigned char* buffer = self->pool->acquire(size);
+                    memset(buffer, self->id, size);
+                    held.push_back(std::make_pair(buffer, size));
+                }
+                else if (!held.empty())
+                {
+                    std::pair<unsigned char*, size_t> entry = held.back();
+                    held.pop_back();
+                    for (size_t j = 0; j < entry.second; j += 61)
+                    {
+                        if (entry.first[j] != self->id)
+                        {
+                            self->clobbered++;
+                            break;
+                        }
+                    }
+                    self->pool->release(entry.first);
+                }
+            }
+            for (size_t j = 0; j < held.size(); j++)
+                self->pool->release(held[j].first);
+            return 0;
+        }
+    };
+}
+
+int main()
+{
+    // portrait and landscape framebuffers, odd sizes for the tails of the kernels
+    const int sizes[][2] = { { 640, 960 }, { 960, 640 }, { 321, 157 }, { 1, 1 }, { 1536, 2048 } };
+    PixelBufferPool pool;
+    bool correct = true;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        int width = sizes[i][0], height = sizes[i][1];
+        unsigned char* pixels = readFramebuffer(pool, width, height);
+        unsigned char* image = imageFromFramebufferPixels(pool, pixels, width, height);
+        if (!checkImage(image, width, height))
+        {
+            printf("  %dx%d is not flipped and swizzled correctly\n", width, height);
+            correct = false;
+        }
+
+        Releaser releaser = { &pool, image };
+        pthread_t thread;
+        pthread_create(&thread, 0, Releaser::run, &releaser);
+        pthread_join(thread, 0);
+    }
+    check("screenshots are flipped and swizzled", correct);
+
+    PixelBufferPoolStats stats = pool.getStats();
+    check("the readback buffer is reused for the image", stats.allocated < 2 * 5);
+
+    // warm at one size, nothing is allocated anymore
+    for (int i = 0; i < 3; i++)
+        pool.release(imageFromFramebufferPixels(pool, readFramebuffer(pool, 640, 960), 640, 960));
+    unsigned long allocated = pool.getStats().allocated;
+    for (int i = 0; i < 20; i++)
+        pool.release(imageFromFramebufferPixels(pool, readFramebuffer(pool, 640, 960), 640, 960));
+    check("a warm pool does not allocate", pool.getStats().allocated == allocated);
+
+    // a small request takes the smallest free buffer that fits
+    {
+        PixelBufferPool fit(8);
+        unsigned char* large = fit.acquire(1000);
+        unsigned char* small = fit.acquire(100);
+        fit.release(large);
+        fit.release(small);
+        check("best fit among the free buffers", fit.acquire(50) == small && fit.acquire(500) == large);
+        fit.release(small);
+        fit.release(large);
+    }
+
+    // the number of free buffers is capped, the rest is freed
+    {
+        PixelBufferPool capped(2);
+        std::vector<unsigned char*> buffers;
+        for (int i = 0; i < 5; i++)
+            buffers.push_back(capped.acquire(1024));
+        for (int i = 0; i < 5; i++)
+            capped.release(buffers[i]);
+        check("free buffers are capped", capped.getStats().bytesInPool == 2 * 1024);
+        capped.purge();
+        check("purge frees the unused buffers", capped.getStats().bytesInPool == 0);
+    }
+
+    // buffers are never shared between threads
+    {
+        PixelBufferPool shared(4);
+        Worker workers[4];
+        pthread_t threads[4];
+        for (int i = 0; i < 4; i++)
+        {
+            workers[i].pool = &shared;
+            workers[i].id = (unsigned char)(i + 1);
+            workers[i].iterations = 200000;
+            workers[i].clobbered = 0;
+            pthread_create(&threads[i], 0, Worker::run, &workers[i]);
+        }
+        unsigned long clobbered = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            pthread_join(threads[i], 0);
+            clobbered += workers[i].clobbered;
+        }
+        stats = shared.getStats();
+        printf("4 threads: %lu acquired, %lu allocated\n", stats.acquired, stats.allocated);
+        check("no buffer is handed out twice", clobbered == 0);
+        check("all buffers came back", stats.bytesInPool <= 4 * 16384);
+    }
+
+    // the screenshot conversion with a warm pool and with fresh buffers
+    {
+        const int width = 640, height = 960, runs = 50;
+        size_t size = (size_t)width * height * 4;
+        PixelBufferPool warm;
+        std::vector<unsigned char> framebuffer(size, 7);
+        double start = now();
+        for (int i = 0; i < runs; i++)
+        {
+            unsigned char* pixels = warm.acquire(size);
+            memcpy(pixels, &framebuffer[0], size);
+            warm.release(imageFromFramebufferPixels(warm, pixels, width, height));
+        }
+        double pooled = (now() - start) / runs;
+
+        start = now();
+        for (int i = 0; i < runs; i++)
+        {
+            unsigned char* pixels = new unsigned char[size];
+            unsigned char* image = new unsigned char[size];
+            memcpy(pixels, &framebuffer[0], size);
+            metaio::ImageStruct src(pixels, width, height, metaio::common::ECF_A8B8G8R8, false);
+            metaio::ImageStruct dst(image, width, height, metaio::common::ECF_A8R8G8B8, true);
+            convertImage(src, dst);
+            delete[] pixels;
+            delete[] image;
+        }
+        double fresh = (now() - start) / runs;
+        printf("%dx%d screenshot: pooled %.3f ms, fresh buffers %.3f ms\n", width, height, pooled * 1000.0, fresh * 1000.0);
+    }
+
+    if (failures)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
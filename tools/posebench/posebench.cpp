@@ -0,0 +1,384 @@
+//
+//  posebench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Correctness and cost of the pose stream:
+//
+//      posebench
+//
+//  Plays a 20 second trace of four coordinate systems at 60 fps through a
+//  PoseStream: still with tracking jitter, moving, still again, drifting
+//  slowly, one of them lost and found again. Checks that frames are at
+//  least an interval apart, that jitter is never published but the drift
+//  and the lost and found coordinate system are, and that every published
+//  buffer decodes to the latest poses with increasing sequence numbers.
+//  Then compares the events per second with polling every frame and times
+//  encoding a frame against marshalling the poses as dictionaries with
+//  their additionalValues string. Exits with 1 if a check fails.
+//
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+#include "PoseSnapshot.h"
+#include "PoseStream.h"
+
+using namespace unifeye;
+
+namespace
+{
+    const double FPS = 60.0;
+    const double DURATION = 20.0;
+    const int COS = 4;
+    const int FRAMES = 100000;
+
+    int failures = 0;
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    double now()
+    {
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec + time.tv_nsec * 1e-9;
+    }
+
+    unsigned int randomState = 1;
+
+    // uniform in [-1, 1]
+    float randomFloat()
+    {
+        randomState = randomState * 1664525U + 1013904223U;
+        return (float)((randomState >> 8) / 8388608.0 - 1.0);
+    }
+
+    void setPose( metaio::Pose& pose, int cosID, float x, float y, float z, float angle, float quality )
+    {
+        pose.cosID = cosID;
+        pose.translation = metaio::Vector3d(x, y, z);
+        pose.rotation = metaio::Vector4d(0.0f, sinf(angle * 0.5f), 0.0f, cosf(angle * 0.5f));
+        pose.quality = quality;
+    }
+
+    // the poses of the trace at a time
+    std::vector<metaio::Pose> tracePoses( double t )
+    {
+        const float degree = (float)(3.14159265358979 / 180.0);
+        std::vector<metaio::Pose> poses;
+        for (int i = 0; i < COS; i++)
+        {
+            int cosID = i + 1;
+            if (cosID == 3 && t >= 16.0 && t < 18.0)
+                continue;
+
+            float x = i * 100.0f, angle = i * 10.0f * degree;
+            if (cosID == 1 && t >= 4.0)
+            {
+                // moves 50 mm and turns 20 degrees per second, then stops
+                float moving = (float)((t < 8.0 ? t : 8.0) - 4.0);
+                x += moving * 50.0f;
+                angle += moving * 20.0f * degree;
+            }
+            if (cosID == 2 && t >= 12.0)
+            {
+                // drifts 0.5 mm per second, 8 um per frame
+                x += (float)((t < 16.0 ? t : 16.0) - 12.0) * 0.5f;
+            }
+
+            // jitter of 0.2 mm, 0.1 degrees and 0.01 quality
+            metaio::Pose pose;
+            setPose(pose, cosID, x + randomFloat() * 0.2f, 50.0f + randomFloat() * 0.2f, 500.0f + randomFloat() * 0.2f,
+                angle + randomFloat() * 0.1f * degree, 0.9f + randomFloat() * 0.01f);
+            poses.push_back(pose);
+        }
+        return poses;
+    }
+
+    unsigned int getWord( const unsigned char* p )
+    {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+    }
+
+    float getFloat( const unsigned char* p )
+    {
+        unsigned int word = getWord(p);
+        float value;
+        memcpy(&value, &word, sizeof(value));
+        return value;
+    }
+
+    double getDouble( const unsigned char* p )
+    {
+        unsigned int words[2] = { getWord(p), getWord(p + 4) };
+        double value;
+        memcpy(&value, words, sizeof(value));
+        return value;
+    }
+
+    // decode a frame and compare it with the poses it was made from
+    bool matches( const unsigned char* data, size_t size, const PoseSnapshot& poses, bool matrices )
+    {
+        size_t poseSize = matrices ? 100 : 36;
+        if (size != POSE_STREAM_HEADER_SIZE + poses.getCount() * poseSize ||
+            getWord(data) != POSE_STREAM_MAGIC || getDouble(data + 8) != poses.getTimestamp() ||
+            getWord(data + 16) != (unsigned int)poses.getCount() || getWord(data + 20) != (matrices ? 1u : 0u))
+        {
+            return false;
+        }
+
+        const unsigned char* p = data + POSE_STREAM_HEADER_SIZE;
+        for (int i = 0; i < poses.getCount(); i++, p += poseSize)
+        {
+            if ((int)getWord(p) != poses.cosID[i] ||
+                getFloat(p + 4) != poses.tx[i] || getFloat(p + 8) != poses.ty[i] || getFloat(p + 12) != poses.tz[i] ||
+                getFloat(p + 16) != poses.qx[i] || getFloat(p + 20) != poses.qy[i] ||
+                getFloat(p + 24) != poses.qz[i] || getFloat(p + 28) != poses.qw[i] ||
+                getFloat(p + 32) != poses.quality[i])
+            {
+                return false;
+            }
+            for (int k = 0; matrices && k < 16; k++)
+            {
+                if (getFloat(p + 36 + k * 4) != poses.getMatrix(i)[k])
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    struct Event
+    {
+        double time;
+        unsigned int sequence;
+        int count;
+    };
+
+    int countEvents( const std::vector<Event>& events, double from, double to )
+    {
+        int count = 0;
+        for (size_t i = 0; i < events.size(); i++)
+        {
+            if (events[i].time >= from && events[i].time < to)
+                count++;
+        }
+        return count;
+    }
+
+    // what publishing a frame as dictionaries costs, without the bridge itself
+    typedef std::map<std::string, double> Values;
+
+    struct MarshalledPose
+    {
+        Values values;
+        std::string additionalValues;
+    };
+
+    void marshal( const std::vector<metaio::Pose>& poses, std::vector<MarshalledPose>& result )
+    {
+        result.clear();
+        for (size_t i = 0; i < poses.size(); i++)
+        {
+            const metaio::Pose& pose = poses[i];
+            MarshalledPose marshalled;
+            marshalled.values["cosID"] = pose.cosID;
+            marshalled.values["x"] = pose.translation.x;
+            marshalled.values["y"] = pose.translation.y;
+            marshalled.values["z"] = pose.translation.z;
+            marshalled.values["qx"] = pose.rotation.x;
+            marshalled.values["qy"] = pose.rotation.y;
+            marshalled.values["qz"] = pose.rotation.z;
+            marshalled.values["qw"] = pose.rotation.w;
+            marshalled.values["quality"] = pose.quality;
+            marshalled.additionalValues = pose.additionalValues;
+            result.push_back(marshalled);
+        }
+    }
+
+    // publish the trace, return the events
+    std::vector<Event> play( PoseStream& stream, bool matrices, int& mismatches )
+    {
+        PoseStreamParameters parameters;
+        parameters.matrices = matrices;
+        stream.setParameters(parameters);
+
+        std::vector<Event> events;
+        mismatches = 0;
+        randomState = 1;
+        for (int frame = 0; frame < DURATION * FPS; frame++)
+        {
+            double t = frame / FPS;
+            PoseSnapshot poses;
+            poses.update(tracePoses(t), t);
+            if (stream.update(poses, t))
+            {
+                Event event = { t, getWord(stream.getData() + 4), poses.getCount() };
+                events.push_back(event);
+                if (!matches(stream.getData(), stream.getSize(), poses, matrices))
+                    mismatches++;
+            }
+        }
+        return events;
+    }
+}
+
+int main()
+{
+    // the trace
+    {
+        PoseStream stream;
+        int mismatches = 0;
+        std::vector<Event> events = play(stream, false, mismatches);
+
+        double gap = 1e9;
+        bool sequential = true;
+        for (size_t i = 1; i < events.size(); i++)
+        {
+            if (events[i].time - events[i - 1].time < gap)
+                gap = events[i].time - events[i - 1].time;
+            if (events[i].sequence != events[i - 1].sequence + 1)
+                sequential = false;
+        }
+
+        int lost = -1, found = -1;
+        for (size_t i = 0; i < events.size(); i++)
+        {
+            if (lost < 0 && events[i].count == COS - 1)
+                lost = (int)i;
+            if (lost >= 0 && found < 0 && events[i].count == COS)
+                found = (int)i;
+        }
+
+        PoseStreamStats stats = stream.getStats();
+        printf("trace: %lu frames, %lu published, %lu unchanged after the interval\n",
+            stats.updates, stats.published, stats.unchanged);
+        printf("    still %d, moving %d, still %d, drifting %d, lost and found %d\n",
+            countEvents(events, 0.0, 4.0), countEvents(events, 4.0, 8.0), countEvents(events, 8.0, 12.0),
+            countEvents(events, 12.0, 16.0), countEvents(events, 16.0, 20.0));
+        printf("    %.1f events/s instead of %.1f when polling every frame\n\n", events.size() / DURATION, FPS);
+
+        check("frames are at least an interval apart", gap >= 0.1 - 0.002);
+        check("the first frame is published", !events.empty() && events[0].time == 0.0 && events[0].sequence == 1);
+        check("jitter is not published", countEvents(events, 1e-9, 4.0) == 0);
+        check("moving publishes once per interval", countEvents(events, 4.0, 8.0) >= 38 && countEvents(events, 4.0, 8.0) <= 41);
+        check("standing still stops publishing", countEvents(events, 8.2, 12.0) == 0);
+        check("a slow drift adds up until it is published", countEvents(events, 12.0, 16.2) >= 1 && countEvents(events, 12.0, 16.2) <= 3);
+        check("a lost coordinate system is published", lost >= 0 && events[lost].time >= 16.0 && events[lost].time < 16.1);
+        check("a found coordinate system is published", found >= 0 && events[found].time >= 18.0 && events[found].time < 18.1);
+        check("sequence numbers increase by one", sequential && stream.getSequence() == events.size());
+        check("every frame decodes to the latest poses", mismatches == 0);
+
+        PoseStream withMatrices;
+        std::vector<Event> matrixEvents = play(withMatrices, true, mismatches);
+        check("matrices decode and do not change the events", mismatches == 0 && matrixEvents.size() == events.size());
+        check("matrices add 64 bytes per pose", withMatrices.getSize() == POSE_STREAM_HEADER_SIZE + COS * 100 &&
+            stream.getSize() == POSE_STREAM_HEADER_SIZE + COS * 36);
+    }
+
+    // the epsilons, against the last published frame
+    {
+        const float degree = (float)(3.14159265358979 / 180.0);
+        std::vector<metaio::Pose> list(1);
+        PoseSnapshot poses;
+        PoseStream stream;
+
+        setPose(list[0], 1, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f);
+        poses.update(list, 0.0);
+        stream.update(poses, 0.0);
+
+        setPose(list[0], 1, 0.0f, 0.0f, 0.0f, 0.3f * degree, 0.5f);
+        poses.update(list, 1.0);
+        bool smallTurn = stream.update(poses, 1.0);
+        setPose(list[0], 1, 0.0f, 0.0f, 0.0f, 0.7f * degree, 0.5f);
+        poses.update(list, 2.0);
+        bool turn = stream.update(poses, 2.0);
+        check("turns are published beyond the epsilon", !smallTurn && turn);
+
+        setPose(list[0], 1, 0.0f, 0.0f, 0.0f, 0.7f * degree, 0.53f);
+        poses.update(list, 3.0);
+        bool smallQuality = stream.update(poses, 3.0);
+        setPose(list[0], 1, 0.0f, 0.0f, 0.0f, 0.7f * degree, 0.7f);
+        poses.update(list, 4.0);
+        bool quality = stream.update(poses, 4.0);
+        check("quality changes are published beyond the epsilon", !smallQuality && quality);
+
+        setPose(list[0], 2, 0.0f, 0.0f, 0.0f, 0.7f * degree, 0.7f);
+        poses.update(list, 5.0);
+        check("another coordinate system is published", stream.update(poses, 5.0));
+
+        stream.setParameters(stream.getParameters());
+        poses.update(list, 5.01);
+        check("new parameters publish the next frame", stream.update(poses, 5.01));
+    }
+
+    // the cost of a frame, every frame published
+    {
+        std::vector<std::vector<metaio::Pose> > lists;
+        for (int i = 0; i < 64; i++)
+            lists.push_back(tracePoses(4.0 + i / FPS));
+
+        PoseStreamParameters parameters;
+        parameters.interval = 0.0f;
+        parameters.translationEpsilon = 0.0f;
+        PoseStream stream, matrixStream;
+        stream.setParameters(parameters);
+        parameters.matrices = true;
+        matrixStream.setParameters(parameters);
+
+        PoseSnapshot poses;
+        unsigned long published = 0;
+        double start = now();
+        for (int frame = 0; frame < FRAMES; frame++)
+        {
+            poses.update(lists[frame & 63], frame / FPS);
+            published += stream.update(poses, frame / FPS) ? 1 : 0;
+        }
+        double streamTime = now() - start;
+
+        start = now();
+        for (int frame = 0; frame < FRAMES; frame++)
+        {
+            poses.update(lists[frame & 63], frame / FPS);
+            matrixStream.update(poses, frame / FPS);
+        }
+        double matrixTime = now() - start;
+
+        std::vector<MarshalledPose> marshalled;
+        size_t keys = 0;
+        start = now();
+        for (int frame = 0; frame < FRAMES; frame++)
+        {
+            marshal(lists[frame & 63], marshalled);
+            keys += marshalled.size();
+        }
+        double marshalTime = now() - start;
+
+        printf("\n%d poses per frame, every frame published (%lu)\n", COS, published);
+        printf("    stream           %6.2f us per frame, %8.0f events/s, %lu bytes\n",
+            streamTime / FRAMES * 1e6, FRAMES / streamTime, (unsigned long)stream.getSize());
+        printf("    stream+matrices  %6.2f us per frame, %8.0f events/s, %lu bytes\n",
+            matrixTime / FRAMES * 1e6, FRAMES / matrixTime, (unsigned long)matrixStream.getSize());
+        printf("    dictionaries     %6.2f us per frame, %8.0f events/s, %lu poses\n",
+            marshalTime / FRAMES * 1e6, FRAMES / marshalTime, (unsigned long)keys);
+        check("encoding is cheaper than marshalling dictionaries", streamTime < marshalTime);
+    }
+
+    printf("\n");
+    if (failures > 0)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
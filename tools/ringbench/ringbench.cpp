@@ -0,0 +1,320 @@
+//
+//  ringbench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Stress test and throughput of CameraFrameRing:
+//
+//      ringbench
+//
+//  A producer thread pushes numbered frames as fast as it can while reader
+//  threads lease the latest or the next frame, check every byte of it and
+//  hold it for a while. A frame written while it was leased shows up as a
+//  torn frame. Then a single thread measures how many frames per second a
+//  push copies at 480x360 and 1280x720, next to a plain memcpy of the same
+//  size. Exits with 1 if a check fails.
+//
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include "CameraFrameRing.h"
+#include "ImageFormat.h"
+
+using namespace unifeye;
+
+namespace
+{
+    const metaio::common::ECOLOR_FORMAT FORMAT = metaio::common::ECF_A8R8G8B8;
+
+    int failures = 0;
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    double now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    void sleepFor( double seconds )
+    {
+        struct timespec ts;
+        ts.tv_sec = (time_t)seconds;
+        ts.tv_nsec = (long)((seconds - ts.tv_sec) * 1e9);
+        nanosleep(&ts, 0);
+    }
+
+    // the first 4 bytes hold the number of the frame, the rest a byte derived from it
+    unsigned char fillByte( unsigned int number )
+    {
+        return (unsigned char)((number * 7) ^ 0x5a);
+    }
+
+    void fill( std::vector<unsigned char>& buffer, unsigned int number )
+    {
+        memcpy(&buffer[0], &number, sizeof(number));
+        memset(&buffer[sizeof(number)], fillByte(number), buffer.size() - sizeof(number));
+    }
+
+    bool intact( const metaio::ImageStruct& image, unsigned int& number )
+    {
+        size_t size = getImageBufferSize(image);
+        memcpy(&number, image.buffer, sizeof(number));
+        unsigned char expected = fillByte(number);
+        for (size_t i = sizeof(number); i < size; i++)
+        {
+            if (image.buffer[i] != expected)
+                return false;
+        }
+        return true;
+    }
+
+    struct Producer
+    {
+        CameraFrameRing* ring;
+        int width, height;
+        unsigned int frames;
+        volatile int done;
+
+        unsigned long pushed;
+
+        static void* run( void* argument )
+        {
+            Producer* self = static_cast<Producer*>(argument);
+            std::vector<unsigned char> buffer(getImageBufferSize(FORMAT, self->width, self->height));
+            metaio::ImageStruct image(&buffer[0], self->width, self->height, FORMAT, true);
+            for (unsigned int i = 1; i <= self->frames; i++)
+            {
+                fill(buffer, i);
+                if (self->ring->push(image, i))
+                    self->pushed++;
+            }
+            atomicStore(&self->done, 1);
+            return 0;
+        }
+    };
+
+    struct Reader
+    {
+        CameraFrameRing* ring;
+        Producer* producer;
+        bool next;                  // every frame in order instead of the latest
+        double hold;                // seconds a lease is held, at most
+
+        unsigned long reads;
+        unsigned long torn;
+        unsigned long outOfOrder;
+        unsigned long mismatched;   // the time stamp is not the number of the frame
+        unsigned long stale;        // leases of a latest frame older than one read before
+
+        static void* run( void* argument )
+        {
+            Reader* self = static_cast<Reader*>(argument);
+            unsigned long last = 0;
+            unsigned int lastNumber = 0;
+            unsigned int random = (unsigned int)(size_t)argument;
+            while (!atomicLoad(&self->producer->done))
+            {
+                CameraFrameLease lease = self->next ? self->ring->acquireNext(last) : self->ring->acquireLatest();
+                if (!lease.isValid())
+                    continue;
+
+                // the latest can be older while the newest slot is written again
+                if (!self->next && lease.getSequence() <= last)
+                {
+                    if (lease.getSequence() < last)
+                        self->stale++;
+                    continue;
+                }
+
+                unsigned int number = 0;
+                if (!intact(lease.getImage(), number))
+                    self->torn++;
+                if (lease.getTimestamp() != number)
+                    self->mismatched++;
+                if (lease.getSequence() <= last || number <= lastNumber)
+                    self->outOfOrder++;
+                last = lease.getSequence();
+                lastNumber = number;
+                self->reads++;
+
+                // a copy shares the frame, held while the first one is released
+                CameraFrameLease copy = lease;
+                lease.release();
+                random = random * 1664525U + 1013904223U;
+                if (self->hold > 0)
+                    sleepFor(self->hold * (random >> 8) / 16777216.0);
+                if (!intact(copy.getImage(), number))
+                    self->torn++;
+            }
+            return 0;
+        }
+    };
+
+    void stress( const char* name, int capacity, int readers, double hold, unsigned int frames )
+    {
+        CameraFrameRing ring(capacity, 480, 360, FORMAT);
+        Producer producer;
+        producer.ring = &ring;
+        producer.width = 480;
+        producer.height = 360;
+        producer.frames = frames;
+        producer.done = 0;
+        producer.pushed = 0;
+
+        std::vector<Reader> state(readers);
+        std::vector<pthread_t> threads(readers);
+        for (int i = 0; i < readers; i++)
+        {
+            Reader& reader = state[i];
+            reader.ring = &ring;
+            reader.producer = &producer;
+            reader.next = i % 2 == 1;
+            reader.hold = hold;
+            reader.reads = reader.torn = reader.outOfOrder = reader.mismatched = reader.stale = 0;
+        }
+        for (int i = 0; i < readers; i++)
+            pthread_create(&threads[i], 0, Reader::run, &state[i]);
+
+        double start = now();
+        pthread_t thread;
+        pthread_create(&thread, 0, Producer::run, &producer);
+        pthread_join(thread, 0);
+        double elapsed = now() - start;
+        for (int i = 0; i < readers; i++)
+            pthread_join(threads[i], 0);
+
+        unsigned long reads = 0, torn = 0, outOfOrder = 0, mismatched = 0, stale = 0;
+        for (int i = 0; i < readers; i++)
+        {
+            reads += state[i].reads;
+            torn += state[i].torn;
+            outOfOrder += state[i].outOfOrder;
+            mismatched += state[i].mismatched;
+            stale += state[i].stale;
+        }
+        CameraFrameRingStats stats = ring.getStats();
+        printf("%-28s %d slots %d readers: %6.0f frames/s pushed %6lu rejected %5lu overwritten %5lu reads %6lu stale %4lu\n",
+               name, capacity, readers, frames / elapsed, stats.framesPushed, stats.framesRejected,
+               stats.framesOverwritten, reads, stale);
+
+        char label[64];
+        snprintf(label, sizeof(label), "%s: no torn frames", name);
+        check(label, torn == 0 && mismatched == 0);
+        snprintf(label, sizeof(label), "%s: frames read in order", name);
+        check(label, outOfOrder == 0);
+        snprintf(label, sizeof(label), "%s: every frame accounted for", name);
+        check(label, stats.framesPushed == producer.pushed && stats.framesPushed + stats.framesRejected == frames);
+        snprintf(label, sizeof(label), "%s: no reallocation", name);
+        check(label, stats.reallocations == 0);
+
+        // all leases are gone, every slot takes a frame again
+        std::vector<unsigned char> buffer(getImageBufferSize(FORMAT, 480, 360));
+        metaio::ImageStruct image(&buffer[0], 480, 360, FORMAT, true);
+        bool free = true;
+        std::vector<CameraFrameLease> held;
+        for (int i = 0; i < capacity; i++)
+        {
+            fill(buffer, frames + 1 + i);
+            free = ring.push(image, frames + 1 + i) && free;
+            held.push_back(ring.acquireLatest());
+        }
+        snprintf(label, sizeof(label), "%s: all leases returned", name);
+        check(label, free && !ring.push(image, 0));
+    }
+
+    void throughput( int width, int height )
+    {
+        const int capacity = 4;
+        CameraFrameRing ring(capacity, width, height, FORMAT);
+        std::vector<unsigned char> buffer(getImageBufferSize(FORMAT, width, height));
+        std::vector<unsigned char> copy(buffer.size());
+        fill(buffer, 1);
+        metaio::ImageStruct image(&buffer[0], width, height, FORMAT, true);
+
+        const int frames = width * height > 500000 ? 500 : 2000;
+        double start = now();
+        for (int i = 0; i < frames; i++)
+            ring.push(image, i);
+        double pushTime = (now() - start) / frames;
+
+        start = now();
+        for (int i = 0; i < frames; i++)
+        {
+            buffer[0] = (unsigned char)i;
+            memcpy(&copy[0], &buffer[0], buffer.size());
+        }
+        double copyTime = (now() - start) / frames;
+
+        // a reader leasing every frame, as the render loop and the recorder do
+        start = now();
+        unsigned long last = 0;
+        for (int i = 0; i < frames; i++)
+        {
+            ring.push(image, i);
+            CameraFrameLease lease = ring.acquireNext(last);
+            last = lease.getSequence();
+        }
+        double leaseTime = (now() - start) / frames;
+
+        printf("%4dx%-4d push %6.3f ms (%5.0f frames/s, %5.2f GB/s)  memcpy %6.3f ms  push and lease %6.3f ms\n",
+               width, height, pushTime * 1000.0, 1.0 / pushTime, buffer.size() / pushTime / 1e9,
+               copyTime * 1000.0, leaseTime * 1000.0);
+
+        char label[64];
+        snprintf(label, sizeof(label), "%dx%d push costs about a memcpy", width, height);
+        check(label, pushTime < copyTime * 1.5 + 20e-6);
+        CameraFrameRingStats stats = ring.getStats();
+        snprintf(label, sizeof(label), "%dx%d push never allocates", width, height);
+        check(label, stats.reallocations == 0 && stats.framesRejected == 0);
+    }
+}
+
+int main()
+{
+    // a reader holding a lease per slot stops the producer instead of tearing
+    stress("short leases", 4, 3, 0.0, 10000);
+    stress("long leases", 4, 3, 0.004, 10000);
+    stress("every slot leased", 2, 4, 0.002, 10000);
+
+    {
+        CameraFrameRing ring(2, 480, 360, FORMAT);
+        std::vector<unsigned char> buffer(getImageBufferSize(FORMAT, 480, 360));
+        fill(buffer, 1);
+        metaio::ImageStruct image(&buffer[0], 480, 360, FORMAT, true);
+        ring.push(image, 1);
+        CameraFrameLease first = ring.acquireLatest();
+        ring.push(image, 2);
+        CameraFrameLease second = ring.acquireLatest();
+        check("a full ring rejects the frame", !ring.push(image, 3) && ring.getStats().framesRejected == 1);
+        second.release();
+        check("a released slot is written again", ring.push(image, 4) && first.getTimestamp() == 1);
+        check("unleased frames count as overwritten", (ring.push(image, 5), ring.getStats().framesOverwritten == 1));
+
+        // frames larger than the ring was made for grow a slot, in the producer
+        std::vector<unsigned char> large(getImageBufferSize(FORMAT, 1280, 720));
+        metaio::ImageStruct largeImage(&large[0], 1280, 720, FORMAT, true);
+        ring.push(largeImage, 6);
+        check("a larger frame reallocates", ring.getStats().reallocations == 1);
+    }
+
+    throughput(480, 360);
+    throughput(1280, 720);
+
+    if (failures)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
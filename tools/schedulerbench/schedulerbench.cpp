@@ -0,0 +1,198 @@
+//
+//  schedulerbench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Pacing of FrameScheduler driven by a simulated display link:
+//
+//      schedulerbench
+//
+//  The display ticks at 60 Hz with some noise on a fake clock; a tick that
+//  falls into a frame still rendering is lost, like a display link on a busy
+//  main thread. Each scenario prints the frames rendered, missed and dropped
+//  and the jitter percentiles, and checks them against what the frame costs
+//  allow. The last line is the cost of a tick on the system clock. Exits
+//  with 1 if a check fails.
+//
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "FrameScheduler.h"
+
+using namespace unifeye;
+
+namespace
+{
+    const double DISPLAY_PERIOD = 1.0 / 60.0;
+    const double TICKS = 6000;
+
+    int failures = 0;
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    double now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    class FakeClock : public IFrameClock
+    {
+    public:
+        FakeClock() : time(100.0) {};
+        virtual double now() { return time; }
+
+        double time;
+    };
+
+    // spends the cost of the frame on the fake clock
+    class CostTarget : public IFrameTarget
+    {
+    public:
+        CostTarget( FakeClock* _clock ) : clock(_clock), cost(0.002), slowEvery(0), slowCost(0), frames(0) {};
+
+        virtual void renderFrame( double )
+        {
+            frames++;
+            clock->time += (slowEvery && frames % slowEvery == 0) ? slowCost : cost;
+        }
+
+        FakeClock* clock;
+        double cost;                // seconds per frame
+        int slowEvery;              // every n-th frame costs slowCost instead
+        double slowCost;
+        int frames;
+    };
+
+    struct Scenario
+    {
+        const char* name;
+        float frameRate;
+        double noise;               // display tick noise, seconds peak to peak
+        double cost;
+        int slowEvery;
+        double slowCost;
+        int stallAt;                // the tick after it arrives this late once, 0 for none
+        double stall;
+
+        Scenario( const char* _name, float _frameRate ) : name(_name), frameRate(_frameRate), noise(0.0005),
+            cost(0.002), slowEvery(0), slowCost(0), stallAt(0), stall(0) {};
+    };
+
+    FramePacingStats run( const Scenario& scenario )
+    {
+        FakeClock clock;
+        CostTarget target(&clock);
+        target.cost = scenario.cost;
+        target.slowEvery = scenario.slowEvery;
+        target.slowCost = scenario.slowCost;
+
+        FrameScheduler scheduler(&clock, &target);
+        scheduler.setTargetFrameRate(scenario.frameRate);
+        scheduler.start();
+
+        unsigned int random = 1;
+        double vsync = clock.time;
+        for (int i = 0; i < TICKS; i++)
+        {
+            random = random * 1664525U + 1013904223U;
+            double tickTime = vsync + scenario.noise * ((random >> 8) / 16777216.0 - 0.5);
+            if (i == scenario.stallAt && scenario.stallAt)
+                tickTime += scenario.stall;
+            if (tickTime > clock.time)
+                clock.time = tickTime;
+            scheduler.tick();
+
+            // the next refresh the main thread is free for
+            vsync += DISPLAY_PERIOD;
+            while (vsync < clock.time)
+                vsync += DISPLAY_PERIOD;
+        }
+
+        FramePacingStats stats = scheduler.getStats();
+        printf("%-24s %5.0f fps  rendered %5lu  missed %4lu  dropped %4lu  jitter p50 %5.2f p95 %5.2f p99 %5.2f max %5.2f ms\n",
+               scenario.name, scenario.frameRate, stats.framesRendered, stats.framesMissed, stats.framesDropped,
+               stats.jitterP50, stats.jitterP95, stats.jitterP99, stats.jitterMax);
+        return stats;
+    }
+}
+
+int main()
+{
+    // cheap frames, every other refresh
+    Scenario steady30("steady", 30.0f);
+    FramePacingStats stats = run(steady30);
+    check("30 fps renders every other tick", fabs((double)stats.framesRendered - TICKS / 2) <= 2);
+    check("30 fps misses no frame", stats.framesMissed == 0 && stats.framesDropped == 0);
+    check("30 fps jitter stays within the tick noise", stats.jitterMax <= 1.0);
+
+    Scenario steady60("steady", 60.0f);
+    stats = run(steady60);
+    check("60 fps renders every tick", stats.framesRendered == TICKS);
+    check("60 fps misses no frame", stats.framesMissed == 0);
+
+    // 20 fps does not divide the display rate, the intervals alternate
+    Scenario uneven("uneven", 20.0f);
+    stats = run(uneven);
+    check("20 fps keeps the rate", fabs((double)stats.framesRendered - TICKS / 3) <= 2);
+    check("20 fps misses no frame", stats.framesMissed == 0);
+
+    // every 10th frame takes 1.35 periods: over budget and the next one is late
+    Scenario slow("slow frames", 30.0f);
+    slow.slowEvery = 10;
+    slow.slowCost = 0.045;
+    stats = run(slow);
+    unsigned long slowFrames = stats.framesRendered / 10;
+    check("slow frames are missed, the late ones too",
+          stats.framesMissed >= 2 * slowFrames - 1 && stats.framesMissed <= 2 * slowFrames + 1);
+    check("slow frames drop no whole period", stats.framesDropped == 0);
+
+    // every frame twice the period, each counted once although late and over budget
+    Scenario overloaded("overloaded", 30.0f);
+    overloaded.cost = 0.066;
+    stats = run(overloaded);
+    check("overloaded frames are counted once", stats.framesMissed <= stats.framesRendered);
+    check("overloaded frames are all missed", stats.framesMissed + 1 >= stats.framesRendered);
+
+    // one tick 120 ms late, e.g. the main thread blocked by a load
+    Scenario stall("stall", 30.0f);
+    stall.stallAt = 3000;
+    stall.stall = 0.120;
+    stats = run(stall);
+    check("a stall is one missed frame", stats.framesMissed == 1);
+    check("a stall drops the periods it covered", stats.framesDropped >= 3 && stats.framesDropped <= 4);
+
+    // the cost of tick() itself on the system clock, most ticks render nothing
+    class NullTarget : public IFrameTarget
+    {
+    public:
+        virtual void renderFrame( double ) {};
+    } nullTarget;
+    SystemFrameClock systemClock;
+    FrameScheduler scheduler(&systemClock, &nullTarget);
+    scheduler.setTargetFrameRate(60.0f);
+    scheduler.start();
+    const int calls = 1000000;
+    double start = now();
+    for (int i = 0; i < calls; i++)
+        scheduler.tick();
+    double elapsed = now() - start;
+    printf("tick on the system clock: %.1f ns\n", elapsed * 1e9 / calls);
+    stats = scheduler.getStats();
+    check("ticks are counted", stats.ticks == (unsigned long)calls);
+
+    if (failures)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,372 @@
+//
+//  sensorbench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Correctness and cost of SensorRing, SensorResampler and SensorPipeline:
+//
+//      sensorbench
+//
+//  Synthetic streams stand in for the device: a 100 Hz accelerometer with
+//  noise, a 200 Hz compass turning through north and a 1 Hz GPS. They are
+//  fed to a pipeline updating at 30 Hz from a 60 Hz render loop on a
+//  simulated clock, and the applied values are compared with the signals.
+//  Then the ring is filled while the render loop stalls, and producer
+//  threads push as fast as they can while another thread applies. Exits
+//  with 1 if a check fails.
+//
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+#include "SensorPipeline.h"
+
+using namespace unifeye;
+
+namespace
+{
+    const double PI = 3.14159265358979;
+    const double ACCELEROMETER_RATE = 100.0;
+    const double COMPASS_RATE = 200.0;
+    const double GPS_RATE = 1.0;
+    const double FRAME_RATE = 60.0;
+    const double UPDATE_RATE = 30.0;
+    const double DURATION = 20.0;
+
+    // the accelerometer noise, uniform in +-NOISE g
+    const double NOISE = 0.02;
+
+    int failures = 0;
+
+    double now()
+    {
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec + time.tv_nsec * 1e-9;
+    }
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    double random( double low, double high )
+    {
+        return low + (high - low) * (double)rand() / RAND_MAX;
+    }
+
+    // the device tilts slowly, gravity moves between the axes
+    metaio::Vector3d gravity( double t )
+    {
+        double tilt = 0.3 * sin(t * 0.5);
+        return metaio::Vector3d((float)sin(tilt), (float)-cos(tilt), 0.05f);
+    }
+
+    // turning at 30 degrees per second, through north every 12 seconds
+    double heading( double t )
+    {
+        return fmod(350.0 + 30.0 * t, 360.0);
+    }
+
+    double angleError( double a, double b )
+    {
+        double d = fabs(fmod(a - b + 540.0, 360.0) - 180.0);
+        return d;
+    }
+
+    class CollectingTarget : public ISensorTarget
+    {
+    public:
+        struct Value
+        {
+            double time;
+            double values[4];
+        };
+
+        std::vector<Value> accelerometer, compass, lla;
+
+        virtual void setAccelerometer( const metaio::Vector3d& v, double timestamp )
+        {
+            Value value = { timestamp, { v.x, v.y, v.z, 0 } };
+            accelerometer.push_back(value);
+        }
+
+        virtual void setCompassAngle( float angle, double timestamp )
+        {
+            Value value = { timestamp, { angle, 0, 0, 0 } };
+            compass.push_back(value);
+        }
+
+        virtual void setLLA( const metaio::LLACoordinate& position, double timestamp )
+        {
+            Value value = { timestamp, { position.latitude, position.longitude, position.altitude, position.accuracy } };
+            lla.push_back(value);
+        }
+    };
+
+    class NullTarget : public ISensorTarget
+    {
+    public:
+        NullTarget() : calls(0) {};
+        unsigned long calls;
+
+        virtual void setAccelerometer( const metaio::Vector3d& values, double timestamp ) { calls++; }
+        virtual void setCompassAngle( float angle, double timestamp ) { calls++; }
+        virtual void setLLA( const metaio::LLACoordinate& position, double timestamp ) { calls++; }
+    };
+
+    // the streams of the simulated device up to a time, in order of their timestamps
+    struct Device
+    {
+        int accelerometerSamples, compassSamples, gpsSamples;
+        double rawError;        // sum of the squared errors of the accelerometer samples
+
+        Device() : accelerometerSamples(0), compassSamples(0), gpsSamples(0), rawError(0) {};
+
+        void pushUntil( SensorPipeline& pipeline, double time )
+        {
+            while (accelerometerSamples / ACCELEROMETER_RATE <= time)
+            {
+                double t = accelerometerSamples++ / ACCELEROMETER_RATE;
+                metaio::Vector3d g = gravity(t);
+                metaio::Vector3d sample((float)(g.x + random(-NOISE, NOISE)), (float)(g.y + random(-NOISE, NOISE)),
+                    (float)(g.z + random(-NOISE, NOISE)));
+                rawError += (sample.x - g.x) * (sample.x - g.x);
+                pipeline.pushAccelerometer(sample, t);
+            }
+            while (compassSamples / COMPASS_RATE <= time)
+            {
+                double t = compassSamples++ / COMPASS_RATE;
+                pipeline.pushCompassAngle((float)heading(t), t);
+            }
+            while (gpsSamples / GPS_RATE <= time)
+            {
+                double t = gpsSamples++ / GPS_RATE;
+                pipeline.pushLLA(metaio::LLACoordinate(48.137 + t * 1e-5, 11.575, 520.0, 5.0), t);
+            }
+        }
+    };
+
+    void simulate()
+    {
+        CollectingTarget target;
+        SensorPipeline pipeline(&target);
+        pipeline.setApplyRate(UPDATE_RATE);
+        Device device;
+
+        // the render loop runs at 60 Hz, a little late now and then
+        int frames = 0;
+        for (double time = 0; time < DURATION; frames++)
+        {
+            device.pushUntil(pipeline, time);
+            pipeline.apply(time);
+            time = (frames + 1) / FRAME_RATE + (frames % 7 == 0 ? 0.003 : 0.0);
+        }
+
+        // the mean trails the signal by half the time between updates
+        double accelerometerError = 0, compassError = 0, compassJump = 0;
+        for (size_t i = 0; i < target.accelerometer.size(); i++)
+        {
+            const CollectingTarget::Value& value = target.accelerometer[i];
+            metaio::Vector3d g = gravity(value.time - 0.5 / UPDATE_RATE);
+            accelerometerError += (value.values[0] - g.x) * (value.values[0] - g.x);
+        }
+        accelerometerError = sqrt(accelerometerError / target.accelerometer.size());
+        double rawError = sqrt(device.rawError / device.accelerometerSamples);
+        for (size_t i = 0; i < target.compass.size(); i++)
+        {
+            const CollectingTarget::Value& value = target.compass[i];
+            compassError = fmax(compassError, angleError(value.values[0], heading(value.time)));
+            if (i > 0)
+                compassJump = fmax(compassJump, angleError(value.values[0], target.compass[i - 1].values[0]));
+        }
+
+        SensorStats accelerometer = pipeline.getStats(SENSOR_ACCELEROMETER);
+        SensorStats compass = pipeline.getStats(SENSOR_COMPASS);
+        SensorStats lla = pipeline.getStats(SENSOR_LLA);
+        printf("%d frames, %lu / %lu / %lu samples, %lu / %lu / %lu updates\n", frames, accelerometer.received,
+            compass.received, lla.received, accelerometer.applied, compass.applied, lla.applied);
+        printf("accelerometer   %8.4f g rms error of the mean, %.4f g of a sample\n", accelerometerError, rawError);
+        printf("compass         %8.4f degrees error, %.2f degrees largest step\n", compassError, compassJump);
+        printf("latency         %8.2f ms accelerometer, %.2f ms compass\n\n", accelerometer.latency * 1e3,
+            compass.latency * 1e3);
+
+        int expectedUpdates = (int)(DURATION * UPDATE_RATE);
+        check("updates at the update rate, not the frame rate",
+            abs((int)accelerometer.applied - expectedUpdates) <= 2 && abs((int)compass.applied - expectedUpdates) <= 2);
+        check("every sample received, none dropped", accelerometer.dropped == 0 && compass.dropped == 0 &&
+            lla.dropped == 0 && accelerometer.received == (unsigned long)device.accelerometerSamples);
+        check("every sample coalesced into an update", accelerometer.coalesced + 4 >= accelerometer.received &&
+            compass.coalesced + 8 >= compass.received);
+        check("the mean removes most of the noise", accelerometerError < rawError * 0.75);
+        check("compass interpolated through north", compassError < 1e-3);
+        check("compass steps stay small across north", compassJump < 30.0 / UPDATE_RATE * 1.2);
+        check("each GPS fix applied once", lla.applied == (unsigned long)device.gpsSamples &&
+            target.lla.back().values[0] == 48.137 + (device.gpsSamples - 1) * 1e-5);
+    }
+
+    void stall()
+    {
+        NullTarget target;
+        SensorPipeline pipeline(&target, 256);
+        Device device;
+        device.pushUntil(pipeline, 0.5);
+        pipeline.apply(0.5);
+
+        // two seconds without a frame: 200 and 400 samples for rings of 256
+        device.pushUntil(pipeline, 2.5);
+        pipeline.apply(2.5);
+        SensorStats accelerometer = pipeline.getStats(SENSOR_ACCELEROMETER);
+        SensorStats compass = pipeline.getStats(SENSOR_COMPASS);
+        printf("stall           %8lu accelerometer and %lu compass samples dropped\n", accelerometer.dropped, compass.dropped);
+        check("a stalled render loop drops and counts", accelerometer.dropped == 0 && compass.dropped == 400 - 256);
+        check("dropped samples are not received", compass.received + compass.dropped == (unsigned long)device.compassSamples);
+    }
+
+    struct ProducerArgument
+    {
+        SensorPipeline* pipeline;
+        int sensor;
+        int samples;
+        volatile int* done;
+    };
+
+    void* producer( void* argument )
+    {
+        ProducerArgument& a = *static_cast<ProducerArgument*>(argument);
+        for (int i = 0; i < a.samples; i++)
+        {
+            double t = i / COMPASS_RATE;
+            if (a.sensor == SENSOR_ACCELEROMETER)
+                a.pipeline->pushAccelerometer(metaio::Vector3d((float)i, 0, 0), t);
+            else
+                a.pipeline->pushCompassAngle((float)(i % 360), t);
+            if ((i & 63) == 0)
+                sched_yield();
+        }
+        __sync_add_and_fetch(a.done, 1);
+        return 0;
+    }
+
+    // checks the values arrive in order, which fails if the ring hands out a torn or stale slot
+    class OrderTarget : public ISensorTarget
+    {
+    public:
+        OrderTarget() : last(-1), ordered(true), calls(0) {};
+        double last;
+        bool ordered;
+        unsigned long calls;
+
+        virtual void setAccelerometer( const metaio::Vector3d& values, double timestamp )
+        {
+            // the mean of consecutive integers with their timestamps i / 200
+            if (fabs(values.x - timestamp * COMPASS_RATE) > 0.5 * COMPASS_RATE * 0.1 + 1 || values.x < last)
+                ordered = false;
+            last = values.x;
+            calls++;
+        }
+        virtual void setCompassAngle( float angle, double timestamp ) { calls++; }
+        virtual void setLLA( const metaio::LLACoordinate& position, double timestamp ) { calls++; }
+    };
+
+    void concurrent()
+    {
+        const int SAMPLES = 200000;
+        OrderTarget target;
+        SensorPipeline pipeline(&target, 256);
+        volatile int done = 0;
+        ProducerArgument arguments[2] = { { &pipeline, SENSOR_ACCELEROMETER, SAMPLES, &done },
+                                          { &pipeline, SENSOR_COMPASS, SAMPLES, &done } };
+        pthread_t threads[2];
+        double start = now();
+        for (int i = 0; i < 2; i++)
+            pthread_create(&threads[i], 0, producer, &arguments[i]);
+
+        int applies = 0;
+        while (__sync_add_and_fetch(&done, 0) < 2)
+        {
+            pipeline.apply(SAMPLES / COMPASS_RATE);
+            applies++;
+        }
+        for (int i = 0; i < 2; i++)
+            pthread_join(threads[i], 0);
+        pipeline.apply(SAMPLES / COMPASS_RATE);
+        double seconds = now() - start;
+
+        SensorStats accelerometer = pipeline.getStats(SENSOR_ACCELEROMETER);
+        SensorStats compass = pipeline.getStats(SENSOR_COMPASS);
+        printf("concurrent      %8.1f M samples/s pushed, %d updates, %lu / %lu dropped\n",
+            2.0 * SAMPLES / seconds * 1e-6, applies, accelerometer.dropped, compass.dropped);
+        check("concurrent samples received or dropped, none lost",
+            accelerometer.received + accelerometer.dropped == (unsigned long)SAMPLES &&
+            compass.received + compass.dropped == (unsigned long)SAMPLES);
+        check("concurrent samples all taken by the consumer", accelerometer.coalesced == accelerometer.received &&
+            compass.coalesced == compass.received);
+        check("concurrent values arrive intact and in order", target.ordered);
+    }
+
+    void cost()
+    {
+        // one frame's worth: two accelerometer and four compass samples at 60 Hz
+        NullTarget target;
+        SensorPipeline pipeline(&target);
+        const int FRAMES = 200000;
+        double start = now();
+        for (int frame = 0; frame < FRAMES; frame++)
+        {
+            double time = frame / FRAME_RATE;
+            for (int i = 0; i < 2; i++)
+                pipeline.pushAccelerometer(metaio::Vector3d(0.1f, -0.98f, 0.05f), time - i * 0.01);
+            for (int i = 0; i < 4; i++)
+                pipeline.pushCompassAngle(90.0f, time - i * 0.005);
+            pipeline.apply(time);
+        }
+        double seconds = (now() - start) / FRAMES;
+        printf("\nframe cost      %8.2f us to push 6 samples and apply them\n", seconds * 1e6);
+        check("sensors cost less than 0.1% of a frame", seconds < 0.001 / FRAME_RATE);
+    }
+}
+
+int main( int argc, char** argv )
+{
+    srand(1);
+
+    // resampler edge cases
+    SensorResampler resampler(SENSOR_RESAMPLE_ANGLE, 1);
+    SensorSample sample, result;
+    check("resampler without samples has no value", !resampler.resample(1.0, 0.0, result));
+    sample.timestamp = 1.0;
+    sample.values[0] = 359.0;
+    resampler.add(sample);
+    sample.timestamp = 2.0;
+    sample.values[0] = 1.0;
+    resampler.add(sample);
+    sample.timestamp = 1.5;
+    check("resampler ignores samples out of order", !resampler.add(sample));
+    resampler.resample(1.75, 0.0, result);
+    check("angles interpolate the short way round", fabs(result.values[0] - 0.5) < 1e-9);
+    resampler.resample(5.0, 0.0, result);
+    check("later times hold the last sample", result.values[0] == 1.0 && result.timestamp == 2.0);
+    resampler.resample(0.0, 0.0, result);
+    check("earlier times hold the first sample", result.values[0] == 359.0 && result.timestamp == 1.0);
+    printf("\n");
+
+    simulate();
+    stall();
+    concurrent();
+    cost();
+
+    if (failures > 0)
+    {
+        printf("\n%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,202 @@
+//
+//  StubUnifeyeMobile.h
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  An IUnifeyeMobile without tracking or rendering, to replay sessions on
+//  the host. It keeps what it was given: setImageSource() reads the PNG
+//  back (only the uncompressed ones UnifeyeSessionSink writes, checksums
+//  included) and the sensor calls are counted.
+//
+#ifndef __UNIFEYE_STUBUNIFEYEMOBILE_H__
+#define __UNIFEYE_STUBUNIFEYEMOBILE_H__
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <UnifeyeSDKMobile/AS_IUnifeyeMobile.h>
+
+namespace unifeye
+{
+    class StubUnifeyeMobile : public metaio::IUnifeyeMobile
+    {
+    public:
+        StubUnifeyeMobile() : width(0), height(0), imageSources(0), invalidImages(0), llaCalls(0),
+            accelerometerCalls(0), compassCalls(0), compass(0)
+        {
+            for (unsigned int n = 0; n < 256; n++)
+            {
+                unsigned int c = n;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xedb88320U ^ (c >> 1) : c >> 1;
+                crcTable[n] = c;
+            }
+        }
+
+        // the image given to setImageSource(), RGB, rows from the top
+        std::vector<unsigned char> image;
+        int width, height;
+
+        unsigned long imageSources;
+        unsigned long invalidImages;
+        unsigned long llaCalls, accelerometerCalls, compassCalls;
+        metaio::LLACoordinate lla;
+        metaio::Vector3d accelerometer;
+        float compass;
+
+        virtual metaio::Vector2di setImageSource( const std::string& source )
+        {
+            imageSources++;
+            std::vector<unsigned char> png;
+            FILE* file = fopen(source.c_str(), "rb");
+            if (file)
+            {
+                unsigned char buffer[65536];
+                size_t read;
+                while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+                    png.insert(png.end(), buffer, buffer + read);
+                fclose(file);
+            }
+            if (!decode(png))
+            {
+                invalidImages++;
+                width = height = 0;
+            }
+            return metaio::Vector2di(width, height);
+        }
+
+        virtual void setSensorLLA( const metaio::LLACoordinate& currentPosition ) { lla = currentPosition; llaCalls++; }
+        virtual void setSensorAccelerometer( const metaio::Vector3d& values ) { accelerometer = values; accelerometerCalls++; }
+        virtual void setSensorCompassAngle( float angle ) { compass = angle; compassCalls++; }
+
+        // everything else does nothing
+        virtual bool setTrackingData( const std::string& trackingDataFile ) { return false; }
+        virtual bool loadStandardCameraCalibration( const std::string& calibrationFile ) { return false; }
+        virtual void render() {}
+        virtual metaio::Vector2di activateCamera( int index, unsigned int width, unsigned int height ) { return metaio::Vector2di(); }
+        virtual void stopCamera() {}
+        virtual void setCameraRotation( int rotation ) {}
+        virtual void requestCameraImage() {}
+        virtual bool saveLastCapturedImage( const std::string& absFilename ) { return false; }
+        virtual float getRendererFrameRate() { return 0; }
+        virtual float getTrackingFrameRate() { return 0; }
+        virtual metaio::Pose getTrackingValues( int cosID ) { return metaio::Pose(); }
+        virtual void getTrackingValues( int cosID, float* matrix, bool preMultiplyWithStandardViewMatrix ) {}
+        virtual std::vector<metaio::Pose> getValidTrackingValues() { return std::vector<metaio::Pose>(); }
+        virtual bool getCosRelation( int baseCos, int relativeCos, metaio::Pose& relation ) { return false; }
+        virtual void setCosOffset( int cosID, const metaio::Pose& pose ) {}
+        virtual metaio::Pose invertPose( const metaio::Pose& inPose ) { return metaio::Pose(); }
+        virtual void getProjectionMatrix( float* matrix ) {}
+        virtual int getNumberOfValidCoordinateSystems() { return 0; }
+        virtual int getNumberOfDefinedCoordinateSystems() { return 0; }
+        virtual void setSeeThrough( bool seeThrough ) {}
+        virtual void setFreezeTracking( bool freeze ) {}
+        virtual metaio::ImageStruct getScreenshot() { return metaio::ImageStruct(); }
+        virtual int saveScreenshot( const std::string& filename ) { return 0; }
+        virtual bool isOpticalTracking() { return false; }
+        virtual std::string getSensorType() { return "stub"; }
+        virtual void setRendererClippingPlaneLimits( float nearCP, float farCP ) {}
+        virtual metaio::IUnifeyeMobileGeometry* loadGeometry( const std::string& geometryFile ) { return 0; }
+        virtual void unloadGeometry( metaio::IUnifeyeMobileGeometry* geometry ) {}
+        virtual std::vector<metaio::IUnifeyeMobileGeometry*> getLoadedGeometries() { return std::vector<metaio::IUnifeyeMobileGeometry*>(); }
+        virtual metaio::IUnifeyeMobileGeometry* getGeometryFromScreenCoordinates( int x, int y, bool useTriangleTest ) { return 0; }
+        virtual metaio::Vector2d getScreenCoordinatesFrom3DPosition( int cosID, const metaio::Vector3d& point ) { return metaio::Vector2d(); }
+        virtual metaio::Vector3d get3DPositionFromScreenCoordinates( int cosID, const metaio::Vector2d& point ) { return metaio::Vector3d(); }
+        virtual void setLLAObjectRenderingLimits( int nearLimit, int farLimit ) {}
+        virtual metaio::IUnifeyeBillboardGroup* createBillboardGroup( float nearValue, float farValue ) { return 0; }
+        virtual metaio::IUnifeyeMobileGeometry* loadImageBillboard( const std::string& texturePath ) { return 0; }
+        virtual metaio::IUnifeyeMobileGeometry* loadImageBillboard( const std::string& textureName, const metaio::ImageStruct& image ) { return 0; }
+        virtual void registerCallback( metaio::IUnifeyeMobileCallback* callback ) {}
+        virtual bool loadEnvironmentMap( const std::string& folder ) { return false; }
+        virtual void pauseAllMovieTextures() {}
+
+    private:
+        unsigned int crcTable[256];
+
+        static unsigned int readBigEndian( const unsigned char* data )
+        {
+            return ((unsigned int)data[0] << 24) | ((unsigned int)data[1] << 16) | ((unsigned int)data[2] << 8) | data[3];
+        }
+
+        // signature, IHDR, one IDAT of stored blocks, IEND
+        bool decode( const std::vector<unsigned char>& png )
+        {
+            static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+            if (png.size() < 8 || memcmp(&png[0], signature, 8) != 0)
+                return false;
+
+            std::vector<unsigned char> zlib;
+            size_t at = 8;
+            bool end = false;
+            while (!end && at + 12 <= png.size())
+            {
+                unsigned int length = readBigEndian(&png[at]);
+                if (at + 12 + length > png.size())
+                    return false;
+                const unsigned char* type = &png[at + 4];
+                const unsigned char* data = &png[at + 8];
+
+                unsigned int crc = 0xffffffffU;
+                for (unsigned int i = 0; i < length + 4; i++)
+                    crc = crcTable[(crc ^ type[i]) & 0xff] ^ (crc >> 8);
+                if ((crc ^ 0xffffffffU) != readBigEndian(data + length))
+                    return false;
+
+                if (memcmp(type, "IHDR", 4) == 0)
+                {
+                    if (length != 13 || data[8] != 8 || data[9] != 2 || data[12] != 0)
+                        return false;
+                    width = (int)readBigEndian(data);
+                    height = (int)readBigEndian(data + 4);
+                }
+                else if (memcmp(type, "IDAT", 4) == 0)
+                    zlib.insert(zlib.end(), data, data + length);
+                else if (memcmp(type, "IEND", 4) == 0)
+                    end = true;
+                at += 12 + length;
+            }
+            if (!end || zlib.size() < 6 || zlib[0] != 0x78)
+                return false;
+
+            // stored blocks only
+            std::vector<unsigned char> rows;
+            size_t in = 2;
+            bool last = false;
+            while (!last)
+            {
+                if (in + 5 > zlib.size() || (zlib[in] & 6) != 0)
+                    return false;
+                last = (zlib[in] & 1) != 0;
+                unsigned int size = zlib[in + 1] | (zlib[in + 2] << 8);
+                unsigned int inverse = zlib[in + 3] | (zlib[in + 4] << 8);
+                if ((size ^ 0xffff) != inverse || in + 5 + size > zlib.size())
+                    return false;
+                rows.insert(rows.end(), zlib.begin() + in + 5, zlib.begin() + in + 5 + size);
+                in += 5 + size;
+            }
+
+            unsigned int a = 1, b = 0;
+            for (size_t i = 0; i < rows.size(); i++)
+            {
+                a = (a + rows[i]) % 65521;
+                b = (b + a) % 65521;
+            }
+            size_t rowSize = (size_t)width * 3;
+            if (in + 4 != zlib.size() || readBigEndian(&zlib[in]) != ((b << 16) | a) || rows.size() != (rowSize + 1) * height)
+                return false;
+
+            image.resize(rowSize * height);
+            for (int y = 0; y < height; y++)
+            {
+                if (rows[(rowSize + 1) * y] != 0)
+                    return false;
+                memcpy(&image[rowSize * y], &rows[(rowSize + 1) * y + 1], rowSize);
+            }
+            return true;
+        }
+    };
+}
+
+#endif
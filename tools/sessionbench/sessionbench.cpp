@@ -0,0 +1,567 @@
+//
+//  sessionbench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  Size, speed and correctness of session recording and replay:
+//
+//      sessionbench [session.uses]
+//
+//  Records a synthetic session: ten seconds of 480x360 camera frames, half
+//  ARGB and half YUV420SP, a mostly still scene with a moving square and
+//  sensor noise, plus accelerometer, compass, LLA and poses. Then checks
+//  that replay delivers every record unchanged and in order, from the
+//  start, after a seek and from a file that was cut off before the index.
+//  Replay is timed as fast as possible and paced by a simulated 60 Hz
+//  clock, and once through UnifeyeSessionSink into a stub IUnifeyeMobile
+//  that reads the PNG files back. The session is written to the given
+//  file, by default to /tmp. The cost of recordCameraFrame is its CPU time
+//  on the calling thread, the encoding runs on the thread of the recorder;
+//  a burst of frames faster than they are encoded must drop frames, not
+//  block. Exits with 1 if a check fails.
+//
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include "SessionRecorder.h"
+#include "SessionPlayer.h"
+#include "ColorConvert.h"
+#include "ImageFormat.h"
+#include "StubUnifeyeMobile.h"
+
+using namespace unifeye;
+
+namespace
+{
+    const int WIDTH = 480;
+    const int HEIGHT = 360;
+    const int FRAMES = 300;
+    const double FRAME_RATE = 30.0;
+    const int KEY_FRAME_INTERVAL = 30;
+
+    // an arbitrary clock the recorder makes relative
+    const double CLOCK_START = 12345.5;
+
+    int failures = 0;
+
+    double now()
+    {
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec + time.tv_nsec * 1e-9;
+    }
+
+    // CPU time of the calling thread, without the time the writer thread runs on the same core
+    double threadTime()
+    {
+        struct timespec time;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+        return time.tv_sec + time.tv_nsec * 1e-9;
+    }
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    unsigned long long hashBytes( const void* data, size_t size, unsigned long long hash = 14695981039346656037ULL )
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        return hash;
+    }
+
+    // deterministic noise, so any frame can be made again
+    inline unsigned int noise( unsigned int x, unsigned int y, unsigned int frame )
+    {
+        unsigned int h = x * 73856093U ^ y * 19349663U ^ frame * 83492791U;
+        h ^= h >> 13;
+        h *= 0x5bd1e995U;
+        return h ^ (h >> 15);
+    }
+
+    // a textured background that pans by a pixel every fourth frame and a square moving across it
+    unsigned char scene( int x, int y, int frame, int channel )
+    {
+        int u = x + frame / 4;
+        int value = 96 + (int)(48 * sin(u * 0.05 + channel) * cos(y * 0.04)) + ((u / 16 + y / 16) & 1) * 24;
+        int squareX = (frame * 3) % (WIDTH - 60);
+        if (x >= squareX && x < squareX + 60 && y >= 150 && y < 210)
+            value = 200 - channel * 40;
+
+        // a quarter of the bytes are one off, as from a camera sensor
+        unsigned int n = noise(x * 4 + channel, y, frame) & 7;
+        if (n == 0)
+            value++;
+        else if (n == 1)
+            value--;
+        return (unsigned char)(value < 0 ? 0 : value > 255 ? 255 : value);
+    }
+
+    metaio::common::ECOLOR_FORMAT getFormat( int frame )
+    {
+        return frame < FRAMES / 2 ? metaio::common::ECF_A8R8G8B8 : metaio::common::ECF_YUV420SP;
+    }
+
+    void makeFrame( int frame, std::vector<unsigned char>& pixels )
+    {
+        metaio::common::ECOLOR_FORMAT format = getFormat(frame);
+        pixels.resize(getImageBufferSize(format, WIDTH, HEIGHT));
+        if (format == metaio::common::ECF_A8R8G8B8)
+        {
+            for (int y = 0; y < HEIGHT; y++)
+            {
+                for (int x = 0; x < WIDTH; x++)
+                {
+                    unsigned char* p = &pixels[(y * WIDTH + x) * 4];
+                    p[0] = 255;
+                    for (int c = 0; c < 3; c++)
+                        p[c + 1] = scene(x, y, frame, c);
+                }
+            }
+        }
+        else
+        {
+            for (int y = 0; y < HEIGHT; y++)
+                for (int x = 0; x < WIDTH; x++)
+                    pixels[y * WIDTH + x] = scene(x, y, frame, 0);
+            unsigned char* uv = &pixels[WIDTH * HEIGHT];
+            for (int y = 0; y < HEIGHT / 2; y++)
+            {
+                for (int x = 0; x < WIDTH / 2; x++)
+                {
+                    uv[(y * WIDTH / 2 + x) * 2] = (unsigned char)(128 + scene(x * 2, y * 2, frame, 1) / 8);
+                    uv[(y * WIDTH / 2 + x) * 2 + 1] = (unsigned char)(128 - scene(x * 2, y * 2, frame, 2) / 8);
+                }
+            }
+        }
+    }
+
+    enum EVENT
+    {
+        EVENT_FRAME,
+        EVENT_LLA,
+        EVENT_ACCELEROMETER,
+        EVENT_COMPASS,
+        EVENT_POSES
+    };
+
+    struct Event
+    {
+        int type;
+        double time;                // relative to the start of the session
+        unsigned long long hash;    // of the payload
+    };
+
+    bool operator==( const Event& a, const Event& b )
+    {
+        return a.type == b.type && a.time == b.time && a.hash == b.hash;
+    }
+
+    unsigned long long hashFrame( const metaio::ImageStruct& frame )
+    {
+        int header[4] = { frame.width, frame.height, (int)frame.colorFormat, frame.originIsUpperLeft ? 1 : 0 };
+        return hashBytes(frame.buffer, getImageBufferSize(frame), hashBytes(header, sizeof(header)));
+    }
+
+    unsigned long long hashLLA( const metaio::LLACoordinate& lla )
+    {
+        double values[4] = { lla.latitude, lla.longitude, lla.altitude, lla.accuracy };
+        return hashBytes(values, sizeof(values));
+    }
+
+    unsigned long long hashVector( const metaio::Vector3d& v )
+    {
+        float values[3] = { v.x, v.y, v.z };
+        return hashBytes(values, sizeof(values));
+    }
+
+    unsigned long long hashPoses( const PoseSnapshot& poses )
+    {
+        unsigned long long hash = hashBytes(0, 0);
+        for (int i = 0; i < poses.getCount(); i++)
+        {
+            float values[8] = { poses.tx[i], poses.ty[i], poses.tz[i], poses.qx[i], poses.qy[i], poses.qz[i], poses.qw[i],
+                poses.quality[i] };
+            hash = hashBytes(values, sizeof(values), hashBytes(&poses.cosID[i], sizeof(int), hash));
+        }
+        return hash;
+    }
+
+    // what replay delivered
+    class RecordingSink : public ISessionSink
+    {
+    public:
+        std::vector<Event> events;
+
+        void add( int type, double time, unsigned long long hash )
+        {
+            Event event = { type, time, hash };
+            events.push_back(event);
+        }
+
+        virtual void onCameraFrame( const metaio::ImageStruct& frame, double timestamp ) { add(EVENT_FRAME, timestamp, hashFrame(frame)); }
+        virtual void onSensorLLA( const metaio::LLACoordinate& position, double timestamp ) { add(EVENT_LLA, timestamp, hashLLA(position)); }
+        virtual void onAccelerometer( const metaio::Vector3d& values, double timestamp ) { add(EVENT_ACCELEROMETER, timestamp, hashVector(values)); }
+        virtual void onCompassAngle( float angle, double timestamp ) { add(EVENT_COMPASS, timestamp, hashBytes(&angle, sizeof(angle))); }
+        virtual void onPoses( const PoseSnapshot& poses ) { add(EVENT_POSES, poses.getTimestamp(), hashPoses(poses)); }
+    };
+
+    // touches the frames without keeping them, for the throughput
+    class CountingSink : public ISessionSink
+    {
+    public:
+        CountingSink() : records(0), checksum(0) {};
+        unsigned long records;
+        unsigned int checksum;
+
+        virtual void onCameraFrame( const metaio::ImageStruct& frame, double timestamp ) { records++; checksum += frame.buffer[frame.width]; }
+        virtual void onSensorLLA( const metaio::LLACoordinate& position, double timestamp ) { records++; }
+        virtual void onAccelerometer( const metaio::Vector3d& values, double timestamp ) { records++; }
+        virtual void onCompassAngle( float angle, double timestamp ) { records++; }
+        virtual void onPoses( const PoseSnapshot& poses ) { records++; }
+    };
+
+    // the session as recorded; time is relative like the recorder stores it
+    struct Session
+    {
+        std::vector<Event> events;
+        std::vector<size_t> frameEvents;        // index in events of every frame
+        double recordSeconds;                   // in recordCameraFrame
+        double encodeSeconds;                   // until the writer thread wrote the frame
+        unsigned long long rawBytes;
+    };
+
+    double relative( double timestamp )
+    {
+        return timestamp - CLOCK_START;
+    }
+
+    void recordAccelerometer( SessionRecorder& recorder, Session& session, int frame, int k, double t )
+    {
+        metaio::Vector3d values(0.01f * (float)sin(t * 3), -0.98f + 0.005f * (float)(noise(frame, k, 1) & 3), 0.1f);
+        recorder.recordAccelerometer(values, t);
+        Event event = { EVENT_ACCELEROMETER, relative(t), hashVector(values) };
+        session.events.push_back(event);
+    }
+
+    bool record( const std::string& path, Session& session )
+    {
+        SessionRecorder recorder;
+        if (!recorder.open(path, KEY_FRAME_INTERVAL))
+            return false;
+
+        session.recordSeconds = 0;
+        session.encodeSeconds = 0;
+        session.rawBytes = 0;
+        std::vector<unsigned char> pixels;
+        PoseSnapshot poses;
+        std::vector<metaio::Pose> poseList(2);
+        for (int frame = 0; frame < FRAMES; frame++)
+        {
+            double t = CLOCK_START + frame / FRAME_RATE;
+
+            // the accelerometer at 60 Hz, the compass at 30 Hz and a GPS fix every second
+            recordAccelerometer(recorder, session, frame, 0, t);
+            float angle = 90.0f + 10.0f * (float)sin(t);
+            recorder.recordCompassAngle(angle, t + 0.002);
+            Event compass = { EVENT_COMPASS, relative(t + 0.002), hashBytes(&angle, sizeof(angle)) };
+            session.events.push_back(compass);
+            if (frame % 30 == 5)
+            {
+                metaio::LLACoordinate lla(48.137 + frame * 1e-6, 11.575, 520.0, 5.0);
+                recorder.recordSensorLLA(lla, t + 0.003);
+                Event event = { EVENT_LLA, relative(t + 0.003), hashLLA(lla) };
+                session.events.push_back(event);
+            }
+
+            makeFrame(frame, pixels);
+            metaio::ImageStruct image(&pixels[0], WIDTH, HEIGHT, getFormat(frame), true);
+            // waiting for the writer after every frame keeps it from dropping any
+            recorder.flush();
+            double start = now(), startThread = threadTime();
+            recorder.recordCameraFrame(image, t + 0.005);
+            session.recordSeconds += threadTime() - startThread;
+            recorder.flush();
+            session.encodeSeconds += now() - start;
+            session.rawBytes += pixels.size();
+            Event event = { EVENT_FRAME, relative(t + 0.005), hashFrame(image) };
+            session.frameEvents.push_back(session.events.size());
+            session.events.push_back(event);
+            recordAccelerometer(recorder, session, frame, 1, t + 1 / (2 * FRAME_RATE));
+
+            // two coordinate systems, one of them lost now and then
+            for (int i = 0; i < 2; i++)
+            {
+                float phase = frame * 0.02f + i;
+                poseList[i] = metaio::Pose(10.0f * sinf(phase), 5.0f * i, -300.0f, 0, sinf(phase / 2), 0, cosf(phase / 2),
+                    (frame + i) % 50 == 0 ? 0.0f : 0.9f, i + 1);
+            }
+            poses.update(poseList, t + 0.02);
+            recorder.recordPoses(poses);
+            Event posesEvent = { EVENT_POSES, relative(t + 0.02), hashPoses(poses) };
+            session.events.push_back(posesEvent);
+        }
+
+        bool closed = recorder.close();
+        SessionRecorderStats stats = recorder.getStats();
+        printf("recorded        %8lu frames, %lu key frames, %lu sensor values, %lu poses\n", stats.frames, stats.keyFrames,
+            stats.sensorRecords, stats.poseRecords);
+        return closed && stats.frames == (unsigned long)FRAMES && stats.droppedFrames == 0 && stats.droppedRecords == 0;
+    }
+
+    // frames as fast as they can be copied, into two slots
+    bool recordBurst( const std::string& path, int frames, SessionRecorderStats& stats, double& seconds )
+    {
+        SessionRecorder recorder(2);
+        if (!recorder.open(path, KEY_FRAME_INTERVAL))
+            return false;
+
+        std::vector<unsigned char> pixels;
+        makeFrame(0, pixels);
+        metaio::ImageStruct image(&pixels[0], WIDTH, HEIGHT, getFormat(0), true);
+        double start = threadTime();
+        for (int frame = 0; frame < frames; frame++)
+        {
+            pixels[frame] ^= 1;
+            recorder.recordCameraFrame(image, CLOCK_START + frame / FRAME_RATE);
+        }
+        seconds = threadTime() - start;
+        bool closed = recorder.close();
+        stats = recorder.getStats();
+        return closed;
+    }
+
+    size_t getFileSize( const std::string& path )
+    {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file)
+            return 0;
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fclose(file);
+        return size > 0 ? (size_t)size : 0;
+    }
+
+    bool copyPrefix( const std::string& from, const std::string& to, size_t size )
+    {
+        std::vector<unsigned char> data(size);
+        FILE* in = fopen(from.c_str(), "rb");
+        if (!in)
+            return false;
+        bool ok = fread(&data[0], 1, size, in) == size;
+        fclose(in);
+        FILE* out = fopen(to.c_str(), "wb");
+        if (!out)
+            return false;
+        ok = ok && fwrite(&data[0], 1, size, out) == size;
+        return fclose(out) == 0 && ok;
+    }
+
+    // the expected events after a seek: the sensor values at the key frame, then everything from it on
+    std::vector<Event> expectAfterSeek( const Session& session, size_t frameEvent )
+    {
+        std::vector<Event> expected;
+        const int sensors[3] = { EVENT_LLA, EVENT_ACCELEROMETER, EVENT_COMPASS };
+        for (int s = 0; s < 3; s++)
+        {
+            for (size_t i = frameEvent; i-- > 0;)
+            {
+                if (session.events[i].type == sensors[s])
+                {
+                    Event state = session.events[i];
+                    state.time = session.events[frameEvent].time;
+                    expected.push_back(state);
+                    break;
+                }
+            }
+        }
+        expected.insert(expected.end(), session.events.begin() + frameEvent, session.events.end());
+        return expected;
+    }
+}
+
+int main( int argc, char** argv )
+{
+    std::string path = argc > 1 ? argv[1] : "/tmp/sessionbench.uses";
+    std::string truncatedPath = path + ".truncated";
+
+    Session session;
+    check("session recorded", record(path, session));
+    size_t fileSize = getFileSize(path);
+    printf("file            %8.2f MB of %.2f MB frames, %.1f : 1\n", fileSize / 1048576.0, session.rawBytes / 1048576.0,
+        (double)session.rawBytes / fileSize);
+    printf("encode          %8.1f MB/s, %.2f ms per frame\n", session.rawBytes / 1048576.0 / session.encodeSeconds,
+        session.encodeSeconds * 1e3 / FRAMES);
+    printf("record call     %8.3f ms per frame on the calling thread\n\n", session.recordSeconds * 1e3 / FRAMES);
+    check("frames compress at least 2 : 1", fileSize * 2 < session.rawBytes);
+
+    // everything in order, bit exact
+    SessionPlayer player;
+    check("session opened with its index", player.open(path) && player.hasIndex());
+    check("duration is the last record", fabs(player.getDuration() - session.events.back().time) < 1e-12);
+    check("a key frame every interval and at the format change",
+        player.getKeyFrameCount() == FRAMES / KEY_FRAME_INTERVAL);
+    RecordingSink sink;
+    while (player.next(sink))
+        ;
+    check("replay delivers every record unchanged and in order", sink.events == session.events);
+    check("no frames skipped", player.getStats().skippedFrames == 0);
+
+    // as fast as possible
+    CountingSink counting;
+    double start = now();
+    const int ROUNDS = 3;
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        player.rewind();
+        while (player.next(counting))
+            ;
+    }
+    double seconds = (now() - start) / ROUNDS;
+    printf("\nreplay          %8.1f MB/s, %.2f ms per frame, %.0fx real time\n", session.rawBytes / 1048576.0 / seconds,
+        seconds * 1e3 / FRAMES, player.getDuration() / seconds);
+    check("all records counted", counting.records == ROUNDS * session.events.size());
+
+    // seeking lands on the key frame before and restates the sensors
+    const double seekTimes[3] = { 0.0, 4.99, 7.5 };
+    bool seekOk = true;
+    for (int s = 0; s < 3; s++)
+    {
+        size_t frame = 0;
+        for (size_t i = 0; i < session.frameEvents.size(); i++)
+        {
+            bool keyFrame = i % KEY_FRAME_INTERVAL == 0;
+            if (keyFrame && session.events[session.frameEvents[i]].time <= seekTimes[s])
+                frame = i;
+        }
+        RecordingSink seekSink;
+        seekOk = seekOk && player.seek(seekTimes[s]);
+        while (player.next(seekSink))
+            ;
+        std::vector<Event> expected = expectAfterSeek(session, session.frameEvents[frame]);
+        printf("seek %5.2f s    %8s key frame %d at %.3f s, %lu records\n", seekTimes[s], "", (int)frame,
+            session.events[session.frameEvents[frame]].time, (unsigned long)seekSink.events.size());
+        seekOk = seekOk && seekSink.events == expected;
+    }
+    check("seek restates the sensors and continues exactly", seekOk);
+
+    // paced by a 60 Hz clock, every record in the tick it is due
+    player.rewind();
+    RecordingSink paced;
+    bool timely = true;
+    int ticks = 0;
+    for (double previous = -1.0; !player.isFinished(); ticks++)
+    {
+        double t = ticks / 60.0;
+        size_t before = paced.events.size();
+        player.advance(paced, t);
+        for (size_t i = before; i < paced.events.size(); i++)
+            timely = timely && paced.events[i].time <= t && paced.events[i].time > previous;
+        previous = t;
+    }
+    printf("\nreal time       %8d ticks of 60 Hz for %.2f s\n", ticks, player.getDuration());
+    check("real time replay delivers every record", paced.events == session.events);
+    check("real time replay delivers records when due", timely);
+
+    // the app was killed: no index, the last record cut off
+    player.close();
+    size_t cut = fileSize - sizeof(SessionFileFooter) - sizeof(SessionRecordHeader) -
+        (FRAMES / KEY_FRAME_INTERVAL) * sizeof(SessionIndexEntry) - 10;
+    check("truncated copy written", copyPrefix(path, truncatedPath, cut));
+    SessionPlayer truncated;
+    bool opened = truncated.open(truncatedPath);
+    check("truncated session opened by scanning", opened && !truncated.hasIndex());
+    check("scanning finds every key frame", truncated.getKeyFrameCount() == FRAMES / KEY_FRAME_INTERVAL);
+    RecordingSink truncatedSink;
+    while (truncated.next(truncatedSink))
+        ;
+    bool prefix = truncatedSink.events.size() == session.events.size() - 1;
+    for (size_t i = 0; prefix && i < truncatedSink.events.size(); i++)
+        prefix = truncatedSink.events[i] == session.events[i];
+    check("truncated session replays all complete records", prefix);
+    RecordingSink truncatedSeek;
+    check("truncated session seeks", truncated.seek(5.5));
+    while (truncated.next(truncatedSeek))
+        ;
+    std::vector<Event> expected = expectAfterSeek(session, session.frameEvents[150]);
+    expected.pop_back();
+    check("truncated session seeks exactly", truncatedSeek.events == expected);
+    truncated.close();
+    remove(truncatedPath.c_str());
+
+    // into the SDK interface, each frame as PNG file
+    StubUnifeyeMobile stub;
+    std::string imagePath = path + ".png";
+    UnifeyeSessionSink unifeyeSink(&stub, imagePath);
+    player.open(path);
+    std::vector<unsigned char> pixels, rgb(WIDTH * HEIGHT * 3);
+    bool images = true;
+    int frame = 0;
+    double sdkSeconds = 0;
+    while (!player.isFinished())
+    {
+        double before = now();
+        unsigned long sources = stub.imageSources;
+        player.next(unifeyeSink);
+        sdkSeconds += now() - before;
+        if (stub.imageSources == sources)
+            continue;
+
+        // the PNG must hold exactly the recorded frame
+        makeFrame(frame, pixels);
+        metaio::ImageStruct src(&pixels[0], WIDTH, HEIGHT, getFormat(frame), true);
+        metaio::ImageStruct dst(&rgb[0], WIDTH, HEIGHT, metaio::common::ECF_R8G8B8, true);
+        convertImage(src, dst);
+        images = images && stub.width == WIDTH && stub.height == HEIGHT && stub.image == rgb;
+        frame++;
+    }
+    remove(imagePath.c_str());
+    printf("\nsdk replay      %8.2f ms per frame through PNG files\n", sdkSeconds * 1e3 / FRAMES);
+    check("every frame reaches setImageSource as valid PNG", stub.imageSources == (unsigned long)FRAMES &&
+        stub.invalidImages == 0 && frame == FRAMES);
+    check("the PNG files hold the recorded frames", images);
+    unsigned long accelerometers = 0, compasses = 0, llas = 0;
+    for (size_t i = 0; i < session.events.size(); i++)
+    {
+        accelerometers += session.events[i].type == EVENT_ACCELEROMETER;
+        compasses += session.events[i].type == EVENT_COMPASS;
+        llas += session.events[i].type == EVENT_LLA;
+    }
+    check("every sensor value reaches the SDK", stub.accelerometerCalls == accelerometers &&
+        stub.compassCalls == compasses && stub.llaCalls == llas);
+    check("recorded poses kept for comparison", unifeyeSink.getRecordedPoses().getCount() == 2);
+
+    // the writer can not keep up, frames are dropped and the file stays consistent
+    const int BURST = 60;
+    SessionRecorderStats burst;
+    double burstSeconds = 0;
+    std::string burstPath = path + ".burst";
+    check("burst recorded", recordBurst(burstPath, BURST, burst, burstSeconds));
+    printf("\nburst           %8lu of %d frames recorded, %lu dropped, %.3f ms per call\n", burst.frames, BURST,
+        burst.droppedFrames, burstSeconds * 1e3 / BURST);
+    check("every burst frame recorded or counted as dropped", burst.frames + burst.droppedFrames == (unsigned long)BURST);
+    SessionPlayer burstPlayer;
+    CountingSink burstSink;
+    bool burstOpened = burstPlayer.open(burstPath);
+    while (burstPlayer.next(burstSink))
+        ;
+    check("the burst replays the recorded frames", burstOpened && burstSink.records == burst.frames);
+    burstPlayer.close();
+    remove(burstPath.c_str());
+
+    if (failures > 0)
+    {
+        printf("\n%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,305 @@
+//
+//  snapshotbench.cpp
+//  Unifeye TiModule
+//
+//  Copyright (c) 2012 by Otiga
+//
+//  PoseSnapshot against polling std::vector<metaio::Pose>:
+//
+//      snapshotbench
+//
+//  First on one thread: three consumers per frame (culling, overlays and
+//  the bridge) either each ask the SDK for the poses and compute their
+//  matrices, or read one snapshot filled once per frame. Then under
+//  contention: the render thread publishes every frame to reader threads
+//  that copy the latest poses as fast as they can, once as a snapshot and
+//  once as a vector of poses, behind the same mutex. Prints the time and
+//  the heap allocations per frame and the time the render thread waits to
+//  publish. The standard library here keeps the "empty" additionalValues
+//  of a pose inline, so the allocations counted for the vector are a lower
+//  bound for the device. Exits with 1 if a check fails.
+//
+#include <math.h>
+#include <new>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+#include <UnifeyeSDKMobile/AS_MobileStructs.h>
+
+#include "PoseSnapshot.h"
+#include "Threading.h"
+#include "VectorMath.h"
+
+using namespace unifeye;
+
+// every heap allocation is counted, per thread; not inlined so the compiler
+// does not pair the malloc and free with the new and delete of the callers
+namespace
+{
+    __thread int allocations = 0;
+}
+
+__attribute__((noinline)) void* operator new( size_t size ) throw(std::bad_alloc)
+{
+    allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+__attribute__((noinline)) void operator delete( void* p ) throw()
+{
+    free(p);
+}
+
+__attribute__((noinline)) void* operator new[]( size_t size ) throw(std::bad_alloc)
+{
+    return operator new(size);
+}
+
+__attribute__((noinline)) void operator delete[]( void* p ) throw()
+{
+    operator delete(p);
+}
+
+namespace
+{
+    const int CONSUMERS = 3;
+
+    int failures = 0;
+
+    void check( const char* name, bool ok )
+    {
+        printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+        if (!ok)
+            failures++;
+    }
+
+    double now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    // what getValidTrackingValues() hands out, a new vector every call
+    std::vector<metaio::Pose> getValidTrackingValues( int count, int frame )
+    {
+        std::vector<metaio::Pose> poses(count);
+        for (int i = 0; i < count; i++)
+        {
+            float angle = 0.01f * (frame + i);
+            poses[i].cosID = i + 1;
+            poses[i].translation = metaio::Vector3d((float)frame, 10.0f * i, 500.0f);
+            poses[i].rotation = metaio::Vector4d(0.0f, sinf(angle), 0.0f, cosf(angle));
+            poses[i].quality = 0.9f;
+        }
+        return poses;
+    }
+
+    float sink = 0;
+
+    struct Cost
+    {
+        double time;            // seconds per frame
+        double allocations;     // per frame
+    };
+
+    Cost pollEveryConsumer( int count, int frames )
+    {
+        int before = allocations;
+        double start = now();
+        for (int frame = 0; frame < frames; frame++)
+        {
+            for (int c = 0; c < CONSUMERS; c++)
+            {
+                std::vector<metaio::Pose> poses = getValidTrackingValues(count, frame);
+                float matrix[16];
+                for (size_t i = 0; i < poses.size(); i++)
+                {
+                    quaternionToMatrix(poses[i].rotation, poses[i].translation, matrix);
+                    sink += matrix[12];
+                }
+            }
+        }
+        Cost cost = { (now() - start) / frames, (double)(allocations - before) / frames };
+        return cost;
+    }
+
+    Cost readSnapshot( int count, int frames, double& consumerAllocations )
+    {
+        PoseSnapshot snapshot;
+        int before = allocations;
+        int consumers = 0;
+        double start = now();
+        for (int frame = 0; frame < frames; frame++)
+        {
+            snapshot.update(getValidTrackingValues(count, frame), frame / 60.0);
+
+            int reading = allocations;
+            for (int c = 0; c < CONSUMERS; c++)
+            {
+                for (int i = 0; i < snapshot.getCount(); i++)
+                    sink += snapshot.getMatrix(i)[12];
+            }
+            consumers += allocations - reading;
+        }
+        Cost cost = { (now() - start) / frames, (double)(allocations - before) / frames };
+        consumerAllocations = (double)consumers / frames;
+        return cost;
+    }
+
+    // the latest poses behind a mutex, as either representation
+    struct Shared
+    {
+        Mutex mutex;
+        PoseSnapshot snapshot;
+        std::vector<metaio::Pose> poses;
+        volatile int done;
+    };
+
+    struct Reader
+    {
+        Shared* shared;
+        bool snapshot;
+        unsigned long copies;
+        unsigned long torn;         // poses of different frames in one copy
+        int allocated;
+
+        static void* run( void* argument )
+        {
+            Reader* self = static_cast<Reader*>(argument);
+            PoseSnapshot snapshot;
+            std::vector<metaio::Pose> poses;
+            int before = allocations;
+            while (!atomicLoad(&self->shared->done))
+            {
+                {
+                    ScopedLock lock(self->shared->mutex);
+                    if (self->snapshot)
+                        snapshot = self->shared->snapshot;
+                    else
+                        poses = self->shared->poses;
+                }
+                self->copies++;
+
+                int count = self->snapshot ? snapshot.getCount() : (int)poses.size();
+                for (int i = 1; i < count; i++)
+                {
+                    float first = self->snapshot ? snapshot.tx[0] : poses[0].translation.x;
+                    float other = self->snapshot ? snapshot.tx[i] : poses[i].translation.x;
+                    if (first != other)
+                        self->torn++;
+                }
+            }
+            self->allocated = allocations - before;
+            return 0;
+        }
+    };
+
+    void contention( bool useSnapshot, int count, int readers, int frames )
+    {
+        Shared shared;
+        shared.done = 0;
+        std::vector<Reader> state(readers);
+        std::vector<pthread_t> threads(readers);
+        for (int i = 0; i < readers; i++)
+        {
+            state[i].shared = &shared;
+            state[i].snapshot = useSnapshot;
+            state[i].copies = 0;
+            state[i].torn = 0;
+            state[i].allocated = 0;
+            pthread_create(&threads[i], 0, Reader::run, &state[i]);
+        }
+
+        // the render thread: the SDK's poses, then publish them
+        PoseSnapshot snapshot;
+        std::vector<double> waits;
+        waits.reserve(frames);
+        double start = now();
+        for (int frame = 0; frame < frames; frame++)
+        {
+            std::vector<metaio::Pose> poses = getValidTrackingValues(count, frame);
+            if (useSnapshot)
+                snapshot.update(poses, frame / 60.0);
+
+            double publish = now();
+            {
+                ScopedLock lock(shared.mutex);
+                if (useSnapshot)
+                    shared.snapshot = snapshot;
+                else
+                    shared.poses = poses;
+            }
+            waits.push_back(now() - publish);
+        }
+        double elapsed = now() - start;
+        atomicStore(&shared.done, 1);
+
+        unsigned long copies = 0, torn = 0;
+        int readerAllocations = 0;
+        for (int i = 0; i < readers; i++)
+        {
+            pthread_join(threads[i], 0);
+            copies += state[i].copies;
+            torn += state[i].torn;
+            readerAllocations += state[i].allocated;
+        }
+
+        std::sort(waits.begin(), waits.end());
+        printf("%-9s %2d poses %d readers: publish p50 %6.2f p99 %6.2f max %7.2f us, %8.0f copies/s, %6.2f allocations per copy\n",
+               useSnapshot ? "snapshot" : "vector", count, readers, waits[waits.size() / 2] * 1e6,
+               waits[waits.size() * 99 / 100] * 1e6, waits.back() * 1e6, copies / elapsed,
+               copies ? (double)readerAllocations / copies : 0.0);
+
+        char label[64];
+        snprintf(label, sizeof(label), "%s copies are consistent", useSnapshot ? "snapshot" : "vector");
+        check(label, torn == 0);
+        if (useSnapshot)
+            check("snapshot readers do not allocate", readerAllocations == 0);
+    }
+}
+
+int main()
+{
+    const int frames = 20000;
+    const int counts[] = { 1, 4, 16 };
+
+    printf("%d consumers per frame\n", CONSUMERS);
+    printf("%-6s %16s %16s %16s %16s\n", "poses", "polling", "allocations", "snapshot", "allocations");
+    for (int c = 0; c < 3; c++)
+    {
+        double consumerAllocations = 0;
+        Cost polling = pollEveryConsumer(counts[c], frames);
+        Cost snapshot = readSnapshot(counts[c], frames, consumerAllocations);
+        printf("%-6d %13.3f us %16.1f %13.3f us %16.1f\n", counts[c], polling.time * 1e6, polling.allocations,
+               snapshot.time * 1e6, snapshot.allocations);
+
+        char label[64];
+        snprintf(label, sizeof(label), "%d poses: consumers read without allocating", counts[c]);
+        check(label, consumerAllocations == 0);
+        snprintf(label, sizeof(label), "%d poses: one SDK call per frame", counts[c]);
+        check(label, snapshot.allocations * CONSUMERS <= polling.allocations + 0.01);
+    }
+
+    printf("\n");
+    contention(false, 4, 3, frames);
+    contention(true, 4, 3, frames);
+    contention(false, 16, 3, frames);
+    contention(true, 16, 3, frames);
+
+    if (sink == 12345.0f)
+        printf("\n");
+
+    if (failures)
+    {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}